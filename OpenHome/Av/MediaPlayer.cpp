@@ -38,9 +38,11 @@ MediaPlayer::MediaPlayer(Net::DvStack& aDvStack, Net::DvDeviceStandard& aDevice,
                          VolumeConsumer& aVolumeConsumer, IVolumeProfile& aVolumeProfile,
                          const Brx& aEntropy,
                          const Brx& aDefaultRoom,
-                         const Brx& aDefaultName)
+                         const Brx& aDefaultName,
+                         TUint aPlaylistMaxTracks)
     : iDvStack(aDvStack)
     , iDevice(aDevice)
+    , iPlaylistMaxTracks(aPlaylistMaxTracks)
     , iReadWriteStore(aReadWriteStore)
     , iConfigProductRoom(nullptr)
     , iConfigProductName(nullptr)
@@ -48,7 +50,7 @@ MediaPlayer::MediaPlayer(Net::DvStack& aDvStack, Net::DvDeviceStandard& aDevice,
 {
     iInfoLogger = new AllocatorInfoLogger();
     iKvpStore = new KvpStore(aStaticDataSource);
-    iTrackFactory = new Media::TrackFactory(*iInfoLogger, kTrackCount);
+    iTrackFactory = new Media::TrackFactory(*iInfoLogger, kTrackCount + iPlaylistMaxTracks);
     iPipeline = new PipelineManager(aPipelineInitParams, *iInfoLogger, *iTrackFactory, aShell);
     iConfigManager = new Configuration::ConfigManager(iReadWriteStore);
     iPowerManager = new OpenHome::PowerManager(*iConfigManager);
@@ -115,6 +117,11 @@ void MediaPlayer::Add(Codec::CodecBase* aCodec)
     iPipeline->Add(aCodec);
 }
 
+void MediaPlayer::Add(Codec::CodecBase* aCodec, Codec::CodecBase* aCodecDecodeAhead)
+{
+    iPipeline->Add(aCodec, aCodecDecodeAhead);
+}
+
 void MediaPlayer::Add(Protocol* aProtocol)
 {
     iPipeline->Add(aProtocol);
@@ -190,6 +197,11 @@ Media::TrackFactory& MediaPlayer::TrackFactory()
     return *iTrackFactory;
 }
 
+TUint MediaPlayer::PlaylistMaxTracks() const
+{
+    return iPlaylistMaxTracks;
+}
+
 IReadStore& MediaPlayer::ReadStore()
 {
     return *iKvpStore;
@@ -73,6 +73,7 @@ public:
     virtual Media::IInfoAggregator& InfoAggregator() = 0;
     virtual Media::PipelineManager& Pipeline() = 0;
     virtual Media::TrackFactory& TrackFactory() = 0;
+    virtual TUint PlaylistMaxTracks() const = 0;
     virtual IReadStore& ReadStore() = 0;
     virtual Configuration::IStoreReadWrite& ReadWriteStore() = 0;
     virtual Configuration::IConfigManager& ConfigManager() = 0;
@@ -89,7 +90,9 @@ public:
 
 class MediaPlayer : public IMediaPlayer, private INonCopyable
 {
-    static const TUint kTrackCount = 1200;
+    static const TUint kTrackCount = 200; // for pipeline and non-playlist sources; aPlaylistMaxTracks are added to this
+public:
+    static const TUint kPlaylistMaxTracksDefault = 1000;
 public:
     MediaPlayer(Net::DvStack& aDvStack, Net::DvDeviceStandard& aDevice,
                 Net::IShell& aShell,
@@ -99,11 +102,13 @@ public:
                 VolumeConsumer& aVolumeConsumer, IVolumeProfile& aVolumeProfile,
                 const Brx& aEntropy,
                 const Brx& aDefaultRoom,
-                const Brx& aDefaultName);
+                const Brx& aDefaultName,
+                TUint aPlaylistMaxTracks = kPlaylistMaxTracksDefault); // every playlist track holds a preallocated Track
     ~MediaPlayer();
     void Quit();
     void Add(Media::Codec::ContainerBase* aContainer);
     void Add(Media::Codec::CodecBase* aCodec);
+    void Add(Media::Codec::CodecBase* aCodec, Media::Codec::CodecBase* aCodecDecodeAhead);
     void Add(Media::Protocol* aProtocol);
     void Add(ISource* aSource);
     void Start();
@@ -114,6 +119,7 @@ public: // from IMediaPlayer
     Media::IInfoAggregator& InfoAggregator() override;
     Media::PipelineManager& Pipeline() override;
     Media::TrackFactory& TrackFactory() override;
+    TUint PlaylistMaxTracks() const override;
     IReadStore& ReadStore() override;
     Configuration::IStoreReadWrite& ReadWriteStore() override;
     Configuration::IConfigManager& ConfigManager() override;
@@ -133,6 +139,7 @@ private:
     KvpStore* iKvpStore;
     Media::PipelineManager* iPipeline;
     Media::TrackFactory* iTrackFactory;
+    const TUint iPlaylistMaxTracks;
     Configuration::IStoreReadWrite& iReadWriteStore;
     Configuration::ConfigManager* iConfigManager;
     OpenHome::PowerManager* iPowerManager;
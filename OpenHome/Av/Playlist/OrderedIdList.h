@@ -0,0 +1,290 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Private/Standard.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace OpenHome {
+namespace Av {
+
+/*
+ * Ordered sequence of items, each with a unique id (given by T::Id()).
+ *
+ * Lookup by id is O(1).  Insertion and removal at any position, finding the position of
+ * an id and finding the item at a position are all O(log n).  This allows playlists of
+ * 100k+ tracks to be edited without the linear scans a std::vector requires.
+ *
+ * Implemented as an implicit treap (a randomised balanced binary tree, ordered by position,
+ * with each node storing the size of its subtree) plus a hash map from id to tree node.
+ * Items are not reference counted; callers manage the lifetime of anything they insert.
+ */
+template <class T>
+class OrderedIdList : private INonCopyable
+{
+public:
+    OrderedIdList();
+    ~OrderedIdList();
+    TUint Size() const;
+    T* Find(TUint aId) const; // returns nullptr if aId isn't present
+    TBool TryIndexOf(TUint aId, TUint& aIndex) const;
+    T* At(TUint aIndex) const;
+    void Insert(TUint aIndex, T* aItem);
+    T* RemoveAt(TUint aIndex);
+    void Clear();
+    void ToVector(std::vector<T*>& aItems) const;
+    void Assign(const std::vector<T*>& aItems);
+private:
+    class Node
+    {
+    public:
+        Node(T* aItem, TUint aPriority)
+            : iItem(aItem), iLeft(nullptr), iRight(nullptr), iParent(nullptr), iSize(1), iPriority(aPriority)
+        {}
+    public:
+        T* iItem;
+        Node* iLeft;
+        Node* iRight;
+        Node* iParent;
+        TUint iSize;
+        TUint iPriority;
+    };
+private:
+    static TUint SizeOf(const Node* aNode);
+    static void Update(Node* aNode);
+    static void Split(Node* aNode, TUint aCount, Node*& aLeft, Node*& aRight);
+    static Node* Merge(Node* aLeft, Node* aRight);
+    static void AppendItems(const Node* aNode, std::vector<T*>& aItems);
+    TUint NextPriority();
+private:
+    Node* iRoot;
+    std::unordered_map<TUint, Node*> iNodes;
+    TUint iRandom;
+};
+
+// OrderedIdList
+
+template <class T>
+OrderedIdList<T>::OrderedIdList()
+    : iRoot(nullptr)
+    , iRandom(0x9e3779b9)
+{
+}
+
+template <class T>
+OrderedIdList<T>::~OrderedIdList()
+{
+    Clear();
+}
+
+template <class T>
+TUint OrderedIdList<T>::Size() const
+{
+    return SizeOf(iRoot);
+}
+
+template <class T>
+T* OrderedIdList<T>::Find(TUint aId) const
+{
+    auto it = iNodes.find(aId);
+    if (it == iNodes.end()) {
+        return nullptr;
+    }
+    return it->second->iItem;
+}
+
+template <class T>
+TBool OrderedIdList<T>::TryIndexOf(TUint aId, TUint& aIndex) const
+{
+    auto it = iNodes.find(aId);
+    if (it == iNodes.end()) {
+        return false;
+    }
+    // position is the number of nodes that precede this one in an in-order walk
+    const Node* node = it->second;
+    TUint index = SizeOf(node->iLeft);
+    while (node->iParent != nullptr) {
+        if (node == node->iParent->iRight) {
+            index += SizeOf(node->iParent->iLeft) + 1;
+        }
+        node = node->iParent;
+    }
+    aIndex = index;
+    return true;
+}
+
+template <class T>
+T* OrderedIdList<T>::At(TUint aIndex) const
+{
+    ASSERT(aIndex < Size());
+    const Node* node = iRoot;
+    for (;;) {
+        const TUint leftSize = SizeOf(node->iLeft);
+        if (aIndex < leftSize) {
+            node = node->iLeft;
+        }
+        else if (aIndex == leftSize) {
+            return node->iItem;
+        }
+        else {
+            aIndex -= leftSize + 1;
+            node = node->iRight;
+        }
+    }
+}
+
+template <class T>
+void OrderedIdList<T>::Insert(TUint aIndex, T* aItem)
+{
+    ASSERT(aIndex <= Size());
+    Node* node = new Node(aItem, NextPriority());
+    const bool inserted = iNodes.insert(std::make_pair(aItem->Id(), node)).second;
+    ASSERT(inserted);
+    Node* left;
+    Node* right;
+    Split(iRoot, aIndex, left, right);
+    iRoot = Merge(Merge(left, node), right);
+    iRoot->iParent = nullptr;
+}
+
+template <class T>
+T* OrderedIdList<T>::RemoveAt(TUint aIndex)
+{
+    ASSERT(aIndex < Size());
+    Node* left;
+    Node* mid;
+    Node* right;
+    Split(iRoot, aIndex, left, mid);
+    Split(mid, 1, mid, right);
+    iRoot = Merge(left, right);
+    if (iRoot != nullptr) {
+        iRoot->iParent = nullptr;
+    }
+    T* item = mid->iItem;
+    (void)iNodes.erase(item->Id());
+    delete mid;
+    return item;
+}
+
+template <class T>
+void OrderedIdList<T>::Clear()
+{
+    for (auto it=iNodes.begin(); it!=iNodes.end(); ++it) {
+        delete it->second;
+    }
+    iNodes.clear();
+    iRoot = nullptr;
+}
+
+template <class T>
+void OrderedIdList<T>::ToVector(std::vector<T*>& aItems) const
+{
+    aItems.clear();
+    aItems.reserve(Size());
+    AppendItems(iRoot, aItems);
+}
+
+template <class T>
+void OrderedIdList<T>::Assign(const std::vector<T*>& aItems)
+{
+    Clear();
+    for (TUint i=0; i<aItems.size(); i++) {
+        Insert(i, aItems[i]);
+    }
+}
+
+template <class T>
+TUint OrderedIdList<T>::SizeOf(const Node* aNode)
+{ // static
+    return (aNode == nullptr? 0 : aNode->iSize);
+}
+
+template <class T>
+void OrderedIdList<T>::Update(Node* aNode)
+{ // static
+    aNode->iSize = 1 + SizeOf(aNode->iLeft) + SizeOf(aNode->iRight);
+    if (aNode->iLeft != nullptr) {
+        aNode->iLeft->iParent = aNode;
+    }
+    if (aNode->iRight != nullptr) {
+        aNode->iRight->iParent = aNode;
+    }
+}
+
+template <class T>
+void OrderedIdList<T>::Split(Node* aNode, TUint aCount, Node*& aLeft, Node*& aRight)
+{ // static
+    // aLeft receives the first aCount nodes of aNode's subtree, aRight the remainder
+    if (aNode == nullptr) {
+        aLeft = aRight = nullptr;
+        return;
+    }
+    const TUint leftSize = SizeOf(aNode->iLeft);
+    if (aCount <= leftSize) {
+        Split(aNode->iLeft, aCount, aLeft, aNode->iLeft);
+        Update(aNode);
+        aRight = aNode;
+    }
+    else {
+        Split(aNode->iRight, aCount - leftSize - 1, aNode->iRight, aRight);
+        Update(aNode);
+        aLeft = aNode;
+    }
+    if (aLeft != nullptr) {
+        aLeft->iParent = nullptr;
+    }
+    if (aRight != nullptr) {
+        aRight->iParent = nullptr;
+    }
+}
+
+template <class T>
+typename OrderedIdList<T>::Node* OrderedIdList<T>::Merge(Node* aLeft, Node* aRight)
+{ // static
+    if (aLeft == nullptr) {
+        return aRight;
+    }
+    if (aRight == nullptr) {
+        return aLeft;
+    }
+    if (aLeft->iPriority > aRight->iPriority) {
+        aLeft->iRight = Merge(aLeft->iRight, aRight);
+        Update(aLeft);
+        return aLeft;
+    }
+    aRight->iLeft = Merge(aLeft, aRight->iLeft);
+    Update(aRight);
+    return aRight;
+}
+
+template <class T>
+void OrderedIdList<T>::AppendItems(const Node* aNode, std::vector<T*>& aItems)
+{ // static
+    // iterative in-order walk; tree depth is only probabilistically bounded
+    std::vector<const Node*> stack;
+    const Node* node = aNode;
+    while (node != nullptr || !stack.empty()) {
+        while (node != nullptr) {
+            stack.push_back(node);
+            node = node->iLeft;
+        }
+        node = stack.back();
+        stack.pop_back();
+        aItems.push_back(node->iItem);
+        node = node->iRight;
+    }
+}
+
+template <class T>
+TUint OrderedIdList<T>::NextPriority()
+{
+    // xorshift32; treap balance only needs priorities to be well distributed, not unpredictable
+    iRandom ^= iRandom << 13;
+    iRandom ^= iRandom >> 17;
+    iRandom ^= iRandom << 5;
+    return iRandom;
+}
+
+} // namespace Av
+} // namespace OpenHome
@@ -0,0 +1,501 @@
+#include <OpenHome/Av/Playlist/PlaylistStore.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Configuration/IStore.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Av/Playlist/OrderedIdList.h>
+#include <OpenHome/Private/Arch.h>
+#include <OpenHome/Private/Converter.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Timer.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Av/Debug.h>
+
+#include <algorithm>
+#include <vector>
+#include <string.h>
+
+EXCEPTION(PlaylistStoreCorrupt);
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+using namespace OpenHome::Configuration;
+using namespace OpenHome::Media;
+
+namespace OpenHome {
+namespace Av {
+
+class StoredTrack
+{
+public:
+    StoredTrack(TUint aId, const Brx& aUri, const Brx& aMetaData)
+        : iId(aId), iUri(aUri), iMetaData(aMetaData)
+    {}
+    TUint Id() const { return iId; }
+    const Brx& Uri() const { return iUri; }
+    const Brx& MetaData() const { return iMetaData; }
+private:
+    TUint iId;
+    Brn iUri;       // references the buffer the value was read into
+    Brn iMetaData;  //                 "
+};
+
+// Bounds checked walk through a value read from store.  Throws PlaylistStoreCorrupt.
+class StoreParser
+{
+public:
+    StoreParser(const Brx& aData);
+    TUint Remaining() const;
+    TUint ReadUint8();
+    TUint ReadUint16();
+    TUint ReadUint32();
+    Brn Read(TUint aBytes);
+private:
+    const Brx& iData;
+    TUint iOffset;
+};
+
+// IWriter that appends to a heap buffer, growing it as required
+class WriterBwhAppend : public IWriter, private INonCopyable
+{
+public:
+    WriterBwhAppend(Bwh& aBuf);
+public: // from IWriter
+    void Write(TByte aValue) override;
+    void Write(const Brx& aBuffer) override;
+    void WriteFlush() override;
+private:
+    Bwh& iBuf;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+static const TUint kReadBytesInitial = 64 * 1024;
+static const TUint kReadBytesMax = 16 * 1024 * 1024;
+
+static void WriteTrack(WriterBinary& aWriter, TUint aId, const Brx& aUri, const Brx& aMetaData)
+{
+    aWriter.WriteUint32Be(aId);
+    aWriter.WriteUint16Be(aUri.Bytes());
+    aWriter.Write(aUri);
+    aWriter.WriteUint16Be(aMetaData.Bytes());
+    aWriter.Write(aMetaData);
+}
+
+static StoredTrack* ReadTrack(StoreParser& aParser)
+{
+    const TUint id = aParser.ReadUint32();
+    const Brn uri = aParser.Read(aParser.ReadUint16());
+    const Brn metadata = aParser.Read(aParser.ReadUint16());
+    if (id == ITrackDatabase::kTrackIdNone || uri.Bytes() > kTrackUriMaxBytes || metadata.Bytes() > kTrackMetaDataMaxBytes) {
+        THROW(PlaylistStoreCorrupt);
+    }
+    return new StoredTrack(id, uri, metadata);
+}
+
+
+// StoreParser
+
+StoreParser::StoreParser(const Brx& aData)
+    : iData(aData)
+    , iOffset(0)
+{
+}
+
+TUint StoreParser::Remaining() const
+{
+    return iData.Bytes() - iOffset;
+}
+
+TUint StoreParser::ReadUint8()
+{
+    return Read(1)[0];
+}
+
+TUint StoreParser::ReadUint16()
+{
+    return Converter::BeUint16At(Read(2), 0);
+}
+
+TUint StoreParser::ReadUint32()
+{
+    return Converter::BeUint32At(Read(4), 0);
+}
+
+Brn StoreParser::Read(TUint aBytes)
+{
+    if (aBytes > Remaining()) {
+        THROW(PlaylistStoreCorrupt);
+    }
+    Brn buf(iData.Ptr() + iOffset, aBytes);
+    iOffset += aBytes;
+    return buf;
+}
+
+
+// WriterBwhAppend
+
+WriterBwhAppend::WriterBwhAppend(Bwh& aBuf)
+    : iBuf(aBuf)
+{
+}
+
+void WriterBwhAppend::Write(TByte aValue)
+{
+    Write(Brn(&aValue, 1));
+}
+
+void WriterBwhAppend::Write(const Brx& aBuffer)
+{
+    const TUint bytes = iBuf.Bytes() + aBuffer.Bytes();
+    if (bytes > iBuf.MaxBytes()) {
+        iBuf.Grow(std::max(bytes, 2 * iBuf.MaxBytes()));
+    }
+    iBuf.Append(aBuffer);
+}
+
+void WriterBwhAppend::WriteFlush()
+{
+}
+
+
+// PlaylistStore
+
+const Brn PlaylistStore::kKeySnapshot("Playlist.Tracks");
+const Brn PlaylistStore::kKeyJournal("Playlist.Journal");
+
+PlaylistStore::PlaylistStore(Environment& aEnv, IStoreReadWrite& aStore, IPowerManager& aPowerManager, ITrackDatabase& aDatabase)
+    : iLock("PLST")
+    , iStore(aStore)
+    , iDatabase(aDatabase)
+    , iGeneration(0)
+    , iSnapshotRequired(false)
+    , iDirty(false)
+    , iWriteScheduled(false)
+    , iTracksLoaded(0)
+{
+    iTimer = new Timer(aEnv, MakeFunctor(*this, &PlaylistStore::TimerCallback), "PlaylistStore");
+    iDatabase.AddObserver(*this);
+    iPowerObserver = aPowerManager.RegisterPowerHandler(*this, kPowerPriorityNormal); // calls PowerUp(), which loads the playlist
+}
+
+PlaylistStore::~PlaylistStore()
+{
+    delete iPowerObserver; // calls PowerDown(), which writes any outstanding changes
+    delete iTimer;
+}
+
+void PlaylistStore::Write()
+{
+    AutoMutex _(iLock);
+    WriteLocked();
+}
+
+TUint PlaylistStore::TracksLoaded() const
+{
+    AutoMutex _(iLock);
+    return iTracksLoaded;
+}
+
+void PlaylistStore::NotifyTrackInserted(Track& aTrack, TUint aIdBefore, TUint /*aIdAfter*/)
+{
+    AutoMutex _(iLock);
+    if (!iSnapshotRequired) {
+        WriterBwhAppend writer(iPending);
+        WriterBinary writerBin(writer);
+        writerBin.WriteUint8(kOpInsert);
+        writerBin.WriteUint32Be(aTrack.Id());
+        writerBin.WriteUint32Be(aIdBefore);
+        WriteTrack(writerBin, aTrack.Id(), aTrack.Uri(), aTrack.MetaData());
+    }
+    ScheduleWriteLocked();
+}
+
+void PlaylistStore::NotifyTrackDeleted(TUint aId, Track* /*aBefore*/, Track* /*aAfter*/)
+{
+    AutoMutex _(iLock);
+    if (!iSnapshotRequired) {
+        WriterBwhAppend writer(iPending);
+        WriterBinary writerBin(writer);
+        writerBin.WriteUint8(kOpDelete);
+        writerBin.WriteUint32Be(aId);
+    }
+    ScheduleWriteLocked();
+}
+
+void PlaylistStore::NotifyAllDeleted()
+{
+    AutoMutex _(iLock);
+    // an empty snapshot is smaller than a journal op for every track
+    iSnapshotRequired = true;
+    iPending.SetBytes(0);
+    ScheduleWriteLocked();
+}
+
+void PlaylistStore::PowerUp()
+{
+    Load();
+}
+
+void PlaylistStore::PowerDown()
+{
+    Write();
+}
+
+void PlaylistStore::Load()
+{
+    iLock.Wait();
+    // ids are reassigned as tracks are inserted below, so everything needs writing again
+    // anyway.  Skip journalling notifications for the tracks we're about to insert.
+    iSnapshotRequired = true;
+    iLock.Signal();
+
+    Bwh snapshot;
+    Bwh journal;
+    OrderedIdList<StoredTrack> tracks;
+    TUint generation = 0;
+    if (!TryReadValue(kKeySnapshot, snapshot)) {
+        AutoMutex _(iLock);
+        iSnapshotRequired = false;
+        return;
+    }
+    try {
+        if (snapshot.Bytes() < kHeaderBytes + 8) {
+            THROW(PlaylistStoreCorrupt);
+        }
+        const TUint bytes = snapshot.Bytes() - 4;
+        Brn body(snapshot.Ptr(), bytes);
+        if (Converter::BeUint32At(snapshot, bytes) != Checksum(body)) {
+            THROW(PlaylistStoreCorrupt);
+        }
+        StoreParser parser(body);
+        if (parser.ReadUint32() != kMagicSnapshot) {
+            THROW(PlaylistStoreCorrupt);
+        }
+        generation = parser.ReadUint32();
+        const TUint count = parser.ReadUint32();
+        for (TUint i=0; i<count; i++) {
+            StoredTrack* track = ReadTrack(parser);
+            if (tracks.Find(track->Id()) != nullptr) {
+                delete track;
+                THROW(PlaylistStoreCorrupt);
+            }
+            tracks.Insert(tracks.Size(), track);
+        }
+    }
+    catch (PlaylistStoreCorrupt&) {
+        LOG(kError, "PlaylistStore: snapshot corrupt, discarding stored playlist\n");
+        std::vector<StoredTrack*> items;
+        tracks.ToVector(items);
+        tracks.Clear();
+        for (TUint i=0; i<items.size(); i++) {
+            delete items[i];
+        }
+        return;
+    }
+
+    if (TryReadValue(kKeyJournal, journal)) {
+        try {
+            StoreParser parser(journal);
+            if (parser.ReadUint32() != kMagicJournal || parser.ReadUint32() != generation) {
+                THROW(PlaylistStoreCorrupt); // journal predates the snapshot
+            }
+            while (parser.Remaining() > 0) {
+                const Brn batch = parser.Read(parser.ReadUint32());
+                if (parser.ReadUint32() != Checksum(batch)) {
+                    THROW(PlaylistStoreCorrupt); // write was interrupted; ignore it and anything after it
+                }
+                StoreParser ops(batch);
+                while (ops.Remaining() > 0) {
+                    const TUint op = ops.ReadUint8();
+                    const TUint id = ops.ReadUint32();
+                    TUint index;
+                    if (op == kOpInsert) {
+                        const TUint idBefore = ops.ReadUint32();
+                        StoredTrack* track = ReadTrack(ops);
+                        if (tracks.Find(track->Id()) != nullptr) {
+                            // already captured by the snapshot
+                            delete track;
+                            continue;
+                        }
+                        if (idBefore == ITrackDatabase::kTrackIdNone) {
+                            index = 0;
+                        }
+                        else if (tracks.TryIndexOf(idBefore, index)) {
+                            index++;
+                        }
+                        else {
+                            index = tracks.Size();
+                        }
+                        tracks.Insert(index, track);
+                    }
+                    else if (op == kOpDelete) {
+                        if (tracks.TryIndexOf(id, index)) {
+                            delete tracks.RemoveAt(index);
+                        }
+                    }
+                    else {
+                        THROW(PlaylistStoreCorrupt);
+                    }
+                }
+            }
+        }
+        catch (PlaylistStoreCorrupt&) {
+            LOG(kSources, "PlaylistStore: ignoring remainder of journal\n");
+        }
+    }
+
+    std::vector<StoredTrack*> items;
+    tracks.ToVector(items);
+    tracks.Clear();
+    TUint idPrev = ITrackDatabase::kTrackIdNone;
+    TUint loaded = 0;
+    for (TUint i=0; i<items.size(); i++) {
+        try {
+            iDatabase.Insert(idPrev, items[i]->Uri(), items[i]->MetaData(), idPrev);
+            loaded++;
+        }
+        catch (TrackDbFull&) {
+            LOG(kError, "PlaylistStore: playlist full, discarding %u stored tracks\n", (TUint)items.size() - i);
+            break;
+        }
+    }
+    for (TUint i=0; i<items.size(); i++) {
+        delete items[i];
+    }
+    LOG(kSources, "PlaylistStore: loaded %u tracks\n", loaded);
+
+    AutoMutex _(iLock);
+    iGeneration = generation;
+    iTracksLoaded = loaded;
+    if (loaded > 0) {
+        ScheduleWriteLocked();
+    }
+    else {
+        iSnapshotRequired = false;
+    }
+}
+
+TBool PlaylistStore::TryReadValue(const Brx& aKey, Bwh& aBuf)
+{
+    aBuf.Grow(kReadBytesInitial);
+    for (;;) {
+        try {
+            iStore.Read(aKey, aBuf);
+            return true;
+        }
+        catch (StoreKeyNotFound&) {
+            return false;
+        }
+        catch (StoreReadBufferUndersized&) {
+            if (aBuf.MaxBytes() >= kReadBytesMax) {
+                LOG(kError, "PlaylistStore: %.*s too large to read\n", PBUF(aKey));
+                return false;
+            }
+            aBuf.Grow(2 * aBuf.MaxBytes());
+        }
+    }
+}
+
+void PlaylistStore::ScheduleWriteLocked()
+{
+    iDirty = true;
+    if (!iWriteScheduled) {
+        iWriteScheduled = true;
+        iTimer->FireIn(kWriteDelayMs);
+    }
+}
+
+void PlaylistStore::WriteLocked()
+{
+    if (!iDirty) {
+        return;
+    }
+    try {
+        if (iSnapshotRequired || iJournal.Bytes() == 0 ||
+            iJournal.Bytes() + iPending.Bytes() + kBatchOverheadBytes > kMaxJournalBytes) {
+            WriteSnapshotLocked();
+        }
+        else {
+            WriterBwhAppend writer(iJournal);
+            WriterBinary writerBin(writer);
+            writerBin.WriteUint32Be(iPending.Bytes());
+            writerBin.Write(iPending);
+            writerBin.WriteUint32Be(Checksum(iPending));
+            iStore.Write(kKeyJournal, iJournal);
+        }
+        iPending.SetBytes(0);
+        iDirty = false;
+    }
+    catch (StoreWriteAllocationFailed&) {
+        LOG(kError, "PlaylistStore: failed to write playlist\n");
+        // our copy of the journal may no longer match the store; start again from a snapshot
+        iSnapshotRequired = true;
+    }
+}
+
+void PlaylistStore::WriteSnapshotLocked()
+{
+    /* Tracks may be inserted/deleted while we're building the snapshot.  Their notifications
+       will block on iLock then be journalled, possibly repeating a change already captured
+       here.  Load() tolerates this by ignoring inserts of existing ids and deletes of
+       missing ones. */
+    std::vector<TUint32> ids;
+    TUint seq;
+    iDatabase.GetIdArray(ids, seq);
+    const TUint generation = iGeneration + 1;
+    Bwh snapshot(kReadBytesInitial);
+    WriterBwhAppend writer(snapshot);
+    WriterBinary writerBin(writer);
+    writerBin.WriteUint32Be(kMagicSnapshot);
+    writerBin.WriteUint32Be(generation);
+    writerBin.WriteUint32Be(0); // track count, updated below
+    TUint count = 0;
+    for (TUint i=0; i<ids.size(); i++) {
+        Track* track = nullptr;
+        try {
+            iDatabase.GetTrackById(ids[i], track);
+        }
+        catch (TrackDbIdNotFound&) {
+            continue;
+        }
+        AutoAllocatedRef a(track);
+        WriteTrack(writerBin, track->Id(), track->Uri(), track->MetaData());
+        count++;
+    }
+    const TUint32 countBe = Arch::BigEndian4(count);
+    (void)memcpy(const_cast<TByte*>(snapshot.Ptr()) + kHeaderBytes, &countBe, sizeof(countBe));
+    writerBin.WriteUint32Be(Checksum(snapshot));
+    iStore.Write(kKeySnapshot, snapshot);
+    iGeneration = generation;
+
+    iJournal.SetBytes(0);
+    WriterBwhAppend writerJournal(iJournal);
+    WriterBinary writerJournalBin(writerJournal);
+    writerJournalBin.WriteUint32Be(kMagicJournal);
+    writerJournalBin.WriteUint32Be(iGeneration);
+    iStore.Write(kKeyJournal, iJournal);
+    iSnapshotRequired = false;
+    LOG(kSources, "PlaylistStore: wrote snapshot of %u tracks (%u bytes)\n", count, snapshot.Bytes());
+}
+
+void PlaylistStore::TimerCallback()
+{
+    AutoMutex _(iLock);
+    iWriteScheduled = false;
+    WriteLocked();
+}
+
+TUint32 PlaylistStore::Checksum(const Brx& aData)
+{ // static
+    // FNV-1a.  Only needs to catch torn or truncated writes, not deliberate tampering.
+    TUint32 hash = 2166136261u;
+    const TByte* ptr = aData.Ptr();
+    for (TUint i=0; i<aData.Bytes(); i++) {
+        hash ^= ptr[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Standard.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/PowerManager.h>
+#include <OpenHome/Av/Playlist/TrackDatabase.h>
+
+namespace OpenHome {
+    class Environment;
+    class Timer;
+namespace Configuration {
+    class IStoreReadWrite;
+}
+namespace Av {
+
+/*
+ * Persists the contents of a playlist TrackDatabase so the queue survives a power cycle.
+ *
+ * The store holds two values.  A snapshot lists every track (id, uri, metadata) in order.
+ * A journal lists the inserts and deletes made since that snapshot was written.  Changes
+ * are batched and written kWriteDelayMs after the first of them, or at power down.  Each
+ * write is either a single checksummed batch appended to the journal or, once the journal
+ * grows past kMaxJournalBytes (or after DeleteAll), a new snapshot.
+ *
+ * Snapshot and journal share a generation number.  A journal left over from an earlier
+ * snapshot, or a batch that was only partially written, is ignored on load.
+ *
+ * The playlist is loaded into the database when this registers with the power manager
+ * (i.e. during construction), with one Insert per track.  TrackDatabase assigns new ids,
+ * so a fresh snapshot is written soon after a non-empty playlist is loaded.
+ */
+class PlaylistStore : private ITrackDatabaseObserver, private IPowerHandler, private INonCopyable
+{
+public:
+    static const Brn kKeySnapshot;
+    static const Brn kKeyJournal;
+    static const TUint kWriteDelayMs = 5000;
+    static const TUint kMaxJournalBytes = 64 * 1024;
+public:
+    PlaylistStore(Environment& aEnv, Configuration::IStoreReadWrite& aStore, IPowerManager& aPowerManager, ITrackDatabase& aDatabase);
+    ~PlaylistStore();
+    void Write(); // writes any outstanding changes immediately
+    TUint TracksLoaded() const;
+private: // from ITrackDatabaseObserver
+    void NotifyTrackInserted(Media::Track& aTrack, TUint aIdBefore, TUint aIdAfter) override;
+    void NotifyTrackDeleted(TUint aId, Media::Track* aBefore, Media::Track* aAfter) override;
+    void NotifyAllDeleted() override;
+private: // from IPowerHandler
+    void PowerUp() override;
+    void PowerDown() override;
+private:
+    void Load();
+    TBool TryReadValue(const Brx& aKey, Bwh& aBuf);
+    void ScheduleWriteLocked();
+    void WriteLocked();
+    void WriteSnapshotLocked();
+    void TimerCallback();
+    static TUint32 Checksum(const Brx& aData);
+private:
+    //Snapshot
+    //Offset    Bytes                   Desc
+    //0         4                       kMagicSnapshot
+    //4         4                       Generation
+    //8         4                       Track count
+    //12        ...                     Tracks (see below), in playlist order
+    //n-4       4                       Checksum of all preceding bytes
+    //
+    //Track
+    //0         4                       Id
+    //4         2                       Uri bytes (u)
+    //6         u                       Uri
+    //6+u       2                       Metadata bytes (m)
+    //8+u       m                       Metadata
+    //
+    //Journal
+    //0         4                       kMagicJournal
+    //4         4                       Generation (matches the snapshot this applies to)
+    //8         ...                     Batches
+    //
+    //Batch
+    //0         4                       Bytes of ops (b)
+    //4         b                       Ops
+    //4+b       4                       Checksum of ops
+    //
+    //Op
+    //0         1                       kOpInsert or kOpDelete
+    //1         4                       Id
+    //5         4                       Id of preceding track (kOpInsert only)
+    //9         ...                     Uri & metadata, as for Track (kOpInsert only)
+    static const TUint32 kMagicSnapshot = 0x6f68504c; // "ohPL"
+    static const TUint32 kMagicJournal  = 0x6f68504a; // "ohPJ"
+    static const TByte kOpInsert = 1;
+    static const TByte kOpDelete = 2;
+    static const TUint kHeaderBytes = 8;
+    static const TUint kBatchOverheadBytes = 8;
+private:
+    Mutex iLock;
+    Configuration::IStoreReadWrite& iStore;
+    ITrackDatabase& iDatabase;
+    Timer* iTimer;
+    IPowerManagerObserver* iPowerObserver;
+    Bwh iJournal;
+    Bwh iPending;
+    TUint iGeneration;
+    TBool iSnapshotRequired;
+    TBool iDirty;
+    TBool iWriteScheduled;
+    TUint iTracksLoaded;
+};
+
+} // namespace Av
+} // namespace OpenHome
@@ -9,9 +9,14 @@
 #include <OpenHome/Private/Parser.h>
 #include <OpenHome/Av/ProviderUtils.h>
 #include <OpenHome/Private/Converter.h>
+#include <OpenHome/Private/Stream.h>
 #include <OpenHome/Private/Timer.h>
 #include <OpenHome/Media/Pipeline/Seeker.h>
 
+#include <algorithm>
+#include <map>
+#include <string.h>
+
 using namespace OpenHome;
 using namespace OpenHome::Net;
 using namespace OpenHome::Av;
@@ -28,12 +33,14 @@ static const Brn kSeekFailureMsg("Seek failed");
 
 // ProviderPlaylist
 
-ProviderPlaylist::ProviderPlaylist(Net::DvDevice& aDevice, Environment& aEnv, ISourcePlaylist& aSource, ITrackDatabase& aDatabase, IRepeater& aRepeater)
+ProviderPlaylist::ProviderPlaylist(Net::DvDevice& aDevice, Environment& aEnv, ISourcePlaylist& aSource, ITrackDatabase& aDatabase, IRepeater& aRepeater, TUint aMaxTracks)
     : DvProviderAvOpenhomeOrgPlaylist1(aDevice)
     , iLock("PPLY")
     , iSource(aSource)
     , iDatabase(aDatabase)
     , iRepeater(aRepeater)
+    , iIdArrayBuf(aMaxTracks * sizeof(TUint32))
+    , iTrackListEntryBytes(0)
     , iTimerLock("PPL2")
     , iTimerActive(false)
 {
@@ -78,12 +85,13 @@ ProviderPlaylist::ProviderPlaylist(Net::DvDevice& aDevice, Environment& aEnv, IS
     SetShuffle(false);
     NotifyTrack(ITrackDatabase::kTrackIdNone);
     UpdateIdArrayProperty();
-    (void)SetPropertyTracksMax(ITrackDatabase::kMaxTracks);
+    (void)SetPropertyTracksMax(aMaxTracks);
 }
 
 ProviderPlaylist::~ProviderPlaylist()
 {
     delete iTimer;
+    ClearTrackListEntries();
 }
 
 void ProviderPlaylist::NotifyPipelineState(Media::EPipelineState aState)
@@ -106,13 +114,21 @@ void ProviderPlaylist::NotifyProtocolInfo(const Brx& aProtocolInfo)
     (void)SetPropertyProtocolInfo(iProtocolInfo);
 }
 
-void ProviderPlaylist::NotifyTrackInserted(Track& /*aTrack*/, TUint /*aIdBefore*/, TUint /*aIdAfter*/)
+void ProviderPlaylist::NotifyTrackInserted(Track& aTrack, TUint aIdBefore, TUint /*aIdAfter*/)
 {
+    iLock.Wait();
+    IdArrayInsertLocked(aTrack.Id(), aIdBefore);
+    iLock.Signal();
     TrackDatabaseChanged();
 }
 
-void ProviderPlaylist::NotifyTrackDeleted(TUint /*aId*/, Track* aBefore, Track* aAfter)
+void ProviderPlaylist::NotifyTrackDeleted(TUint aId, Track* aBefore, Track* aAfter)
 {
+    iLock.Wait();
+    IdArrayDeleteLocked(aId, aBefore);
+    RemoveTrackListEntryLocked(aId);
+    iLock.Signal();
+
     /* Deleting one of many tracks in a playlist will result in a new track starting to play
        and NotifyTrack() being called.  If we've just deleted the last track, we'll stop
        receiving pipeline events so will need to manually reset the current track id. */
@@ -124,6 +140,11 @@ void ProviderPlaylist::NotifyTrackDeleted(TUint /*aId*/, Track* aBefore, Track*
 
 void ProviderPlaylist::NotifyAllDeleted()
 {
+    iLock.Wait();
+    iIdArrayBuf.SetBytes(0);
+    iDbSeq++;
+    ClearTrackListEntries();
+    iLock.Signal();
     NotifyTrack(ITrackDatabase::kTrackIdNone);
     TrackDatabaseChanged();
 }
@@ -280,71 +301,55 @@ void ProviderPlaylist::Id(IDvInvocation& aInvocation, IDvInvocationResponseUint&
 
 void ProviderPlaylist::Read(IDvInvocation& aInvocation, TUint aId, IDvInvocationResponseString& aUri, IDvInvocationResponseString& aMetadata)
 {
+    Track* track = nullptr;
     {
         AutoMutex a(iLock);
-        Track* track = nullptr;
         try {
             iDatabase.GetTrackById(aId, track);
         }
         catch (TrackDbIdNotFound&) {
             aInvocation.Error(kIdNotFoundCode, kIdNotFoundMsg);
         }
-        AutoAllocatedRef t(track);
-        aInvocation.StartResponse();
-        aUri.Write(track->Uri());
-        aUri.WriteFlush();
-        aMetadata.Write(track->MetaData());
-        aMetadata.WriteFlush();
     }
+    AutoAllocatedRef t(track); // our reference keeps uri/metadata valid after iLock is released
+    aInvocation.StartResponse();
+    aUri.Write(track->Uri());
+    aUri.WriteFlush();
+    aMetadata.Write(track->MetaData());
+    aMetadata.WriteFlush();
     aInvocation.EndResponse();
 }
 
 void ProviderPlaylist::ReadList(IDvInvocation& aInvocation, const Brx& aIdList, IDvInvocationResponseString& aTrackList)
 {
-    iLock.Wait();
-    const TUint seq = iDbSeq;
-    iLock.Signal();
     Parser parser(aIdList);
-    TUint index = 0;
-    const Brn entryStart("<Entry>");
-    const Brn entryEnd("</Entry>");
-    const Brn idStart("<Id>");
-    const Brn idEnd("</Id>");
-    const Brn uriStart("<Uri>");
-    const Brn uriEnd("</Uri>");
-    const Brn metaStart("<Metadata>");
-    const Brn metaEnd("</Metadata>");
     Brn idBuf;
     idBuf.Set(parser.Next(' '));
 
-    aInvocation.StartResponse();
-    aTrackList.Write(Brn("<TrackList>"));
-    do {
-        try {
-            TUint id = Ascii::Uint(idBuf);
+    /* Copy the requested entries while holding iLock but only write them out once it is
+       released - a slow control point must not block playlist edits or the pipeline. */
+    WriterBwh writer(1024);
+    writer.Write(Brn("<TrackList>"));
+    {
+        AutoMutex a(iLock);
+        do {
             try {
-                Track* track;
-                iDatabase.GetTrackById(id, seq, track, index);
-                AutoAllocatedRef a(track);
-                aTrackList.Write(entryStart);
-                aTrackList.Write(idStart);
-                aTrackList.Write(idBuf);
-                aTrackList.Write(idEnd);
-                aTrackList.Write(uriStart);
-                WriterInvocationResponseString writer(aTrackList);
-                Converter::ToXmlEscaped(writer, track->Uri());
-                aTrackList.Write(uriEnd);
-                aTrackList.Write(metaStart);
-                Converter::ToXmlEscaped(writer, track->MetaData());
-                aTrackList.Write(metaEnd);
-                aTrackList.Write(entryEnd);
+                const TUint id = Ascii::Uint(idBuf);
+                const Brx* entry = TrackListEntryLocked(id);
+                if (entry != nullptr) {
+                    writer.Write(*entry);
+                }
             }
-            catch (TrackDbIdNotFound&) { }
-        }
-        catch (AsciiError&) { }
-        idBuf.Set(parser.Next(' '));
-    } while (idBuf != Brx::Empty());
-    aTrackList.Write(Brn("</TrackList>"));
+            catch (AsciiError&) { }
+            idBuf.Set(parser.Next(' '));
+        } while (idBuf != Brx::Empty());
+    }
+    writer.Write(Brn("</TrackList>"));
+    Bwh trackList;
+    writer.TransferTo(trackList);
+
+    aInvocation.StartResponse();
+    aTrackList.Write(trackList);
     aTrackList.WriteFlush();
     aInvocation.EndResponse();
 }
@@ -399,11 +404,13 @@ void ProviderPlaylist::TracksMax(IDvInvocation& aInvocation, IDvInvocationRespon
 
 void ProviderPlaylist::IdArray(IDvInvocation& aInvocation, IDvInvocationResponseUint& aToken, IDvInvocationResponseBinary& aArray)
 {
-    AutoMutex a(iLock);
-    UpdateIdArray(); // can't rely on iIdArrayBuf being up to date since we defer acting on PlaylistDatabaseChanged() calls
+    iLock.Wait();
+    const TUint token = iDbSeq;
+    Bwh idArray(iIdArrayBuf);
+    iLock.Signal();
     aInvocation.StartResponse();
-    aToken.Write(iDbSeq);
-    aArray.Write(iIdArrayBuf);
+    aToken.Write(token);
+    aArray.Write(idArray);
     aArray.WriteFlush();
     aInvocation.EndResponse();
 }
@@ -452,10 +459,8 @@ void ProviderPlaylist::UpdateIdArray()
 {
     iDatabase.GetIdArray(iIdArray, iDbSeq);
     iIdArrayBuf.SetBytes(0);
-    for (TUint i=0; i<ITrackDatabase::kMaxTracks; i++) {
-        if (iIdArray[i] == ITrackDatabase::kTrackIdNone) {
-            break;
-        }
+    const TUint count = std::min((TUint)iIdArray.size(), iIdArrayBuf.MaxBytes() / (TUint)sizeof(TUint32));
+    for (TUint i=0; i<count; i++) {
         TUint32 bigEndianId = Arch::BigEndian4(iIdArray[i]);
         Brn idBuf(reinterpret_cast<const TByte*>(&bigEndianId), sizeof(bigEndianId));
         iIdArrayBuf.Append(idBuf);
@@ -468,11 +473,148 @@ void ProviderPlaylist::UpdateIdArrayProperty()
     (void)SetPropertyIdArray(iIdArrayBuf);
 }
 
+TBool ProviderPlaylist::IdArrayHasIdAtLocked(TUint aIndex, TUint aId) const
+{
+    if (aIndex >= iIdArrayBuf.Bytes() / sizeof(TUint32)) {
+        return false;
+    }
+    const TUint32 bigEndianId = Arch::BigEndian4(aId);
+    return (memcmp(iIdArrayBuf.Ptr() + (aIndex * sizeof(TUint32)), &bigEndianId, sizeof(bigEndianId)) == 0);
+}
+
+void ProviderPlaylist::IdArrayInsertLocked(TUint aId, TUint aIdBefore)
+{
+    /* The database's index for aId is its position in our array too.  Check that the id
+       before it agrees so that we rebuild (rather than corrupt) the array if we're ever
+       out of step with the database. */
+    TUint index;
+    if (!iDatabase.TryIndexOf(aId, index)) {
+        UpdateIdArray();
+        return;
+    }
+    const TBool inStep = (aIdBefore == ITrackDatabase::kTrackIdNone? index == 0 : IdArrayHasIdAtLocked(index - 1, aIdBefore));
+    if (!inStep) {
+        UpdateIdArray();
+        return;
+    }
+    iDbSeq++;
+    const TUint offset = index * sizeof(TUint32);
+    if (offset == iIdArrayBuf.MaxBytes()) {
+        return; // new track is beyond the first aMaxTracks, which are all we report
+    }
+    TUint bytes = iIdArrayBuf.Bytes();
+    if (bytes == iIdArrayBuf.MaxBytes()) {
+        bytes -= sizeof(TUint32); // last id drops off the end of the array
+    }
+    TByte* ptr = const_cast<TByte*>(iIdArrayBuf.Ptr());
+    (void)memmove(ptr + offset + sizeof(TUint32), ptr + offset, bytes - offset);
+    const TUint32 bigEndianId = Arch::BigEndian4(aId);
+    (void)memcpy(ptr + offset, &bigEndianId, sizeof(bigEndianId));
+    iIdArrayBuf.SetBytes(bytes + sizeof(TUint32));
+}
+
+void ProviderPlaylist::IdArrayDeleteLocked(TUint aId, const Track* aBefore)
+{
+    // aId has already gone from the database; it was at the index following aBefore
+    TUint index = 0;
+    if (aBefore != nullptr) {
+        if (!iDatabase.TryIndexOf(aBefore->Id(), index)) {
+            UpdateIdArray();
+            return;
+        }
+        index++;
+    }
+    if (iIdArrayBuf.Bytes() == iIdArrayBuf.MaxBytes() || !IdArrayHasIdAtLocked(index, aId)) {
+        // a full array may have been truncated, in which case another id now needs to be appended
+        UpdateIdArray();
+        return;
+    }
+    iDbSeq++;
+    const TUint offset = index * sizeof(TUint32);
+    const TUint bytes = iIdArrayBuf.Bytes() - sizeof(TUint32);
+    TByte* ptr = const_cast<TByte*>(iIdArrayBuf.Ptr());
+    (void)memmove(ptr + offset, ptr + offset + sizeof(TUint32), bytes - offset);
+    iIdArrayBuf.SetBytes(bytes);
+}
+
+const Brx* ProviderPlaylist::TrackListEntryLocked(TUint aId)
+{
+    auto it = iTrackListEntries.find(aId);
+    if (it != iTrackListEntries.end()) {
+        iTrackListLru.splice(iTrackListLru.begin(), iTrackListLru, it->second.iLruPos);
+        return it->second.iEntry;
+    }
+    Track* track = nullptr;
+    try {
+        iDatabase.GetTrackById(aId, track);
+    }
+    catch (TrackDbIdNotFound&) {
+        return nullptr;
+    }
+    AutoAllocatedRef a(track);
+    Bwh* entry = CreateTrackListEntry(*track);
+    // evict before adding so that the entry returned stays valid until our caller has copied it
+    while (iTrackListLru.size() > 0 && iTrackListEntryBytes + entry->Bytes() > kMaxTrackListEntryBytes) {
+        RemoveTrackListEntryLocked(iTrackListLru.back());
+    }
+    iTrackListLru.push_front(aId);
+    iTrackListEntries.insert(std::pair<TUint, TrackListEntry>(aId, TrackListEntry(entry, iTrackListLru.begin())));
+    iTrackListEntryBytes += entry->Bytes();
+    return entry;
+}
+
+Bwh* ProviderPlaylist::CreateTrackListEntry(const Track& aTrack)
+{ // static
+    WriterBwh writer(1024);
+    writer.Write(Brn("<Entry><Id>"));
+    Bws<Ascii::kMaxUintStringBytes> id;
+    Ascii::AppendDec(id, aTrack.Id());
+    writer.Write(id);
+    writer.Write(Brn("</Id><Uri>"));
+    Converter::ToXmlEscaped(writer, aTrack.Uri());
+    writer.Write(Brn("</Uri><Metadata>"));
+    Converter::ToXmlEscaped(writer, aTrack.MetaData());
+    writer.Write(Brn("</Metadata></Entry>"));
+    Bwh buf;
+    writer.TransferTo(buf);
+    return new Bwh(buf); // WriterBwh over-allocates; store a copy sized to fit
+}
+
+void ProviderPlaylist::RemoveTrackListEntryLocked(TUint aId)
+{
+    auto it = iTrackListEntries.find(aId);
+    if (it != iTrackListEntries.end()) {
+        iTrackListEntryBytes -= it->second.iEntry->Bytes();
+        delete it->second.iEntry;
+        iTrackListLru.erase(it->second.iLruPos);
+        iTrackListEntries.erase(it);
+    }
+}
+
+void ProviderPlaylist::ClearTrackListEntries()
+{
+    for (auto it=iTrackListEntries.begin(); it!=iTrackListEntries.end(); ++it) {
+        delete it->second.iEntry;
+    }
+    iTrackListEntries.clear();
+    iTrackListLru.clear();
+    iTrackListEntryBytes = 0;
+}
+
 void ProviderPlaylist::TimerCallback()
 {
     iTimerLock.Wait();
     iTimerActive = false;
     iTimerLock.Signal();
     AutoMutex a(iLock);
-    UpdateIdArrayProperty();
+    (void)SetPropertyIdArray(iIdArrayBuf);
+}
+
+
+// ProviderPlaylist::TrackListEntry
+
+ProviderPlaylist::TrackListEntry::TrackListEntry(Bwh* aEntry, std::list<TUint>::iterator aLruPos)
+    : iEntry(aEntry)
+    , iLruPos(aLruPos)
+{
 }
@@ -9,7 +9,9 @@
 #include <OpenHome/Media/PipelineObserver.h>
 #include <OpenHome/Av/Playlist/TrackDatabase.h>
 
-#include <array>
+#include <vector>
+#include <map>
+#include <list>
 
 namespace OpenHome {
     class Environment;
@@ -36,8 +38,9 @@ public:
 class ProviderPlaylist : public Net::DvProviderAvOpenhomeOrgPlaylist1, private ITrackDatabaseObserver
 {
     static const TUint kIdArrayUpdateFrequencyMillisecs = 300;
+    static const TUint kMaxTrackListEntryBytes = 1024 * 1024; // cache of ReadList entries is trimmed (least recently read first) to this size
 public:
-    ProviderPlaylist(Net::DvDevice& aDevice, Environment& aEnv, ISourcePlaylist& aSource, ITrackDatabase& aDatabase, IRepeater& aRepeater);
+    ProviderPlaylist(Net::DvDevice& aDevice, Environment& aEnv, ISourcePlaylist& aSource, ITrackDatabase& aDatabase, IRepeater& aRepeater, TUint aMaxTracks);
     ~ProviderPlaylist();
     void NotifyPipelineState(Media::EPipelineState aState);
     void NotifyTrack(TUint aId);
@@ -77,7 +80,23 @@ private:
     void SetShuffle(TBool aShuffle);
     void UpdateIdArray();
     void UpdateIdArrayProperty();
+    TBool IdArrayHasIdAtLocked(TUint aIndex, TUint aId) const;
+    void IdArrayInsertLocked(TUint aId, TUint aIdBefore);
+    void IdArrayDeleteLocked(TUint aId, const Media::Track* aBefore);
+    const Brx* TrackListEntryLocked(TUint aId);
+    static Bwh* CreateTrackListEntry(const Media::Track& aTrack);
+    void RemoveTrackListEntryLocked(TUint aId);
+    void ClearTrackListEntries();
     void TimerCallback();
+private:
+    class TrackListEntry
+    {
+    public:
+        TrackListEntry(Bwh* aEntry, std::list<TUint>::iterator aLruPos);
+    public:
+        Bwh* iEntry; // xml escaped <Entry> for ReadList
+        std::list<TUint>::iterator iLruPos;
+    };
 private:
     Mutex iLock;
     ISourcePlaylist& iSource;
@@ -86,8 +105,11 @@ private:
     Brn iProtocolInfo;
     Media::EPipelineState iPipelineState;
     TUint iDbSeq;
-    std::array<TUint, ITrackDatabase::kMaxTracks> iIdArray;
-    Bws<ITrackDatabase::kMaxTracks * sizeof(TUint32)> iIdArrayBuf;
+    std::vector<TUint32> iIdArray;
+    Bwh iIdArrayBuf; // aMaxTracks ids, maintained incrementally as tracks are inserted/deleted
+    std::map<TUint, TrackListEntry> iTrackListEntries; // created on first read
+    std::list<TUint> iTrackListLru; // ids in iTrackListEntries, most recently read first
+    TUint iTrackListEntryBytes;
     Timer* iTimer;
     Mutex iTimerLock;
     TBool iTimerActive;
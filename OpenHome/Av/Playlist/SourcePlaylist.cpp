@@ -5,6 +5,7 @@
 #include <OpenHome/Av/Playlist/TrackDatabase.h>
 #include <OpenHome/Av/Playlist/ProviderPlaylist.h>
 #include <OpenHome/Av/Playlist/UriProviderPlaylist.h>
+#include <OpenHome/Av/Playlist/PlaylistStore.h>
 #include <OpenHome/Media/PipelineManager.h>
 #include <OpenHome/Av/KvpStore.h>
 #include <OpenHome/Av/SourceFactory.h>
@@ -18,6 +19,9 @@ namespace OpenHome {
 namespace Net {
     class DvDevice;
 }
+namespace Configuration {
+    class IStoreReadWrite;
+}
 namespace Media {
     class PipelineManager;
     class TrackFactory;
@@ -31,7 +35,8 @@ class SourcePlaylist : public Source, private ISourcePlaylist, private ITrackDat
 {
 public:
     SourcePlaylist(Environment& aEnv, Net::DvDevice& aDevice, Media::PipelineManager& aPipeline,
-                   Media::TrackFactory& aTrackFactory, Media::MimeTypeList& aMimeTypeList, IPowerManager& aPowerManager);
+                   Media::TrackFactory& aTrackFactory, Media::MimeTypeList& aMimeTypeList,
+                   Configuration::IStoreReadWrite& aStore, IPowerManager& aPowerManager, TUint aMaxTracks);
     ~SourcePlaylist();
 private:
     void EnsureActive();
@@ -72,6 +77,7 @@ private:
     Repeater* iRepeater;
     Media::UriProvider* iUriProvider;
     ProviderPlaylist* iProviderPlaylist;
+    PlaylistStore* iPlaylistStore;
     TUint iTrackPosSeconds;
     TUint iStreamId;
     Media::EPipelineState iTransportState; // FIXME - this appears to be set but never used
@@ -93,14 +99,15 @@ using namespace OpenHome::Media;
 
 ISource* SourceFactory::NewPlaylist(IMediaPlayer& aMediaPlayer)
 { // static
-    return new SourcePlaylist(aMediaPlayer.Env(), aMediaPlayer.Device(), aMediaPlayer.Pipeline(), aMediaPlayer.TrackFactory(), aMediaPlayer.MimeTypes(), aMediaPlayer.PowerManager());
+    return new SourcePlaylist(aMediaPlayer.Env(), aMediaPlayer.Device(), aMediaPlayer.Pipeline(), aMediaPlayer.TrackFactory(), aMediaPlayer.MimeTypes(), aMediaPlayer.ReadWriteStore(), aMediaPlayer.PowerManager(), aMediaPlayer.PlaylistMaxTracks());
 }
 
 
 // SourcePlaylist
 
 SourcePlaylist::SourcePlaylist(Environment& aEnv, Net::DvDevice& aDevice, PipelineManager& aPipeline,
-                               TrackFactory& aTrackFactory, MimeTypeList& aMimeTypeList, IPowerManager& aPowerManager)
+                               TrackFactory& aTrackFactory, MimeTypeList& aMimeTypeList,
+                               Configuration::IStoreReadWrite& aStore, IPowerManager& aPowerManager, TUint aMaxTracks)
     : Source(Brn("Playlist"), "Playlist", aPipeline, aPowerManager)
     , iLock("SPL1")
     , iActivationLock("SPL2")
@@ -111,18 +118,20 @@ SourcePlaylist::SourcePlaylist(Environment& aEnv, Net::DvDevice& aDevice, Pipeli
     , iNoPipelineStateChangeOnActivation(false)
     , iNewPlaylist(true)
 {
-    iDatabase = new TrackDatabase(aTrackFactory);
+    iDatabase = new TrackDatabase(aTrackFactory, aMaxTracks);
     iShuffler = new Shuffler(aEnv, *iDatabase);
     iRepeater = new Repeater(*iShuffler);
     iUriProvider = new UriProviderPlaylist(*iRepeater, aPipeline, *this);
     iPipeline.Add(iUriProvider); // ownership passes to iPipeline
-    iProviderPlaylist = new ProviderPlaylist(aDevice, aEnv, *this, *iDatabase, *iRepeater);
+    iProviderPlaylist = new ProviderPlaylist(aDevice, aEnv, *this, *iDatabase, *iRepeater, aMaxTracks);
     aMimeTypeList.AddUpnpProtocolInfoObserver(MakeFunctorGeneric(*iProviderPlaylist, &ProviderPlaylist::NotifyProtocolInfo));
     iPipeline.AddObserver(*this);
+    iPlaylistStore = new PlaylistStore(aEnv, aStore, aPowerManager, *iDatabase);
 }
 
 SourcePlaylist::~SourcePlaylist()
 {
+    delete iPlaylistStore;
     delete iProviderPlaylist;
     delete iDatabase;
     delete iShuffler;
@@ -31,13 +31,14 @@ static inline void RemoveRefIfNonNull(Track* aTrack)
 
 // TrackDatabase
 
-TrackDatabase::TrackDatabase(TrackFactory& aTrackFactory)
+TrackDatabase::TrackDatabase(TrackFactory& aTrackFactory, TUint aMaxTracks)
     : iLock("TDB1")
     , iObserverLock("TDB2")
     , iTrackFactory(aTrackFactory)
+    , iMaxTracks(aMaxTracks)
+    , iIdArraySeq(0)
     , iSeq(0)
 {
-    iTrackList.reserve(kMaxTracks);
 }
 
 TrackDatabase::~TrackDatabase()
@@ -53,16 +54,26 @@ void TrackDatabase::AddObserver(ITrackDatabaseObserver& aObserver)
 void TrackDatabase::GetIdArray(std::array<TUint32, kMaxTracks>& aIdArray, TUint& aSeq) const
 {
     AutoMutex a(iLock);
+    UpdateIdArrayLocked();
+    const TUint count = std::min((TUint)iIdArray.size(), kMaxTracks);
     TUint i;
-    for (i=0; i<iTrackList.size(); i++) {
-        aIdArray[i] = iTrackList[i]->Id();
+    for (i=0; i<count; i++) {
+        aIdArray[i] = iIdArray[i];
     }
-    for (i=iTrackList.size(); i<kMaxTracks; i++) {
+    for (; i<kMaxTracks; i++) {
         aIdArray[i] = kTrackIdNone;
     }
     aSeq = iSeq;
 }
 
+void TrackDatabase::GetIdArray(std::vector<TUint32>& aIdArray, TUint& aSeq) const
+{
+    AutoMutex a(iLock);
+    UpdateIdArrayLocked();
+    aIdArray = iIdArray;
+    aSeq = iSeq;
+}
+
 void TrackDatabase::GetTrackById(TUint aId, Track*& aTrack) const
 {
     AutoMutex a(iLock);
@@ -71,11 +82,27 @@ void TrackDatabase::GetTrackById(TUint aId, Track*& aTrack) const
 
 void TrackDatabase::GetTrackByIdLocked(TUint aId, Track*& aTrack) const
 {
-    const TUint index = TrackListUtils::IndexFromId(iTrackList, aId);
-    aTrack = iTrackList[index];
+    aTrack = iTrackList.Find(aId);
+    if (aTrack == nullptr) {
+        THROW(TrackDbIdNotFound);
+    }
     aTrack->AddRef();
 }
 
+void TrackDatabase::UpdateIdArrayLocked() const
+{
+    // iSeq changes on every insert/delete so the cached ids are only regenerated after an edit
+    if (iIdArraySeq == iSeq) {
+        return;
+    }
+    iTrackList.ToVector(iTracksTemp);
+    iIdArray.resize(iTracksTemp.size());
+    for (TUint i=0; i<iTracksTemp.size(); i++) {
+        iIdArray[i] = iTracksTemp[i]->Id();
+    }
+    iIdArraySeq = iSeq;
+}
+
 void TrackDatabase::GetTrackById(TUint aId, TUint aSeq, Track*& aTrack, TUint& aIndex) const
 {
     AutoMutex a(iLock);
@@ -84,12 +111,17 @@ void TrackDatabase::GetTrackById(TUint aId, TUint aSeq, Track*& aTrack, TUint& a
         GetTrackByIdLocked(aId, aTrack);
         return;
     }
-    if (!TryGetTrackById(aId, aTrack, aIndex, iTrackList.size(), aIndex)) {
-        TUint endIndex = std::min(aIndex, (TUint)iTrackList.size());
-        if (!TryGetTrackById(aId, aTrack, 0, endIndex, aIndex)) {
-            THROW(TrackDbIdNotFound);
-        }
+    if (!iTrackList.TryIndexOf(aId, aIndex)) {
+        THROW(TrackDbIdNotFound);
     }
+    aTrack = iTrackList.Find(aId);
+    aTrack->AddRef();
+}
+
+TBool TrackDatabase::TryIndexOf(TUint aId, TUint& aIndex) const
+{
+    AutoMutex a(iLock);
+    return iTrackList.TryIndexOf(aId, aIndex);
 }
 
 void TrackDatabase::Insert(TUint aIdAfter, const Brx& aUri, const Brx& aMetaData, TUint& aIdInserted)
@@ -99,7 +131,7 @@ void TrackDatabase::Insert(TUint aIdAfter, const Brx& aUri, const Brx& aMetaData
     AutoMutex _(iObserverLock);
     {
         AutoMutex a(iLock);
-        if (iTrackList.size() == kMaxTracks) {
+        if (iTrackList.Size() == iMaxTracks) {
             THROW(TrackDbFull);
         }
         TUint index = 0;
@@ -108,10 +140,10 @@ void TrackDatabase::Insert(TUint aIdAfter, const Brx& aUri, const Brx& aMetaData
         }
         track = iTrackFactory.CreateTrack(aUri, aMetaData);
         aIdInserted = track->Id();
-        iTrackList.insert(iTrackList.begin() + index, track);
+        iTrackList.Insert(index, track);
         iSeq++;
         idBefore = aIdAfter;
-        idAfter = (index == iTrackList.size()-1? kTrackIdNone : index+1);
+        idAfter = (index == iTrackList.Size()-1? kTrackIdNone : iTrackList.At(index+1)->Id());
     }
     for (TUint i=0; i<iObservers.size(); i++) {
         iObservers[i]->NotifyTrackInserted(*track, idBefore, idAfter);
@@ -127,15 +159,14 @@ void TrackDatabase::DeleteId(TUint aId)
         AutoMutex a(iLock);
         TUint index = TrackListUtils::IndexFromId(iTrackList, aId);
         if (index > 0) {
-            before = iTrackList[index-1];
+            before = iTrackList.At(index-1);
             before->AddRef();
         }
-        if (index < iTrackList.size()-1) {
-            after = iTrackList[index+1];
+        if (index < iTrackList.Size()-1) {
+            after = iTrackList.At(index+1);
             after->AddRef();
         }
-        iTrackList[index]->RemoveRef();
-        (void)iTrackList.erase(iTrackList.begin() + index);
+        iTrackList.RemoveAt(index)->RemoveRef();
         iSeq++;
     }
     for (TUint i=0; i<iObservers.size(); i++) {
@@ -149,7 +180,7 @@ void TrackDatabase::DeleteAll()
 {
     AutoMutex _(iObserverLock);
     iLock.Wait();
-    const TBool changed = (iTrackList.size() > 0);
+    const TBool changed = (iTrackList.Size() > 0);
     if (changed) {
         TrackListUtils::Clear(iTrackList);
         iSeq++;
@@ -165,7 +196,7 @@ void TrackDatabase::DeleteAll()
 TUint TrackDatabase::TrackCount() const
 {
     iLock.Wait();
-    const TUint count = iTrackList.size();
+    const TUint count = iTrackList.Size();
     iLock.Signal();
     return count;
 }
@@ -179,14 +210,9 @@ void TrackDatabase::SetObserver(ITrackDatabaseObserver& aObserver)
 
 Track* TrackDatabase::TrackRef(TUint aId)
 {
-    Track* track = nullptr;
     AutoMutex a(iLock);
-    try {
-        const TUint index = TrackListUtils::IndexFromId(iTrackList, aId);
-        track = iTrackList[index];
-        track->AddRef();
-    }
-    catch (TrackDbIdNotFound&) { }
+    Track* track = iTrackList.Find(aId);
+    AddRefIfNonNull(track);
     return track;
 }
 
@@ -195,20 +221,17 @@ Track* TrackDatabase::NextTrackRef(TUint aId)
     Track* track = nullptr;
     AutoMutex a(iLock);
     if (aId == kTrackIdNone) {
-        if (iTrackList.size() > 0) {
-            track = iTrackList[0];
+        if (iTrackList.Size() > 0) {
+            track = iTrackList.At(0);
             track->AddRef();
         }
     }
     else {
-        try {
-            const TUint index = TrackListUtils::IndexFromId(iTrackList, aId);
-            if (index < iTrackList.size()-1) {
-                track = iTrackList[index+1];
-                track->AddRef();
-            }
+        TUint index;
+        if (iTrackList.TryIndexOf(aId, index) && index < iTrackList.Size()-1) {
+            track = iTrackList.At(index+1);
+            track->AddRef();
         }
-        catch (TrackDbIdNotFound&) { }
     }
     return track;
 }
@@ -217,14 +240,11 @@ Track* TrackDatabase::PrevTrackRef(TUint aId)
 {
     Track* track = nullptr;
     AutoMutex a(iLock);
-    try {
-        const TUint index = TrackListUtils::IndexFromId(iTrackList, aId);
-        if (index > 0) {
-            track = iTrackList[index-1];
-            track->AddRef();
-        }
+    TUint index;
+    if (iTrackList.TryIndexOf(aId, index) && index > 0) {
+        track = iTrackList.At(index-1);
+        track->AddRef();
     }
-    catch (TrackDbIdNotFound&) { }
     return track;
 }
 
@@ -232,8 +252,8 @@ Track* TrackDatabase::TrackRefByIndex(TUint aIndex)
 {
     Track* track = nullptr;
     iLock.Wait();
-    if (aIndex < iTrackList.size()) {
-        track = iTrackList[aIndex];
+    if (aIndex < iTrackList.Size()) {
+        track = iTrackList.At(aIndex);
         track->AddRef();
     }
     iLock.Signal();
@@ -246,19 +266,6 @@ Track* TrackDatabase::TrackRefByIndexSorted(TUint /*aIndex*/)
     return nullptr;
 }
 
-TBool TrackDatabase::TryGetTrackById(TUint aId, Track*& aTrack, TUint aStartIndex, TUint aEndIndex, TUint& aFoundIndex) const
-{
-    for (TUint i=aStartIndex; i<aEndIndex; i++) {
-        if (iTrackList[i]->Id() == aId) {
-            aTrack = iTrackList[i];
-            aTrack->AddRef();
-            aFoundIndex = i;
-            return true;
-        }
-    }
-    return false;
-}
-
 
 // Shuffler
 
@@ -271,7 +278,6 @@ Shuffler::Shuffler(Environment& aEnv, ITrackDatabaseReader& aReader)
     , iShuffle(false)
 {
     aReader.SetObserver(*this);
-    iShuffleList.reserve(ITrackDatabase::kMaxTracks);
 }
 
 TBool Shuffler::Enabled() const
@@ -308,7 +314,7 @@ TBool Shuffler::TryMoveToStart(TUint aId)
     if (iShuffle) {
         try {
             const TUint index = TrackListUtils::IndexFromId(iShuffleList, aId);
-            Track* track = iShuffleList[index];
+            Track* track = iShuffleList.At(index);
             MoveToStartOfUnplayed(track, "MoveToStart");
             return true;
         }
@@ -331,7 +337,7 @@ Track* Shuffler::TrackRef(TUint aId)
     if (iShuffle) {
         try {
             const TUint index = TrackListUtils::IndexFromId(iShuffleList, aId);
-            track = iShuffleList[index];
+            track = iShuffleList.At(index);
             track->AddRef();
             iPrevTrackId = track->Id();
             LogIds("TrackRef");
@@ -355,22 +361,22 @@ Track* Shuffler::NextTrackRef(TUint aId)
     }
     else {
         if (aId == ITrackDatabase::kTrackIdNone) {
-            if (iShuffleList.size() > 0) {
-                track = iShuffleList[0];
+            if (iShuffleList.Size() > 0) {
+                track = iShuffleList.At(0);
                 track->AddRef();
             }
         }
         else {
             try {
                 const TUint index = TrackListUtils::IndexFromId(iShuffleList, aId);
-                if (index < iShuffleList.size()-1) {
-                    track = iShuffleList[index+1];
+                if (index < iShuffleList.Size()-1) {
+                    track = iShuffleList.At(index+1);
                     track->AddRef();
                 }
-                else if (index == iShuffleList.size()-1) {
+                else if (index == iShuffleList.Size()-1) {
                     // we've run through the entire list
                     // prefer re-shuffling over repeating the order of tracks if we play again
-                    std::random_shuffle(iShuffleList.begin(), iShuffleList.end());
+                    ShuffleList();
                     LogIds("NextTrackRef");
                 }
             }
@@ -392,7 +398,7 @@ Track* Shuffler::PrevTrackRef(TUint aId)
         try {
             const TUint index = TrackListUtils::IndexFromId(iShuffleList, aId);
             if (index != 0) {
-                track = iShuffleList[index-1];
+                track = iShuffleList.At(index-1);
                 track->AddRef();
             }
         }
@@ -428,8 +434,8 @@ Track* Shuffler::TrackRefByIndexSorted(TUint aIndex)
     if (!iShuffle) {
         track = iReader.TrackRefByIndex(aIndex);
     }
-    else if (aIndex < iShuffleList.size()) {
-        track = iShuffleList[aIndex];
+    else if (aIndex < iShuffleList.Size()) {
+        track = iShuffleList.At(aIndex);
         track->AddRef();
     }
     return track;
@@ -442,23 +448,23 @@ void Shuffler::NotifyTrackInserted(Track& aTrack, TUint aIdBefore, TUint aIdAfte
     try {
         AutoMutex a(iLock);
         TUint index = 0;
-        if (iShuffleList.size() > 0) {
+        if (iShuffleList.Size() > 0) {
             TUint min = 0;
             if (iPrevTrackId != ITrackDatabase::kTrackIdNone) {
                 min = TrackListUtils::IndexFromId(iShuffleList, iPrevTrackId) + 1;
             }
-            if (min == iShuffleList.size()) {
+            if (min == iShuffleList.Size()) {
                 index = min;
             }
             else {
-                index = iEnv.Random(iShuffleList.size(), min);
+                index = iEnv.Random(iShuffleList.Size(), min);
             }
         }
-        iShuffleList.insert(iShuffleList.begin() + index, &aTrack);
+        iShuffleList.Insert(index, &aTrack);
         aTrack.AddRef();
         if (iShuffle) {
-            idBefore = (index == 0? ITrackDatabase::kTrackIdNone : iShuffleList[index-1]->Id());
-            idAfter = (index == iShuffleList.size()-1? ITrackDatabase::kTrackIdNone : iShuffleList[index+1]->Id());
+            idBefore = (index == 0? ITrackDatabase::kTrackIdNone : iShuffleList.At(index-1)->Id());
+            idAfter = (index == iShuffleList.Size()-1? ITrackDatabase::kTrackIdNone : iShuffleList.At(index+1)->Id());
             LogIds("TrackInserted");
         }
     }
@@ -476,19 +482,18 @@ void Shuffler::NotifyTrackDeleted(TUint aId, Track* aBefore, Track* aAfter)
         AutoMutex a(iLock);
         const TUint index = TrackListUtils::IndexFromId(iShuffleList, aId);
         if (iShuffle) {
-            before = (index==0? nullptr : iShuffleList[index-1]);
-            after = (index==iShuffleList.size()-1? nullptr : iShuffleList[index+1]);
-            if (iShuffleList[index]->Id() == iPrevTrackId) {
+            before = (index==0? nullptr : iShuffleList.At(index-1));
+            after = (index==iShuffleList.Size()-1? nullptr : iShuffleList.At(index+1));
+            if (iShuffleList.At(index)->Id() == iPrevTrackId) {
                 if (index == 0) {
                     iPrevTrackId = ITrackDatabase::kTrackIdNone;
                 }
                 else {
-                    iPrevTrackId = iShuffleList[index-1]->Id();
+                    iPrevTrackId = iShuffleList.At(index-1)->Id();
                 }
             }
         }
-        iShuffleList[index]->RemoveRef();
-        iShuffleList.erase(iShuffleList.begin() + index);
+        iShuffleList.RemoveAt(index)->RemoveRef();
         LogIds("TrackDeleted");
         AddRefIfNonNull(before);
         AddRefIfNonNull(after);
@@ -513,7 +518,7 @@ void Shuffler::NotifyAllDeleted()
 void Shuffler::DoReshuffle(const TChar* aLogPrefix)
 {
     if (iShuffle) { // prefer re-shuffling over repeating the order of tracks if we play again
-        std::random_shuffle(iShuffleList.begin(), iShuffleList.end());
+        ShuffleList();
         LogIds(aLogPrefix);
         iPrevTrackId = ITrackDatabase::kTrackIdNone;
     }
@@ -525,23 +530,37 @@ void Shuffler::MoveToStartOfUnplayed(Track* aTrack, const TChar* aLogPrefix)
     const TUint cursorIndex = (iPrevTrackId == ITrackDatabase::kTrackIdNone?
             0 : TrackListUtils::IndexFromId(iShuffleList, iPrevTrackId));
     if (index > cursorIndex+1) {
-        iShuffleList.erase(iShuffleList.begin() + index);
-        iShuffleList.insert(iShuffleList.begin() + cursorIndex, aTrack);
+        (void)iShuffleList.RemoveAt(index);
+        iShuffleList.Insert(cursorIndex, aTrack);
     }
     iPrevTrackId = aTrack->Id();
     LogIds(aLogPrefix);
 }
 
+void Shuffler::ShuffleList()
+{
+    iShuffleList.ToVector(iShuffleTemp);
+    std::random_shuffle(iShuffleTemp.begin(), iShuffleTemp.end());
+    iShuffleList.Assign(iShuffleTemp);
+    iShuffleTemp.clear();
+}
+
 void Shuffler::LogIds(const TChar* aPrefix)
 {
+    if (!Debug::TestLevel(Debug::kSources)) {
+        // avoid walking the entire (potentially very large) list when logging is disabled
+        return;
+    }
+    iShuffleList.ToVector(iShuffleTemp);
     LOG(kSources, "%s.  New track order is: { ", aPrefix);
-    if (iShuffleList.size() > 0) {
-        LOG(kSources, "%u", iShuffleList[0]->Id());
-        for (TUint i=1; i<iShuffleList.size(); i++) {
-            LOG(kSources, ", %u", iShuffleList[i]->Id());
+    if (iShuffleTemp.size() > 0) {
+        LOG(kSources, "%u", iShuffleTemp[0]->Id());
+        for (TUint i=1; i<iShuffleTemp.size(); i++) {
+            LOG(kSources, ", %u", iShuffleTemp[i]->Id());
         }
     }
     LOG(kSources, "}\n");
+    iShuffleTemp.clear();
 }
 
 
@@ -612,7 +631,6 @@ void Repeater::NotifyTrackInserted(Track& aTrack, TUint aIdBefore, TUint aIdAfte
 {
     iLock.Wait();
     iTrackCount++;
-    ASSERT(iTrackCount <= ITrackDatabase::kMaxTracks);
     iLock.Signal();
     iObserver->NotifyTrackInserted(aTrack, aIdBefore, aIdAfter);
 }
@@ -620,8 +638,8 @@ void Repeater::NotifyTrackInserted(Track& aTrack, TUint aIdBefore, TUint aIdAfte
 void Repeater::NotifyTrackDeleted(TUint aId, Track* aBefore, Track* aAfter)
 {
     iLock.Wait();
+    ASSERT(iTrackCount > 0);
     iTrackCount--;
-    ASSERT(iTrackCount <= ITrackDatabase::kMaxTracks);
     iLock.Signal();
     iObserver->NotifyTrackDeleted(aId, aBefore, aAfter);
 }
@@ -647,6 +665,15 @@ TUint TrackListUtils::IndexFromId(const std::vector<Track*>& aList, TUint aId)
     THROW(TrackDbIdNotFound);
 }
 
+TUint TrackListUtils::IndexFromId(const OrderedIdList<Track>& aList, TUint aId)
+{ // static
+    TUint index;
+    if (!aList.TryIndexOf(aId, index)) {
+        THROW(TrackDbIdNotFound);
+    }
+    return index;
+}
+
 void TrackListUtils::Clear(std::vector<Track*>& aList)
 { // static
     for (TUint i=0; i<aList.size(); i++) {
@@ -654,3 +681,11 @@ void TrackListUtils::Clear(std::vector<Track*>& aList)
     }
     aList.clear();
 }
+
+void TrackListUtils::Clear(OrderedIdList<Track>& aList)
+{ // static
+    std::vector<Track*> tracks;
+    aList.ToVector(tracks);
+    aList.Clear();
+    Clear(tracks);
+}
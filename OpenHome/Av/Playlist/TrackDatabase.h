@@ -4,6 +4,7 @@
 #include <OpenHome/Buffer.h>
 #include <OpenHome/Exception.h>
 #include <OpenHome/Private/Thread.h>
+#include <OpenHome/Av/Playlist/OrderedIdList.h>
 
 #include <array>
 #include <vector>
@@ -36,9 +37,11 @@ public:
 public:
     virtual ~ITrackDatabase() {}
     virtual void AddObserver(ITrackDatabaseObserver& aObserver) = 0;
-    virtual void GetIdArray(std::array<TUint32, kMaxTracks>& aIdArray, TUint& aSeq) const = 0;
+    virtual void GetIdArray(std::array<TUint32, kMaxTracks>& aIdArray, TUint& aSeq) const = 0; // first kMaxTracks ids only
+    virtual void GetIdArray(std::vector<TUint32>& aIdArray, TUint& aSeq) const = 0;
     virtual void GetTrackById(TUint aId, Media::Track*& aTrack) const = 0;
     virtual void GetTrackById(TUint aId, TUint aSeq, Media::Track*& aTrack, TUint& aIndex) const = 0;
+    virtual TBool TryIndexOf(TUint aId, TUint& aIndex) const = 0;
     virtual void Insert(TUint aIdAfter, const Brx& aUri, const Brx& aMetaData, TUint& aIdInserted) = 0;
     virtual void DeleteId(TUint aId) = 0;
     virtual void DeleteAll() = 0;
@@ -67,13 +70,15 @@ public:
 class TrackDatabase : public ITrackDatabase, public ITrackDatabaseReader
 {
 public:
-    TrackDatabase(Media::TrackFactory& aTrackFactory);
+    TrackDatabase(Media::TrackFactory& aTrackFactory, TUint aMaxTracks = kMaxTracks);
     ~TrackDatabase();
 private: // from ITrackDatabase
     void AddObserver(ITrackDatabaseObserver& aObserver) override;
     void GetIdArray(std::array<TUint32, kMaxTracks>& aIdArray, TUint& aSeq) const override;
+    void GetIdArray(std::vector<TUint32>& aIdArray, TUint& aSeq) const override;
     void GetTrackById(TUint aId, Media::Track*& aTrack) const override;
     void GetTrackById(TUint aId, TUint aSeq, Media::Track*& aTrack, TUint& aIndex) const override;
+    TBool TryIndexOf(TUint aId, TUint& aIndex) const override;
     void Insert(TUint aIdAfter, const Brx& aUri, const Brx& aMetaData, TUint& aIdInserted) override;
     void DeleteId(TUint aId) override;
     void DeleteAll() override;
@@ -87,13 +92,17 @@ private: // from ITrackDatabaseReader
     Media::Track* TrackRefByIndexSorted(TUint aIndex) override;
 private:
     void GetTrackByIdLocked(TUint aId, Media::Track*& aTrack) const;
-    TBool TryGetTrackById(TUint aId, Media::Track*& aTrack, TUint aStartIndex, TUint aEndIndex, TUint& aFoundIndex) const;
+    void UpdateIdArrayLocked() const;
 private:
     mutable Mutex iLock;
     Mutex iObserverLock;
     Media::TrackFactory& iTrackFactory;
+    const TUint iMaxTracks;
     std::vector<ITrackDatabaseObserver*> iObservers;
-    std::vector<Media::Track*> iTrackList;
+    OrderedIdList<Media::Track> iTrackList;
+    mutable std::vector<Media::Track*> iTracksTemp; // in-order copy of iTrackList.  Only used while iLock is held
+    mutable std::vector<TUint32> iIdArray; // ids from iTrackList, regenerated by GetIdArray when iIdArraySeq != iSeq
+    mutable TUint iIdArraySeq;
     TUint iSeq;
 };
 
@@ -121,13 +130,15 @@ private: // from ITrackDatabaseObserver
 private:
     void DoReshuffle(const TChar* aLogPrefix);
     void MoveToStartOfUnplayed(Media::Track* aTrack, const TChar* aLogPrefix);
+    void ShuffleList();
     void LogIds(const TChar* aPrefix);
 private:
     mutable Mutex iLock;
     Environment& iEnv;
     ITrackDatabaseReader& iReader;
     ITrackDatabaseObserver* iObserver;
-    std::vector<Media::Track*> iShuffleList;
+    OrderedIdList<Media::Track> iShuffleList;
+    std::vector<Media::Track*> iShuffleTemp; // only used while reshuffling
     TUint iPrevTrackId;
     TBool iShuffle;
 };
@@ -161,7 +172,9 @@ class TrackListUtils
 {
 public:
     static TUint IndexFromId(const std::vector<Media::Track*>& aList, TUint aId);
+    static TUint IndexFromId(const OrderedIdList<Media::Track>& aList, TUint aId);
     static void Clear(std::vector<Media::Track*>& aList);
+    static void Clear(OrderedIdList<Media::Track>& aList);
 };
 
 } // namespace Av
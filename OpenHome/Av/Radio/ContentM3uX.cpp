@@ -33,6 +33,9 @@
    #EXT-X-STREAM-INF:BANDWIDTH=65000,CODECS="mp4a.40.5"
    http://example.com/audio-only.m3u8
 
+ * If the master playlist can be read over http, it is passed on (as hls://...) so that
+ * ProtocolHls can switch between its variants as network conditions change.  Otherwise,
+ * the preferred variant (highest bandwidth, audio-only if possible) is passed on.
  */
 
 
@@ -205,6 +208,10 @@ ProtocolStreamResult ContentM3uX::Stream(IReader& aReader, TUint64 aTotalBytes)
         return EProtocolStreamErrorUnrecoverable;
     }
 
+    if (Ascii::CaseInsensitiveEquals(iUriPlaylist.Scheme(), kSchemeHttp)) {
+        StoreHlsUriAbsolute(iUriPlaylist);
+    }
+
     TBool streamSucceeded = false;
     ProtocolStreamResult res = iProtocolSet->Stream(iUriHls.AbsoluteUri());
     if (res == EProtocolStreamStopped) {
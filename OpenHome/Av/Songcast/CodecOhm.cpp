@@ -8,8 +8,10 @@
 #include <OpenHome/Av/Debug.h>
 #include <OpenHome/Av/Songcast/Ohm.h>
 #include <OpenHome/Av/Songcast/OhmMsg.h>
+#include <OpenHome/Av/Songcast/OhmFlac.h>
 
 #include <string.h>
+#include <algorithm>
 
 
 using namespace OpenHome;
@@ -23,10 +25,12 @@ CodecOhm::CodecOhm(OhmMsgFactory& aMsgFactory, IOhmTimestampMapper* aTsMapper)
     , iOffset(0)
     , iTsMapper(aTsMapper)
 {
+    iDecoder = new OhmFlacDecoder();
 }
 
 CodecOhm::~CodecOhm()
 {
+    delete iDecoder;
 }
 
 TBool CodecOhm::Recognise(const EncodedStreamInfo& aStreamInfo)
@@ -64,7 +68,8 @@ void CodecOhm::Process()
 
         if (!iStreamOutput) {
             const TUint64 trackLengthJiffies = jiffiesPerSample * msg->SamplesTotal();
-            iController->OutputDecodedStream(msg->BitRate(), msg->BitDepth(), sampleRate, msg->Channels(), msg->Codec(), trackLengthJiffies, msg->SampleStart(), msg->Lossless());
+            const Brn codecName = OhmFlac::OriginalCodecName(msg->Codec());
+            iController->OutputDecodedStream(msg->BitRate(), msg->BitDepth(), sampleRate, msg->Channels(), codecName, trackLengthJiffies, msg->SampleStart(), msg->Lossless());
             iStreamOutput = true;
         }
 
@@ -75,13 +80,14 @@ void CodecOhm::Process()
         }
 
         if (msg->Samples() > 0) {
+            const Brx& audio = Decompress(*msg);
             const TUint64 jiffiesStart = jiffiesPerSample * msg->SampleStart();
             if (msg->RxTimestamped() && msg->Timestamped()) {
                 TUint rxTstamp = (iTsMapper != nullptr) ? iTsMapper->ToOhmTimestamp(msg->RxTimestamp(), sampleRate) : msg->RxTimestamp();
-                iController->OutputAudioPcm(msg->Audio(), msg->Channels(), sampleRate, msg->BitDepth(), EMediaDataEndianBig, jiffiesStart, rxTstamp, msg->NetworkTimestamp());
+                iController->OutputAudioPcm(audio, msg->Channels(), sampleRate, msg->BitDepth(), EMediaDataEndianBig, jiffiesStart, rxTstamp, msg->NetworkTimestamp());
             }
             else {
-                iController->OutputAudioPcm(msg->Audio(), msg->Channels(), sampleRate, msg->BitDepth(), EMediaDataEndianBig, jiffiesStart);
+                iController->OutputAudioPcm(audio, msg->Channels(), sampleRate, msg->BitDepth(), EMediaDataEndianBig, jiffiesStart);
             }
         }
     }
@@ -142,6 +148,28 @@ void CodecOhm::OutputDelay()
     iController->OutputDelay(delayJiffies);
 }
 
+const Brx& CodecOhm::Decompress(const OhmMsgAudio& aMsg)
+{
+    if (!OhmFlac::IsCompressed(aMsg.Codec())) {
+        return aMsg.Audio();
+    }
+    try {
+        iDecoder->Decode(aMsg.Audio(), aMsg.Channels(), aMsg.BitDepth(), iDecoded);
+        if (iDecoded.Bytes() == aMsg.Samples() * aMsg.Channels() * (aMsg.BitDepth() / 8)) {
+            return iDecoded;
+        }
+    }
+    catch (OhmError&) {
+    }
+    /* Frame was corrupt.  Output silence in its place rather than dropping it so that
+       timestamps and sample positions of later frames remain consistent. */
+    Log::Print("WARNING: (CodecOhm) failed to decompress frame %u\n", aMsg.Frame());
+    const TUint bytes = std::min(aMsg.Samples() * aMsg.Channels() * (aMsg.BitDepth() / 8), iDecoded.MaxBytes());
+    iDecoded.SetBytes(bytes);
+    (void)memset(const_cast<TByte*>(iDecoded.Ptr()), 0, bytes);
+    return iDecoded;
+}
+
 void CodecOhm::Reset()
 {
     iBuf.SetBytes(0);
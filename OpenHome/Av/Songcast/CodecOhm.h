@@ -10,6 +10,8 @@
 namespace OpenHome {
 namespace Av {
 
+class OhmFlacDecoder;
+
 class CodecOhm : public Media::Codec::CodecBase, private IReader
 {
 public:
@@ -28,6 +30,7 @@ private: // from IReader
 private:
     void OutputDelay();
     void Reset();
+    const Brx& Decompress(const OhmMsgAudio& aMsg);
 private:
     OhmMsgFactory& iMsgFactory;
     Bws<OhmMsgAudioBlob::kMaxBytes> iBuf;
@@ -36,6 +39,8 @@ private:
     TUint iSampleRate;
     TUint iLatency;
     IOhmTimestampMapper* iTsMapper;
+    OhmFlacDecoder* iDecoder;
+    Bws<OhmMsgAudio::kMaxSampleBytes> iDecoded;
 };
 
 } // namespace Av
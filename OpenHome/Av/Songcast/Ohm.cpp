@@ -32,7 +32,7 @@ void OhmHeader::Internalise(IReader& aReader)
         THROW(OhmError);
     }
     iMsgType  = reader.ReadUintBe(1);
-    if(iMsgType > kMsgTypeResend && iMsgType != kMsgTypeAudioBlob) {
+    if(iMsgType > kMsgTypeParity && iMsgType != kMsgTypeAudioBlob) {
         THROW(OhmError);
     }
     iBytes = reader.ReadUintBe(2);
@@ -300,6 +300,37 @@ void OhmHeaderSlave::Externalise(IWriter& aWriter) const
     
     
 
+// OhmHeaderJoin
+
+OhmHeaderJoin::OhmHeaderJoin()
+    : iCapabilities(0)
+{
+}
+
+OhmHeaderJoin::OhmHeaderJoin(TUint aCapabilities)
+    : iCapabilities(aCapabilities)
+{
+}
+
+void OhmHeaderJoin::Internalise(IReader& aReader, const OhmHeader& aHeader)
+{
+    ASSERT(aHeader.MsgType() == OhmHeader::kMsgTypeJoin || aHeader.MsgType() == OhmHeader::kMsgTypeListen);
+
+    iCapabilities = 0;
+    if (aHeader.MsgBytes() >= kHeaderBytes) {
+        ReaderBinary readerBinary(aReader);
+        iCapabilities = readerBinary.ReadUintBe(4);
+    }
+}
+
+void OhmHeaderJoin::Externalise(IWriter& aWriter) const
+{
+    WriterBinary writer(aWriter);
+
+    writer.WriteUint32Be(iCapabilities);
+}
+
+
 // OhmHeaderResend
 
 OhmHeaderResend::OhmHeaderResend()
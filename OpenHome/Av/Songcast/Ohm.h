@@ -38,6 +38,7 @@ public:
     static const TUint kMsgTypeMetatext = 5;
     static const TUint kMsgTypeSlave = 6;
     static const TUint kMsgTypeResend = 7;
+    static const TUint kMsgTypeParity = 8;
     static const TUint kMsgTypeAudioBlob = 255; // locally generated, is never sent over the network
 
 public:
@@ -237,6 +238,31 @@ private:
     TUint iSlaveCount;
 };
 
+class OhmHeaderJoin // body of both join and listen msgs
+{
+public:
+    static const TUint kHeaderBytes = 4;
+    static const TUint kCapabilityFlac = 1 << 0; // receiver can decode OhmFlac compressed audio
+
+public:
+    OhmHeaderJoin();
+    OhmHeaderJoin(TUint aCapabilities);
+
+    void Internalise(IReader& aReader, const OhmHeader& aHeader);
+    void Externalise(IWriter& aWriter) const;
+
+    TUint Capabilities() const {return iCapabilities;}
+    TUint MsgBytes() const {return kHeaderBytes;}
+
+private:
+    //Offset    Bytes                   Desc
+    //0         4                       Capabilities (bitmask)
+    //
+    // Older receivers send join/listen msgs with no body.  These have no capabilities.
+
+    TUint iCapabilities;
+};
+
 class OhmHeaderResend
 {
 public:
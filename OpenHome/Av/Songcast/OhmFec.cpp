@@ -0,0 +1,230 @@
+#include <OpenHome/Av/Songcast/OhmFec.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Arch.h>
+#include <OpenHome/Private/Converter.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Av/Debug.h>
+#include <OpenHome/Av/Songcast/Ohm.h>
+#include <OpenHome/Av/Songcast/OhmMsg.h>
+
+#include <algorithm>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+static const TUint kAudioFlagsOffset = 1;
+static const TUint kAudioFrameOffset = 4;
+
+// OhmFec
+
+TUint OhmFec::GroupFirstFrame(TUint aFrame, TUint aGroupFrames)
+{ // static
+    return aFrame - (aFrame % aGroupFrames);
+}
+
+void OhmFec::XorInto(Bwx& aParity, const Brx& aAudio)
+{ // static
+    ASSERT(aAudio.Bytes() <= aParity.MaxBytes());
+    TByte* parity = const_cast<TByte*>(aParity.Ptr());
+    const TByte* audio = aAudio.Ptr();
+    const TUint common = std::min(aParity.Bytes(), aAudio.Bytes());
+    for (TUint i=0; i<common; i++) {
+        parity[i] ^= audio[i];
+    }
+    if (aAudio.Bytes() > common) {
+        // parity is implicitly zero padded
+        aParity.Append(audio + common, aAudio.Bytes() - common);
+    }
+    if (aAudio.Bytes() > kAudioFlagsOffset) {
+        parity[kAudioFlagsOffset] ^= (audio[kAudioFlagsOffset] & OhmMsgAudio::kFlagResent);
+    }
+}
+
+
+// OhmFecEncoder
+
+OhmFecEncoder::OhmFecEncoder()
+    : iFirstFrame(0)
+    , iGroupFrames(0)
+    , iBytesXor(0)
+{
+}
+
+void OhmFecEncoder::Begin(TUint aFirstFrame, TUint aGroupFrames)
+{
+    ASSERT(aGroupFrames >= OhmFec::kMinGroupFrames && aGroupFrames <= OhmFec::kMaxGroupFrames);
+    iFirstFrame = aFirstFrame;
+    iGroupFrames = aGroupFrames;
+    iBytesXor = 0;
+    iParity.SetBytes(0);
+}
+
+void OhmFecEncoder::Add(const Brx& aAudio)
+{
+    OhmFec::XorInto(iParity, aAudio);
+    iBytesXor ^= aAudio.Bytes();
+}
+
+void OhmFecEncoder::Externalise(IWriter& aWriter) const
+{
+    OhmHeader header(OhmHeader::kMsgTypeParity, OhmFec::kHeaderBytes + iParity.Bytes());
+    header.Externalise(aWriter);
+    WriterBinary writer(aWriter);
+    writer.WriteUint32Be(iFirstFrame);
+    writer.WriteUint8(iGroupFrames);
+    writer.WriteUint8(0);
+    writer.WriteUint16Be(iBytesXor);
+    aWriter.Write(iParity);
+}
+
+
+// OhmFecDecoder::Group
+
+OhmFecDecoder::Group::Group()
+{
+    Reset(0, 0);
+    iValid = false;
+}
+
+void OhmFecDecoder::Group::Reset(TUint aFirstFrame, TUint aGroupFrames)
+{
+    iValid = true;
+    iParity = false;
+    iRecovered = false;
+    iFirstFrame = aFirstFrame;
+    iGroupFrames = aGroupFrames;
+    iReceived = 0;
+    iRecoveredFrame = 0;
+    iBytesXor = 0;
+    iXor.SetBytes(0);
+}
+
+
+// OhmFecDecoder
+
+OhmFecDecoder::OhmFecDecoder()
+    : iGroupFrames(0)
+    , iFramesRecovered(0)
+{
+}
+
+void OhmFecDecoder::Reset()
+{
+    for (TUint i=0; i<kMaxGroups; i++) {
+        iGroups[i].iValid = false;
+    }
+    iGroupFrames = 0;
+}
+
+TBool OhmFecDecoder::AddAudio(TUint aFrame, const Brx& aAudio)
+{
+    if (iGroupFrames == 0) {
+        // sender isn't using fec (or we've not yet seen a parity msg)
+        return true;
+    }
+    const TUint first = OhmFec::GroupFirstFrame(aFrame, iGroupFrames);
+    Group* group = FindGroup(first, iGroupFrames);
+    if (group == nullptr) {
+        return true;
+    }
+    const TUint bit = 1 << (aFrame - first);
+    if ((group->iReceived & bit) != 0) {
+        return !(group->iRecovered && group->iRecoveredFrame == aFrame);
+    }
+    OhmFec::XorInto(group->iXor, aAudio);
+    group->iBytesXor ^= aAudio.Bytes();
+    group->iReceived |= bit;
+    return true;
+}
+
+void OhmFecDecoder::AddParity(IReader& aReader, const OhmHeader& aHeader)
+{
+    if (aHeader.MsgBytes() < OhmFec::kHeaderBytes) {
+        THROW(OhmError);
+    }
+    ReaderBinary reader(aReader);
+    const TUint first = reader.ReadUintBe(4);
+    const TUint groupFrames = reader.ReadUintBe(1);
+    (void)reader.ReadUintBe(1); // reserved
+    const TUint bytesXor = reader.ReadUintBe(2);
+    const TUint parityBytes = aHeader.MsgBytes() - OhmFec::kHeaderBytes;
+    if (groupFrames < OhmFec::kMinGroupFrames || groupFrames > OhmFec::kMaxGroupFrames ||
+        (first % groupFrames) != 0 || parityBytes > OhmFec::kMaxParityBytes) {
+        THROW(OhmError);
+    }
+    iGroupFrames = groupFrames;
+    Group* group = FindGroup(first, groupFrames);
+    if (group == nullptr || group->iParity) {
+        return;
+    }
+    reader.ReadReplace(parityBytes, iParity);
+    OhmFec::XorInto(group->iXor, iParity);
+    group->iBytesXor ^= bytesXor;
+    group->iParity = true;
+}
+
+TBool OhmFecDecoder::TryRecover(Bwx& aAudio)
+{
+    for (TUint i=0; i<kMaxGroups; i++) {
+        if (TryRecover(iGroups[i], aAudio)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TUint OhmFecDecoder::FramesRecovered() const
+{
+    return iFramesRecovered;
+}
+
+OhmFecDecoder::Group* OhmFecDecoder::FindGroup(TUint aFirstFrame, TUint aGroupFrames)
+{
+    Group& group = iGroups[(aFirstFrame / aGroupFrames) % kMaxGroups];
+    if (group.iValid && group.iFirstFrame == aFirstFrame && group.iGroupFrames == aGroupFrames) {
+        return &group;
+    }
+    if (!group.iValid || group.iGroupFrames != aGroupFrames || (TInt)(aFirstFrame - group.iFirstFrame) > 0) {
+        // slot held an older group (or nothing useful); reuse it
+        group.Reset(aFirstFrame, aGroupFrames);
+        return &group;
+    }
+    // frame belongs to a group that has already been discarded
+    return nullptr;
+}
+
+TBool OhmFecDecoder::TryRecover(Group& aGroup, Bwx& aAudio)
+{
+    if (!aGroup.iValid || !aGroup.iParity || aGroup.iRecovered) {
+        return false;
+    }
+    const TUint all = (1 << aGroup.iGroupFrames) - 1;
+    const TUint missing = all & ~aGroup.iReceived;
+    if (missing == 0 || (missing & (missing - 1)) != 0) {
+        // nothing to do or more than one frame missing
+        return false;
+    }
+    TUint index = 0;
+    while ((missing & (1 << index)) == 0) {
+        index++;
+    }
+    const TUint frame = aGroup.iFirstFrame + index;
+    aGroup.iRecovered = true; // whether or not the following succeeds, there's no point in trying again
+    const TUint bytes = aGroup.iBytesXor;
+    if (bytes < OhmHeaderAudio::kHeaderBytes || bytes > aGroup.iXor.Bytes() || bytes > aAudio.MaxBytes() ||
+        Converter::BeUint32At(aGroup.iXor, kAudioFrameOffset) != frame) {
+        LOG(kSongcast, "OhmFecDecoder: parity for frames %u-%u inconsistent, can't rebuild %u\n",
+                       aGroup.iFirstFrame, aGroup.iFirstFrame + aGroup.iGroupFrames - 1, frame);
+        return false;
+    }
+    aAudio.Replace(aGroup.iXor.Ptr(), bytes);
+    aAudio[kAudioFlagsOffset] = (TByte)(aAudio[kAudioFlagsOffset] | OhmMsgAudio::kFlagResent);
+    aGroup.iReceived |= missing;
+    aGroup.iRecoveredFrame = frame;
+    iFramesRecovered++;
+    LOG(kSongcast, "OhmFecDecoder: rebuilt frame %u\n", frame);
+    return true;
+}
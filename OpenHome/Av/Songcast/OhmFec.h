@@ -0,0 +1,104 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Av/Songcast/Ohm.h>
+#include <OpenHome/Av/Songcast/OhmMsg.h>
+
+namespace OpenHome {
+namespace Av {
+
+/*
+ * Optional forward error correction for songcast audio.
+ *
+ * The sender groups audio frames into runs of N consecutive frames (aligned so the first
+ * frame of a group is a multiple of N) and, after the last frame of each group, sends a
+ * parity msg holding the XOR of the group's audio msgs.  A receiver that is missing exactly
+ * one frame of a group can rebuild it from the parity and the other N-1 frames without
+ * waiting for a resend.  Overhead is one parity msg per N audio frames.
+ *
+ * Parity covers the audio msg body (everything after the OhmHeader) with the 'resent' flag
+ * masked out, so a group can be completed using frames that were themselves resent.
+ * Rebuilt frames are marked as resent.
+ */
+class OhmFec
+{
+public:
+    static const TUint kMinGroupFrames = 2;
+    static const TUint kMaxGroupFrames = 16;
+    static const TUint kHeaderBytes = 8;
+    static const TUint kMaxParityBytes = OhmMsgAudioBlob::kMaxBytes;
+public:
+    static TUint GroupFirstFrame(TUint aFrame, TUint aGroupFrames);
+    static void XorInto(Bwx& aParity, const Brx& aAudio);
+private:
+    //Offset    Bytes                   Desc
+    //0         4                       First frame in group
+    //4         1                       Frames in group
+    //5         1                       Reserved (must be zero)
+    //6         2                       XOR of the byte counts of all audio msg bodies in the group
+    //8         n                       XOR of all audio msg bodies in the group, each zero padded to n bytes
+};
+
+class OhmFecEncoder
+{
+public:
+    OhmFecEncoder();
+    void Begin(TUint aFirstFrame, TUint aGroupFrames);
+    void Add(const Brx& aAudio); // audio msg body, excluding OhmHeader
+    void Externalise(IWriter& aWriter) const; // complete parity msg, including OhmHeader
+private:
+    TUint iFirstFrame;
+    TUint iGroupFrames;
+    TUint iBytesXor;
+    Bws<OhmFec::kMaxParityBytes> iParity;
+};
+
+class OhmFecDecoder
+{
+    static const TUint kMaxGroups = 4;
+public:
+    OhmFecDecoder();
+    void Reset();
+    /*
+     * Returns false if aFrame has already been rebuilt from parity.  Callers should discard
+     * such frames rather than treat them as a sender reset.
+     */
+    TBool AddAudio(TUint aFrame, const Brx& aAudio);
+    void AddParity(IReader& aReader, const OhmHeader& aHeader); // throws OhmError for malformed msgs
+    /*
+     * Writes the body of a rebuilt audio msg (suitable for IOhmMsgFactory::CreateAudioBlob)
+     * into aAudio.  Returns false if no frame can currently be rebuilt.
+     */
+    TBool TryRecover(Bwx& aAudio);
+    TUint FramesRecovered() const;
+private:
+    class Group
+    {
+    public:
+        Group();
+        void Reset(TUint aFirstFrame, TUint aGroupFrames);
+    public:
+        TBool iValid;
+        TBool iParity;
+        TBool iRecovered;
+        TUint iFirstFrame;
+        TUint iGroupFrames;
+        TUint iReceived;     // bitmask, (1 << (frame - iFirstFrame))
+        TUint iRecoveredFrame;
+        TUint iBytesXor;
+        Bws<OhmFec::kMaxParityBytes> iXor;
+    };
+private:
+    Group* FindGroup(TUint aFirstFrame, TUint aGroupFrames);
+    TBool TryRecover(Group& aGroup, Bwx& aAudio);
+private:
+    Group iGroups[kMaxGroups];
+    TUint iGroupFrames;
+    TUint iFramesRecovered;
+    Bws<OhmFec::kMaxParityBytes> iParity;
+};
+
+} // namespace Av
+} // namespace OpenHome
@@ -0,0 +1,319 @@
+#include <OpenHome/Av/Songcast/OhmFlac.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Av/Debug.h>
+#include <OpenHome/Av/Songcast/Ohm.h>
+#include <FLAC/format.h>
+#include <FLAC/stream_encoder.h>
+#include <FLAC/stream_decoder.h>
+
+#include <algorithm>
+#include <string.h>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+
+// libFLAC callbacks are given distinct names as CodecFlac already defines global CallbackXxx functions
+
+static FLAC__StreamEncoderWriteStatus OhmFlacEncoderWrite(const FLAC__StreamEncoder* /*aEncoder*/,
+                                                          const FLAC__byte aBuffer[], size_t aBytes,
+                                                          unsigned aSamples, unsigned /*aCurrentFrame*/,
+                                                          void* aClientData)
+{
+    return reinterpret_cast<OhmFlacEncoder*>(aClientData)->CallbackWrite(aBuffer, aBytes, aSamples);
+}
+
+static FLAC__StreamDecoderReadStatus OhmFlacDecoderRead(const FLAC__StreamDecoder* /*aDecoder*/,
+                                                        FLAC__byte aBuffer[], size_t* aBytes,
+                                                        void* aClientData)
+{
+    return reinterpret_cast<OhmFlacDecoder*>(aClientData)->CallbackRead(aBuffer, aBytes);
+}
+
+static FLAC__StreamDecoderWriteStatus OhmFlacDecoderWrite(const FLAC__StreamDecoder* /*aDecoder*/,
+                                                          const FLAC__Frame* aFrame,
+                                                          const FLAC__int32* const aBuffer[],
+                                                          void* aClientData)
+{
+    return reinterpret_cast<OhmFlacDecoder*>(aClientData)->CallbackWrite(aFrame, aBuffer);
+}
+
+static void OhmFlacDecoderError(const FLAC__StreamDecoder* /*aDecoder*/,
+                                FLAC__StreamDecoderErrorStatus aStatus,
+                                void* aClientData)
+{
+    reinterpret_cast<OhmFlacDecoder*>(aClientData)->CallbackError(aStatus);
+}
+
+
+// OhmFlac
+
+const Brn OhmFlac::kCodecNamePrefix("OHMFLAC:");
+
+TBool OhmFlac::IsCompressed(const Brx& aCodecName)
+{ // static
+    return (aCodecName.Bytes() >= kCodecNamePrefix.Bytes() &&
+            Brn(aCodecName.Ptr(), kCodecNamePrefix.Bytes()) == kCodecNamePrefix);
+}
+
+Brn OhmFlac::OriginalCodecName(const Brx& aCodecName)
+{ // static
+    if (!IsCompressed(aCodecName)) {
+        return Brn(aCodecName);
+    }
+    return aCodecName.Split(kCodecNamePrefix.Bytes());
+}
+
+
+// OhmFlacEncoder
+
+OhmFlacEncoder::OhmFlacEncoder(TUint aMaxPcmBytes)
+    : iMaxSamples(aMaxPcmBytes / 2)
+    , iStarted(false)
+    , iChannels(0)
+    , iBitDepth(0)
+    , iSampleRate(0)
+    , iSamplesPerFrame(0)
+    , iOutput(nullptr)
+    , iOverflow(false)
+{
+    iEncoder = FLAC__stream_encoder_new();
+    ASSERT(iEncoder != nullptr);
+    iSamples = new FLAC__int32[iMaxSamples];
+}
+
+OhmFlacEncoder::~OhmFlacEncoder()
+{
+    Stop();
+    FLAC__stream_encoder_delete(iEncoder);
+    delete[] iSamples;
+}
+
+TBool OhmFlacEncoder::Start(TUint aChannels, TUint aBitDepth, TUint aSampleRate, TUint aSamplesPerFrame)
+{
+    Stop();
+    /* Frames are decoded without a STREAMINFO block so sample rate and bit depth must be
+       representable in each frame header.  Blocksize is always written to the frame header
+       since songcast frame sizes are not FLAC 'subset' blocksizes. */
+    if ((aBitDepth != 16 && aBitDepth != 24) ||
+        aChannels == 0 || aChannels > FLAC__MAX_CHANNELS ||
+        !FLAC__format_sample_rate_is_subset(aSampleRate) ||
+        aSamplesPerFrame < FLAC__MIN_BLOCK_SIZE || aSamplesPerFrame > FLAC__MAX_BLOCK_SIZE ||
+        aSamplesPerFrame * aChannels > iMaxSamples) {
+        return false;
+    }
+    FLAC__bool ok = FLAC__stream_encoder_set_compression_level(iEncoder, kCompressionLevel);
+    ok &= FLAC__stream_encoder_set_channels(iEncoder, aChannels);
+    ok &= FLAC__stream_encoder_set_bits_per_sample(iEncoder, aBitDepth);
+    ok &= FLAC__stream_encoder_set_sample_rate(iEncoder, aSampleRate);
+    ok &= FLAC__stream_encoder_set_blocksize(iEncoder, aSamplesPerFrame);
+    ok &= FLAC__stream_encoder_set_streamable_subset(iEncoder, false);
+    ok &= FLAC__stream_encoder_set_verify(iEncoder, false);
+    ASSERT(ok);
+    // the stream header written during init is discarded by CallbackWrite as iOutput is null
+    const FLAC__StreamEncoderInitStatus status = FLAC__stream_encoder_init_stream(iEncoder, OhmFlacEncoderWrite, nullptr, nullptr, nullptr, this);
+    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+        LOG(kSongcast, "OhmFlacEncoder: init failed (%d)\n", status);
+        return false;
+    }
+    iStarted = true;
+    iChannels = aChannels;
+    iBitDepth = aBitDepth;
+    iSampleRate = aSampleRate;
+    iSamplesPerFrame = aSamplesPerFrame;
+    return true;
+}
+
+TBool OhmFlacEncoder::Started() const
+{
+    return iStarted;
+}
+
+TBool OhmFlacEncoder::Matches(TUint aChannels, TUint aBitDepth, TUint aSampleRate, TUint aSamplesPerFrame) const
+{
+    return (iStarted &&
+            iChannels == aChannels &&
+            iBitDepth == aBitDepth &&
+            iSampleRate == aSampleRate &&
+            iSamplesPerFrame == aSamplesPerFrame);
+}
+
+TBool OhmFlacEncoder::Encode(const Brx& aPcm, Bwx& aEncoded)
+{
+    aEncoded.SetBytes(0);
+    if (!iStarted) {
+        return false;
+    }
+    const TUint bytesPerSample = iBitDepth / 8;
+    const TUint numSubsamples = iSamplesPerFrame * iChannels;
+    if (aPcm.Bytes() != numSubsamples * bytesPerSample) {
+        Stop();
+        return false;
+    }
+
+    const TByte* src = aPcm.Ptr();
+    if (iBitDepth == 16) {
+        for (TUint i=0; i<numSubsamples; i++) {
+            iSamples[i] = (TInt16)((src[0] << 8) | src[1]);
+            src += 2;
+        }
+    }
+    else {
+        for (TUint i=0; i<numSubsamples; i++) {
+            const TInt32 subsample = (TInt32)(((TUint)src[0] << 24) | ((TUint)src[1] << 16) | ((TUint)src[2] << 8));
+            iSamples[i] = subsample >> 8;
+            src += 3;
+        }
+    }
+
+    iOutput = &aEncoded;
+    iOverflow = false;
+    const FLAC__bool ok = FLAC__stream_encoder_process_interleaved(iEncoder, iSamples, iSamplesPerFrame);
+    iOutput = nullptr;
+    if (!ok || iOverflow) {
+        LOG(kSongcast, "OhmFlacEncoder: encode failed (state %d)\n", FLAC__stream_encoder_get_state(iEncoder));
+        Stop();
+        return false;
+    }
+    return true;
+}
+
+TBool OhmFlacEncoder::Finish(Bwx& aEncoded)
+{
+    aEncoded.SetBytes(0);
+    if (!iStarted) {
+        return false;
+    }
+    iOutput = &aEncoded;
+    iOverflow = false;
+    const FLAC__bool ok = FLAC__stream_encoder_finish(iEncoder);
+    iOutput = nullptr;
+    iStarted = false;
+    return (ok && !iOverflow);
+}
+
+void OhmFlacEncoder::Stop()
+{
+    if (iStarted) {
+        iOutput = nullptr;
+        (void)FLAC__stream_encoder_finish(iEncoder);
+        iStarted = false;
+    }
+}
+
+FLAC__StreamEncoderWriteStatus OhmFlacEncoder::CallbackWrite(const FLAC__byte aBuffer[], size_t aBytes, unsigned aSamples)
+{
+    // Writes with no samples are the 'fLaC' marker and STREAMINFO.  Receivers don't need either.
+    if (iOutput == nullptr || aSamples == 0 || iOverflow) {
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    }
+    if (iOutput->Bytes() + aBytes > iOutput->MaxBytes()) {
+        iOverflow = true;
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    }
+    iOutput->Append(aBuffer, (TUint)aBytes);
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+
+// OhmFlacDecoder
+
+OhmFlacDecoder::OhmFlacDecoder()
+    : iInput(Brx::Empty())
+    , iInputOffset(0)
+    , iOutput(nullptr)
+    , iChannels(0)
+    , iBitDepth(0)
+    , iDecoded(false)
+    , iError(false)
+{
+    iDecoder = FLAC__stream_decoder_new();
+    ASSERT(iDecoder != nullptr);
+    const FLAC__StreamDecoderInitStatus status = FLAC__stream_decoder_init_stream(
+        iDecoder,
+        OhmFlacDecoderRead,
+        nullptr, // seek
+        nullptr, // tell
+        nullptr, // length
+        nullptr, // eof
+        OhmFlacDecoderWrite,
+        nullptr, // metadata
+        OhmFlacDecoderError,
+        this);
+    ASSERT(status == FLAC__STREAM_DECODER_INIT_STATUS_OK);
+}
+
+OhmFlacDecoder::~OhmFlacDecoder()
+{
+    (void)FLAC__stream_decoder_finish(iDecoder);
+    FLAC__stream_decoder_delete(iDecoder);
+}
+
+void OhmFlacDecoder::Decode(const Brx& aEncoded, TUint aChannels, TUint aBitDepth, Bwx& aPcm)
+{
+    // each frame is decoded in isolation; discard any state left over from a lost or corrupt predecessor
+    (void)FLAC__stream_decoder_flush(iDecoder);
+    iInput.Set(aEncoded);
+    iInputOffset = 0;
+    iOutput = &aPcm;
+    iOutput->SetBytes(0);
+    iChannels = aChannels;
+    iBitDepth = aBitDepth;
+    iDecoded = false;
+    iError = false;
+
+    const FLAC__bool ok = FLAC__stream_decoder_process_single(iDecoder);
+    iOutput = nullptr;
+    iInput.Set(Brx::Empty());
+    if (!ok || !iDecoded || iError) {
+        LOG(kSongcast, "OhmFlacDecoder: failed to decode frame (state %d)\n", FLAC__stream_decoder_get_state(iDecoder));
+        THROW(OhmError);
+    }
+}
+
+FLAC__StreamDecoderReadStatus OhmFlacDecoder::CallbackRead(FLAC__byte aBuffer[], size_t* aBytes)
+{
+    const TUint remaining = iInput.Bytes() - iInputOffset;
+    if (remaining == 0) {
+        *aBytes = 0;
+        return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+    }
+    const TUint bytes = std::min(remaining, (TUint)*aBytes);
+    (void)memcpy(aBuffer, iInput.Ptr() + iInputOffset, bytes);
+    iInputOffset += bytes;
+    *aBytes = bytes;
+    return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderWriteStatus OhmFlacDecoder::CallbackWrite(const FLAC__Frame* aFrame, const FLAC__int32* const aBuffer[])
+{
+    const FLAC__FrameHeader& header = aFrame->header;
+    const TUint bytesPerSample = iBitDepth / 8;
+    if (header.channels != iChannels || header.bits_per_sample != iBitDepth ||
+        header.blocksize * iChannels * bytesPerSample > iOutput->MaxBytes()) {
+        iError = true;
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+    }
+    TByte* dest = const_cast<TByte*>(iOutput->Ptr());
+    for (TUint i=0; i<header.blocksize; i++) {
+        for (TUint ch=0; ch<iChannels; ch++) {
+            const FLAC__int32 subsample = aBuffer[ch][i];
+            if (bytesPerSample == 3) {
+                *dest++ = (TByte)(subsample >> 16);
+            }
+            *dest++ = (TByte)(subsample >> 8);
+            *dest++ = (TByte)subsample;
+        }
+    }
+    iOutput->SetBytes(header.blocksize * iChannels * bytesPerSample);
+    iDecoded = true;
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void OhmFlacDecoder::CallbackError(FLAC__StreamDecoderErrorStatus aStatus)
+{
+    LOG(kSongcast, "OhmFlacDecoder: error %d\n", aStatus);
+    iError = true;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <FLAC/format.h>
+#include <FLAC/stream_encoder.h>
+#include <FLAC/stream_decoder.h>
+
+namespace OpenHome {
+namespace Av {
+
+/*
+ * Optional lossless compression of songcast audio frames.
+ *
+ * Each songcast frame is encoded as a single FLAC frame.  No stream header is sent and FLAC
+ * frames don't depend on their predecessors so frames remain independently decodable for
+ * repair and resend.  Compressed frames
+ * are identified by a prefix on the frame's codec name; the remainder of the name is the
+ * codec of the original stream, for display by receivers.
+ */
+class OhmFlac
+{
+public:
+    static const Brn kCodecNamePrefix;
+public:
+    static TBool IsCompressed(const Brx& aCodecName);
+    static Brn OriginalCodecName(const Brx& aCodecName);
+};
+
+/*
+ * One libFLAC encoder, initialised once per stream of equal sized frames.
+ *
+ * libFLAC only completes a block once it has seen the first sample of the following one,
+ * so the FLAC frame for each block of pcm is output by the *next* call to Encode() (or by
+ * Finish() for the last block).
+ */
+class OhmFlacEncoder
+{
+    static const TUint kCompressionLevel = 1;
+public:
+    OhmFlacEncoder(TUint aMaxPcmBytes);
+    ~OhmFlacEncoder();
+    /*
+     * Start a stream of frames, each of aSamplesPerFrame samples.  Any stream in progress is abandoned.
+     * Returns false if this format can't be encoded.  Callers should send pcm instead.
+     */
+    TBool Start(TUint aChannels, TUint aBitDepth, TUint aSampleRate, TUint aSamplesPerFrame);
+    TBool Started() const;
+    TBool Matches(TUint aChannels, TUint aBitDepth, TUint aSampleRate, TUint aSamplesPerFrame) const; // false if !Started()
+    /*
+     * Add one frame of big-endian interleaved pcm.  aEncoded receives the FLAC frame for the
+     * pcm passed to the previous call (and is empty following Start()).
+     * Returns false, and stops the stream, on any error.
+     */
+    TBool Encode(const Brx& aPcm, Bwx& aEncoded);
+    /*
+     * Complete the stream.  aEncoded receives the FLAC frame for the pcm passed to the last
+     * call to Encode() (and is empty if there was no such call).
+     */
+    TBool Finish(Bwx& aEncoded);
+    void Stop(); // abandons any frame not yet output
+public:
+    FLAC__StreamEncoderWriteStatus CallbackWrite(const FLAC__byte aBuffer[], size_t aBytes, unsigned aSamples);
+private:
+    FLAC__StreamEncoder* iEncoder;
+    FLAC__int32* iSamples;
+    const TUint iMaxSamples;
+    TBool iStarted;
+    TUint iChannels;
+    TUint iBitDepth;
+    TUint iSampleRate;
+    TUint iSamplesPerFrame;
+    Bwx* iOutput;
+    TBool iOverflow;
+};
+
+class OhmFlacDecoder
+{
+public:
+    OhmFlacDecoder();
+    ~OhmFlacDecoder();
+    /*
+     * Decode a frame produced by OhmFlacEncoder into big-endian interleaved pcm.
+     * Throws OhmError if aEncoded isn't a valid frame or doesn't match aChannels/aBitDepth.
+     */
+    void Decode(const Brx& aEncoded, TUint aChannels, TUint aBitDepth, Bwx& aPcm);
+public:
+    FLAC__StreamDecoderReadStatus CallbackRead(FLAC__byte aBuffer[], size_t* aBytes);
+    FLAC__StreamDecoderWriteStatus CallbackWrite(const FLAC__Frame* aFrame, const FLAC__int32* const aBuffer[]);
+    void CallbackError(FLAC__StreamDecoderErrorStatus aStatus);
+private:
+    FLAC__StreamDecoder* iDecoder;
+    Brn iInput;
+    TUint iInputOffset;
+    Bwx* iOutput;
+    TUint iChannels;
+    TUint iBitDepth;
+    TBool iDecoded;
+    TBool iError;
+};
+
+} // namespace Av
+} // namespace OpenHome
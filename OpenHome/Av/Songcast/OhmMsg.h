@@ -132,6 +132,7 @@ public:
     TByte Flags() const { return iFlags; }
     TUint Frame() const { return iFrame; }
     TUint64 SampleStart() const { return iSampleStart; }
+    const Brx& Blob() const { return iBlob; }
     void ExternaliseAsBlob(IWriter& aWriter);
 public: // from OhmMsg
     void Process(IOhmMsgProcessor& aProcessor) override;
@@ -7,10 +7,12 @@
 #include <OpenHome/Av/Debug.h>
 #include <OpenHome/Av/Songcast/ZoneHandler.h>
 #include <OpenHome/Av/Songcast/OhmTimestamp.h>
+#include <OpenHome/Av/Songcast/OhmFlac.h>
 #include <OpenHome/Private/NetworkAdapterList.h>
 #include <OpenHome/Net/Core/OhNet.h>
 
 #include <stdio.h>
+#include <algorithm>
 
 namespace OpenHome {
 class Environment;
@@ -172,6 +174,7 @@ void ProviderSender::NotifyAudioPlaying(TBool aPlaying)
 
 OhmSenderDriver::OhmSenderDriver(Environment& aEnv, IOhmTimestamper* aTimestamper, IOhmTimestampMapper* aTsMapper)
     : iMutex("OHMD")
+    , iResendLock("OHMR")
     , iEnabled(false)
     , iActive(false)
     , iSend(false)
@@ -181,27 +184,74 @@ OhmSenderDriver::OhmSenderDriver(Environment& aEnv, IOhmTimestamper* aTimestampe
     , iChannels(0)
     , iBitDepth(0)
     , iLossless(false)
+    , iCompress(false)
+    , iCompressionSupported(false)
+    , iPendingSamples(0)
+    , iFecGroupFrames(0)
     , iSamplesTotal(0)
     , iSampleStart(0)
     , iLatency(100)
     , iSocket(aEnv)
-    , iFactory(100, 10, 10, 10) // FIXME - rationale for msg counts??
+    , iFactory(1, 10, 10, 10) // audio msgs are externalised into iHistory then released immediately
+    , iResendBuf(kMaxResendBatchFrames * kMaxAudioFrameBytes)
     , iTimestamper(aTimestamper)
     , iFirstFrame(true)
     , iTsMapper(aTsMapper)
 {
+    iHistory = new HistoryPacket[kMaxHistoryFrames];
+    iEncoder = new OhmFlacEncoder(OhmMsgAudio::kMaxSampleBytes);
+}
+
+OhmSenderDriver::~OhmSenderDriver()
+{
+    delete[] iHistory;
+    delete iEncoder;
 }
 
 void OhmSenderDriver::SetAudioFormat(TUint aSampleRate, TUint aBitRate, TUint aChannels, TUint aBitDepth, TBool aLossless, const Brx& aCodecName)
 {
     AutoMutex mutex(iMutex);
 
+    FlushEncoderLocked(); // pending frame was encoded in the previous format
     iSampleRate = aSampleRate;
     iBitRate = aBitRate;
     iChannels = aChannels;
     iBitDepth = aBitDepth;
     iLossless = aLossless;
     iCodecName.Replace(aCodecName);
+    iCodecNameCompressed.Replace(OhmFlac::kCodecNamePrefix);
+    iCodecNameCompressed.Append(Brn(aCodecName.Ptr(), std::min(aCodecName.Bytes(), iCodecNameCompressed.MaxBytes() - iCodecNameCompressed.Bytes())));
+}
+
+void OhmSenderDriver::SetCompression(TBool aEnable)
+{
+    AutoMutex mutex(iMutex);
+    iCompress = aEnable;
+    if (!CompressLocked()) {
+        FlushEncoderLocked();
+    }
+}
+
+void OhmSenderDriver::SetCompressionSupported(TBool aValue)
+{
+    AutoMutex mutex(iMutex);
+    iCompressionSupported = aValue;
+    if (!CompressLocked()) {
+        FlushEncoderLocked();
+    }
+}
+
+TBool OhmSenderDriver::CompressLocked() const
+{
+    // FLAC frames played as pcm by a receiver that can't decode them would be noise
+    return iCompress && iCompressionSupported;
+}
+
+void OhmSenderDriver::SetErrorCorrection(TUint aGroupFrames)
+{
+    ASSERT(aGroupFrames == 0 || (aGroupFrames >= OhmFec::kMinGroupFrames && aGroupFrames <= OhmFec::kMaxGroupFrames));
+    AutoMutex mutex(iMutex);
+    iFecGroupFrames = aGroupFrames;
 }
 
 void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes, TBool aHalt)
@@ -223,14 +273,68 @@ void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes, TBool aHalt)
         // nothing to usefully communicate to receivers
         return;
     }
+    Brn audio(aData, aBytes);
+    if (CompressLocked() && !aHalt && samples > 0 && EncodeLocked(audio, samples)) {
+        return;
+    }
+    // pcm.  Any compressed frame still held by the encoder must be sent first
+    FlushEncoderLocked();
+    SendAudioLocked(audio, samples, aHalt, iCodecName);
+}
+
+TBool OhmSenderDriver::EncodeLocked(const Brx& aAudio, TUint aSamples)
+{
+    /* A single encoder is used for the whole stream and is only restarted when the format
+       (or frame size) changes.  The encoder outputs the FLAC frame for its previous input
+       so each frame is held in iPendingAudio until its compressed form is available. */
+    if (!iEncoder->Matches(iChannels, iBitDepth, iSampleRate, aSamples)) {
+        FlushEncoderLocked();
+        if (!iEncoder->Start(iChannels, iBitDepth, iSampleRate, aSamples)) {
+            return false;
+        }
+    }
+    if (!iEncoder->Encode(aAudio, iEncoded)) {
+        if (iPendingSamples > 0) {
+            SendPendingLocked(Brx::Empty());
+        }
+        return false;
+    }
+    if (iPendingSamples > 0) {
+        SendPendingLocked(iEncoded);
+    }
+    iPendingAudio.Replace(aAudio);
+    iPendingSamples = aSamples;
+    return true;
+}
+
+void OhmSenderDriver::SendPendingLocked(const Brx& aEncoded)
+{
+    // Compressed frames are self-describing (via their codec name) so receivers cope with
+    // the sender falling back to pcm for any frame that doesn't compress usefully.
+    if (aEncoded.Bytes() > 0 && aEncoded.Bytes() < iPendingAudio.Bytes()) {
+        SendAudioLocked(aEncoded, iPendingSamples, false, iCodecNameCompressed);
+    }
+    else {
+        SendAudioLocked(iPendingAudio, iPendingSamples, false, iCodecName);
+    }
+    iPendingSamples = 0;
+}
+
+void OhmSenderDriver::FlushEncoderLocked()
+{
+    const TBool finished = iEncoder->Finish(iEncoded); // false (and no output) if not started
+    if (iPendingSamples > 0) {
+        SendPendingLocked(finished? static_cast<const Brx&>(iEncoded) : Brx::Empty());
+    }
+}
+
+void OhmSenderDriver::SendAudioLocked(const Brx& aAudio, TUint aSamples, TBool aHalt, const Brx& aCodecName)
+{
     TUint multiplier = 48000 * 256;
     if ((iSampleRate % 441) == 0) {
         multiplier = 44100 * 256;
     }
     const TUint latency = iLatency * multiplier / 1000;
-    if (iFifoHistory.SlotsUsed() == kMaxHistoryFrames) {
-        iFifoHistory.Read()->RemoveRef();
-    }
 
     TBool isTimeStamped = false;
     TUint timeStamp = 0;
@@ -253,7 +357,7 @@ void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes, TBool aHalt)
         iLossless,
         isTimeStamped,
         false,
-        samples,
+        aSamples,
         iFrame,
         timeStamp, // network timestamp
         latency,
@@ -265,22 +369,28 @@ void OhmSenderDriver::SendAudio(const TByte* aData, TUint aBytes, TBool aHalt)
         0, // volume offset
         iBitDepth,
         iChannels,
-        iCodecName,
-        Brn(aData, aBytes)
+        aCodecName,
+        aAudio
     );
 
-    WriterBuffer writer(iBuffer);
+    // Externalise once, straight into this frame's history slot.  The oldest
+    // frame sharing the slot is overwritten, which bounds history to kMaxHistoryFrames.
+    HistoryPacket& packet = iHistory[iFrame % kMaxHistoryFrames];
+    WriterBuffer writer(packet.iData);
     writer.Flush();
     msg->Externalise(writer);
-    msg->SetResent(true);
-    iFifoHistory.Write(msg);
-    try {
-        iSocket.Send(iBuffer, iEndpoint);
-    }
-    catch (NetworkError&) {
+    msg->RemoveRef();
+    packet.iFrame = iFrame;
+    packet.iValid = true;
+    SendLocked(packet.iData);
+    // any later transmission of this packet will be a resend
+    const TByte flags = packet.iData[kFlagsOffset];
+    packet.iData[kFlagsOffset] = (TByte)(flags | OhmMsgAudio::kFlagResent);
+    if (iFecGroupFrames > 0 && (iFrame % iFecGroupFrames) == iFecGroupFrames - 1) {
+        SendParityLocked();
     }
 
-    iSampleStart += samples;
+    iSampleStart += aSamples;
     iFrame++;
 }
 
@@ -332,6 +442,48 @@ void OhmSenderDriver::SetEndpoint(const Endpoint& aEndpoint, TIpAddress aAdapter
     iAdapter = aAdapter;
 }
 
+void OhmSenderDriver::SetSlaves(const std::vector<Endpoint>& aSlaves)
+{
+    AutoMutex mutex(iMutex);
+    iSlaves = aSlaves;
+}
+
+void OhmSenderDriver::SendLocked(const Brx& aPacket)
+{
+    // The same serialised packet is sent to every receiver
+    try {
+        iSocket.Send(aPacket, iEndpoint);
+    }
+    catch (NetworkError&) {
+    }
+    for (auto it=iSlaves.begin(); it!=iSlaves.end(); ++it) {
+        try {
+            iSocket.Send(aPacket, *it);
+        }
+        catch (NetworkError&) {
+        }
+    }
+}
+
+void OhmSenderDriver::SendParityLocked()
+{
+    // Parity covers the group ending with the frame just sent.  All of its frames are still in iHistory.
+    const TUint first = OhmFec::GroupFirstFrame(iFrame, iFecGroupFrames);
+    iFecEncoder.Begin(first, iFecGroupFrames);
+    for (TUint frame=first; frame!=iFrame+1; frame++) {
+        const HistoryPacket& packet = iHistory[frame % kMaxHistoryFrames];
+        if (!packet.iValid || packet.iFrame != frame) {
+            // we started sending part way through this group
+            return;
+        }
+        iFecEncoder.Add(packet.iData.Split(OhmHeader::kHeaderBytes));
+    }
+    WriterBuffer writer(iFecPacket);
+    writer.Flush();
+    iFecEncoder.Externalise(writer);
+    SendLocked(iFecPacket);
+}
+
 void OhmSenderDriver::SetTtl(TUint aValue)
 {
     AutoMutex mutex(iMutex);
@@ -347,73 +499,62 @@ void OhmSenderDriver::SetLatency(TUint aValue)
 void OhmSenderDriver::SetTrackPosition(TUint64 aSamplesTotal, TUint64 aSampleStart)
 {
     AutoMutex mutex(iMutex);
+    FlushEncoderLocked(); // pending frame belongs to the previous track
     iSamplesTotal = aSamplesTotal;
     iSampleStart = aSampleStart;
 }
 
-void OhmSenderDriver::Resend(OhmMsgAudio& aMsg)
+TUint OhmSenderDriver::CopyResendBatchLocked(ReaderBinary& aReader, TUint& aFramesRemaining)
 {
-    WriterBuffer writer(iBuffer);
-    writer.Flush();
-    aMsg.Externalise(writer);
-    try {
-        iSocket.Send(iBuffer, iEndpoint);
-    }
-    catch (NetworkError&) {
+    // Copies up to kMaxResendBatchFrames requested packets out of iHistory.
+    // Each lookup is O(1); frames no longer held in history are skipped.
+    iResendBuf.SetBytes(0);
+    TUint count = 0;
+    while (aFramesRemaining > 0 && count < kMaxResendBatchFrames) {
+        const TUint frame = aReader.ReadUintBe(4);
+        aFramesRemaining--;
+        LOG(kSongcast, " %lu", (unsigned long)frame);
+        const HistoryPacket& packet = iHistory[frame % kMaxHistoryFrames];
+        if (!packet.iValid || packet.iFrame != frame) {
+            continue;
+        }
+        iResendBuf.Append(packet.iData);
+        iResendBytes[count++] = packet.iData.Bytes();
     }
+    return count;
 }
 
-void OhmSenderDriver::Resend(const Brx& aFrames)
+void OhmSenderDriver::Resend(const Brx& aFrames, const Endpoint& aEndpoint)
 {
-    AutoMutex mutex(iMutex);
+    /* iResendLock serialises resend requests (and so use of iResendBuf).
+       iMutex is only held while packets are copied out of history so that
+       SendAudio is never blocked behind network writes for resent frames. */
+    AutoMutex _(iResendLock);
     LOG(kSongcast, "RESEND");
+    iResendEndpoint.Replace(aEndpoint); // only the requesting receiver (or multicast group) needs these frames
 
     ReaderBuffer buffer(aFrames);
     ReaderBinary reader(buffer);
     TUint frames = aFrames.Bytes() / 4;
-    TUint frame = reader.ReadUintBe(4);
-    frames--;
-    LOG(kSongcast, " %lu", (unsigned long)frame);
-    TBool found = false;
-    TUint count = iFifoHistory.SlotsUsed();
-    for (TUint i = 0; i < count; i++) {
-        OhmMsgAudio* msg = iFifoHistory.Read();
-        if (!found) {
-            TInt diff = frame - msg->Frame();
-            if (diff == 0) {
-                Resend(*msg);
-                if (frames-- > 0) {
-                    frame = reader.ReadUintBe(4);
-                }
-                else {
-                    found = true;
-                }
+    while (frames > 0) {
+        TUint count;
+        {
+            AutoMutex mutex(iMutex);
+            if (!iSend) {
+                break;
             }
-            else {
-                while (diff < 0) {
-                    if (frames-- > 0) {
-                        frame = reader.ReadUintBe(4);
-                    }
-                    else {
-                        found = true;
-                        break;
-                    }
-                    diff = frame - msg->Frame();
-                    if (diff == 0) {
-                        Resend(*msg);
-                        if (frames-- > 0) {
-                            frame = reader.ReadUintBe(4);
-                        }
-                        else {
-                            found = true;
-                        }
-                        break;
-                    }
-                }
+            count = CopyResendBatchLocked(reader, frames);
+        }
+        TUint offset = 0;
+        for (TUint i = 0; i < count; i++) {
+            const TUint bytes = iResendBytes[i];
+            try {
+                iSocket.Send(Brn(iResendBuf.Ptr() + offset, bytes), iResendEndpoint);
             }
+            catch (NetworkError&) {
+            }
+            offset += bytes;
         }
-
-        iFifoHistory.Write(msg);
     }
     LOG(kSongcast, "\n");
 }
@@ -423,12 +564,14 @@ void OhmSenderDriver::ResetLocked()
     iSend = false;
     iFrame = 0;
     iFirstFrame = true;
+    iEncoder->Stop(); // receivers won't get any frame it still holds
+    iSampleStart += iPendingSamples;
+    iPendingSamples = 0;
     if (iTimestamper != nullptr) {
         iTimestamper->Stop();
     }
-    const TUint count = iFifoHistory.SlotsUsed();
-    for (TUint i = 0; i < count; i++) {
-        iFifoHistory.Read()->RemoveRef();
+    for (TUint i = 0; i < kMaxHistoryFrames; i++) {
+        iHistory[i].iValid = false;
     }
 }
 
@@ -457,6 +600,9 @@ OhmSender::OhmSender(Environment& aEnv, Net::DvDeviceStandard& aDevice, IOhmSend
     , iActive(false)
     , iAliveJoined(false)
     , iAliveBlocked(false)
+    , iTargetDecodesFlac(false)
+    , iPcmReceiverSeen(false)
+    , iPcmReceiverExpiry(0)
     , iSequenceTrack(0)
     , iSequenceMetatext(0)
     , iClientControllingTrackMetadata(false)
@@ -738,8 +884,10 @@ void OhmSender::RunMulticast()
                     
                     if (header.MsgType() <= OhmHeader::kMsgTypeListen) {
                         LOG(kSongcast, "OhmSender::RunMulticast join/listen received\n");
+                        const TBool decodesFlac = ReadDecodesFlac(header);
                         
                         AutoMutex mutex(iMutexActive);
+                        UpdateMulticastCompression(decodesFlac);
                         
                         if (header.MsgType() == OhmHeader::kMsgTypeJoin) {
                             SendTrack();
@@ -761,7 +909,7 @@ void OhmSender::RunMulticast()
 
                         TUint frames = headerResend.FramesCount();
                         if (frames > 0) {
-                            iDriver.Resend(iRxBuffer.Read(frames * 4));
+                            iDriver.Resend(iRxBuffer.Read(frames * 4), iTargetEndpoint);
                         }
                     }
                     else if (header.MsgType() == OhmHeader::kMsgTypeAudio) {
@@ -814,6 +962,8 @@ void OhmSender::RunMulticast()
             } 
             iAliveJoined = false;
             iAliveBlocked = false;
+            iPcmReceiverSeen = false;
+            iDriver.SetCompressionSupported(false);
         }
         
         iNetworkDeactivated.Signal();
@@ -829,6 +979,7 @@ void OhmSender::RunUnicast()
         LOG(kSongcast, "OhmSender::RunUnicast go\n");
         try {
             for (;;) {
+                TBool targetDecodesFlac = false;
                 // wait for first receiver to join
                 // if we receive a listen, it's probably from a temporarily physically disconnected receiver
                 // so accept them as well
@@ -839,6 +990,7 @@ void OhmSender::RunUnicast()
                         
                         if (header.MsgType() <= OhmHeader::kMsgTypeListen) {
                             LOG(kSongcast, "OhmSender::RunUnicast ready/join or listen (%u)\n", header.MsgType());
+                            targetDecodesFlac = ReadDecodesFlac(header);
                             break;                        
                         }
                     }
@@ -854,9 +1006,11 @@ void OhmSender::RunUnicast()
                 LOG(kSongcast, "OHM SENDER DRIVER ENDPOINT %x:%d\n", iTargetEndpoint.Address(), iTargetEndpoint.Port());
                 SendTrack();
                 SendMetatext();
-                iSlaveCount = 0;
                 { // scope for AutoMutex
                     AutoMutex mutex(iMutexActive);
+                    iSlaves.clear();
+                    iTargetDecodesFlac = targetDecodesFlac;
+                    UpdateDriverSlaves();
                     iActive = true;
                     iAliveJoined = true;
                     iDriver.SetActive(true);
@@ -872,27 +1026,33 @@ void OhmSender::RunUnicast()
                         if (header.MsgType() == OhmHeader::kMsgTypeJoin) {
                             LOG(kSongcast, "OhmSender::RunUnicast sending/join\n");
                             Endpoint sender(iSocketOhm.Sender());
+                            const TBool decodesFlac = ReadDecodesFlac(header);
                             if (sender.Equals(iTargetEndpoint)) {
                                 iTimerExpiry->FireIn(kTimerExpiryTimeoutMs);
+                                AutoMutex mutex(iMutexActive);
+                                if (iTargetDecodesFlac != decodesFlac) {
+                                    iTargetDecodesFlac = decodesFlac;
+                                    UpdateDriverSlaves();
+                                }
                             }
                             else {
+                                AutoMutex mutex(iMutexActive);
                                 TUint slave = FindSlave(sender);
-                                if (slave >= iSlaveCount) {
-                                    if (slave < kMaxSlaveCount) {
-                                        iSlaveList[slave].Replace(sender);
-                                        iSlaveExpiry[slave] = Time::Now(iEnv) + kTimerExpiryTimeoutMs;
-                                        iSlaveCount++;
-
-                                        Endpoint::EndpointBuf buf;
-                                        sender.AppendEndpoint(buf);
-                                        LOG(kSongcast, "OhmSender::RunUnicast new slave: %s (#%u)\n", buf.Ptr(), iSlaveCount);
-
-                                        AutoMutex mutex(iMutexActive);
-                                        SendListen(sender);
-                                    }
+                                if (slave >= iSlaves.size()) {
+                                    AddSlave(sender, decodesFlac);
+
+                                    Endpoint::EndpointBuf buf;
+                                    sender.AppendEndpoint(buf);
+                                    LOG(kSongcast, "OhmSender::RunUnicast new slave: %s (#%u)\n", buf.Ptr(), (TUint)iSlaves.size());
+
+                                    SendListen(sender);
                                 }
                                 else {
-                                    iSlaveExpiry[slave] = Time::Now(iEnv) + kTimerExpiryTimeoutMs;
+                                    iSlaves[slave].iExpiry = Time::Now(iEnv) + kTimerExpiryTimeoutMs;
+                                    if (iSlaves[slave].iDecodesFlac != decodesFlac) {
+                                        iSlaves[slave].iDecodesFlac = decodesFlac;
+                                        UpdateDriverSlaves();
+                                    }
                                 }
                             }
 
@@ -903,6 +1063,7 @@ void OhmSender::RunUnicast()
                         }
                         else if (header.MsgType() == OhmHeader::kMsgTypeListen) {
                             Endpoint sender(iSocketOhm.Sender());
+                            const TBool decodesFlac = ReadDecodesFlac(header);
 
                             Endpoint::EndpointBuf endptBuf;
                             sender.AppendEndpoint(endptBuf);
@@ -910,31 +1071,35 @@ void OhmSender::RunUnicast()
 
                             if (sender.Equals(iTargetEndpoint)) {
                                 iTimerExpiry->FireIn(kTimerExpiryTimeoutMs);
+                                AutoMutex mutex(iMutexActive);
+                                if (iTargetDecodesFlac != decodesFlac) {
+                                    iTargetDecodesFlac = decodesFlac;
+                                    UpdateDriverSlaves();
+                                }
                                 if (CheckSlaveExpiry()) {
-                                    AutoMutex mutex(iMutexActive);
                                     SendSlaveList();
                                 }
                             }
                             else {
+                                AutoMutex mutex(iMutexActive);
                                 TUint slave = FindSlave(sender);
-                                if (slave < iSlaveCount) {
-                                    iSlaveExpiry[slave] = Time::Now(iEnv) + kTimerExpiryTimeoutMs;
+                                if (slave < iSlaves.size()) {
+                                    iSlaves[slave].iExpiry = Time::Now(iEnv) + kTimerExpiryTimeoutMs;
+                                    if (iSlaves[slave].iDecodesFlac != decodesFlac) {
+                                        iSlaves[slave].iDecodesFlac = decodesFlac;
+                                        UpdateDriverSlaves();
+                                    }
                                 }
                                 else {
                                     // unknown slave, probably temporarily physically disconnected receiver
-                                    if (slave < kMaxSlaveCount) {
-                                        iSlaveList[slave].Replace(sender);
-                                        iSlaveExpiry[slave] = Time::Now(iEnv) + kTimerExpiryTimeoutMs;
-                                        iSlaveCount++;
+                                    AddSlave(sender, decodesFlac);
 
-                                        LOG(kSongcast, "OhmSender::RunUnicast new slave: %s (#%u)\n", endptBuf.Ptr(), iSlaveCount);
+                                    LOG(kSongcast, "OhmSender::RunUnicast new slave: %s (#%u)\n", endptBuf.Ptr(), (TUint)iSlaves.size());
 
-                                        AutoMutex mutex(iMutexActive);
-                                        SendListen(sender);
-                                        SendSlaveList();
-                                        SendTrack();
-                                        SendMetatext();
-                                    }
+                                    SendListen(sender);
+                                    SendSlaveList();
+                                    SendTrack();
+                                    SendMetatext();
                                 }
                             }
                         }
@@ -945,14 +1110,19 @@ void OhmSender::RunUnicast()
                             LOG(kSongcast, "OhmSender::RunUnicast LEAVE from %s\n", endptBuf.Ptr());
                             if (sender.Equals(iTargetEndpoint) || sender.Equals(iSocketOhm.This())) {
                                 iTimerExpiry->Cancel();
-                                if (iSlaveCount == 0) {
+                                AutoMutex mutex(iMutexActive);
+                                if (iSlaves.size() == 0) {
                                     break;
                                 }
                                 else {
-                                    AutoMutex mutex(iMutexActive);
-                                    iTargetEndpoint.Replace(iSlaveList[--iSlaveCount]);
-                                    iTimerExpiry->FireAt(iSlaveExpiry[iSlaveCount]);
-                                    if (iSlaveCount > 0) {
+                                    // promote the most recently joined slave to be the primary receiver
+                                    const Slave& last = iSlaves.back();
+                                    iTargetEndpoint.Replace(last.iEndpoint);
+                                    iTargetDecodesFlac = last.iDecodesFlac;
+                                    iTimerExpiry->FireAt(last.iExpiry);
+                                    iSlaves.pop_back();
+                                    UpdateDriverSlaves();
+                                    if (iSlaves.size() > 0) {
                                         SendSlaveList();
                                     }
                                     iDriver.SetEndpoint(iTargetEndpoint, iTargetInterface);
@@ -960,10 +1130,10 @@ void OhmSender::RunUnicast()
                                 }
                             }
                             else {
+                                AutoMutex mutex(iMutexActive);
                                 TUint slave = FindSlave(sender);
-                                if (slave < iSlaveCount) {
+                                if (slave < iSlaves.size()) {
                                     RemoveSlave(slave);
-                                    AutoMutex mutex(iMutexActive);
                                     SendLeave(sender);
                                     SendSlaveList();
                                 }
@@ -975,7 +1145,15 @@ void OhmSender::RunUnicast()
                             headerResend.Internalise(iRxBuffer, header);
                             TUint frames = headerResend.FramesCount();
                             if (frames > 0) {
-                                iDriver.Resend(iRxBuffer.Read(frames * 4));
+                                const Endpoint sender(iSocketOhm.Sender());
+                                {
+                                    AutoMutex mutex(iMutexActive);
+                                    const TUint slave = FindSlave(sender);
+                                    if (slave < iSlaves.size()) {
+                                        iSlaves[slave].iResendRequests++;
+                                    }
+                                }
+                                iDriver.Resend(iRxBuffer.Read(frames * 4), sender);
                             }
                         }
                     }
@@ -1010,6 +1188,9 @@ void OhmSender::RunUnicast()
             } 
             iAliveJoined = false;
             iAliveBlocked = false;
+            iSlaves.clear();
+            iTargetDecodesFlac = false;
+            UpdateDriverSlaves();
         }
 
         iNetworkDeactivated.Signal();
@@ -1135,11 +1316,19 @@ void OhmSender::UpdateMetadata()
 
 void OhmSender::Send()
 {
+    // called with alive mutex locked
     try {
         iSocketOhm.Send(iTxBuffer, iTargetEndpoint);
     }
     catch (NetworkError&) {
     }
+    for (auto it=iSlaves.begin(); it!=iSlaves.end(); ++it) {
+        try {
+            iSocketOhm.Send(iTxBuffer, it->iEndpoint);
+        }
+        catch (NetworkError&) {
+        }
+    }
 }
 
 void OhmSender::SendTrack()
@@ -1174,17 +1363,15 @@ void OhmSender::SendMetatext()
 void OhmSender::SendSlaveList()
 {
     // called with alive mutex locked;
-    OhmHeaderSlave headerSlave(iSlaveCount);
+    // Audio, track and metatext are sent to every slave directly (see UpdateDriverSlaves), so
+    // receivers are always sent an empty list.  This stops any receiver still forwarding to
+    // slaves from an earlier session from also relaying audio to them.
+    OhmHeaderSlave headerSlave(0);
     OhmHeader header(OhmHeader::kMsgTypeSlave, headerSlave.MsgBytes());
     WriterBuffer writer(iTxBuffer);
     writer.Flush();
     header.Externalise(writer);
     headerSlave.Externalise(writer);
-    WriterBinary binary(writer);
-    for (TUint i = 0; i < iSlaveCount; i++) {
-        binary.WriteUint32Be(Arch::BigEndian4(iSlaveList[i].Address()));
-        binary.WriteUint16Be(iSlaveList[i].Port());
-    }
     Send();
 }
 
@@ -1224,9 +1411,10 @@ void OhmSender::SendLeave(const Endpoint& aEndpoint)
 
 TBool OhmSender::CheckSlaveExpiry()
 {
+    // called with alive mutex locked
     TBool changed = false;
-    for (TUint i = 0; i < iSlaveCount;) {
-        if (Time::IsInPastOrNow(iEnv, iSlaveExpiry[i])) {
+    for (TUint i = 0; i < iSlaves.size();) {
+        if (Time::IsInPastOrNow(iEnv, iSlaves[i].iExpiry)) {
             RemoveSlave(i);
             changed = true;
             continue;
@@ -1237,24 +1425,81 @@ TBool OhmSender::CheckSlaveExpiry()
     return changed;
 }
 
+TBool OhmSender::ReadDecodesFlac(const OhmHeader& aHeader)
+{
+    // reads the body of a join or listen msg from iRxBuffer
+    OhmHeaderJoin join;
+    join.Internalise(iRxBuffer, aHeader);
+    return ((join.Capabilities() & OhmHeaderJoin::kCapabilityFlac) != 0);
+}
+
+void OhmSender::UpdateMulticastCompression(TBool aDecodesFlac)
+{
+    // called with alive mutex locked
+    // Multicast receivers aren't tracked individually.  Any receiver that can't decode compressed
+    // audio disables compression until it has been silent for as long as a joined receiver is assumed alive.
+    if (!aDecodesFlac) {
+        iPcmReceiverSeen = true;
+        iPcmReceiverExpiry = Time::Now(iEnv) + kTimerAliveJoinTimeoutMs;
+    }
+    else if (iPcmReceiverSeen && Time::IsInPastOrNow(iEnv, iPcmReceiverExpiry)) {
+        iPcmReceiverSeen = false;
+    }
+    iDriver.SetCompressionSupported(!iPcmReceiverSeen);
+}
+
+void OhmSender::AddSlave(const Endpoint& aEndpoint, TBool aDecodesFlac)
+{
+    // called with alive mutex locked
+    iSlaves.push_back(Slave(aEndpoint, Time::Now(iEnv) + kTimerExpiryTimeoutMs, aDecodesFlac));
+    UpdateDriverSlaves();
+}
+
 void OhmSender::RemoveSlave(TUint aIndex)
 {
-    iSlaveCount--;
-    for (TUint i = aIndex; i < iSlaveCount; i++) {
-        iSlaveList[i].Replace(iSlaveList[i + 1]);
-        iSlaveExpiry[i] = iSlaveExpiry[i + 1];
+    // called with alive mutex locked
+    Slave& slave = iSlaves[aIndex];
+    Endpoint::EndpointBuf buf;
+    slave.iEndpoint.AppendEndpoint(buf);
+    LOG(kSongcast, "OhmSender::RemoveSlave %s (%u resend requests)\n", buf.Ptr(), slave.iResendRequests);
+    iSlaves.erase(iSlaves.begin() + aIndex);
+    UpdateDriverSlaves();
+}
+
+void OhmSender::UpdateDriverSlaves()
+{
+    // called with alive mutex locked
+    // Audio is only compressed if every unicast receiver can decode it
+    std::vector<Endpoint> slaves;
+    slaves.reserve(iSlaves.size());
+    TBool decodeFlac = iTargetDecodesFlac;
+    for (auto it=iSlaves.begin(); it!=iSlaves.end(); ++it) {
+        slaves.push_back(it->iEndpoint);
+        decodeFlac = decodeFlac && it->iDecodesFlac;
     }
+    iDriver.SetSlaves(slaves);
+    iDriver.SetCompressionSupported(decodeFlac);
 }
 
-// Returns index of supplied endpoint, or index of empty slot if not found
-// distinguish between the two by comparing returned value with iSlaveCount
-  
+// Returns index of supplied endpoint, or iSlaves.size() if not found
+
 TUint OhmSender::FindSlave(const Endpoint& aEndpoint)
 {
-    for (TUint i = 0; i < iSlaveCount; i++) {
-        if (aEndpoint.Equals(iSlaveList[i])) {
+    for (TUint i = 0; i < iSlaves.size(); i++) {
+        if (aEndpoint.Equals(iSlaves[i].iEndpoint)) {
             return i;
         }
     }
-    return iSlaveCount;
+    return (TUint)iSlaves.size();
+}
+
+
+// OhmSender::Slave
+
+OhmSender::Slave::Slave(const Endpoint& aEndpoint, TUint aExpiry, TBool aDecodesFlac)
+    : iEndpoint(aEndpoint)
+    , iExpiry(aExpiry)
+    , iResendRequests(0)
+    , iDecodesFlac(aDecodesFlac)
+{
 }
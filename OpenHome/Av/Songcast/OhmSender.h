@@ -9,9 +9,12 @@
 #include <OpenHome/Private/Http.h>
 #include <OpenHome/Av/Songcast/ZoneHandler.h>
 
+#include <vector>
+
 #include "Ohm.h"
 #include "OhmMsg.h"
 #include "OhmSocket.h"
+#include "OhmFec.h"
 #include "OhmSenderDriver.h"
 
 namespace OpenHome {
@@ -21,34 +24,60 @@ namespace Av {
 class ProviderSender;
 class IOhmTimestamper;
 class IOhmTimestampMapper;
+class OhmFlacEncoder;
 
 class OhmSenderDriver : public IOhmSenderDriver
 {
     static const TUint kMaxAudioFrameBytes = 16 * 1024;
     static const TUint kMaxHistoryFrames = 100;
+    static const TUint kMaxResendBatchFrames = 16;
+    static const TUint kFlagsOffset = OhmHeader::kHeaderBytes + 1;
 public:
     OhmSenderDriver(Environment& aEnv, IOhmTimestamper* aTimestamper, IOhmTimestampMapper* aTsMapper);
+    ~OhmSenderDriver();
     void SetAudioFormat(TUint aSampleRate, TUint aBitRate, TUint aChannels, TUint aBitDepth, TBool aLossless, const Brx& aCodecName);
     void SendAudio(const TByte* aData, TUint aBytes, TBool aHalt = false);
+    void SetCompression(TBool aEnable); // only used while SetCompressionSupported(true)
+    void SetErrorCorrection(TUint aGroupFrames); // send a parity frame every aGroupFrames audio frames.  0 disables
 private: // from IOhmSenderDriver
     void SetEnabled(TBool aValue) override;
     void SetActive(TBool aValue) override;
+    void SetCompressionSupported(TBool aValue) override;
     void SetEndpoint(const Endpoint& aEndpoint, TIpAddress aAdapter) override;
+    void SetSlaves(const std::vector<Endpoint>& aSlaves) override;
     void SetTtl(TUint aValue) override;
     void SetLatency(TUint aValue) override;
     void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal) override;
-    void Resend(const Brx& aFrames) override;
+    void Resend(const Brx& aFrames, const Endpoint& aEndpoint) override;
 private:
     void ResetLocked();
-    void Resend(OhmMsgAudio& aMsg);
+    TBool CompressLocked() const;
+    TBool EncodeLocked(const Brx& aAudio, TUint aSamples);
+    void SendPendingLocked(const Brx& aEncoded);
+    void FlushEncoderLocked();
+    void SendAudioLocked(const Brx& aAudio, TUint aSamples, TBool aHalt, const Brx& aCodecName);
+    TUint CopyResendBatchLocked(ReaderBinary& aReader, TUint& aFramesRemaining);
+    void SendLocked(const Brx& aPacket);
+    void SendParityLocked();
+private:
+    class HistoryPacket
+    {
+    public:
+        HistoryPacket() : iFrame(0), iValid(false) {}
+    public:
+        TUint iFrame;
+        TBool iValid;
+        Bws<kMaxAudioFrameBytes> iData;
+    };
 private:
     Mutex iMutex;
+    Mutex iResendLock;
     TBool iEnabled;
     TBool iActive;
     TBool iSend;
     Endpoint iEndpoint;
+    std::vector<Endpoint> iSlaves;
     TIpAddress iAdapter;
-    Bws<kMaxAudioFrameBytes> iBuffer;
     TUint iFrame;
     TUint iSampleRate;
     TUint iBitRate;
@@ -56,12 +85,25 @@ private:
     TUint iBitDepth;
     TBool iLossless;
     Bws<Ohm::kMaxCodecNameBytes> iCodecName;
+    Bws<OhmMsgAudio::kMaxCodecBytes> iCodecNameCompressed;
+    TBool iCompress;
+    TBool iCompressionSupported;
+    OhmFlacEncoder* iEncoder;
+    Bws<OhmMsgAudio::kMaxSampleBytes> iEncoded;
+    Bws<OhmMsgAudio::kMaxSampleBytes> iPendingAudio; // frame whose FLAC encoding is still held by iEncoder
+    TUint iPendingSamples;
+    TUint iFecGroupFrames;
+    OhmFecEncoder iFecEncoder;
+    Bws<kMaxAudioFrameBytes> iFecPacket;
     TUint64 iSamplesTotal;
     TUint64 iSampleStart;
     TUint iLatency;
     SocketUdp iSocket;
     OhmMsgFactory iFactory;
-    FifoLite<OhmMsgAudio*, kMaxHistoryFrames> iFifoHistory;
+    HistoryPacket* iHistory;      // ring indexed by (frame % kMaxHistoryFrames)
+    Bwh iResendBuf;               // packets copied out of iHistory, sent outside iMutex
+    TUint iResendBytes[kMaxResendBatchFrames];
+    Endpoint iResendEndpoint;
     IOhmTimestamper* iTimestamper;
     TBool iFirstFrame;
     IOhmTimestampMapper* iTsMapper;
@@ -76,7 +118,6 @@ class OhmSender
     static const TUint kTimerAliveJoinTimeoutMs = 10000;
     static const TUint kTimerAliveAudioTimeoutMs = 3000;
     static const TUint kTimerExpiryTimeoutMs = 10000;
-    static const TUint kMaxSlaveCount = 4;
     static const TUint kTtl = 1;
 public:
     static const TUint kMaxNameBytes = 64;
@@ -118,9 +159,24 @@ private:
     void SendSlaveList();
     void SendListen(const Endpoint& aEndpoint);
     void SendLeave(const Endpoint& aEndpoint);
+    TBool ReadDecodesFlac(const OhmHeader& aHeader);
+    void UpdateMulticastCompression(TBool aDecodesFlac);
     TUint FindSlave(const Endpoint& aEndpoint);
+    void AddSlave(const Endpoint& aEndpoint, TBool aDecodesFlac);
     void RemoveSlave(TUint aIndex);
     TBool CheckSlaveExpiry();
+    void UpdateDriverSlaves();
+private:
+    class Slave
+    {
+    public:
+        Slave(const Endpoint& aEndpoint, TUint aExpiry, TBool aDecodesFlac);
+    public:
+        Endpoint iEndpoint;
+        TUint iExpiry;
+        TUint iResendRequests;
+        TBool iDecodesFlac;
+    };
 private:
     Environment& iEnv;
     Net::DvDeviceStandard& iDevice;
@@ -154,9 +210,10 @@ private:
     TUint iNacnId;
     Uri iSenderUri;
     Bws<kMaxMetadataBytes> iSenderMetadata;
-    TUint iSlaveCount;
-    Endpoint iSlaveList[kMaxSlaveCount];
-    TUint iSlaveExpiry[kMaxSlaveCount];
+    std::vector<Slave> iSlaves; // unicast receivers other than iTargetEndpoint.  Protected by iMutexActive
+    TBool iTargetDecodesFlac;   // unicast only.  Protected by iMutexActive
+    TBool iPcmReceiverSeen;     // multicast only; a receiver that can't decode compressed audio joined/listened before iPcmReceiverExpiry
+    TUint iPcmReceiverExpiry;
     Timer* iTimerAliveJoin;
     Timer* iTimerAliveAudio;
     Timer* iTimerExpiry;
@@ -4,6 +4,8 @@
 #include <OpenHome/Buffer.h>
 #include <OpenHome/Private/Network.h>
 
+#include <vector>
+
 namespace OpenHome {
 namespace Av {
 
@@ -12,11 +14,13 @@ class IOhmSenderDriver
 public:
     virtual void SetEnabled(TBool aValue) = 0;
     virtual void SetEndpoint(const Endpoint& aEndpoint, TIpAddress aAdapter) = 0;
+    virtual void SetSlaves(const std::vector<Endpoint>& aSlaves) = 0; // unicast receivers other than the primary endpoint
     virtual void SetActive(TBool aValue) = 0;
+    virtual void SetCompressionSupported(TBool aValue) = 0; // true iff every current receiver advertised OhmHeaderJoin::kCapabilityFlac
     virtual void SetTtl(TUint aValue) = 0;
     virtual void SetLatency(TUint aValue) = 0;
     virtual void SetTrackPosition(TUint64 aSampleStart, TUint64 aSamplesTotal) = 0;
-    virtual void Resend(const Brx& aFrames) = 0;
+    virtual void Resend(const Brx& aFrames, const Endpoint& aEndpoint) = 0;
     virtual ~IOhmSenderDriver() {}
 };
 
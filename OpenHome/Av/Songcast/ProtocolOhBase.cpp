@@ -73,6 +73,13 @@ void ProtocolOhBase::Add(OhmMsg* aMsg)
     aMsg->Process(*this);
 }
 
+void ProtocolOhBase::AddParity(const OhmHeader& aHeader)
+{
+    AutoMutex a(iMutexTransport);
+    iFec.AddParity(iReadBuffer, aHeader);
+    RecoverAudioLocked();
+}
+
 void ProtocolOhBase::ResendSeen()
 {
     iMutexTransport.Wait();
@@ -117,10 +124,19 @@ void ProtocolOhBase::SendListen()
 
 void ProtocolOhBase::Send(TUint aType)
 {
-    Bws<OhmHeader::kHeaderBytes> buffer;
+    Bws<OhmHeader::kHeaderBytes + OhmHeaderJoin::kHeaderBytes> buffer;
     WriterBuffer writer(buffer);
-    OhmHeader msg(aType, 0);
-    msg.Externalise(writer);
+    if (aType == OhmHeader::kMsgTypeJoin || aType == OhmHeader::kMsgTypeListen) {
+        // tell the sender it may compress audio (CodecOhm decodes OhmFlac frames)
+        OhmHeaderJoin join(OhmHeaderJoin::kCapabilityFlac);
+        OhmHeader msg(aType, join.MsgBytes());
+        msg.Externalise(writer);
+        join.Externalise(writer);
+    }
+    else {
+        OhmHeader msg(aType, 0);
+        msg.Externalise(writer);
+    }
     try {
         iSocket.Send(buffer, iEndpoint);
     }
@@ -173,6 +189,7 @@ ProtocolStreamResult ProtocolOhBase::Stream(const Brx& aUri)
 
     iMutexTransport.Wait();
     RepairReset();
+    iFec.Reset();
     iFrame = 0;
     iTrackMsgDue = false;
     iStreamMsgDue = true;
@@ -465,6 +482,17 @@ void ProtocolOhBase::Process(OhmMsgAudioBlob& aMsg)
     }
 
     AutoMutex a(iMutexTransport);
+    if (!iFec.AddAudio(aMsg.Frame(), aMsg.Blob())) {
+        // already rebuilt from parity; this copy was delayed rather than lost
+        aMsg.RemoveRef();
+        return;
+    }
+    ProcessAudioLocked(aMsg);
+    RecoverAudioLocked();
+}
+
+void ProtocolOhBase::ProcessAudioLocked(OhmMsgAudioBlob& aMsg)
+{
     if (!iRunning) {
         iFrame = aMsg.Frame();
         iRunning = true;
@@ -496,6 +524,17 @@ void ProtocolOhBase::Process(OhmMsgAudioBlob& aMsg)
     }
 }
 
+void ProtocolOhBase::RecoverAudioLocked()
+{
+    // Rebuilt frames are marked as resent so are handled exactly as a resend would have been
+    while (iFec.TryRecover(iFecFrame)) {
+        ReaderBuffer reader(iFecFrame);
+        OhmHeader header(OhmHeader::kMsgTypeAudio, iFecFrame.Bytes());
+        OhmMsgAudioBlob* msg = iMsgFactory.CreateAudioBlob(reader, header);
+        ProcessAudioLocked(*msg);
+    }
+}
+
 void ProtocolOhBase::Process(OhmMsgTrack& aMsg)
 {
     if (!iSeqTrackValid || iSeqTrack != aMsg.Sequence()) {
@@ -8,6 +8,7 @@
 #include <OpenHome/Av/Songcast/OhmMsg.h>
 #include <OpenHome/Av/Songcast/OhmSocket.h>
 #include <OpenHome/Av/Songcast/OhmTimestamp.h>
+#include <OpenHome/Av/Songcast/OhmFec.h>
 #include <OpenHome/Private/Stream.h>
 #include <OpenHome/Media/Supply.h>
 
@@ -33,6 +34,7 @@ protected:
     ProtocolOhBase(Environment& aEnv, IOhmMsgFactory& aFactory, Media::TrackFactory& aTrackFactory, IOhmTimestamper* aTimestamper, const TChar* aSupportedScheme, const Brx& aMode);
     ~ProtocolOhBase();
     void Add(OhmMsg* aMsg);
+    void AddParity(const OhmHeader& aHeader);
     void ResendSeen();
     void RequestResend(const Brx& aFrames);
     void SendJoin();
@@ -58,6 +60,8 @@ private:
     TBool RepairBegin(OhmMsgAudioBlob& aMsg);
     TBool Repair(OhmMsgAudioBlob& aMsg);
     void OutputAudio(OhmMsgAudioBlob& aMsg);
+    void ProcessAudioLocked(OhmMsgAudioBlob& aMsg);
+    void RecoverAudioLocked();
 private: // from IOhmMsgProcessor
     void Process(OhmMsgAudio& aMsg) override;
     void Process(OhmMsgAudioBlob& aMsg) override;
@@ -99,6 +103,8 @@ private:
     OhmMsgAudioBlob* iRepairFirst;
     std::vector<OhmMsgAudioBlob*> iRepairFrames;
     Timer* iTimerRepair;
+    OhmFecDecoder iFec;
+    Bws<OhmMsgAudioBlob::kMaxBytes> iFecFrame;
     Bws<Media::EncodedAudio::kMaxBytes> iFrameBuf;
     TUint iAddr; // FIXME - should listen for subnet changes and update this value
     Media::BwsTrackUri iTrackUri;
@@ -92,6 +92,9 @@ ProtocolStreamResult ProtocolOhm::Play(TIpAddress aInterface, TUint aTtl, const
                     case OhmHeader::kMsgTypeAudio:
                         Add(iMsgFactory.CreateAudioBlob(iReadBuffer, header));
                         break;
+                    case OhmHeader::kMsgTypeParity:
+                        AddParity(header);
+                        break;
                     case OhmHeader::kMsgTypeTrack:
                         Add(iMsgFactory.CreateTrack(iReadBuffer, header));
                         receivedTrack = true;
@@ -140,6 +143,9 @@ ProtocolStreamResult ProtocolOhm::Play(TIpAddress aInterface, TUint aTtl, const
                     case OhmHeader::kMsgTypeAudio:
                         Add(iMsgFactory.CreateAudioBlob(iReadBuffer, header));
                         break;
+                    case OhmHeader::kMsgTypeParity:
+                        AddParity(header);
+                        break;
                     case OhmHeader::kMsgTypeTrack:
                         Add(iMsgFactory.CreateTrack(iReadBuffer, header));
                         break;
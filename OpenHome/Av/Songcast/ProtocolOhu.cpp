@@ -135,6 +135,9 @@ ProtocolStreamResult ProtocolOhu::Play(TIpAddress aInterface, TUint aTtl, const
                     case OhmHeader::kMsgTypeAudio:
                         HandleAudio(header);
                         break;
+                    case OhmHeader::kMsgTypeParity:
+                        AddParity(header);
+                        break;
                     case OhmHeader::kMsgTypeTrack:
                         LOG(kSongcast, "OHU: Joining, received track\n");
                         HandleTrack(header);
@@ -191,6 +194,9 @@ ProtocolStreamResult ProtocolOhu::Play(TIpAddress aInterface, TUint aTtl, const
                     case OhmHeader::kMsgTypeAudio:
                         HandleAudio(header);
                         break;
+                    case OhmHeader::kMsgTypeParity:
+                        AddParity(header);
+                        break;
                     case OhmHeader::kMsgTypeTrack:
                         HandleTrack(header);
                         break;
@@ -29,6 +29,8 @@ const Brn Sender::kConfigIdEnabled("Sender.Enabled");
 const Brn Sender::kConfigIdChannel("Sender.Channel");
 const Brn Sender::kConfigIdMode("Sender.Mode");
 const Brn Sender::kConfigIdPreset("Sender.Preset");
+const Brn Sender::kConfigIdCompression("Sender.Compression");
+const Brn Sender::kConfigIdErrorCorrection("Sender.ErrorCorrection");
 
 Sender::Sender(Environment& aEnv,
                Net::DvDeviceStandard& aDevice,
@@ -67,6 +69,19 @@ Sender::Sender(Environment& aEnv,
     iConfigEnabled = new ConfigChoice(aConfigInit, kConfigIdEnabled, choices, eStringIdYes);
     iListenerIdConfigEnabled = iConfigEnabled->Subscribe(MakeFunctorConfigChoice(*this, &Sender::ConfigEnabledChanged));
 
+    // lossless compression of audio frames; off by default as older receivers only understand pcm
+    iConfigCompression = new ConfigChoice(aConfigInit, kConfigIdCompression, choices, eStringIdNo);
+    iListenerIdConfigCompression = iConfigCompression->Subscribe(MakeFunctorConfigChoice(*this, &Sender::ConfigCompressionChanged));
+
+    // parity frames for forward error correction; off by default as older receivers reject unknown msg types
+    choices.clear();
+    choices.push_back(kErrorCorrectionOff);
+    choices.push_back(kErrorCorrectionLow);
+    choices.push_back(kErrorCorrectionMedium);
+    choices.push_back(kErrorCorrectionHigh);
+    iConfigErrorCorrection = new ConfigChoice(aConfigInit, kConfigIdErrorCorrection, choices, kErrorCorrectionOff);
+    iListenerIdConfigErrorCorrection = iConfigErrorCorrection->Subscribe(MakeFunctorConfigChoice(*this, &Sender::ConfigErrorCorrectionChanged));
+
     iPendingAudio.reserve(100); // arbitrarily chosen value.  Doesn't need to prevent any reallocation, just avoid regular churn early on
 }
 
@@ -82,6 +97,10 @@ Sender::~Sender()
     delete iConfigMode;
     iConfigPreset->Unsubscribe(iListenerIdConfigPreset);
     delete iConfigPreset;
+    iConfigCompression->Unsubscribe(iListenerIdConfigCompression);
+    delete iConfigCompression;
+    iConfigErrorCorrection->Unsubscribe(iListenerIdConfigErrorCorrection);
+    delete iConfigErrorCorrection;
 }
 
 void Sender::SetName(const Brx& aName)
@@ -289,6 +308,17 @@ void Sender::ConfigPresetChanged(KeyValuePair<TInt>& aKvp)
     iOhmSender->SetPreset(aKvp.Value());
 }
 
+void Sender::ConfigCompressionChanged(KeyValuePair<TUint>& aStringId)
+{
+    const TBool compress = (aStringId.Value() == eStringIdYes);
+    iOhmSenderDriver->SetCompression(compress);
+}
+
+void Sender::ConfigErrorCorrectionChanged(KeyValuePair<TUint>& aValue)
+{
+    iOhmSenderDriver->SetErrorCorrection(aValue.Value());
+}
+
 void Sender::BeginBlock()
 {
 }
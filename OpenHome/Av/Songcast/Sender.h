@@ -26,6 +26,13 @@ class Sender : public Media::IPipelineElementDownstream, private Media::IMsgProc
     static const Brn kConfigIdChannel;
     static const Brn kConfigIdMode;
     static const Brn kConfigIdPreset;
+    static const Brn kConfigIdCompression;
+    static const Brn kConfigIdErrorCorrection;
+    // Sender.ErrorCorrection choices are the number of audio frames covered by each parity frame
+    static const TUint kErrorCorrectionOff = 0;
+    static const TUint kErrorCorrectionLow = 16;
+    static const TUint kErrorCorrectionMedium = 8;
+    static const TUint kErrorCorrectionHigh = 4;
     static const TInt kChannelMin = 1024;
     static const TInt kChannelMax = 65535;
     static const TInt kPresetMin = 0;
@@ -74,6 +81,8 @@ private:
     void ConfigChannelChanged(Configuration::KeyValuePair<TInt>& aValue);
     void ConfigModeChanged(Configuration::KeyValuePair<TUint>& aStringId);
     void ConfigPresetChanged(Configuration::KeyValuePair<TInt>& aValue);
+    void ConfigCompressionChanged(Configuration::KeyValuePair<TUint>& aStringId);
+    void ConfigErrorCorrectionChanged(Configuration::KeyValuePair<TUint>& aValue);
 private: // from IPcmProcessor
     void BeginBlock() override;
     void ProcessFragment8(const Brx& aData, TUint aNumChannels) override;
@@ -127,6 +136,10 @@ private:
     TUint iListenerIdConfigMode;
     Configuration::ConfigNum* iConfigPreset;
     TUint iListenerIdConfigPreset;
+    Configuration::ConfigChoice* iConfigCompression;
+    TUint iListenerIdConfigCompression;
+    Configuration::ConfigChoice* iConfigErrorCorrection;
+    TUint iListenerIdConfigErrorCorrection;
     std::vector<Media::MsgAudio*> iPendingAudio;
     Bws<kSongcastPacketMaxBytes> iAudioBuf;
     TUint iSampleRate;
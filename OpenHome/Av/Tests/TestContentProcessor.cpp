@@ -616,7 +616,7 @@ void SuiteM3uX::TestParse()
         "http://example.com/hi.m3u8\n";
     FileBrx file1(kFile1);
     iFileStream.SetFile(&file1);
-    const char* expected1[] = {"hls://example.com/audio-only.m3u8"};
+    const char* expected1[] = {"hls://example.com/playlist"};
     iExpectedStreams = expected1;
     iIndex = 0;
     iNextResult = EProtocolStreamSuccess;
@@ -624,6 +624,19 @@ void SuiteM3uX::TestParse()
     TEST(iProcessor->Stream(*this, iFileStream.Bytes()) == EProtocolStreamSuccess);
     TEST(iIndex == 1);
 
+    // master playlist that can't be read over http; desired stream is passed on instead
+    static const Brn kPlaylistUriHttps("https://example.com/playlist");
+    iProcessor->Reset();
+    file1.Seek(0);
+    iFileStream.SetFile(&file1);
+    const char* expectedHttps[] = {"hls://example.com/audio-only.m3u8"};
+    iExpectedStreams = expectedHttps;
+    iReadBuffer->ReadFlush();
+    iIndex = 0;
+    iProcessor->Recognise(kPlaylistUriHttps, kMimeType, Brx::Empty());
+    TEST(iProcessor->Stream(*this, iFileStream.Bytes()) == EProtocolStreamSuccess);
+    TEST(iIndex == 1);
+
     // standard file with unix line endings and desired stream last
     static const TChar* kFile2 =
         "#EXTM3U\n"
@@ -639,7 +652,7 @@ void SuiteM3uX::TestParse()
     iProcessor->Reset();
     FileBrx file2(kFile2);
     iFileStream.SetFile(&file2);
-    const char* expected2[] = {"hls://example.com/audio-only.m3u8"};
+    const char* expected2[] = {"hls://example.com/playlist"};
     iExpectedStreams = expected2;
     iReadBuffer->ReadFlush();
     iIndex = 0;
@@ -660,7 +673,7 @@ void SuiteM3uX::TestParse()
     iProcessor->Reset();
     FileBrx file3(kFile3);
     iFileStream.SetFile(&file3);
-    const char* expected3[] = {"hls://example.com/hi.m3u8"};
+    const char* expected3[] = {"hls://example.com/playlist"};
     iExpectedStreams = expected3;
     iReadBuffer->ReadFlush();
     iIndex = 0;
@@ -749,7 +762,7 @@ void SuiteM3uX::TestParse()
     iProcessor->Reset();
     FileBrx file7(kFile7);
     iFileStream.SetFile(&file7);
-    const char* expected7[] ={ "hls://example.com/audio-only.m3u8" };
+    const char* expected7[] ={ "hls://example.com/playlist" };
     iExpectedStreams = expected7;
     iReadBuffer->ReadFlush();
     iIndex = 0;
@@ -770,7 +783,7 @@ void SuiteM3uX::TestParse()
     iProcessor->Reset();
     FileBrx file8(kFile8);
     iFileStream.SetFile(&file8);
-    const char* expected8[] ={ "hls://example.com/audio=320000.m3u8" };
+    const char* expected8[] ={ "hls://example.com/playlist" };
     iExpectedStreams = expected8;
     iReadBuffer->ReadFlush();
     iIndex = 0;
@@ -792,7 +805,7 @@ void SuiteM3uX::TestParse()
     iProcessor->Reset();
     FileBrx file9(kFile9);
     iFileStream.SetFile(&file9);
-    const char* expected9[] ={ "hls://example.com/audio=320000.m3u8" };
+    const char* expected9[] ={ "hls://example.com/playlist" };
     iExpectedStreams = expected9;
     iReadBuffer->ReadFlush();
     iIndex = 0;
@@ -0,0 +1,292 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Private/SuiteUnitTest.h>
+#include <OpenHome/Av/Songcast/OhmFlac.h>
+#include <OpenHome/Av/Songcast/Ohm.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Stream.h>
+
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+
+/*
+ * Round trip of songcast audio frames through OhmFlacEncoder and OhmFlacDecoder.
+ * Every frame must decode, on its own, to exactly the pcm it was encoded from.
+ */
+
+namespace OpenHome {
+namespace Av {
+
+class SuiteOhmFlac : public SuiteUnitTest
+{
+    static const TUint kMaxPcmBytes = 8 * 1024;
+    static const TUint kSampleRate = 44100;
+    static const TUint kSamplesPerFrame = kSampleRate * 5 / 1000; // songcast frames are 5ms
+    static const TUint kNumFrames = 20;
+public:
+    SuiteOhmFlac();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestRoundTrip16();
+    void TestRoundTrip24();
+    void TestFramesDecodeIndependently();
+    void TestNoStreamHeader();
+    void TestFormatChange();
+    void TestUnsupportedFormat();
+    void TestFrameSizeMismatchStops();
+    void TestJoinCapabilities();
+    void TestJoinLegacyNoCapabilities();
+private:
+    void MakePcm(TUint aChannels, TUint aBitDepth, TUint aFrame, Bwx& aPcm);
+    void EncodeStream(TUint aChannels, TUint aBitDepth, TUint aSampleRate, TUint aFirstFrame);
+    TBool DecodesTo(const Brx& aEncoded, TUint aChannels, TUint aBitDepth, const Brx& aPcm);
+    void ClearFrames();
+private:
+    OhmFlacEncoder* iEncoder;
+    OhmFlacDecoder* iDecoder;
+    std::vector<Bwh*> iPcm;     // pcm passed to the encoder for each frame
+    std::vector<Bwh*> iEncoded; // FLAC output for each frame
+    TUint iSeed;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+
+// SuiteOhmFlac
+
+SuiteOhmFlac::SuiteOhmFlac()
+    : SuiteUnitTest("SuiteOhmFlac")
+{
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestRoundTrip16), "TestRoundTrip16");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestRoundTrip24), "TestRoundTrip24");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestFramesDecodeIndependently), "TestFramesDecodeIndependently");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestNoStreamHeader), "TestNoStreamHeader");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestFormatChange), "TestFormatChange");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestUnsupportedFormat), "TestUnsupportedFormat");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestFrameSizeMismatchStops), "TestFrameSizeMismatchStops");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestJoinCapabilities), "TestJoinCapabilities");
+    AddTest(MakeFunctor(*this, &SuiteOhmFlac::TestJoinLegacyNoCapabilities), "TestJoinLegacyNoCapabilities");
+}
+
+void SuiteOhmFlac::Setup()
+{
+    iEncoder = new OhmFlacEncoder(kMaxPcmBytes);
+    iDecoder = new OhmFlacDecoder();
+    iSeed = 1;
+}
+
+void SuiteOhmFlac::TearDown()
+{
+    ClearFrames();
+    delete iDecoder;
+    delete iEncoder;
+}
+
+void SuiteOhmFlac::MakePcm(TUint aChannels, TUint aBitDepth, TUint aFrame, Bwx& aPcm)
+{
+    // a triangle wave (which compresses well) plus low level noise (so that frames differ)
+    static const TUint kPeriod = 100;
+    const TInt amplitude = 1 << (aBitDepth - 3);
+    aPcm.SetBytes(0);
+    for (TUint i=0; i<kSamplesPerFrame; i++) {
+        const TUint pos = (aFrame * kSamplesPerFrame + i) % kPeriod;
+        TInt wave = (TInt)(pos < kPeriod/2? pos : kPeriod - pos) * 4 * amplitude / kPeriod - amplitude;
+        for (TUint ch=0; ch<aChannels; ch++) {
+            iSeed = iSeed * 1103515245 + 12345;
+            const TInt subsample = (ch == 0? wave : -wave / 2) + (TInt)((iSeed >> 16) & 0x3f) - 32;
+            if (aBitDepth == 24) {
+                aPcm.Append((TByte)(subsample >> 16));
+            }
+            aPcm.Append((TByte)(subsample >> 8));
+            aPcm.Append((TByte)subsample);
+        }
+    }
+}
+
+void SuiteOhmFlac::EncodeStream(TUint aChannels, TUint aBitDepth, TUint aSampleRate, TUint aFirstFrame)
+{
+    TEST(iEncoder->Start(aChannels, aBitDepth, aSampleRate, kSamplesPerFrame));
+    Bws<kMaxPcmBytes> encoded;
+    for (TUint i=0; i<kNumFrames; i++) {
+        Bwh* pcm = new Bwh(kMaxPcmBytes);
+        MakePcm(aChannels, aBitDepth, aFirstFrame + i, *pcm);
+        iPcm.push_back(pcm);
+        TEST(iEncoder->Encode(*pcm, encoded));
+        // output lags input by one frame
+        if (i == 0) {
+            TEST(encoded.Bytes() == 0);
+        }
+        else {
+            TEST(encoded.Bytes() > 0);
+            iEncoded.push_back(new Bwh(encoded));
+        }
+    }
+    TEST(iEncoder->Finish(encoded));
+    TEST(encoded.Bytes() > 0);
+    iEncoded.push_back(new Bwh(encoded));
+    TEST(!iEncoder->Started());
+}
+
+TBool SuiteOhmFlac::DecodesTo(const Brx& aEncoded, TUint aChannels, TUint aBitDepth, const Brx& aPcm)
+{
+    Bws<kMaxPcmBytes> decoded;
+    try {
+        iDecoder->Decode(aEncoded, aChannels, aBitDepth, decoded);
+    }
+    catch (OhmError&) {
+        return false;
+    }
+    return (decoded == aPcm);
+}
+
+void SuiteOhmFlac::ClearFrames()
+{
+    for (TUint i=0; i<iPcm.size(); i++) {
+        delete iPcm[i];
+    }
+    iPcm.clear();
+    for (TUint i=0; i<iEncoded.size(); i++) {
+        delete iEncoded[i];
+    }
+    iEncoded.clear();
+}
+
+void SuiteOhmFlac::TestRoundTrip16()
+{
+    EncodeStream(2, 16, kSampleRate, 0);
+    TEST(iEncoded.size() == kNumFrames);
+    TUint pcmBytes = 0;
+    TUint encodedBytes = 0;
+    for (TUint i=0; i<kNumFrames; i++) {
+        TEST(DecodesTo(*iEncoded[i], 2, 16, *iPcm[i]));
+        pcmBytes += iPcm[i]->Bytes();
+        encodedBytes += iEncoded[i]->Bytes();
+    }
+    TEST(encodedBytes < pcmBytes);
+}
+
+void SuiteOhmFlac::TestRoundTrip24()
+{
+    EncodeStream(2, 24, 96000, 0);
+    TEST(iEncoded.size() == kNumFrames);
+    for (TUint i=0; i<kNumFrames; i++) {
+        TEST(DecodesTo(*iEncoded[i], 2, 24, *iPcm[i]));
+    }
+}
+
+void SuiteOhmFlac::TestFramesDecodeIndependently()
+{
+    // receivers may lose frames or have them repaired/resent out of order
+    EncodeStream(2, 16, kSampleRate, 0);
+    for (TUint i=kNumFrames; i>0; i-=2) {
+        TEST(DecodesTo(*iEncoded[i-1], 2, 16, *iPcm[i-1]));
+    }
+    // a corrupt frame fails without affecting its successor
+    const Brn corrupt(iEncoded[3]->Ptr(), iEncoded[3]->Bytes() / 2);
+    TEST(!DecodesTo(corrupt, 2, 16, *iPcm[3]));
+    TEST(DecodesTo(*iEncoded[4], 2, 16, *iPcm[4]));
+}
+
+void SuiteOhmFlac::TestNoStreamHeader()
+{
+    // STREAMINFO is only generated once per stream and is never output.  Each frame starts with a FLAC frame sync code.
+    EncodeStream(2, 16, kSampleRate, 0);
+    for (TUint i=0; i<iEncoded.size(); i++) {
+        const Brx& frame = *iEncoded[i];
+        TEST(frame.Bytes() > 2);
+        TEST(frame[0] == 0xff);
+        TEST((frame[1] & 0xfe) == 0xf8);
+    }
+}
+
+void SuiteOhmFlac::TestFormatChange()
+{
+    EncodeStream(2, 16, kSampleRate, 0);
+    for (TUint i=0; i<kNumFrames; i++) {
+        TEST(DecodesTo(*iEncoded[i], 2, 16, *iPcm[i]));
+    }
+    ClearFrames();
+    EncodeStream(1, 24, 48000, kNumFrames);
+    for (TUint i=0; i<kNumFrames; i++) {
+        TEST(DecodesTo(*iEncoded[i], 1, 24, *iPcm[i]));
+    }
+    TEST(!DecodesTo(*iEncoded[0], 2, 24, *iPcm[0])); // channel count must match the ohm header
+}
+
+void SuiteOhmFlac::TestUnsupportedFormat()
+{
+    TEST(!iEncoder->Start(2, 8, kSampleRate, kSamplesPerFrame));
+    TEST(!iEncoder->Start(2, 32, kSampleRate, kSamplesPerFrame));
+    TEST(!iEncoder->Start(0, 16, kSampleRate, kSamplesPerFrame));
+    TEST(!iEncoder->Start(2, 16, kSampleRate, 8)); // below FLAC's minimum blocksize
+    TEST(!iEncoder->Start(2, 24, 192000, kMaxPcmBytes)); // frame larger than the encoder's buffer
+    TEST(!iEncoder->Started());
+    Bws<kMaxPcmBytes> pcm;
+    Bws<kMaxPcmBytes> encoded;
+    MakePcm(2, 16, 0, pcm);
+    TEST(!iEncoder->Encode(pcm, encoded));
+    TEST(!iEncoder->Finish(encoded));
+}
+
+void SuiteOhmFlac::TestFrameSizeMismatchStops()
+{
+    TEST(iEncoder->Start(2, 16, kSampleRate, kSamplesPerFrame));
+    TEST(iEncoder->Matches(2, 16, kSampleRate, kSamplesPerFrame));
+    TEST(!iEncoder->Matches(2, 16, kSampleRate, kSamplesPerFrame - 1));
+    TEST(!iEncoder->Matches(2, 24, kSampleRate, kSamplesPerFrame));
+    Bws<kMaxPcmBytes> pcm;
+    Bws<kMaxPcmBytes> encoded;
+    MakePcm(2, 16, 0, pcm);
+    pcm.SetBytes(pcm.Bytes() - 4);
+    TEST(!iEncoder->Encode(pcm, encoded));
+    TEST(!iEncoder->Started());
+    TEST(!iEncoder->Matches(2, 16, kSampleRate, kSamplesPerFrame));
+}
+
+void SuiteOhmFlac::TestJoinCapabilities()
+{
+    // senders only compress audio for receivers that advertise kCapabilityFlac in join/listen msgs
+    Bws<OhmHeader::kHeaderBytes + OhmHeaderJoin::kHeaderBytes> msg;
+    WriterBuffer writer(msg);
+    OhmHeaderJoin joinOut(OhmHeaderJoin::kCapabilityFlac);
+    OhmHeader(OhmHeader::kMsgTypeListen, joinOut.MsgBytes()).Externalise(writer);
+    joinOut.Externalise(writer);
+
+    ReaderBuffer reader(msg);
+    OhmHeader header;
+    header.Internalise(reader);
+    TEST(header.MsgType() == OhmHeader::kMsgTypeListen);
+    TEST(header.MsgBytes() == OhmHeaderJoin::kHeaderBytes);
+    OhmHeaderJoin joinIn;
+    joinIn.Internalise(reader, header);
+    TEST((joinIn.Capabilities() & OhmHeaderJoin::kCapabilityFlac) != 0);
+}
+
+void SuiteOhmFlac::TestJoinLegacyNoCapabilities()
+{
+    // older receivers send join msgs with no body
+    Bws<OhmHeader::kHeaderBytes> msg;
+    WriterBuffer writer(msg);
+    OhmHeader(OhmHeader::kMsgTypeJoin, 0).Externalise(writer);
+
+    ReaderBuffer reader(msg);
+    OhmHeader header;
+    header.Internalise(reader);
+    TEST(header.MsgType() == OhmHeader::kMsgTypeJoin);
+    OhmHeaderJoin join(OhmHeaderJoin::kCapabilityFlac);
+    join.Internalise(reader, header);
+    TEST(join.Capabilities() == 0);
+}
+
+
+void TestOhmFlac()
+{
+    Runner runner("Songcast FLAC compression tests\n");
+    runner.Add(new SuiteOhmFlac());
+    runner.Run();
+}
@@ -6,6 +6,7 @@
 #include <OpenHome/Media/PipelineObserver.h>
 #include <OpenHome/Media/Pipeline/Msg.h>
 #include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Ascii.h>
 #include <OpenHome/Functor.h>
 #include <OpenHome/Net/Private/DviStack.h>
 #include <OpenHome/Av/Tests/RamStore.h>
@@ -125,9 +126,12 @@ private:
     void PlayDeleteAll();
     void PlayDeleteAllPlay();
     void AddTrackJustBeforeCompletingPlaylist();
+    void ReadListConcurrentEdits();
 private:
     void Disabled();
     void TrackChanged();
+    void EditPlaylist();
+    static TUint CountEntries(const Brx& aTrackList);
 private:
     Semaphore iDeviceDisabled;
     Semaphore iTrackChanged;
@@ -149,6 +153,7 @@ private:
     Semaphore iTimeSem;
     Semaphore iSemPrefetched;
     TBool iPrefetchCompleted;
+    TBool iEditsComplete;
 };
 
 } // namespace TestPlaylist
@@ -171,6 +176,7 @@ Test cases:
     - SeekId for #3; Prev then Delete newly queued track.  Check we move to the preceeding track (#1).
     - Play then DeleteAll.  Check TransportState changes to ??? within Stopper + StarvationMonitor bounds
     - Seek to last track.  Add new track after it when we're ~2secs from the end.  Check this new track is played.
+    - ReadList while another control point inserts/deletes tracks.  Check each response is complete and consistent.
 */
 
 // DummyAsyncOutput
@@ -416,6 +422,7 @@ SuitePlaylist::SuitePlaylist(CpStack& aCpStack, DvStack& aDvStack)
     AddTest(MakeFunctor(*this, &SuitePlaylist::PlayDeleteAll), "PlayDeleteAll");
     AddTest(MakeFunctor(*this, &SuitePlaylist::PlayDeleteAllPlay), "PlayDeleteAllPlay");
     AddTest(MakeFunctor(*this, &SuitePlaylist::AddTrackJustBeforeCompletingPlaylist), "AddTrackJustBeforeCompletingPlaylist");
+    AddTest(MakeFunctor(*this, &SuitePlaylist::ReadListConcurrentEdits), "ReadListConcurrentEdits");
 }
 
 SuitePlaylist::~SuitePlaylist()
@@ -742,6 +749,71 @@ void SuitePlaylist::AddTrackJustBeforeCompletingPlaylist()
     TEST(iTransportStateCount[EPipelinePlaying] == 1);
 }
 
+void SuitePlaylist::ReadListConcurrentEdits()
+{
+    static const TUint kMaxEditedIds = 200;
+    Bwh idList((kNumTracks + kMaxEditedIds) * (Ascii::kMaxUintStringBytes + 1));
+    const TUint firstId = iTrackIds[0];
+    for (TUint i=0; i<kNumTracks+kMaxEditedIds; i++) {
+        if (i > 0) {
+            idList.Append(' ');
+        }
+        Ascii::AppendDec(idList, firstId + i);
+    }
+
+    iEditsComplete = false;
+    ThreadFunctor* editor = new ThreadFunctor("TPLE", MakeFunctor(*this, &SuitePlaylist::EditPlaylist));
+    editor->Start();
+    TUint reads = 0;
+    do {
+        Brh trackList;
+        iProxy->SyncReadList(idList, trackList);
+        static const Brn kStart("<TrackList>");
+        static const Brn kEnd("</TrackList>");
+        TEST(trackList.Bytes() >= kStart.Bytes() + kEnd.Bytes());
+        if (trackList.Bytes() >= kStart.Bytes() + kEnd.Bytes()) {
+            TEST(Brn(trackList.Ptr(), kStart.Bytes()) == kStart);
+            TEST(trackList.Split(trackList.Bytes() - kEnd.Bytes()) == kEnd);
+        }
+        // the original tracks are never edited; at most one inserted track exists at any time
+        const TUint entries = CountEntries(trackList);
+        TEST(entries >= kNumTracks);
+        TEST(entries <= kNumTracks + 1);
+        reads++;
+    } while (!iEditsComplete);
+    delete editor;
+    Print("%u ReadList calls during edits", reads);
+
+    Brh trackList;
+    iProxy->SyncReadList(idList, trackList);
+    TEST(CountEntries(trackList) == kNumTracks);
+}
+
+void SuitePlaylist::EditPlaylist()
+{
+    static const TUint kEdits = 100;
+    Bws<128> tone;
+    tone.AppendPrintf(kFmtTone, kNumTracks+1);
+    for (TUint i=0; i<kEdits; i++) {
+        TUint id;
+        iProxy->SyncInsert(iTrackIds[kNumTracks-1], tone, Brx::Empty(), id);
+        iProxy->SyncDeleteId(id);
+    }
+    iEditsComplete = true;
+}
+
+TUint SuitePlaylist::CountEntries(const Brx& aTrackList)
+{ // static
+    static const Brn kEntry("<Entry>");
+    TUint count = 0;
+    for (TUint i=0; i+kEntry.Bytes()<=aTrackList.Bytes(); i++) {
+        if (Brn(aTrackList.Ptr() + i, kEntry.Bytes()) == kEntry) {
+            count++;
+        }
+    }
+    return count;
+}
+
 void SuitePlaylist::TrackChanged()
 {
     iTrackChanged.Signal();
@@ -0,0 +1,357 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Av/Playlist/PlaylistStore.h>
+#include <OpenHome/Av/Playlist/TrackDatabase.h>
+#include <OpenHome/Private/SuiteUnitTest.h>
+#include <OpenHome/Configuration/Tests/ConfigRamStore.h>
+#include <OpenHome/Media/Utils/AllocatorInfoLogger.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/PowerManager.h>
+#include <OpenHome/Private/Env.h>
+
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Av;
+using namespace OpenHome::Media;
+using namespace OpenHome::Configuration;
+
+namespace OpenHome {
+namespace Av {
+
+class CountingRamStore : public ConfigRamStore
+{
+public:
+    CountingRamStore() : iWriteCount(0) {}
+    TUint WriteCount() const { return iWriteCount; }
+public: // from ConfigRamStore
+    void Write(const Brx& aKey, const Brx& aSource) override
+    {
+        iWriteCount++;
+        ConfigRamStore::Write(aKey, aSource);
+    }
+private:
+    TUint iWriteCount;
+};
+
+class MockPowerManager : public IPowerManager
+{
+public:
+    MockPowerManager();
+    void Deregister();
+public: // from IPowerManager
+    void NotifyPowerDown() override;
+    void StandbyEnable() override;
+    void StandbyDisable(StandbyDisableReason aReason) override;
+    IPowerManagerObserver* RegisterPowerHandler(IPowerHandler& aHandler, TUint aPriority) override;
+    IStandbyObserver* RegisterStandbyHandler(IStandbyHandler& aHandler) override;
+private:
+    IPowerHandler* iHandler;
+    TBool iPowerDown;
+};
+
+class MockPowerObserver : public IPowerManagerObserver
+{
+public:
+    MockPowerObserver(MockPowerManager& aPowerManager) : iPowerManager(aPowerManager) {}
+    ~MockPowerObserver() { iPowerManager.Deregister(); }
+private:
+    MockPowerManager& iPowerManager;
+};
+
+class SuitePlaylistStore : public SuiteUnitTest
+{
+    static const TUint kMaxTracks = 100;
+public:
+    SuitePlaylistStore(Environment& aEnv);
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void Start();
+    void Restart();
+    void Stop();
+    TUint Insert(TUint aIdAfter, const TChar* aUri);
+    TBool PlaylistIs(const std::vector<const TChar*>& aUris);
+    void CorruptLastByte(const Brx& aKey);
+private:
+    void EmptyStoreLoadsNothing();
+    void TracksPersistAcrossRestart();
+    void JournalAppliedOverSnapshot();
+    void DeleteAllPersists();
+    void ChangesAreBatched();
+    void PowerDownWritesChanges();
+    void InterruptedJournalWriteIgnored();
+    void CorruptSnapshotDiscarded();
+    void JournalCompactedIntoSnapshot();
+private:
+    Environment& iEnv;
+    Media::AllocatorInfoLogger iInfoAggregator;
+    CountingRamStore* iStore;
+    MockPowerManager* iPowerManager;
+    TrackFactory* iTrackFactory;
+    TrackDatabase* iDb;
+    PlaylistStore* iPlaylistStore;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+
+// MockPowerManager
+
+MockPowerManager::MockPowerManager()
+    : iHandler(nullptr)
+    , iPowerDown(false)
+{
+}
+
+void MockPowerManager::Deregister()
+{
+    if (iHandler != nullptr && !iPowerDown) {
+        iHandler->PowerDown();
+    }
+    iHandler = nullptr;
+}
+
+void MockPowerManager::NotifyPowerDown()
+{
+    iPowerDown = true;
+    if (iHandler != nullptr) {
+        iHandler->PowerDown();
+    }
+}
+
+void MockPowerManager::StandbyEnable()
+{
+}
+
+void MockPowerManager::StandbyDisable(StandbyDisableReason /*aReason*/)
+{
+}
+
+IPowerManagerObserver* MockPowerManager::RegisterPowerHandler(IPowerHandler& aHandler, TUint /*aPriority*/)
+{
+    ASSERT(iHandler == nullptr);
+    iHandler = &aHandler;
+    iPowerDown = false;
+    aHandler.PowerUp();
+    return new MockPowerObserver(*this);
+}
+
+IStandbyObserver* MockPowerManager::RegisterStandbyHandler(IStandbyHandler& /*aHandler*/)
+{
+    ASSERTS();
+    return nullptr;
+}
+
+
+// SuitePlaylistStore
+
+SuitePlaylistStore::SuitePlaylistStore(Environment& aEnv)
+    : SuiteUnitTest("PlaylistStore")
+    , iEnv(aEnv)
+{
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::EmptyStoreLoadsNothing), "EmptyStoreLoadsNothing");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::TracksPersistAcrossRestart), "TracksPersistAcrossRestart");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::JournalAppliedOverSnapshot), "JournalAppliedOverSnapshot");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::DeleteAllPersists), "DeleteAllPersists");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::ChangesAreBatched), "ChangesAreBatched");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::PowerDownWritesChanges), "PowerDownWritesChanges");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::InterruptedJournalWriteIgnored), "InterruptedJournalWriteIgnored");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::CorruptSnapshotDiscarded), "CorruptSnapshotDiscarded");
+    AddTest(MakeFunctor(*this, &SuitePlaylistStore::JournalCompactedIntoSnapshot), "JournalCompactedIntoSnapshot");
+}
+
+void SuitePlaylistStore::Setup()
+{
+    iStore = new CountingRamStore();
+    iPowerManager = new MockPowerManager();
+    iTrackFactory = new TrackFactory(iInfoAggregator, 2 * kMaxTracks);
+    Start();
+}
+
+void SuitePlaylistStore::TearDown()
+{
+    Stop();
+    delete iTrackFactory;
+    delete iPowerManager;
+    delete iStore;
+}
+
+void SuitePlaylistStore::Start()
+{
+    iDb = new TrackDatabase(*iTrackFactory, kMaxTracks);
+    iPlaylistStore = new PlaylistStore(iEnv, *iStore, *iPowerManager, *iDb);
+}
+
+void SuitePlaylistStore::Restart()
+{
+    Stop();
+    Start();
+}
+
+void SuitePlaylistStore::Stop()
+{
+    delete iPlaylistStore;
+    delete iDb;
+}
+
+TUint SuitePlaylistStore::Insert(TUint aIdAfter, const TChar* aUri)
+{
+    TUint id;
+    iDb->Insert(aIdAfter, Brn(aUri), Brn("<DIDL-Lite>metadata</DIDL-Lite>"), id);
+    return id;
+}
+
+TBool SuitePlaylistStore::PlaylistIs(const std::vector<const TChar*>& aUris)
+{
+    std::vector<TUint32> ids;
+    TUint seq;
+    iDb->GetIdArray(ids, seq);
+    if (ids.size() != aUris.size()) {
+        return false;
+    }
+    for (TUint i=0; i<ids.size(); i++) {
+        Track* track;
+        iDb->GetTrackById(ids[i], track);
+        const TBool match = (track->Uri() == Brn(aUris[i]) && track->MetaData() == Brn("<DIDL-Lite>metadata</DIDL-Lite>"));
+        track->RemoveRef();
+        if (!match) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SuitePlaylistStore::CorruptLastByte(const Brx& aKey)
+{
+    Bwh buf(1024 * 1024);
+    iStore->Read(aKey, buf);
+    buf[buf.Bytes()-1] = (TByte)(buf[buf.Bytes()-1] ^ 0xff);
+    iStore->Write(aKey, buf);
+}
+
+void SuitePlaylistStore::EmptyStoreLoadsNothing()
+{
+    TEST(iPlaylistStore->TracksLoaded() == 0);
+    TEST(iDb->TrackCount() == 0);
+    iPlaylistStore->Write();
+    TEST(iStore->WriteCount() == 0);
+}
+
+void SuitePlaylistStore::TracksPersistAcrossRestart()
+{
+    const TUint id1 = Insert(ITrackDatabase::kTrackIdNone, "uri1");
+    const TUint id2 = Insert(id1, "uri2");
+    (void)Insert(id2, "uri3");
+    (void)Insert(ITrackDatabase::kTrackIdNone, "uri0");
+    iDb->DeleteId(id2);
+    Restart();
+    TEST(iPlaylistStore->TracksLoaded() == 3);
+    TEST(PlaylistIs({ "uri0", "uri1", "uri3" }));
+}
+
+void SuitePlaylistStore::JournalAppliedOverSnapshot()
+{
+    const TUint id1 = Insert(ITrackDatabase::kTrackIdNone, "uri1");
+    (void)Insert(id1, "uri2");
+    Restart();
+    iPlaylistStore->Write(); // snapshot, using the newly assigned ids
+    std::vector<TUint32> ids;
+    TUint seq;
+    iDb->GetIdArray(ids, seq);
+    (void)Insert(ids[0], "uri1.5");
+    iDb->DeleteId(ids[1]);
+    iPlaylistStore->Write(); // journal
+    Restart();
+    TEST(PlaylistIs({ "uri1", "uri1.5" }));
+}
+
+void SuitePlaylistStore::DeleteAllPersists()
+{
+    const TUint id1 = Insert(ITrackDatabase::kTrackIdNone, "uri1");
+    (void)Insert(id1, "uri2");
+    iPlaylistStore->Write();
+    iDb->DeleteAll();
+    (void)Insert(ITrackDatabase::kTrackIdNone, "uri3");
+    Restart();
+    TEST(PlaylistIs({ "uri3" }));
+}
+
+void SuitePlaylistStore::ChangesAreBatched()
+{
+    TUint id = Insert(ITrackDatabase::kTrackIdNone, "uri");
+    iPlaylistStore->Write();
+    const TUint writes = iStore->WriteCount();
+    for (TUint i=0; i<10; i++) {
+        id = Insert(id, "uri");
+    }
+    TEST(iStore->WriteCount() == writes);
+    iPlaylistStore->Write();
+    TEST(iStore->WriteCount() == writes + 1);
+    iPlaylistStore->Write();
+    TEST(iStore->WriteCount() == writes + 1);
+}
+
+void SuitePlaylistStore::PowerDownWritesChanges()
+{
+    (void)Insert(ITrackDatabase::kTrackIdNone, "uri1");
+    TEST(iStore->WriteCount() == 0);
+    iPowerManager->NotifyPowerDown();
+    TEST(iStore->WriteCount() > 0);
+    Restart();
+    TEST(PlaylistIs({ "uri1" }));
+}
+
+void SuitePlaylistStore::InterruptedJournalWriteIgnored()
+{
+    const TUint id1 = Insert(ITrackDatabase::kTrackIdNone, "uri1");
+    iPlaylistStore->Write();
+    const TUint id2 = Insert(id1, "uri2");
+    iPlaylistStore->Write();
+    (void)Insert(id2, "uri3");
+    iPlaylistStore->Write();
+    CorruptLastByte(PlaylistStore::kKeyJournal); // checksum of the batch holding uri3
+    Restart();
+    TEST(PlaylistIs({ "uri1", "uri2" }));
+}
+
+void SuitePlaylistStore::CorruptSnapshotDiscarded()
+{
+    (void)Insert(ITrackDatabase::kTrackIdNone, "uri1");
+    iPlaylistStore->Write();
+    CorruptLastByte(PlaylistStore::kKeySnapshot);
+    Restart();
+    TEST(iPlaylistStore->TracksLoaded() == 0);
+    TEST(iDb->TrackCount() == 0);
+}
+
+void SuitePlaylistStore::JournalCompactedIntoSnapshot()
+{
+    Bwh metadata(kTrackMetaDataMaxBytes);
+    metadata.SetBytes(metadata.MaxBytes());
+    for (TUint i=0; i<metadata.Bytes(); i++) {
+        metadata[i] = (TByte)('a' + (i % 26));
+    }
+    TUint id = ITrackDatabase::kTrackIdNone;
+    const TUint count = 2 * PlaylistStore::kMaxJournalBytes / kTrackMetaDataMaxBytes;
+    for (TUint i=0; i<count; i++) {
+        iDb->Insert(id, Brn("uri"), metadata, id);
+        iPlaylistStore->Write();
+        Bwh journal(2 * PlaylistStore::kMaxJournalBytes);
+        iStore->Read(PlaylistStore::kKeyJournal, journal);
+        TEST(journal.Bytes() <= PlaylistStore::kMaxJournalBytes);
+    }
+    Restart();
+    TEST(iDb->TrackCount() == count);
+}
+
+
+
+void TestPlaylistStore(Environment& aEnv)
+{
+    Runner runner("PlaylistStore tests\n");
+    runner.Add(new SuitePlaylistStore(aEnv));
+    runner.Run();
+}
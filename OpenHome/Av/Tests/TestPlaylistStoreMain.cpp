@@ -0,0 +1,11 @@
+#include <OpenHome/Private/TestFramework.h>
+
+extern void TestPlaylistStore(OpenHome::Environment& aEnv);
+
+void OpenHome::TestFramework::Runner::Main(TInt /*aArgc*/, TChar* /*aArgv*/[], Net::InitialisationParams* aInitParams)
+{
+    Environment* env = Net::UpnpLibrary::InitialiseMinimal(aInitParams);
+    TestPlaylistStore(*env);
+    delete aInitParams;
+    Net::UpnpLibrary::Close();
+}
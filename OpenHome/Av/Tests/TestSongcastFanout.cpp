@@ -0,0 +1,205 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Av/Songcast/OhmSender.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/OsWrapper.h>
+
+#include <atomic>
+#include <vector>
+#include <string.h>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+using namespace OpenHome::TestFramework;
+
+/*
+ * Load test for unicast songcast fan-out.
+ *
+ * Simulates N receivers on loopback, each a UDP socket counting the audio frames it receives.
+ * The primary receiver is set as OhmSenderDriver's endpoint, the remainder as its slaves.
+ * Reports the time spent in OhmSenderDriver::SendAudio per frame and per receiver, expressed
+ * as a percentage of the real time the audio represents.  Nothing is asserted about timings.
+ */
+
+namespace OpenHome {
+namespace Av {
+
+class FanoutReceiver : private INonCopyable
+{
+    static const TUint kMaxPacketBytes = 16 * 1024;
+public:
+    FanoutReceiver(Environment& aEnv, TIpAddress aInterface);
+    ~FanoutReceiver();
+    const Endpoint& GetEndpoint() const;
+    TUint PacketsReceived() const;
+private:
+    void Run();
+private:
+    SocketUdp iSocket;
+    Endpoint iEndpoint;
+    ThreadFunctor* iThread;
+    Bws<kMaxPacketBytes> iBuf;
+    std::atomic<TUint> iPackets;
+};
+
+class SuiteSongcastFanout : public Suite, private INonCopyable
+{
+    static const TUint kSampleRate = 44100;
+    static const TUint kChannels = 2;
+    static const TUint kBitDepth = 16;
+    static const TUint kFrameMs = 5;
+    static const TUint kFrameBytes = (kSampleRate * kFrameMs / 1000) * kChannels * (kBitDepth / 8);
+    static const TUint kReceiverDrainMs = 200;
+public:
+    SuiteSongcastFanout(Environment& aEnv, TIpAddress aInterface, TUint aMaxReceivers, TUint aFrames);
+    void Test() override;
+private:
+    void Run(TUint aNumReceivers);
+private:
+    Environment& iEnv;
+    TIpAddress iInterface;
+    const TUint iMaxReceivers;
+    const TUint iFrames;
+    TByte iAudio[kFrameBytes];
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+
+// FanoutReceiver
+
+FanoutReceiver::FanoutReceiver(Environment& aEnv, TIpAddress aInterface)
+    : iSocket(aEnv, 0, aInterface)
+    , iPackets(0)
+{
+    iEndpoint.SetAddress(aInterface);
+    iEndpoint.SetPort(iSocket.Port());
+    iThread = new ThreadFunctor("FanR", MakeFunctor(*this, &FanoutReceiver::Run));
+    iThread->Start();
+}
+
+FanoutReceiver::~FanoutReceiver()
+{
+    iSocket.Interrupt(true);
+    delete iThread;
+}
+
+const Endpoint& FanoutReceiver::GetEndpoint() const
+{
+    return iEndpoint;
+}
+
+TUint FanoutReceiver::PacketsReceived() const
+{
+    return iPackets.load();
+}
+
+void FanoutReceiver::Run()
+{
+    for (;;) {
+        try {
+            (void)iSocket.Receive(iBuf);
+            iPackets++;
+        }
+        catch (NetworkError&) {
+            break;
+        }
+    }
+}
+
+
+// SuiteSongcastFanout
+
+SuiteSongcastFanout::SuiteSongcastFanout(Environment& aEnv, TIpAddress aInterface, TUint aMaxReceivers, TUint aFrames)
+    : Suite("Songcast unicast fan-out")
+    , iEnv(aEnv)
+    , iInterface(aInterface)
+    , iMaxReceivers(aMaxReceivers)
+    , iFrames(aFrames)
+{
+    // arbitrary non-silent audio so that frames are a realistic size
+    for (TUint i=0; i<kFrameBytes; i++) {
+        iAudio[i] = (TByte)(i * 7);
+    }
+}
+
+void SuiteSongcastFanout::Test()
+{
+    for (TUint n=1; n<iMaxReceivers; n*=2) {
+        Run(n);
+    }
+    Run(iMaxReceivers);
+}
+
+void SuiteSongcastFanout::Run(TUint aNumReceivers)
+{
+    std::vector<FanoutReceiver*> receivers;
+    for (TUint i=0; i<aNumReceivers; i++) {
+        receivers.push_back(new FanoutReceiver(iEnv, iInterface));
+    }
+    std::vector<Endpoint> slaves;
+    for (TUint i=1; i<aNumReceivers; i++) {
+        slaves.push_back(receivers[i]->GetEndpoint());
+    }
+
+    OhmSenderDriver* driver = new OhmSenderDriver(iEnv, nullptr, nullptr);
+    driver->SetAudioFormat(kSampleRate, kSampleRate * kChannels * kBitDepth, kChannels, kBitDepth, true, Brn("PCM"));
+    driver->SetEndpoint(receivers[0]->GetEndpoint(), iInterface);
+    driver->SetSlaves(slaves);
+    driver->SetEnabled(true);
+    driver->SetActive(true);
+
+    const TUint64 start = Os::TimeInUs(iEnv.OsCtx());
+    for (TUint i=0; i<iFrames; i++) {
+        driver->SendAudio(iAudio, kFrameBytes);
+    }
+    const TUint64 elapsedUs = Os::TimeInUs(iEnv.OsCtx()) - start;
+    Thread::Sleep(kReceiverDrainMs);
+
+    TUint minReceived = iFrames;
+    for (TUint i=0; i<aNumReceivers; i++) {
+        const TUint received = receivers[i]->PacketsReceived();
+        if (received < minReceived) {
+            minReceived = received;
+        }
+    }
+    const TUint64 audioUs = (TUint64)iFrames * kFrameMs * 1000;
+    const TUint usPerFrame = (TUint)(elapsedUs / iFrames);
+    const TUint nsPerFrameReceiver = (TUint)((elapsedUs * 1000) / ((TUint64)iFrames * aNumReceivers));
+    // percentage of one core, in hundredths, needed to keep up with real time
+    const TUint cpuPerReceiver = (TUint)((elapsedUs * 10000) / (audioUs * aNumReceivers));
+    Log::Print("receivers=%2u: %6uus/frame, %7uns/frame/receiver, %u.%02u%% cpu/receiver, min received %u/%u\n",
+               aNumReceivers, usPerFrame, nsPerFrameReceiver, cpuPerReceiver / 100, cpuPerReceiver % 100, minReceived, iFrames);
+    TEST(receivers[0]->PacketsReceived() > 0);
+
+    driver->SetActive(false);
+    delete driver;
+    for (TUint i=0; i<aNumReceivers; i++) {
+        delete receivers[i];
+    }
+}
+
+
+
+void TestSongcastFanout(Environment& aEnv, const std::vector<Brn>& aArgs)
+{
+    OptionParser parser;
+    OptionUint optionReceivers("-n", "--receivers", 32, "Maximum number of simulated receivers");
+    parser.AddOption(&optionReceivers);
+    OptionUint optionFrames("-f", "--frames", 2000, "Number of audio frames to send for each receiver count");
+    parser.AddOption(&optionFrames);
+    if (!parser.Parse(aArgs) || parser.HelpDisplayed()) {
+        return;
+    }
+    const TUint receivers = optionReceivers.Value() == 0? 1 : optionReceivers.Value();
+    const TUint frames = optionFrames.Value() == 0? 1 : optionFrames.Value();
+
+    Endpoint loopback(0, Brn("127.0.0.1"));
+    Runner runner("Songcast fan-out load test\n");
+    runner.Add(new SuiteSongcastFanout(aEnv, loopback.Address(), receivers, frames));
+    runner.Run();
+}
@@ -0,0 +1,336 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Av/Songcast/OhmSender.h>
+#include <OpenHome/Av/Songcast/OhmFec.h>
+#include <OpenHome/Av/Songcast/Ohm.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Converter.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/OptionParser.h>
+
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+using namespace OpenHome::TestFramework;
+
+/*
+ * Loss-injection test for songcast forward error correction.
+ *
+ * OhmSenderDriver sends to a loopback UDP socket.  The receiver discards a configurable
+ * proportion of incoming packets (audio and parity alike), feeds the remainder to an
+ * OhmFecDecoder and checks every rebuilt frame against the original that was discarded.
+ * For each parity group size and loss rate, reports the bandwidth overhead of parity and
+ * the proportion of lost frames that were rebuilt without needing a resend.
+ */
+
+namespace OpenHome {
+namespace Av {
+
+class LossyReceiver : private INonCopyable
+{
+    static const TUint kMaxPacketBytes = 16 * 1024;
+    static const TUint kRecvBufBytes = 1024 * 1024;
+    static const TUint kMaxDroppedFrames = 64;
+    static const TUint kAudioFrameOffset = 4;
+    static const TUint kAudioFlagsOffset = 1;
+public:
+    LossyReceiver(Environment& aEnv, TIpAddress aInterface, TUint aLossPerMille, TUint aSeed);
+    ~LossyReceiver();
+    const Endpoint& GetEndpoint() const;
+    void Stop();
+    TUint AudioFramesReceived() const;
+    TUint AudioFramesDropped() const;
+    TUint FramesRecovered() const;
+    TUint FramesMismatched() const;
+    TUint64 AudioBytes() const;
+    TUint64 ParityBytes() const;
+private:
+    void Run();
+    TBool Drop();
+    void Process(const Brx& aPacket);
+    void CheckRecovered(const Brx& aAudio);
+private:
+    class DroppedFrame
+    {
+    public:
+        DroppedFrame() : iFrame(0), iValid(false) {}
+    public:
+        TUint iFrame;
+        TBool iValid;
+        Bws<OhmMsgAudioBlob::kMaxBytes> iAudio;
+    };
+private:
+    SocketUdp iSocket;
+    Endpoint iEndpoint;
+    ThreadFunctor* iThread;
+    const TUint iLossPerMille;
+    TUint iRandom;
+    OhmFecDecoder iDecoder;
+    Bws<kMaxPacketBytes> iPacket;
+    Bws<OhmMsgAudioBlob::kMaxBytes> iRecovered;
+    DroppedFrame* iDropped; // ring indexed by (frame % kMaxDroppedFrames)
+    TUint iAudioReceived;
+    TUint iAudioDropped;
+    TUint iMismatched;
+    TUint64 iAudioBytes;
+    TUint64 iParityBytes;
+};
+
+class SuiteSongcastFec : public Suite, private INonCopyable
+{
+    static const TUint kSampleRate = 44100;
+    static const TUint kChannels = 2;
+    static const TUint kBitDepth = 16;
+    static const TUint kFrameMs = 5;
+    static const TUint kFrameBytes = (kSampleRate * kFrameMs / 1000) * kChannels * (kBitDepth / 8);
+    static const TUint kFramesPerBurst = 20;
+    static const TUint kReceiverDrainMs = 200;
+public:
+    SuiteSongcastFec(Environment& aEnv, TIpAddress aInterface, TUint aFrames, TUint aSeed);
+    void Test() override;
+private:
+    void Run(TUint aGroupFrames, TUint aLossPerMille);
+private:
+    Environment& iEnv;
+    TIpAddress iInterface;
+    const TUint iFrames;
+    const TUint iSeed;
+    TByte iAudio[kFrameBytes];
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+
+// LossyReceiver
+
+LossyReceiver::LossyReceiver(Environment& aEnv, TIpAddress aInterface, TUint aLossPerMille, TUint aSeed)
+    : iSocket(aEnv, 0, aInterface)
+    , iLossPerMille(aLossPerMille)
+    , iRandom(aSeed)
+    , iAudioReceived(0)
+    , iAudioDropped(0)
+    , iMismatched(0)
+    , iAudioBytes(0)
+    , iParityBytes(0)
+{
+    iSocket.SetRecvBufBytes(kRecvBufBytes);
+    iEndpoint.SetAddress(aInterface);
+    iEndpoint.SetPort(iSocket.Port());
+    iDropped = new DroppedFrame[kMaxDroppedFrames];
+    iThread = new ThreadFunctor("FecR", MakeFunctor(*this, &LossyReceiver::Run));
+    iThread->Start();
+}
+
+LossyReceiver::~LossyReceiver()
+{
+    Stop();
+    delete[] iDropped;
+}
+
+const Endpoint& LossyReceiver::GetEndpoint() const
+{
+    return iEndpoint;
+}
+
+void LossyReceiver::Stop()
+{
+    if (iThread != nullptr) {
+        iSocket.Interrupt(true);
+        delete iThread;
+        iThread = nullptr;
+    }
+}
+
+TUint LossyReceiver::AudioFramesReceived() const
+{
+    return iAudioReceived;
+}
+
+TUint LossyReceiver::AudioFramesDropped() const
+{
+    return iAudioDropped;
+}
+
+TUint LossyReceiver::FramesRecovered() const
+{
+    return iDecoder.FramesRecovered();
+}
+
+TUint LossyReceiver::FramesMismatched() const
+{
+    return iMismatched;
+}
+
+TUint64 LossyReceiver::AudioBytes() const
+{
+    return iAudioBytes;
+}
+
+TUint64 LossyReceiver::ParityBytes() const
+{
+    return iParityBytes;
+}
+
+void LossyReceiver::Run()
+{
+    for (;;) {
+        try {
+            (void)iSocket.Receive(iPacket);
+            Process(iPacket);
+        }
+        catch (NetworkError&) {
+            break;
+        }
+        catch (OhmError&) {
+            ASSERTS();
+        }
+    }
+}
+
+TBool LossyReceiver::Drop()
+{
+    // deterministic so that results are repeatable for a given seed
+    iRandom = iRandom * 1103515245 + 12345;
+    return ((iRandom >> 16) % 1000) < iLossPerMille;
+}
+
+void LossyReceiver::Process(const Brx& aPacket)
+{
+    ReaderBuffer reader(aPacket);
+    OhmHeader header;
+    header.Internalise(reader);
+    if (header.MsgType() == OhmHeader::kMsgTypeAudio) {
+        const Brn audio = aPacket.Split(OhmHeader::kHeaderBytes, header.MsgBytes());
+        const TUint frame = Converter::BeUint32At(audio, kAudioFrameOffset);
+        iAudioReceived++;
+        iAudioBytes += aPacket.Bytes();
+        if (Drop()) {
+            iAudioDropped++;
+            DroppedFrame& dropped = iDropped[frame % kMaxDroppedFrames];
+            dropped.iFrame = frame;
+            dropped.iValid = true;
+            dropped.iAudio.Replace(audio);
+            return;
+        }
+        (void)iDecoder.AddAudio(frame, audio);
+    }
+    else if (header.MsgType() == OhmHeader::kMsgTypeParity) {
+        iParityBytes += aPacket.Bytes();
+        if (Drop()) {
+            return;
+        }
+        iDecoder.AddParity(reader, header);
+    }
+    while (iDecoder.TryRecover(iRecovered)) {
+        CheckRecovered(iRecovered);
+    }
+}
+
+void LossyReceiver::CheckRecovered(const Brx& aAudio)
+{
+    const TUint frame = Converter::BeUint32At(aAudio, kAudioFrameOffset);
+    const DroppedFrame& dropped = iDropped[frame % kMaxDroppedFrames];
+    if (!dropped.iValid || dropped.iFrame != frame || dropped.iAudio.Bytes() != aAudio.Bytes()) {
+        Log::Print("Rebuilt frame %u doesn't correspond to a dropped frame\n", frame);
+        iMismatched++;
+        return;
+    }
+    // rebuilt frames are flagged as resent; all other bytes should be identical
+    const TByte flags = (TByte)(aAudio[kAudioFlagsOffset] & ~OhmMsgAudio::kFlagResent);
+    if (flags != dropped.iAudio[kAudioFlagsOffset] ||
+        Brn(aAudio.Ptr(), kAudioFlagsOffset) != Brn(dropped.iAudio.Ptr(), kAudioFlagsOffset) ||
+        aAudio.Split(kAudioFlagsOffset + 1) != dropped.iAudio.Split(kAudioFlagsOffset + 1)) {
+        Log::Print("Rebuilt frame %u differs from original\n", frame);
+        iMismatched++;
+    }
+}
+
+
+// SuiteSongcastFec
+
+SuiteSongcastFec::SuiteSongcastFec(Environment& aEnv, TIpAddress aInterface, TUint aFrames, TUint aSeed)
+    : Suite("Songcast forward error correction")
+    , iEnv(aEnv)
+    , iInterface(aInterface)
+    , iFrames(aFrames)
+    , iSeed(aSeed)
+{
+    // arbitrary non-silent audio so that frames are a realistic size
+    for (TUint i=0; i<kFrameBytes; i++) {
+        iAudio[i] = (TByte)(i * 7);
+    }
+}
+
+void SuiteSongcastFec::Test()
+{
+    static const TUint kGroupFrames[] = { 16, 8, 4 };
+    static const TUint kLossPerMille[] = { 0, 10, 20, 50, 100 };
+    for (TUint i=0; i<sizeof(kGroupFrames)/sizeof(kGroupFrames[0]); i++) {
+        for (TUint j=0; j<sizeof(kLossPerMille)/sizeof(kLossPerMille[0]); j++) {
+            Run(kGroupFrames[i], kLossPerMille[j]);
+        }
+    }
+}
+
+void SuiteSongcastFec::Run(TUint aGroupFrames, TUint aLossPerMille)
+{
+    LossyReceiver* receiver = new LossyReceiver(iEnv, iInterface, aLossPerMille, iSeed);
+    OhmSenderDriver* driver = new OhmSenderDriver(iEnv, nullptr, nullptr);
+    driver->SetAudioFormat(kSampleRate, kSampleRate * kChannels * kBitDepth, kChannels, kBitDepth, true, Brn("PCM"));
+    driver->SetErrorCorrection(aGroupFrames);
+    driver->SetEndpoint(receiver->GetEndpoint(), iInterface);
+    driver->SetEnabled(true);
+    driver->SetActive(true);
+
+    for (TUint i=0; i<iFrames; i++) {
+        driver->SendAudio(iAudio, kFrameBytes);
+        if ((i % kFramesPerBurst) == kFramesPerBurst - 1) {
+            // avoid overflowing the receiver's socket buffer; we only want to measure injected loss
+            Thread::Sleep(1);
+        }
+    }
+    Thread::Sleep(kReceiverDrainMs);
+    receiver->Stop();
+
+    const TUint dropped = receiver->AudioFramesDropped();
+    const TUint recovered = receiver->FramesRecovered();
+    const TUint overhead = receiver->AudioBytes() == 0? 0 : (TUint)((receiver->ParityBytes() * 10000) / receiver->AudioBytes());
+    const TUint recoveryRate = dropped == 0? 10000 : (recovered * 10000) / dropped;
+    Log::Print("group=%2u frames, loss=%2u.%u%%: overhead %2u.%02u%%, received %u/%u, dropped %3u, rebuilt %3u (%3u.%02u%%), resends needed %3u\n",
+               aGroupFrames, aLossPerMille / 10, aLossPerMille % 10, overhead / 100, overhead % 100,
+               receiver->AudioFramesReceived(), iFrames, dropped, recovered, recoveryRate / 100, recoveryRate % 100,
+               dropped - recovered);
+    TEST(receiver->FramesMismatched() == 0);
+    TEST(recovered <= dropped);
+    if (aLossPerMille > 0 && aLossPerMille <= 20) {
+        // at low loss rates, most groups lose at most one packet
+        TEST(recovered > dropped / 2);
+    }
+
+    driver->SetActive(false);
+    delete driver;
+    delete receiver;
+}
+
+
+
+void TestSongcastFec(Environment& aEnv, const std::vector<Brn>& aArgs)
+{
+    OptionParser parser;
+    OptionUint optionFrames("-f", "--frames", 4000, "Number of audio frames to send for each group size and loss rate");
+    parser.AddOption(&optionFrames);
+    OptionUint optionSeed("-s", "--seed", 1, "Seed for packet loss injection");
+    parser.AddOption(&optionSeed);
+    if (!parser.Parse(aArgs) || parser.HelpDisplayed()) {
+        return;
+    }
+    const TUint frames = optionFrames.Value() == 0? 1 : optionFrames.Value();
+
+    Endpoint loopback(0, Brn("127.0.0.1"));
+    Runner runner("Songcast forward error correction loss-injection test\n");
+    runner.Add(new SuiteSongcastFec(aEnv, loopback.Address(), frames, optionSeed.Value()));
+    runner.Run();
+}
@@ -35,6 +35,7 @@ private:
     void GetIdArrayDbEmpty();
     void GetIdArrayDbPartiallyFull();
     void GetIdArrayDbFull();
+    void GetIdArrayVectorTracksEdits();
     void InsertAtStart();
     void InsertInMiddle();
     void InsertAtEnd();
@@ -46,6 +47,7 @@ private:
     void GetTrackByInvalidIdFails();
     void GetTrackByIdValidSeq();
     void GetTrackByIdInvalidSeq();
+    void TryIndexOf();
     void MultipleObservers();
 private:
     Media::AllocatorInfoLogger iInfoAggregator;
@@ -176,6 +178,7 @@ SuiteTrackDatabase::SuiteTrackDatabase()
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::GetIdArrayDbEmpty), "GetIdArrayDbEmpty");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::GetIdArrayDbPartiallyFull), "GetIdArrayDbPartiallyFull");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::GetIdArrayDbFull), "GetIdArrayDbFull");
+    AddTest(MakeFunctor(*this, &SuiteTrackDatabase::GetIdArrayVectorTracksEdits), "GetIdArrayVectorTracksEdits");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::InsertAtStart), "InsertAtStart");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::InsertInMiddle), "InsertInMiddle");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::InsertAtEnd), "InsertAtEnd");
@@ -187,6 +190,7 @@ SuiteTrackDatabase::SuiteTrackDatabase()
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::GetTrackByInvalidIdFails), "GetTrackByInvalidIdFails");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::GetTrackByIdValidSeq), "GetTrackByIdValidSeq");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::GetTrackByIdInvalidSeq), "GetTrackByIdInvalidSeq");
+    AddTest(MakeFunctor(*this, &SuiteTrackDatabase::TryIndexOf), "TryIndexOf");
     AddTest(MakeFunctor(*this, &SuiteTrackDatabase::MultipleObservers), "MultipleObservers");
 }
 
@@ -308,6 +312,42 @@ void SuiteTrackDatabase::GetIdArrayDbFull()
     }
 }
 
+void SuiteTrackDatabase::GetIdArrayVectorTracksEdits()
+{
+    TUint ids[3];
+    iTrackDatabase->Insert(ITrackDatabase::kTrackIdNone, Brx::Empty(), Brx::Empty(), ids[0]);
+    iTrackDatabase->Insert(ids[0], Brx::Empty(), Brx::Empty(), ids[1]);
+    std::vector<TUint32> idArray;
+    TUint seq;
+    iTrackDatabase->GetIdArray(idArray, seq);
+    TEST(idArray.size() == 2);
+    TEST(idArray[0] == ids[0]);
+    TEST(idArray[1] == ids[1]);
+
+    // unchanged db returns the same ids
+    TUint seq2;
+    iTrackDatabase->GetIdArray(idArray, seq2);
+    TEST(seq2 == seq);
+    TEST(idArray.size() == 2);
+
+    // each edit is reflected in the next call
+    iTrackDatabase->Insert(ids[0], Brx::Empty(), Brx::Empty(), ids[2]);
+    iTrackDatabase->GetIdArray(idArray, seq2);
+    TEST(seq2 != seq);
+    TEST(idArray.size() == 3);
+    TEST(idArray[0] == ids[0]);
+    TEST(idArray[1] == ids[2]);
+    TEST(idArray[2] == ids[1]);
+    iTrackDatabase->DeleteId(ids[0]);
+    iTrackDatabase->GetIdArray(idArray, seq2);
+    TEST(idArray.size() == 2);
+    TEST(idArray[0] == ids[2]);
+    TEST(idArray[1] == ids[1]);
+    iTrackDatabase->DeleteAll();
+    iTrackDatabase->GetIdArray(idArray, seq2);
+    TEST(idArray.size() == 0);
+}
+
 void SuiteTrackDatabase::InsertAtStart()
 {
     TUint ids[2];
@@ -530,6 +570,25 @@ void SuiteTrackDatabase::GetTrackByIdInvalidSeq()
     track->RemoveRef();
 }
 
+void SuiteTrackDatabase::TryIndexOf()
+{
+    TUint ids[3];
+    iTrackDatabase->Insert(ITrackDatabase::kTrackIdNone, Brx::Empty(), Brx::Empty(), ids[0]);
+    iTrackDatabase->Insert(ids[0], Brx::Empty(), Brx::Empty(), ids[2]);
+    iTrackDatabase->Insert(ids[0], Brx::Empty(), Brx::Empty(), ids[1]);
+    TUint index = UINT_MAX;
+    for (TUint i=0; i<sizeof(ids)/sizeof(ids[0]); i++) {
+        TEST(iTrackDatabase->TryIndexOf(ids[i], index));
+        TEST(index == i);
+    }
+    TEST(!iTrackDatabase->TryIndexOf(ITrackDatabase::kTrackIdNone, index));
+
+    iTrackDatabase->DeleteId(ids[0]);
+    TEST(!iTrackDatabase->TryIndexOf(ids[0], index));
+    TEST(iTrackDatabase->TryIndexOf(ids[2], index));
+    TEST(index == 1);
+}
+
 void SuiteTrackDatabase::MultipleObservers()
 {
     iTrackDatabase->AddObserver(*this);
@@ -828,7 +887,7 @@ void SuiteShuffler::PrevTrackRefShuffleOn()
     iShuffler->SetShuffle(true);
 
     // find id of last shuffled track
-    TUint id = iShuffler->iShuffleList[iShuffler->iShuffleList.size()-1]->Id();
+    TUint id = iShuffler->iShuffleList.At(iShuffler->iShuffleList.Size()-1)->Id();
 
     TBool shuffled = false;
     for (TInt i=kNumTracks-1; i>=0; i--) {
@@ -912,7 +971,7 @@ void SuiteShuffler::TrackRefByIndexSortedShuffleOn()
     for (TUint i=0; i<kNumTracks; i++) {
         track = iReader->TrackRefByIndexSorted(i);
         TEST(track != nullptr);
-        TEST(track->Id() == iShuffler->iShuffleList[i]->Id());
+        TEST(track->Id() == iShuffler->iShuffleList.At(i)->Id());
         track->RemoveRef();
     }
     track = iReader->TrackRefByIndexSorted(kNumTracks+1);
@@ -0,0 +1,250 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Av/Playlist/OrderedIdList.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/OsWrapper.h>
+
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::Av;
+using namespace OpenHome::TestFramework;
+
+/*
+ * Benchmark for playlist track storage.
+ *
+ * Compares OrderedIdList (as now used by TrackDatabase and Shuffler) with the std::vector
+ * and linear id search it replaced, for playlists of 1k, 10k and 100k tracks.  Each run
+ * starts from a playlist of the given size then times a fixed number of random
+ * insert-after-id, lookup-by-id (including index) and delete-by-id operations.
+ *
+ * Lightweight stand-ins are used for Media::Track, whose fixed size uri/metadata buffers
+ * would need ~600MB for a 100k track TrackFactory.
+ */
+
+namespace OpenHome {
+namespace Av {
+
+class BenchTrack
+{
+public:
+    BenchTrack(TUint aId) : iId(aId) {}
+    TUint Id() const { return iId; }
+private:
+    TUint iId;
+};
+
+class ITrackStoreBench
+{
+public:
+    virtual ~ITrackStoreBench() {}
+    virtual const TChar* Name() const = 0;
+    virtual void Append(BenchTrack* aTrack) = 0;
+    virtual void InsertAfter(TUint aIdAfter, BenchTrack* aTrack) = 0;
+    virtual TUint IndexOf(TUint aId) const = 0;
+    virtual BenchTrack* Delete(TUint aId) = 0;
+    virtual TUint Size() const = 0;
+};
+
+class TrackStoreVector : public ITrackStoreBench
+{
+public: // from ITrackStoreBench
+    const TChar* Name() const override { return "vector"; }
+    void Append(BenchTrack* aTrack) override;
+    void InsertAfter(TUint aIdAfter, BenchTrack* aTrack) override;
+    TUint IndexOf(TUint aId) const override;
+    BenchTrack* Delete(TUint aId) override;
+    TUint Size() const override;
+private:
+    std::vector<BenchTrack*> iTracks;
+};
+
+class TrackStoreOrdered : public ITrackStoreBench
+{
+public: // from ITrackStoreBench
+    const TChar* Name() const override { return "ordered"; }
+    void Append(BenchTrack* aTrack) override;
+    void InsertAfter(TUint aIdAfter, BenchTrack* aTrack) override;
+    TUint IndexOf(TUint aId) const override;
+    BenchTrack* Delete(TUint aId) override;
+    TUint Size() const override;
+private:
+    OrderedIdList<BenchTrack> iTracks;
+};
+
+class SuiteTrackDatabaseBenchmark : public Suite, private INonCopyable
+{
+public:
+    SuiteTrackDatabaseBenchmark(Environment& aEnv, TUint aOps);
+    void Test() override;
+private:
+    void Run(TUint aTracks);
+    TUint64 Run(ITrackStoreBench& aStore, TUint aTracks, TUint& aChecksum);
+    TUint NextRandom();
+private:
+    Environment& iEnv;
+    const TUint iOps;
+    TUint iRandom;
+};
+
+} // namespace Av
+} // namespace OpenHome
+
+
+// TrackStoreVector
+
+void TrackStoreVector::Append(BenchTrack* aTrack)
+{
+    iTracks.push_back(aTrack);
+}
+
+void TrackStoreVector::InsertAfter(TUint aIdAfter, BenchTrack* aTrack)
+{
+    const TUint index = IndexOf(aIdAfter) + 1;
+    iTracks.insert(iTracks.begin() + index, aTrack);
+}
+
+TUint TrackStoreVector::IndexOf(TUint aId) const
+{
+    for (TUint i=0; i<iTracks.size(); i++) {
+        if (iTracks[i]->Id() == aId) {
+            return i;
+        }
+    }
+    ASSERTS();
+    return 0;
+}
+
+BenchTrack* TrackStoreVector::Delete(TUint aId)
+{
+    const TUint index = IndexOf(aId);
+    BenchTrack* track = iTracks[index];
+    (void)iTracks.erase(iTracks.begin() + index);
+    return track;
+}
+
+TUint TrackStoreVector::Size() const
+{
+    return iTracks.size();
+}
+
+
+// TrackStoreOrdered
+
+void TrackStoreOrdered::Append(BenchTrack* aTrack)
+{
+    iTracks.Insert(iTracks.Size(), aTrack);
+}
+
+void TrackStoreOrdered::InsertAfter(TUint aIdAfter, BenchTrack* aTrack)
+{
+    iTracks.Insert(IndexOf(aIdAfter) + 1, aTrack);
+}
+
+TUint TrackStoreOrdered::IndexOf(TUint aId) const
+{
+    TUint index = 0;
+    ASSERT(iTracks.TryIndexOf(aId, index));
+    return index;
+}
+
+BenchTrack* TrackStoreOrdered::Delete(TUint aId)
+{
+    return iTracks.RemoveAt(IndexOf(aId));
+}
+
+TUint TrackStoreOrdered::Size() const
+{
+    return iTracks.Size();
+}
+
+
+// SuiteTrackDatabaseBenchmark
+
+SuiteTrackDatabaseBenchmark::SuiteTrackDatabaseBenchmark(Environment& aEnv, TUint aOps)
+    : Suite("TrackDatabase storage benchmark")
+    , iEnv(aEnv)
+    , iOps(aOps)
+    , iRandom(1)
+{
+}
+
+void SuiteTrackDatabaseBenchmark::Test()
+{
+    Run(1000);
+    Run(10000);
+    Run(100000);
+}
+
+void SuiteTrackDatabaseBenchmark::Run(TUint aTracks)
+{
+    TrackStoreVector vec;
+    TrackStoreOrdered ordered;
+    TUint checksumVector = 0;
+    TUint checksumOrdered = 0;
+    const TUint64 usVector = Run(vec, aTracks, checksumVector);
+    const TUint64 usOrdered = Run(ordered, aTracks, checksumOrdered);
+    const TUint speedup = (usOrdered == 0? 0 : (TUint)(usVector / usOrdered));
+    Log::Print("tracks=%6u: vector %8lluus, ordered %6lluus (%u ops of each type), speedup x%u\n",
+               aTracks, (unsigned long long)usVector, (unsigned long long)usOrdered, iOps, speedup);
+    // both stores saw the same sequence of operations so should agree on every index
+    TEST(checksumVector == checksumOrdered);
+}
+
+TUint64 SuiteTrackDatabaseBenchmark::Run(ITrackStoreBench& aStore, TUint aTracks, TUint& aChecksum)
+{
+    std::vector<BenchTrack*> tracks;
+    tracks.reserve(aTracks + iOps);
+    TUint nextId = 1;
+    for (TUint i=0; i<aTracks; i++) {
+        BenchTrack* track = new BenchTrack(nextId++);
+        tracks.push_back(track);
+        aStore.Append(track);
+    }
+
+    iRandom = 1; // same operations for each store
+    aChecksum = 0;
+    const TUint64 start = Os::TimeInUs(iEnv.OsCtx());
+    for (TUint i=0; i<iOps; i++) {
+        // insert after a random track, look up a random track, then delete a random track
+        BenchTrack* track = new BenchTrack(nextId++);
+        aStore.InsertAfter(tracks[NextRandom() % tracks.size()]->Id(), track);
+        tracks.push_back(track);
+        aChecksum += aStore.IndexOf(tracks[NextRandom() % tracks.size()]->Id());
+        const TUint index = NextRandom() % tracks.size();
+        delete aStore.Delete(tracks[index]->Id());
+        tracks[index] = tracks.back();
+        tracks.pop_back();
+    }
+    const TUint64 elapsed = Os::TimeInUs(iEnv.OsCtx()) - start;
+    TEST(aStore.Size() == aTracks);
+
+    for (TUint i=0; i<tracks.size(); i++) {
+        delete aStore.Delete(tracks[i]->Id());
+    }
+    return elapsed;
+}
+
+TUint SuiteTrackDatabaseBenchmark::NextRandom()
+{
+    iRandom = iRandom * 1103515245 + 12345;
+    return iRandom >> 8;
+}
+
+
+
+void TestTrackDatabaseBenchmark(Environment& aEnv, const std::vector<Brn>& aArgs)
+{
+    OptionParser parser;
+    OptionUint optionOps("-o", "--ops", 2000, "Number of each type of operation timed for each playlist size");
+    parser.AddOption(&optionOps);
+    if (!parser.Parse(aArgs) || parser.HelpDisplayed()) {
+        return;
+    }
+    const TUint ops = optionOps.Value() == 0? 1 : optionOps.Value();
+
+    Runner runner("TrackDatabase storage benchmark\n");
+    runner.Add(new SuiteTrackDatabaseBenchmark(aEnv, ops));
+    runner.Run();
+}
@@ -0,0 +1,17 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Private/OptionParser.h>
+
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+
+extern void TestTrackDatabaseBenchmark(OpenHome::Environment& aEnv, const std::vector<Brn>& aArgs);
+
+void OpenHome::TestFramework::Runner::Main(TInt aArgc, TChar* aArgv[], Net::InitialisationParams* aInitParams)
+{
+    Net::Library* lib = new Net::Library(aInitParams);
+    std::vector<Brn> args = OptionParser::ConvertArgs(aArgc, aArgv);
+    TestTrackDatabaseBenchmark(lib->Env(), args);
+    delete lib;
+}
@@ -54,6 +54,9 @@ CodecAac::CodecAac(IMimeTypeList& aMimeTypeList)
     : CodecAacBase("AAC", aMimeTypeList)
 {
     LOG(kCodec, "CodecAac::CodecAac\n");
+    AddRecognitionSignature(Brn("mp4a"));
+    AddRecognitionExtension("m4a");
+    AddRecognitionExtension("mp4");
 }
 
 CodecAac::~CodecAac()
@@ -108,14 +111,8 @@ void CodecAac::StreamInitialise()
         mp4Reader.Read(info);
 
         // Read sample size table.
-        ReaderBinary readerBin(codecBufReader);
         iSampleSizeTable.Clear();
-        const TUint sampleCount = readerBin.ReadUintBe(4);
-        iSampleSizeTable.Init(sampleCount);
-        for (TUint i=0; i<sampleCount; i++) {
-            const TUint sampleSize = readerBin.ReadUintBe(4);
-            iSampleSizeTable.AddSampleSize(sampleSize);
-        }
+        iSampleSizeTable.Read(codecBufReader);
 
         // Read seek table.
         iSeekTable.Deinitialise();
@@ -252,6 +249,7 @@ void CodecAac::StreamInitialise()
 void CodecAac::StreamCompleted()
 {
     LOG(kCodec, "CodecAac::StreamCompleted\n");
+    CodecAacBase::StreamCompleted();
 }
 
 TBool CodecAac::TrySeek(TUint aStreamId, TUint64 aSample)
@@ -275,7 +273,7 @@ TBool CodecAac::TrySeek(TUint aStreamId, TUint64 aSample)
             iTrackOffset = (Jiffies::kPerSecond/iOutputSampleRate)*aSample;
             iInBuf.SetBytes(0);
             iDecodedBuf.SetBytes(0);
-            iOutBuf.SetBytes(0);
+            ReleaseOutput();
             iController->OutputDecodedStream(iBitrateAverage, iBitDepth, iOutputSampleRate, iChannels, kCodecAac, iTrackLengthJiffies, aSample, false);
         }
         return canSeek;
@@ -3,6 +3,7 @@
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Media/Debug.h>
 #include <OpenHome/Media/MimeTypeList.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
 
 #include <string.h>
 
@@ -39,6 +40,8 @@ const Brn CodecAacBase::kCodecAac("AAC");
 
 CodecAacBase::CodecAacBase(const TChar* aId, IMimeTypeList& aMimeTypeList)
     : CodecBase(aId)
+    , iOutBuf(nullptr)
+    , iOutBufBytes(0)
 {
     LOG(kCodec, "CodecAacBase::CodecAacBase\n");
     aMimeTypeList.Add("audio/aac");
@@ -91,12 +94,13 @@ void CodecAacBase::StreamInitialise()
 
     iInBuf.SetBytes(0);
     iDecodedBuf.SetBytes(0);
-    iOutBuf.SetBytes(0);
+    ReleaseOutput();
 }
 
 void CodecAacBase::StreamCompleted()
 {
     LOG(kCodec, "CodecAacBase::StreamCompleted\n");
+    ReleaseOutput();
 }
 
 TBool CodecAacBase::TrySeek(TUint /*aStreamId*/, TUint64 /*aSample*/)
@@ -106,40 +110,29 @@ TBool CodecAacBase::TrySeek(TUint /*aStreamId*/, TUint64 /*aSample*/)
 
 void CodecAacBase::BigEndianData(TUint aToWrite, TUint aSamplesWritten)
 {
-    TByte* dst = const_cast<TByte*>(iOutBuf.Ptr()) + iOutBuf.Bytes();
+    TByte* dst = iOutBuf->WritePtr() + iOutBufBytes;
     TByte* src = const_cast<TByte*>(iDecodedBuf.Ptr()) + (aSamplesWritten * iBytesPerSample);
-    TUint i=0;
-
-    for(i=0 ; i<aToWrite*iChannels; i++) {
-        switch (iBitDepth) {
-        case 8:
-            *dst++ = *src++;
-            break;
-        case 16:
-#ifdef DEFINE_BIG_ENDIAN
-            *dst++ = src[0];
-            *dst++ = src[1];
-#else
-            *dst++ = src[1];
-            *dst++ = src[0];
-#endif
-            src += 2;
-            break;
-        case 24:
+    const TUint subsamples = aToWrite * iChannels;
+
+    switch (iBitDepth) {
+    case 8:
+        (void)memcpy(dst, src, subsamples);
+        break;
 #ifdef DEFINE_BIG_ENDIAN
-            *dst++ = src[0];
-            *dst++ = src[1];
-            *dst++ = src[2];
+    case 16:
+    case 24:
+        (void)memcpy(dst, src, subsamples * (iBitDepth/8));
+        break;
 #else
-            *dst++ = src[2];
-            *dst++ = src[1];
-            *dst++ = src[0];
+    case 16:
+        PcmConverter::SwapEndian16(dst, src, subsamples);
+        break;
+    case 24:
+        PcmConverter::SwapEndian24(dst, src, subsamples);
+        break;
 #endif
-            src += 3;
-            break;
-        default:
-            ASSERTS();
-        }
+    default:
+        ASSERTS();
     }
 }
 
@@ -176,14 +169,30 @@ void CodecAacBase::Process()
 // flush any remaining samples from the decoded buffer
 void CodecAacBase::FlushOutput()
 {    
-    if ((iStreamEnded || iNewStreamStarted) && iOutBuf.Bytes() > 0) {
-        iTrackOffset += iController->OutputAudioPcm(iOutBuf, iChannels, iOutputSampleRate,
-            iBitDepth, EMediaDataEndianBig, iTrackOffset);
-        iOutBuf.SetBytes(0);
+    if ((iStreamEnded || iNewStreamStarted) && iOutBufBytes > 0) {
+        OutputAudio();
     }
     //LOG(kCodec, "CodecAac::Process complete - total samples = %lld\n", iTotalSamplesOutput);
 }
 
+void CodecAacBase::ReleaseOutput()
+{
+    if (iOutBuf != nullptr) {
+        iOutBuf->RemoveRef();
+        iOutBuf = nullptr;
+    }
+    iOutBufBytes = 0;
+}
+
+void CodecAacBase::OutputAudio()
+{
+    DecodedAudio* audio = iOutBuf;
+    const TUint bytes = iOutBufBytes;
+    iOutBuf = nullptr;
+    iOutBufBytes = 0;
+    iTrackOffset += iController->OutputAudioPcm(audio, bytes, iChannels, iOutputSampleRate, iBitDepth, iTrackOffset);
+}
+
 void CodecAacBase::DecodeFrame(TBool aParseOnly)
 {
     TUint error = false;
@@ -292,9 +301,13 @@ void CodecAacBase::DecodeFrame(TBool aParseOnly)
     TUint samplesToWrite = iDecodedBuf.Bytes()/iBytesPerSample;
     TUint samplesWritten = 0;
     while (samplesToWrite > 0) {
+        if (iOutBuf == nullptr) {
+            iOutBuf = iController->GetAudioBuffer();
+            iOutBufBytes = 0;
+        }
         TUint bytes = samplesToWrite * (iBitDepth/8) * iChannels;
         TUint samples = samplesToWrite;
-        TUint outputSpace = iOutBuf.MaxBytes() - iOutBuf.Bytes();
+        TUint outputSpace = DecodedAudio::kMaxBytes - iOutBufBytes;
         if (bytes > outputSpace) {
             samples = outputSpace / (iChannels * (iBitDepth/8));
             bytes = samples * (iBitDepth/8) * iChannels;
@@ -302,11 +315,9 @@ void CodecAacBase::DecodeFrame(TBool aParseOnly)
 
         // read from iDecodedBuf into iOutBuf
         BigEndianData(samples, samplesWritten);
-        iOutBuf.SetBytes(iOutBuf.Bytes() + bytes);
-        if (iOutBuf.MaxBytes() - iOutBuf.Bytes() < (TUint)(iBitDepth/8) * iChannels) {
-            iTrackOffset += iController->OutputAudioPcm(iOutBuf, iChannels, iOutputSampleRate,
-                iBitDepth, EMediaDataEndianBig, iTrackOffset);
-            iOutBuf.SetBytes(0);
+        iOutBufBytes += bytes;
+        if (DecodedAudio::kMaxBytes - iOutBufBytes < (TUint)(iBitDepth/8) * iChannels) {
+            OutputAudio();
         }
         samplesToWrite -= samples;
         samplesWritten += samples;
@@ -38,7 +38,9 @@ protected:
     void InitialiseDecoder();
     void DecodeFrame(TBool aParseOnly);
     void FlushOutput();
+    void ReleaseOutput();
 private:
+    void OutputAudio();
     void BigEndianData(TUint toWrite, TUint samplesWritten);
     static void InterleaveSamples(Word16 *pTimeCh0,
                   Word16 *pTimeCh1,
@@ -48,7 +50,8 @@ private:
 protected:
     Bws<kInputBufBytes> iInBuf;
     Bws<16*10240> iDecodedBuf;
-    Bws<DecodedAudio::kMaxBytes> iOutBuf;
+    DecodedAudio* iOutBuf; // borrowed from the pipeline; decoded into directly
+    TUint iOutBufBytes;
     TUint iFrameCounter;
 
     TUint iSampleRate;
@@ -187,6 +187,11 @@ CodecAdts::CodecAdts(IMimeTypeList& aMimeTypeList)
     : CodecAacBase("ADTS", aMimeTypeList)
 {
     LOG(kCodec, "CodecAdts::CodecAdts\n");
+    static const TByte kSync[][2] = { { 0xff, 0xf1 }, { 0xff, 0xf0 }, { 0xff, 0xf9 }, { 0xff, 0xf8 } }; // mpeg4/mpeg2, with/without crc
+    for (TUint i=0; i<sizeof(kSync)/sizeof(kSync[0]); i++) {
+        AddRecognitionSignature(Brn(kSync[i], sizeof(kSync[i])));
+    }
+    AddRecognitionExtension("aac");
 }
 
 CodecAdts::~CodecAdts()
@@ -42,6 +42,8 @@ CodecAifc::CodecAifc(IMimeTypeList& aMimeTypeList)
 {
     aMimeTypeList.Add("audio/aifc");
     aMimeTypeList.Add("audio/x-aifc");
+    AddRecognitionSignature(Brn("AIFC"), 8);
+    AddRecognitionExtension("aifc");
 }
 
 CodecAifc::~CodecAifc()
@@ -41,6 +41,9 @@ CodecAiff::CodecAiff(IMimeTypeList& aMimeTypeList)
 {
     aMimeTypeList.Add("audio/aiff");
     aMimeTypeList.Add("audio/x-aiff");
+    AddRecognitionSignature(Brn("AIFF"), 8);
+    AddRecognitionExtension("aif");
+    AddRecognitionExtension("aiff");
 }
 
 CodecAiff::~CodecAiff()
@@ -57,6 +57,8 @@ CodecAlac::CodecAlac(IMimeTypeList& aMimeTypeList)
 {
     LOG(kCodec, "CodecAlac::CodecAlac\n");
     aMimeTypeList.Add("audio/x-m4a");
+    AddRecognitionSignature(Brn("alac"));
+    AddRecognitionExtension("m4a");
 }
 
 CodecAlac::~CodecAlac()
@@ -99,14 +101,8 @@ void CodecAlac::StreamInitialise()
         mp4Reader.Read(info);
 
         // Read sample size table.
-        ReaderBinary readerBin(codecBufReader);
         iSampleSizeTable.Clear();
-        const TUint sampleCount = readerBin.ReadUintBe(4);
-        iSampleSizeTable.Init(sampleCount);
-        for (TUint i=0; i<sampleCount; i++) {
-            const TUint sampleSize = readerBin.ReadUintBe(4);
-            iSampleSizeTable.AddSampleSize(sampleSize);
-        }
+        iSampleSizeTable.Read(codecBufReader);
 
         // Read seek table.
         iSeekTable.Deinitialise();
@@ -8,6 +8,9 @@
 #include <OpenHome/Private/Debug.h>
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Media/Debug.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
+
+#include <string.h>
 
 extern "C" {
 int host_bigendian;     // used by alac.c
@@ -72,27 +75,20 @@ void CodecAlacBase::BigEndianData(TUint aToWrite, TUint aSamplesWritten)
     TByte* dst = const_cast<TByte*>(iOutBuf.Ptr()) + iOutBuf.Bytes();
     TByte* src = const_cast<TByte*>(iDecodedBuf.Ptr()) + (aSamplesWritten * iBytesPerSample);
 
-    TUint i=0;
-
-    for (i=0 ; i<aToWrite*iChannels; i++) {
-        switch (iBitDepth) {
-        case 8:
-            *dst++ = *src++;
-            break;
-        case 16:
-            *dst++ = src[1];
-            *dst++ = src[0];
-            src += 2;
-            break;
-        case 24:
-            *dst++ = src[2];
-            *dst++ = src[1];
-            *dst++ = src[0];
-            src += 3;
-            break;
-        default:
-            ASSERTS();
-        }
+    const TUint subsamples = aToWrite * iChannels;
+
+    switch (iBitDepth) {
+    case 8:
+        (void)memcpy(dst, src, subsamples);
+        break;
+    case 16:
+        PcmConverter::SwapEndian16(dst, src, subsamples);
+        break;
+    case 24:
+        PcmConverter::SwapEndian24(dst, src, subsamples);
+        break;
+    default:
+        ASSERTS();
     }
 }
 
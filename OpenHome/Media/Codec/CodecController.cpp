@@ -99,6 +99,16 @@ CodecBase::CodecBase(const TChar* aId, RecognitionComplexity aRecognitionCost)
 {
 }
 
+void CodecBase::AddRecognitionExtension(const TChar* aExtension)
+{
+    iRecognitionHints.AddExtension(aExtension);
+}
+
+void CodecBase::AddRecognitionSignature(const Brx& aSignature, TUint aOffset)
+{
+    iRecognitionHints.AddSignature(aSignature, aOffset);
+}
+
 void CodecBase::Construct(ICodecController& aController)
 {
     iController = &aController;
@@ -132,6 +142,7 @@ CodecController::CodecController(MsgFactory& aMsgFactory, IPipelineElementUpstre
     , iStreamLength(0)
     , iStreamPos(0)
     , iTrackId(UINT_MAX)
+    , iHeldOutput(nullptr)
 {
     iDecoderThread = new ThreadFunctor("CodecController", MakeFunctor(*this, &CodecController::CodecThread), aThreadPriority);
     iLoggerRewinder = new Logger(iRewinder, "Rewinder");
@@ -167,6 +178,10 @@ void CodecController::AddCodec(CodecBase* aCodec)
         }
     }
     iCodecs.insert(it, aCodec);
+    iRecognitionIndex.Clear();
+    for (TUint i=0; i<iCodecs.size(); i++) {
+        iRecognitionIndex.Add(i, iCodecs[i]->iRecognitionHints);
+    }
 #if 0
     Log::Print("Sorted codecs are: ");
     it = iCodecs.begin();
@@ -177,6 +192,11 @@ void CodecController::AddCodec(CodecBase* aCodec)
 #endif
 }
 
+void CodecController::SetHeldOutput(IHeldOutput& aHeldOutput)
+{
+    iHeldOutput = &aHeldOutput;
+}
+
 void CodecController::Start()
 {
     iDecoderThread->Start();
@@ -257,8 +277,11 @@ void CodecController::CodecThread()
             LOG(kMedia, "CodecThread: start recognition.  iTrackId=%u, iStreamId=%u\n", iTrackId, iStreamId);
             TBool streamEnded = false;
 
-            for (size_t i=0; i<iCodecs.size() && !iQuit && !iStreamStopped; i++) {
-                CodecBase* codec = iCodecs[i];
+            if (!BuildRecognitionOrder(streamEnded)) {
+                iRecognitionOrder.clear(); // flushing; don't attempt recognition
+            }
+            for (size_t i=0; i<iRecognitionOrder.size() && !iQuit && !iStreamStopped; i++) {
+                CodecBase* codec = iCodecs[iRecognitionOrder[i]];
                 TBool recognised = false;
                 try {
                     recognised = codec->Recognise(streamInfo);
@@ -298,15 +321,19 @@ void CodecController::CodecThread()
                     !streamEnded) {    // ...or reach the track end during recognition
                     Log::Print("Failed to recognise audio format (iStreamStopped=%u, iExpectedFlushId=%u), flushing stream...\n", iStreamStopped, iExpectedFlushId);
                 }
-                iLock.Wait();
-                if (iExpectedFlushId == MsgFlush::kIdInvalid) {
-                    (void)iStreamHandler->OkToPlay(iStreamId);
-                    iExpectedFlushId = iStreamHandler->TryStop(iStreamId);
-                    if (iExpectedFlushId != MsgFlush::kIdInvalid) {
-                        iConsumeExpectedFlush = true;
-                    }
+                if (iHeldOutput == nullptr) {
+                    iLock.Wait();
+                    StopUnrecognisedStream(iStreamHandler, iStreamId);
+                    iLock.Signal();
+                }
+                else {
+                    /* Our output may still be held behind the track before this one.  Claiming
+                       the stream now would tell the stream handler it is playing early. */
+                    iLock.Wait();
+                    iDeferredStops.push_back(std::pair<IStreamHandler*, TUint>(iStreamHandler, iStreamId));
+                    iLock.Signal();
+                    iHeldOutput->CallWhenReleased(MakeFunctor(*this, &CodecController::StopDeferredStream));
                 }
-                iLock.Signal();
                 continue;
             }
 
@@ -387,6 +414,67 @@ void CodecController::CodecThread()
     }
 }
 
+void CodecController::StopUnrecognisedStream(IStreamHandler* aStreamHandler, TUint aStreamId)
+{
+    // called with iLock held
+    if (iExpectedFlushId == MsgFlush::kIdInvalid) {
+        (void)aStreamHandler->OkToPlay(aStreamId);
+        iExpectedFlushId = aStreamHandler->TryStop(aStreamId);
+        if (iExpectedFlushId != MsgFlush::kIdInvalid) {
+            iConsumeExpectedFlush = true;
+        }
+    }
+}
+
+void CodecController::StopDeferredStream()
+{
+    AutoMutex _(iLock);
+    ASSERT(iDeferredStops.size() > 0);
+    const std::pair<IStreamHandler*, TUint> stop = iDeferredStops[0];
+    iDeferredStops.erase(iDeferredStops.begin());
+    StopUnrecognisedStream(stop.first, stop.second);
+}
+
+TBool CodecController::BuildRecognitionOrder(TBool& aStreamEnded)
+{
+    /* Try codecs whose hints match the stream first, then fall back to all others in order
+       of recognition cost.  Raw pcm streams don't have a uri or header worth inspecting. */
+    Bws<RecognitionHints::kMaxHeaderBytes> header;
+    if (!iRawPcm && iRecognitionIndex.HeaderBytes() > 0) {
+        try {
+            Read(header, iRecognitionIndex.HeaderBytes());
+        }
+        catch (CodecStreamStart&) {}
+        catch (CodecStreamEnded&) {}
+        catch (CodecStreamStopped&) {}
+        catch (CodecStreamFlush&) {
+            return false;
+        }
+        catch (CodecRecognitionOutOfData&) {}
+        iLock.Wait();
+        if (iStreamStarted || iStreamEnded) {
+            aStreamEnded = true;
+        }
+        iStreamStarted = iStreamEnded = false;
+        Rewind();
+        iLock.Signal();
+    }
+    if (iRawPcm) {
+        iRecognitionOrder.clear();
+    }
+    else {
+        iRecognitionIndex.Candidates(iTrackUri, header, iRecognitionOrder);
+    }
+    const TUint hinted = (TUint)iRecognitionOrder.size();
+    for (TUint i=0; i<iCodecs.size(); i++) {
+        if (std::find(iRecognitionOrder.begin(), iRecognitionOrder.begin() + hinted, i) == iRecognitionOrder.begin() + hinted) {
+            iRecognitionOrder.push_back(i);
+        }
+    }
+    LOG(kMedia, "CodecThread: %u of %u codecs hinted for stream\n", hinted, (TUint)iCodecs.size());
+    return true;
+}
+
 void CodecController::Rewind()
 {
     iRewinder.Rewind();
@@ -614,6 +702,20 @@ TUint64 CodecController::OutputAudioPcm(const Brx& aData, TUint aChannels, TUint
     return DoOutputAudioPcm(audio);
 }
 
+DecodedAudio* CodecController::GetAudioBuffer()
+{
+    return iMsgFactory.CreateDecodedAudioBuffer();
+}
+
+TUint64 CodecController::OutputAudioPcm(DecodedAudio* aAudio, TUint aBytes, TUint aChannels, TUint aSampleRate, TUint aBitDepth, TUint64 aTrackOffset)
+{
+    ASSERT(aChannels == iChannels);
+    ASSERT(aSampleRate == iSampleRate);
+    ASSERT(aBitDepth == iBitDepth);
+    MsgAudioPcm* audio = iMsgFactory.CreateMsgAudioPcm(aAudio, aBytes, aChannels, aSampleRate, aBitDepth, aTrackOffset);
+    return DoOutputAudioPcm(audio);
+}
+
 TUint64 CodecController::DoOutputAudioPcm(MsgAudio* aAudioMsg)
 {
     if (iExpectedFlushId != MsgFlush::kIdInvalid) {
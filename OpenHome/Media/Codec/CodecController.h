@@ -3,10 +3,13 @@
 #include <OpenHome/Types.h>
 #include <OpenHome/Exception.h>
 #include <OpenHome/Buffer.h>
+#include <OpenHome/Functor.h>
 #include <OpenHome/Private/Standard.h>
 #include <OpenHome/Media/Pipeline/Msg.h>
 #include <OpenHome/Media/Pipeline/Rewinder.h>
+#include <OpenHome/Media/Codec/RecognitionIndex.h>
 
+#include <utility>
 #include <vector>
 
 EXCEPTION(CodecStreamStart);
@@ -150,6 +153,32 @@ public:
      * @return     Number of jiffies of audio contained in aData.
      */
     virtual TUint64 OutputAudioPcm(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian, TUint64 aTrackOffset, TUint aRxTimestamp, TUint aNetworkTimestamp) = 0;
+    /**
+     * Borrow a block of pipeline memory that a codec can decode directly into.
+     *
+     * Avoids the copy made by the Brx overloads of OutputAudioPcm.  Up to
+     * DecodedAudio::kMaxBytes of big endian PCM may be written to aAudio->WritePtr().
+     * The buffer must later be either passed to OutputAudioPcm(DecodedAudio*, ...)
+     * or released by calling RemoveRef().
+     *
+     * @return     Writable audio buffer, owned by the caller.
+     */
+    virtual DecodedAudio* GetAudioBuffer() = 0;
+    /**
+     * Add a block of decoded (PCM) audio, previously written to a buffer returned by
+     * GetAudioBuffer(), to the pipeline.
+     *
+     * @param[in] aAudio         Buffer returned by GetAudioBuffer().  Ownership passes to the pipeline.
+     * @param[in] aBytes         Number of bytes of big endian PCM written to aAudio.
+     *                           Must contain an exact number of samples.
+     * @param[in] aChannels      Number of channels.  Must be in the range [2..8].
+     * @param[in] aSampleRate    Sample rate.
+     * @param[in] aBitDepth      Number of bits of audio for a single sample for a single channel.
+     * @param[in] aTrackOffset   Offset (in jiffies) into the stream at the start of aAudio.
+     *
+     * @return     Number of jiffies of audio contained in aAudio.
+     */
+    virtual TUint64 OutputAudioPcm(DecodedAudio* aAudio, TUint aBytes, TUint aChannels, TUint aSampleRate, TUint aBitDepth, TUint64 aTrackOffset) = 0;
     /**
      * Notify the pipeline of a change in bit rate.
      *
@@ -290,6 +319,23 @@ public:
     const TChar* Id() const;
 protected:
     CodecBase(const TChar* aId, RecognitionComplexity aRecognitionCost=kCostMedium);
+    /**
+     * Hint that streams whose uri ends with a given file extension are likely to be recognised.
+     *
+     * Hints only affect the order codecs are tried in.  Should be called from the constructor.
+     *
+     * @param[in] aExtension     Lower case extension, without leading '.'.  Must be a string literal.
+     */
+    void AddRecognitionExtension(const TChar* aExtension);
+    /**
+     * Hint that streams starting with a given sequence of bytes are likely to be recognised.
+     *
+     * Hints only affect the order codecs are tried in.  Should be called from the constructor.
+     *
+     * @param[in] aSignature     Bytes expected in the stream.
+     * @param[in] aOffset        Offset of aSignature from the start of the stream.
+     */
+    void AddRecognitionSignature(const Brx& aSignature, TUint aOffset = 0);
 private:
     void Construct(ICodecController& aController);
 protected:
@@ -297,6 +343,19 @@ protected:
 private:
     const TChar* iId;
     RecognitionComplexity iRecognitionCost;
+    RecognitionHints iRecognitionHints;
+};
+
+/*
+ * Optional.  Implemented by an element that may hold a CodecController's output for a while
+ * before passing it downstream (see DecodeAhead).
+ */
+class IHeldOutput
+{
+public:
+    virtual ~IHeldOutput() {}
+    // Run aCallback once every msg pushed so far has been passed on.  May run immediately or later, from another thread.
+    virtual void CallWhenReleased(Functor aCallback) = 0;
 };
 
 class CodecController : public ISeeker, private ICodecController, private IMsgProcessor, private IStreamHandler, private INonCopyable
@@ -306,9 +365,13 @@ public:
                     IUrlBlockWriter& aUrlBlockWriter, TUint aThreadPriority);
     virtual ~CodecController();
     void AddCodec(CodecBase* aCodec);
+    void SetHeldOutput(IHeldOutput& aHeldOutput); // must be called before Start()
     void Start();
 private:
     void CodecThread();
+    void StopUnrecognisedStream(IStreamHandler* aStreamHandler, TUint aStreamId);
+    void StopDeferredStream();
+    TBool BuildRecognitionOrder(TBool& aStreamEnded);
     void Rewind();
     Msg* PullMsg();
     void Queue(Msg* aMsg);
@@ -329,6 +392,8 @@ private: // ICodecController
     void OutputDelay(TUint aJiffies) override;
     TUint64 OutputAudioPcm(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian, TUint64 aTrackOffset) override;
     TUint64 OutputAudioPcm(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian, TUint64 aTrackOffset, TUint aRxTimestamp, TUint aNetworkTimestamp) override;
+    DecodedAudio* GetAudioBuffer() override;
+    TUint64 OutputAudioPcm(DecodedAudio* aAudio, TUint aBytes, TUint aChannels, TUint aSampleRate, TUint aBitDepth, TUint64 aTrackOffset) override;
     void OutputBitRate(TUint aBitRate) override;
     void OutputWait() override;
     void OutputHalt() override;
@@ -366,6 +431,8 @@ private:
     IUrlBlockWriter& iUrlBlockWriter;
     Mutex iLock;
     std::vector<CodecBase*> iCodecs;
+    RecognitionIndex iRecognitionIndex;
+    std::vector<TUint> iRecognitionOrder; // indices into iCodecs, in the order they'll be tried for the current stream
     ThreadFunctor* iDecoderThread;
     CodecBase* iActiveCodec;
     MsgQueue iQueue;
@@ -401,6 +468,8 @@ private:
     TUint64 iStreamLength;
     TUint64 iStreamPos;
     TUint iTrackId;
+    IHeldOutput* iHeldOutput;
+    std::vector<std::pair<IStreamHandler*, TUint>> iDeferredStops; // unrecognised streams waiting for iHeldOutput to release earlier msgs
 };
 
 class CodecBufferedReader : public IReader, private INonCopyable
@@ -6,6 +6,8 @@
 #include <OpenHome/Media/Pipeline/Msg.h>
 #include <OpenHome/Media/Debug.h>
 
+#include <algorithm>
+
 using namespace OpenHome;
 using namespace OpenHome::Media;
 using namespace OpenHome::Media::Codec;
@@ -22,6 +24,11 @@ ContainerBase::ContainerBase(const Brx& aId)
 {
 }
 
+void ContainerBase::AddRecognitionExtension(const TChar* aExtension)
+{
+    iRecognitionHints.AddExtension(aExtension);
+}
+
 const Brx& ContainerBase::Id() const
 {
     return iId;
@@ -397,6 +404,11 @@ void ContainerController::AddContainer(ContainerBase* aContainer)
      iContainers.pop_back();
      iContainers.push_back(aContainer);
      iContainers.push_back(containerNull);
+
+     iRecognitionIndex.Clear();
+     for (TUint i=0; i<iContainers.size(); i++) {
+         iRecognitionIndex.Add(i, iContainers[i]->iRecognitionHints);
+     }
 }
 
 ContainerController::~ContainerController()
@@ -421,12 +433,20 @@ Msg* ContainerController::RecogniseContainer()
         iActiveContainer = nullptr;
         while (iState != eRecognitionComplete) {
             if (iState == eRecognitionStart) {
+                // Try containers hinted by the uri first.  ContainerNull has no hints so remains last.
+                iRecognitionIndex.Candidates(iUrl, Brx::Empty(), iRecogOrder);
+                const TUint hinted = (TUint)iRecogOrder.size();
+                for (TUint i=0; i<iContainers.size(); i++) {
+                    if (std::find(iRecogOrder.begin(), iRecogOrder.begin() + hinted, i) == iRecogOrder.begin() + hinted) {
+                        iRecogOrder.push_back(i);
+                    }
+                }
                 iRecogIdx = 0;
                 iState = eRecognitionSelectContainer;
             }
             else if (iState == eRecognitionSelectContainer) {
-                ASSERT(iRecogIdx < iContainers.size()); // ContainerNull should always recognise.
-                auto& container = iContainers[iRecogIdx];
+                ASSERT(iRecogIdx < iRecogOrder.size()); // ContainerNull should always recognise.
+                auto& container = iContainers[iRecogOrder[iRecogIdx]];
                 iStreamEnded = false;
                 iRewinder.Rewind();
                 iCache.Reset();
@@ -435,7 +455,7 @@ Msg* ContainerController::RecogniseContainer()
             }
             else if (iState == eRecognitionContainer) {
                 if (!iStreamEnded) {
-                    auto& container = iContainers[iRecogIdx];
+                    auto& container = iContainers[iRecogOrder[iRecogIdx]];
                     try {
                         Msg* msg = container->Recognise();
                         if (msg != nullptr) {
@@ -6,6 +6,7 @@
 #include <OpenHome/Private/Uri.h>
 #include <OpenHome/Media/Pipeline/Msg.h>
 #include <OpenHome/Media/Pipeline/Rewinder.h>
+#include <OpenHome/Media/Codec/RecognitionIndex.h>
 
 #include <vector>
 
@@ -66,6 +67,7 @@ private:
     static const TUint kMaxNameBytes = 4;
 protected:
     ContainerBase(const Brx& aId);
+    void AddRecognitionExtension(const TChar* aExtension); // hint that streams whose uri has this extension are likely to be recognised
 public:
     virtual Msg* Recognise() = 0;   // Returns nullptr upon recognition complete.
     virtual TBool Recognised() const = 0; // Can only be called after Recognise() returns nullptr.
@@ -83,6 +85,7 @@ protected:
     IContainerUrlBlockWriter* iUrlBlockWriter;
 private:
     const Bws<kMaxNameBytes> iId;
+    RecognitionHints iRecognitionHints;
 };
 
 class MsgAudioEncodedCache : public IMsgAudioEncodedCache, public IMsgProcessor, private INonCopyable
@@ -196,6 +199,8 @@ private:
     Rewinder iRewinder;
     MsgAudioEncodedCache iCache;
     std::vector<ContainerBase*> iContainers;
+    RecognitionIndex iRecognitionIndex;
+    std::vector<TUint> iRecogOrder; // indices into iContainers, in the order they'll be tried for the current stream
     ContainerBase* iActiveContainer;
     ContainerNull* iContainerNull;
     IStreamHandler* iStreamHandler;
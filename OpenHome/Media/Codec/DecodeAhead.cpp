@@ -0,0 +1,454 @@
+#include <OpenHome/Media/Codec/DecodeAhead.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Private/Standard.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Media/Codec/CodecController.h>
+#include <OpenHome/Media/Debug.h>
+
+#include <algorithm>
+
+using namespace OpenHome;
+using namespace OpenHome::Media;
+using namespace OpenHome::Media::Codec;
+
+
+// DecodeAheadSplitter
+
+const TUint DecodeAheadSplitter::kSupportedMsgTypes =   eMode
+                                                      | eTrack
+                                                      | eDrain
+                                                      | eDelay
+                                                      | eEncodedStream
+                                                      | eAudioEncoded
+                                                      | eMetatext
+                                                      | eStreamInterrupted
+                                                      | eHalt
+                                                      | eFlush
+                                                      | eWait
+                                                      | eQuit;
+
+DecodeAheadSplitter::DecodeAheadSplitter(MsgFactory& aMsgFactory, IPipelineElementUpstream& aUpstreamElement, TUint aMaxReadAheadBytes)
+    : PipelineElement(kSupportedMsgTypes)
+    , iMsgFactory(aMsgFactory)
+    , iUpstreamElement(aUpstreamElement)
+    , iMaxReadAheadBytes(aMaxReadAheadBytes)
+    , iMaxReadAheadMsgs(MaxReadAheadMsgs(aMaxReadAheadBytes))
+    , iLock("DAHS")
+    , iEnabled(true)
+    , iRouteTo(0)
+    , iPulling(false)
+    , iUpstreamQuit(false)
+    , iSegmentHasTrack(false)
+    , iBoundary(false)
+    , iQuit(false)
+{
+    for (TUint i=0; i<kNumOutputs; i++) {
+        iOutputs[i] = new Output(*this, i);
+        iSems[i] = new Semaphore("DAHS", 0);
+    }
+}
+
+DecodeAheadSplitter::~DecodeAheadSplitter()
+{
+    for (TUint i=0; i<kNumOutputs; i++) {
+        delete iOutputs[i];
+        delete iSems[i];
+    }
+}
+
+TUint DecodeAheadSplitter::MaxReadAheadMsgs(TUint aMaxReadAheadBytes)
+{ // static
+    /* Not all MsgAudioEncoded will be full.  Limit the number held as well as the bytes so
+       that reading ahead can't exhaust the allocator. */
+    return (aMaxReadAheadBytes + EncodedAudio::kMaxBytes - 1) / EncodedAudio::kMaxBytes;
+}
+
+IPipelineElementUpstream& DecodeAheadSplitter::Output(TUint aIndex)
+{
+    ASSERT(aIndex < kNumOutputs);
+    return *iOutputs[aIndex];
+}
+
+void DecodeAheadSplitter::SetEnabled(TBool aEnabled)
+{
+    AutoMutex _(iLock);
+    iEnabled = aEnabled;
+}
+
+TBool DecodeAheadSplitter::IsSegmentEnd(TUint aIndex, const Msg* aMsg)
+{
+    AutoMutex _(iLock);
+    auto& markers = iMarkers[aIndex];
+    if (markers.size() == 0 || markers[0] != aMsg) {
+        return false;
+    }
+    markers.erase(markers.begin());
+    return true;
+}
+
+Msg* DecodeAheadSplitter::Pull(TUint aIndex)
+{
+    iLock.Wait();
+    for (;;) {
+        SegmentQueue& queue = iQueues[aIndex];
+        if (!queue.IsEmpty()) {
+            Msg* msg = queue.Dequeue();
+            if (aIndex == iRouteTo) {
+                SignalOutputs(); // may have freed up space for read-ahead
+            }
+            iLock.Signal();
+            return msg;
+        }
+        /* Pull from upstream if we need the next msg ourselves or (if we're idle) to read
+           ahead on behalf of the other output, looking for the start of the next segment. */
+        const SegmentQueue& ahead = iQueues[iRouteTo];
+        const TBool readAhead = (iEnabled && ahead.EncodedBytes() < iMaxReadAheadBytes
+                                          && ahead.EncodedAudioCount() < iMaxReadAheadMsgs);
+        if (!iPulling && !iUpstreamQuit && (aIndex == iRouteTo || readAhead)) {
+            iPulling = true;
+            iLock.Signal();
+            Msg* msg = iUpstreamElement.Pull();
+            iLock.Wait();
+            iPulling = false;
+            Route(msg);
+            SignalOutputs();
+            continue;
+        }
+        iSems[aIndex]->Clear();
+        iLock.Signal();
+        iSems[aIndex]->Wait();
+        iLock.Wait();
+    }
+}
+
+void DecodeAheadSplitter::Route(Msg* aMsg)
+{
+    iBoundary = iQuit = false;
+    aMsg = aMsg->Process(*this);
+    if (iBoundary) {
+        const TUint prev = iRouteTo;
+        iRouteTo = (iRouteTo + 1) % kNumOutputs;
+        MsgHalt* marker = iMsgFactory.CreateMsgHalt();
+        iMarkers[prev].push_back(marker);
+        iQueues[prev].Enqueue(marker);
+        LOG(kCodec, "DecodeAheadSplitter: start of segment for output %u\n", iRouteTo);
+    }
+    iQueues[iRouteTo].Enqueue(aMsg);
+    if (iQuit) {
+        iUpstreamQuit = true;
+        for (TUint i=0; i<kNumOutputs; i++) {
+            if (i != iRouteTo) {
+                iQueues[i].Enqueue(iMsgFactory.CreateMsgQuit());
+            }
+        }
+    }
+}
+
+void DecodeAheadSplitter::SignalOutputs()
+{
+    for (TUint i=0; i<kNumOutputs; i++) {
+        iSems[i]->Signal();
+    }
+}
+
+Msg* DecodeAheadSplitter::ProcessMsg(MsgTrack* aMsg)
+{
+    if (aMsg->StartOfStream()) {
+        iBoundary = (iEnabled && iSegmentHasTrack);
+        iSegmentHasTrack = true;
+    }
+    return aMsg;
+}
+
+Msg* DecodeAheadSplitter::ProcessMsg(MsgQuit* aMsg)
+{
+    iQuit = true;
+    return aMsg;
+}
+
+
+// DecodeAheadSplitter::Output
+
+DecodeAheadSplitter::Output::Output(DecodeAheadSplitter& aSplitter, TUint aIndex)
+    : iSplitter(aSplitter)
+    , iIndex(aIndex)
+{
+}
+
+Msg* DecodeAheadSplitter::Output::Pull()
+{
+    return iSplitter.Pull(iIndex);
+}
+
+
+// DecodeAheadSplitter::SegmentQueue
+
+void DecodeAheadSplitter::SegmentQueue::Enqueue(Msg* aMsg)
+{
+    DoEnqueue(aMsg);
+}
+
+Msg* DecodeAheadSplitter::SegmentQueue::Dequeue()
+{
+    return DoDequeue();
+}
+
+TBool DecodeAheadSplitter::SegmentQueue::IsEmpty() const
+{
+    return MsgReservoir::IsEmpty();
+}
+
+TUint DecodeAheadSplitter::SegmentQueue::EncodedBytes() const
+{
+    return MsgReservoir::EncodedBytes();
+}
+
+TUint DecodeAheadSplitter::SegmentQueue::EncodedAudioCount() const
+{
+    return MsgReservoir::EncodedAudioCount();
+}
+
+
+// DecodeAheadSplicer
+
+DecodeAheadSplicer::DecodeAheadSplicer(IPipelineElementDownstream& aDownstreamElement, IDecodeAheadSegments& aSegments, TUint aMaxJiffies, TUint aMaxMsgs)
+    : iDownstreamElement(aDownstreamElement)
+    , iSegments(aSegments)
+    , iMaxJiffies(aMaxJiffies)
+    , iMaxMsgs(aMaxMsgs)
+    , iLock("DAHJ")
+    , iCurrent(0)
+    , iDraining(false)
+{
+    ASSERT(iMaxMsgs > 0);
+    for (TUint i=0; i<kNumInputs; i++) {
+        iInputs[i] = new Input(*this, i);
+        iSems[i] = new Semaphore("DAHJ", 0);
+    }
+}
+
+DecodeAheadSplicer::~DecodeAheadSplicer()
+{
+    for (TUint i=0; i<kNumInputs; i++) {
+        delete iInputs[i];
+        delete iSems[i];
+    }
+}
+
+IPipelineElementDownstream& DecodeAheadSplicer::Input(TUint aIndex)
+{
+    ASSERT(aIndex < kNumInputs);
+    return *iInputs[aIndex];
+}
+
+IHeldOutput& DecodeAheadSplicer::HeldOutput(TUint aIndex)
+{
+    ASSERT(aIndex < kNumInputs);
+    return *iInputs[aIndex];
+}
+
+void DecodeAheadSplicer::Push(TUint aIndex, Msg* aMsg)
+{
+    iLock.Wait();
+    if (aIndex == iCurrent && !iDraining) {
+        if (iSegments.IsSegmentEnd(aIndex, aMsg)) {
+            aMsg->RemoveRef();
+            iCurrent = (iCurrent + 1) % kNumInputs;
+            iDraining = true;
+            iLock.Signal();
+            Drain();
+        }
+        else {
+            iLock.Signal();
+            iDownstreamElement.Push(aMsg);
+        }
+        return;
+    }
+
+    // Not our turn yet (or held msgs are still being drained).  Hold aMsg, blocking
+    // the caller's decoder once it is far enough ahead.
+    iHeld[aIndex].Enqueue(aMsg);
+    while (IsFull(aIndex)) {
+        iSems[aIndex]->Clear();
+        iLock.Signal();
+        iSems[aIndex]->Wait();
+        iLock.Wait();
+    }
+    iLock.Signal();
+}
+
+void DecodeAheadSplicer::CallWhenReleased(TUint aIndex, Functor aCallback)
+{
+    iLock.Wait();
+    if (aIndex == iCurrent && !iDraining) {
+        iLock.Signal();
+        aCallback();
+        return;
+    }
+    iReleases[aIndex].push_back(Release(iHeld[aIndex].Count(), aCallback));
+    iLock.Signal();
+}
+
+void DecodeAheadSplicer::Drain()
+{
+    /* Only one thread drains at a time.  Other inputs hold msgs until we're done so that
+       the order msgs are pushed downstream in is preserved. */
+    for (;;) {
+        iLock.Wait();
+        auto& releases = iReleases[iCurrent];
+        if (releases.size() > 0 && releases[0].iMsgsAhead == 0) {
+            Functor callback = releases[0].iCallback;
+            releases.erase(releases.begin());
+            iLock.Signal();
+            callback();
+            continue;
+        }
+        HeldQueue& held = iHeld[iCurrent];
+        if (held.IsEmpty()) {
+            iDraining = false;
+            iLock.Signal();
+            return;
+        }
+        Msg* msg = held.Dequeue();
+        for (auto it=releases.begin(); it!=releases.end(); ++it) {
+            it->iMsgsAhead--;
+        }
+        iSems[iCurrent]->Signal();
+        if (iSegments.IsSegmentEnd(iCurrent, msg)) {
+            msg->RemoveRef();
+            iCurrent = (iCurrent + 1) % kNumInputs;
+            iLock.Signal();
+            continue;
+        }
+        iLock.Signal();
+        iDownstreamElement.Push(msg);
+    }
+}
+
+TBool DecodeAheadSplicer::IsFull(TUint aIndex) const
+{
+    const HeldQueue& held = iHeld[aIndex];
+    return (held.Jiffies() >= iMaxJiffies || held.Count() >= iMaxMsgs);
+}
+
+
+// DecodeAheadSplicer::Input
+
+DecodeAheadSplicer::Input::Input(DecodeAheadSplicer& aSplicer, TUint aIndex)
+    : iSplicer(aSplicer)
+    , iIndex(aIndex)
+{
+}
+
+void DecodeAheadSplicer::Input::Push(Msg* aMsg)
+{
+    iSplicer.Push(iIndex, aMsg);
+}
+
+void DecodeAheadSplicer::Input::CallWhenReleased(Functor aCallback)
+{
+    iSplicer.CallWhenReleased(iIndex, aCallback);
+}
+
+
+// DecodeAheadSplicer::Release
+
+DecodeAheadSplicer::Release::Release(TUint aMsgsAhead, Functor aCallback)
+    : iMsgsAhead(aMsgsAhead)
+    , iCallback(aCallback)
+{
+}
+
+
+// DecodeAheadSplicer::HeldQueue
+
+DecodeAheadSplicer::HeldQueue::HeldQueue()
+    : iCount(0)
+{
+}
+
+void DecodeAheadSplicer::HeldQueue::Enqueue(Msg* aMsg)
+{
+    DoEnqueue(aMsg);
+    iCount++;
+}
+
+Msg* DecodeAheadSplicer::HeldQueue::Dequeue()
+{
+    Msg* msg = DoDequeue();
+    iCount--;
+    return msg;
+}
+
+TBool DecodeAheadSplicer::HeldQueue::IsEmpty() const
+{
+    return MsgReservoir::IsEmpty();
+}
+
+TUint DecodeAheadSplicer::HeldQueue::Jiffies() const
+{
+    return MsgReservoir::Jiffies();
+}
+
+TUint DecodeAheadSplicer::HeldQueue::Count() const
+{
+    return iCount;
+}
+
+
+// DecodeAhead
+
+DecodeAhead::DecodeAhead(MsgFactory& aMsgFactory, IPipelineElementUpstream& aUpstreamElement, IPipelineElementDownstream& aDownstreamElement,
+                         IUrlBlockWriter& aUrlBlockWriter, TUint aThreadPriority,
+                         TUint aMaxReadAheadBytes, TUint aMaxDecodeAheadJiffies, TUint aMaxDecodeAheadMsgs)
+    : iSplitter(aMsgFactory, aUpstreamElement, aMaxReadAheadBytes)
+    , iSplicer(aDownstreamElement, iSplitter, aMaxDecodeAheadJiffies, aMaxDecodeAheadMsgs)
+    , iEnabled(true)
+{
+    for (TUint i=0; i<DecodeAheadSplitter::kNumOutputs; i++) {
+        iControllers[i] = new CodecController(aMsgFactory, iSplitter.Output(i), iSplicer.Input(i), aUrlBlockWriter, aThreadPriority);
+        iControllers[i]->SetHeldOutput(iSplicer.HeldOutput(i));
+    }
+}
+
+DecodeAhead::~DecodeAhead()
+{
+    for (TUint i=0; i<DecodeAheadSplitter::kNumOutputs; i++) {
+        delete iControllers[i];
+    }
+}
+
+void DecodeAhead::AddCodec(CodecBase* aCodec, CodecBase* aCodecDecodeAhead)
+{
+    iControllers[0]->AddCodec(aCodec);
+    if (aCodecDecodeAhead == nullptr) {
+        iEnabled = false;
+    }
+    else {
+        iControllers[1]->AddCodec(aCodecDecodeAhead);
+    }
+}
+
+void DecodeAhead::Start()
+{
+    if (!iEnabled) {
+        Log::Print("WARNING: decode-ahead disabled - not all codecs have a second instance\n");
+    }
+    iSplitter.SetEnabled(iEnabled);
+    for (TUint i=0; i<DecodeAheadSplitter::kNumOutputs; i++) {
+        iControllers[i]->Start();
+    }
+}
+
+void DecodeAhead::StartSeek(TUint aStreamId, TUint aSecondsAbsolute, ISeekObserver& aObserver, TUint& aHandle)
+{
+    // only the controller currently decoding aStreamId will accept the seek
+    for (TUint i=0; i<DecodeAheadSplitter::kNumOutputs; i++) {
+        ISeeker& seeker = *iControllers[i];
+        seeker.StartSeek(aStreamId, aSecondsAbsolute, aObserver, aHandle);
+        if (aHandle != ISeeker::kHandleError) {
+            break;
+        }
+    }
+}
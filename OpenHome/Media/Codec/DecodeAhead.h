@@ -0,0 +1,185 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Private/Standard.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Functor.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Media/Codec/CodecController.h>
+
+#include <vector>
+
+namespace OpenHome {
+namespace Media {
+namespace Codec {
+
+/*
+Optional decode-ahead for gapless track transitions.
+
+Runs two CodecControllers, each with its own set of codecs.  Encoded msgs are cut into segments,
+each starting at a MsgTrack which starts a new stream, and segments are handed to the controllers
+alternately.  While one controller finishes the current track, the other recognises and starts
+decoding the next.  Its output is held (up to a configurable duration) until the first controller
+has output everything for its track, then spliced in.  Downstream elements therefore see exactly
+the sequence of msgs a single controller would have produced.
+
+An idle controller reads ahead of the active one (up to a configurable number of encoded bytes) so
+that the next track boundary is found well before the active controller reaches it.
+*/
+
+class IDecodeAheadSegments
+{
+public:
+    virtual ~IDecodeAheadSegments() {}
+    // returns true (and claims aMsg) if aMsg marks the end of the segment most recently passed to aIndex
+    virtual TBool IsSegmentEnd(TUint aIndex, const Msg* aMsg) = 0;
+};
+
+class DecodeAheadSplitter : private PipelineElement, public IDecodeAheadSegments, private INonCopyable
+{
+    friend class SuiteDecodeAhead;
+    static const TUint kSupportedMsgTypes;
+public:
+    static const TUint kNumOutputs = 2;
+public:
+    DecodeAheadSplitter(MsgFactory& aMsgFactory, IPipelineElementUpstream& aUpstreamElement, TUint aMaxReadAheadBytes);
+    ~DecodeAheadSplitter();
+    static TUint MaxReadAheadMsgs(TUint aMaxReadAheadBytes); // number of MsgAudioEncoded that may be held while reading ahead
+    IPipelineElementUpstream& Output(TUint aIndex);
+    void SetEnabled(TBool aEnabled); // must be called before the first Pull().  If disabled, all msgs go to output 0
+public: // from IDecodeAheadSegments
+    TBool IsSegmentEnd(TUint aIndex, const Msg* aMsg) override;
+private:
+    Msg* Pull(TUint aIndex);
+    void Route(Msg* aMsg);
+    void SignalOutputs();
+private: // from IMsgProcessor
+    Msg* ProcessMsg(MsgTrack* aMsg) override;
+    Msg* ProcessMsg(MsgQuit* aMsg) override;
+private:
+    class Output : public IPipelineElementUpstream, private INonCopyable
+    {
+    public:
+        Output(DecodeAheadSplitter& aSplitter, TUint aIndex);
+    private: // from IPipelineElementUpstream
+        Msg* Pull() override;
+    private:
+        DecodeAheadSplitter& iSplitter;
+        const TUint iIndex;
+    };
+    class SegmentQueue : public MsgReservoir
+    {
+    public:
+        void Enqueue(Msg* aMsg);
+        Msg* Dequeue();
+        TBool IsEmpty() const;
+        TUint EncodedBytes() const;
+        TUint EncodedAudioCount() const;
+    };
+private:
+    MsgFactory& iMsgFactory;
+    IPipelineElementUpstream& iUpstreamElement;
+    const TUint iMaxReadAheadBytes;
+    const TUint iMaxReadAheadMsgs;
+    Mutex iLock;
+    Output* iOutputs[kNumOutputs];
+    SegmentQueue iQueues[kNumOutputs];
+    Semaphore* iSems[kNumOutputs];
+    std::vector<const Msg*> iMarkers[kNumOutputs]; // segment end markers, oldest first
+    TBool iEnabled;
+    TUint iRouteTo;       // output that msgs currently being pulled from upstream belong to
+    TBool iPulling;       // some thread is blocked in iUpstreamElement.Pull()
+    TBool iUpstreamQuit;
+    TBool iSegmentHasTrack;
+    TBool iBoundary;      // set by ProcessMsg while routing
+    TBool iQuit;          // ditto
+};
+
+class DecodeAheadSplicer : private INonCopyable
+{
+    friend class SuiteDecodeAhead;
+public:
+    static const TUint kNumInputs = DecodeAheadSplitter::kNumOutputs;
+public:
+    DecodeAheadSplicer(IPipelineElementDownstream& aDownstreamElement, IDecodeAheadSegments& aSegments, TUint aMaxJiffies, TUint aMaxMsgs);
+    ~DecodeAheadSplicer();
+    IPipelineElementDownstream& Input(TUint aIndex);
+    IHeldOutput& HeldOutput(TUint aIndex);
+private:
+    void Push(TUint aIndex, Msg* aMsg);
+    void CallWhenReleased(TUint aIndex, Functor aCallback);
+    void Drain();
+    TBool IsFull(TUint aIndex) const;
+private:
+    class Input : public IPipelineElementDownstream, public IHeldOutput, private INonCopyable
+    {
+    public:
+        Input(DecodeAheadSplicer& aSplicer, TUint aIndex);
+    private: // from IPipelineElementDownstream
+        void Push(Msg* aMsg) override;
+    private: // from IHeldOutput
+        void CallWhenReleased(Functor aCallback) override;
+    private:
+        DecodeAheadSplicer& iSplicer;
+        const TUint iIndex;
+    };
+    class Release
+    {
+    public:
+        Release(TUint aMsgsAhead, Functor aCallback);
+    public:
+        TUint iMsgsAhead; // held msgs that must be passed downstream before iCallback runs
+        Functor iCallback;
+    };
+    class HeldQueue : public MsgReservoir
+    {
+    public:
+        HeldQueue();
+        void Enqueue(Msg* aMsg);
+        Msg* Dequeue();
+        TBool IsEmpty() const;
+        TUint Jiffies() const;
+        TUint Count() const;
+    private:
+        TUint iCount;
+    };
+private:
+    IPipelineElementDownstream& iDownstreamElement;
+    IDecodeAheadSegments& iSegments;
+    const TUint iMaxJiffies;
+    const TUint iMaxMsgs;
+    Mutex iLock;
+    Input* iInputs[kNumInputs];
+    HeldQueue iHeld[kNumInputs];
+    std::vector<Release> iReleases[kNumInputs]; // oldest first
+    Semaphore* iSems[kNumInputs];
+    TUint iCurrent;   // input whose msgs are passed straight downstream
+    TBool iDraining;  // a thread is pushing held msgs downstream
+};
+
+class DecodeAhead : public ISeeker, private INonCopyable
+{
+public:
+    DecodeAhead(MsgFactory& aMsgFactory, IPipelineElementUpstream& aUpstreamElement, IPipelineElementDownstream& aDownstreamElement,
+                IUrlBlockWriter& aUrlBlockWriter, TUint aThreadPriority,
+                TUint aMaxReadAheadBytes, TUint aMaxDecodeAheadJiffies, TUint aMaxDecodeAheadMsgs);
+    ~DecodeAhead();
+    /*
+     * aCodec and aCodecDecodeAhead must be separate instances of the same codec.
+     * If aCodecDecodeAhead is nullptr, decode-ahead is disabled (the second controller
+     * wouldn't be able to decode every format the first can).
+     */
+    void AddCodec(CodecBase* aCodec, CodecBase* aCodecDecodeAhead);
+    void Start();
+private: // from ISeeker
+    void StartSeek(TUint aStreamId, TUint aSecondsAbsolute, ISeekObserver& aObserver, TUint& aHandle) override;
+private:
+    DecodeAheadSplitter iSplitter;
+    DecodeAheadSplicer iSplicer;
+    CodecController* iControllers[DecodeAheadSplitter::kNumOutputs];
+    TBool iEnabled;
+};
+
+} // namespace Codec
+} // namespace Media
+} // namespace OpenHome
@@ -1,6 +1,7 @@
 #include <OpenHome/Media/Codec/CodecController.h>
 #include <OpenHome/Media/Codec/CodecFactory.h>
 #include <OpenHome/Media/Codec/Container.h>
+#include <OpenHome/Media/Codec/SeekIndex.h>
 #include <FLAC/format.h>
 #include <FLAC/stream_decoder.h>
 #include <OpenHome/Types.h>
@@ -8,8 +9,10 @@
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Private/Debug.h>
 #include <OpenHome/Media/MimeTypeList.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
 
 #include <string.h>
+#include <vector>
 
 namespace OpenHome {
 namespace Media {
@@ -45,7 +48,10 @@ public:
     void CallbackError(const FLAC__StreamDecoder* aDecoder,
                        FLAC__StreamDecoderErrorStatus aStatus);
 private:
-    TByte iBuf[DecodedAudio::kMaxBytes];
+    void IndexSeekPoints();
+private:
+    static const TUint kMaxSeekDiscardSeconds = 10; // decode and discard up to this much audio rather than have libFLAC search for a frame
+private:
     FLAC__StreamDecoder* iDecoder;
     Brn iName;
     TUint64 iSampleStart;
@@ -55,6 +61,12 @@ private:
     TBool iStreamMsgDue;
     TBool iOgg;
     TUint iStreamId;
+    SeekIndex iSeekIndex;
+    std::vector<FLAC__StreamMetadata_SeekPoint> iSeekPoints; // from SEEKTABLE; offsets are relative to the first frame
+    TBool iIndexing;        // native FLAC with a known sample rate; frame offsets are added to iSeekIndex
+    TBool iMetadataComplete;
+    TBool iSeekDiscard;     // frames from an iSeekIndex seek are decoded but not output until iSeekDiscardSample
+    TUint64 iSeekDiscardSample;
 };
 
 } // namespace Codec
@@ -134,12 +146,20 @@ CodecFlac::CodecFlac(IMimeTypeList& aMimeTypeList)
     : CodecBase("FLAC")
     , iName("FLAC")
     , iStreamMsgDue(true)
+    , iIndexing(false)
+    , iMetadataComplete(false)
+    , iSeekDiscard(false)
+    , iSeekDiscardSample(0)
 {
     iDecoder = FLAC__stream_decoder_new();
     ASSERT(iDecoder != nullptr);
-    // By default, only the STREAMINFO metadata block is returned, but let's just explicitly tell the decoder that's all we want.
+    // By default, only the STREAMINFO metadata block is returned.  We also want any SEEKTABLE to seed iSeekIndex.
     ASSERT(FLAC__stream_decoder_set_metadata_respond(iDecoder, FLAC__METADATA_TYPE_STREAMINFO));
+    ASSERT(FLAC__stream_decoder_set_metadata_respond(iDecoder, FLAC__METADATA_TYPE_SEEKTABLE));
     aMimeTypeList.Add("audio/x-flac");
+    AddRecognitionSignature(Brn("fLaC"));
+    AddRecognitionSignature(Brn("fLaC"), 37); // ogg flac
+    AddRecognitionExtension("flac");
 }
 
 CodecFlac::~CodecFlac()
@@ -179,6 +199,10 @@ void CodecFlac::StreamInitialise()
     iTrackOffset = 0;
     iSampleRate = 0;
     iTrackLengthJiffies = 0;
+    iSeekPoints.clear();
+    iIndexing = false;
+    iMetadataComplete = false;
+    iSeekDiscard = false;
 
     FLAC__StreamDecoderState state;
     state = FLAC__stream_decoder_get_state(iDecoder);
@@ -230,6 +254,11 @@ void CodecFlac::Process()
 {
     FLAC__stream_decoder_process_single(iDecoder);
     FLAC__StreamDecoderState state = FLAC__stream_decoder_get_state(iDecoder);
+    if (!iMetadataComplete && state == FLAC__STREAM_DECODER_SEARCH_FOR_FRAME_SYNC) {
+        // last metadata block has just been read; the decode position is now the start of the first frame
+        iMetadataComplete = true;
+        IndexSeekPoints();
+    }
     switch(state) {
         case FLAC__STREAM_DECODER_SEARCH_FOR_METADATA:
         case FLAC__STREAM_DECODER_READ_METADATA:
@@ -270,6 +299,21 @@ TBool CodecFlac::TrySeek(TUint aStreamId, TUint64 aSample)
 {
     iStreamId = aStreamId;
     iSampleStart = aSample;
+    iSeekDiscard = false;
+    TUint64 frameSample, frameOffset;
+    if (iIndexing && iSeekIndex.TryFind(aSample, (TUint64)iSampleRate * kMaxSeekDiscardSeconds, frameSample, frameOffset)) {
+        // We know where a frame shortly before aSample starts.  Move straight there then discard
+        // samples up to aSample rather than have libFLAC search the stream for the target frame.
+        if (!iController->TrySeekTo(aStreamId, frameOffset)) {
+            return false;
+        }
+        (void)FLAC__stream_decoder_flush(iDecoder);
+        iSeekDiscard = true;
+        iSeekDiscardSample = aSample;
+        iTrackOffset = iSampleStart * Jiffies::JiffiesPerSample(iSampleRate);
+        iStreamMsgDue = true;
+        return true;
+    }
     FLAC__bool ret = FLAC__stream_decoder_seek_absolute(iDecoder, aSample);
     if (ret == 0) {
         // Seeking failed.
@@ -335,13 +379,24 @@ FLAC__StreamDecoderLengthStatus CodecFlac::CallbackLength(const FLAC__StreamDeco
     return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
 }
 
+void CodecFlac::IndexSeekPoints()
+{
+    TUint64 firstFrame;
+    if (iIndexing && FLAC__stream_decoder_get_decode_position(iDecoder, &firstFrame)) {
+        for (auto it=iSeekPoints.begin(); it!=iSeekPoints.end(); ++it) {
+            iSeekIndex.Add(it->sample_number, firstFrame + it->stream_offset);
+        }
+    }
+    iSeekPoints.clear();
+}
+
 TBool CodecFlac::CallbackEof(const FLAC__StreamDecoder* /*aDecoder*/)
 {
     //Log::Print("FIXME - CodecFlac::CallbackEof unimplemented\n");
     return false;
 }
 
-FLAC__StreamDecoderWriteStatus CodecFlac::CallbackWrite(const FLAC__StreamDecoder* /*aDecoder*/,
+FLAC__StreamDecoderWriteStatus CodecFlac::CallbackWrite(const FLAC__StreamDecoder* aDecoder,
                                                         const FLAC__Frame* aFrame, 
                                                         const TInt32* const aBuffer[])
 {
@@ -349,6 +404,26 @@ FLAC__StreamDecoderWriteStatus CodecFlac::CallbackWrite(const FLAC__StreamDecode
     TUint samplesToWrite = aFrame->header.blocksize;
     const TUint bitDepth = aFrame->header.bits_per_sample;
     const TUint sampleRate = aFrame->header.sample_rate;
+    TUint startI = 0;
+
+    if (aFrame->header.number_type == FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER) {
+        const TUint64 frameSample = aFrame->header.number.sample_number;
+        const TUint64 nextFrameSample = frameSample + aFrame->header.blocksize;
+        TUint64 nextFrameOffset;
+        if (iIndexing && FLAC__stream_decoder_get_decode_position(aDecoder, &nextFrameOffset)) {
+            iSeekIndex.Add(nextFrameSample, nextFrameOffset);
+        }
+        if (iSeekDiscard) {
+            if (nextFrameSample <= iSeekDiscardSample) {
+                return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+            }
+            if (frameSample < iSeekDiscardSample) {
+                startI = (TUint)(iSeekDiscardSample - frameSample);
+                samplesToWrite -= startI;
+            }
+        }
+    }
+    iSeekDiscard = false;
 
     if (iStreamMsgDue) {
         /* If we get a Audio Frame prior to a metadata frame (and therefore
@@ -359,39 +434,18 @@ FLAC__StreamDecoderWriteStatus CodecFlac::CallbackWrite(const FLAC__StreamDecode
         iStreamMsgDue = false;
     }
     
-    const TUint maxSamples = sizeof(iBuf) / ((bitDepth/8) * channels);
-    TUint startI=0, endI;
+    const TUint maxSamples = DecodedAudio::kMaxBytes / ((bitDepth/8) * channels);
+    TUint endI;
     while (samplesToWrite > 0) {
         const TUint samples = (samplesToWrite > maxSamples? maxSamples : samplesToWrite);
-        TByte* p = iBuf;
+        // decode straight into pipeline memory
+        DecodedAudio* audio = iController->GetAudioBuffer();
         endI = startI + samples;
-        for (TUint i=startI; i<endI; i++) {
-            for (TUint j=0; j<channels; j++) {
-                TUint subsample = aBuffer[j][i];
-                // pipeline audio data is big endian so we might as well convert to that here
-                switch (bitDepth)
-                {
-                case 8:
-                    *p++ = (TByte)subsample;
-                    break;
-                case 16:
-                    *p++ = (TByte)(subsample >> 8);
-                    *p++ = (TByte)subsample;
-                    break;
-                case 24:
-                    *p++ = (TByte)(subsample >> 16);
-                    *p++ = (TByte)(subsample >> 8);
-                    *p++ = (TByte)subsample;
-                    break;
-                default:
-                    ASSERTS();
-                }
-            }
-        }
+        // pipeline audio data is big endian so we might as well convert to that here
+        PcmConverter::InterleaveToBigEndian(audio->WritePtr(), aBuffer, channels, startI, samples, bitDepth);
         const TUint bytes = samples * (bitDepth/8) * channels;
-        Brn encodedAudio(iBuf, bytes);
-        iTrackOffset += iController->OutputAudioPcm(encodedAudio, channels, sampleRate,
-                                                    bitDepth, EMediaDataEndianBig, iTrackOffset);
+        iTrackOffset += iController->OutputAudioPcm(audio, bytes, channels, sampleRate,
+                                                    bitDepth, iTrackOffset);
         samplesToWrite -= samples;
         startI = endI;
     }
@@ -408,6 +462,24 @@ void CodecFlac::CallbackError(const FLAC__StreamDecoder * /*aDecoder*/,
 void CodecFlac::CallbackMetadata(const FLAC__StreamDecoder * /*aDecoder*/,
                                  const FLAC__StreamMetadata* aMetadata)
 {
+    if (aMetadata->type == FLAC__METADATA_TYPE_SEEKTABLE) {
+        /* Offsets are relative to the first frame, which we won't know until all metadata has been
+           read.  Only keep points that iSeekIndex would accept; some encoders write one per frame. */
+        if (iIndexing) {
+            const FLAC__StreamMetadata_SeekTable* seekTable = &aMetadata->data.seek_table;
+            for (TUint i=0; i<seekTable->num_points; i++) {
+                const FLAC__StreamMetadata_SeekPoint& point = seekTable->points[i];
+                if (point.sample_number == FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER) {
+                    continue;
+                }
+                if (iSeekPoints.size() > 0 && point.sample_number < iSeekPoints.back().sample_number + iSeekIndex.Granularity()) {
+                    continue;
+                }
+                iSeekPoints.push_back(point);
+            }
+        }
+        return;
+    }
     ASSERT(aMetadata->type == FLAC__METADATA_TYPE_STREAMINFO);
     ASSERT(iStreamMsgDue);
     const FLAC__StreamMetadata_StreamInfo* streamInfo = &aMetadata->data.stream_info;
@@ -415,6 +487,8 @@ void CodecFlac::CallbackMetadata(const FLAC__StreamDecoder * /*aDecoder*/,
     iSampleRate = streamInfo->sample_rate;
     const TUint bitRate = iSampleRate * streamInfo->bits_per_sample * streamInfo->channels;
     iTrackLengthJiffies = (streamInfo->total_samples * Jiffies::kPerSecond) / iSampleRate;
+    iIndexing = !iOgg; // libFLAC can't report decode positions for ogg streams
+    iSeekIndex.Reset(iSampleRate);
 
     iController->OutputDecodedStream(bitRate, streamInfo->bits_per_sample, iSampleRate, streamInfo->channels, iName, iTrackLengthJiffies, iSampleStart, true);
     iStreamMsgDue = false;
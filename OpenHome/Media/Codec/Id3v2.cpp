@@ -25,6 +25,8 @@ ContainerBase* ContainerFactory::NewId3v2()
 Id3v2::Id3v2()
     : ContainerBase(Brn("ID3"))
 {
+    AddRecognitionExtension("mp3");
+    AddRecognitionExtension("aac");
 }
 
 Msg* Id3v2::Recognise()
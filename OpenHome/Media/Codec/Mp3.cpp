@@ -3,12 +3,14 @@
 #include <OpenHome/Media/Codec/CodecController.h>
 #include <OpenHome/Media/Codec/CodecFactory.h>
 #include <OpenHome/Media/Codec/Container.h>
+#include <OpenHome/Media/Codec/SeekIndex.h>
 #include <OpenHome/Private/Converter.h>
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Av/Debug.h>
 #include <OpenHome/Exception.h>
 #include <OpenHome/Private/Standard.h>
 #include <OpenHome/Media/MimeTypeList.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
 #include <mad.h>
 
 #include <stdlib.h>
@@ -33,9 +35,14 @@ private: // from CodecBase
     void Process();
     TBool TrySeek(TUint aStreamId, TUint64 aSample);
     void StreamCompleted();
+private:
+    TUint64 OutputAudio(TUint aChannels);
+    void ReleaseOutput();
 private:
     static const TUint kReadReqBytes = 4096;
     static const TUint kInBufBytes = kReadReqBytes+MAD_BUFFER_GUARD;
+    static const TUint kMaxSeekDiscardSeconds = 10;     // decode and discard up to this much audio rather than estimate a byte position
+    static const TUint kSeekPrimeSamples = 3 * 1152;    // frames decoded (and discarded) after a seek to refill libmad's bit reservoir
     mad_stream  iMadStream;
     mad_frame   iMadFrame;
     mad_synth   iMadSynth;
@@ -45,9 +52,16 @@ private:
     Bws<kInBufBytes> iInput;
     TUint64     iTrackLengthJiffies;
     TUint64     iTrackOffset;
-    Bws<DecodedAudio::kMaxBytes> iOutput;
+    DecodedAudio* iOutput; // borrowed from the pipeline; decoded into directly
+    TUint       iOutputBytes;
     TBool       iStreamEnded;
     Bws<6*1024> iRecogBuf;
+    SeekIndex   iSeekIndex;
+    TUint64     iInputOffset;   // stream position of iInput[0]
+    TUint64     iFrameSample;   // first sample of the next frame to be decoded.  Only exact while iIndexing
+    TBool       iIndexing;
+    TBool       iSeekDiscard;   // frames following an iSeekIndex seek are decoded but not output until iSeekDiscardSample
+    TUint64     iSeekDiscardSample;
 };
 
 class IMp3HeaderExtended
@@ -548,46 +562,19 @@ TUint Mp3Header::ValidSync(const Brx& aSync, TUint& layer, TUint& mode)
 }
 
 
-
-// Synthesized samples need to be converted from libmad's fixed
-// point representation to standard pcm.
-// libmad stores in 32 bits the following:
-//   SWWWFFFF FFFFFFFF FFFFFFFF FFFFFFF
-//      where 
-//        S: sign 
-//        W: whole number
-//        F: fraction of W
-//
-// MAD_F_FRACBITS is the number of F's and is architecture dependent (28 on all
-// platforms we currently care about).
-//
-// After checking for clipping (first two if's) we then convert to 24-bit with the bottom 8 bits unused.
-static TUint32 fixedToPcm(mad_fixed_t aFixed)
-{
-    const TUint32 kPlusOne  = 0x7FFFFF00l;
-    const TUint32 kMinusOne = 0x80000000l;
-    if (aFixed >= MAD_F_ONE) {
-        //LOG(kCodec, "fixedToPcm upper CLIPPED: %08x ret: %08x\n", aFixed, kPlusOne);
-        return kPlusOne;
-    }
-    if (aFixed <= -MAD_F_ONE) {
-        //LOG(kCodec, "fixedToPcm lower CLIPPED: %08x ret: %08x\n", aFixed, kMinusOne);
-        return kMinusOne; 
-    }
-    // if no clipping, then the 24 bit number is composed of the lsb W and 23 of
-    // the most significant F's.  Linn stores the 24 bits in the higher order
-    // bits with the bottom eight bits zeroed.
-    TInt32 value = (aFixed << 3) & 0xFFFFFF00l;
-    return (TUint32)value;
-}
-
-
 // CodecMp3
 
 CodecMp3::CodecMp3(IMimeTypeList& aMimeTypeList)
     : CodecBase("MP3")
     , iHeader(nullptr)
     , iHeaderBytes(0)
+    , iOutput(nullptr)
+    , iOutputBytes(0)
+    , iInputOffset(0)
+    , iFrameSample(0)
+    , iIndexing(false)
+    , iSeekDiscard(false)
+    , iSeekDiscardSample(0)
 {
     (void)memset(&iMadStream, 0, sizeof(iMadStream));
     (void)memset(&iMadFrame, 0, sizeof(iMadFrame));
@@ -595,6 +582,11 @@ CodecMp3::CodecMp3(IMimeTypeList& aMimeTypeList)
     aMimeTypeList.Add("audio/mpeg");
     aMimeTypeList.Add("audio/x-mpeg");
     aMimeTypeList.Add("audio/mp1");
+    static const TByte kSync[][2] = { { 0xff, 0xfb }, { 0xff, 0xfa }, { 0xff, 0xf3 }, { 0xff, 0xf2 }, { 0xff, 0xe3 }, { 0xff, 0xe2 } }; // layer 3: mpeg1/mpeg2/mpeg2.5, with/without crc
+    for (TUint i=0; i<sizeof(kSync)/sizeof(kSync[0]); i++) {
+        AddRecognitionSignature(Brn(kSync[i], sizeof(kSync[i])));
+    }
+    AddRecognitionExtension("mp3");
 }
 
 CodecMp3::~CodecMp3()
@@ -649,6 +641,11 @@ void CodecMp3::StreamInitialise()
     }
     ASSERT_DEBUG(iHeader == nullptr);
     iHeader = new Mp3Header(iInput, iHeaderBytes, iController->StreamLength());
+    iSeekIndex.Reset(iHeader->SampleRate());
+    iInputOffset = iController->StreamPos() - iInput.Bytes();
+    iFrameSample = 0;
+    iIndexing = true;
+    iSeekDiscard = false;
 
     iTrackLengthJiffies = (iHeader->SamplesTotal() * Jiffies::kPerSecond) / iHeader->SampleRate();
     iController->OutputDecodedStream(iHeader->BitRate(), kBitDepth, iHeader->SampleRate(), iHeader->Channels(), iHeader->Name(), iTrackLengthJiffies, 0, false);
@@ -662,14 +659,57 @@ void CodecMp3::StreamCompleted()
     iHeader = nullptr;
     iInput.SetBytes(0);
     iHeaderBytes = 0;
+    ReleaseOutput();
 
     mad_synth_finish(&iMadSynth);
     mad_frame_finish(&iMadFrame);
     mad_stream_finish(&iMadStream);
 }
 
+TUint64 CodecMp3::OutputAudio(TUint aChannels)
+{
+    DecodedAudio* audio = iOutput;
+    const TUint bytes = iOutputBytes;
+    iOutput = nullptr;
+    iOutputBytes = 0;
+    return iController->OutputAudioPcm(audio, bytes, aChannels, iHeader->SampleRate(), kBitDepth, iTrackOffset);
+}
+
+void CodecMp3::ReleaseOutput()
+{
+    if (iOutput != nullptr) {
+        iOutput->RemoveRef();
+        iOutput = nullptr;
+    }
+    iOutputBytes = 0;
+}
+
 TBool CodecMp3::TrySeek(TUint aStreamId, TUint64 aSample)
 {
+    const TUint64 primeSample = (aSample > kSeekPrimeSamples? aSample - kSeekPrimeSamples : 0);
+    TUint64 frameSample, frameOffset;
+    if (iSeekIndex.TryFind(primeSample, (TUint64)iHeader->SampleRate() * kMaxSeekDiscardSeconds, frameSample, frameOffset)) {
+        // We know exactly where a frame shortly before aSample starts.  Decode from there with
+        // a clean decoder state, discarding audio before aSample.
+        if (!iController->TrySeekTo(aStreamId, frameOffset)) {
+            return false;
+        }
+        mad_stream_finish(&iMadStream);
+        mad_stream_init(&iMadStream);
+        mad_frame_mute(&iMadFrame);
+        mad_synth_mute(&iMadSynth);
+        iInput.SetBytes(0);
+        ReleaseOutput();
+        iFrameSample = frameSample;
+        iIndexing = true;
+        iSeekDiscard = true;
+        iSeekDiscardSample = aSample;
+        iSamplesWrittenTotal = aSample;
+        iTrackOffset = (aSample * Jiffies::kPerSecond) / iHeader->SampleRate();
+        iController->OutputDecodedStream(iHeader->BitRate(), kBitDepth, iHeader->SampleRate(), iHeader->Channels(), iHeader->Name(), iTrackLengthJiffies, aSample, false);
+        return true;
+    }
+
     TUint64 bytes = 0;
     try {
         bytes = iHeader->SampleToByte(aSample);
@@ -686,6 +726,9 @@ TBool CodecMp3::TrySeek(TUint aStreamId, TUint64 aSample)
     TBool canSeek = iController->TrySeekTo(aStreamId, bytes);
     if (canSeek) {
         iInput.SetBytes(0);
+        ReleaseOutput();
+        iIndexing = false; // byte position was estimated so we no longer know the sample of each frame
+        iSeekDiscard = false;
         iSamplesWrittenTotal = aSample;
         iTrackOffset = (aSample * Jiffies::kPerSecond) / iHeader->SampleRate();
         iController->OutputDecodedStream(iHeader->BitRate(), kBitDepth, iHeader->SampleRate(), iHeader->Channels(), iHeader->Name(), iTrackLengthJiffies, aSample, false);
@@ -740,6 +783,12 @@ void CodecMp3::Process()
             iStreamEnded = true;
             //LOG(kCodec, "CodecMp3::Process caught CodecStreamEnded\n");
         }
+        if (newStreamStarted) {
+            iIndexing = false; // StreamPos() now refers to the new stream
+        }
+        else {
+            iInputOffset = iController->StreamPos() - iInput.Bytes();
+        }
         if (newStreamStarted || iStreamEnded) {
             ASSERT_DEBUG(iInput.Bytes() + MAD_BUFFER_GUARD < iInput.MaxBytes()); // FIXME - volkano just assumes this holds true.  Why is that safe?
             TUint8* ptr = (TUint8*)iInput.Ptr() + iInput.Bytes();
@@ -763,6 +812,13 @@ void CodecMp3::Process()
 
         // Not start/end of stream; try some error recovery.
         if (MAD_RECOVERABLE(iMadStream.error)) {
+            if (iMadStream.error == MAD_ERROR_BADDATAPTR) {
+                // header was decoded (and main data kept for following frames) but the frame's audio is lost
+                iFrameSample += 32 * MAD_NSBSAMPLES(&iMadFrame.header);
+            }
+            else {
+                iIndexing = false;
+            }
             //LOG(kCodec, "CodecMp3::Process recoverable error: %s\n", mad_stream_errorstr(&iMadStream));
             return;
         }
@@ -778,10 +834,29 @@ void CodecMp3::Process()
         }
     }
         
+    const TUint64 frameSample = iFrameSample;
+    iFrameSample += 32 * MAD_NSBSAMPLES(&iMadFrame.header);
+    if (iIndexing) {
+        iSeekIndex.Add(frameSample, iInputOffset + (iMadStream.this_frame - iInput.Ptr()));
+    }
+
     // Once frame is decoded, synthesize to pcm samples.  
     (void)mad_synth_frame(&iMadSynth, &iMadFrame);
     TUint channels = iHeader->Channels();
     TUint samplesToWrite = iMadSynth.pcm.length;
+    TUint pcmIndex = 0;
+    if (iSeekDiscard) {
+        if (iFrameSample <= iSeekDiscardSample) {
+            samplesToWrite = 0;
+        }
+        else {
+            if (frameSample < iSeekDiscardSample) {
+                pcmIndex = (TUint)(iSeekDiscardSample - frameSample);
+                samplesToWrite -= pcmIndex;
+            }
+            iSeekDiscard = false;
+        }
+    }
     //LOG(kCodec, "CodecMp3::Process samplesToWrite: %d, written: %lld\n", samplesToWrite, iSamplesWrittenTotal);
 
     // limit output of samples to total defined in header, unless its a live stream
@@ -792,44 +867,39 @@ void CodecMp3::Process()
         }
     }
 
-    TUint pcmIndex = 0;
-    do {
+    while (samplesToWrite > 0) {
+        if (iOutput == nullptr) {
+            iOutput = iController->GetAudioBuffer();
+            iOutputBytes = 0;
+        }
         TUint bytes = samplesToWrite * (kBitDepth/8) * channels;
         TUint samples = samplesToWrite;
-        TUint outputSpace = iOutput.MaxBytes() - iOutput.Bytes();
+        TUint outputSpace = DecodedAudio::kMaxBytes - iOutputBytes;
         if (bytes > outputSpace) {
             samples = outputSpace / (channels * (kBitDepth/8));
             bytes = samples * (kBitDepth/8) * channels;
         }
-        TByte* dst = const_cast<TByte*>(iOutput.Ptr()) + iOutput.Bytes();
-        for (TUint i=pcmIndex; i<pcmIndex+samples; i++) {
-            for (TUint j=0; j<channels; j++) {
-                TUint subsample = fixedToPcm(iMadSynth.pcm.samples[j][i]);
-                // output is always 24-bit
-                *dst++ = (TByte)(subsample >> 24);
-                *dst++ = (TByte)(subsample >> 16);
-                *dst++ = (TByte)(subsample >> 8);
-            }
-        }
+        // libmad's fixed point samples (MAD_F_FRACBITS fractional bits) are clipped then
+        // truncated to 24 bits.  Output is always 24-bit.
+        TByte* dst = iOutput->WritePtr() + iOutputBytes;
+        const TInt32* const src[2] = { iMadSynth.pcm.samples[0], iMadSynth.pcm.samples[1] };
+        PcmConverter::InterleaveFixedToBigEndian24(dst, src, channels, pcmIndex, samples, MAD_F_FRACBITS);
         pcmIndex += samples;
-        iOutput.SetBytes(iOutput.Bytes() + bytes);
+        iOutputBytes += bytes;
         // only output audio when we have data for a full-sized msg.
         // any data not output now will be picked up the next time round
-        if (iOutput.MaxBytes() - iOutput.Bytes() < (kBitDepth/8) * channels) {
-            iTrackOffset += iController->OutputAudioPcm(iOutput, channels, iHeader->SampleRate(),
-                                                        kBitDepth, EMediaDataEndianBig, iTrackOffset);
-            iOutput.SetBytes(0);
+        if (DecodedAudio::kMaxBytes - iOutputBytes < (kBitDepth/8) * channels) {
+            iTrackOffset += OutputAudio(channels);
         }
         iSamplesWrittenTotal += samples;
         samplesToWrite -= samples;
-    } while (samplesToWrite > 0);
+    }
 
     // now propogate any end of stream exception
     // first check we have processed remaining frames of this stream
     if ((iMadStream.md_len == 0) && (iStreamEnded || newStreamStarted)) {
-        if (iOutput.Bytes() > 0) { // only output if there is audio remaining
-            iController->OutputAudioPcm(iOutput, channels, iHeader->SampleRate(),
-                                        kBitDepth, EMediaDataEndianBig, iTrackOffset);
+        if (iOutputBytes > 0) { // only output if there is audio remaining
+            (void)OutputAudio(channels);
         }
         if (newStreamStarted) {
             THROW(CodecStreamStart);
@@ -10,6 +10,7 @@
 #include <OpenHome/Media/Debug.h>
 #include <OpenHome/Media/MimeTypeList.h>
 
+#include <algorithm>
 #include <limits>
 #include <vector>
 
@@ -959,13 +960,7 @@ Msg* Mpeg4BoxStsz::Process()
         }
         else if (iState == eSampleSize) {
             iOffset += iBuf.Bytes();
-            const TUint sampleSize = Converter::BeUint32At(iBuf, 0);
-            if (sampleSize != 0) {
-                // Don't support constant sample size.
-                iCache->Discard(iBytes - iOffset);
-                iOffset = iBytes;
-                THROW(MediaMpeg4FileInvalid); // FIXME - not very accurate. File is valid, it just isn't supported in this code.
-            }
+            iSampleSize = Converter::BeUint32At(iBuf, 0);
             iCache->Inspect(iBuf, iBuf.MaxBytes());
             iState = eEntryCount;
         }
@@ -973,8 +968,22 @@ Msg* Mpeg4BoxStsz::Process()
             iOffset += iBuf.Bytes();
             const TUint entries = Converter::BeUint32At(iBuf, 0);
             iSampleSizeTable.Init(entries);
-            iCache->Inspect(iBuf, iBuf.MaxBytes());
-            iState = eEntry;
+            if (iSampleSize != 0) {
+                // All samples are the same size and no table follows.  Packs down to a single run.
+                for (TUint i=0; i<entries; i++) {
+                    iSampleSizeTable.AddSampleSize(iSampleSize);
+                }
+                if (!Complete()) {
+                    iCache->Discard(iBytes - iOffset);
+                    iOffset = iBytes;
+                    THROW(MediaMpeg4FileInvalid);
+                }
+                iState = eComplete;
+            }
+            else {
+                iCache->Inspect(iBuf, iBuf.MaxBytes());
+                iState = eEntry;
+            }
         }
         else if (iState == eEntry) {
             iOffset += iBuf.Bytes();
@@ -1011,6 +1020,7 @@ void Mpeg4BoxStsz::Reset()
     iBytes = 0;
     iOffset = 0;
     iBuf.SetBytes(0);
+    iSampleSize = 0;
 }
 
 TBool Mpeg4BoxStsz::Recognise(const Brx& aBoxId) const
@@ -1923,9 +1933,214 @@ TUint Mpeg4BoxMdat::BytesToRead() const
     return bytes;
 }
 
+// PackedTable
+
+PackedTable::PackedTable()
+{
+    Clear();
+}
+
+void PackedTable::Clear()
+{
+    iBlocks.clear();
+    iWords.clear();
+    iBitCount = 0;
+    iPackedCount = 0;
+    iPendingCount = 0;
+}
+
+void PackedTable::Add(TUint64 aValue)
+{
+    iPending[iPendingCount++] = aValue;
+    if (iPendingCount == kBlockEntries) {
+        Pack();
+    }
+}
+
+TUint64 PackedTable::Get(TUint aIndex) const
+{
+    ASSERT(aIndex < Count());
+    if (aIndex >= iPackedCount) {
+        return iPending[aIndex - iPackedCount];
+    }
+    auto it = std::upper_bound(iBlocks.begin(), iBlocks.end(), aIndex, BlockCmp());
+    ASSERT(it != iBlocks.begin());
+    const Block& block = *(--it);
+    const TUint i = aIndex - block.iFirstIndex;
+    const TUint64 residual = ReadBits(block.iBitOffset + (TUint64)i * block.iBits, block.iBits);
+    return block.iBase + i * block.iStride + residual;
+}
+
+TUint PackedTable::Count() const
+{
+    return iPackedCount + iPendingCount;
+}
+
+TUint PackedTable::BlockCount() const
+{
+    return (TUint)iBlocks.size();
+}
+
+TUint PackedTable::Bytes() const
+{
+    return (TUint)(sizeof(*this) + iBlocks.capacity() * sizeof(Block) + iWords.capacity() * sizeof(TUint32));
+}
+
+void PackedTable::Write(IWriter& aWriter) const
+{
+    WriterBinary writerBin(aWriter);
+    writerBin.WriteUint32Be((TUint)iBlocks.size());
+    for (auto it=iBlocks.begin(); it!=iBlocks.end(); ++it) {
+        writerBin.WriteUint32Be(it->iCount);
+        writerBin.WriteUint64Be(it->iBase);
+        writerBin.WriteUint64Be(it->iStride);
+        writerBin.WriteUint8((TByte)it->iBits);
+    }
+    writerBin.WriteUint32Be((TUint)((iBitCount + 31) / 32));
+    for (TUint i=0; i<(iBitCount + 31) / 32; i++) {
+        writerBin.WriteUint32Be(iWords[i]);
+    }
+    writerBin.WriteUint32Be(iPendingCount);
+    for (TUint i=0; i<iPendingCount; i++) {
+        writerBin.WriteUint64Be(iPending[i]);
+    }
+}
+
+void PackedTable::Read(IReader& aReader)
+{
+    Clear();
+    ReaderBinary readerBin(aReader);
+    const TUint blocks = readerBin.ReadUintBe(4);
+    for (TUint i=0; i<blocks; i++) {
+        Block block;
+        block.iFirstIndex = iPackedCount;
+        block.iCount = readerBin.ReadUintBe(4);
+        block.iBase = readerBin.ReadUint64Be(8);
+        block.iStride = readerBin.ReadUint64Be(8);
+        block.iBits = readerBin.ReadUintBe(1);
+        block.iBitOffset = iBitCount;
+        if (block.iCount == 0 || block.iBits > 64 || block.iCount > std::numeric_limits<TUint>::max() - iPackedCount) {
+            THROW(MediaMpeg4FileInvalid);
+        }
+        iBlocks.push_back(block);
+        iPackedCount += block.iCount;
+        iBitCount += (TUint64)block.iCount * block.iBits;
+    }
+    const TUint words = readerBin.ReadUintBe(4);
+    if (words != (iBitCount + 31) / 32) {
+        THROW(MediaMpeg4FileInvalid);
+    }
+    iWords.reserve(words);
+    for (TUint i=0; i<words; i++) {
+        iWords.push_back(readerBin.ReadUintBe(4));
+    }
+    const TUint pending = readerBin.ReadUintBe(4);
+    if (pending >= kBlockEntries) {
+        THROW(MediaMpeg4FileInvalid);
+    }
+    for (TUint i=0; i<pending; i++) {
+        iPending[iPendingCount++] = readerBin.ReadUint64Be(8);
+    }
+}
+
+void PackedTable::Pack()
+{
+    TBool increasing = true;
+    TUint64 stride = std::numeric_limits<TUint64>::max();
+    for (TUint i=1; i<iPendingCount; i++) {
+        if (iPending[i] < iPending[i-1]) {
+            increasing = false;
+            break;
+        }
+        stride = std::min(stride, iPending[i] - iPending[i-1]);
+    }
+    if (!increasing || iPendingCount == 1) {
+        stride = 0;
+    }
+    // For increasing values, iPending[i] - i*stride never decreases so the base is the first value.
+    TUint64 base = iPending[0];
+    if (stride == 0) {
+        base = *std::min_element(iPending, iPending + iPendingCount);
+    }
+    TUint64 maxResidual = 0;
+    for (TUint i=0; i<iPendingCount; i++) {
+        maxResidual = std::max(maxResidual, iPending[i] - base - i * stride);
+    }
+    TUint bits = 0;
+    while (bits < 64 && (maxResidual >> bits) != 0) {
+        bits++;
+    }
+
+    Block block;
+    block.iFirstIndex = iPackedCount;
+    block.iCount = iPendingCount;
+    block.iBase = base;
+    block.iStride = stride;
+    block.iBitOffset = iBitCount;
+    block.iBits = bits;
+    for (TUint i=0; i<iPendingCount; i++) {
+        AppendBits(iPending[i] - base - i * stride, bits);
+    }
+    AddBlock(block);
+    iPackedCount += iPendingCount;
+    iPendingCount = 0;
+}
+
+void PackedTable::AddBlock(const Block& aBlock)
+{
+    if (aBlock.iBits == 0 && iBlocks.size() > 0) {
+        Block& prev = iBlocks.back();
+        if (prev.iBits == 0 && prev.iStride == aBlock.iStride &&
+            prev.iBase + prev.iCount * prev.iStride == aBlock.iBase) {
+            prev.iCount += aBlock.iCount;
+            return;
+        }
+    }
+    iBlocks.push_back(aBlock);
+}
+
+void PackedTable::AppendBits(TUint64 aValue, TUint aBits)
+{
+    for (TUint written=0; written<aBits;) {
+        const TUint shift = (TUint)(iBitCount % 32);
+        if (shift == 0) {
+            iWords.push_back(0);
+        }
+        const TUint bits = std::min(32 - shift, aBits - written);
+        const TUint32 mask = (bits == 32? 0xffffffff : (1u << bits) - 1);
+        iWords.back() |= ((TUint32)(aValue >> written) & mask) << shift;
+        written += bits;
+        iBitCount += bits;
+    }
+}
+
+TUint64 PackedTable::ReadBits(TUint64 aBitOffset, TUint aBits) const
+{
+    TUint64 value = 0;
+    for (TUint read=0; read<aBits;) {
+        const TUint shift = (TUint)(aBitOffset % 32);
+        const TUint bits = std::min(32 - shift, aBits - read);
+        const TUint32 mask = (bits == 32? 0xffffffff : (1u << bits) - 1);
+        value |= (TUint64)((iWords[(size_t)(aBitOffset / 32)] >> shift) & mask) << read;
+        read += bits;
+        aBitOffset += bits;
+    }
+    return value;
+}
+
+
+// PackedTable::BlockCmp
+
+TBool PackedTable::BlockCmp::operator()(TUint aIndex, const Block& aBlock) const
+{
+    return aIndex < aBlock.iFirstIndex;
+}
+
+
 // SampleSizeTable
 
 SampleSizeTable::SampleSizeTable()
+    : iMaxEntries(0)
 {
 }
 
@@ -1936,35 +2151,47 @@ SampleSizeTable::~SampleSizeTable()
 
 void SampleSizeTable::Init(TUint aMaxEntries)
 {
-    ASSERT(iTable.size() == 0);
-    iTable.reserve(aMaxEntries);
+    ASSERT(iTable.Count() == 0);
+    iMaxEntries = aMaxEntries;
 }
 
 void SampleSizeTable::Clear()
 {
-    iTable.clear();
+    iTable.Clear();
+    iMaxEntries = 0;
 }
 
 void SampleSizeTable::AddSampleSize(TUint aSize)
 {
-    if (iTable.size() == iTable.capacity()) {
-        // File contains more sample sizes than it reported (and than we reserved capacity for).
+    if (iTable.Count() == iMaxEntries) {
+        // File contains more sample sizes than it reported.
         THROW(MediaMpeg4FileInvalid);
     }
-    iTable.push_back(aSize);
+    iTable.Add(aSize);
 }
 
 TUint32 SampleSizeTable::SampleSize(TUint aIndex) const
 {
-    if (aIndex > iTable.size() - 1) {
+    if (aIndex >= iTable.Count()) {
         THROW(MediaMpeg4FileInvalid); // FIXME - sign of corrupt file or programmer error (i.e., should ASSERT)?
     }
-    return iTable[aIndex];
+    return (TUint32)iTable.Get(aIndex);
 }
 
 TUint32 SampleSizeTable::Count() const
 {
-    return iTable.size();
+    return iTable.Count();
+}
+
+void SampleSizeTable::Write(IWriter& aWriter) const
+{
+    iTable.Write(aWriter);
+}
+
+void SampleSizeTable::Read(IReader& aReader)
+{
+    iTable.Read(aReader);
+    iMaxEntries = iTable.Count();
 }
 
 // SeekTable
@@ -1989,15 +2216,15 @@ void SeekTable::InitialiseAudioSamplesPerSample(TUint aEntries)
     iAudioSamplesPerSample.reserve(aEntries);
 }
 
-void SeekTable::InitialiseOffsets(TUint aEntries)
+void SeekTable::InitialiseOffsets(TUint /*aEntries*/)
 {
-    iOffsets.reserve(aEntries);
+    // Offsets are packed as they're added so there's nothing to reserve.
 }
 
 TBool SeekTable::Initialised() const
 {
     const TBool initialised = iSamplesPerChunk.size() > 0
-            && iAudioSamplesPerSample.size() > 0 && iOffsets.size() > 0;
+            && iAudioSamplesPerSample.size() > 0 && iOffsets.Count() > 0;
     return initialised;
 }
 
@@ -2005,7 +2232,7 @@ void SeekTable::Deinitialise()
 {
     iSamplesPerChunk.clear();
     iAudioSamplesPerSample.clear();
-    iOffsets.clear();
+    iOffsets.Clear();
 }
 
 void SeekTable::SetSamplesPerChunk(TUint aFirstChunk, TUint aSamplesPerChunk,
@@ -2025,12 +2252,17 @@ void SeekTable::SetAudioSamplesPerSample(TUint32 aSampleCount,
 
 void SeekTable::SetOffset(TUint64 aOffset)
 {
-    iOffsets.push_back(aOffset);
+    iOffsets.Add(aOffset);
+}
+
+void SeekTable::ReadOffsets(IReader& aReader)
+{
+    iOffsets.Read(aReader);
 }
 
 TUint SeekTable::ChunkCount() const
 {
-    return iOffsets.size();
+    return iOffsets.Count();
 }
 
 TUint SeekTable::AudioSamplesPerSample() const
@@ -2093,7 +2325,7 @@ TUint SeekTable::StartSample(TUint aChunkIndex) const
 TUint64 SeekTable::Offset(TUint64& aAudioSample, TUint64& aSample)
 {
     if (iSamplesPerChunk.size() == 0 || iAudioSamplesPerSample.size() == 0
-            || iOffsets.size() == 0) {
+            || iOffsets.Count() == 0) {
         THROW(CodecStreamCorrupt); // seek table empty - cannot do seek // FIXME - throw a MpegMediaFileInvalid exception, which is actually expected/caught?
     }
 
@@ -2112,16 +2344,16 @@ TUint64 SeekTable::Offset(TUint64& aAudioSample, TUint64& aSample)
     aSample = codecSampleFromChunk;
 
     //stco:
-    if (chunk >= iOffsets.size()+1) { // error - required chunk doesn't exist
+    if (chunk >= iOffsets.Count()+1) { // error - required chunk doesn't exist
         THROW(MediaMpeg4OutOfRange);
     }
-    return iOffsets[chunk - 1]; // entry found - return offset to required chunk
+    return iOffsets.Get(chunk - 1); // entry found - return offset to required chunk
 }
 
 TUint64 SeekTable::GetOffset(TUint aChunkIndex) const
 {
-    ASSERT(aChunkIndex < iOffsets.size());
-    return iOffsets[aChunkIndex];
+    ASSERT(aChunkIndex < iOffsets.Count());
+    return iOffsets.Get(aChunkIndex);
 }
 
 void SeekTable::Write(IWriter& aWriter) const
@@ -2143,11 +2375,7 @@ void SeekTable::Write(IWriter& aWriter) const
         writerBin.WriteUint32Be(iAudioSamplesPerSample[i].iAudioSamples);
     }
 
-    const TUint chunkCount = iOffsets.size();
-    writerBin.WriteUint32Be(chunkCount);
-    for (TUint i = 0; i < chunkCount; i++) {
-        writerBin.WriteUint64Be(iOffsets[i]);
-    }
+    iOffsets.Write(aWriter);
 }
 
 TUint64 SeekTable::CodecSample(TUint64 aAudioSample) const
@@ -2201,7 +2429,7 @@ TUint SeekTable::SamplesPerChunkTotal(TUint aIndex) const
     else {
         // No next entry, so end chunk must be last chunk in file.
         // Since chunk numbers start at one, must be chunk_count+1.
-        endChunk = iOffsets.size()+1;
+        endChunk = iOffsets.Count()+1;
     }
 
     const TUint chunkDiff = endChunk - startChunk;
@@ -2265,7 +2493,7 @@ TUint SeekTable::CodecSampleFromChunk(TUint aChunk) const
         }
         else {
             // No next entry, so end chunk must be last chunk in file.
-            endChunk = iOffsets.size();
+            endChunk = iOffsets.Count();
         }
 
         const TUint chunkDiff = endChunk - startChunk;
@@ -2355,12 +2583,7 @@ void SeekTableInitialiser::Init()
         iSeekTable.SetAudioSamplesPerSample(sampleCount, audioSamples);
     }
 
-    const TUint chunkCount = readerBin.ReadUintBe(4);
-    iSeekTable.InitialiseOffsets(chunkCount);
-    for (TUint i = 0; i < chunkCount; i++) {
-        const TUint64 offset = readerBin.ReadUint64Be(8);
-        iSeekTable.SetOffset(offset);
-    }
+    iSeekTable.ReadOffsets(iReader);
     iInitialised = true;
 }
 
@@ -2412,7 +2635,7 @@ void MsgAudioEncodedWriter::Write(const Brx& aBuffer)
             if (remaining < bufCapacity) {
                 bytes = remaining;
             }
-            iBuf.Append(iBuf.Ptr() + offset, bytes);
+            iBuf.Append(aBuffer.Ptr() + offset, bytes);
             offset += bytes;
             remaining -= bytes;
         }
@@ -2599,6 +2822,9 @@ Mpeg4Container::Mpeg4Container(IMimeTypeList& aMimeTypeList)
     , iLock("MP4L")
 {
     aMimeTypeList.Add("audio/mp4");
+    AddRecognitionExtension("m4a");
+    AddRecognitionExtension("mp4");
+    AddRecognitionExtension("m4b");
 }
 
 void Mpeg4Container::Construct(IMsgAudioEncodedCache& aCache, MsgFactory& aMsgFactory, IContainerSeekHandler& aSeekHandler, IContainerUrlBlockWriter& aUrlBlockWriter)
@@ -2738,13 +2964,7 @@ void Mpeg4Container::RegisterChunkSeekObserver(
 MsgAudioEncoded* Mpeg4Container::WriteSampleSizeTable() const
 {
     MsgAudioEncodedWriter writerMsg(*iMsgFactory);
-    WriterBinary writerBin(writerMsg);
-
-    const TUint count = iSampleSizeTable.Count();
-    writerBin.WriteUint32Be(count);
-    for (TUint i = 0; i < count; i++) {
-        writerBin.WriteUint32Be(iSampleSizeTable.SampleSize(i));
-    }
+    iSampleSizeTable.Write(writerMsg);
     writerMsg.WriteFlush();
 
     MsgAudioEncoded* msg = writerMsg.Msg();
@@ -420,6 +420,7 @@ private:
     TUint iBytes;
     TUint iOffset;
     Bws<4> iBuf;
+    TUint iSampleSize;  // non-zero if all samples are this size
 };
 
 class IMpeg4DurationSettable
@@ -740,6 +741,60 @@ private:
     Mutex iLock;
 };
 
+/*
+Append-only table of unsigned values, read back by index.
+
+Sample sizes and chunk offsets for a multi-hour file run to hundreds of thousands of entries
+but vary little from one entry to the next.  Values are packed kBlockEntries at a time as
+(base, stride) plus the bit-packed residuals of each value from base+i*stride, where stride is
+the smallest step between values in a block that only ever increases (e.g. chunk offsets) and
+zero otherwise (e.g. sample sizes).  Consecutive blocks with no residuals that continue the same
+line are merged, so a run of constant or evenly spaced values costs a single block.
+*/
+class PackedTable
+{
+public:
+    static const TUint kBlockEntries = 64;
+public:
+    PackedTable();
+    void Clear();
+    void Add(TUint64 aValue);
+    TUint64 Get(TUint aIndex) const;
+    TUint Count() const;
+    TUint BlockCount() const;   // packed blocks, excluding any values not yet packed
+    TUint Bytes() const;        // approximate memory used
+    void Write(IWriter& aWriter) const; // Serialise.
+    void Read(IReader& aReader);        // Replaces contents with a table serialised by Write().  Throws MediaMpeg4FileInvalid.
+private:
+    class Block
+    {
+    public:
+        TUint iFirstIndex;
+        TUint iCount;
+        TUint64 iBase;
+        TUint64 iStride;
+        TUint64 iBitOffset;
+        TUint iBits;
+    };
+    class BlockCmp
+    {
+    public:
+        TBool operator()(TUint aIndex, const Block& aBlock) const;
+    };
+private:
+    void Pack();
+    void AddBlock(const Block& aBlock);
+    void AppendBits(TUint64 aValue, TUint aBits);
+    TUint64 ReadBits(TUint64 aBitOffset, TUint aBits) const;
+private:
+    std::vector<Block> iBlocks;
+    std::vector<TUint32> iWords;
+    TUint64 iBitCount;
+    TUint iPackedCount;
+    TUint64 iPending[kBlockEntries];
+    TUint iPendingCount;
+};
+
 class SampleSizeTable
 {
 public:
@@ -750,8 +805,11 @@ public:
     void AddSampleSize(TUint aSampleSize);
     TUint SampleSize(TUint aIndex) const;
     TUint Count() const;
+    void Write(IWriter& aWriter) const; // Serialise.
+    void Read(IReader& aReader);        // Deserialise output of Write().
 private:
-    std::vector<TUint> iTable;
+    PackedTable iTable;
+    TUint iMaxEntries;
 };
 
 // FIXME - should probably also include stss here.
@@ -771,6 +829,7 @@ public:
     void SetSamplesPerChunk(TUint aFirstChunk, TUint aSamplesPerChunk, TUint aSampleDescriptionIndex);
     void SetAudioSamplesPerSample(TUint32 aSampleCount, TUint32 aAudioSamples);
     void SetOffset(TUint64 aOffset);    // FIXME - rename to AddOffset()? and similar with above methods?
+    void ReadOffsets(IReader& aReader); // Replaces offsets with those serialised by Write().
     TUint ChunkCount() const;
     TUint AudioSamplesPerSample() const;
     TUint SamplesPerChunk(TUint aChunkIndex) const;
@@ -801,7 +860,7 @@ private:
 private:
     std::vector<TSamplesPerChunkEntry> iSamplesPerChunk;
     std::vector<TAudioSamplesPerSampleEntry> iAudioSamplesPerSample;
-    std::vector<TUint64> iOffsets;
+    PackedTable iOffsets;
 };
 
 class SeekTableInitialiser : public INonCopyable
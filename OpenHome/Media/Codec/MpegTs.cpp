@@ -865,6 +865,8 @@ MpegTsContainer::MpegTsContainer(IMimeTypeList& aMimeTypeList)
     , iMpegPes(nullptr)
 {
     aMimeTypeList.Add("application/vnd.apple.mpegurl");
+    AddRecognitionExtension("ts");
+    AddRecognitionExtension("m3u8");
 }
 
 MpegTsContainer::~MpegTsContainer()
@@ -0,0 +1,183 @@
+#include <OpenHome/Media/Codec/RecognitionIndex.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Standard.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::Media;
+using namespace OpenHome::Media::Codec;
+
+
+// RecognitionHints
+
+void RecognitionHints::AddExtension(const TChar* aExtension)
+{
+    Brn ext(aExtension);
+    ASSERT(ext.Bytes() > 0 && ext.Bytes() <= RecognitionIndex::kMaxExtensionBytes);
+    iExtensions.push_back(ext);
+}
+
+void RecognitionHints::AddSignature(const Brx& aSignature, TUint aOffset)
+{
+    ASSERT(aSignature.Bytes() > 0);
+    ASSERT(aOffset + aSignature.Bytes() <= kMaxHeaderBytes);
+    iSignatures.push_back(Signature(aSignature, aOffset));
+}
+
+
+// RecognitionHints::Signature
+
+RecognitionHints::Signature::Signature(const Brx& aBytes, TUint aOffset)
+    : iBytes(aBytes)
+    , iOffset(aOffset)
+{
+}
+
+
+// RecognitionIndex
+
+RecognitionIndex::RecognitionIndex()
+    : iHeaderBytes(0)
+{
+}
+
+void RecognitionIndex::Clear()
+{
+    iTries.clear();
+    iExtensions.clear();
+    iHeaderBytes = 0;
+}
+
+void RecognitionIndex::Add(TUint aId, const RecognitionHints& aHints)
+{
+    for (auto& sig : aHints.iSignatures) {
+        auto it = std::find_if(iTries.begin(), iTries.end(), [&sig](const Trie& aTrie) { return aTrie.iOffset == sig.iOffset; });
+        if (it == iTries.end()) {
+            iTries.push_back(Trie(sig.iOffset));
+            it = iTries.end() - 1;
+        }
+        it->Add(sig.iBytes, aId);
+        iHeaderBytes = std::max(iHeaderBytes, sig.iOffset + sig.iBytes.Bytes());
+    }
+    for (auto& ext : aHints.iExtensions) {
+        auto& ids = iExtensions[ext];
+        Merge(ids, std::vector<TUint>(1, aId));
+        std::sort(ids.begin(), ids.end());
+    }
+}
+
+TUint RecognitionIndex::HeaderBytes() const
+{
+    return iHeaderBytes;
+}
+
+void RecognitionIndex::Candidates(const Brx& aUri, const Brx& aHeader, std::vector<TUint>& aCandidates) const
+{
+    aCandidates.clear();
+    if (aHeader.Bytes() > 0) {
+        std::vector<TUint> matched;
+        for (auto& trie : iTries) {
+            trie.Match(aHeader, matched);
+        }
+        std::sort(matched.begin(), matched.end());
+        Merge(aCandidates, matched);
+    }
+    Bws<kMaxExtensionBytes> ext;
+    Extension(aUri, ext);
+    if (ext.Bytes() > 0) {
+        auto it = iExtensions.find(Brn(ext));
+        if (it != iExtensions.end()) {
+            Merge(aCandidates, it->second);
+        }
+    }
+}
+
+void RecognitionIndex::Extension(const Brx& aUri, Bwx& aExtension)
+{ // static
+    aExtension.SetBytes(0);
+    TUint end = aUri.Bytes();
+    for (TUint i=0; i<end; i++) {
+        if (aUri[i] == '?' || aUri[i] == '#') {
+            end = i;
+            break;
+        }
+    }
+    TUint start = end;
+    for (TUint i=end; i>0; i--) {
+        const TByte ch = aUri[i-1];
+        if (ch == '/') {
+            return;
+        }
+        if (ch == '.') {
+            start = i;
+            break;
+        }
+    }
+    const TUint bytes = end - start;
+    if (bytes == 0 || bytes > aExtension.MaxBytes()) {
+        return;
+    }
+    for (TUint i=start; i<end; i++) {
+        TByte ch = aUri[i];
+        if (ch >= 'A' && ch <= 'Z') {
+            ch = (TByte)(ch - 'A' + 'a');
+        }
+        aExtension.Append(ch);
+    }
+}
+
+void RecognitionIndex::Merge(std::vector<TUint>& aIds, const std::vector<TUint>& aAdded)
+{ // static
+    for (auto id : aAdded) {
+        if (std::find(aIds.begin(), aIds.end(), id) == aIds.end()) {
+            aIds.push_back(id);
+        }
+    }
+}
+
+
+// RecognitionIndex::Trie
+
+RecognitionIndex::Trie::Trie(TUint aOffset)
+    : iOffset(aOffset)
+    , iNodes(1)
+{
+}
+
+void RecognitionIndex::Trie::Add(const Brx& aSignature, TUint aId)
+{
+    TUint node = 0;
+    for (TUint i=0; i<aSignature.Bytes(); i++) {
+        const TByte byte = aSignature[i];
+        auto& children = iNodes[node].iChildren;
+        auto it = std::find_if(children.begin(), children.end(), [byte](const std::pair<TByte, TUint>& aChild) { return aChild.first == byte; });
+        if (it != children.end()) {
+            node = it->second;
+        }
+        else {
+            const TUint child = (TUint)iNodes.size();
+            children.push_back(std::pair<TByte, TUint>(byte, child));
+            iNodes.push_back(Node()); // invalidates children
+            node = child;
+        }
+    }
+    Merge(iNodes[node].iIds, std::vector<TUint>(1, aId));
+}
+
+void RecognitionIndex::Trie::Match(const Brx& aHeader, std::vector<TUint>& aIds) const
+{
+    TUint node = 0;
+    for (TUint i=iOffset; i<aHeader.Bytes(); i++) {
+        const TByte byte = aHeader[i];
+        auto& children = iNodes[node].iChildren;
+        auto it = std::find_if(children.begin(), children.end(), [byte](const std::pair<TByte, TUint>& aChild) { return aChild.first == byte; });
+        if (it == children.end()) {
+            break;
+        }
+        node = it->second;
+        aIds.insert(aIds.end(), iNodes[node].iIds.begin(), iNodes[node].iIds.end());
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Standard.h>
+
+#include <map>
+#include <vector>
+
+namespace OpenHome {
+namespace Media {
+namespace Codec {
+
+/*
+Recognition fast-path.
+
+Codecs and containers can describe streams they're likely to recognise using file extensions
+(taken from the stream's uri) and magic byte signatures (found at a fixed offset from the start of
+the stream).  Controllers use these hints to try plausible candidates first.  Hints never prevent
+a candidate being tried - if no hinted candidate recognises a stream, all remaining candidates are
+tried in their default order.
+*/
+
+class RecognitionHints
+{
+    friend class RecognitionIndex;
+public:
+    static const TUint kMaxSignatureBytes = 16;
+    static const TUint kMaxHeaderBytes = 64; // max offset + length of any signature
+public:
+    void AddExtension(const TChar* aExtension); // lower case, without leading '.'.  Must remain valid for the lifetime of the hints
+    void AddSignature(const Brx& aSignature, TUint aOffset = 0);
+private:
+    class Signature
+    {
+    public:
+        Signature(const Brx& aBytes, TUint aOffset);
+    public:
+        Bws<kMaxSignatureBytes> iBytes;
+        TUint iOffset;
+    };
+private:
+    std::vector<Brn> iExtensions;
+    std::vector<Signature> iSignatures;
+};
+
+class RecognitionIndex : private INonCopyable
+{
+public:
+    static const TUint kMaxExtensionBytes = 8;
+public:
+    RecognitionIndex();
+    void Clear();
+    /*
+     * Candidates are identified by aId.  Lower ids are preferred - where several candidates
+     * match a stream, they are returned in ascending order of aId.
+     */
+    void Add(TUint aId, const RecognitionHints& aHints);
+    TUint HeaderBytes() const; // bytes from the start of a stream that are worth passing to Candidates()
+    /*
+     * Sets aCandidates to the ids of all candidates whose hints match aUri or aHeader (which may
+     * be shorter than HeaderBytes(), or empty).  Signature matches are listed before extension matches.
+     */
+    void Candidates(const Brx& aUri, const Brx& aHeader, std::vector<TUint>& aCandidates) const;
+    static void Extension(const Brx& aUri, Bwx& aExtension); // lower case extension of the final path segment of aUri
+private:
+    class Node
+    {
+    public:
+        std::vector<std::pair<TByte, TUint>> iChildren; // byte, index of child node
+        std::vector<TUint> iIds;                        // candidates whose signature ends at this node
+    };
+    class Trie
+    {
+    public:
+        Trie(TUint aOffset);
+        void Add(const Brx& aSignature, TUint aId);
+        void Match(const Brx& aHeader, std::vector<TUint>& aIds) const;
+    public:
+        TUint iOffset;
+    private:
+        std::vector<Node> iNodes; // iNodes[0] is the root
+    };
+    typedef std::map<Brn, std::vector<TUint>, BufferCmp> ExtensionMap;
+private:
+    static void Merge(std::vector<TUint>& aIds, const std::vector<TUint>& aAdded);
+private:
+    std::vector<Trie> iTries; // one per distinct signature offset
+    ExtensionMap iExtensions;
+    TUint iHeaderBytes;
+};
+
+} // namespace Codec
+} // namespace Media
+} // namespace OpenHome
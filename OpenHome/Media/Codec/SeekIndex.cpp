@@ -0,0 +1,97 @@
+#include <OpenHome/Media/Codec/SeekIndex.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Private/Standard.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::Media;
+using namespace OpenHome::Media::Codec;
+
+
+// SeekIndex
+
+SeekIndex::SeekIndex(TUint aMaxEntries)
+    : iMaxEntries(aMaxEntries)
+    , iGranularity(1)
+{
+    ASSERT(iMaxEntries >= 2);
+    iEntries.reserve(iMaxEntries + 1);
+}
+
+void SeekIndex::Reset(TUint64 aGranularity)
+{
+    ASSERT(aGranularity > 0);
+    iGranularity = aGranularity;
+    iEntries.clear();
+}
+
+void SeekIndex::Add(TUint64 aSample, TUint64 aOffset)
+{
+    auto it = std::lower_bound(iEntries.begin(), iEntries.end(), aSample, EntryCmp());
+    if (it != iEntries.end() && it->iSample < aSample + iGranularity) {
+        return;
+    }
+    if (it != iEntries.begin() && (it-1)->iSample + iGranularity > aSample) {
+        return;
+    }
+    (void)iEntries.insert(it, Entry(aSample, aOffset));
+    if (iEntries.size() > iMaxEntries) {
+        Thin();
+    }
+}
+
+TBool SeekIndex::TryFind(TUint64 aSample, TUint64 aMaxDistance, TUint64& aSampleFound, TUint64& aOffset) const
+{
+    auto it = std::lower_bound(iEntries.begin(), iEntries.end(), aSample, EntryCmp());
+    if (it == iEntries.end() || it->iSample != aSample) {
+        if (it == iEntries.begin()) {
+            return false;
+        }
+        --it;
+    }
+    if (aSample - it->iSample > aMaxDistance) {
+        return false;
+    }
+    aSampleFound = it->iSample;
+    aOffset = it->iOffset;
+    return true;
+}
+
+TUint SeekIndex::Count() const
+{
+    return (TUint)iEntries.size();
+}
+
+TUint64 SeekIndex::Granularity() const
+{
+    return iGranularity;
+}
+
+void SeekIndex::Thin()
+{
+    TUint j = 0;
+    for (TUint i=0; i<iEntries.size(); i+=2) {
+        iEntries[j++] = iEntries[i];
+    }
+    iEntries.resize(j, Entry(0, 0));
+    iGranularity *= 2;
+}
+
+
+// SeekIndex::Entry
+
+SeekIndex::Entry::Entry(TUint64 aSample, TUint64 aOffset)
+    : iSample(aSample)
+    , iOffset(aOffset)
+{
+}
+
+
+// SeekIndex::EntryCmp
+
+TBool SeekIndex::EntryCmp::operator()(const Entry& aEntry, TUint64 aSample) const
+{
+    return aEntry.iSample < aSample;
+}
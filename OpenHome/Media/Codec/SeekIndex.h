@@ -0,0 +1,63 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Private/Standard.h>
+
+#include <vector>
+
+namespace OpenHome {
+namespace Media {
+namespace Codec {
+
+/*
+Map from sample number to the byte offset of a frame that starts at that sample.
+
+Codecs add entries for frames as they decode them (and for any seek points the stream
+describes itself) so that a later seek into audio that has already been played can move
+straight to a nearby frame with a single call to ICodecController::TrySeekTo() rather than
+estimating a position or searching the stream.
+
+Entries are kept at least Granularity() samples apart.  When the index is full, every other
+entry is dropped and the granularity doubles, so memory use is bounded for any stream length.
+*/
+
+class SeekIndex : private INonCopyable
+{
+public:
+    static const TUint kMaxEntriesDefault = 4096;
+public:
+    SeekIndex(TUint aMaxEntries = kMaxEntriesDefault);
+    void Reset(TUint64 aGranularity); // removes all entries.  aGranularity is in samples
+    void Add(TUint64 aSample, TUint64 aOffset);
+    /*
+     * Finds the entry with the highest sample that is <= aSample.
+     * Returns false if there is no such entry or it is more than aMaxDistance samples before aSample.
+     */
+    TBool TryFind(TUint64 aSample, TUint64 aMaxDistance, TUint64& aSampleFound, TUint64& aOffset) const;
+    TUint Count() const;
+    TUint64 Granularity() const;
+private:
+    void Thin();
+private:
+    class Entry
+    {
+    public:
+        Entry(TUint64 aSample, TUint64 aOffset);
+    public:
+        TUint64 iSample;
+        TUint64 iOffset;
+    };
+    class EntryCmp
+    {
+    public:
+        TBool operator()(const Entry& aEntry, TUint64 aSample) const;
+    };
+private:
+    const TUint iMaxEntries;
+    TUint64 iGranularity;
+    std::vector<Entry> iEntries; // sorted by iSample
+};
+
+} // namespace Codec
+} // namespace Media
+} // namespace OpenHome
@@ -9,6 +9,7 @@
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Media/Debug.h>
 #include <OpenHome/Media/MimeTypeList.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
 
 extern "C" {
 #include <ivorbisfile.h>
@@ -16,6 +17,7 @@ extern "C" {
 }
 
 #include <limits>
+#include <string.h>
 
 namespace OpenHome {
 namespace Media {
@@ -206,6 +208,9 @@ CodecVorbis::CodecVorbis(IMimeTypeList& aMimeTypeList)
     aMimeTypeList.Add("audio/ogg");
     aMimeTypeList.Add("audio/x-ogg");
     aMimeTypeList.Add("application/ogg");
+    AddRecognitionSignature(Brn("\x01vorbis"), 28); // identification header following first page header
+    AddRecognitionExtension("ogg");
+    AddRecognitionExtension("oga");
 }
 
 CodecVorbis::~CodecVorbis()
@@ -420,10 +425,12 @@ TUint64 CodecVorbis::GetTotalSamples()
 // copy audio data to output buffer, converting to big endian if required.
 void CodecVorbis::BigEndian(TInt16* aDst, TInt16* aSrc, TUint aSamples)
 {
-    aSamples *= iChannels;
-    while(aSamples--) {
-        *aDst++ = Arch::BigEndian2(*aSrc++);
-    }
+    // ov_read() output is native endian
+#ifdef DEFINE_BIG_ENDIAN
+    (void)memcpy(aDst, aSrc, aSamples * iChannels * sizeof(TInt16));
+#else
+    PcmConverter::SwapEndian16(reinterpret_cast<TByte*>(aDst), reinterpret_cast<const TByte*>(aSrc), aSamples * iChannels);
+#endif
 }
 
 void CodecVorbis::Process()
@@ -66,6 +66,8 @@ CodecWav::CodecWav(IMimeTypeList& aMimeTypeList)
     aMimeTypeList.Add("audio/wav");
     aMimeTypeList.Add("audio/wave");
     aMimeTypeList.Add("audio/x-wav");
+    AddRecognitionSignature(Brn("WAVE"), 8);
+    AddRecognitionExtension("wav");
 }
 
 CodecWav::~CodecWav()
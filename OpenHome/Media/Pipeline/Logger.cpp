@@ -2,6 +2,7 @@
 #include <OpenHome/Types.h>
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Media/Pipeline/PipelineTracer.h>
 
 using namespace OpenHome;
 using namespace OpenHome::Media;
@@ -19,6 +20,11 @@ Logger::Logger(IPipelineElementUpstream& aUpstreamElement, const TChar* aId)
     , iEnabled(false)
     , iFilter(EMsgAll)
     , iShutdownSem("PDSD", 0)
+    , iQuit(false)
+    , iTracer(nullptr)
+    , iTraceId(0)
+    , iTraceJiffies(0)
+    , iTraceLastPushUs(0)
 {
 }
 
@@ -29,6 +35,11 @@ Logger::Logger(const TChar* aId, IPipelineElementDownstream& aDownstreamElement)
     , iEnabled(false)
     , iFilter(EMsgAll)
     , iShutdownSem("PDSD", 0)
+    , iQuit(false)
+    , iTracer(nullptr)
+    , iTraceId(0)
+    , iTraceJiffies(0)
+    , iTraceLastPushUs(0)
 {
 }
 
@@ -47,15 +58,37 @@ void Logger::SetFilter(TUint aMsgTypes)
     iFilter = aMsgTypes;
 }
 
+void Logger::SetTracer(PipelineTracer& aTracer)
+{
+    iTracer = &aTracer;
+    iTraceId = aTracer.AddElement(iId);
+}
+
+void Logger::SetTracer(PipelineTracer& aTracer, FunctorGeneric<TUint&> aLevel, const TChar* aLevelUnits)
+{
+    iTracer = &aTracer;
+    iTraceId = aTracer.AddElement(iId, aLevel, aLevelUnits);
+}
+
 Msg* Logger::Pull()
 {
+    const TBool tracing = (iTracer != nullptr && iTracer->Enabled());
+    const TUint64 start = (tracing? PipelineTracer::NowUs() : 0);
     Msg* msg = iUpstreamElement->Pull();
     if (msg == nullptr) {
         Log::Print("Pipeline (%s): nullptr\n", iId);
     }
     else {
         ASSERT_DEBUG(msg->iRefCount > 0);
+        iTraceJiffies = 0;
         (void)msg->Process(*this);
+        if (tracing) {
+            const TUint64 now = PipelineTracer::NowUs();
+            iTracer->Trace(iTraceId, *msg, PipelineTracer::ECallPull, now, (TUint)(now - start), iTraceJiffies);
+        }
+        if (iQuit) {
+            iShutdownSem.Signal();
+        }
     }
     return msg;
 }
@@ -63,8 +96,25 @@ Msg* Logger::Pull()
 void Logger::Push(Msg* aMsg)
 {
     ASSERT(aMsg != nullptr);
+    iTraceJiffies = 0;
     (void)aMsg->Process(*this);
+    const TBool tracing = (iTracer != nullptr && iTracer->Enabled());
+    TUint64 start = 0;
+    if (tracing) {
+        // aMsg may be consumed downstream before Push() returns so has to be traced first
+        start = PipelineTracer::NowUs();
+        iTracer->Trace(iTraceId, *aMsg, PipelineTracer::ECallPush, start, iTraceLastPushUs, iTraceJiffies);
+    }
+    if (iQuit) {
+        IPipelineElementDownstream* downstream = iDownstreamElement;
+        iShutdownSem.Signal();
+        downstream->Push(aMsg);
+        return;
+    }
     iDownstreamElement->Push(aMsg);
+    if (tracing) {
+        iTraceLastPushUs = (TUint)(PipelineTracer::NowUs() - start);
+    }
 }
 
 Msg* Logger::ProcessMsg(MsgMode* aMsg)
@@ -212,6 +262,7 @@ Msg* Logger::ProcessMsg(MsgBitRate* aMsg)
 
 Msg* Logger::ProcessMsg(MsgAudioPcm* aMsg)
 {
+    iTraceJiffies = aMsg->Jiffies();
     if (IsEnabled(EMsgAudioPcm) ||
         (IsEnabled(EMsgAudioRamped) && aMsg->Ramp().IsEnabled())) {
         iBuf.SetBytes(0);
@@ -225,6 +276,7 @@ Msg* Logger::ProcessMsg(MsgAudioPcm* aMsg)
 
 Msg* Logger::ProcessMsg(MsgSilence* aMsg)
 {
+    iTraceJiffies = aMsg->Jiffies();
     if (IsEnabled(EMsgSilence) ||
         (IsEnabled(EMsgAudioRamped) && aMsg->Ramp().IsEnabled())) {
         iBuf.SetBytes(0);
@@ -254,7 +306,7 @@ Msg* Logger::ProcessMsg(MsgQuit* aMsg)
     if (IsEnabled(EMsgQuit)) {
         Log::Print("Pipeline (%s): quit\n", iId);
     }
-    iShutdownSem.Signal();
+    iQuit = true; // iShutdownSem signalled once we've finished accessing members
     return aMsg;
 }
 
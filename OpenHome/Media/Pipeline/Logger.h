@@ -1,15 +1,19 @@
 #pragma once
 
 #include <OpenHome/Types.h>
+#include <OpenHome/Functor.h>
 #include <OpenHome/Private/Standard.h>
 #include <OpenHome/Media/Pipeline/Msg.h>
 
 namespace OpenHome {
 namespace Media {
 
+class PipelineTracer;
+
 /*
 Element which logs msgs as they pass through.
 Can be inserted [0..n] times through the pipeline, depending on your debugging needs.
+Also reports each msg to an optional PipelineTracer.
 */
 
 class Logger : public IPipelineElementUpstream, public IPipelineElementDownstream, private IMsgProcessor, private INonCopyable
@@ -44,6 +48,8 @@ public:
     virtual ~Logger();
     void SetEnabled(TBool aEnabled);
     void SetFilter(TUint aMsgTypes);
+    void SetTracer(PipelineTracer& aTracer);
+    void SetTracer(PipelineTracer& aTracer, FunctorGeneric<TUint&> aLevel, const TChar* aLevelUnits);
 public: // from IPipelineElementUpstream
     Msg* Pull() override;
 public: // from IPipelineElementDownstream
@@ -76,7 +82,12 @@ private:
     TBool iEnabled;
     TInt iFilter;
     Semaphore iShutdownSem;
+    TBool iQuit;
     Bws<kMaxLogBytes> iBuf;
+    PipelineTracer* iTracer;
+    TUint iTraceId;
+    TUint iTraceJiffies;
+    TUint iTraceLastPushUs;
 };
 
 } // namespace Media
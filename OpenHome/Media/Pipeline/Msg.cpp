@@ -8,6 +8,7 @@
 #include <OpenHome/Private/Thread.h>
 #include <OpenHome/Private/Arch.h>
 #include <OpenHome/Media/ClockPuller.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Private/Debug.h>
 #include <OpenHome/Media/Debug.h>
@@ -16,6 +17,14 @@
 #include <climits>
 #include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define RAMP_APPLICATOR_SSE2
+# include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+# define RAMP_APPLICATOR_NEON
+# include <arm_neon.h>
+#endif
+
 using namespace OpenHome;
 using namespace OpenHome::Media;
 
@@ -27,7 +36,13 @@ const Brn AllocatorBase::kQueryMemory = Brn("memory");
 
 AllocatorBase::~AllocatorBase()
 {
-    LOG(kPipeline, "> ~AllocatorBase for %s. (Peak %u/%u)\n", iName, iCellsUsedMax, iFree.Slots());
+    LOG(kPipeline, "> ~AllocatorBase for %s. (Peak %u/%u)\n", iName, iCellsUsedMax.load(), iFree.Slots());
+    if (iMagazines != nullptr) {
+        for (TUint i=0; i<kNumMagazines; i++) {
+            FlushMagazine(iMagazines[i], iMagazines[i].iCount);
+        }
+        delete[] iMagazines;
+    }
     const TUint slots = iFree.Slots();
     for (TUint i=0; i<slots; i++) {
         //Log::Print("  %u", i);
@@ -40,52 +55,47 @@ AllocatorBase::~AllocatorBase()
 
 void AllocatorBase::Free(Allocated* aPtr)
 {
+    iCellsUsed.fetch_sub(1, std::memory_order_relaxed);
+    if (iMagazines != nullptr) {
+        Magazine& magazine = iMagazines[MagazineIndex()];
+        AutoMutex _(magazine.iLock);
+        if (magazine.iCount == kMagazineCells) {
+            FlushMagazine(magazine, kMagazineBatch);
+        }
+        magazine.iCells[magazine.iCount++] = aPtr;
+        return;
+    }
     iLock.Wait();
-    iCellsUsed--;
     iFree.Write(aPtr);
     iLock.Signal();
 }
 
 TUint AllocatorBase::CellsTotal() const
 {
-    iLock.Wait();
-    TUint cellsTotal = iCellsTotal;
-    iLock.Signal();
-    return cellsTotal;
+    return iCellsTotal;
 }
 
 TUint AllocatorBase::CellBytes() const
 {
-    iLock.Wait();
-    TUint cellBytes = iCellBytes;
-    iLock.Signal();
-    return cellBytes;
+    return iCellBytes;
 }
 
 TUint AllocatorBase::CellsUsed() const
 {
-    iLock.Wait();
-    TUint cellsUsed = iCellsUsed;
-    iLock.Signal();
-    return cellsUsed;
+    return iCellsUsed.load(std::memory_order_relaxed);
 }
 
 TUint AllocatorBase::CellsUsedMax() const
 {
-    iLock.Wait();
-    TUint cellsUsedMax = iCellsUsedMax;
-    iLock.Signal();
-    return cellsUsedMax;
+    return iCellsUsedMax.load(std::memory_order_relaxed);
 }
 
 void AllocatorBase::GetStats(TUint& aCellsTotal, TUint& aCellBytes, TUint& aCellsUsed, TUint& aCellsUsedMax) const
 {
-    iLock.Wait();
     aCellsTotal = iCellsTotal;
     aCellBytes = iCellBytes;
-    aCellsUsed = iCellsUsed;
-    aCellsUsedMax = iCellsUsedMax;
-    iLock.Signal();
+    aCellsUsed = iCellsUsed.load(std::memory_order_relaxed);
+    aCellsUsedMax = iCellsUsedMax.load(std::memory_order_relaxed);
 }
 
 AllocatorBase::AllocatorBase(const TChar* aName, TUint aNumCells, TUint aCellBytes, IInfoAggregator& aInfoAggregator)
@@ -96,7 +106,11 @@ AllocatorBase::AllocatorBase(const TChar* aName, TUint aNumCells, TUint aCellByt
     , iCellBytes(aCellBytes)
     , iCellsUsed(0)
     , iCellsUsedMax(0)
+    , iMagazines(nullptr)
 {
+    if (aNumCells >= kMinCellsForMagazines) {
+        iMagazines = new Magazine[kNumMagazines];
+    }
     std::vector<Brn> infoQueries;
     infoQueries.push_back(kQueryMemory);
     aInfoAggregator.Register(*this, infoQueries);
@@ -104,15 +118,30 @@ AllocatorBase::AllocatorBase(const TChar* aName, TUint aNumCells, TUint aCellByt
 
 Allocated* AllocatorBase::DoAllocate()
 {
-    iLock.Wait();
-    Allocated* cell = Read();
-    ASSERT_DEBUG(cell->iRefCount == 0);
-    cell->iRefCount = 1;
-    iCellsUsed++;
-    if (iCellsUsed > iCellsUsedMax) {
-        iCellsUsedMax = iCellsUsed;
+    Allocated* cell = nullptr;
+    if (iMagazines == nullptr) {
+        iLock.Wait();
+        cell = Read();
+        iLock.Signal();
     }
-    iLock.Signal();
+    else {
+        Magazine& magazine = iMagazines[MagazineIndex()];
+        magazine.iLock.Wait();
+        if (magazine.iCount == 0) {
+            RefillMagazine(magazine);
+        }
+        if (magazine.iCount > 0) {
+            cell = magazine.iCells[--magazine.iCount];
+        }
+        magazine.iLock.Signal();
+        if (cell == nullptr) {
+            cell = Steal();
+        }
+    }
+    ASSERT_DEBUG(cell->iRefCount == 0);
+    cell->iRefCount.store(1, std::memory_order_relaxed);
+    cell->iTraceTimeUs = 0;
+    CellAllocated();
     return cell;
 }
 
@@ -129,10 +158,79 @@ Allocated* AllocatorBase::Read()
     return p;
 }
 
+Allocated* AllocatorBase::Steal()
+{
+    /* Shared list and our own magazine are both empty.  Any remaining free cells are
+       cached by other threads.  Hold every magazine lock (in index order, then iLock -
+       the same order Free/DoAllocate use) for the whole scan so a cell can't be freed
+       into a magazine we've already checked before we conclude all cells are in use. */
+    for (TUint i=0; i<kNumMagazines; i++) {
+        iMagazines[i].iLock.Wait();
+    }
+    iLock.Wait();
+    Allocated* cell = nullptr;
+    if (iFree.SlotsUsed() > 0) {
+        cell = iFree.Read();
+    }
+    else {
+        for (TUint i=0; i<kNumMagazines; i++) {
+            Magazine& magazine = iMagazines[i];
+            if (magazine.iCount > 0) {
+                cell = magazine.iCells[--magazine.iCount];
+                break;
+            }
+        }
+    }
+    if (cell == nullptr) {
+        cell = Read(); // asserts - all cells are in use
+    }
+    iLock.Signal();
+    for (TUint i=0; i<kNumMagazines; i++) {
+        iMagazines[i].iLock.Signal();
+    }
+    return cell;
+}
+
+void AllocatorBase::RefillMagazine(Magazine& aMagazine)
+{
+    // called with aMagazine.iLock held
+    AutoMutex _(iLock);
+    TUint count = iFree.SlotsUsed();
+    if (count > kMagazineBatch) {
+        count = kMagazineBatch;
+    }
+    for (TUint i=0; i<count; i++) {
+        aMagazine.iCells[aMagazine.iCount++] = iFree.Read();
+    }
+}
+
+void AllocatorBase::FlushMagazine(Magazine& aMagazine, TUint aCount)
+{
+    // called with aMagazine.iLock held (or from the destructor)
+    AutoMutex _(iLock);
+    for (TUint i=0; i<aCount; i++) {
+        iFree.Write(aMagazine.iCells[--aMagazine.iCount]);
+    }
+}
+
+void AllocatorBase::CellAllocated()
+{
+    const TUint used = iCellsUsed.fetch_add(1, std::memory_order_relaxed) + 1;
+    TUint max = iCellsUsedMax.load(std::memory_order_relaxed);
+    while (used > max && !iCellsUsedMax.compare_exchange_weak(max, used, std::memory_order_relaxed)) {
+    }
+}
+
+TUint AllocatorBase::MagazineIndex()
+{
+    static std::atomic<TUint> nextIndex(0);
+    static thread_local TUint index = nextIndex.fetch_add(1, std::memory_order_relaxed) % kNumMagazines;
+    return index;
+}
+
 void AllocatorBase::QueryInfo(const Brx& aQuery, IWriter& aWriter)
 {
     // Note that value of iCellsUsed may be slightly out of date as Allocator doesn't hold any lock while updating its fifo and iCellsUsed
-    AutoMutex a(iLock);
     if (aQuery == kQueryMemory) {
         WriterAscii writer(aWriter);
         writer.Write(Brn("Allocator: "));
@@ -142,30 +240,35 @@ void AllocatorBase::QueryInfo(const Brx& aQuery, IWriter& aWriter)
         writer.Write(Brn(" cells x "));
         writer.WriteUint(iCellBytes);
         writer.Write(Brn(" bytes, in use:"));
-        writer.WriteUint(iCellsUsed);
+        writer.WriteUint(iCellsUsed.load(std::memory_order_relaxed));
         writer.Write(Brn(" cells, peak:"));
-        writer.WriteUint(iCellsUsedMax);
+        writer.WriteUint(iCellsUsedMax.load(std::memory_order_relaxed));
         aWriter.Write(Brn(" cells\n"));
     }
 }
 
 
+// AllocatorBase::Magazine
+
+AllocatorBase::Magazine::Magazine()
+    : iLock("PALM")
+    , iCount(0)
+{
+}
+
+
 // Allocated
 
 void Allocated::AddRef()
 {
-    iLock.Wait();
-    iRefCount++;
-    iLock.Signal();
+    iRefCount.fetch_add(1, std::memory_order_relaxed);
     RefAdded();
 }
 
 void Allocated::RemoveRef()
 {
     ASSERT_DEBUG(iRefCount != 0);
-    iLock.Wait();
-    TBool free = (--iRefCount == 0);
-    iLock.Signal();
+    const TBool free = (iRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1);
     RefRemoved();
     if (free) {
         Clear();
@@ -189,6 +292,7 @@ Allocated::Allocated(AllocatorBase& aAllocator)
     : iAllocator(aAllocator)
     , iLock("ALOC")
     , iRefCount(0)
+    , iTraceTimeUs(0)
 {
 }
 
@@ -201,22 +305,33 @@ Allocated::~Allocated()
 
 EncodedAudio::EncodedAudio(AllocatorBase& aAllocator)
     : Allocated(aAllocator)
+    , iSource(nullptr)
 {
 }
 
 const TByte* EncodedAudio::Ptr(TUint aBytes) const
 {
+    if (iSource != nullptr) {
+        ASSERT(aBytes < iSourceData.Bytes());
+        return iSourceData.Ptr() + aBytes;
+    }
     ASSERT(aBytes < iData.Bytes());
     return iData.Ptr() + aBytes;
 }
 
 TUint EncodedAudio::Bytes() const
 {
+    if (iSource != nullptr) {
+        return iSourceData.Bytes();
+    }
     return iData.Bytes();
 }
 
 TUint EncodedAudio::Append(const Brx& aData)
 {
+    if (iSource != nullptr) {
+        return 0; // source data is read-only
+    }
     const TUint avail = iData.MaxBytes() - iData.Bytes();
     if (avail < aData.Bytes()) {
         Brn data(aData.Ptr(), avail);
@@ -232,6 +347,14 @@ void EncodedAudio::Construct(const Brx& aData)
     ASSERT(Append(aData) == aData.Bytes());
 }
 
+void EncodedAudio::Construct(IEncodedAudioSource& aSource, const Brx& aData)
+{
+    ASSERT(aData.Bytes() <= kMaxBytes);
+    iSource = &aSource;
+    iSource->AddRef();
+    iSourceData.Set(aData);
+}
+
 void EncodedAudio::Clear()
 {
 #ifdef DEFINE_DEBUG
@@ -240,6 +363,11 @@ void EncodedAudio::Clear()
     memset(const_cast<TByte*>(iData.Ptr()), deadByte, iData.Bytes());
 #endif // DEFINE_DEBUG
     iData.SetBytes(0);
+    if (iSource != nullptr) {
+        iSource->RemoveRef();
+        iSource = nullptr;
+        iSourceData.Set(nullptr, 0);
+    }
 }
 
     
@@ -402,6 +530,11 @@ void DecodedAudio::Aggregate(DecodedAudio& aDecodedAudio)
     iSubsampleCount += aDecodedAudio.Bytes() / iByteDepth;
 }
 
+TByte* DecodedAudio::WritePtr()
+{
+    return iData;
+}
+
 void DecodedAudio::Construct(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian)
 {
     iChannels = aChannels;
@@ -433,23 +566,29 @@ void DecodedAudio::Construct(const Brx& aData, TUint aChannels, TUint aSampleRat
     }*/
 }
 
+void DecodedAudio::Construct(TUint aBytes, TUint aChannels, TUint aSampleRate, TUint aBitDepth)
+{
+    // audio has already been written (in big endian form) via WritePtr()
+    iChannels = aChannels;
+    iSampleRate = aSampleRate;
+    iBitDepth = aBitDepth;
+    iByteDepth = iBitDepth/8;
+    iJiffiesPerSample = Jiffies::JiffiesPerSample(aSampleRate);
+
+    ASSERT(aBitDepth == 8 || aBitDepth == 16 || aBitDepth == 24);
+    ASSERT(aBytes % (iByteDepth * aChannels) == 0);
+    ASSERT(aBytes <= kMaxBytes);
+    iSubsampleCount = aBytes / iByteDepth;
+}
+
 void DecodedAudio::CopyToBigEndian16(const Brx& aData)
 {
-    const TByte* src = aData.Ptr();
-    for (TUint i=0; i<aData.Bytes(); i+=2) {
-        iData[i]   = src[i+1];
-        iData[i+1] = src[i];
-    }
+    PcmConverter::SwapEndian16(iData, aData.Ptr(), aData.Bytes() / 2);
 }
 
 void DecodedAudio::CopyToBigEndian24(const Brx& aData)
 {
-    const TByte* src = aData.Ptr();
-    for (TUint i=0; i<aData.Bytes(); i+=3) {
-        iData[i]   = src[i+2];
-        iData[i+1] = src[i+1];
-        iData[i+2] = src[i];
-    }
+    PcmConverter::SwapEndian24(iData, aData.Ptr(), aData.Bytes() / 3);
 }
 
 void DecodedAudio::Clear()
@@ -799,6 +938,179 @@ void RampApplicator::GetNextSample(TByte* aDest)
     iLoopCount++;
 }
 
+TUint RampApplicator::GetNextBlock(TByte* aDest)
+{
+    ASSERT_DEBUG(iPtr != nullptr);
+    const TUint numSamples = std::min(iNumSamples - iLoopCount, kMaxBlockSamples);
+    if (numSamples == 0) {
+        return 0;
+    }
+
+    /* Build the gain curve for this block, one entry per subsample.
+       GetNextSample calculates ramp as Start - (loopCount * totalRamp) / (numSamples-1) for every sample.
+       We avoid a 64-bit divide per sample by stepping the quotient and remainder of that expression,
+       which gives identical (truncated towards zero) values. */
+    TUint32* gains = iGains;
+    if (iNumSamples == 1) {
+        const TUint gain = GainFromRampIndex((iFullRampSpan - iRamp.Start() + (1<<20)) >> 21);
+        for (TUint i=0; i<iNumChannels; i++) {
+            *gains++ = gain;
+        }
+    }
+    else {
+        const TUint divisor = iNumSamples - 1;
+        const TBool rampDown = (iTotalRamp >= 0);
+        const TUint64 totalRamp = (rampDown? (TUint64)iTotalRamp : (TUint64)(-(TInt64)iTotalRamp));
+        const TUint64 stepQuot = totalRamp / divisor;
+        const TUint stepRem = (TUint)(totalRamp % divisor);
+        const TUint64 offset = iLoopCount * totalRamp;
+        TUint64 quot = offset / divisor;
+        TUint rem = (TUint)(offset % divisor);
+        for (TUint i=0; i<numSamples; i++) {
+            const TUint ramp = (TUint)(rampDown? iRamp.Start() - quot : iRamp.Start() + quot);
+            const TUint gain = GainFromRampIndex((iFullRampSpan - ramp + (1<<20)) >> 21);
+            for (TUint j=0; j<iNumChannels; j++) {
+                *gains++ = gain;
+            }
+            quot += stepQuot;
+            rem += stepRem;
+            if (rem >= divisor) {
+                rem -= divisor;
+                quot++;
+            }
+        }
+    }
+
+    const TUint numSubsamples = numSamples * iNumChannels;
+    switch (iBitDepth)
+    {
+    case 8:
+        ApplyGain8(iPtr, aDest, iGains, numSubsamples);
+        break;
+    case 16:
+        ApplyGain16(iPtr, aDest, iGains, numSubsamples);
+        break;
+    case 24:
+        ApplyGain24(iPtr, aDest, iGains, numSubsamples);
+        break;
+    default:
+        ASSERTS();
+    }
+    iPtr += numSubsamples * (iBitDepth/8);
+    iLoopCount += numSamples;
+    return numSamples;
+}
+
+inline TUint RampApplicator::GainFromRampIndex(TUint aRampIndex)
+{
+    return (aRampIndex == kRampArrayCount? 0 : kRampArray[aRampIndex]);
+}
+
+/* Each ApplyGain function calculates ((TInt64)subsample * gain) >> 31 for every (big endian) subsample.
+   This matches GetNextSample, which applies the same calculation to subsamples shifted to the top of a TInt
+   then shifts the result back down. */
+
+void RampApplicator::ApplyGain8(const TByte* aSrc, TByte* aDest, const TUint32* aGains, TUint aNumSubsamples)
+{
+    for (TUint i=0; i<aNumSubsamples; i++) {
+        const TInt subsample = ((TInt)((TUint)aSrc[i] << 24)) >> 24;
+        aDest[i] = (TByte)(((TInt64)subsample * aGains[i]) >> 31);
+    }
+}
+
+void RampApplicator::ApplyGain16(const TByte* aSrc, TByte* aDest, const TUint32* aGains, TUint aNumSubsamples)
+{
+    TUint i = 0;
+#if defined(RAMP_APPLICATOR_SSE2)
+    /* SSE2 has no signed 32x32 multiply so split each gain into high/low 16-bit halves:
+       (s * g) >> 31 == ((s * gHigh) + ((s * gLowUnsigned) >> 16)) >> 15 */
+    for (; i+8<=aNumSubsamples; i+=8) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + 2*i));
+        s = _mm_or_si128(_mm_slli_epi16(s, 8), _mm_srli_epi16(s, 8));
+        const __m128i g0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aGains + i));
+        const __m128i g1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aGains + i + 4));
+        const __m128i gHigh = _mm_packs_epi32(_mm_srli_epi32(g0, 16), _mm_srli_epi32(g1, 16));
+        const __m128i gLow = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(g0, 16), 16),
+                                             _mm_srai_epi32(_mm_slli_epi32(g1, 16), 16));
+        const __m128i prodLo = _mm_mullo_epi16(s, gHigh);
+        const __m128i prodHi = _mm_mulhi_epi16(s, gHigh);
+        // gLow is signed in the multiply below; add s back in for lanes where its top bit was set
+        const __m128i low = _mm_add_epi16(_mm_mulhi_epi16(s, gLow), _mm_and_si128(s, _mm_srai_epi16(gLow, 15)));
+        __m128i r0 = _mm_add_epi32(_mm_unpacklo_epi16(prodLo, prodHi), _mm_srai_epi32(_mm_unpacklo_epi16(low, low), 16));
+        __m128i r1 = _mm_add_epi32(_mm_unpackhi_epi16(prodLo, prodHi), _mm_srai_epi32(_mm_unpackhi_epi16(low, low), 16));
+        r0 = _mm_srai_epi32(r0, 15);
+        r1 = _mm_srai_epi32(r1, 15);
+        __m128i r = _mm_packs_epi32(r0, r1);
+        r = _mm_or_si128(_mm_slli_epi16(r, 8), _mm_srli_epi16(r, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDest + 2*i), r);
+    }
+#elif defined(RAMP_APPLICATOR_NEON)
+    // vqdmulh returns (2 * s * g) >> 32, which is (s * g) >> 31 given g is never negative
+    for (; i+8<=aNumSubsamples; i+=8) {
+        const int16x8_t s = vreinterpretq_s16_u8(vrev16q_u8(vld1q_u8(aSrc + 2*i)));
+        const int32x4_t g0 = vreinterpretq_s32_u32(vld1q_u32(aGains + i));
+        const int32x4_t g1 = vreinterpretq_s32_u32(vld1q_u32(aGains + i + 4));
+        const int32x4_t r0 = vqdmulhq_s32(vmovl_s16(vget_low_s16(s)), g0);
+        const int32x4_t r1 = vqdmulhq_s32(vmovl_s16(vget_high_s16(s)), g1);
+        const int16x8_t r = vcombine_s16(vmovn_s32(r0), vmovn_s32(r1));
+        vst1q_u8(aDest + 2*i, vrev16q_u8(vreinterpretq_u8_s16(r)));
+    }
+#endif
+    for (; i<aNumSubsamples; i++) {
+        const TByte* src = aSrc + 2*i;
+        const TInt subsample = (TInt16)((src[0] << 8) | src[1]);
+        const TInt ramped = (TInt)(((TInt64)subsample * aGains[i]) >> 31);
+        TByte* dest = aDest + 2*i;
+        dest[0] = (TByte)(ramped >> 8);
+        dest[1] = (TByte)ramped;
+    }
+}
+
+void RampApplicator::ApplyGain24(const TByte* aSrc, TByte* aDest, const TUint32* aGains, TUint aNumSubsamples)
+{
+    TUint i = 0;
+#if defined(RAMP_APPLICATOR_NEON)
+    for (; i+16<=aNumSubsamples; i+=16) {
+        const uint8x16x3_t src = vld3q_u8(aSrc + 3*i);
+        const uint16x8_t hiMidLow = vorrq_u16(vshll_n_u8(vget_low_u8(src.val[0]), 8), vmovl_u8(vget_low_u8(src.val[1])));
+        const uint16x8_t hiMidHigh = vorrq_u16(vshll_n_u8(vget_high_u8(src.val[0]), 8), vmovl_u8(vget_high_u8(src.val[1])));
+        const uint16x8_t loLow = vmovl_u8(vget_low_u8(src.val[2]));
+        const uint16x8_t loHigh = vmovl_u8(vget_high_u8(src.val[2]));
+        int32x4_t s[4];
+        s[0] = vreinterpretq_s32_u32(vorrq_u32(vshll_n_u16(vget_low_u16(hiMidLow), 16), vshll_n_u16(vget_low_u16(loLow), 8)));
+        s[1] = vreinterpretq_s32_u32(vorrq_u32(vshll_n_u16(vget_high_u16(hiMidLow), 16), vshll_n_u16(vget_high_u16(loLow), 8)));
+        s[2] = vreinterpretq_s32_u32(vorrq_u32(vshll_n_u16(vget_low_u16(hiMidHigh), 16), vshll_n_u16(vget_low_u16(loHigh), 8)));
+        s[3] = vreinterpretq_s32_u32(vorrq_u32(vshll_n_u16(vget_high_u16(hiMidHigh), 16), vshll_n_u16(vget_high_u16(loHigh), 8)));
+        uint16x4_t hiMid[4];
+        uint16x4_t lo[4];
+        for (TUint j=0; j<4; j++) {
+            const int32x4_t g = vreinterpretq_s32_u32(vld1q_u32(aGains + i + 4*j));
+            const int32x4_t r = vqdmulhq_s32(vshrq_n_s32(s[j], 8), g);
+            hiMid[j] = vreinterpret_u16_s16(vshrn_n_s32(r, 8));
+            lo[j] = vreinterpret_u16_s16(vmovn_s32(r));
+        }
+        const uint16x8_t hiMid0 = vcombine_u16(hiMid[0], hiMid[1]);
+        const uint16x8_t hiMid1 = vcombine_u16(hiMid[2], hiMid[3]);
+        uint8x16x3_t dest;
+        dest.val[0] = vcombine_u8(vshrn_n_u16(hiMid0, 8), vshrn_n_u16(hiMid1, 8));
+        dest.val[1] = vcombine_u8(vmovn_u16(hiMid0), vmovn_u16(hiMid1));
+        dest.val[2] = vcombine_u8(vmovn_u16(vcombine_u16(lo[0], lo[1])), vmovn_u16(vcombine_u16(lo[2], lo[3])));
+        vst3q_u8(aDest + 3*i, dest);
+    }
+#endif
+    // No SSE2 path - there's no cheap way to do signed 32x32 multiplies; the scalar loop compiles to a single
+    // 64-bit multiply per subsample on x86 targets.
+    for (; i<aNumSubsamples; i++) {
+        const TByte* src = aSrc + 3*i;
+        const TInt subsample = ((TInt)(((TUint)src[0] << 24) | (src[1] << 16) | (src[2] << 8))) >> 8;
+        const TInt ramped = (TInt)(((TInt64)subsample * aGains[i]) >> 31);
+        TByte* dest = aDest + 3*i;
+        dest[0] = (TByte)(ramped >> 16);
+        dest[1] = (TByte)(ramped >> 8);
+        dest[2] = (TByte)ramped;
+    }
+}
+
  
 // Track
 
@@ -2035,22 +2347,26 @@ void MsgPlayablePcm::ReadBlock(IPcmProcessor& aProcessor)
     const TUint bitDepth = iAudioData->BitDepth();
     const TUint byteDepth = bitDepth / 8;
     if (iRamp.IsEnabled()) {
-        // we need calculate each subsample value when ramped so there is no option to process as a single fragment
-        TByte sample[DecodedAudio::kMaxNumChannels * 3]; // largest possible sample - 24-bit, 8 channel
+        // ramp blocks of samples into a local buffer, passing each on as a fragment
+        TByte block[RampApplicator::kMaxBlockSamples * DecodedAudio::kMaxNumChannels * 3]; // largest possible block - 24-bit, 8 channel
         RampApplicator ra(iRamp);
-        const TUint numSamples = ra.Start(audioBuf, bitDepth, numChannels);
-        for (TUint i=0; i<numSamples; i++) {
-            ra.GetNextSample(sample);
+        (void)ra.Start(audioBuf, bitDepth, numChannels);
+        for (;;) {
+            const TUint numSamples = ra.GetNextBlock(block);
+            if (numSamples == 0) {
+                break;
+            }
+            Brn fragment(block, numSamples * numChannels * byteDepth);
             switch (byteDepth)
             {
             case 1:
-                aProcessor.ProcessSample8(sample, numChannels);
+                aProcessor.ProcessFragment8(fragment, numChannels);
                 break;
             case 2:
-                aProcessor.ProcessSample16(sample, numChannels);
+                aProcessor.ProcessFragment16(fragment, numChannels);
                 break;
             case 3:
-                aProcessor.ProcessSample24(sample, numChannels);
+                aProcessor.ProcessFragment24(fragment, numChannels);
                 break;
             default:
                 ASSERTS();
@@ -2283,11 +2599,135 @@ void MsgQueue::CheckMsgNotQueued(Msg* aMsg) const
 }
 
 
+// MsgQueueSpsc
+
+MsgQueueSpsc::Chunk::Chunk()
+    : iNext(nullptr)
+{
+}
+
+MsgQueueSpsc::MsgQueueSpsc()
+    : iPushedBack(nullptr)
+    , iNumQueued(0)
+    , iNumPushedBack(0)
+    , iSpareChunk(nullptr)
+    , iConsumerWaiting(false)
+    , iSem("MQSP", 0)
+{
+    iTailChunk = iHeadChunk = new Chunk();
+    iTailIndex = iHeadIndex = 0;
+}
+
+MsgQueueSpsc::~MsgQueueSpsc()
+{
+    Clear();
+    ASSERT(iHeadChunk == iTailChunk);
+    delete iHeadChunk;
+    delete iSpareChunk.load();
+}
+
+void MsgQueueSpsc::Enqueue(Msg* aMsg)
+{
+    ASSERT(aMsg != nullptr);
+    if (iTailIndex == kMsgsPerChunk) {
+        Chunk* chunk = AllocateChunk();
+        iTailChunk->iNext.store(chunk, std::memory_order_release);
+        iTailChunk = chunk;
+        iTailIndex = 0;
+    }
+    iTailChunk->iMsgs[iTailIndex++] = aMsg;
+    (void)iNumQueued.fetch_add(1, std::memory_order_seq_cst); // publishes aMsg to the consumer
+    if (iConsumerWaiting.exchange(false, std::memory_order_seq_cst)) {
+        iSem.Signal();
+    }
+}
+
+Msg* MsgQueueSpsc::Dequeue()
+{
+    for (;;) {
+        Msg* msg = TryDequeue();
+        if (msg != nullptr) {
+            return msg;
+        }
+        /* Advertise that we're about to block then re-check for a msg.  Enqueue increments iNumQueued
+           before checking iConsumerWaiting so one of us will always see the other's write.
+           A late Signal() may leave the semaphore with a stray count; this just causes one extra
+           iteration of this loop. */
+        iConsumerWaiting.store(true, std::memory_order_seq_cst);
+        if (iNumQueued.load(std::memory_order_seq_cst) > 0) {
+            iConsumerWaiting.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        iSem.Wait();
+    }
+}
+
+Msg* MsgQueueSpsc::TryDequeue()
+{
+    if (iPushedBack != nullptr) {
+        Msg* msg = iPushedBack;
+        iPushedBack = msg->iNextMsg;
+        msg->iNextMsg = nullptr;
+        (void)iNumPushedBack.fetch_sub(1, std::memory_order_relaxed);
+        return msg;
+    }
+    if (iNumQueued.load(std::memory_order_acquire) == 0) {
+        return nullptr;
+    }
+    if (iHeadIndex == kMsgsPerChunk) {
+        Chunk* chunk = iHeadChunk;
+        iHeadChunk = chunk->iNext.load(std::memory_order_acquire);
+        ASSERT(iHeadChunk != nullptr);
+        iHeadIndex = 0;
+        chunk->iNext.store(nullptr, std::memory_order_relaxed);
+        delete iSpareChunk.exchange(chunk, std::memory_order_acq_rel);
+    }
+    Msg* msg = iHeadChunk->iMsgs[iHeadIndex++];
+    (void)iNumQueued.fetch_sub(1, std::memory_order_release);
+    return msg;
+}
+
+MsgQueueSpsc::Chunk* MsgQueueSpsc::AllocateChunk()
+{
+    Chunk* chunk = iSpareChunk.exchange(nullptr, std::memory_order_acq_rel);
+    if (chunk == nullptr) {
+        chunk = new Chunk();
+    }
+    return chunk;
+}
+
+void MsgQueueSpsc::EnqueueAtHead(Msg* aMsg)
+{
+    ASSERT(aMsg != nullptr);
+    ASSERT(aMsg != iPushedBack);
+    aMsg->iNextMsg = iPushedBack;
+    iPushedBack = aMsg;
+    (void)iNumPushedBack.fetch_add(1, std::memory_order_relaxed);
+}
+
+TBool MsgQueueSpsc::IsEmpty() const
+{
+    return (iNumQueued.load() == 0 && iNumPushedBack.load() == 0);
+}
+
+void MsgQueueSpsc::Clear()
+{
+    Msg* msg;
+    while ((msg = TryDequeue()) != nullptr) {
+        msg->RemoveRef();
+    }
+}
+
+TUint MsgQueueSpsc::NumMsgs() const
+{
+    return iNumQueued.load() + iNumPushedBack.load();
+}
+
+
 // MsgReservoir
 
 MsgReservoir::MsgReservoir()
-    : iLock("MQJF")
-    , iEncodedBytes(0)
+    : iEncodedBytes(0)
     , iJiffies(0)
     , iTrackCount(0)
     , iEncodedStreamCount(0)
@@ -2328,13 +2768,12 @@ void MsgReservoir::EnqueueAtHead(Msg* aMsg)
 
 TUint MsgReservoir::Jiffies() const
 {
-    AutoMutex a(iLock);
-    return iJiffies;
+    return iJiffies.load();
 }
 
 TUint MsgReservoir::EncodedBytes() const
 {
-    return iEncodedBytes;
+    return iEncodedBytes.load();
 }
 
 TBool MsgReservoir::IsEmpty() const
@@ -2344,41 +2783,33 @@ TBool MsgReservoir::IsEmpty() const
 
 TUint MsgReservoir::TrackCount() const
 {
-    AutoMutex a(iLock);
-    return iTrackCount;
+    return iTrackCount.load();
 }
 
 TUint MsgReservoir::EncodedStreamCount() const
 {
-    AutoMutex a(iLock);
-    return iEncodedStreamCount;
+    return iEncodedStreamCount.load();
 }
 
 TUint MsgReservoir::DecodedStreamCount() const
 {
-    AutoMutex a(iLock);
-    return iDecodedStreamCount;
+    return iDecodedStreamCount.load();
 }
 
 TUint MsgReservoir::EncodedAudioCount() const
 {
-    AutoMutex a(iLock);
-    return iEncodedAudioCount;
+    return iEncodedAudioCount.load();
 }
 
-void MsgReservoir::Add(TUint& aValue, TUint aAdded)
-{
-    iLock.Wait();
-    aValue += aAdded;
-    iLock.Signal();
+void MsgReservoir::Add(std::atomic<TUint>& aValue, TUint aAdded)
+{ // static
+    (void)aValue.fetch_add(aAdded);
 }
 
-void MsgReservoir::Remove(TUint& aValue, TUint aRemoved)
-{
-    iLock.Wait();
-    ASSERT(aValue >= aRemoved);
-    aValue -= aRemoved;
-    iLock.Signal();
+void MsgReservoir::Remove(std::atomic<TUint>& aValue, TUint aRemoved)
+{ // static
+    const TUint prev = aValue.fetch_sub(aRemoved);
+    ASSERT(prev >= aRemoved);
 }
 
 void MsgReservoir::ProcessMsgIn(MsgMode* /*aMsg*/)              { }
@@ -2427,9 +2858,7 @@ Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgMode* aMsg)               { r
 
 Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgTrack* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iTrackCount++;
-    iQueue.iLock.Signal();
+    MsgReservoir::Add(iQueue.iTrackCount, 1);
     return aMsg;
 }
 
@@ -2438,18 +2867,14 @@ Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgDelay* aMsg)              { r
 
 Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgEncodedStream* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iEncodedStreamCount++;
-    iQueue.iLock.Signal();
+    MsgReservoir::Add(iQueue.iEncodedStreamCount, 1);
     return aMsg;
 }
 
 Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgAudioEncoded* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iEncodedAudioCount++;
-    iQueue.iLock.Signal();
-    iQueue.Add(iQueue.iEncodedBytes, aMsg->Bytes());
+    MsgReservoir::Add(iQueue.iEncodedAudioCount, 1);
+    MsgReservoir::Add(iQueue.iEncodedBytes, aMsg->Bytes());
     return aMsg;
 }
 
@@ -2461,9 +2886,7 @@ Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgWait* aMsg)               { r
 
 Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgDecodedStream* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iDecodedStreamCount++;
-    iQueue.iLock.Signal();
+    MsgReservoir::Add(iQueue.iDecodedStreamCount, 1);
     return aMsg;
 }
 
@@ -2471,13 +2894,13 @@ Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgBitRate* aMsg)            { r
 
 Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgAudioPcm* aMsg)
 {
-    iQueue.Add(iQueue.iJiffies, aMsg->Jiffies());
+    MsgReservoir::Add(iQueue.iJiffies, aMsg->Jiffies());
     return aMsg;
 }
 
 Msg* MsgReservoir::ProcessorEnqueue::ProcessMsg(MsgSilence* aMsg)
 {
-    iQueue.Add(iQueue.iJiffies, aMsg->Jiffies());
+    MsgReservoir::Add(iQueue.iJiffies, aMsg->Jiffies());
     return aMsg;
 }
 
@@ -2620,9 +3043,7 @@ Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgMode* aMsg)
 
 Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgTrack* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iTrackCount--;
-    iQueue.iLock.Signal();
+    MsgReservoir::Remove(iQueue.iTrackCount, 1);
     return iQueue.ProcessMsgOut(aMsg);
 }
 
@@ -2638,18 +3059,14 @@ Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgDelay* aMsg)
 
 Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgEncodedStream* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iEncodedStreamCount--;
-    iQueue.iLock.Signal();
+    MsgReservoir::Remove(iQueue.iEncodedStreamCount, 1);
     return iQueue.ProcessMsgOut(aMsg);
 }
 
 Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgAudioEncoded* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iEncodedAudioCount--;
-    iQueue.iLock.Signal();
-    iQueue.Remove(iQueue.iEncodedBytes, aMsg->Bytes());
+    MsgReservoir::Remove(iQueue.iEncodedAudioCount, 1);
+    MsgReservoir::Remove(iQueue.iEncodedBytes, aMsg->Bytes());
     return iQueue.ProcessMsgOut(aMsg);
 }
 
@@ -2680,9 +3097,7 @@ Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgWait* aMsg)
 
 Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgDecodedStream* aMsg)
 {
-    iQueue.iLock.Wait();
-    iQueue.iDecodedStreamCount--;
-    iQueue.iLock.Signal();
+    MsgReservoir::Remove(iQueue.iDecodedStreamCount, 1);
     return iQueue.ProcessMsgOut(aMsg);
 }
 
@@ -2693,13 +3108,13 @@ Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgBitRate* aMsg)
 
 Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgAudioPcm* aMsg)
 {
-    iQueue.Remove(iQueue.iJiffies, aMsg->Jiffies());
+    MsgReservoir::Remove(iQueue.iJiffies, aMsg->Jiffies());
     return iQueue.ProcessMsgOut(aMsg);
 }
 
 Msg* MsgReservoir::ProcessorQueueOut::ProcessMsg(MsgSilence* aMsg)
 {
-    iQueue.Remove(iQueue.iJiffies, aMsg->Jiffies());
+    MsgReservoir::Remove(iQueue.iJiffies, aMsg->Jiffies());
     return iQueue.ProcessMsgOut(aMsg);
 }
 
@@ -2955,6 +3370,14 @@ MsgAudioEncoded* MsgFactory::CreateMsgAudioEncoded(const Brx& aData)
     return msg;
 }
 
+MsgAudioEncoded* MsgFactory::CreateMsgAudioEncoded(IEncodedAudioSource& aSource, const Brx& aData)
+{
+    EncodedAudio* encodedAudio = CreateEncodedAudio(aSource, aData);
+    MsgAudioEncoded* msg = iAllocatorMsgAudioEncoded.Allocate();
+    msg->Initialise(encodedAudio);
+    return msg;
+}
+
 MsgMetaText* MsgFactory::CreateMsgMetaText(const Brx& aMetaText)
 {
     MsgMetaText* msg = iAllocatorMsgMetaText.Allocate();
@@ -3031,6 +3454,25 @@ MsgAudioPcm* MsgFactory::CreateMsgAudioPcm(const Brx& aData, TUint aChannels, TU
     return msg;
 }
 
+MsgAudioPcm* MsgFactory::CreateMsgAudioPcm(DecodedAudio* aDecodedAudio, TUint aBytes, TUint aChannels, TUint aSampleRate, TUint aBitDepth, TUint64 aTrackOffset)
+{
+    aDecodedAudio->Construct(aBytes, aChannels, aSampleRate, aBitDepth);
+    MsgAudioPcm* msg = iAllocatorMsgAudioPcm.Allocate();
+    try {
+        msg->Initialise(aDecodedAudio, aTrackOffset, iAllocatorMsgPlayablePcm, iAllocatorMsgPlayableSilence);
+    }
+    catch (AssertionFailed&) { // test code helper
+        msg->RemoveRef();
+        throw;
+    }
+    return msg;
+}
+
+DecodedAudio* MsgFactory::CreateDecodedAudioBuffer()
+{
+    return iAllocatorDecodedAudio.Allocate();
+}
+
 MsgSilence* MsgFactory::CreateMsgSilence(TUint aSizeJiffies)
 {
     MsgSilence* msg = iAllocatorMsgSilence.Allocate();
@@ -3050,6 +3492,13 @@ EncodedAudio* MsgFactory::CreateEncodedAudio(const Brx& aData)
     return encodedAudio;
 }
 
+EncodedAudio* MsgFactory::CreateEncodedAudio(IEncodedAudioSource& aSource, const Brx& aData)
+{
+    EncodedAudio* encodedAudio = iAllocatorEncodedAudio.Allocate();
+    encodedAudio->Construct(aSource, aData);
+    return encodedAudio;
+}
+
 DecodedAudio* MsgFactory::CreateDecodedAudio(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian)
 {
     DecodedAudio* decodedAudio = iAllocatorDecodedAudio.Allocate();
@@ -10,6 +10,7 @@
 #include <OpenHome/Media/InfoProvider.h>
 
 #include <limits.h>
+#include <atomic>
 
 EXCEPTION(SampleRateInvalid);
 EXCEPTION(SampleRateUnsupported);
@@ -33,8 +34,33 @@ public:
 protected:
     AllocatorBase(const TChar* aName, TUint aNumCells, TUint aCellBytes, IInfoAggregator& aInfoAggregator);
     Allocated* DoAllocate();
+private:
+    static const TUint kNumMagazines = 8;
+    static const TUint kMagazineCells = 16;
+    static const TUint kMagazineBatch = kMagazineCells / 2;
+    static const TUint kMinCellsForMagazines = 64;
+private:
+    /*
+     * Small cache of free cells sitting in front of iFree.  Each thread is mapped onto
+     * one magazine so allocations and frees normally only touch an uncontended lock;
+     * cells move to/from iFree in batches of kMagazineBatch.
+     */
+    class Magazine
+    {
+    public:
+        Magazine();
+    public:
+        Mutex iLock;
+        TUint iCount;
+        Allocated* iCells[kMagazineCells];
+    };
 private:
     Allocated* Read();
+    Allocated* Steal();
+    void RefillMagazine(Magazine& aMagazine);
+    void FlushMagazine(Magazine& aMagazine, TUint aCount);
+    void CellAllocated();
+    static TUint MagazineIndex();
 private: // from IInfoProvider
     void QueryInfo(const Brx& aQuery, IWriter& aWriter);
 protected:
@@ -44,8 +70,9 @@ private:
     const TChar* iName;
     TUint iCellsTotal;
     TUint iCellBytes;
-    TUint iCellsUsed;
-    TUint iCellsUsedMax;
+    std::atomic<TUint> iCellsUsed;
+    std::atomic<TUint> iCellsUsedMax;
+    Magazine* iMagazines;
 };
     
 template <class T> class Allocator : public AllocatorBase
@@ -80,6 +107,7 @@ class Allocated
     friend class AllocatorBase;
     friend class SuiteAllocator;
     friend class Logger;
+    friend class PipelineTracer;
 public:
     void AddRef();
     void RemoveRef();
@@ -95,7 +123,22 @@ protected:
     AllocatorBase& iAllocator;
     mutable Mutex iLock;
 private:
-    TUint iRefCount;
+    std::atomic<TUint> iRefCount;
+    TUint64 iTraceTimeUs; // time this msg last passed a traced element; cleared on allocation.  See PipelineTracer
+};
+
+/**
+ * Read-only encoded audio owned outside the pipeline (e.g. a memory-mapped file).
+ *
+ * EncodedAudio can reference a slice of a source rather than copying it.  Each
+ * EncodedAudio holds a reference to its source until the EncodedAudio is freed.
+ */
+class IEncodedAudioSource
+{
+public:
+    virtual ~IEncodedAudioSource() {}
+    virtual void AddRef() = 0;
+    virtual void RemoveRef() = 0;
 };
 
 class EncodedAudio : public Allocated
@@ -107,13 +150,16 @@ public:
     EncodedAudio(AllocatorBase& aAllocator);
     const TByte* Ptr(TUint aBytes) const;
     TUint Bytes() const;
-    TUint Append(const Brx& aData);
+    TUint Append(const Brx& aData); // always returns 0 for audio referencing an IEncodedAudioSource
 private:
     void Construct(const Brx& aData);
+    void Construct(IEncodedAudioSource& aSource, const Brx& aData);
 private: // from Allocated
     void Clear();
 private:
     Bws<kMaxBytes> iData;
+    IEncodedAudioSource* iSource;
+    Brn iSourceData;
 };
 
 enum EMediaDataEndian
@@ -179,8 +225,16 @@ public:
     TUint NumChannels() const;
     TUint BitDepth() const;
     void Aggregate(DecodedAudio& aDecodedAudio);
+    /**
+     * Writable access to an unconstructed cell (see MsgFactory::CreateDecodedAudioBuffer).
+     *
+     * Allows codecs to decode straight into pipeline memory.  Up to kMaxBytes of big
+     * endian PCM may be written.
+     */
+    TByte* WritePtr();
 private:
     void Construct(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian);
+    void Construct(TUint aBytes, TUint aChannels, TUint aSampleRate, TUint aBitDepth);
     void CopyToBigEndian16(const Brx& aData);
     void CopyToBigEndian24(const Brx& aData);
 private: // from Allocated
@@ -200,6 +254,7 @@ class IMsgProcessor;
 class Msg : public Allocated
 {
     friend class MsgQueue;
+    friend class MsgQueueSpsc;
 public:
     virtual Msg* Process(IMsgProcessor& aProcessor) = 0;
 protected:
@@ -244,10 +299,23 @@ private:
 
 class RampApplicator : private INonCopyable
 {
+public:
+    static const TUint kMaxBlockSamples = 64;
 public:
     RampApplicator(const Media::Ramp& aRamp);
     TUint Start(const Brx& aData, TUint aBitDepth, TUint aNumChannels); // returns number of samples
     void GetNextSample(TByte* aDest);
+    /*
+     * Ramps up to kMaxBlockSamples samples into aDest.  Output is bit-exact with the same number of
+     * calls to GetNextSample.  Calls to GetNextSample and GetNextBlock may be interleaved.
+     * Returns number of samples written; aDest must have space for this many samples.
+     */
+    TUint GetNextBlock(TByte* aDest);
+private:
+    static TUint GainFromRampIndex(TUint aRampIndex);
+    static void ApplyGain8(const TByte* aSrc, TByte* aDest, const TUint32* aGains, TUint aNumSubsamples);
+    static void ApplyGain16(const TByte* aSrc, TByte* aDest, const TUint32* aGains, TUint aNumSubsamples);
+    static void ApplyGain24(const TByte* aSrc, TByte* aDest, const TUint32* aGains, TUint aNumSubsamples);
 private:
     const Media::Ramp& iRamp;
     const TByte* iPtr;
@@ -257,6 +325,7 @@ private:
     TInt iTotalRamp;
     TUint iFullRampSpan;
     TUint iLoopCount;
+    TUint32 iGains[kMaxBlockSamples * DecodedAudio::kMaxNumChannels]; // one gain per subsample
 };
 
 class MsgFactory;
@@ -904,6 +973,53 @@ private:
     TUint iNumMsgs;
 };
 
+/*
+ * Queue for use by exactly one producer (Enqueue) and one consumer (Dequeue, EnqueueAtHead, Clear) thread.
+ *
+ * Enqueue and Dequeue don't take any locks.  Msg pointers are held in a linked list of fixed size
+ * chunks; a single spare chunk is recycled between consumer and producer so steady state operation
+ * doesn't allocate.  The consumer only blocks (on a semaphore) when the queue is empty.
+ * Msgs passed to EnqueueAtHead are held in a consumer-only list that is checked before the shared chunks.
+ */
+class MsgQueueSpsc : private INonCopyable
+{
+    static const TUint kMsgsPerChunk = 64;
+    class Chunk
+    {
+    public:
+        Chunk();
+    public:
+        Msg* iMsgs[kMsgsPerChunk];
+        std::atomic<Chunk*> iNext;
+    };
+public:
+    MsgQueueSpsc();
+    ~MsgQueueSpsc();
+    void Enqueue(Msg* aMsg);
+    Msg* Dequeue();
+    void EnqueueAtHead(Msg* aMsg);
+    TBool IsEmpty() const;
+    void Clear();
+    TUint NumMsgs() const; // test/debug use only
+private:
+    Msg* TryDequeue();
+    Chunk* AllocateChunk();
+private:
+    // written by producer only
+    Chunk* iTailChunk;
+    TUint iTailIndex;
+    // written by consumer only
+    Chunk* iHeadChunk;
+    TUint iHeadIndex;
+    Msg* iPushedBack;
+    // shared
+    std::atomic<TUint> iNumQueued;
+    std::atomic<TUint> iNumPushedBack;
+    std::atomic<Chunk*> iSpareChunk;
+    std::atomic<bool> iConsumerWaiting;
+    Semaphore iSem;
+};
+
 class MsgReservoir
 {
 protected:
@@ -920,8 +1036,8 @@ protected:
     TUint DecodedStreamCount() const;
     TUint EncodedAudioCount() const;
 private:
-    void Add(TUint& aValue, TUint aAdded);
-    void Remove(TUint& aValue, TUint aRemoved);
+    static void Add(std::atomic<TUint>& aValue, TUint aAdded);
+    static void Remove(std::atomic<TUint>& aValue, TUint aRemoved);
 private:
     virtual void ProcessMsgIn(MsgMode* aMsg);
     virtual void ProcessMsgIn(MsgTrack* aMsg);
@@ -1030,14 +1146,13 @@ private:
         MsgReservoir& iQueue;
     };
 private:
-    mutable Mutex iLock;
-    MsgQueue iQueue;
-    TUint iEncodedBytes;
-    TUint iJiffies;
-    TUint iTrackCount;
-    TUint iEncodedStreamCount;
-    TUint iDecodedStreamCount;
-    TUint iEncodedAudioCount;
+    MsgQueueSpsc iQueue;
+    std::atomic<TUint> iEncodedBytes;
+    std::atomic<TUint> iJiffies;
+    std::atomic<TUint> iTrackCount;
+    std::atomic<TUint> iEncodedStreamCount;
+    std::atomic<TUint> iDecodedStreamCount;
+    std::atomic<TUint> iEncodedAudioCount;
 };
 
 class PipelineElement : protected IMsgProcessor
@@ -1206,6 +1321,13 @@ public:
     virtual TUint NextFlushId() = 0;
 };
 
+class IEncodedReservoirLevel
+{
+public:
+    virtual ~IEncodedReservoirLevel() {}
+    virtual TUint EncodedReservoirBytes() const = 0; // encoded audio buffered but not yet decoded
+};
+
 enum EStreamPlay
 {
     ePlayYes
@@ -1492,6 +1614,7 @@ public:
     MsgEncodedStream* CreateMsgEncodedStream(const Brx& aUri, const Brx& aMetaText, TUint64 aTotalBytes, TUint64 aOffset, TUint aStreamId, TBool aSeekable, TBool aLive, IStreamHandler* aStreamHandler, const PcmStreamInfo& aPcmStream);
     MsgEncodedStream* CreateMsgEncodedStream(MsgEncodedStream* aMsg, IStreamHandler* aStreamHandler);
     MsgAudioEncoded* CreateMsgAudioEncoded(const Brx& aData);
+    MsgAudioEncoded* CreateMsgAudioEncoded(IEncodedAudioSource& aSource, const Brx& aData); // references rather than copies aData, which must be owned by aSource and be <= EncodedAudio::kMaxBytes
     MsgMetaText* CreateMsgMetaText(const Brx& aMetaText);
     MsgStreamInterrupted* CreateMsgStreamInterrupted();
     MsgHalt* CreateMsgHalt(TUint aId = MsgHalt::kIdNone);
@@ -1502,10 +1625,13 @@ public:
     MsgBitRate* CreateMsgBitRate(TUint aBitRate);
     MsgAudioPcm* CreateMsgAudioPcm(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian, TUint64 aTrackOffset);
     MsgAudioPcm* CreateMsgAudioPcm(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian, TUint64 aTrackOffset, TUint aRxTimestamp, TUint aNetworkTimestamp);
+    MsgAudioPcm* CreateMsgAudioPcm(DecodedAudio* aDecodedAudio, TUint aBytes, TUint aChannels, TUint aSampleRate, TUint aBitDepth, TUint64 aTrackOffset); // takes ownership of aDecodedAudio
+    DecodedAudio* CreateDecodedAudioBuffer();
     MsgSilence* CreateMsgSilence(TUint aSizeJiffies);
     MsgQuit* CreateMsgQuit();
 private:
     EncodedAudio* CreateEncodedAudio(const Brx& aData);
+    EncodedAudio* CreateEncodedAudio(IEncodedAudioSource& aSource, const Brx& aData);
     DecodedAudio* CreateDecodedAudio(const Brx& aData, TUint aChannels, TUint aSampleRate, TUint aBitDepth, EMediaDataEndian aEndian);
 private:
     Allocator<MsgMode> iAllocatorMsgMode;
@@ -6,6 +6,7 @@
 #include <OpenHome/Media/Pipeline/EncodedAudioReservoir.h>
 #include <OpenHome/Media/Codec/Container.h>
 #include <OpenHome/Media/Codec/CodecController.h>
+#include <OpenHome/Media/Codec/DecodeAhead.h>
 #include <OpenHome/Media/Codec/Id3v2.h>
 #include <OpenHome/Media/Codec/Mpeg4.h>
 #include <OpenHome/Media/Codec/MpegTs.h>
@@ -32,6 +33,7 @@
 #include <OpenHome/Media/Pipeline/StarvationMonitor.h>
 #include <OpenHome/Media/Pipeline/Muter.h>
 #include <OpenHome/Media/Pipeline/PreDriver.h>
+#include <OpenHome/Media/Pipeline/PipelineTracer.h>
 #include <OpenHome/Private/Printer.h>
 #include <OpenHome/Media/Pipeline/Msg.h>
 #include <OpenHome/Media/Debug.h>
@@ -60,6 +62,9 @@ PipelineInitParams::PipelineInitParams()
     , iRampEmergencyJiffies(kEmergencyRampDurationDefault)
     , iThreadPriorityMax(kThreadPriorityMax)
     , iMaxLatencyJiffies(kMaxLatencyDefault)
+    , iTracingEnabled(kTracingEnabledDefault)
+    , iDecodeAheadJiffies(kDecodeAheadDefault)
+    , iUrlBlockCacheBytes(kUrlBlockCacheBytesDefault)
 {
 }
 
@@ -122,6 +127,21 @@ void PipelineInitParams::SetMaxLatency(TUint aJiffies)
     iMaxLatencyJiffies = aJiffies;
 }
 
+void PipelineInitParams::SetTracingEnabled(TBool aEnabled)
+{
+    iTracingEnabled = aEnabled;
+}
+
+void PipelineInitParams::SetDecodeAhead(TUint aJiffies)
+{
+    iDecodeAheadJiffies = aJiffies;
+}
+
+void PipelineInitParams::SetUrlBlockCache(TUint aBytes)
+{
+    iUrlBlockCacheBytes = aBytes;
+}
+
 TUint PipelineInitParams::EncodedReservoirBytes() const
 {
     return iEncodedReservoirBytes;
@@ -177,6 +197,21 @@ TUint PipelineInitParams::MaxLatencyJiffies() const
     return iMaxLatencyJiffies;
 }
 
+TBool PipelineInitParams::TracingEnabled() const
+{
+    return iTracingEnabled;
+}
+
+TUint PipelineInitParams::DecodeAheadJiffies() const
+{
+    return iDecodeAheadJiffies;
+}
+
+TUint PipelineInitParams::UrlBlockCacheBytes() const
+{
+    return iUrlBlockCacheBytes;
+}
+
 
 // Pipeline
 
@@ -192,15 +227,27 @@ Pipeline::Pipeline(PipelineInitParams* aInitParams, IInfoAggregator& aInfoAggreg
     , iQuitting(false)
     , iNextFlushId(MsgFlush::kIdInvalid + 1)
 {
-    const TUint perStreamMsgCount = aInitParams->MaxStreamsPerReservoir() * kReservoirCount;
+    const TUint decodeAheadJiffies = aInitParams->DecodeAheadJiffies();
+    const TBool decodeAhead = (decodeAheadJiffies > 0);
+    const TUint decodeAheadReadBytes = aInitParams->EncodedReservoirBytes() / 2;
+    const TUint decodeAheadMsgs = (decodeAheadJiffies + kDecodeAheadMsgJiffies - 1) / kDecodeAheadMsgJiffies;
+    const TUint reservoirCount = kReservoirCount + (decodeAhead? 2 : 0); // decode-ahead adds read-ahead and decoded output queues
+    const TUint perStreamMsgCount = aInitParams->MaxStreamsPerReservoir() * reservoirCount;
     TUint encodedAudioCount = ((aInitParams->EncodedReservoirBytes() + EncodedAudio::kMaxBytes - 1) / EncodedAudio::kMaxBytes); // this may only be required on platforms that don't guarantee priority based thread scheduling
     encodedAudioCount = std::max(encodedAudioCount, // songcast and some hardware inputs won't use the full capacity of each encodedAudio
                                  (kReceiverMaxLatency + kSongcastFrameJiffies - 1) / kSongcastFrameJiffies);
     const TUint maxEncodedReservoirMsgs = encodedAudioCount;
     encodedAudioCount += kRewinderMaxMsgs; // this may only be required on platforms that don't guarantee priority based thread scheduling
-    const TUint msgEncodedAudioCount = encodedAudioCount + 100; // +100 allows for Split()ing by Container and CodecController
+    if (decodeAhead) {
+        encodedAudioCount += kRewinderMaxMsgs; // second CodecController
+        encodedAudioCount += Codec::DecodeAheadSplitter::MaxReadAheadMsgs(decodeAheadReadBytes);
+    }
+    const TUint msgEncodedAudioCount = encodedAudioCount + (decodeAhead? 200 : 100); // +100 (per CodecController) allows for Split()ing by Container and CodecController
     const TUint decodedReservoirSize = aInitParams->DecodedReservoirJiffies() + aInitParams->GorgeDurationJiffies() + aInitParams->StarvationMonitorMaxJiffies();
-    const TUint decodedAudioCount = (decodedReservoirSize / DecodedAudioAggregator::kMaxJiffies) + 100; // +100 allows for some smaller msgs and some buffering in non-reservoir elements
+    TUint decodedAudioCount = (decodedReservoirSize / DecodedAudioAggregator::kMaxJiffies) + 100; // +100 allows for some smaller msgs and some buffering in non-reservoir elements
+    if (decodeAhead) {
+        decodedAudioCount += decodeAheadMsgs; // codec output held, unaggregated, while decoding ahead
+    }
     const TUint msgAudioPcmCount = decodedAudioCount + 100; // +100 allows for Split()ing in various elements
     const TUint msgHaltCount = perStreamMsgCount * 2; // worst case is tiny Vorbis track with embedded metatext in a single-track playlist with repeat
     MsgFactoryInitParams msgInit;
@@ -219,13 +266,14 @@ Pipeline::Pipeline(PipelineInitParams* aInitParams, IInfoAggregator& aInfoAggreg
     msgInit.SetMsgAudioPcmCount(msgAudioPcmCount, decodedAudioCount);
     msgInit.SetMsgSilenceCount(kMsgCountSilence);
     msgInit.SetMsgPlayableCount(kMsgCountPlayablePcm, kMsgCountPlayableSilence);
-    msgInit.SetMsgQuitCount(kMsgCountQuit);
+    msgInit.SetMsgQuitCount(kMsgCountQuit + (decodeAhead? 1 : 0)); // DecodeAhead sends a second MsgQuit to its idle CodecController
     iMsgFactory = new MsgFactory(aInfoAggregator, msgInit);
     const TUint threadPriorityBase = aInitParams->ThreadPriorityMax() - kThreadCount + 1;
     TUint threadPriority = threadPriorityBase;
 
     iEventThread = new PipelineElementObserverThread(threadPriorityBase-1);
-    
+    iTracer = new PipelineTracer(aInfoAggregator, aShell);
+
     // Construct encoded reservoir out of sequence.  It doesn't pull from the left so doesn't need to know its preceding element
     iEncodedAudioReservoir = new EncodedAudioReservoir(*iMsgFactory, *this, maxEncodedReservoirMsgs, aInitParams->MaxStreamsPerReservoir());
     iLoggerEncodedAudioReservoir = new Logger(*iEncodedAudioReservoir, "Encoded Audio Reservoir");
@@ -252,14 +300,25 @@ Pipeline::Pipeline(PipelineInitParams* aInitParams, IInfoAggregator& aInfoAggreg
     // construct push logger slightly out of sequence
     iRampValidatorCodec = new RampValidator("Codec Controller", *iSampleRateValidator);
     iLoggerCodecController = new Logger("Codec Controller", *iRampValidatorCodec);
-    iCodecController = new Codec::CodecController(*iMsgFactory, *iLoggerContainer, *iLoggerCodecController, aUrlBlockWriter, threadPriority);
+    ISeeker* codecSeeker;
+    if (decodeAhead) {
+        iCodecController = nullptr;
+        iDecodeAhead = new Codec::DecodeAhead(*iMsgFactory, *iLoggerContainer, *iLoggerCodecController, aUrlBlockWriter, threadPriority,
+                                              decodeAheadReadBytes, decodeAheadJiffies, decodeAheadMsgs);
+        codecSeeker = iDecodeAhead;
+    }
+    else {
+        iCodecController = new Codec::CodecController(*iMsgFactory, *iLoggerContainer, *iLoggerCodecController, aUrlBlockWriter, threadPriority);
+        iDecodeAhead = nullptr;
+        codecSeeker = iCodecController;
+    }
     threadPriority++;
 
     iClockPullerManual = new ClockPullerManual(*iLoggerDecodedAudioReservoir, aShell);
     iRamper = new Ramper(*iClockPullerManual, aInitParams->RampLongJiffies());
     iLoggerRamper = new Logger(*iRamper, "Ramper");
     iRampValidatorRamper = new RampValidator(*iLoggerRamper, "Ramper");
-    iSeeker = new Seeker(*iMsgFactory, *iRampValidatorRamper, *iCodecController, aSeekRestreamer, aInitParams->RampShortJiffies());
+    iSeeker = new Seeker(*iMsgFactory, *iRampValidatorRamper, *codecSeeker, aSeekRestreamer, aInitParams->RampShortJiffies());
     iLoggerSeeker = new Logger(*iSeeker, "Seeker");
     iRampValidatorSeeker = new RampValidator(*iLoggerSeeker, "Seeker");
     iDecodedAudioValidatorSeeker = new DecodedAudioValidator(*iRampValidatorSeeker, "Seeker");
@@ -320,6 +379,9 @@ Pipeline::Pipeline(PipelineInitParams* aInitParams, IInfoAggregator& aInfoAggreg
         iPipelineEnd = iPreDriver;
     }
 
+    RegisterTracedElements();
+    iTracer->SetEnabled(aInitParams->TracingEnabled());
+
     //iAudioDumper->SetEnabled(true);
 
     //iLoggerEncodedAudioReservoir->SetEnabled(true);
@@ -446,12 +508,14 @@ Pipeline::~Pipeline()
     delete iRampValidatorCodec;
     delete iLoggerCodecController;
     delete iCodecController;
+    delete iDecodeAhead;
     delete iLoggerContainer;
     delete iContainer;
     delete iAudioDumper;
     delete iLoggerEncodedAudioReservoir;
     delete iEncodedAudioReservoir;
     delete iEventThread;
+    delete iTracer;
     delete iMsgFactory;
     delete iInitParams;
 }
@@ -463,12 +527,28 @@ void Pipeline::AddContainer(Codec::ContainerBase* aContainer)
 
 void Pipeline::AddCodec(Codec::CodecBase* aCodec)
 {
-    iCodecController->AddCodec(aCodec);
+    AddCodec(aCodec, nullptr);
+}
+
+void Pipeline::AddCodec(Codec::CodecBase* aCodec, Codec::CodecBase* aCodecDecodeAhead)
+{
+    if (iDecodeAhead != nullptr) {
+        iDecodeAhead->AddCodec(aCodec, aCodecDecodeAhead);
+    }
+    else {
+        iCodecController->AddCodec(aCodec);
+        delete aCodecDecodeAhead;
+    }
 }
 
 void Pipeline::Start()
 {
-    iCodecController->Start();
+    if (iDecodeAhead != nullptr) {
+        iDecodeAhead->Start();
+    }
+    else {
+        iCodecController->Start();
+    }
 }
 
 void Pipeline::Quit()
@@ -508,6 +588,55 @@ void Pipeline::NotifyStatus()
     iObserver.NotifyPipelineState(state);
 }
 
+void Pipeline::RegisterTracedElements()
+{
+    // register loggers in pipeline order so the trace history reads from left to right
+    iLoggerEncodedAudioReservoir->SetTracer(*iTracer, MakeFunctorGeneric<TUint&>(*this, &Pipeline::TraceLevelEncodedReservoir), "bytes");
+    iLoggerContainer->SetTracer(*iTracer);
+    iLoggerCodecController->SetTracer(*iTracer);
+    iLoggerSampleRateValidator->SetTracer(*iTracer);
+    iLoggerTimestampInspector->SetTracer(*iTracer);
+    iLoggerDecodedAudioAggregator->SetTracer(*iTracer);
+    iLoggerDecodedAudioReservoir->SetTracer(*iTracer, MakeFunctorGeneric<TUint&>(*this, &Pipeline::TraceLevelDecodedReservoir), "jiffies");
+    iLoggerRamper->SetTracer(*iTracer);
+    iLoggerSeeker->SetTracer(*iTracer);
+    iLoggerVariableDelay1->SetTracer(*iTracer);
+    iLoggerTrackInspector->SetTracer(*iTracer);
+    iLoggerSkipper->SetTracer(*iTracer);
+    iLoggerWaiter->SetTracer(*iTracer);
+    iLoggerStopper->SetTracer(*iTracer);
+    iLoggerGorger->SetTracer(*iTracer, MakeFunctorGeneric<TUint&>(*this, &Pipeline::TraceLevelGorger), "jiffies");
+    iLoggerSpotifyReporter->SetTracer(*iTracer);
+    iLoggerReporter->SetTracer(*iTracer);
+    iLoggerRouter->SetTracer(*iTracer);
+    iLoggerDrainer->SetTracer(*iTracer);
+    iLoggerVariableDelay2->SetTracer(*iTracer);
+    iLoggerPruner->SetTracer(*iTracer);
+    iLoggerStarvationMonitor->SetTracer(*iTracer, MakeFunctorGeneric<TUint&>(*this, &Pipeline::TraceLevelStarvationMonitor), "jiffies");
+    iLoggerMuter->SetTracer(*iTracer);
+    iLoggerPreDriver->SetTracer(*iTracer);
+}
+
+void Pipeline::TraceLevelEncodedReservoir(TUint& aBytes)
+{
+    aBytes = iEncodedAudioReservoir->SizeInBytes();
+}
+
+void Pipeline::TraceLevelDecodedReservoir(TUint& aJiffies)
+{
+    aJiffies = iDecodedAudioReservoir->SizeInJiffies();
+}
+
+void Pipeline::TraceLevelGorger(TUint& aJiffies)
+{
+    aJiffies = iGorger->SizeInJiffies();
+}
+
+void Pipeline::TraceLevelStarvationMonitor(TUint& aJiffies)
+{
+    aJiffies = iStarvationMonitor->SizeInJiffies();
+}
+
 MsgFactory& Pipeline::Factory()
 {
     return *iMsgFactory;
@@ -669,6 +798,11 @@ TUint Pipeline::NextFlushId()
     return id;
 }
 
+TUint Pipeline::EncodedReservoirBytes() const
+{
+    return iEncodedAudioReservoir->SizeInBytes();
+}
+
 void Pipeline::PipelineWaiting(TBool aWaiting)
 {
     iLock.Wait();
@@ -725,6 +859,9 @@ void Pipeline::NotifyStarvationMonitorBuffering(TBool aBuffering)
     iLock.Signal();
     if (notify) {
         NotifyStatus();
+        if (!iWaiting) {
+            iTracer->NotifyStarvation(aBuffering);
+        }
 #if 1
         if (aBuffering && !iWaiting) {
             const TUint encodedBytes = iEncodedAudioReservoir->SizeInBytes();
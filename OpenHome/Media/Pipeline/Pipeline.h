@@ -30,6 +30,9 @@ class PipelineInitParams
     static const TUint kEmergencyRampDurationDefault    = Jiffies::kPerMs * 20;
     static const TUint kThreadPriorityMax               = kPriorityHighest - 1;
     static const TUint kMaxLatencyDefault               = Jiffies::kPerMs * 2000;
+    static const TBool kTracingEnabledDefault           = false;
+    static const TUint kDecodeAheadDefault              = 0;
+    static const TUint kUrlBlockCacheBytesDefault       = 256 * 1024;
 public:
     static PipelineInitParams* New();
     virtual ~PipelineInitParams();
@@ -45,6 +48,9 @@ public:
     void SetEmergencyRamp(TUint aJiffies);
     void SetThreadPriorityMax(TUint aPriority); // highest priority used by pipeline
     void SetMaxLatency(TUint aJiffies);
+    void SetTracingEnabled(TBool aEnabled); // see PipelineTracer.  Can also be enabled at runtime via shell
+    void SetDecodeAhead(TUint aJiffies); // see Codec::DecodeAhead.  0 => disabled
+    void SetUrlBlockCache(TUint aBytes); // see UrlBlockCache.  0 => disabled
     // getters
     TUint EncodedReservoirBytes() const;
     TUint DecodedReservoirJiffies() const;
@@ -57,6 +63,9 @@ public:
     TUint RampEmergencyJiffies() const;
     TUint ThreadPriorityMax() const;
     TUint MaxLatencyJiffies() const;
+    TBool TracingEnabled() const;
+    TUint DecodeAheadJiffies() const;
+    TUint UrlBlockCacheBytes() const;
 private:
     PipelineInitParams();
 private:
@@ -71,6 +80,9 @@ private:
     TUint iRampEmergencyJiffies;
     TUint iThreadPriorityMax;
     TUint iMaxLatencyJiffies;
+    TBool iTracingEnabled;
+    TUint iDecodeAheadJiffies;
+    TUint iUrlBlockCacheBytes;
 };
 
 namespace Codec {
@@ -78,8 +90,10 @@ namespace Codec {
     class ContainerBase;
     class CodecController;
     class CodecBase;
+    class DecodeAhead;
 }
 class PipelineElementObserverThread;
+class PipelineTracer;
 class AudioDumper;
 class EncodedAudioReservoir;
 class Logger;
@@ -115,6 +129,7 @@ class IMimeTypeList;
 class Pipeline : public IPipelineElementDownstream
                , public IPipeline
                , public IFlushIdProvider
+               , public IEncodedReservoirLevel
                , public IWaiterObserver
                , public IStopper
                , public IMute
@@ -129,6 +144,7 @@ class Pipeline : public IPipelineElementDownstream
     static const TUint kReservoirCount          = 5; // Encoded + Decoded + Gorger + StarvationMonitor + spare
     static const TUint kSongcastFrameJiffies    = Jiffies::kPerMs * 5; // effectively hard-coded by volkano1
     static const TUint kRewinderMaxMsgs         = 100;
+    static const TUint kDecodeAheadMsgJiffies   = Jiffies::kPerMs * 10; // allow for codecs outputting small msgs while decoding ahead
 
     static const TUint kMsgCountSilence         = 410; // 2secs @ 5ms per msg + 10 spare
     static const TUint kMsgCountPlayablePcm     = 10;
@@ -145,6 +161,7 @@ public:
     virtual ~Pipeline();
     void AddContainer(Codec::ContainerBase* aContainer);
     void AddCodec(Codec::CodecBase* aCodec);
+    void AddCodec(Codec::CodecBase* aCodec, Codec::CodecBase* aCodecDecodeAhead); // aCodecDecodeAhead is a second instance of aCodec.  Deleted if decode-ahead is disabled
     void Start();
     void Quit();
     MsgFactory& Factory();
@@ -170,6 +187,8 @@ public: // from IPipeline
     void SetAnimator(IPipelineAnimator& aAnimator) override;
 private: // from IFlushIdProvider
     TUint NextFlushId() override;
+private: // from IEncodedReservoirLevel
+    TUint EncodedReservoirBytes() const override;
 private: // from IWaiterObserver
     void PipelineWaiting(TBool aWaiting) override;
 private: // from IStopper
@@ -180,6 +199,11 @@ private: // from IMute
 private:
     void DoPlay(TBool aQuit);
     void NotifyStatus();
+    void RegisterTracedElements();
+    void TraceLevelEncodedReservoir(TUint& aBytes);
+    void TraceLevelDecodedReservoir(TUint& aJiffies);
+    void TraceLevelGorger(TUint& aJiffies);
+    void TraceLevelStarvationMonitor(TUint& aJiffies);
 private: // from IStopperObserver
     void PipelinePaused() override;
     void PipelineStopped() override;
@@ -206,12 +230,14 @@ private:
     Mutex iLock;
     MsgFactory* iMsgFactory;
     PipelineElementObserverThread* iEventThread;
+    PipelineTracer* iTracer;
     AudioDumper* iAudioDumper;
     EncodedAudioReservoir* iEncodedAudioReservoir;
     Logger* iLoggerEncodedAudioReservoir;
     Codec::ContainerController* iContainer;
     Logger* iLoggerContainer;
     Codec::CodecController* iCodecController;
+    Codec::DecodeAhead* iDecodeAhead; // replaces iCodecController if decode-ahead is enabled
     Logger* iLoggerCodecController;
     RampValidator* iRampValidatorCodec;
     SampleRateValidator* iSampleRateValidator;
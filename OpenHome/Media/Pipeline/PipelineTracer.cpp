@@ -0,0 +1,604 @@
+#include <OpenHome/Media/Pipeline/PipelineTracer.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Functor.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Converter.h>
+#include <OpenHome/Private/File.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Net/Private/Shell.h>
+#include <OpenHome/Media/InfoProvider.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits.h>
+#include <string.h>
+
+using namespace OpenHome;
+using namespace OpenHome::Media;
+
+// PipelineTracer
+
+const TChar PipelineTracer::kShellCommand[] = "pipeline_trace";
+const Brn PipelineTracer::kQueryTrace("trace");
+
+static const TUint kRecordBytes = 28;
+static const TUint64 kStarvationWindowUs = 1000000; // history examined when a starvation event is reported
+
+PipelineTracer::PipelineTracer(IInfoAggregator& aInfoAggregator, Net::IShell& aShell, TUint aMaxRecords)
+    : iShell(aShell)
+    , iLock("PTRC")
+    , iNumElements(0)
+    , iMaxRecords(aMaxRecords)
+    , iNextRecord(0)
+    , iEnabled(false)
+    , iFrozen(false)
+    , iFreezeOnStarvation(false)
+    , iEpochUs(0)
+    , iStarvations(0)
+    , iLastStarvationUs(0)
+{
+    ASSERT(iMaxRecords > 0);
+    iRecords = new Record[iMaxRecords];
+    for (TUint i=0; i<iMaxRecords; i++) {
+        iRecords[i].iSeq.store(0, std::memory_order_relaxed);
+    }
+    std::vector<Brn> infoQueries;
+    infoQueries.push_back(kQueryTrace);
+    aInfoAggregator.Register(*this, infoQueries);
+    iShell.AddCommandHandler(kShellCommand, *this);
+}
+
+PipelineTracer::~PipelineTracer()
+{
+    iShell.RemoveCommandHandler(kShellCommand);
+    delete[] iRecords;
+}
+
+TUint PipelineTracer::AddElement(const TChar* aName)
+{
+    return DoAddElement(aName);
+}
+
+TUint PipelineTracer::AddElement(const TChar* aName, FunctorGeneric<TUint&> aLevel, const TChar* aLevelUnits)
+{
+    const TUint id = DoAddElement(aName);
+    Element& elem = iElements[id];
+    elem.iLevel = aLevel;
+    elem.iLevelUnits = aLevelUnits;
+    elem.iHasLevel = true;
+    return id;
+}
+
+TUint PipelineTracer::DoAddElement(const TChar* aName)
+{
+    AutoMutex _(iLock);
+    ASSERT(iNumElements < kMaxElements);
+    ASSERT(strlen(aName) <= kMaxNameBytes);
+    const TUint id = iNumElements++;
+    iElements[id].iName = aName;
+    return id;
+}
+
+void PipelineTracer::SetEnabled(TBool aEnabled)
+{
+    if (aEnabled) {
+        // discard any stamps applied during a previous tracing session
+        iEpochUs.store(NowUs(), std::memory_order_relaxed);
+    }
+    iEnabled.store(aEnabled, std::memory_order_relaxed);
+}
+
+void PipelineTracer::SetFreezeOnStarvation(TBool aFreeze)
+{
+    iFreezeOnStarvation.store(aFreeze, std::memory_order_relaxed);
+}
+
+void PipelineTracer::SetFrozen(TBool aFrozen)
+{
+    iFrozen.store(aFrozen, std::memory_order_relaxed);
+}
+
+void PipelineTracer::Reset()
+{
+    AutoMutex _(iLock);
+    for (TUint i=0; i<iNumElements; i++) {
+        iElements[i].Reset();
+    }
+    for (TUint i=0; i<iMaxRecords; i++) {
+        iRecords[i].iSeq.store(0, std::memory_order_relaxed);
+    }
+    iNextRecord.store(0, std::memory_order_relaxed);
+    iStarvations.store(0, std::memory_order_relaxed);
+    iLastStarvationUs.store(0, std::memory_order_relaxed);
+    iEpochUs.store(NowUs(), std::memory_order_relaxed);
+    iFrozen.store(false, std::memory_order_relaxed);
+}
+
+void PipelineTracer::Trace(TUint aElement, Msg& aMsg, ECall aCall, TUint64 aNowUs, TUint aCallUs, TUint aJiffies)
+{
+    ASSERT_DEBUG(aElement < iNumElements);
+    Element& elem = iElements[aElement];
+
+    TUint residency = 0;
+    const TUint64 stamp = aMsg.iTraceTimeUs;
+    if (stamp != 0 && stamp >= iEpochUs.load(std::memory_order_relaxed) && aNowUs >= stamp) {
+        const TUint64 delta = aNowUs - stamp;
+        residency = (delta > UINT_MAX? UINT_MAX : (TUint)delta);
+        elem.iResidency.Add(residency);
+    }
+    aMsg.iTraceTimeUs = aNowUs;
+
+    elem.iCallLatency.Add(aCallUs);
+    Increment(elem.iMsgs, 1);
+    if (aJiffies > 0) {
+        Increment(elem.iJiffies, aJiffies);
+    }
+
+    TUint level = 0;
+    if (elem.iHasLevel) {
+        elem.iLevel(level);
+        Minimise(elem.iLevelMin, level);
+        Maximise(elem.iLevelMax, level);
+        Increment(elem.iLevelSum, level);
+        Increment(elem.iLevelSamples, 1);
+    }
+
+    WriteRecord(aNowUs, aElement, EEventMsg, aCall, residency, aCallUs, level, aJiffies);
+}
+
+void PipelineTracer::NotifyStarvation(TBool aStarving)
+{
+    if (!Enabled()) {
+        return;
+    }
+    const TUint64 now = NowUs();
+    WriteRecord(now, kElementNone, aStarving? EEventStarvation : EEventStarvationEnd, ECallPull, 0, 0, 0, 0);
+    if (!aStarving) {
+        return;
+    }
+    Increment(iStarvations, 1);
+    iLastStarvationUs.store(now, std::memory_order_relaxed);
+    if (iFreezeOnStarvation.load(std::memory_order_relaxed)) {
+        iFrozen.store(true, std::memory_order_relaxed);
+    }
+
+    // Note the worst residency seen at each element in the lead up to this starvation.
+    // The element that held msgs for longest is the likeliest culprit.
+    AutoMutex _(iLock);
+    TUint worst[kMaxElements];
+    for (TUint i=0; i<iNumElements; i++) {
+        worst[i] = 0;
+    }
+    for (TUint i=0; i<iMaxRecords; i++) {
+        const Record& rec = iRecords[i];
+        if (rec.iSeq.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+        if (rec.iEvent == EEventMsg && rec.iElement < iNumElements &&
+            rec.iTimeUs <= now && now - rec.iTimeUs <= kStarvationWindowUs) {
+            if (rec.iResidencyUs > worst[rec.iElement]) {
+                worst[rec.iElement] = rec.iResidencyUs;
+            }
+        }
+    }
+    for (TUint i=0; i<iNumElements; i++) {
+        iElements[i].iStarvationMaxResidency.store(worst[i], std::memory_order_relaxed);
+    }
+}
+
+void PipelineTracer::WriteRecord(TUint64 aTimeUs, TUint aElement, EEvent aEvent, ECall aCall,
+                                 TUint aResidencyUs, TUint aCallUs, TUint aLevel, TUint aJiffies)
+{
+    if (iFrozen.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const TUint64 index = iNextRecord.fetch_add(1, std::memory_order_relaxed);
+    Record& rec = iRecords[index % iMaxRecords];
+    rec.iSeq.store(0, std::memory_order_relaxed); // mark as in-progress for any concurrent reader
+    std::atomic_thread_fence(std::memory_order_release);
+    rec.iTimeUs = aTimeUs;
+    rec.iResidencyUs = aResidencyUs;
+    rec.iCallUs = aCallUs;
+    rec.iLevel = aLevel;
+    rec.iJiffies = aJiffies;
+    rec.iElement = (TUint16)aElement;
+    rec.iEvent = (TByte)aEvent;
+    rec.iCall = (TByte)aCall;
+    rec.iSeq.store(index + 1, std::memory_order_release);
+}
+
+void PipelineTracer::Dump(IWriter& aWriter)
+{
+    AutoMutex _(iLock);
+    const TUint64 next = iNextRecord.load(std::memory_order_acquire);
+    const TUint64 first = (next > iMaxRecords? next - iMaxRecords : 0);
+
+    // count records first so the header can be written up front
+    TUint count = 0;
+    for (TUint64 i=first; i<next; i++) {
+        if (iRecords[i % iMaxRecords].iSeq.load(std::memory_order_acquire) == i + 1) {
+            count++;
+        }
+    }
+
+    WriterBinary writer(aWriter);
+    writer.Write(Brn("OHPT"));
+    writer.WriteUint32Be(kDumpVersion);
+    writer.WriteUint32Be(iNumElements);
+    writer.WriteUint32Be(count);
+    for (TUint i=0; i<iNumElements; i++) {
+        const Element& elem = iElements[i];
+        Brn name(elem.iName);
+        writer.WriteUint8((TByte)name.Bytes());
+        writer.Write(name);
+        Brn units(elem.iHasLevel? elem.iLevelUnits : "");
+        writer.WriteUint8((TByte)units.Bytes());
+        writer.Write(units);
+    }
+
+    TUint written = 0;
+    for (TUint64 i=first; i<next && written<count; i++) {
+        const Record& rec = iRecords[i % iMaxRecords];
+        if (rec.iSeq.load(std::memory_order_acquire) != i + 1) {
+            continue; // overwritten or being written since we started
+        }
+        const TUint64 timeUs = rec.iTimeUs;
+        const TUint residency = rec.iResidencyUs;
+        const TUint callUs = rec.iCallUs;
+        const TUint level = rec.iLevel;
+        const TUint jiffies = rec.iJiffies;
+        const TUint element = rec.iElement;
+        const TUint event = rec.iEvent;
+        const TUint call = rec.iCall;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (rec.iSeq.load(std::memory_order_relaxed) != i + 1) {
+            continue;
+        }
+        writer.WriteUint64Be(timeUs);
+        writer.WriteUint32Be(residency);
+        writer.WriteUint32Be(callUs);
+        writer.WriteUint32Be(level);
+        writer.WriteUint32Be(jiffies);
+        writer.WriteUint16Be(element);
+        writer.WriteUint8(event);
+        writer.WriteUint8(call);
+        written++;
+    }
+    // pad with empty markers if records were overwritten after we counted them
+    for (; written<count; written++) {
+        writer.WriteUint64Be(0);
+        writer.WriteUint32Be(0);
+        writer.WriteUint32Be(0);
+        writer.WriteUint32Be(0);
+        writer.WriteUint32Be(0);
+        writer.WriteUint16Be(kElementNone);
+        writer.WriteUint8(EEventMsg);
+        writer.WriteUint8(ECallPull);
+    }
+    aWriter.WriteFlush();
+}
+
+void PipelineTracer::PrintDump(const Brx& aDump, IWriter& aWriter)
+{ // static
+    Bws<256> line;
+    if (aDump.Bytes() < 16 || Brn(aDump.Ptr(), 4) != Brn("OHPT") || Converter::BeUint32At(aDump, 4) != kDumpVersion) {
+        aWriter.Write(Brn("Not a pipeline trace dump\n"));
+        return;
+    }
+    const TUint numElements = Converter::BeUint32At(aDump, 8);
+    const TUint numRecords = Converter::BeUint32At(aDump, 12);
+    if (numElements > kMaxElements) {
+        aWriter.Write(Brn("Corrupt pipeline trace dump\n"));
+        return;
+    }
+    TUint offset = 16;
+    Brn names[kMaxElements];
+    Brn units[kMaxElements];
+    for (TUint i=0; i<numElements; i++) {
+        for (TUint j=0; j<2; j++) {
+            if (offset >= aDump.Bytes()) {
+                aWriter.Write(Brn("Truncated pipeline trace dump\n"));
+                return;
+            }
+            const TUint len = aDump[offset++];
+            if (offset + len > aDump.Bytes()) {
+                aWriter.Write(Brn("Truncated pipeline trace dump\n"));
+                return;
+            }
+            (j == 0? names[i] : units[i]).Set(aDump.Ptr() + offset, len);
+            offset += len;
+        }
+    }
+    if (offset + (TUint64)numRecords * kRecordBytes > aDump.Bytes()) {
+        aWriter.Write(Brn("Truncated pipeline trace dump\n"));
+        return;
+    }
+
+    TUint64 startUs = 0;
+    for (TUint i=0; i<numRecords; i++, offset+=kRecordBytes) {
+        const TUint64 timeUs = Converter::BeUint64At(aDump, offset);
+        const TUint residency = Converter::BeUint32At(aDump, offset + 8);
+        const TUint callUs = Converter::BeUint32At(aDump, offset + 12);
+        const TUint level = Converter::BeUint32At(aDump, offset + 16);
+        const TUint jiffies = Converter::BeUint32At(aDump, offset + 20);
+        const TUint element = Converter::BeUint16At(aDump, offset + 24);
+        const TUint event = aDump[offset + 26];
+        const TUint call = aDump[offset + 27];
+        if (timeUs == 0) {
+            continue;
+        }
+        if (startUs == 0) {
+            startUs = timeUs;
+        }
+        line.SetBytes(0);
+        line.AppendPrintf("%10llu ", timeUs - startUs);
+        if (event == EEventStarvation) {
+            line.Append("*** STARVATION ***\n");
+        }
+        else if (event == EEventStarvationEnd) {
+            line.Append("*** recovered from starvation ***\n");
+        }
+        else if (element < numElements) {
+            line.Append(names[element]);
+            line.AppendPrintf(": residency %uus, %s %uus", residency, (call == ECallPull? "pull" : "push"), callUs);
+            if (jiffies > 0) {
+                line.AppendPrintf(", %ums audio", jiffies / Jiffies::kPerMs);
+            }
+            if (units[element].Bytes() > 0) {
+                line.AppendPrintf(", level %u ", level);
+                line.Append(units[element]);
+            }
+            line.Append('\n');
+        }
+        else {
+            line.AppendPrintf("unknown element %u\n", element);
+        }
+        aWriter.Write(line);
+    }
+    aWriter.WriteFlush();
+}
+
+TUint64 PipelineTracer::NowUs()
+{ // static
+    using namespace std::chrono;
+    const TUint64 us = (TUint64)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    return us + 1; // reserve 0 for 'not stamped'
+}
+
+void PipelineTracer::QueryInfo(const Brx& aQuery, IWriter& aWriter)
+{
+    if (aQuery == kQueryTrace) {
+        WriteStats(aWriter);
+    }
+}
+
+void PipelineTracer::WriteStats(IWriter& aWriter)
+{
+    AutoMutex _(iLock);
+    const TUint64 now = NowUs();
+    const TUint64 epoch = iEpochUs.load(std::memory_order_relaxed);
+    const TUint64 elapsedUs = (epoch == 0 || now <= epoch? 1 : now - epoch);
+    Bws<256> line;
+    line.AppendPrintf("Pipeline trace: %s%s, %llums sampled, starvations: %llu\n",
+                      (Enabled()? "enabled" : "disabled"), (iFrozen.load(std::memory_order_relaxed)? " (frozen)" : ""),
+                      elapsedUs / 1000, iStarvations.load(std::memory_order_relaxed));
+    aWriter.Write(line);
+    aWriter.Write(Brn("  element: msgs/s, audio x realtime, residency us (p50/p99/max), call us (p50/p99/max), worst residency before last starvation, level (min/mean/max)\n"));
+    for (TUint i=0; i<iNumElements; i++) {
+        const Element& elem = iElements[i];
+        const TUint64 msgs = elem.iMsgs.load(std::memory_order_relaxed);
+        const TUint64 jiffies = elem.iJiffies.load(std::memory_order_relaxed);
+        const TUint64 msgsPerSec = (msgs * 1000000) / elapsedUs;
+        const TUint64 realtimePercent = (jiffies * 100) / ((elapsedUs * Jiffies::kPerMs) / 1000); // jiffies per us would truncate to 0
+        line.SetBytes(0);
+        line.Append("  ");
+        line.Append(elem.iName);
+        line.AppendPrintf(": %llu, %llu.%02llux, (%u/%u/%u), (%u/%u/%u), %llu",
+                          msgsPerSec, realtimePercent / 100, realtimePercent % 100,
+                          elem.iResidency.Percentile(50), elem.iResidency.Percentile(99), elem.iResidency.Max(),
+                          elem.iCallLatency.Percentile(50), elem.iCallLatency.Percentile(99), elem.iCallLatency.Max(),
+                          elem.iStarvationMaxResidency.load(std::memory_order_relaxed));
+        const TUint64 samples = elem.iLevelSamples.load(std::memory_order_relaxed);
+        if (elem.iHasLevel && samples > 0) {
+            line.AppendPrintf(", (%u/%llu/%u) ", elem.iLevelMin.load(std::memory_order_relaxed),
+                              elem.iLevelSum.load(std::memory_order_relaxed) / samples,
+                              elem.iLevelMax.load(std::memory_order_relaxed));
+            line.Append(elem.iLevelUnits);
+        }
+        line.Append('\n');
+        aWriter.Write(line);
+    }
+}
+
+void PipelineTracer::DumpToFile(const Brx& aFilename, IWriter& aResponse)
+{
+    WriterBwh writer(64 * 1024);
+    Dump(writer);
+    Bwh dump;
+    writer.TransferTo(dump);
+    Bwh filename(aFilename.Bytes() + 1);
+    filename.Replace(aFilename);
+    FileSystemAnsii fs;
+    IFile* file = nullptr;
+    try {
+        file = fs.Open(filename.PtrZ(), eFileReadWrite);
+        file->Write(dump);
+        aResponse.Write(Brn("Wrote "));
+        Bws<Ascii::kMaxUintStringBytes> bytes;
+        Ascii::AppendDec(bytes, dump.Bytes());
+        aResponse.Write(bytes);
+        aResponse.Write(Brn(" bytes\n"));
+    }
+    catch (FileOpenError&) {
+        aResponse.Write(Brn("Failed to open file\n"));
+    }
+    catch (FileWriteError&) {
+        aResponse.Write(Brn("Failed to write file\n"));
+    }
+    delete file;
+}
+
+void PipelineTracer::HandleShellCommand(Brn aCommand, const std::vector<Brn>& aArgs, IWriter& aResponse)
+{
+    if (aArgs.size() == 1) {
+        const Brx& cmd = aArgs[0];
+        if (cmd == Brn("on")) {
+            SetEnabled(true);
+            return;
+        }
+        if (cmd == Brn("off")) {
+            SetEnabled(false);
+            return;
+        }
+        if (cmd == Brn("reset")) {
+            Reset();
+            return;
+        }
+        if (cmd == Brn("freeze")) {
+            SetFrozen(true);
+            return;
+        }
+        if (cmd == Brn("unfreeze")) {
+            SetFrozen(false);
+            return;
+        }
+        if (cmd == Brn("stats")) {
+            WriteStats(aResponse);
+            return;
+        }
+        if (cmd == Brn("print")) {
+            WriterBwh writer(64 * 1024);
+            Dump(writer);
+            Bwh dump;
+            writer.TransferTo(dump);
+            PrintDump(dump, aResponse);
+            return;
+        }
+    }
+    else if (aArgs.size() == 2) {
+        if (aArgs[0] == Brn("dump")) {
+            DumpToFile(aArgs[1], aResponse);
+            return;
+        }
+        if (aArgs[0] == Brn("freeze_on_starvation")) {
+            SetFreezeOnStarvation(aArgs[1] == Brn("on"));
+            return;
+        }
+    }
+    aResponse.Write(Brn("Unexpected arguments for \'pipeline_trace\' command\n"));
+    DisplayHelp(aResponse);
+}
+
+void PipelineTracer::DisplayHelp(IWriter& aResponse)
+{
+    aResponse.Write(Brn("pipeline_trace [on|off|reset|freeze|unfreeze|stats|print]\n"));
+    aResponse.Write(Brn("  control msg latency tracing at each pipeline element\n"));
+    aResponse.Write(Brn("pipeline_trace dump [filename]\n"));
+    aResponse.Write(Brn("  write the binary trace history to [filename]\n"));
+    aResponse.Write(Brn("pipeline_trace freeze_on_starvation [on|off]\n"));
+    aResponse.Write(Brn("  stop recording history when the starvation monitor next buffers\n"));
+}
+
+void PipelineTracer::Minimise(std::atomic<TUint>& aValue, TUint aNew)
+{ // static
+    TUint prev = aValue.load(std::memory_order_relaxed);
+    while (aNew < prev && !aValue.compare_exchange_weak(prev, aNew, std::memory_order_relaxed)) {
+    }
+}
+
+void PipelineTracer::Maximise(std::atomic<TUint>& aValue, TUint aNew)
+{ // static
+    TUint prev = aValue.load(std::memory_order_relaxed);
+    while (aNew > prev && !aValue.compare_exchange_weak(prev, aNew, std::memory_order_relaxed)) {
+    }
+}
+
+void PipelineTracer::Increment(std::atomic<TUint64>& aValue, TUint64 aAdded)
+{ // static
+    (void)aValue.fetch_add(aAdded, std::memory_order_relaxed);
+}
+
+
+// PipelineTracer::Histogram
+
+PipelineTracer::Histogram::Histogram()
+{
+    Reset();
+}
+
+void PipelineTracer::Histogram::Add(TUint aValue)
+{
+    TUint bucket = 0;
+    for (TUint v=aValue>>1; v!=0 && bucket<kNumBuckets-1; v>>=1) {
+        bucket++;
+    }
+    (void)iBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    (void)iCount.fetch_add(1, std::memory_order_relaxed);
+    PipelineTracer::Maximise(iMax, aValue);
+}
+
+void PipelineTracer::Histogram::Reset()
+{
+    for (TUint i=0; i<kNumBuckets; i++) {
+        iBuckets[i].store(0, std::memory_order_relaxed);
+    }
+    iCount.store(0, std::memory_order_relaxed);
+    iMax.store(0, std::memory_order_relaxed);
+}
+
+TUint64 PipelineTracer::Histogram::Count() const
+{
+    return iCount.load(std::memory_order_relaxed);
+}
+
+TUint PipelineTracer::Histogram::Max() const
+{
+    return iMax.load(std::memory_order_relaxed);
+}
+
+TUint PipelineTracer::Histogram::Percentile(TUint aPercent) const
+{
+    const TUint64 count = Count();
+    if (count == 0) {
+        return 0;
+    }
+    const TUint64 target = (count * aPercent + 99) / 100;
+    TUint64 seen = 0;
+    for (TUint i=0; i<kNumBuckets-1; i++) {
+        seen += iBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            const TUint upper = (1u << (i+1)) - 1;
+            return std::min(upper, Max());
+        }
+    }
+    return Max();
+}
+
+
+// PipelineTracer::Element
+
+PipelineTracer::Element::Element()
+    : iName(nullptr)
+    , iLevelUnits(nullptr)
+    , iHasLevel(false)
+{
+    Reset();
+}
+
+void PipelineTracer::Element::Reset()
+{
+    iResidency.Reset();
+    iCallLatency.Reset();
+    iMsgs.store(0, std::memory_order_relaxed);
+    iJiffies.store(0, std::memory_order_relaxed);
+    iLevelMin.store(UINT_MAX, std::memory_order_relaxed);
+    iLevelMax.store(0, std::memory_order_relaxed);
+    iLevelSum.store(0, std::memory_order_relaxed);
+    iLevelSamples.store(0, std::memory_order_relaxed);
+    iStarvationMaxResidency.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Functor.h>
+#include <OpenHome/Private/Standard.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Net/Private/Shell.h>
+#include <OpenHome/Media/InfoProvider.h>
+
+#include <atomic>
+#include <vector>
+
+namespace OpenHome {
+namespace Media {
+
+class Msg;
+
+/*
+Opt-in latency/throughput tracing for the pipeline.
+
+Each traced element (in practice, each Logger - these sit at the output of every element) reports
+every msg passing its boundary.  Msgs are stamped with a monotonic time at each boundary so the tracer
+can record how long a msg took to get from the previous boundary to this one (residency - this
+includes any time queued in a reservoir), how long the Pull()/Push() at this boundary blocked
+(call latency), msg/audio rates and, for reservoirs, how full the element was.
+
+Per-element summaries are available via the "trace" info query.  Every boundary crossing is also
+written to a fixed size ring buffer which can be dumped (see Dump() for the format) and decoded
+offline by PrintDump().  The ring can optionally be frozen on the first starvation event so that the
+history leading up to it is preserved.
+
+Tracing is disabled by default and costs a single atomic load per msg per element while disabled.
+Controlled via the "pipeline_trace" shell command.
+*/
+
+class PipelineTracer : private IInfoProvider, private Net::IShellCommandHandler, private INonCopyable
+{
+    friend class SuitePipelineTracer;
+    static const TChar kShellCommand[];
+    static const TUint kMaxElements = 48;
+    static const TUint kMaxNameBytes = 32;
+    static const TUint kNumBuckets = 24; // log2 buckets: [0..2), [2..4), [4..8) ... microseconds; final bucket is unbounded
+    static const TUint kDumpVersion = 1;
+public:
+    static const Brn kQueryTrace;
+    static const TUint kDefaultRecords = 8192;
+    static const TUint kElementNone = 0xffff;
+    enum ECall
+    {
+        ECallPull
+       ,ECallPush
+    };
+    enum EEvent
+    {
+        EEventMsg
+       ,EEventStarvation
+       ,EEventStarvationEnd
+    };
+public:
+    PipelineTracer(IInfoAggregator& aInfoAggregator, Net::IShell& aShell, TUint aMaxRecords = kDefaultRecords);
+    ~PipelineTracer();
+    /*
+     * Elements must be added before the pipeline is started.  aName must remain valid for the
+     * lifetime of the tracer.  Returns an id to be passed to Trace().
+     * aLevel, if supplied, is called each time a msg passes the element and should report how
+     * full the element is (bytes or jiffies, as described by aLevelUnits).
+     */
+    TUint AddElement(const TChar* aName);
+    TUint AddElement(const TChar* aName, FunctorGeneric<TUint&> aLevel, const TChar* aLevelUnits);
+    void SetEnabled(TBool aEnabled);
+    TBool Enabled() const { return iEnabled.load(std::memory_order_relaxed); }
+    void SetFreezeOnStarvation(TBool aFreeze);
+    void SetFrozen(TBool aFrozen);
+    void Reset();
+    /*
+     * Record that aMsg has crossed the output boundary of aElement at time aNowUs (from NowUs()).
+     * aCallUs is how long the Pull() that returned aMsg blocked or, for push boundaries, how long
+     * the previous Push() blocked (aMsg may be freed downstream before a Push() returns).
+     * aJiffies is the duration of any decoded audio in aMsg.
+     */
+    void Trace(TUint aElement, Msg& aMsg, ECall aCall, TUint64 aNowUs, TUint aCallUs, TUint aJiffies);
+    void NotifyStarvation(TBool aStarving);
+    /*
+     * Write the ring buffer as a binary dump.  All values are big endian.
+     *   header:   "OHPT", version (4), element count (4), record count (4)
+     *   elements: name length (1), name, level units length (1), level units
+     *   records:  oldest first, each 28 bytes -
+     *             time us (8), residency us (4), call us (4), level (4),
+     *             audio jiffies (4), element (2), event (1), call type (1)
+     */
+    void Dump(IWriter& aWriter);
+    static void PrintDump(const Brx& aDump, IWriter& aWriter);
+    static TUint64 NowUs();
+private: // from IInfoProvider
+    void QueryInfo(const Brx& aQuery, IWriter& aWriter) override;
+private: // from Net::IShellCommandHandler
+    void HandleShellCommand(Brn aCommand, const std::vector<Brn>& aArgs, IWriter& aResponse) override;
+    void DisplayHelp(IWriter& aResponse) override;
+private:
+    class Histogram
+    {
+    public:
+        Histogram();
+        void Add(TUint aValue);
+        void Reset();
+        TUint64 Count() const;
+        TUint Max() const;
+        TUint Percentile(TUint aPercent) const; // upper bound of bucket containing aPercent'th value
+    private:
+        std::atomic<TUint64> iBuckets[kNumBuckets];
+        std::atomic<TUint64> iCount;
+        std::atomic<TUint> iMax;
+    };
+    class Element
+    {
+    public:
+        Element();
+        void Reset();
+    public:
+        const TChar* iName;
+        const TChar* iLevelUnits;
+        FunctorGeneric<TUint&> iLevel;
+        TBool iHasLevel;
+        Histogram iResidency;
+        Histogram iCallLatency;
+        std::atomic<TUint64> iMsgs;
+        std::atomic<TUint64> iJiffies;
+        std::atomic<TUint> iLevelMin;
+        std::atomic<TUint> iLevelMax;
+        std::atomic<TUint64> iLevelSum;
+        std::atomic<TUint64> iLevelSamples;
+        std::atomic<TUint64> iStarvationMaxResidency; // worst residency in the second before the last starvation
+    };
+    class Record
+    {
+    public:
+        std::atomic<TUint64> iSeq; // 0 => never written; otherwise index+1 of the write that filled the slot
+        TUint64 iTimeUs;
+        TUint iResidencyUs;
+        TUint iCallUs;
+        TUint iLevel;
+        TUint iJiffies;
+        TUint16 iElement;
+        TByte iEvent;
+        TByte iCall;
+    };
+private:
+    TUint DoAddElement(const TChar* aName);
+    void WriteRecord(TUint64 aTimeUs, TUint aElement, EEvent aEvent, ECall aCall,
+                     TUint aResidencyUs, TUint aCallUs, TUint aLevel, TUint aJiffies);
+    void WriteStats(IWriter& aWriter);
+    void DumpToFile(const Brx& aFilename, IWriter& aResponse);
+    static void Minimise(std::atomic<TUint>& aValue, TUint aNew);
+    static void Maximise(std::atomic<TUint>& aValue, TUint aNew);
+    static void Increment(std::atomic<TUint64>& aValue, TUint64 aAdded);
+private:
+    Net::IShell& iShell;
+    Mutex iLock;
+    Element iElements[kMaxElements];
+    TUint iNumElements;
+    Record* iRecords;
+    const TUint iMaxRecords;
+    std::atomic<TUint64> iNextRecord;
+    std::atomic<TBool> iEnabled;
+    std::atomic<TBool> iFrozen;
+    std::atomic<TBool> iFreezeOnStarvation;
+    std::atomic<TUint64> iEpochUs; // stamps older than this predate the last Reset()/SetEnabled(true)
+    std::atomic<TUint64> iStarvations;
+    std::atomic<TUint64> iLastStarvationUs;
+};
+
+} // namespace Media
+} // namespace OpenHome
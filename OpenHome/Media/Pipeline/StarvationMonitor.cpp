@@ -54,6 +54,11 @@ StarvationMonitor::~StarvationMonitor()
     delete iThread;
 }
 
+TUint StarvationMonitor::SizeInJiffies() const
+{
+    return Jiffies();
+}
+
 void StarvationMonitor::PullerThread()
 {
     do {
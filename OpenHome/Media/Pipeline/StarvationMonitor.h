@@ -37,6 +37,7 @@ public:
                       IStarvationMonitorObserver& aObserver, IPipelineElementObserverThread& aObserverThread,
                       TUint aThreadPriority, TUint aNormalSize, TUint aStarvationThreshold, TUint aRampUpSize, TUint aMaxStreamCount);
     ~StarvationMonitor();
+    TUint SizeInJiffies() const;
 public: // from IPipelineElementUpstream
     Msg* Pull() override;
 private:
@@ -1,6 +1,7 @@
 #include <OpenHome/Media/PipelineManager.h>
 #include <OpenHome/Media/Pipeline/Pipeline.h>
 #include <OpenHome/Media/Protocol/Protocol.h>
+#include <OpenHome/Media/Protocol/UrlBlockCache.h>
 #include <OpenHome/Media/Filler.h>
 #include <OpenHome/Media/IdManager.h>
 #include <OpenHome/Private/Printer.h>
@@ -48,6 +49,7 @@ PipelineManager::PipelineManager(PipelineInitParams* aInitParams, IInfoAggregato
     , iPipelineState(EPipelineStopped)
     , iPipelineStoppedSem("PLM3", 1)
 {
+    const TUint urlBlockCacheBytes = aInitParams->UrlBlockCacheBytes(); // aInitParams is owned by iPipeline
     iPrefetchObserver = new PrefetchObserver();
     iPipeline = new Pipeline(aInitParams, aInfoAggregator, aTrackFactory, *this, *iPrefetchObserver, *this, *this, aShell);
     iIdManager = new IdManager(*iPipeline);
@@ -56,7 +58,8 @@ PipelineManager::PipelineManager(PipelineInitParams* aInitParams, IInfoAggregato
     iFiller = new Filler(*iPipeline, *iIdManager, *iPipeline, iPipeline->Factory(), aTrackFactory,
                          *iPrefetchObserver, *iIdManager, min-1,
                          iPipeline->SenderMinLatencyMs() * Jiffies::kPerMs);
-    iProtocolManager = new ProtocolManager(*iFiller, iPipeline->Factory(), *iIdManager, *iPipeline);
+    iProtocolManager = new ProtocolManager(*iFiller, iPipeline->Factory(), *iIdManager, *iPipeline, iPipeline);
+    iUrlBlockCache = new UrlBlockCache(*iProtocolManager, urlBlockCacheBytes);
     iFiller->Start(*iProtocolManager);
 }
 
@@ -64,6 +67,7 @@ PipelineManager::~PipelineManager()
 {
     delete iPipeline;
     delete iPrefetchObserver;
+    delete iUrlBlockCache;
     delete iProtocolManager;
     delete iFiller;
     delete iIdManager;
@@ -97,6 +101,11 @@ void PipelineManager::Add(Codec::CodecBase* aCodec)
     iPipeline->AddCodec(aCodec);
 }
 
+void PipelineManager::Add(Codec::CodecBase* aCodec, Codec::CodecBase* aCodecDecodeAhead)
+{
+    iPipeline->AddCodec(aCodec, aCodecDecodeAhead);
+}
+
 void PipelineManager::Add(Protocol* aProtocol)
 {
     iProtocolManager->Add(aProtocol);
@@ -393,7 +402,7 @@ TUint PipelineManager::SeekRestream(const Brx& aMode, TUint aTrackId)
 
 TBool PipelineManager::TryGet(IWriter& aWriter, const Brx& aUrl, TUint64 aOffset, TUint aBytes)
 {
-    return iProtocolManager->TryGet(aWriter, aUrl, aOffset, aBytes);
+    return iUrlBlockCache->TryGet(aWriter, aUrl, aOffset, aBytes);
 }
 
 
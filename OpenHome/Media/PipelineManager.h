@@ -20,6 +20,7 @@ class Pipeline;
 class PipelineInitParams;
 class IPipelineAnimator;
 class ProtocolManager;
+class UrlBlockCache;
 class ITrackObserver;
 class Filler;
 class IdManager;
@@ -86,6 +87,17 @@ public:
      * @param[in] aCodec           Ownership transfers to PipelineManager.
      */
     void Add(Codec::CodecBase* aCodec);
+    /**
+     * Add a codec to the pipeline, along with a second instance for use when decoding ahead.
+     *
+     * See PipelineInitParams::SetDecodeAhead().  Decode-ahead is only used if every codec
+     * is added using this overload.
+     * Must be called before Start().
+     *
+     * @param[in] aCodec             Ownership transfers to PipelineManager.
+     * @param[in] aCodecDecodeAhead  Separate instance of the same codec.  Ownership transfers to PipelineManager.
+     */
+    void Add(Codec::CodecBase* aCodec, Codec::CodecBase* aCodecDecodeAhead);
     /**
      * Add a protocol to the pipeline.
      *
@@ -288,6 +300,7 @@ private:
     Mutex iPublicLock;
     Pipeline* iPipeline;
     ProtocolManager* iProtocolManager;
+    UrlBlockCache* iUrlBlockCache;
     Filler* iFiller;
     IdManager* iIdManager;
     std::vector<UriProvider*> iUriProviders;
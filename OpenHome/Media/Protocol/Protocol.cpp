@@ -17,6 +17,7 @@ Protocol::Protocol(Environment& aEnv)
     , iProtocolManager(nullptr)
     , iIdProvider(nullptr)
     , iFlushIdProvider(nullptr)
+    , iReservoirLevel(nullptr)
     , iActive(false)
     , iLockActive("PROT")
 {
@@ -26,11 +27,12 @@ Protocol::~Protocol()
 {
 }
 
-void Protocol::Initialise(IProtocolManager& aProtocolManager, IPipelineIdProvider& aIdProvider, MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream, IFlushIdProvider& aFlushIdProvider)
+void Protocol::Initialise(IProtocolManager& aProtocolManager, IPipelineIdProvider& aIdProvider, MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream, IFlushIdProvider& aFlushIdProvider, IEncodedReservoirLevel* aReservoirLevel)
 {
     iProtocolManager = &aProtocolManager;
     iIdProvider = &aIdProvider;
     iFlushIdProvider = &aFlushIdProvider;
+    iReservoirLevel = aReservoirLevel;
     Initialise(aMsgFactory, aDownstream);
 }
 
@@ -366,11 +368,12 @@ void ContentRecogBuf::ReadInterrupt()
 
 // ProtocolManager
 
-ProtocolManager::ProtocolManager(IPipelineElementDownstream& aDownstream, MsgFactory& aMsgFactory, IPipelineIdProvider& aIdProvider, IFlushIdProvider& aFlushIdProvider)
+ProtocolManager::ProtocolManager(IPipelineElementDownstream& aDownstream, MsgFactory& aMsgFactory, IPipelineIdProvider& aIdProvider, IFlushIdProvider& aFlushIdProvider, IEncodedReservoirLevel* aReservoirLevel)
     : iDownstream(aDownstream)
     , iMsgFactory(aMsgFactory)
     , iIdProvider(aIdProvider)
     , iFlushIdProvider(aFlushIdProvider)
+    , iReservoirLevel(aReservoirLevel)
     , iLock("PMGR")
 {
     iAudioProcessor = new ContentAudio(aMsgFactory, aDownstream);
@@ -393,7 +396,7 @@ void ProtocolManager::Add(Protocol* aProtocol)
 {
     LOG(kMedia, "ProtocolManager::Add(Protocol*)\n");
     iProtocols.push_back(aProtocol);
-    aProtocol->Initialise(*this, iIdProvider, iMsgFactory, iDownstream, iFlushIdProvider);
+    aProtocol->Initialise(*this, iIdProvider, iMsgFactory, iDownstream, iFlushIdProvider, iReservoirLevel);
 }
 
 void ProtocolManager::Add(ContentProcessor* aProcessor)
@@ -64,7 +64,7 @@ public:
     virtual ~Protocol();
     ProtocolGetResult DoGet(IWriter& aWriter, const Brx& aUri, TUint64 aOffset, TUint aBytes);
     ProtocolStreamResult TryStream(const Brx& aUri);
-    void Initialise(IProtocolManager& aProtocolManager, IPipelineIdProvider& aIdProvider, MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream, IFlushIdProvider& aFlushIdProvider);
+    void Initialise(IProtocolManager& aProtocolManager, IPipelineIdProvider& aIdProvider, MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream, IFlushIdProvider& aFlushIdProvider, IEncodedReservoirLevel* aReservoirLevel);
     TBool TrySetActive();
     /**
      * Interrupt any stream that is currently in-progress, or cancel a previous interruption.
@@ -128,6 +128,7 @@ protected:
     IProtocolManager* iProtocolManager;
     IPipelineIdProvider* iIdProvider;
     IFlushIdProvider* iFlushIdProvider;
+    IEncodedReservoirLevel* iReservoirLevel; // may be nullptr
     TBool iActive;
 private:
     Mutex iLockActive;
@@ -218,7 +219,7 @@ class ProtocolManager : public IUriStreamer, public IUrlBlockWriter, private IPr
 {
     static const TUint kMaxUriBytes = 1024;
 public:
-    ProtocolManager(IPipelineElementDownstream& aDownstream, MsgFactory& aMsgFactory, IPipelineIdProvider& aIdProvider, IFlushIdProvider& aFlushIdProvider);
+    ProtocolManager(IPipelineElementDownstream& aDownstream, MsgFactory& aMsgFactory, IPipelineIdProvider& aIdProvider, IFlushIdProvider& aFlushIdProvider, IEncodedReservoirLevel* aReservoirLevel = nullptr);
     virtual ~ProtocolManager();
     void Add(Protocol* aProtocol);
     void Add(ContentProcessor* aProcessor);
@@ -237,6 +238,7 @@ private:
     MsgFactory& iMsgFactory;
     IPipelineIdProvider& iIdProvider;
     IFlushIdProvider& iFlushIdProvider;
+    IEncodedReservoirLevel* iReservoirLevel;
     mutable Mutex iLock;
     std::vector<Protocol*> iProtocols;
     std::vector<ContentProcessor*> iContentProcessors;
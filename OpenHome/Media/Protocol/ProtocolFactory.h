@@ -22,7 +22,7 @@ public:
     static Protocol* NewHls(Environment& aEnv, const Brx& aUserAgent);
     static Protocol* NewHttp(Environment& aEnv, const Brx& aUserAgent); // UA is optional so can be empty
     static Protocol* NewHttps(Environment& aEnv);
-    static Protocol* NewFile(Environment& aEnv);
+    static Protocol* NewFile(Environment& aEnv, TBool aMemoryMapped = false); // aMemoryMapped avoids copying file data but is only supported on some platforms; files must not be truncated while they play
     static Protocol* NewTone(Environment& aEnv);
     static Protocol* NewRtsp(Environment& aEnv, const Brx& aGuid);
     static Protocol* NewTidal(Environment& aEnv, const Brx& aToken, Av::Credentials& aCredentialsManager, Configuration::IConfigInitialiser& aConfigInitialiser);
@@ -11,15 +11,51 @@
 #include <OpenHome/Media/Debug.h>
 #include <OpenHome/Media/Supply.h>
 
+#include <atomic>
+#include <algorithm>
+#include <limits.h>
 #include <stdlib.h>
 
+#if defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
+# define PROTOCOL_FILE_MMAP
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
 namespace OpenHome {
 namespace Media {
 
+/*
+Read-only mapping of a local file.
+EncodedAudio references slices of the mapping (see IEncodedAudioSource) so the mapping
+stays valid until the last msg referencing it has been freed.
+*/
+
+class MappedFile : public IEncodedAudioSource, private INonCopyable
+{
+    static const TUint kReadAheadBytes = 1024 * 1024;
+public:
+    static MappedFile* TryOpen(const TChar* aPath); // returns nullptr if the file can't be mapped
+    const Brx& Data() const;
+    void WillNeed(TUint aOffset); // hint that data from aOffset will be read soon
+public: // from IEncodedAudioSource
+    void AddRef() override;
+    void RemoveRef() override;
+private:
+    MappedFile(void* aBase, TUint aBytes);
+    ~MappedFile();
+private:
+    void* iBase;
+    Brn iData;
+    std::atomic<TUint> iRefCount;
+};
+
 class ProtocolFile : public Protocol, private IReader
 {
 public:
-    ProtocolFile(Environment& aEnv);
+    ProtocolFile(Environment& aEnv, TBool aMemoryMapped);
     ~ProtocolFile();
 private: // from Protocol
     void Initialise(MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream) override;
@@ -34,9 +70,11 @@ private: // from IReader
     void ReadFlush() override;
     void ReadInterrupt() override;
 private:
+    ProtocolStreamResult StreamMapped(TUint aFileSize);
     TBool IsCurrentStream(TUint aStreamId) const;
 private:
     static const TUint kReadBufBytes = 9 * 1024;
+    const TBool iMemoryMapped;
     Mutex iLock;
     Supply* iSupply;
     OpenHome::Uri iUri;
@@ -49,6 +87,7 @@ private:
     TBool iFileOpen;
     TUint32 iSeekPos;
     TUint iNextFlushId;
+    MappedFile* iMappedFile;
 };
 
 };  // namespace Media
@@ -58,20 +97,95 @@ using namespace OpenHome;
 using namespace OpenHome::Media;
 
 
-Protocol* ProtocolFactory::NewFile(Environment& aEnv)
+Protocol* ProtocolFactory::NewFile(Environment& aEnv, TBool aMemoryMapped)
 { // static
-    return new ProtocolFile(aEnv);
+    return new ProtocolFile(aEnv, aMemoryMapped);
+}
+
+
+// MappedFile
+
+MappedFile* MappedFile::TryOpen(const TChar* aPath)
+{ // static
+#ifdef PROTOCOL_FILE_MMAP
+    const int fd = ::open(aPath, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0 && (TUint64)st.st_size <= UINT_MAX) {
+        base = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    (void)::close(fd); // mapping remains valid after its descriptor is closed
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    (void)::madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+    return new MappedFile(base, (TUint)st.st_size);
+#else
+    (void)aPath;
+    return nullptr;
+#endif
+}
+
+MappedFile::MappedFile(void* aBase, TUint aBytes)
+    : iBase(aBase)
+    , iData(static_cast<const TByte*>(aBase), aBytes)
+    , iRefCount(1)
+{
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef PROTOCOL_FILE_MMAP
+    (void)::munmap(iBase, iData.Bytes());
+#endif
+}
+
+const Brx& MappedFile::Data() const
+{
+    return iData;
+}
+
+void MappedFile::WillNeed(TUint aOffset)
+{
+#ifdef PROTOCOL_FILE_MMAP
+    static const TUint kPageBytes = (TUint)::sysconf(_SC_PAGESIZE);
+    if (aOffset >= iData.Bytes()) {
+        return;
+    }
+    const TUint start = aOffset - (aOffset % kPageBytes);
+    const TUint bytes = std::min(kReadAheadBytes, iData.Bytes() - start);
+    (void)::madvise(static_cast<TByte*>(iBase) + start, bytes, MADV_WILLNEED);
+#else
+    (void)aOffset;
+#endif
+}
+
+void MappedFile::AddRef()
+{
+    iRefCount++;
+}
+
+void MappedFile::RemoveRef()
+{
+    if (--iRefCount == 0) {
+        delete this;
+    }
 }
 
 
 // ProtocolFile
 
-ProtocolFile::ProtocolFile(Environment& aEnv)
+ProtocolFile::ProtocolFile(Environment& aEnv, TBool aMemoryMapped)
     : Protocol(aEnv)
+    , iMemoryMapped(aMemoryMapped)
     , iLock("PRTF")
     , iSupply(nullptr)
     , iReaderBuf(iFileStream)
     , iContentRecogBuf(iReaderBuf)
+    , iMappedFile(nullptr)
 {
 }
 
@@ -139,7 +253,20 @@ ProtocolStreamResult ProtocolFile::Stream(const Brx& aUri)
     ProtocolStreamResult res = EProtocolStreamErrorRecoverable;
     iStreamId = iIdProvider->NextStreamId();
     iSupply->OutputStream(iUri.AbsoluteUri(), fileSize, iSeekPos, true, false, *this, iStreamId);
-    contentProcessor = iProtocolManager->GetAudioProcessor();
+    if (iMemoryMapped) {
+        Brhz path(iUri.Path());
+        iMappedFile = MappedFile::TryOpen(path.CString());
+        if (iMappedFile != nullptr && iMappedFile->Data().Bytes() != fileSize) {
+            iMappedFile->RemoveRef();
+            iMappedFile = nullptr;
+        }
+    }
+    if (iMappedFile != nullptr) {
+        res = StreamMapped(fileSize);
+    }
+    else {
+        contentProcessor = iProtocolManager->GetAudioProcessor();
+    }
     TUint remaining = fileSize;
     while (res == EProtocolStreamErrorRecoverable) {
         res = contentProcessor->Stream(*this, remaining);
@@ -167,6 +294,10 @@ ProtocolStreamResult ProtocolFile::Stream(const Brx& aUri)
     iFileStream.CloseFile();
     iFileOpen = false;
     iStreamId = IPipelineIdProvider::kStreamIdInvalid;
+    if (iMappedFile != nullptr) {
+        iMappedFile->RemoveRef(); // msgs still in the pipeline keep the mapping alive
+        iMappedFile = nullptr;
+    }
     iLock.Signal();
     if (contentProcessor != nullptr) {
         contentProcessor->Reset();
@@ -174,6 +305,37 @@ ProtocolStreamResult ProtocolFile::Stream(const Brx& aUri)
     return res;
 }
 
+ProtocolStreamResult ProtocolFile::StreamMapped(TUint aFileSize)
+{
+    // Msgs reference the mapping so a seek only moves our offset into it
+    const Brx& data = iMappedFile->Data();
+    TUint offset = 0;
+    iMappedFile->WillNeed(offset);
+    for (;;) {
+        iLock.Wait();
+        if (iSeek) {
+            offset = iSeekPos;
+            iSeek = false;
+            iSeekPos = 0;
+            iFileStream.Interrupt(false);
+            iSupply->OutputFlush(iNextFlushId);
+            iMappedFile->WillNeed(offset);
+        }
+        else if (iStop) {
+            iSupply->OutputFlush(iNextFlushId);
+            iLock.Signal();
+            return EProtocolStreamStopped;
+        }
+        iLock.Signal();
+        if (offset >= aFileSize) {
+            return EProtocolStreamSuccess;
+        }
+        const TUint bytes = std::min(aFileSize - offset, EncodedAudio::kMaxBytes);
+        iSupply->OutputData(*iMappedFile, data.Split(offset, bytes));
+        offset += bytes;
+    }
+}
+
 ProtocolGetResult ProtocolFile::Get(IWriter& /*aWriter*/, const Brx& /*aUri*/, TUint64 /*aOffset*/, TUint /*aBytes*/)
 {
     return EProtocolGetErrorNotSupported;
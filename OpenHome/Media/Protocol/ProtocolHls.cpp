@@ -14,8 +14,10 @@
 #include <OpenHome/Media/Supply.h>
 #include <OpenHome/Media/Tests/TestProtocolHls.h>
 #include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/OsWrapper.h>
 
 #include <algorithm>
+#include <vector>
 
 namespace OpenHome {
 namespace Media {
@@ -63,7 +65,7 @@ public:
 class ProtocolHls : public Protocol
 {
 public:
-    ProtocolHls(Environment& aEnv, IHlsReader* aReaderM3u, IHlsReader* aReaderSegment, IHlsTimer* aTimer, ISemaphore* aM3uReaderSem);
+    ProtocolHls(Environment& aEnv, IHlsReader* aReaderM3u, IHlsReader* aReaderSegment, IHlsTimer* aTimer, ISemaphore* aM3uReaderSem, SegmentPrefetcher* aPrefetcher = nullptr); // aPrefetcher, if not nullptr, must also be aReaderSegment
     ~ProtocolHls();
 private: // from Protocol
     void Initialise(MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream) override;
@@ -80,9 +82,13 @@ private:
     void StartStream(const Uri& aUri);
     TBool IsCurrentStream(TUint aStreamId) const;
     void WaitForDrain();
+    void StreamSegments();
+    void InterruptSegments();
+    void StopSegments();
 private:
     IHlsReader* iHlsReaderM3u;
     IHlsReader* iHlsReaderSegment;
+    SegmentPrefetcher* iPrefetcher;
     Supply* iSupply;
     IHlsTimer* iTimer;
     ISemaphore* iSemReaderM3u;
@@ -104,13 +110,19 @@ using namespace OpenHome;
 using namespace OpenHome::Media;
 
 
+static const TUint kHlsPrefetchSegments = 3;
+
 Protocol* ProtocolFactory::NewHls(Environment& aEnv, const Brx& aUserAgent)
 { // static
     HlsReader* readerM3u = new HlsReader(aEnv, aUserAgent);
-    HlsReader* readerSegment = new HlsReader(aEnv, aUserAgent);
+    std::vector<IHlsReader*> readersSegment;
+    for (TUint i=0; i<kHlsPrefetchSegments; i++) {
+        readersSegment.push_back(new HlsSegmentReader(aEnv, aUserAgent));
+    }
+    SegmentPrefetcher* prefetcher = new SegmentPrefetcher(aEnv, readersSegment);
     TimerGeneric* timer = new TimerGeneric(aEnv, "PHLS");
     SemaphoreGeneric* semM3u = new SemaphoreGeneric("HMRS", 0);
-    return new ProtocolHls(aEnv, readerM3u, readerSegment, timer, semM3u);
+    return new ProtocolHls(aEnv, readerM3u, prefetcher, timer, semM3u, prefetcher);
 }
 
 
@@ -204,6 +216,97 @@ IReader& HlsReader::Reader()
 }
 
 
+// HlsVariantSelector
+
+HlsVariantSelector::HlsVariantSelector()
+{
+    Reset();
+}
+
+void HlsVariantSelector::Reset()
+{
+    iBandwidths.clear();
+    iCurrent = 0;
+    iThroughput = 0;
+    iSegments = 0;
+}
+
+void HlsVariantSelector::AddVariant(TUint aBandwidth)
+{
+    ASSERT(iBandwidths.size() == 0 || iBandwidths.back() <= aBandwidth);
+    iBandwidths.push_back(aBandwidth);
+}
+
+TUint HlsVariantSelector::Count() const
+{
+    return (TUint)iBandwidths.size();
+}
+
+void HlsVariantSelector::SetCurrent(TUint aIndex)
+{
+    ASSERT(aIndex < iBandwidths.size());
+    iCurrent = aIndex;
+    iSegments = 0;
+}
+
+TUint HlsVariantSelector::Current() const
+{
+    return iCurrent;
+}
+
+void HlsVariantSelector::SegmentDownloaded(TUint aBytes, TUint aDownloadMs)
+{
+    if (aDownloadMs == 0) {
+        aDownloadMs = 1;
+    }
+    const TUint64 throughput = ((TUint64)aBytes * 8 * 1000) / aDownloadMs;
+    // weight recent segments heavily so that a congested connection is noticed quickly
+    iThroughput = (iThroughput == 0? throughput : (iThroughput + throughput) / 2);
+    iSegments++;
+}
+
+TUint HlsVariantSelector::Select(TUint aHeadroomMs)
+{
+    if (iBandwidths.size() < 2 || iSegments == 0) {
+        return iCurrent;
+    }
+    const TUint64 usable = (iThroughput * kUsablePercent) / 100;
+    if (iBandwidths[iCurrent] > usable) {
+        if (aHeadroomMs < kMinHeadroomMs || aHeadroomMs == kHeadroomUnknown) {
+            TUint index = 0;
+            for (TUint i=1; i<iCurrent; i++) {
+                if (iBandwidths[i] <= usable) {
+                    index = i;
+                }
+            }
+            if (index != iCurrent) {
+                SetCurrent(index);
+            }
+        }
+    }
+    else if (iCurrent + 1 < iBandwidths.size() && iBandwidths[iCurrent + 1] <= usable &&
+             iSegments >= kSegmentsBeforeUp && aHeadroomMs >= kUpHeadroomMs) {
+        SetCurrent(iCurrent + 1);
+    }
+    return iCurrent;
+}
+
+TUint HlsVariantSelector::ThroughputBps() const
+{
+    return (TUint)std::min(iThroughput, (TUint64)0xffffffff);
+}
+
+
+// HlsM3uReader::Variant
+
+HlsM3uReader::Variant::Variant(const Brx& aUri, TUint aBandwidth, TBool aAudioOnly)
+    : iUri(aUri)
+    , iBandwidth(aBandwidth)
+    , iAudioOnly(aAudioOnly)
+{
+}
+
+
 // HlsM3uReader
 
 HlsM3uReader::HlsM3uReader(IHttpSocket& aSocket, IReader& aReader, IHlsTimer& aTimer, ISemaphore& aSemaphore)
@@ -222,7 +325,20 @@ HlsM3uReader::HlsM3uReader(IHttpSocket& aSocket, IReader& aReader, IHlsTimer& aT
     , iSem(aSemaphore)
     , iInterrupted(true)
     , iError(false)
+    , iReservoirLevel(nullptr)
+    , iMasterPlaylist(false)
+{
+}
+
+HlsM3uReader::~HlsM3uReader()
+{
+    ClearVariants();
+}
+
+void HlsM3uReader::SetReservoirLevel(IEncodedReservoirLevel& aReservoirLevel)
 {
+    AutoMutex a(iLock);
+    iReservoirLevel = &aReservoirLevel;
 }
 
 void HlsM3uReader::SetUri(const Uri& aUri)
@@ -245,6 +361,9 @@ void HlsM3uReader::SetUri(const Uri& aUri)
     iSem.Signal();
     iInterrupted = false;
     iError = false;
+    ClearVariants();
+    iMasterPlaylist = false;
+    iSelector.Reset();
     //iReaderUntil.ReadFlush();
 }
 
@@ -278,6 +397,9 @@ void HlsM3uReader::Close()
 TUint HlsM3uReader::NextSegmentUri(Uri& aUri)
 {
     LOG(kMedia, ">HlsM3uReader::NextSegmentUri\n");
+    if (TrySwitchVariant()) {
+        THROW(HlsVariantChanged);
+    }
     TUint duration = 0;
     Brn segmentUri = Brx::Empty();
     try {
@@ -371,6 +493,12 @@ TUint HlsM3uReader::NextSegmentUri(Uri& aUri)
     return duration;
 }
 
+void HlsM3uReader::NotifySegmentDownloaded(TUint aBytes, TUint aDownloadMs)
+{
+    AutoMutex a(iLock);
+    iSelector.SegmentDownloaded(aBytes, aDownloadMs);
+}
+
 void HlsM3uReader::TimerFired()
 {
     LOG(kMedia, "HlsM3uReader::TimerFired\n");
@@ -416,34 +544,50 @@ TBool HlsM3uReader::ReloadVariantPlaylist()
         }
     }
 
-    Close();
-    TUint code = iSocket.Connect(iUri);
-    if (code >= HttpStatus::kSuccessCodes && code < HttpStatus::kRedirectionCodes) {
-        const Brx& absUri = iUri.AbsoluteUri();
-        LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist successfully connected to %.*s\n", PBUF(absUri));
+    for (;;) {
+        Close();
+        TUint code = iSocket.Connect(iUri);
+        if (code >= HttpStatus::kSuccessCodes && code < HttpStatus::kRedirectionCodes) {
+            const Brx& absUri = iUri.AbsoluteUri();
+            LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist successfully connected to %.*s\n", PBUF(absUri));
+            {
+                AutoMutex a(iLock);
+                iConnected = true;
+            }
+            iTotalBytes = iSocket.ContentLength();
+            iOffset = 0;
+        }
+        else if (code == 0) {
+            // Connection error. Should be temporary and recoverable.
+            const Brx& absUri = iUri.AbsoluteUri();
+            LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist unable to (re-)connect to %.*s\n", PBUF(absUri));
+            return false;
+        }
+        else {
+            const Brx& absUri = iUri.AbsoluteUri();
+            LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist encountered code %u while trying to connect to %.*s\n", code, PBUF(absUri));
+            THROW(HlsVariantPlaylistError);
+        }
+
+        // If HlsVariantPlaylistError or HlsDiscontinuityError are thrown, just let them be thrown up; everything else should be encapsulated in true/false return state.
+        if (!PreprocessM3u()) {
+            LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist failed to pre-process M3U8\n");
+            return false;
+        }
+        if (!iMasterPlaylist) {
+            break;
+        }
+
+        // Read a master playlist.  Load the variant playlist that has been chosen from it.
+        iMasterPlaylist = false;
+        SelectInitialVariant();
         {
             AutoMutex a(iLock);
-            iConnected = true;
+            if (iInterrupted) {
+                LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist interrupted after reading master playlist\n");
+                return false;
+            }
         }
-        iTotalBytes = iSocket.ContentLength();
-        iOffset = 0;
-    }
-    else if (code == 0) {
-        // Connection error. Should be temporary and recoverable.
-        const Brx& absUri = iUri.AbsoluteUri();
-        LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist unable to (re-)connect to %.*s\n", PBUF(absUri));
-        return false;
-    }
-    else {
-        const Brx& absUri = iUri.AbsoluteUri();
-        LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist encountered code %u while trying to connect to %.*s\n", code, PBUF(absUri));
-        THROW(HlsVariantPlaylistError);
-    }
-
-    // If HlsVariantPlaylistError or HlsDiscontinuityError are thrown, just let them be thrown up; everything else should be encapsulated in true/false return state.
-    if (!PreprocessM3u()) {
-        LOG(kMedia, "HlsM3uReader::ReloadVariantPlaylist failed to pre-process M3U8\n");
-        return false;
     }
 
     if (iTargetDuration == 0) { // #EXT-X-TARGETDURATION is a required tag.
@@ -521,6 +665,15 @@ TBool HlsM3uReader::PreprocessM3u()
                 iEndlist = true;
                 LOG(kMedia, "HlsM3uReader::PreprocessM3u found #EXT-X-ENDLIST\n");
             }
+            else if (tag == Brn("#EXT-X-STREAM-INF")) {
+                // Master playlist.  Nested master playlists aren't supported.
+                if (!iMasterPlaylist && iVariants.size() > 0) {
+                    LOG(kMedia, "HlsM3uReader::PreprocessM3u found #EXT-X-STREAM-INF in variant playlist\n");
+                    THROW(HlsVariantPlaylistError);
+                }
+                iMasterPlaylist = true;
+                ReadVariant(p.NextToEnd());
+            }
             else if (tag == Brn("#EXTINF")) {
                 if (!mediaSeqFound) {
                     // EXT-X-MEDIA-SEQUENCE MUST appear before EXTINF, so must
@@ -598,23 +751,198 @@ void HlsM3uReader::SetSegmentUri(Uri& aUri, const Brx& aSegmentUri)
     }
 }
 
+void HlsM3uReader::ReadVariant(const Brx& aAttributes)
+{
+    // aAttributes is a comma separated list of NAME=VALUE pairs.  Quoted values may contain commas.
+    TUint bandwidth = 0;
+    TBool audioOnly = false;
+    const TUint bytes = aAttributes.Bytes();
+    TUint i = 0;
+    while (i < bytes) {
+        TUint start = i;
+        while (i < bytes && aAttributes[i] != '=') {
+            i++;
+        }
+        const Brn name = Ascii::Trim(aAttributes.Split(start, i - start));
+        start = (i < bytes? ++i : i);
+        TBool quoted = false;
+        while (i < bytes && (quoted || aAttributes[i] != ',')) {
+            if (aAttributes[i] == '"') {
+                quoted = !quoted;
+            }
+            i++;
+        }
+        Brn value = Ascii::Trim(aAttributes.Split(start, i - start));
+        i++;
+
+        if (name == Brn("BANDWIDTH")) { // required attribute
+            bandwidth = Ascii::Uint(value);
+        }
+        else if (name == Brn("CODECS")) {
+            if (value.Bytes() >= 2 && value[0] == '"' && value[value.Bytes() - 1] == '"') {
+                value.Set(value.Ptr() + 1, value.Bytes() - 2);
+            }
+            static const Brn kAudioCodecPrefix("mp4a");
+            audioOnly = (value.Bytes() > 0);
+            Parser codecs(value);
+            while (!codecs.Finished()) {
+                const Brn codec = codecs.Next(',');
+                if (!codec.BeginsWith(kAudioCodecPrefix)) {
+                    audioOnly = false;
+                }
+            }
+        }
+    }
+
+    // uri of variant follows on next non-blank line that isn't a comment
+    Brn line;
+    do {
+        if (iOffset >= iTotalBytes) {
+            LOG(kMedia, "HlsM3uReader::ReadVariant no uri follows #EXT-X-STREAM-INF\n");
+            iNextLine.Set(Brx::Empty());
+            return;
+        }
+        ReadNextLine();
+        line.Set(Ascii::Trim(iNextLine));
+    } while (line.Bytes() == 0 || line[0] == '#');
+    iNextLine.Set(Brx::Empty());
+
+    Uri uri;
+    try {
+        SetSegmentUri(uri, line);
+    }
+    catch (UriError&) {
+        LOG(kMedia, "HlsM3uReader::ReadVariant UriError\n");
+        return;
+    }
+    // Only http is supported
+    if (!Ascii::CaseInsensitiveEquals(uri.Scheme(), Brn("http"))) {
+        const Brx& absUri = uri.AbsoluteUri();
+        LOG(kMedia, "HlsM3uReader::ReadVariant ignoring %.*s\n", PBUF(absUri));
+        return;
+    }
+    LOG(kMedia, "HlsM3uReader::ReadVariant bandwidth: %u, audioOnly: %u\n", bandwidth, audioOnly);
+    iVariants.push_back(new Variant(uri.AbsoluteUri(), bandwidth, audioOnly));
+}
+
+void HlsM3uReader::SelectInitialVariant()
+{
+    // Only use audio-only variants if there are any...
+    TBool audioOnly = false;
+    for (auto it=iVariants.begin(); it!=iVariants.end(); ++it) {
+        audioOnly = audioOnly || (*it)->iAudioOnly;
+    }
+    // ...in order of increasing bandwidth, keeping only the first of any with the same bandwidth
+    std::vector<Variant*> variants;
+    variants.swap(iVariants);
+    for (auto it=variants.begin(); it!=variants.end(); ++it) {
+        Variant* variant = *it;
+        auto pos = iVariants.begin();
+        while (pos != iVariants.end() && (*pos)->iBandwidth < variant->iBandwidth) {
+            ++pos;
+        }
+        if ((audioOnly && !variant->iAudioOnly) || (pos != iVariants.end() && (*pos)->iBandwidth == variant->iBandwidth)) {
+            delete variant;
+        }
+        else {
+            (void)iVariants.insert(pos, variant);
+        }
+    }
+    if (iVariants.size() == 0) {
+        LOG(kMedia, "HlsM3uReader::SelectInitialVariant no supported variants in master playlist\n");
+        THROW(HlsVariantPlaylistError);
+    }
+
+    // Start with the highest bandwidth variant.  The selector switches down if it can't be streamed.
+    {
+        AutoMutex a(iLock);
+        iSelector.Reset();
+        for (auto it=iVariants.begin(); it!=iVariants.end(); ++it) {
+            iSelector.AddVariant((*it)->iBandwidth);
+        }
+        iSelector.SetCurrent(iSelector.Count() - 1);
+    }
+    iUri.Replace(iVariants.back()->iUri);
+    const Brx& absUri = iUri.AbsoluteUri();
+    LOG(kMedia, "HlsM3uReader::SelectInitialVariant %.*s (of %u)\n", PBUF(absUri), (TUint)iVariants.size());
+}
+
+TBool HlsM3uReader::TrySwitchVariant()
+{
+    // Variants are only switched between segments, once one variant playlist has been read
+    if (iVariants.size() < 2 || (iLastSegment == 0 && iTargetDuration == 0)) {
+        return false;
+    }
+    TUint index = 0;
+    {
+        AutoMutex a(iLock);
+        if (iInterrupted) {
+            return false;
+        }
+        const TUint current = iSelector.Current();
+        index = iSelector.Select(HeadroomMs());
+        if (index == current) {
+            return false;
+        }
+        LOG(kMedia, "HlsM3uReader::TrySwitchVariant from %u to %u bps (throughput %u bps)\n",
+                    iVariants[current]->iBandwidth, iVariants[index]->iBandwidth, iSelector.ThroughputBps());
+        // reload the new variant's playlist without waiting for the timer
+        iTimer.Cancel();
+        (void)iSem.Clear();
+        iSem.Signal();
+    }
+
+    // Media sequence numbers are the same in all variants so the next segment is found by
+    // reloading from the new variant's playlist.
+    Close();
+    iUri.Replace(iVariants[index]->iUri);
+    iEndlist = false;
+    iTotalBytes = 0;
+    iOffset = 0;
+    iNextLine.Set(Brx::Empty());
+    return true;
+}
+
+TUint HlsM3uReader::HeadroomMs() const
+{
+    // iLock must be held
+    const TUint bandwidth = iVariants[iSelector.Current()]->iBandwidth;
+    if (iReservoirLevel == nullptr || bandwidth == 0) {
+        return HlsVariantSelector::kHeadroomUnknown;
+    }
+    const TUint64 ms = ((TUint64)iReservoirLevel->EncodedReservoirBytes() * 8 * kMillisecondsPerSecond) / bandwidth;
+    return (TUint)std::min(ms, (TUint64)HlsVariantSelector::kHeadroomUnknown - 1);
+}
+
+void HlsM3uReader::ClearVariants()
+{
+    for (auto it=iVariants.begin(); it!=iVariants.end(); ++it) {
+        delete *it;
+    }
+    iVariants.clear();
+}
+
 
 // SegmentStreamer
 
-SegmentStreamer::SegmentStreamer(IHttpSocket& aSocket, IReader& aReader)
-    : iSocket(aSocket)
+SegmentStreamer::SegmentStreamer(Environment& aEnv, IHttpSocket& aSocket, IReader& aReader)
+    : iEnv(aEnv)
+    , iSocket(aSocket)
     , iReader(aReader)
     , iSegmentUriProvider(nullptr)
+    , iObserver(nullptr)
     , iConnected(false)
     , iTotalBytes(0)
     , iOffset(0)
+    , iDownloadMs(0)
     , iInterrupted(true)
     , iError(false)
+    , iVariantChanged(false)
     , iLock("SEGL")
 {
 }
 
-void SegmentStreamer::Stream(ISegmentUriProvider& aSegmentUriProvider)
+void SegmentStreamer::Stream(ISegmentUriProvider& aSegmentUriProvider, ISegmentThroughputObserver* aObserver)
 {
     LOG(kMedia, "SegmentStreamer::Stream\n");
     AutoMutex a(iLock);
@@ -622,9 +950,12 @@ void SegmentStreamer::Stream(ISegmentUriProvider& aSegmentUriProvider)
     ASSERT(!iConnected);
     iInterrupted = false;
     iError = false;
+    iVariantChanged = false;
     iSegmentUriProvider = &aSegmentUriProvider;
+    iObserver = aObserver;
     iTotalBytes = 0;
     iOffset = 0;
+    iDownloadMs = 0;
 }
 
 TBool SegmentStreamer::Error() const
@@ -632,11 +963,22 @@ TBool SegmentStreamer::Error() const
     return iError;
 }
 
+TBool SegmentStreamer::VariantChanged() const
+{
+    return iVariantChanged;
+}
+
 Brn SegmentStreamer::Read(TUint aBytes)
 {
+    iVariantChanged = false;
     try {
         EnsureSegmentIsReady();
     }
+    catch (HlsVariantChanged&) {
+        LOG(kMedia, "SegmentStreamer::Read HlsVariantChanged\n");
+        iVariantChanged = true;
+        THROW(ReaderError);
+    }
     catch (HlsSegmentError&) {
         LOG(kMedia, "SegmentStreamer::Read HlsSegmentError\n");
         THROW(ReaderError);
@@ -653,7 +995,11 @@ Brn SegmentStreamer::Read(TUint aBytes)
         LOG(kMedia, "SegmentStreamer::Read HlsDiscontinuityError\n");
         THROW(ReaderError);
     }
+    const TUint start = (iObserver == nullptr? 0 : Os::TimeInMs(iEnv.OsCtx()));
     Brn buf = iReader.Read(aBytes);
+    if (iObserver != nullptr) {
+        iDownloadMs += Os::TimeInMs(iEnv.OsCtx()) - start;
+    }
     iOffset += buf.Bytes();
     return buf;
 }
@@ -706,11 +1052,19 @@ void SegmentStreamer::GetNextSegment()
         LOG(kMedia, "SegmentStreamer::GetNextSegment HlsEndOfStream\n");
         throw;
     }
+    catch (HlsVariantChanged&) {
+        LOG(kMedia, "SegmentStreamer::GetNextSegment HlsVariantChanged\n");
+        throw;
+    }
 
     iUri.Replace(segment.AbsoluteUri());
 
     Close();
+    const TUint start = (iObserver == nullptr? 0 : Os::TimeInMs(iEnv.OsCtx()));
     TUint code = iSocket.Connect(iUri);
+    if (iObserver != nullptr) {
+        iDownloadMs += Os::TimeInMs(iEnv.OsCtx()) - start;
+    }
     if (code >= HttpStatus::kSuccessCodes && code < HttpStatus::kRedirectionCodes) {
         const Brx& absUri = iUri.AbsoluteUri();
         LOG(kMedia, "SegmentStreamer::GetNextSegment successfully connected to %.*s\n", PBUF(absUri));
@@ -740,103 +1094,897 @@ void SegmentStreamer::EnsureSegmentIsReady()
 {
     // FIXME - what if iTotalBytes == 0?
     if (iOffset == iTotalBytes) {
+        if (iTotalBytes > 0 && iObserver != nullptr) {
+            iObserver->NotifySegmentDownloaded((TUint)iTotalBytes, iDownloadMs);
+        }
+        // GetNextSegment() may throw.  Leave state so that the next Read() tries again.
+        iTotalBytes = 0;
         iOffset = 0;
+        iDownloadMs = 0;
         //Close();
         GetNextSegment();
     }
 }
 
 
-// ProtocolHls
+// HlsSegmentReader
+
+HlsSegmentReader::HlsSegmentReader(Environment& aEnv, const Brx& aUserAgent)
+    : iEnv(aEnv)
+    , iUserAgent(aUserAgent)
+    , iReadBuffer(iTcpClient)
+    , iReaderUntil(iReadBuffer)
+    , iReaderResponse(aEnv, iReaderUntil)
+    , iWriteBuffer(iTcpClient)
+    , iWriterRequest(iWriteBuffer)
+    , iDechunker(iReaderUntil)
+    , iLock("HSRL")
+    , iSocketIsOpen(false)
+    , iInterrupted(false)
+    , iConnected(false)
+    , iKeepAlive(false)
+    , iPort(0)
+    , iTotalBytes(0)
+    , iOffset(0)
+{
+    iReaderResponse.AddHeader(iHeaderContentLength);
+    iReaderResponse.AddHeader(iHeaderLocation);
+    iReaderResponse.AddHeader(iHeaderTransferEncoding);
+    iReaderResponse.AddHeader(iHeaderConnection);
+}
 
-ProtocolHls::ProtocolHls(Environment& aEnv, IHlsReader* aReaderM3u, IHlsReader* aReaderSegment, IHlsTimer* aTimer, ISemaphore* aM3uReaderSem)
-    : Protocol(aEnv)
-    , iHlsReaderM3u(aReaderM3u)
-    , iHlsReaderSegment(aReaderSegment)
-    , iSupply(nullptr)
-    , iTimer(aTimer)
-    , iSemReaderM3u(aM3uReaderSem)
-    , iM3uReader(iHlsReaderM3u->Socket(), iHlsReaderM3u->Reader(), *iTimer, *iSemReaderM3u)
-    , iSegmentStreamer(iHlsReaderSegment->Socket(), iHlsReaderSegment->Reader())
-    , iSem("PRTH", 0)
-    , iLock("PRHL")
+HlsSegmentReader::~HlsSegmentReader()
 {
+    CloseSocket();
 }
 
-ProtocolHls::~ProtocolHls()
+IHttpSocket& HlsSegmentReader::Socket()
 {
-    delete iSemReaderM3u;
-    delete iTimer;
-    delete iSupply;
-    delete iHlsReaderSegment;
-    delete iHlsReaderM3u;
+    return *this;
 }
 
-void ProtocolHls::Initialise(MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream)
+IReader& HlsSegmentReader::Reader()
 {
-    iSupply = new Supply(aMsgFactory, aDownstream);
+    return *this;
 }
 
-void ProtocolHls::Interrupt(TBool aInterrupt)
+TUint HlsSegmentReader::Connect(const Uri& aUri)
 {
-    iLock.Wait();
-    if (iActive) {
-        LOG(kMedia, "ProtocolHls::Interrupt(%u)\n", aInterrupt);
-        if (aInterrupt) {
-            iStopped = true;
+    Uri uri(aUri.AbsoluteUri());
+    for (TUint i=0; i<=kMaxRedirects; i++) {
+        const TUint code = SendRequest(uri);
+        if (code >= HttpStatus::kRedirectionCodes && code < HttpStatus::kClientErrorCodes && iHeaderLocation.Received()) {
+            uri.Replace(iHeaderLocation.Location());
+            continue;
         }
-        iSegmentStreamer.ReadInterrupt();
-        iM3uReader.Interrupt();
-        iSem.Signal();
+        return code;
     }
-    iLock.Signal();
+    return 0;
 }
 
-ProtocolStreamResult ProtocolHls::Stream(const Brx& aUri)
+void HlsSegmentReader::Close()
 {
-    // There is no notion of a live or seekable stream in HLS!
-    //
-    // By default, all streams are live.
-    //
-    // It is legal to perform a seek, as long as it is within the current
-    // stream segments available within the variant playlist.
-    // (i.e., if the first available segment was some_stream-002.ts, and the
-    // user wished to seek to a position that would be in some_stream-001.ts,
-    // that seek would be invalid.)
-    //
-    // It is also legal to attempt to pause an HLS stream (albeit that the
-    // position at which it can resume is bounded by the segments available in
-    // the variant playlist).
-    // (i.e., if paused during some_stream-002.ts and when unpaused first
-    // segment now available was some_stream-004.ts, there would be a forced
-    // discontinuity in the audio.)
-    //
-    // Given the limited usefulness of this behaviour (because it is bound by
-    // the limits of the periodically changing variant playlist), the use case
-    // (why would a client wish to seek during a live radio stream?), and the
-    // increased complexity of the code required, just don't allow
-    // seeking/pausing.
-
+    CloseSocket();
+    AutoMutex a(iLock);
+    iInterrupted = false;
+}
 
+TUint HlsSegmentReader::ContentLength() const
+{
+    ASSERT(iConnected);
+    return iTotalBytes;
+}
 
-    Reinitialise();
-    Uri uriHls(aUri);
-    if (uriHls.Scheme() != Brn("hls")) {
-        return EProtocolErrorNotSupported;
+Brn HlsSegmentReader::Read(TUint aBytes)
+{
+    ASSERT(iConnected);
+    if (iTotalBytes > 0) {
+        if (iOffset == iTotalBytes) {
+            THROW(ReaderError);
+        }
+        aBytes = std::min(aBytes, iTotalBytes - iOffset);
     }
-    LOG(kMedia, "ProtocolHls::Stream(%.*s)\n", PBUF(aUri));
+    Brn buf = iDechunker.Read(aBytes);
+    iOffset += buf.Bytes();
+    if (iOffset == iTotalBytes && CanKeepAlive()) {
+        iKeepAlive = true;
+    }
+    return buf;
+}
 
-    if (!iStarted) {
-        StartStream(uriHls);
+void HlsSegmentReader::ReadFlush()
+{
+    if (iConnected) {
+        iDechunker.ReadFlush();
     }
+}
 
-    // Don't want to buffer content from a live stream
-    // ...so need to wait on pipeline signalling it is ready to play
-    LOG(kMedia, "ProtocolHls::Stream live stream waiting to be (re-)started\n");
-    iSegmentStreamer.Close();
-    iM3uReader.Close();
-    iSem.Wait();
-    LOG(kMedia, "ProtocolHls::Stream live stream restart\n");
+void HlsSegmentReader::ReadInterrupt()
+{
+    AutoMutex a(iLock);
+    iInterrupted = true;
+    if (iSocketIsOpen) {
+        iTcpClient.Interrupt(true);
+    }
+}
+
+TUint HlsSegmentReader::SendRequest(const Uri& aUri)
+{
+    const TUint port = (aUri.Port() == Uri::kPortNotSpecified? kHttpPort : (TUint)aUri.Port());
+    const TBool reuse = (iKeepAlive && iPort == port && iHost == aUri.Host());
+    iKeepAlive = false;
+    iConnected = false;
+    TUint code = 0;
+    TBool responseReceived = false;
+    if (reuse) {
+        LOG(kMedia, "HlsSegmentReader::SendRequest reusing connection\n");
+        code = WriteRequest(aUri, port, responseReceived);
+    }
+    if (!reuse || (code == 0 && !responseReceived)) {
+        // no connection to reuse or the server closed it while idle
+        CloseSocket();
+        if (!Open(aUri, port)) {
+            return 0;
+        }
+        code = WriteRequest(aUri, port, responseReceived);
+    }
+    if (code == 0) {
+        CloseSocket();
+        return 0;
+    }
+    iHost.Replace(aUri.Host());
+    iPort = port;
+    iConnected = true;
+    iDechunker.SetChunked(iHeaderTransferEncoding.IsChunked());
+    iTotalBytes = iHeaderContentLength.ContentLength();
+    iOffset = 0;
+    if (iTotalBytes == 0 && code >= HttpStatus::kSuccessCodes && code < HttpStatus::kRedirectionCodes) {
+        iKeepAlive = CanKeepAlive(); // empty body
+    }
+    return code;
+}
+
+TUint HlsSegmentReader::WriteRequest(const Uri& aUri, TUint aPort, TBool& aResponseReceived)
+{
+    aResponseReceived = false;
+    try {
+        iWriterRequest.WriteMethod(Http::kMethodGet, aUri.PathAndQuery(), Http::eHttp11);
+        Http::WriteHeaderHostAndPort(iWriterRequest, aUri.Host(), aPort);
+        if (iUserAgent.Bytes() > 0) {
+            iWriterRequest.WriteHeader(Http::kHeaderUserAgent, iUserAgent);
+        }
+        iWriterRequest.WriteFlush();
+    }
+    catch (WriterError&) {
+        LOG(kMedia, "HlsSegmentReader::WriteRequest WriterError\n");
+        return 0;
+    }
+
+    try {
+        iReaderResponse.Read(kResponseTimeoutMs);
+        aResponseReceived = true;
+    }
+    catch (HttpError&) {
+        LOG(kMedia, "HlsSegmentReader::WriteRequest HttpError\n");
+        return 0;
+    }
+    catch (ReaderError&) {
+        LOG(kMedia, "HlsSegmentReader::WriteRequest ReaderError\n");
+        return 0;
+    }
+    return iReaderResponse.Status().Code();
+}
+
+TBool HlsSegmentReader::Open(const Uri& aUri, TUint aPort)
+{
+    Endpoint ep;
+    try {
+        ep.SetAddress(aUri.Host());
+        ep.SetPort(aPort);
+    }
+    catch (NetworkError&) {
+        LOG(kMedia, "HlsSegmentReader::Open error setting address and port\n");
+        return false;
+    }
+    try {
+        AutoMutex a(iLock);
+        if (iInterrupted) {
+            return false;
+        }
+        iTcpClient.Open(iEnv);
+        iSocketIsOpen = true;
+    }
+    catch (NetworkError&) {
+        LOG(kMedia, "HlsSegmentReader::Open error opening\n");
+        return false;
+    }
+    try {
+        iTcpClient.Connect(ep, kConnectTimeoutMs);
+    }
+    catch (NetworkTimeout&) {
+        LOG(kMedia, "HlsSegmentReader::Open timed out connecting\n");
+        CloseSocket();
+        return false;
+    }
+    catch (NetworkError&) {
+        LOG(kMedia, "HlsSegmentReader::Open error connecting\n");
+        CloseSocket();
+        return false;
+    }
+    return true;
+}
+
+void HlsSegmentReader::CloseSocket()
+{
+    AutoMutex a(iLock);
+    iConnected = false;
+    iKeepAlive = false;
+    if (iSocketIsOpen) {
+        iSocketIsOpen = false;
+        iDechunker.ReadFlush();
+        iTcpClient.Close();
+    }
+}
+
+TBool HlsSegmentReader::CanKeepAlive() const
+{
+    // Only reuse a connection if the server told us how long its response was and hasn't asked us to close it
+    return (iHeaderContentLength.Received() &&
+            !iHeaderTransferEncoding.IsChunked() &&
+            !iHeaderConnection.Close());
+}
+
+
+// SegmentPrefetcher
+
+SegmentPrefetcher::SegmentPrefetcher(Environment& aEnv, const std::vector<IHlsReader*>& aReaders, TUint aSlotBytes)
+    : iEnv(aEnv)
+    , iLock("SGPL")
+    , iUriLock("SGPU")
+    , iConsumerSem("SGPC", 0)
+    , iIdleSem("SGPI", 0)
+    , iProvider(nullptr)
+    , iObserver(nullptr)
+    , iRunning(false)
+    , iInterrupted(true)
+    , iUriFailed(false)
+    , iQuit(false)
+    , iNextSequence(0)
+    , iReadSequence(0)
+    , iPending(nullptr)
+    , iCurrent(nullptr)
+    , iTransfers(0)
+    , iTransferStart(0)
+    , iTransferMs(0)
+    , iTransferBytes(0)
+{
+    ASSERT(aReaders.size() > 0);
+    ASSERT(aSlotBytes > 0);
+    for (auto it=aReaders.begin(); it!=aReaders.end(); ++it) {
+        iSlots.push_back(new Slot(*this, *it, aSlotBytes));
+    }
+    for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+        (*it)->iThread->Start();
+    }
+}
+
+SegmentPrefetcher::~SegmentPrefetcher()
+{
+    {
+        AutoMutex a(iLock);
+        iQuit = true;
+    }
+    Interrupt();
+    for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+        (*it)->iSem.Signal();
+    }
+    for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+        delete *it;
+    }
+}
+
+void SegmentPrefetcher::Start(ISegmentUriProvider& aProvider, ISegmentThroughputObserver* aObserver)
+{
+    LOG(kMedia, "SegmentPrefetcher::Start\n");
+    AutoMutex a(iLock);
+    ASSERT(!iRunning);
+    iProvider = &aProvider;
+    iObserver = aObserver;
+    iTransferMs = 0;
+    iTransferBytes = 0;
+    iRunning = true;
+    iInterrupted = false;
+    iUriFailed = false;
+    iNextSequence = 0;
+    iReadSequence = 0;
+    iPending = nullptr;
+    iCurrent = nullptr;
+    for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+        ASSERT(!(*it)->iBusy);
+        (*it)->Reset();
+        (*it)->iSem.Signal();
+    }
+}
+
+void SegmentPrefetcher::Interrupt()
+{
+    LOG(kMedia, "SegmentPrefetcher::Interrupt\n");
+    AutoMutex a(iLock);
+    if (!iInterrupted) {
+        iInterrupted = true;
+        for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+            Slot& slot = **it;
+            if (slot.iBusy) {
+                slot.iReader->Reader().ReadInterrupt();
+            }
+            slot.iSem.Signal();
+        }
+    }
+    iConsumerSem.Signal();
+}
+
+void SegmentPrefetcher::Stop()
+{
+    LOG(kMedia, "SegmentPrefetcher::Stop\n");
+    Interrupt();
+    for (;;) {
+        {
+            AutoMutex a(iLock);
+            (void)iIdleSem.Clear();
+            TBool busy = false;
+            for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+                busy = busy || (*it)->iBusy;
+            }
+            if (!busy) {
+                iRunning = false;
+                iProvider = nullptr;
+                iObserver = nullptr;
+                iPending = nullptr;
+                iCurrent = nullptr;
+                for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+                    (*it)->Reset();
+                }
+                break;
+            }
+        }
+        iIdleSem.Wait();
+    }
+    // No thread is using a reader now.  Closing them also clears the interrupt above.
+    for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+        (*it)->iReader->Socket().Close();
+    }
+}
+
+TUint SegmentPrefetcher::NextSegmentUri(Uri& aUri)
+{
+    Slot* slot = nullptr;
+    for (;;) {
+        {
+            AutoMutex a(iLock);
+            if (iCurrent != nullptr) {
+                // SegmentStreamer only asks for the next segment once it's finished with the current one
+                Release(*iCurrent);
+                iCurrent = nullptr;
+            }
+            if (iPending != nullptr) {
+                Release(*iPending);
+                iPending = nullptr;
+            }
+            (void)iConsumerSem.Clear();
+            if (iInterrupted) {
+                THROW(HlsReaderError);
+            }
+            slot = FindSequence(iReadSequence);
+            if (slot != nullptr) {
+                iReadSequence++;
+                if (slot->iUriResult == eUriOk) {
+                    iPending = slot;
+                    aUri.Replace(slot->iUri.AbsoluteUri());
+                    return slot->iDuration;
+                }
+                break;
+            }
+        }
+        iConsumerSem.Wait();
+    }
+
+    AutoMutex a(iLock);
+    const EUriResult result = slot->iUriResult;
+    Release(*slot);
+    switch (result)
+    {
+    case eUriVariantPlaylistError:
+        THROW(HlsVariantPlaylistError);
+    case eUriEndOfStream:
+        THROW(HlsEndOfStream);
+    case eUriDiscontinuity:
+        THROW(HlsDiscontinuityError);
+    case eUriVariantChanged:
+        THROW(HlsVariantChanged);
+    default:
+        THROW(HlsReaderError);
+    }
+}
+
+IHttpSocket& SegmentPrefetcher::Socket()
+{
+    return *this;
+}
+
+IReader& SegmentPrefetcher::Reader()
+{
+    return *this;
+}
+
+TUint SegmentPrefetcher::Connect(const Uri& aUri)
+{
+    {
+        AutoMutex a(iLock);
+        if (iCurrent != nullptr) {
+            Release(*iCurrent);
+        }
+        iCurrent = iPending;
+        iPending = nullptr;
+    }
+    for (;;) {
+        {
+            AutoMutex a(iLock);
+            (void)iConsumerSem.Clear();
+            if (iInterrupted || iCurrent == nullptr) {
+                return 0;
+            }
+            ASSERT(aUri.AbsoluteUri() == iCurrent->iUri.AbsoluteUri());
+            if (iCurrent->iState != eConnecting) {
+                return iCurrent->iCode;
+            }
+        }
+        iConsumerSem.Wait();
+    }
+}
+
+void SegmentPrefetcher::Close()
+{
+    AutoMutex a(iLock);
+    if (iCurrent != nullptr) {
+        Release(*iCurrent);
+        iCurrent = nullptr;
+    }
+}
+
+TUint SegmentPrefetcher::ContentLength() const
+{
+    AutoMutex a(iLock);
+    return (iCurrent == nullptr? 0 : iCurrent->iContentLength);
+}
+
+Brn SegmentPrefetcher::Read(TUint aBytes)
+{
+    for (;;) {
+        {
+            AutoMutex a(iLock);
+            (void)iConsumerSem.Clear();
+            if (iInterrupted || iCurrent == nullptr) {
+                THROW(ReaderError);
+            }
+            Slot& slot = *iCurrent;
+            const TUint available = slot.Available();
+            if (available > 0) {
+                const TUint start = (TUint)(slot.iRead % slot.iData.Bytes());
+                TUint bytes = std::min(std::min(aBytes, available), iReadBuf.MaxBytes());
+                bytes = std::min(bytes, slot.iData.Bytes() - start); // don't wrap
+                iReadBuf.Replace(slot.iData.Ptr() + start, bytes);
+                slot.iRead += bytes;
+                slot.iSem.Signal();
+                return Brn(iReadBuf);
+            }
+            if (slot.iState == eComplete || slot.iState == eFailed) {
+                THROW(ReaderError);
+            }
+        }
+        iConsumerSem.Wait();
+    }
+}
+
+void SegmentPrefetcher::ReadFlush()
+{
+}
+
+void SegmentPrefetcher::ReadInterrupt()
+{
+    Interrupt();
+}
+
+void SegmentPrefetcher::Run(Slot& aSlot)
+{
+    while (WaitForWork(aSlot)) {
+        if (FetchUri(aSlot)) {
+            Fetch(aSlot);
+        }
+        {
+            AutoMutex a(iLock);
+            aSlot.iBusy = false;
+        }
+        iConsumerSem.Signal();
+        iIdleSem.Signal();
+    }
+}
+
+TBool SegmentPrefetcher::WaitForWork(Slot& aSlot)
+{
+    for (;;) {
+        {
+            AutoMutex a(iLock);
+            (void)aSlot.iSem.Clear();
+            if (iQuit) {
+                return false;
+            }
+            if (iRunning && !iInterrupted && !iUriFailed && aSlot.iState == eIdle) {
+                aSlot.iBusy = true;
+                return true;
+            }
+        }
+        aSlot.iSem.Wait();
+    }
+}
+
+TBool SegmentPrefetcher::FetchUri(Slot& aSlot)
+{
+    AutoMutex _(iUriLock);
+    ISegmentUriProvider* provider = nullptr;
+    {
+        AutoMutex a(iLock);
+        if (iInterrupted || iUriFailed) {
+            return false;
+        }
+        aSlot.Reset();
+        aSlot.iSequence = iNextSequence++;
+        aSlot.iState = eUri;
+        provider = iProvider;
+    }
+
+    EUriResult result = eUriOk;
+    TUint duration = 0;
+    try {
+        duration = provider->NextSegmentUri(aSlot.iUri);
+    }
+    catch (HlsVariantPlaylistError&) {
+        result = eUriVariantPlaylistError;
+    }
+    catch (HlsEndOfStream&) {
+        result = eUriEndOfStream;
+    }
+    catch (HlsDiscontinuityError&) {
+        result = eUriDiscontinuity;
+    }
+    catch (HlsReaderError&) {
+        result = eUriReaderError;
+    }
+    catch (HlsVariantChanged&) {
+        result = eUriVariantChanged;
+    }
+
+    AutoMutex a(iLock);
+    aSlot.iUriResult = result;
+    aSlot.iDuration = duration;
+    if (result == eUriOk) {
+        aSlot.iState = eConnecting;
+    }
+    else {
+        aSlot.iState = eFailed;
+        // segments after a variant change can still be fetched
+        iUriFailed = (result != eUriVariantChanged);
+    }
+    iConsumerSem.Signal();
+    return (result == eUriOk);
+}
+
+void SegmentPrefetcher::Fetch(Slot& aSlot)
+{
+    IHttpSocket& socket = aSlot.iReader->Socket();
+    IReader& reader = aSlot.iReader->Reader();
+    BeginTransfer();
+    const TUint code = socket.Connect(aSlot.iUri);
+    EndTransfer(0);
+    const TBool success = (code >= HttpStatus::kSuccessCodes && code < HttpStatus::kRedirectionCodes);
+    TUint remaining = 0;
+    {
+        AutoMutex a(iLock);
+        aSlot.iCode = code;
+        if (success) {
+            aSlot.iContentLength = remaining = socket.ContentLength();
+        }
+        if (aSlot.iState == eConnecting) {
+            aSlot.iState = (success? eFetching : eFailed);
+        }
+    }
+    iConsumerSem.Signal();
+    if (!success) {
+        return;
+    }
+
+    const TBool lengthKnown = (remaining > 0);
+    for (;;) {
+        TUint bytes = WaitForSpace(aSlot);
+        if (bytes == 0) {
+            // segment abandoned by the consumer (or we're stopping) so the rest of the response won't be read
+            socket.Close();
+            return;
+        }
+        if (bytes > kReadBytes) {
+            bytes = kReadBytes;
+        }
+        if (lengthKnown) {
+            bytes = std::min(bytes, remaining);
+        }
+
+        Brn buf;
+        TBool error = false;
+        BeginTransfer();
+        try {
+            buf.Set(reader.Read(bytes));
+        }
+        catch (ReaderError&) {
+            error = true;
+        }
+        EndTransfer(buf.Bytes());
+        if (buf.Bytes() == 0) {
+            error = true; // end of chunked response
+        }
+
+        TBool done = error;
+        TBool complete = false;
+        {
+            AutoMutex a(iLock);
+            if (aSlot.iState == eFetching) {
+                const TUint size = aSlot.iData.Bytes();
+                for (TUint i=0; i<buf.Bytes();) {
+                    const TUint start = (TUint)(aSlot.iWritten % size);
+                    const TUint n = std::min(buf.Bytes() - i, size - start);
+                    (void)memcpy(const_cast<TByte*>(aSlot.iData.Ptr()) + start, buf.Ptr() + i, n);
+                    aSlot.iWritten += n;
+                    i += n;
+                }
+                remaining -= std::min(remaining, buf.Bytes());
+                done = done || (lengthKnown && remaining == 0);
+                if (error) {
+                    // a response of unknown length ends when the server closes the connection
+                    aSlot.iState = (lengthKnown? eFailed : eComplete);
+                }
+                else if (done) {
+                    aSlot.iState = eComplete;
+                }
+                complete = (aSlot.iState == eComplete);
+            }
+        }
+        iConsumerSem.Signal();
+        if (error) {
+            socket.Close();
+        }
+        if (complete) {
+            ReportThroughput();
+        }
+        if (done) {
+            return;
+        }
+    }
+}
+
+TUint SegmentPrefetcher::WaitForSpace(Slot& aSlot)
+{
+    // returns 0 if the segment is no longer wanted
+    for (;;) {
+        {
+            AutoMutex a(iLock);
+            (void)aSlot.iSem.Clear();
+            if (aSlot.iState != eFetching || iInterrupted) {
+                return 0;
+            }
+            const TUint space = aSlot.iData.Bytes() - aSlot.Available();
+            if (space > 0) {
+                return space;
+            }
+        }
+        aSlot.iSem.Wait();
+    }
+}
+
+void SegmentPrefetcher::Release(Slot& aSlot)
+{
+    // iLock must be held
+    aSlot.iState = eIdle;
+    aSlot.iSem.Signal();
+}
+
+void SegmentPrefetcher::BeginTransfer()
+{
+    AutoMutex a(iLock);
+    if (iTransfers++ == 0) {
+        iTransferStart = Os::TimeInMs(iEnv.OsCtx());
+    }
+}
+
+void SegmentPrefetcher::EndTransfer(TUint aBytes)
+{
+    AutoMutex a(iLock);
+    iTransferBytes += aBytes;
+    if (--iTransfers == 0) {
+        iTransferMs += Os::TimeInMs(iEnv.OsCtx()) - iTransferStart;
+    }
+}
+
+void SegmentPrefetcher::ReportThroughput()
+{
+    ISegmentThroughputObserver* observer = nullptr;
+    TUint bytes = 0;
+    TUint ms = 0;
+    {
+        AutoMutex a(iLock);
+        observer = iObserver;
+        bytes = (TUint)iTransferBytes;
+        ms = iTransferMs;
+        if (iTransfers > 0) {
+            const TUint now = Os::TimeInMs(iEnv.OsCtx());
+            ms += now - iTransferStart;
+            iTransferStart = now;
+        }
+        iTransferBytes = 0;
+        iTransferMs = 0;
+    }
+    if (observer != nullptr && bytes > 0) {
+        observer->NotifySegmentDownloaded(bytes, ms);
+    }
+}
+
+SegmentPrefetcher::Slot* SegmentPrefetcher::FindSequence(TUint64 aSequence) const
+{
+    // iLock must be held.  Only returns slots whose uri has been fetched.
+    for (auto it=iSlots.begin(); it!=iSlots.end(); ++it) {
+        Slot* slot = *it;
+        if (slot->iSequence == aSequence && slot->iState != eIdle && slot->iState != eUri) {
+            return slot;
+        }
+    }
+    return nullptr;
+}
+
+
+// SegmentPrefetcher::Slot
+
+SegmentPrefetcher::Slot::Slot(SegmentPrefetcher& aOwner, IHlsReader* aReader, TUint aBytes)
+    : iOwner(aOwner)
+    , iReader(aReader)
+    , iSem("SGPS", 0)
+    , iData(aBytes)
+    , iBusy(false)
+{
+    iData.SetBytes(aBytes);
+    Reset();
+    iThread = new ThreadFunctor("HlsPrefetcher", MakeFunctor(*this, &SegmentPrefetcher::Slot::Run));
+}
+
+SegmentPrefetcher::Slot::~Slot()
+{
+    delete iThread;
+    delete iReader;
+}
+
+void SegmentPrefetcher::Slot::Reset()
+{
+    iState = eIdle;
+    iSequence = 0;
+    iDuration = 0;
+    iUriResult = eUriOk;
+    iCode = 0;
+    iContentLength = 0;
+    iWritten = 0;
+    iRead = 0;
+}
+
+TUint SegmentPrefetcher::Slot::Available() const
+{
+    return (TUint)(iWritten - iRead);
+}
+
+void SegmentPrefetcher::Slot::Run()
+{
+    iOwner.Run(*this);
+}
+
+
+// ProtocolHls
+
+ProtocolHls::ProtocolHls(Environment& aEnv, IHlsReader* aReaderM3u, IHlsReader* aReaderSegment, IHlsTimer* aTimer, ISemaphore* aM3uReaderSem, SegmentPrefetcher* aPrefetcher)
+    : Protocol(aEnv)
+    , iHlsReaderM3u(aReaderM3u)
+    , iHlsReaderSegment(aReaderSegment)
+    , iPrefetcher(aPrefetcher)
+    , iSupply(nullptr)
+    , iTimer(aTimer)
+    , iSemReaderM3u(aM3uReaderSem)
+    , iM3uReader(iHlsReaderM3u->Socket(), iHlsReaderM3u->Reader(), *iTimer, *iSemReaderM3u)
+    , iSegmentStreamer(aEnv, iHlsReaderSegment->Socket(), iHlsReaderSegment->Reader())
+    , iSem("PRTH", 0)
+    , iLock("PRHL")
+{
+}
+
+ProtocolHls::~ProtocolHls()
+{
+    delete iSemReaderM3u;
+    delete iTimer;
+    delete iSupply;
+    delete iHlsReaderSegment;
+    delete iHlsReaderM3u;
+}
+
+void ProtocolHls::Initialise(MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownstream)
+{
+    iSupply = new Supply(aMsgFactory, aDownstream);
+    if (iReservoirLevel != nullptr) {
+        iM3uReader.SetReservoirLevel(*iReservoirLevel);
+    }
+}
+
+void ProtocolHls::Interrupt(TBool aInterrupt)
+{
+    iLock.Wait();
+    if (iActive) {
+        LOG(kMedia, "ProtocolHls::Interrupt(%u)\n", aInterrupt);
+        if (aInterrupt) {
+            iStopped = true;
+        }
+        InterruptSegments();
+        iSem.Signal();
+    }
+    iLock.Signal();
+}
+
+ProtocolStreamResult ProtocolHls::Stream(const Brx& aUri)
+{
+    // There is no notion of a live or seekable stream in HLS!
+    //
+    // By default, all streams are live.
+    //
+    // It is legal to perform a seek, as long as it is within the current
+    // stream segments available within the variant playlist.
+    // (i.e., if the first available segment was some_stream-002.ts, and the
+    // user wished to seek to a position that would be in some_stream-001.ts,
+    // that seek would be invalid.)
+    //
+    // It is also legal to attempt to pause an HLS stream (albeit that the
+    // position at which it can resume is bounded by the segments available in
+    // the variant playlist).
+    // (i.e., if paused during some_stream-002.ts and when unpaused first
+    // segment now available was some_stream-004.ts, there would be a forced
+    // discontinuity in the audio.)
+    //
+    // Given the limited usefulness of this behaviour (because it is bound by
+    // the limits of the periodically changing variant playlist), the use case
+    // (why would a client wish to seek during a live radio stream?), and the
+    // increased complexity of the code required, just don't allow
+    // seeking/pausing.
+
+
+
+    Reinitialise();
+    Uri uriHls(aUri);
+    if (uriHls.Scheme() != Brn("hls")) {
+        return EProtocolErrorNotSupported;
+    }
+    LOG(kMedia, "ProtocolHls::Stream(%.*s)\n", PBUF(aUri));
+
+    if (!iStarted) {
+        StartStream(uriHls);
+    }
+
+    // Don't want to buffer content from a live stream
+    // ...so need to wait on pipeline signalling it is ready to play
+    LOG(kMedia, "ProtocolHls::Stream live stream waiting to be (re-)started\n");
+    StopSegments();
+    iSegmentStreamer.Close();
+    iM3uReader.Close();
+    iSem.Wait();
+    LOG(kMedia, "ProtocolHls::Stream live stream restart\n");
 
     // Convert hls:// scheme to http:// scheme
     const Brx& uriHlsBuf = uriHls.AbsoluteUri();
@@ -849,7 +1997,7 @@ ProtocolStreamResult ProtocolHls::Stream(const Brx& aUri)
     //iSegmentStreamer.ReadInterrupt();
     //iM3uReader.Interrupt();
     iM3uReader.SetUri(uriHttp);
-    iSegmentStreamer.Stream(iM3uReader);
+    StreamSegments();
 
     if (iContentProcessor == nullptr) {
         iContentProcessor = iProtocolManager->GetAudioProcessor();
@@ -884,6 +2032,15 @@ ProtocolStreamResult ProtocolHls::Stream(const Brx& aUri)
             res = EProtocolStreamStopped;
             break;
         }
+        else if (iSegmentStreamer.VariantChanged()) {
+            // Next segment is from another variant, which may use a different bitrate or codec.
+            // Ramp down the audio output so far then start a new stream for the codec to
+            // recognise, so that audio from the new variant ramps up.
+            LOG(kMedia, "ProtocolHls::Stream variant changed\n");
+            iSupply->OutputStreamInterrupted();
+            StartStream(uriHls);
+            res = EProtocolStreamErrorRecoverable;
+        }
         else if (iM3uReader.StreamEnded()) { // FIXME - what if we've processed end of playlist, but encountered problem while trying to play one segment? Report recoverable error?
             res = EProtocolStreamSuccess;
             break;
@@ -903,8 +2060,8 @@ ProtocolStreamResult ProtocolHls::Stream(const Brx& aUri)
             // - connection/socket errors (for playlist/segments)
             // - stream discontinuity exceptions
 
-            iSegmentStreamer.ReadInterrupt();
-            iM3uReader.Interrupt();
+            InterruptSegments();
+            StopSegments();
             // Close() flushes underlying readers in M3U/segment helpers.
             iSegmentStreamer.Close();
             iM3uReader.Close();
@@ -922,7 +2079,7 @@ ProtocolStreamResult ProtocolHls::Stream(const Brx& aUri)
 
             Reinitialise();
             iM3uReader.SetUri(uriHttp);
-            iSegmentStreamer.Stream(iM3uReader);
+            StreamSegments();
             iContentProcessor = iProtocolManager->GetAudioProcessor();
 
             StartStream(uriHls);    // Output new MsgEncodedStream to signify discontinuity.
@@ -930,8 +2087,8 @@ ProtocolStreamResult ProtocolHls::Stream(const Brx& aUri)
     }
 
     // Streaming helpers MUST be interrupted before being Close()d/restarted.
-    iSegmentStreamer.ReadInterrupt();
-    iM3uReader.Interrupt();
+    InterruptSegments();
+    StopSegments();
     iSegmentStreamer.Close();
     iM3uReader.Close();
 
@@ -993,8 +2150,7 @@ TUint ProtocolHls::TryStop(TUint aStreamId)
             iNextFlushId = iFlushIdProvider->NextFlushId();
         }
         iStopped = true;
-        iSegmentStreamer.ReadInterrupt();
-        iM3uReader.Interrupt();
+        InterruptSegments();
         iSem.Signal();
     }
     const TUint nextFlushId = iNextFlushId;
@@ -1041,3 +2197,31 @@ void ProtocolHls::WaitForDrain()
     iSupply->OutputDrain(MakeFunctor(semDrain, &Semaphore::Signal));
     semDrain.Wait();
 }
+
+void ProtocolHls::StreamSegments()
+{
+    if (iPrefetcher == nullptr) {
+        iSegmentStreamer.Stream(iM3uReader, &iM3uReader);
+    }
+    else {
+        iPrefetcher->Start(iM3uReader, &iM3uReader);
+        iSegmentStreamer.Stream(*iPrefetcher);
+    }
+}
+
+void ProtocolHls::InterruptSegments()
+{
+    iSegmentStreamer.ReadInterrupt();
+    if (iPrefetcher != nullptr) {
+        iPrefetcher->Interrupt();
+    }
+    iM3uReader.Interrupt();
+}
+
+void ProtocolHls::StopSegments()
+{
+    // Prefetcher threads may be waiting on iM3uReader so it must have been interrupted before this is called
+    if (iPrefetcher != nullptr) {
+        iPrefetcher->Stop();
+    }
+}
@@ -5,15 +5,20 @@
 #include <OpenHome/Private/Http.h>
 #include <OpenHome/Buffer.h>
 #include <OpenHome/Private/Uri.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
 #include <OpenHome/Media/Supply.h>
 
 #include <algorithm>
+#include <vector>
 
 EXCEPTION(HlsVariantPlaylistError);
 EXCEPTION(HlsEndOfStream);
 EXCEPTION(HlsSegmentError);
 EXCEPTION(HlsReaderError);
 EXCEPTION(HlsDiscontinuityError);
+EXCEPTION(HlsVariantChanged);
 
 
 namespace OpenHome {
@@ -47,10 +52,17 @@ class ISegmentUriProvider
 {
 public:
     virtual TUint NextSegmentUri(Uri& aUri) = 0;    // returns segment duration (in milliseconds)
-                                                    // THROWS HlsVariantPlaylistError, HlsEndOfStream.
+                                                    // THROWS HlsVariantPlaylistError, HlsEndOfStream, HlsVariantChanged.
     virtual ~ISegmentUriProvider() {}
 };
 
+class ISegmentThroughputObserver
+{
+public:
+    virtual void NotifySegmentDownloaded(TUint aBytes, TUint aDownloadMs) = 0; // aDownloadMs excludes any time spent waiting to be read
+    virtual ~ISegmentThroughputObserver() {}
+};
+
 class IHlsReader
 {
 public:
@@ -59,7 +71,50 @@ public:
     virtual ~IHlsReader() {}
 };
 
-class HlsM3uReader : public IHlsTimerHandler, public ISegmentUriProvider
+/*
+Chooses which variant of a master playlist to stream from.
+
+Throughput is estimated from the time taken to download segments.  Streaming switches down
+as soon as the current variant's bandwidth can't be sustained and less than kMinHeadroomMs
+of audio is buffered.  It switches up one variant at a time, once kSegmentsBeforeUp segments
+have been downloaded since the last switch, the estimate is enough for the next variant and at
+least kUpHeadroomMs of audio is buffered.
+*/
+class HlsVariantSelector
+{
+public:
+    static const TUint kHeadroomUnknown = 0xffffffff;
+    static const TUint kUsablePercent = 80;             // of estimated throughput
+    static const TUint kMinHeadroomMs = 8 * 1000;
+    static const TUint kUpHeadroomMs = 16 * 1000;
+    static const TUint kSegmentsBeforeUp = 3;
+public:
+    HlsVariantSelector();
+    void Reset();
+    void AddVariant(TUint aBandwidth);  // bits per second.  Variants must be added in order of increasing bandwidth
+    TUint Count() const;
+    void SetCurrent(TUint aIndex);
+    TUint Current() const;
+    void SegmentDownloaded(TUint aBytes, TUint aDownloadMs);
+    TUint Select(TUint aHeadroomMs);    // returns index of the variant to read the next segment from
+    TUint ThroughputBps() const;        // 0 if no segments have been downloaded
+private:
+    std::vector<TUint> iBandwidths;
+    TUint iCurrent;
+    TUint64 iThroughput;
+    TUint iSegments;                    // downloaded since the last switch
+};
+
+/*
+Reads segment uris from a media playlist, reloading it as required.
+
+If given a master playlist, segments are read from one of its variants, preferring
+audio-only variants if there are any.  Streaming starts with the highest bandwidth variant
+then switches between variants at segment boundaries as suggested by a HlsVariantSelector,
+using throughput reported via ISegmentThroughputObserver and the amount of encoded audio
+buffered by the pipeline.  NextSegmentUri() throws HlsVariantChanged once at each switch.
+*/
+class HlsM3uReader : public IHlsTimerHandler, public ISegmentUriProvider, public ISegmentThroughputObserver
 {
 private:
     static const TUint kMaxM3uVersion = 2;
@@ -67,6 +122,8 @@ private:
     static const TUint kMaxLineBytes = 2048;
 public:
     HlsM3uReader(IHttpSocket& aSocket, IReader& aReader, IHlsTimer& aTimer, ISemaphore& aSemaphore);
+    ~HlsM3uReader();
+    void SetReservoirLevel(IEncodedReservoirLevel& aReservoirLevel);
     void SetUri(const Uri& aUri);
     TUint Version() const;
     TBool StreamEnded() const;
@@ -78,11 +135,28 @@ public: // from IHlsTimerHandler
     void TimerFired() override;
 public: // from ISegmentUriProvider
     TUint NextSegmentUri(Uri& aUri) override;
+public: // from ISegmentThroughputObserver
+    void NotifySegmentDownloaded(TUint aBytes, TUint aDownloadMs) override;
+private:
+    class Variant : private INonCopyable
+    {
+    public:
+        Variant(const Brx& aUri, TUint aBandwidth, TBool aAudioOnly);
+    public:
+        Bwh iUri;
+        TUint iBandwidth;
+        TBool iAudioOnly;
+    };
 private:
     void ReadNextLine();
     TBool ReloadVariantPlaylist();
     TBool PreprocessM3u();
     void SetSegmentUri(Uri& aUri, const Brx& aSegmentUri);
+    void ReadVariant(const Brx& aAttributes);
+    void SelectInitialVariant();
+    TBool TrySwitchVariant();
+    TUint HeadroomMs() const;
+    void ClearVariants();
 private:
     IHlsTimer& iTimer;
     IHttpSocket& iSocket;
@@ -101,14 +175,19 @@ private:
     ISemaphore& iSem;
     TBool iInterrupted;
     TBool iError;
+    IEncodedReservoirLevel* iReservoirLevel;
+    std::vector<Variant*> iVariants;    // from master playlist, in order of increasing bandwidth
+    TBool iMasterPlaylist;              // variants are being read from the playlist at iUri
+    HlsVariantSelector iSelector;
 };
 
 class SegmentStreamer : public IReader
 {
 public:
-    SegmentStreamer(IHttpSocket& aSocket, IReader& aReader);
-    void Stream(ISegmentUriProvider& aSegmentUriProvider);
+    SegmentStreamer(Environment& aEnv, IHttpSocket& aSocket, IReader& aReader);
+    void Stream(ISegmentUriProvider& aSegmentUriProvider, ISegmentThroughputObserver* aObserver = nullptr);
     TBool Error() const;
+    TBool VariantChanged() const;   // last Read() stopped before the first segment of a new variant
     void Close();
 public: // from IReader
     Brn Read(TUint aBytes) override;
@@ -118,17 +197,207 @@ private:
     void GetNextSegment();
     void EnsureSegmentIsReady();
 private:
+    Environment& iEnv;
     IHttpSocket& iSocket;
     IReader& iReader;
     ISegmentUriProvider* iSegmentUriProvider;
+    ISegmentThroughputObserver* iObserver;
     OpenHome::Uri iUri;
     TBool iConnected;
     TUint64 iTotalBytes;
     TUint64 iOffset;
+    TUint iDownloadMs;
     TBool iInterrupted;
     TBool iError;
+    TBool iVariantChanged;
     Mutex iLock;
 };
 
+/*
+Http reader for media segments that keeps its connection open between segments.
+
+Connect() reuses the connection to the previous segment's server if all of the previous
+response was read and the server didn't ask for the connection to be closed.  If the
+server closed a reused connection while it was idle, a new one is made and the request
+retried.
+ReadInterrupt() applies to any Connect() or Read() until Close() is next called.
+*/
+class HlsSegmentReader : public IHlsReader, private IHttpSocket, private IReader, private INonCopyable
+{
+private:
+    static const TUint kHttpPort = 80;
+    static const TUint kReadBufferBytes = 8 * 1024;
+    static const TUint kMaxHeaderBytes = 2048;
+    static const TUint kWriteBufferBytes = 1024;
+    static const TUint kConnectTimeoutMs = 3000;
+    static const TUint kResponseTimeoutMs = 10 * 1000;
+    static const TUint kMaxRedirects = 5;
+public:
+    HlsSegmentReader(Environment& aEnv, const Brx& aUserAgent);
+    ~HlsSegmentReader();
+public: // from IHlsReader
+    IHttpSocket& Socket() override;
+    IReader& Reader() override;
+private: // from IHttpSocket
+    TUint Connect(const Uri& aUri) override;
+    void Close() override;
+    TUint ContentLength() const override;
+private: // from IReader
+    Brn Read(TUint aBytes) override;
+    void ReadFlush() override;
+    void ReadInterrupt() override;
+private:
+    TUint SendRequest(const Uri& aUri);
+    TUint WriteRequest(const Uri& aUri, TUint aPort, TBool& aResponseReceived);
+    TBool Open(const Uri& aUri, TUint aPort);
+    void CloseSocket();
+    TBool CanKeepAlive() const;
+private:
+    Environment& iEnv;
+    Bwh iUserAgent;
+    SocketTcpClient iTcpClient;
+    HttpHeaderContentLength iHeaderContentLength;
+    HttpHeaderLocation iHeaderLocation;
+    HttpHeaderTransferEncoding iHeaderTransferEncoding;
+    HttpHeaderConnection iHeaderConnection;
+    Srs<kReadBufferBytes> iReadBuffer;
+    ReaderUntilS<kMaxHeaderBytes> iReaderUntil;
+    ReaderHttpResponse iReaderResponse;
+    Sws<kWriteBufferBytes> iWriteBuffer;
+    WriterHttpRequest iWriterRequest;
+    ReaderHttpChunked iDechunker;
+    Mutex iLock;
+    TBool iSocketIsOpen;
+    TBool iInterrupted;
+    TBool iConnected;   // response to the last request has been read
+    TBool iKeepAlive;   // connection to iHost:iPort can be reused for the next request
+    Bws<Uri::kMaxUriBytes> iHost;
+    TUint iPort;
+    TUint iTotalBytes;
+    TUint iOffset;
+};
+
+/*
+Fetches segments ahead of the one being read.
+
+Each reader passed to the constructor has its own thread and a buffer of aSlotBytes.  Readers
+take segment uris, in order, from the provider passed to Start() whenever they are free, then
+download the segment into their buffer.  A reader waiting for the variant playlist to be
+reloaded doesn't hold up segments that other readers are already fetching, and connection
+setup for later segments overlaps reading of the current one.
+
+Segments are passed on in order via ISegmentUriProvider and IHlsReader, so a SegmentStreamer
+reads from this exactly as it would from a single http reader.  Errors thrown by the provider
+are passed on once all segments before them have been read.
+
+Throughput is measured over the time any reader is connecting or reading, so it reflects the
+connection as a whole rather than one of several concurrent downloads.  It is reported to the
+observer passed to Start() each time a segment is downloaded.
+*/
+class SegmentPrefetcher : public ISegmentUriProvider, public IHlsReader, private IHttpSocket, private IReader, private INonCopyable
+{
+public:
+    static const TUint kSlotBytesDefault = 128 * 1024;
+private:
+    static const TUint kReadBytes = 4 * 1024;
+public:
+    SegmentPrefetcher(Environment& aEnv, const std::vector<IHlsReader*>& aReaders, TUint aSlotBytes = kSlotBytesDefault); // takes ownership of aReaders
+    ~SegmentPrefetcher();
+    void Start(ISegmentUriProvider& aProvider, ISegmentThroughputObserver* aObserver = nullptr);
+    void Interrupt();
+    void Stop(); // aProvider must have been interrupted.  Returns once no reader is fetching.
+public: // from ISegmentUriProvider
+    TUint NextSegmentUri(Uri& aUri) override;
+public: // from IHlsReader
+    IHttpSocket& Socket() override;
+    IReader& Reader() override;
+private: // from IHttpSocket
+    TUint Connect(const Uri& aUri) override;
+    void Close() override;
+    TUint ContentLength() const override;
+private: // from IReader
+    Brn Read(TUint aBytes) override;
+    void ReadFlush() override;
+    void ReadInterrupt() override;
+private:
+    enum ESlotState
+    {
+        eIdle,
+        eUri,           // waiting on provider
+        eConnecting,
+        eFetching,
+        eComplete,
+        eFailed
+    };
+    enum EUriResult
+    {
+        eUriOk,
+        eUriVariantPlaylistError,
+        eUriEndOfStream,
+        eUriReaderError,
+        eUriDiscontinuity,
+        eUriVariantChanged
+    };
+    class Slot : private INonCopyable
+    {
+    public:
+        Slot(SegmentPrefetcher& aOwner, IHlsReader* aReader, TUint aBytes);
+        ~Slot();
+        void Reset();
+        TUint Available() const;
+    private:
+        void Run();
+    public:
+        SegmentPrefetcher& iOwner;
+        IHlsReader* iReader;
+        Semaphore iSem;
+        Bwh iData;          // ring buffer
+        ThreadFunctor* iThread;
+        ESlotState iState;
+        TBool iBusy;        // thread is using iReader or the provider
+        TUint64 iSequence;
+        Uri iUri;
+        TUint iDuration;
+        EUriResult iUriResult;
+        TUint iCode;
+        TUint iContentLength;
+        TUint64 iWritten;
+        TUint64 iRead;
+    };
+private:
+    void Run(Slot& aSlot);
+    TBool WaitForWork(Slot& aSlot);
+    TBool FetchUri(Slot& aSlot);
+    void Fetch(Slot& aSlot);
+    TUint WaitForSpace(Slot& aSlot);
+    void Release(Slot& aSlot);
+    Slot* FindSequence(TUint64 aSequence) const;
+    void BeginTransfer();
+    void EndTransfer(TUint aBytes);
+    void ReportThroughput();
+private:
+    Environment& iEnv;
+    std::vector<Slot*> iSlots;
+    mutable Mutex iLock;
+    Mutex iUriLock;             // held while a reader calls the provider so uris are taken in order
+    Semaphore iConsumerSem;
+    Semaphore iIdleSem;
+    ISegmentUriProvider* iProvider;
+    ISegmentThroughputObserver* iObserver;
+    TBool iRunning;
+    TBool iInterrupted;
+    TBool iUriFailed;           // provider threw; no more uris are fetched until the next Start()
+    TBool iQuit;
+    TUint64 iNextSequence;      // for the next uri taken from the provider
+    TUint64 iReadSequence;      // for the next uri passed on from NextSegmentUri()
+    Slot* iPending;             // uri passed on from NextSegmentUri(), not yet Connect()ed
+    Slot* iCurrent;             // segment being read
+    Bws<kReadBytes> iReadBuf;
+    TUint iTransfers;           // readers currently connecting or reading
+    TUint iTransferStart;       // time (ms) iTransfers last became non-zero
+    TUint iTransferMs;          // since throughput was last reported...
+    TUint64 iTransferBytes;     // ...as is this
+};
+
 } // namespace Media
 } // namespace OpenHome
@@ -54,6 +54,7 @@ private:
     void Reinitialise(const Brx& aUri);
     ProtocolStreamResult DoStream();
     ProtocolGetResult DoGet(IWriter& aWriter, TUint64 aOffset, TUint aBytes);
+    TBool CanKeepAlive(TUint aBytes) const;
     ProtocolStreamResult DoSeek(TUint64 aOffset);
     ProtocolStreamResult DoLiveStream();
     void StartStream();
@@ -73,6 +74,7 @@ private:
     HttpHeaderContentLength iHeaderContentLength;
     HttpHeaderLocation iHeaderLocation;
     HttpHeaderTransferEncoding iHeaderTransferEncoding;
+    HttpHeaderConnection iHeaderConnection;
     HeaderIcyMetadata iHeaderIcyMetadata;
     Bws<kMaxUserAgentBytes> iUserAgent;
     Bws<kIcyMetadataBytes> iIcyMetadata;
@@ -96,6 +98,10 @@ private:
     ContentProcessor* iContentProcessor;
     TUint iNextFlushId;
     Semaphore iSem;
+    TBool iKeepAlive;               // connection left open by Get() to iKeepAliveHost:iKeepAlivePort
+    Bws<Uri::kMaxUriBytes> iKeepAliveHost;
+    TUint iKeepAlivePort;
+    TBool iGetResponseReceived;
 };
 
 };  // namespace Media
@@ -159,16 +165,21 @@ ProtocolHttp::ProtocolHttp(Environment& aEnv, const Brx& aUserAgent)
     , iStreamId(IPipelineIdProvider::kStreamIdInvalid)
     , iSeekable(false)
     , iSem("PRTH", 0)
+    , iKeepAlive(false)
+    , iKeepAlivePort(0)
+    , iGetResponseReceived(false)
 {
     iReaderResponse.AddHeader(iHeaderContentType);
     iReaderResponse.AddHeader(iHeaderContentLength);
     iReaderResponse.AddHeader(iHeaderLocation);
     iReaderResponse.AddHeader(iHeaderTransferEncoding);
+    iReaderResponse.AddHeader(iHeaderConnection);
     iReaderResponse.AddHeader(iHeaderIcyMetadata);
 }
 
 ProtocolHttp::~ProtocolHttp()
 {
+    Close();
     delete iSupply;
 }
 
@@ -193,6 +204,7 @@ void ProtocolHttp::Interrupt(TBool aInterrupt)
 
 ProtocolStreamResult ProtocolHttp::Stream(const Brx& aUri)
 {
+    iKeepAlive = false; // any connection left open by Get() is closed by WriteRequest()
     Reinitialise(aUri);
     if (iUri.Scheme() != Brn("http")) {
         return EProtocolErrorNotSupported;
@@ -270,19 +282,38 @@ ProtocolGetResult ProtocolHttp::Get(IWriter& aWriter, const Brx& aUri, TUint64 a
 
     if (iUri.Scheme() != Brn("http")) {
         LOG(kMedia, "ProtocolHttp::Get Scheme not recognised\n");
+        iKeepAlive = false;
         Close();
         return EProtocolGetErrorNotSupported;
     }
 
-    Close();
-    if (!Connect(iUri, 80)) {
-        LOG(kMedia, "ProtocolHttp::Get Connection failure\n");
-        return EProtocolGetErrorUnrecoverable;
+    /* Out-of-band reads tend to come in bursts to the same server (e.g. an MPEG4 container
+       parsing a moov box at the end of a file) so keep the connection open between them. */
+    const TUint port = (iUri.Port() == -1? 80 : (TUint)iUri.Port());
+    const TBool reuse = (iKeepAlive && iKeepAlivePort == port && iKeepAliveHost == iUri.Host());
+    iKeepAlive = false;
+    ProtocolGetResult res = EProtocolGetErrorUnrecoverable;
+    if (reuse) {
+        res = DoGet(aWriter, aOffset, aBytes);
+    }
+    if (!reuse || (res != EProtocolGetSuccess && !iGetResponseReceived)) {
+        // no connection to reuse or the server closed it while idle
+        Close();
+        if (!Connect(iUri, 80)) {
+            LOG(kMedia, "ProtocolHttp::Get Connection failure\n");
+            return EProtocolGetErrorUnrecoverable;
+        }
+        res = DoGet(aWriter, aOffset, aBytes);
     }
-
-    ProtocolGetResult res = DoGet(aWriter, aOffset, aBytes);
     iTcpClient.Interrupt(false);
-    Close();
+    if (res == EProtocolGetSuccess && CanKeepAlive(aBytes)) {
+        iKeepAlive = true;
+        iKeepAliveHost.Replace(iUri.Host());
+        iKeepAlivePort = port;
+    }
+    else {
+        Close();
+    }
     LOG(kMedia, "< ProtocolHttp::Get\n");
     return res;
 }
@@ -293,7 +324,9 @@ void ProtocolHttp::Deactivated()
         iContentProcessor->Reset();
         iContentProcessor = nullptr;
     }
-    Close();
+    if (!iKeepAlive) {
+        Close();
+    }
 }
 
 EStreamPlay ProtocolHttp::OkToPlay(TUint aStreamId)
@@ -449,12 +482,12 @@ ProtocolStreamResult ProtocolHttp::DoStream()
 
 ProtocolGetResult ProtocolHttp::DoGet(IWriter& aWriter, TUint64 aOffset, TUint aBytes)
 {
+    iGetResponseReceived = false;
     try {
         LOG(kMedia, "ProtocolHttp::DoGet send request\n");
         iWriterRequest.WriteMethod(Http::kMethodGet, iUri.PathAndQuery(), Http::eHttp11);
         const TUint port = (iUri.Port() == -1? 80 : (TUint)iUri.Port());
         Http::WriteHeaderHostAndPort(iWriterRequest, iUri.Host(), port);
-        Http::WriteHeaderConnectionClose(iWriterRequest);
         TUint64 last = aOffset+aBytes;
         if (last > 0) {
             last -= 1;  // need to adjust for last byte position as request
@@ -471,6 +504,7 @@ ProtocolGetResult ProtocolHttp::DoGet(IWriter& aWriter, TUint64 aOffset, TUint a
     try {
         LOG(kMedia, "ProtocolHttp::DoGet read response\n");
         iReaderResponse.Read();
+        iGetResponseReceived = true;
 
         const TUint code = iReaderResponse.Status().Code();
         iTotalBytes = iHeaderContentLength.ContentLength();
@@ -519,6 +553,14 @@ ProtocolGetResult ProtocolHttp::DoGet(IWriter& aWriter, TUint64 aOffset, TUint a
     return EProtocolGetErrorUnrecoverable;
 }
 
+TBool ProtocolHttp::CanKeepAlive(TUint aBytes) const
+{
+    // Only reuse a connection if we've read all of the response and the server hasn't asked us to close it
+    return (iHeaderContentLength.ContentLength() == aBytes &&
+            !iHeaderTransferEncoding.IsChunked() &&
+            !iHeaderConnection.Close());
+}
+
 ProtocolStreamResult ProtocolHttp::DoSeek(TUint64 aOffset)
 {
     Interrupt(false);
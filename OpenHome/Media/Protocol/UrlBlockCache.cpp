@@ -0,0 +1,217 @@
+#include <OpenHome/Media/Protocol/UrlBlockCache.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Standard.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::Media;
+
+
+// UrlBlockCache
+
+UrlBlockCache::UrlBlockCache(IUrlBlockWriter& aUpstream, TUint aMaxBytes)
+    : iLock("UBCL")
+    , iUpstream(aUpstream)
+    , iClock(0)
+    , iShortUrl(kMaxUrlBytes)
+    , iShortOffset(0)
+{
+    const TUint count = aMaxBytes / kBlockBytes;
+    if (count >= kMinBlocks) {
+        for (TUint i=0; i<count; i++) {
+            iBlocks.push_back(new Block());
+        }
+        iFetching.reserve(kMaxFetchBlocks);
+    }
+}
+
+UrlBlockCache::~UrlBlockCache()
+{
+    for (auto it=iBlocks.begin(); it!=iBlocks.end(); ++it) {
+        delete *it;
+    }
+}
+
+TBool UrlBlockCache::TryGet(IWriter& aWriter, const Brx& aUrl, TUint64 aOffset, TUint aBytes)
+{
+    AutoMutex _(iLock);
+    const TUint64 end = aOffset + aBytes;
+    /* Every block a read covers must be cached at once.  Limiting reads to half the cache (less
+       one block for misalignment) ensures fetching the last of them can't evict the first. */
+    if (iBlocks.size() == 0 || aBytes == 0 || aUrl.Bytes() > kMaxUrlBytes ||
+        aBytes > (iBlocks.size()/2 - 1) * kBlockBytes ||
+        (aUrl == iShortUrl && end > iShortOffset)) {
+        return iUpstream.TryGet(aWriter, aUrl, aOffset, aBytes);
+    }
+
+    const TUint64 first = aOffset - (aOffset % kBlockBytes);
+    for (TUint64 offset=first; offset<end; offset+=kBlockBytes) {
+        if (Find(aUrl, offset) == nullptr && !TryFetch(aUrl, offset, end)) {
+            return iUpstream.TryGet(aWriter, aUrl, aOffset, aBytes);
+        }
+    }
+    for (TUint64 offset=first; offset<end; offset+=kBlockBytes) {
+        Block* block = Find(aUrl, offset);
+        ASSERT(block != nullptr);
+        const TUint from = (offset < aOffset? (TUint)(aOffset - offset) : 0);
+        const TUint to = (TUint)(std::min(end, offset + kBlockBytes) - offset);
+        aWriter.Write(Brn(block->iData.Ptr() + from, to - from));
+    }
+    return true;
+}
+
+UrlBlockCache::Block* UrlBlockCache::Find(const Brx& aUrl, TUint64 aOffset)
+{
+    for (auto it=iBlocks.begin(); it!=iBlocks.end(); ++it) {
+        Block* block = *it;
+        if (block->iValid && block->iOffset == aOffset && block->iUrl == aUrl) {
+            block->iLastUsed = ++iClock;
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+TBool UrlBlockCache::Cached(const Brx& aUrl, TUint64 aOffset) const
+{
+    for (auto it=iBlocks.begin(); it!=iBlocks.end(); ++it) {
+        const Block* block = *it;
+        if (block->iValid && block->iOffset == aOffset && block->iUrl == aUrl) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TBool UrlBlockCache::TryFetch(const Brx& aUrl, TUint64 aOffset, TUint64 aEnd)
+{
+    // fetch the run of missing blocks starting at aOffset, reading ahead beyond aEnd if possible
+    TUint needed = 0;
+    TUint blocks = 0;
+    for (TUint64 offset=aOffset; blocks<kMaxFetchBlocks; blocks++, offset+=kBlockBytes) {
+        if (Cached(aUrl, offset) || (aUrl == iShortUrl && offset >= iShortOffset)) {
+            break;
+        }
+        if (offset < aEnd) {
+            needed++;
+        }
+    }
+    if (needed == 0) {
+        return false;
+    }
+    if (blocks > needed) {
+        if (TryFetchBlocks(aUrl, aOffset, blocks)) {
+            return true;
+        }
+        if (TryFetchBlocks(aUrl, aOffset, needed)) {
+            SetShort(aUrl, aOffset + needed * kBlockBytes);
+            return true;
+        }
+    }
+    else if (TryFetchBlocks(aUrl, aOffset, needed)) {
+        return true;
+    }
+    SetShort(aUrl, aOffset);
+    return false;
+}
+
+TBool UrlBlockCache::TryFetchBlocks(const Brx& aUrl, TUint64 aOffset, TUint aBlocks)
+{
+    ASSERT(iFetching.size() == 0);
+    for (TUint i=0; i<aBlocks; i++) {
+        Block* block = LeastRecentlyUsed();
+        block->iValid = false;
+        block->iUrl.Replace(aUrl);
+        block->iOffset = aOffset + i * kBlockBytes;
+        block->iData.SetBytes(0);
+        block->iLastUsed = ++iClock; // don't reuse for another block in this fetch
+        iFetching.push_back(block);
+    }
+    BlockFiller filler(iFetching);
+    const TBool success = (iUpstream.TryGet(filler, aUrl, aOffset, aBlocks * kBlockBytes) && filler.Complete());
+    for (auto it=iFetching.begin(); it!=iFetching.end(); ++it) {
+        (*it)->iValid = success;
+        if (!success) {
+            (*it)->iLastUsed = 0;
+        }
+    }
+    iFetching.clear();
+    return success;
+}
+
+UrlBlockCache::Block* UrlBlockCache::LeastRecentlyUsed()
+{
+    Block* lru = iBlocks[0];
+    for (auto it=iBlocks.begin()+1; it!=iBlocks.end(); ++it) {
+        if ((*it)->iLastUsed < lru->iLastUsed) {
+            lru = *it;
+        }
+    }
+    return lru;
+}
+
+void UrlBlockCache::SetShort(const Brx& aUrl, TUint64 aOffset)
+{
+    if (aUrl == iShortUrl) {
+        iShortOffset = std::min(iShortOffset, aOffset);
+    }
+    else {
+        iShortUrl.Replace(aUrl);
+        iShortOffset = aOffset;
+    }
+}
+
+
+// UrlBlockCache::Block
+
+UrlBlockCache::Block::Block()
+    : iUrl(kMaxUrlBytes)
+    , iData(kBlockBytes)
+    , iOffset(0)
+    , iLastUsed(0)
+    , iValid(false)
+{
+}
+
+
+// UrlBlockCache::BlockFiller
+
+UrlBlockCache::BlockFiller::BlockFiller(std::vector<Block*>& aBlocks)
+    : iBlocks(aBlocks)
+    , iIndex(0)
+{
+}
+
+TBool UrlBlockCache::BlockFiller::Complete() const
+{
+    return (iIndex == iBlocks.size());
+}
+
+void UrlBlockCache::BlockFiller::Write(TByte aValue)
+{
+    Write(Brn(&aValue, 1));
+}
+
+void UrlBlockCache::BlockFiller::Write(const Brx& aBuffer)
+{
+    TUint offset = 0;
+    while (offset < aBuffer.Bytes() && iIndex < iBlocks.size()) {
+        Bwx& data = iBlocks[iIndex]->iData;
+        const TUint bytes = std::min(aBuffer.Bytes() - offset, data.MaxBytes() - data.Bytes());
+        data.Append(aBuffer.Ptr() + offset, bytes);
+        offset += bytes;
+        if (data.Bytes() == data.MaxBytes()) {
+            iIndex++;
+        }
+    }
+}
+
+void UrlBlockCache::BlockFiller::WriteFlush()
+{
+}
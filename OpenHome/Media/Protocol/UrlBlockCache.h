@@ -0,0 +1,83 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Standard.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+
+#include <vector>
+
+namespace OpenHome {
+namespace Media {
+
+/*
+Cache of out-of-band reads (e.g. an MPEG4 moov box at the end of a file).
+
+Reads are served from fixed size, aligned blocks keyed by (url, offset).  Missing blocks
+are fetched from aUpstream in a single range read that also reads ahead into the following
+blocks, so a container reading a few KB at a time costs one request per kMaxFetchBlocks
+blocks rather than one per read.  Least recently used blocks are evicted once aMaxBytes
+of blocks are in use.
+
+Blocks are only cached when aUpstream can supply all of them.  A read that can't be
+satisfied this way (typically one close to the end of a stream) is passed to aUpstream unchanged.
+*/
+
+class UrlBlockCache : public IUrlBlockWriter, private INonCopyable
+{
+public:
+    static const TUint kBlockBytes = 16 * 1024;
+    static const TUint kMaxFetchBlocks = 4;
+    static const TUint kMinBlocks = 2 * kMaxFetchBlocks;
+    static const TUint kMaxUrlBytes = 1024;
+public:
+    UrlBlockCache(IUrlBlockWriter& aUpstream, TUint aMaxBytes); // caching is disabled if aMaxBytes < kMinBlocks * kBlockBytes
+    ~UrlBlockCache();
+public: // from IUrlBlockWriter
+    TBool TryGet(IWriter& aWriter, const Brx& aUrl, TUint64 aOffset, TUint aBytes) override;
+private:
+    class Block : private INonCopyable
+    {
+    public:
+        Block();
+    public:
+        Bwh iUrl;
+        Bwh iData;
+        TUint64 iOffset;
+        TUint64 iLastUsed;
+        TBool iValid;
+    };
+    class BlockFiller : public IWriter, private INonCopyable
+    {
+    public:
+        BlockFiller(std::vector<Block*>& aBlocks);
+        TBool Complete() const;
+    public: // from IWriter
+        void Write(TByte aValue) override;
+        void Write(const Brx& aBuffer) override;
+        void WriteFlush() override;
+    private:
+        std::vector<Block*>& iBlocks;
+        TUint iIndex;
+    };
+private:
+    Block* Find(const Brx& aUrl, TUint64 aOffset); // marks any block found as recently used
+    TBool Cached(const Brx& aUrl, TUint64 aOffset) const;
+    TBool TryFetch(const Brx& aUrl, TUint64 aOffset, TUint64 aEnd);
+    TBool TryFetchBlocks(const Brx& aUrl, TUint64 aOffset, TUint aBlocks);
+    Block* LeastRecentlyUsed();
+    void SetShort(const Brx& aUrl, TUint64 aOffset);
+private:
+    Mutex iLock;
+    IUrlBlockWriter& iUpstream;
+    std::vector<Block*> iBlocks;
+    std::vector<Block*> iFetching;
+    TUint64 iClock;
+    Bwh iShortUrl;          // stream that couldn't supply all of a fetch...
+    TUint64 iShortOffset;   // ...at or after this offset.  Reads beyond here aren't cached.
+};
+
+} // namespace Media
+} // namespace OpenHome
@@ -61,6 +61,15 @@ void Supply::OutputData(const Brx& aData)
     iDownStreamElement.Push(msg);
 }
 
+void Supply::OutputData(IEncodedAudioSource& aSource, const Brx& aData)
+{
+    if (aData.Bytes() == 0) {
+        return;
+    }
+    MsgAudioEncoded* msg = iMsgFactory.CreateMsgAudioEncoded(aSource, aData);
+    iDownStreamElement.Push(msg);
+}
+
 void Supply::OutputMetadata(const Brx& aMetadata)
 {
     MsgMetaText* msg = iMsgFactory.CreateMsgMetaText(aMetadata);
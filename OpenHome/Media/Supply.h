@@ -18,6 +18,11 @@ class Supply : public ISupply, private INonCopyable
 public:
     Supply(MsgFactory& aMsgFactory, IPipelineElementDownstream& aDownStreamElement);
     virtual ~Supply();
+    /*
+     * Push a block of encoded audio into the pipeline without copying it.
+     * aData must be owned by aSource and be <= EncodedAudio::kMaxBytes.
+     */
+    void OutputData(IEncodedAudioSource& aSource, const Brx& aData);
 public: // from ISupply
     void OutputTrack(Track& aTrack, TBool aStartOfStream = true) override;
     void OutputDrain(Functor aCallback) override;
@@ -0,0 +1,784 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Codec/DecodeAhead.h>
+#include <OpenHome/Media/Codec/CodecController.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Media/Utils/AllocatorInfoLogger.h>
+#include <OpenHome/Private/Thread.h>
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media;
+using namespace OpenHome::Media::Codec;
+
+namespace OpenHome {
+namespace Media {
+namespace Codec {
+
+class SuiteDecodeAhead : public SuiteUnitTest
+                       , private IPipelineElementUpstream
+                       , private IPipelineElementDownstream
+                       , private IDecodeAheadSegments
+{
+    static const TUint kMaxReadAheadBytes = EncodedAudio::kMaxBytes * 64;
+    static const TUint kMaxHeldJiffies = Jiffies::kPerMs * 100;
+    static const TUint kMaxHeldMsgs = 20;
+public:
+    SuiteDecodeAhead();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private: // from IPipelineElementUpstream
+    Msg* Pull() override;
+private: // from IPipelineElementDownstream
+    void Push(Msg* aMsg) override;
+private: // from IDecodeAheadSegments
+    TBool IsSegmentEnd(TUint aIndex, const Msg* aMsg) override;
+private:
+    void TestDisabledRoutesToFirstOutput();
+    void TestSegmentsAlternate();
+    void TestTrackWithinStreamNotBoundary();
+    void TestIdleOutputReadsAhead();
+    void TestReadAheadLimited();
+    void TestSplicerPassesCurrentInput();
+    void TestSplicerDrainsHeldOnSegmentEnd();
+    void TestSplicerNestedSegmentEnds();
+    void TestSplicerBlocksWhenFull();
+    void TestSplicerReleaseCallbacks();
+private:
+    void AddTrack(TBool aStartOfStream);
+    void AddStream();
+    void AddAudio(TUint aCount);
+    void AddQuit();
+    TUint PendingCount();
+    MsgHalt* AddMarker(TUint aIndex);
+    void PullOutput1();
+    void PushHeld();
+    void Released();
+    static TBool IsHalt(Msg* aMsg);
+    static TBool IsQuit(Msg* aMsg);
+private:
+    AllocatorInfoLogger iInfoAggregator;
+    MsgFactory* iMsgFactory;
+    TrackFactory* iTrackFactory;
+    Mutex iLock;
+    std::list<Msg*> iPendingMsgs;
+    std::vector<Msg*> iPushed;
+    std::vector<const Msg*> iMarkers[DecodeAheadSplitter::kNumOutputs];
+    DecodeAheadSplitter* iSplitter;
+    DecodeAheadSplicer* iSplicer;
+    Msg* iPulled;
+    std::vector<Msg*> iToPush;
+    Semaphore iThreadComplete;
+    TUint iStreamId;
+    std::vector<TUint> iPushedAtRelease;
+};
+
+// Recognises streams whose first byte is kRecognisedByte, outputting the rest as 16-bit stereo pcm
+class DecodeAheadTestCodec : public CodecBase
+{
+public:
+    static const TByte kRecognisedByte = 0x7f;
+private:
+    static const TUint kReadBytes = 1024;
+    static const TUint kSampleRate = 44100;
+public:
+    DecodeAheadTestCodec();
+private: // from CodecBase
+    TBool Recognise(const EncodedStreamInfo& aStreamInfo) override;
+    void StreamInitialise() override;
+    void Process() override;
+    TBool TrySeek(TUint aStreamId, TUint64 aSample) override;
+private:
+    Bws<kReadBytes> iReadBuf;
+    TUint64 iTrackOffset;
+};
+
+class SuiteDecodeAheadRecognition : public SuiteUnitTest
+                                  , private IPipelineElementUpstream
+                                  , private IPipelineElementDownstream
+                                  , private IStreamHandler
+                                  , private IUrlBlockWriter
+{
+    static const TUint kMaxReadAheadBytes = EncodedAudio::kMaxBytes * 64;
+    static const TUint kMaxHeldJiffies = Jiffies::kPerMs * 100;
+    static const TUint kMaxHeldMsgs = 20;
+    static const TUint kAudioBytes = 1024;
+public:
+    SuiteDecodeAheadRecognition();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private: // from IPipelineElementUpstream
+    Msg* Pull() override;
+private: // from IPipelineElementDownstream
+    void Push(Msg* aMsg) override;
+private: // from IStreamHandler
+    EStreamPlay OkToPlay(TUint aStreamId) override;
+    TUint TrySeek(TUint aStreamId, TUint64 aOffset) override;
+    TUint TryStop(TUint aStreamId) override;
+    void NotifyStarving(const Brx& aMode, TUint aStreamId, TBool aStarving) override;
+private: // from IUrlBlockWriter
+    TBool TryGet(IWriter& aWriter, const Brx& aUrl, TUint64 aOffset, TUint aBytes) override;
+private:
+    void TestUnrecognisedNextTrackStoppedAfterSplice();
+private:
+    void AddTrack(TUint aStreamId, TByte aAudioByte, TUint aAudioCount);
+private:
+    AllocatorInfoLogger iInfoAggregator;
+    MsgFactory* iMsgFactory;
+    TrackFactory* iTrackFactory;
+    DecodeAhead* iDecodeAhead;
+    Mutex iLock;
+    std::list<Msg*> iPendingMsgs;
+    std::vector<Msg*> iPushed;
+    TUint iTracksPushed;
+    TBool iBlockOnDecodedStream;
+    Semaphore iSemDecodedStream;
+    Semaphore iSemRelease;
+    Semaphore iSemQuit;
+    std::vector<TUint> iOkToPlayStreams;
+    std::vector<TUint> iTryStopStreams;
+    TUint iTracksPushedAtOkToPlay;
+};
+
+} // namespace Codec
+} // namespace Media
+} // namespace OpenHome
+
+
+// SuiteDecodeAhead
+
+SuiteDecodeAhead::SuiteDecodeAhead()
+    : SuiteUnitTest("DecodeAhead")
+    , iLock("SDAH")
+    , iThreadComplete("SDAH", 0)
+{
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestDisabledRoutesToFirstOutput), "TestDisabledRoutesToFirstOutput");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestSegmentsAlternate), "TestSegmentsAlternate");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestTrackWithinStreamNotBoundary), "TestTrackWithinStreamNotBoundary");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestIdleOutputReadsAhead), "TestIdleOutputReadsAhead");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestReadAheadLimited), "TestReadAheadLimited");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestSplicerPassesCurrentInput), "TestSplicerPassesCurrentInput");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestSplicerDrainsHeldOnSegmentEnd), "TestSplicerDrainsHeldOnSegmentEnd");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestSplicerNestedSegmentEnds), "TestSplicerNestedSegmentEnds");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestSplicerBlocksWhenFull), "TestSplicerBlocksWhenFull");
+    AddTest(MakeFunctor(*this, &SuiteDecodeAhead::TestSplicerReleaseCallbacks), "TestSplicerReleaseCallbacks");
+}
+
+void SuiteDecodeAhead::Setup()
+{
+    MsgFactoryInitParams init;
+    init.SetMsgTrackCount(10);
+    init.SetMsgEncodedStreamCount(10);
+    init.SetMsgAudioEncodedCount(100, 100);
+    init.SetMsgSilenceCount(30);
+    init.SetMsgHaltCount(10);
+    init.SetMsgQuitCount(4);
+    iMsgFactory = new MsgFactory(iInfoAggregator, init);
+    iTrackFactory = new TrackFactory(iInfoAggregator, 10);
+    iSplitter = new DecodeAheadSplitter(*iMsgFactory, *this, kMaxReadAheadBytes);
+    iSplicer = new DecodeAheadSplicer(*this, *this, kMaxHeldJiffies, kMaxHeldMsgs);
+    iPulled = nullptr;
+    iStreamId = 0;
+    iPushedAtRelease.clear();
+}
+
+void SuiteDecodeAhead::TearDown()
+{
+    delete iSplicer;
+    delete iSplitter;
+    for (auto it=iPendingMsgs.begin(); it!=iPendingMsgs.end(); ++it) {
+        (*it)->RemoveRef();
+    }
+    iPendingMsgs.clear();
+    for (auto it=iPushed.begin(); it!=iPushed.end(); ++it) {
+        (*it)->RemoveRef();
+    }
+    iPushed.clear();
+    for (TUint i=0; i<DecodeAheadSplitter::kNumOutputs; i++) {
+        iMarkers[i].clear();
+    }
+    delete iTrackFactory;
+    delete iMsgFactory;
+}
+
+Msg* SuiteDecodeAhead::Pull()
+{
+    AutoMutex _(iLock);
+    ASSERT(iPendingMsgs.size() > 0);
+    Msg* msg = iPendingMsgs.front();
+    iPendingMsgs.pop_front();
+    return msg;
+}
+
+void SuiteDecodeAhead::Push(Msg* aMsg)
+{
+    AutoMutex _(iLock);
+    iPushed.push_back(aMsg);
+}
+
+TBool SuiteDecodeAhead::IsSegmentEnd(TUint aIndex, const Msg* aMsg)
+{
+    auto& markers = iMarkers[aIndex];
+    if (markers.size() == 0 || markers[0] != aMsg) {
+        return false;
+    }
+    markers.erase(markers.begin());
+    return true;
+}
+
+void SuiteDecodeAhead::AddTrack(TBool aStartOfStream)
+{
+    Track* track = iTrackFactory->CreateTrack(Brx::Empty(), Brx::Empty());
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgTrack(*track, aStartOfStream));
+    track->RemoveRef();
+}
+
+void SuiteDecodeAhead::AddStream()
+{
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgEncodedStream(Brn("http://127.0.0.1:65535"), Brn("metatext"), 0, 0, ++iStreamId, false, false, nullptr));
+}
+
+void SuiteDecodeAhead::AddAudio(TUint aCount)
+{
+    TByte data[EncodedAudio::kMaxBytes] = { 0 };
+    const Brn buf(data, sizeof(data));
+    for (TUint i=0; i<aCount; i++) {
+        iPendingMsgs.push_back(iMsgFactory->CreateMsgAudioEncoded(buf));
+    }
+}
+
+void SuiteDecodeAhead::AddQuit()
+{
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgQuit());
+}
+
+TUint SuiteDecodeAhead::PendingCount()
+{
+    AutoMutex _(iLock);
+    return (TUint)iPendingMsgs.size();
+}
+
+MsgHalt* SuiteDecodeAhead::AddMarker(TUint aIndex)
+{
+    MsgHalt* marker = iMsgFactory->CreateMsgHalt();
+    iMarkers[aIndex].push_back(marker);
+    return marker;
+}
+
+void SuiteDecodeAhead::PullOutput1()
+{
+    iPulled = iSplitter->Output(1).Pull();
+    iThreadComplete.Signal();
+}
+
+void SuiteDecodeAhead::PushHeld()
+{
+    for (auto it=iToPush.begin(); it!=iToPush.end(); ++it) {
+        iSplicer->Input(1).Push(*it);
+    }
+    iThreadComplete.Signal();
+}
+
+void SuiteDecodeAhead::Released()
+{
+    iPushedAtRelease.push_back((TUint)iPushed.size());
+}
+
+TBool SuiteDecodeAhead::IsHalt(Msg* aMsg)
+{ // static
+    return dynamic_cast<MsgHalt*>(aMsg) != nullptr;
+}
+
+TBool SuiteDecodeAhead::IsQuit(Msg* aMsg)
+{ // static
+    return dynamic_cast<MsgQuit*>(aMsg) != nullptr;
+}
+
+void SuiteDecodeAhead::TestDisabledRoutesToFirstOutput()
+{
+    iSplitter->SetEnabled(false);
+    AddTrack(true);
+    AddStream();
+    AddAudio(1);
+    AddTrack(true);
+    AddStream();
+    AddAudio(1);
+    AddQuit();
+    std::vector<Msg*> expected(iPendingMsgs.begin(), iPendingMsgs.end());
+    for (auto it=expected.begin(); it!=expected.end(); ++it) {
+        Msg* msg = iSplitter->Output(0).Pull();
+        TEST(msg == *it);
+        msg->RemoveRef();
+    }
+    TEST(iSplitter->iMarkers[0].size() == 0);
+    Msg* msg = iSplitter->Output(1).Pull();
+    TEST(IsQuit(msg));
+    msg->RemoveRef();
+}
+
+void SuiteDecodeAhead::TestSegmentsAlternate()
+{
+    iSplitter->SetEnabled(true);
+    AddTrack(true);
+    AddStream();
+    AddAudio(2);
+    AddTrack(true);
+    AddStream();
+    AddAudio(2);
+    AddTrack(true);
+    AddQuit();
+    std::vector<Msg*> upstream(iPendingMsgs.begin(), iPendingMsgs.end());
+
+    // first segment goes to output 0, terminated by a marker
+    for (TUint i=0; i<4; i++) {
+        Msg* msg = iSplitter->Output(0).Pull();
+        TEST(msg == upstream[i]);
+        msg->RemoveRef();
+    }
+    Msg* marker = iSplitter->Output(0).Pull();
+    TEST(IsHalt(marker));
+    TEST(!iSplitter->IsSegmentEnd(1, marker));
+    TEST(iSplitter->IsSegmentEnd(0, marker));
+    TEST(!iSplitter->IsSegmentEnd(0, marker)); // only claimed once
+    marker->RemoveRef();
+
+    // second segment goes to output 1
+    for (TUint i=4; i<8; i++) {
+        Msg* msg = iSplitter->Output(1).Pull();
+        TEST(msg == upstream[i]);
+        msg->RemoveRef();
+    }
+    marker = iSplitter->Output(1).Pull();
+    TEST(IsHalt(marker));
+    TEST(iSplitter->IsSegmentEnd(1, marker));
+    marker->RemoveRef();
+
+    // third segment goes back to output 0; quit reaches both outputs
+    Msg* msg = iSplitter->Output(0).Pull();
+    TEST(msg == upstream[8]);
+    msg->RemoveRef();
+    msg = iSplitter->Output(0).Pull();
+    TEST(msg == upstream[9]);
+    msg->RemoveRef();
+    msg = iSplitter->Output(1).Pull();
+    TEST(IsQuit(msg));
+    msg->RemoveRef();
+}
+
+void SuiteDecodeAhead::TestTrackWithinStreamNotBoundary()
+{
+    iSplitter->SetEnabled(true);
+    AddTrack(true);
+    AddStream();
+    AddAudio(1);
+    AddTrack(false);
+    AddAudio(1);
+    AddQuit();
+    std::vector<Msg*> upstream(iPendingMsgs.begin(), iPendingMsgs.end());
+    for (auto it=upstream.begin(); it!=upstream.end(); ++it) {
+        Msg* msg = iSplitter->Output(0).Pull();
+        TEST(msg == *it);
+        msg->RemoveRef();
+    }
+    TEST(iSplitter->iMarkers[0].size() == 0);
+    Msg* msg = iSplitter->Output(1).Pull();
+    TEST(IsQuit(msg));
+    msg->RemoveRef();
+}
+
+void SuiteDecodeAhead::TestIdleOutputReadsAhead()
+{
+    iSplitter->SetEnabled(true);
+    AddTrack(true);
+    AddStream();
+    AddAudio(4);
+    AddTrack(true);
+    AddStream();
+    AddQuit();
+    std::vector<Msg*> upstream(iPendingMsgs.begin(), iPendingMsgs.end());
+
+    Msg* msg = iSplitter->Output(0).Pull();
+    TEST(msg == upstream[0]);
+    msg->RemoveRef();
+
+    // output 1 reads past the remainder of output 0's segment to find its own start
+    msg = iSplitter->Output(1).Pull();
+    TEST(msg == upstream[6]);
+    msg->RemoveRef();
+    TEST(PendingCount() == 2);
+    TEST(iSplitter->iQueues[0].EncodedAudioCount() == 4);
+
+    for (TUint i=1; i<6; i++) {
+        msg = iSplitter->Output(0).Pull();
+        TEST(msg == upstream[i]);
+        msg->RemoveRef();
+    }
+    msg = iSplitter->Output(0).Pull();
+    TEST(iSplitter->IsSegmentEnd(0, msg));
+    msg->RemoveRef();
+    for (TUint i=7; i<9; i++) {
+        msg = iSplitter->Output(1).Pull();
+        TEST(msg == upstream[i]);
+        msg->RemoveRef();
+    }
+    msg = iSplitter->Output(0).Pull();
+    TEST(IsQuit(msg));
+    msg->RemoveRef();
+}
+
+void SuiteDecodeAhead::TestReadAheadLimited()
+{
+    const TUint kMaxAhead = 3;
+    delete iSplitter;
+    iSplitter = new DecodeAheadSplitter(*iMsgFactory, *this, EncodedAudio::kMaxBytes * kMaxAhead);
+    iSplitter->SetEnabled(true);
+    AddTrack(true);
+    AddStream();
+    AddAudio(kMaxAhead + 2);
+    AddTrack(true);
+    AddQuit();
+    const TUint total = (TUint)iPendingMsgs.size();
+    Msg* nextTrack = *(++iPendingMsgs.rbegin());
+
+    Msg* msg = iSplitter->Output(0).Pull();
+    msg->RemoveRef();
+    ThreadFunctor* th = new ThreadFunctor("SDAH", MakeFunctor(*this, &SuiteDecodeAhead::PullOutput1));
+    th->Start();
+    Thread::Sleep(50);
+    // stream plus kMaxAhead audio msgs read ahead, then output 1 waits for output 0 to catch up
+    TEST(PendingCount() == total - 2 - kMaxAhead);
+    TEST(iPulled == nullptr);
+
+    for (TUint i=0; i<kMaxAhead + 3; i++) {
+        msg = iSplitter->Output(0).Pull();
+        msg->RemoveRef();
+    }
+    iThreadComplete.Wait();
+    delete th;
+    TEST(iPulled == nextTrack);
+    iPulled->RemoveRef();
+
+    msg = iSplitter->Output(0).Pull();
+    TEST(iSplitter->IsSegmentEnd(0, msg));
+    msg->RemoveRef();
+    msg = iSplitter->Output(1).Pull();
+    TEST(IsQuit(msg));
+    msg->RemoveRef();
+    msg = iSplitter->Output(0).Pull();
+    TEST(IsQuit(msg));
+    msg->RemoveRef();
+}
+
+void SuiteDecodeAhead::TestSplicerPassesCurrentInput()
+{
+    Msg* msg = iMsgFactory->CreateMsgSilence(Jiffies::kPerMs);
+    iSplicer->Input(0).Push(msg);
+    TEST(iPushed.size() == 1);
+    TEST(iPushed[0] == msg);
+    msg = iMsgFactory->CreateMsgSilence(Jiffies::kPerMs);
+    iSplicer->Input(1).Push(msg);
+    TEST(iPushed.size() == 1);
+    TEST(iSplicer->iHeld[1].Count() == 1);
+}
+
+void SuiteDecodeAhead::TestSplicerDrainsHeldOnSegmentEnd()
+{
+    std::vector<Msg*> held;
+    for (TUint i=0; i<3; i++) {
+        held.push_back(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs));
+        iSplicer->Input(1).Push(held.back());
+    }
+    TEST(iPushed.size() == 0);
+    iSplicer->Input(0).Push(AddMarker(0));
+    TEST(iPushed.size() == held.size());
+    for (TUint i=0; i<held.size(); i++) {
+        TEST(iPushed[i] == held[i]);
+    }
+    TEST(iSplicer->iCurrent == 1);
+    TEST(!iSplicer->iDraining);
+
+    // input 1 is now passed straight through; input 0 is held
+    Msg* msg = iMsgFactory->CreateMsgSilence(Jiffies::kPerMs);
+    iSplicer->Input(1).Push(msg);
+    TEST(iPushed.size() == held.size() + 1);
+    TEST(iPushed.back() == msg);
+    iSplicer->Input(0).Push(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs));
+    TEST(iPushed.size() == held.size() + 1);
+    TEST(iSplicer->iHeld[0].Count() == 1);
+}
+
+void SuiteDecodeAhead::TestSplicerNestedSegmentEnds()
+{
+    // input 1 decodes an entire (short) segment while input 0 is still current
+    Msg* held1 = iMsgFactory->CreateMsgSilence(Jiffies::kPerMs);
+    iSplicer->Input(1).Push(held1);
+    iSplicer->Input(1).Push(AddMarker(1));
+    // ...and input 0 starts on the segment after that
+    Msg* held0 = iMsgFactory->CreateMsgSilence(Jiffies::kPerMs);
+    Msg* current = iMsgFactory->CreateMsgSilence(Jiffies::kPerMs);
+    iSplicer->Input(0).Push(current);
+    TEST(iPushed.size() == 1);
+    iSplicer->Input(0).Push(AddMarker(0));
+    TEST(iPushed.size() == 2);
+    TEST(iPushed[1] == held1);
+    TEST(iSplicer->iCurrent == 0);
+
+    iSplicer->Input(0).Push(held0);
+    TEST(iPushed.size() == 3);
+    TEST(iPushed[2] == held0);
+}
+
+void SuiteDecodeAhead::TestSplicerBlocksWhenFull()
+{
+    const TUint kMsgJiffies = kMaxHeldJiffies / 2;
+    for (TUint i=0; i<3; i++) {
+        iToPush.push_back(iMsgFactory->CreateMsgSilence(kMsgJiffies));
+    }
+    ThreadFunctor* th = new ThreadFunctor("SDAH", MakeFunctor(*this, &SuiteDecodeAhead::PushHeld));
+    th->Start();
+    Thread::Sleep(50);
+    TEST(iSplicer->iHeld[1].Count() == 2);
+    TEST(iPushed.size() == 0);
+
+    iSplicer->Input(0).Push(AddMarker(0));
+    iThreadComplete.Wait();
+    delete th;
+    TEST(iPushed.size() == iToPush.size());
+    for (TUint i=0; i<iToPush.size(); i++) {
+        TEST(iPushed[i] == iToPush[i]);
+    }
+    iToPush.clear();
+}
+
+void SuiteDecodeAhead::TestSplicerReleaseCallbacks()
+{
+    // current input's callbacks run immediately
+    iSplicer->HeldOutput(0).CallWhenReleased(MakeFunctor(*this, &SuiteDecodeAhead::Released));
+    TEST(iPushedAtRelease.size() == 1);
+    TEST(iPushedAtRelease[0] == 0);
+
+    // held input's callbacks wait until the msgs pushed before them have been spliced in
+    iSplicer->Input(1).Push(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs));
+    iSplicer->Input(1).Push(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs));
+    iSplicer->HeldOutput(1).CallWhenReleased(MakeFunctor(*this, &SuiteDecodeAhead::Released));
+    iSplicer->Input(1).Push(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs));
+    iSplicer->HeldOutput(1).CallWhenReleased(MakeFunctor(*this, &SuiteDecodeAhead::Released));
+    TEST(iPushedAtRelease.size() == 1);
+    iSplicer->Input(0).Push(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs));
+    TEST(iPushedAtRelease.size() == 1);
+
+    iSplicer->Input(0).Push(AddMarker(0));
+    TEST(iPushed.size() == 4);
+    TEST(iPushedAtRelease.size() == 3);
+    TEST(iPushedAtRelease[1] == 3);
+    TEST(iPushedAtRelease[2] == 4);
+}
+
+
+
+// DecodeAheadTestCodec
+
+DecodeAheadTestCodec::DecodeAheadTestCodec()
+    : CodecBase("TDAH", CodecBase::RecognitionComplexity::kCostLow)
+    , iTrackOffset(0)
+{
+}
+
+TBool DecodeAheadTestCodec::Recognise(const EncodedStreamInfo& /*aStreamInfo*/)
+{
+    Bws<1> buf;
+    iController->Read(buf, buf.MaxBytes());
+    return (buf.Bytes() == 1 && buf[0] == kRecognisedByte);
+}
+
+void DecodeAheadTestCodec::StreamInitialise()
+{
+    iTrackOffset = 0;
+    iController->OutputDecodedStream(0, 16, kSampleRate, 2, Brn("TDAH"), 0, 0, true);
+}
+
+void DecodeAheadTestCodec::Process()
+{
+    iReadBuf.SetBytes(0);
+    iController->Read(iReadBuf, iReadBuf.MaxBytes());
+    if (iReadBuf.Bytes() > 0) {
+        iTrackOffset += iController->OutputAudioPcm(iReadBuf, 2, kSampleRate, 16, EMediaDataEndian::EMediaDataEndianLittle, iTrackOffset);
+    }
+    if (iReadBuf.Bytes() < iReadBuf.MaxBytes()) {
+        THROW(CodecStreamEnded);
+    }
+}
+
+TBool DecodeAheadTestCodec::TrySeek(TUint /*aStreamId*/, TUint64 /*aSample*/)
+{
+    return false;
+}
+
+
+// SuiteDecodeAheadRecognition
+
+SuiteDecodeAheadRecognition::SuiteDecodeAheadRecognition()
+    : SuiteUnitTest("DecodeAheadRecognition")
+    , iLock("SDAR")
+    , iSemDecodedStream("SDAR", 0)
+    , iSemRelease("SDAR", 0)
+    , iSemQuit("SDAR", 0)
+{
+    AddTest(MakeFunctor(*this, &SuiteDecodeAheadRecognition::TestUnrecognisedNextTrackStoppedAfterSplice), "TestUnrecognisedNextTrackStoppedAfterSplice");
+}
+
+void SuiteDecodeAheadRecognition::Setup()
+{
+    MsgFactoryInitParams init;
+    init.SetMsgTrackCount(4);
+    init.SetMsgEncodedStreamCount(4);
+    init.SetMsgAudioEncodedCount(100, 100);
+    init.SetMsgAudioPcmCount(100, 100);
+    init.SetMsgDecodedStreamCount(4);
+    init.SetMsgHaltCount(4);
+    init.SetMsgQuitCount(2);
+    iMsgFactory = new MsgFactory(iInfoAggregator, init);
+    iTrackFactory = new TrackFactory(iInfoAggregator, 4);
+    iDecodeAhead = new DecodeAhead(*iMsgFactory, *this, *this, *this, kPriorityNormal,
+                                   kMaxReadAheadBytes, kMaxHeldJiffies, kMaxHeldMsgs);
+    iDecodeAhead->AddCodec(new DecodeAheadTestCodec(), new DecodeAheadTestCodec());
+    iTracksPushed = 0;
+    iBlockOnDecodedStream = true;
+    iSemDecodedStream.Clear();
+    iSemRelease.Clear();
+    iSemQuit.Clear();
+    iTracksPushedAtOkToPlay = 0;
+}
+
+void SuiteDecodeAheadRecognition::TearDown()
+{
+    delete iDecodeAhead;
+    for (auto it=iPendingMsgs.begin(); it!=iPendingMsgs.end(); ++it) {
+        (*it)->RemoveRef();
+    }
+    iPendingMsgs.clear();
+    for (auto it=iPushed.begin(); it!=iPushed.end(); ++it) {
+        (*it)->RemoveRef();
+    }
+    iPushed.clear();
+    iOkToPlayStreams.clear();
+    iTryStopStreams.clear();
+    delete iTrackFactory;
+    delete iMsgFactory;
+}
+
+Msg* SuiteDecodeAheadRecognition::Pull()
+{
+    AutoMutex _(iLock);
+    ASSERT(iPendingMsgs.size() > 0);
+    Msg* msg = iPendingMsgs.front();
+    iPendingMsgs.pop_front();
+    return msg;
+}
+
+void SuiteDecodeAheadRecognition::Push(Msg* aMsg)
+{
+    iLock.Wait();
+    iPushed.push_back(aMsg);
+    if (dynamic_cast<MsgTrack*>(aMsg) != nullptr) {
+        iTracksPushed++;
+    }
+    const TBool block = (iBlockOnDecodedStream && dynamic_cast<MsgDecodedStream*>(aMsg) != nullptr);
+    if (block) {
+        iBlockOnDecodedStream = false;
+    }
+    const TBool quit = (dynamic_cast<MsgQuit*>(aMsg) != nullptr);
+    iLock.Signal();
+    if (block) {
+        // hold the first track part way through so the look-ahead controller gets ahead of it
+        iSemDecodedStream.Signal();
+        iSemRelease.Wait();
+    }
+    if (quit) {
+        iSemQuit.Signal();
+    }
+}
+
+EStreamPlay SuiteDecodeAheadRecognition::OkToPlay(TUint aStreamId)
+{
+    AutoMutex _(iLock);
+    iOkToPlayStreams.push_back(aStreamId);
+    iTracksPushedAtOkToPlay = iTracksPushed;
+    return ePlayNo;
+}
+
+TUint SuiteDecodeAheadRecognition::TrySeek(TUint /*aStreamId*/, TUint64 /*aOffset*/)
+{
+    ASSERTS();
+    return MsgFlush::kIdInvalid;
+}
+
+TUint SuiteDecodeAheadRecognition::TryStop(TUint aStreamId)
+{
+    AutoMutex _(iLock);
+    iTryStopStreams.push_back(aStreamId);
+    return MsgFlush::kIdInvalid;
+}
+
+void SuiteDecodeAheadRecognition::NotifyStarving(const Brx& /*aMode*/, TUint /*aStreamId*/, TBool /*aStarving*/)
+{
+}
+
+TBool SuiteDecodeAheadRecognition::TryGet(IWriter& /*aWriter*/, const Brx& /*aUrl*/, TUint64 /*aOffset*/, TUint /*aBytes*/)
+{
+    return false;
+}
+
+void SuiteDecodeAheadRecognition::AddTrack(TUint aStreamId, TByte aAudioByte, TUint aAudioCount)
+{
+    Track* track = iTrackFactory->CreateTrack(Brx::Empty(), Brx::Empty());
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgTrack(*track, true));
+    track->RemoveRef();
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgEncodedStream(Brn("http://127.0.0.1:65535"), Brn("metatext"), 0, 0, aStreamId, false, false, this));
+    TByte data[kAudioBytes];
+    (void)memset(data, aAudioByte, sizeof(data));
+    const Brn buf(data, sizeof(data));
+    for (TUint i=0; i<aAudioCount; i++) {
+        iPendingMsgs.push_back(iMsgFactory->CreateMsgAudioEncoded(buf));
+    }
+}
+
+void SuiteDecodeAheadRecognition::TestUnrecognisedNextTrackStoppedAfterSplice()
+{
+    AddTrack(1, DecodeAheadTestCodec::kRecognisedByte, 8);
+    AddTrack(2, 0, 4);
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgQuit());
+    iDecodeAhead->Start();
+
+    // first track is held part way through while the second controller fails to recognise the next
+    iSemDecodedStream.Wait();
+    Thread::Sleep(50);
+    iLock.Wait();
+    TEST(iOkToPlayStreams.size() == 0);
+    TEST(iTryStopStreams.size() == 0);
+    iLock.Signal();
+
+    // stream 2 is only claimed once the first track is complete and the second has been spliced in
+    iSemRelease.Signal();
+    iSemQuit.Wait();
+    AutoMutex _(iLock);
+    TEST(iOkToPlayStreams.size() == 1);
+    TEST(iOkToPlayStreams[0] == 2);
+    TEST(iTracksPushedAtOkToPlay == 2);
+    TEST(std::count(iTryStopStreams.begin(), iTryStopStreams.end(), 2u) == 1);
+}
+
+
+
+void TestDecodeAhead()
+{
+    Runner runner("DecodeAhead tests\n");
+    runner.Add(new SuiteDecodeAhead());
+    runner.Add(new SuiteDecodeAheadRecognition());
+    runner.Run();
+}
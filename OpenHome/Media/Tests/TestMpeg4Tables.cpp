@@ -0,0 +1,346 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Codec/Mpeg4.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Stream.h>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media::Codec;
+
+namespace OpenHome {
+namespace Media {
+namespace Codec {
+
+class SuitePackedTable : public SuiteUnitTest
+{
+    static const TUint kLongTableEntries = 8000 * PackedTable::kBlockEntries; // ~3 hours of 44.1KHz AAC
+public:
+    SuitePackedTable();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestEmpty();
+    void TestUnpackedValues();
+    void TestConstantValues();
+    void TestEvenlySpacedValues();
+    void TestVaryingValues();
+    void TestLargeValues();
+    void TestClear();
+    void TestWriteRead();
+    void TestReadInvalid();
+private:
+    static TUint64 NextRandom(TUint64& aSeed);
+    void RoundTrip(PackedTable& aTo) const;
+private:
+    PackedTable* iTable;
+};
+
+class SuiteMpeg4Tables : public SuiteUnitTest
+{
+public:
+    SuiteMpeg4Tables();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestSampleSizeTableLimit();
+    void TestSampleSizeTableWriteRead();
+    void TestSeekTableWriteRead();
+};
+
+} // namespace Codec
+} // namespace Media
+} // namespace OpenHome
+
+
+// SuitePackedTable
+
+SuitePackedTable::SuitePackedTable()
+    : SuiteUnitTest("PackedTable")
+{
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestEmpty), "TestEmpty");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestUnpackedValues), "TestUnpackedValues");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestConstantValues), "TestConstantValues");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestEvenlySpacedValues), "TestEvenlySpacedValues");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestVaryingValues), "TestVaryingValues");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestLargeValues), "TestLargeValues");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestClear), "TestClear");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestWriteRead), "TestWriteRead");
+    AddTest(MakeFunctor(*this, &SuitePackedTable::TestReadInvalid), "TestReadInvalid");
+}
+
+void SuitePackedTable::Setup()
+{
+    iTable = new PackedTable();
+}
+
+void SuitePackedTable::TearDown()
+{
+    delete iTable;
+}
+
+TUint64 SuitePackedTable::NextRandom(TUint64& aSeed)
+{ // static
+    aSeed = aSeed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return aSeed >> 33;
+}
+
+void SuitePackedTable::RoundTrip(PackedTable& aTo) const
+{
+    WriterBwh writer(1024);
+    iTable->Write(writer);
+    Bwh buf;
+    writer.TransferTo(buf);
+    ReaderBuffer reader(buf);
+    aTo.Read(reader);
+}
+
+void SuitePackedTable::TestEmpty()
+{
+    TEST(iTable->Count() == 0);
+    TEST(iTable->BlockCount() == 0);
+    PackedTable copy;
+    RoundTrip(copy);
+    TEST(copy.Count() == 0);
+}
+
+void SuitePackedTable::TestUnpackedValues()
+{
+    const TUint count = PackedTable::kBlockEntries + PackedTable::kBlockEntries / 2;
+    for (TUint i=0; i<count; i++) {
+        iTable->Add(i * 7 % 5);
+    }
+    TEST(iTable->Count() == count);
+    TEST(iTable->BlockCount() == 1);
+    for (TUint i=0; i<count; i++) {
+        TEST(iTable->Get(i) == i * 7 % 5);
+    }
+}
+
+void SuitePackedTable::TestConstantValues()
+{
+    for (TUint i=0; i<kLongTableEntries; i++) {
+        iTable->Add(4096);
+    }
+    TEST(iTable->Count() == kLongTableEntries);
+    TEST(iTable->BlockCount() == 1);
+    TEST(iTable->Get(0) == 4096);
+    TEST(iTable->Get(kLongTableEntries / 3) == 4096);
+    TEST(iTable->Get(kLongTableEntries - 1) == 4096);
+}
+
+void SuitePackedTable::TestEvenlySpacedValues()
+{
+    for (TUint i=0; i<kLongTableEntries; i++) {
+        iTable->Add(1000 + (TUint64)i * 8192);
+    }
+    TEST(iTable->BlockCount() == 1);
+    for (TUint i=0; i<kLongTableEntries; i+=997) {
+        TEST(iTable->Get(i) == 1000 + (TUint64)i * 8192);
+    }
+    // a break in the spacing starts a new run
+    iTable->Add(1);
+    for (TUint i=1; i<PackedTable::kBlockEntries * 2; i++) {
+        iTable->Add(1 + (TUint64)i * 8192);
+    }
+    TEST(iTable->BlockCount() == 2);
+    TEST(iTable->Get(kLongTableEntries - 1) == 1000 + (TUint64)(kLongTableEntries - 1) * 8192);
+    TEST(iTable->Get(kLongTableEntries + 1) == 1 + 8192);
+}
+
+void SuitePackedTable::TestVaryingValues()
+{
+    // sample sizes of a vbr stream
+    TUint64 seed = 1;
+    for (TUint i=0; i<kLongTableEntries; i++) {
+        iTable->Add(300 + NextRandom(seed) % 400);
+    }
+    seed = 1;
+    TBool match = true;
+    for (TUint i=0; i<kLongTableEntries; i++) {
+        match = match && (iTable->Get(i) == 300 + NextRandom(seed) % 400);
+    }
+    TEST(match);
+    // 9 bits per entry plus block headers, against 32 bits per entry for the raw table
+    TEST(iTable->Bytes() < kLongTableEntries * sizeof(TUint));
+}
+
+void SuitePackedTable::TestLargeValues()
+{
+    // 64-bit chunk offsets in a large file
+    TUint64 seed = 2;
+    TUint64 offset = 0xfffffff0ULL;
+    for (TUint i=0; i<1000; i++) {
+        iTable->Add(offset);
+        offset += 0x10000 + NextRandom(seed) % 0x1000;
+    }
+    iTable->Add(0xffffffffffffffffULL);
+    iTable->Add(0);
+    seed = 2;
+    offset = 0xfffffff0ULL;
+    TBool match = true;
+    for (TUint i=0; i<1000; i++) {
+        match = match && (iTable->Get(i) == offset);
+        offset += 0x10000 + NextRandom(seed) % 0x1000;
+    }
+    TEST(match);
+    TEST(iTable->Get(1000) == 0xffffffffffffffffULL);
+    TEST(iTable->Get(1001) == 0);
+}
+
+void SuitePackedTable::TestClear()
+{
+    for (TUint i=0; i<PackedTable::kBlockEntries * 3; i++) {
+        iTable->Add(i * i);
+    }
+    iTable->Clear();
+    TEST(iTable->Count() == 0);
+    TEST(iTable->BlockCount() == 0);
+    iTable->Add(42);
+    TEST(iTable->Count() == 1);
+    TEST(iTable->Get(0) == 42);
+}
+
+void SuitePackedTable::TestWriteRead()
+{
+    TUint64 seed = 3;
+    const TUint count = 10 * PackedTable::kBlockEntries + 5;
+    for (TUint i=0; i<count; i++) {
+        iTable->Add(i < 3 * PackedTable::kBlockEntries? 17 : NextRandom(seed));
+    }
+    PackedTable copy;
+    RoundTrip(copy);
+    TEST(copy.Count() == count);
+    TEST(copy.BlockCount() == iTable->BlockCount());
+    TBool match = true;
+    for (TUint i=0; i<count; i++) {
+        match = match && (copy.Get(i) == iTable->Get(i));
+    }
+    TEST(match);
+    // values can be added to a table that's been read
+    copy.Add(99);
+    TEST(copy.Count() == count + 1);
+    TEST(copy.Get(count) == 99);
+}
+
+void SuitePackedTable::TestReadInvalid()
+{
+    // a block of 8-bit residuals with no words to hold them
+    WriterBwh writer(64);
+    WriterBinary writerBin(writer);
+    writerBin.WriteUint32Be(1);
+    writerBin.WriteUint32Be(PackedTable::kBlockEntries);
+    writerBin.WriteUint64Be(0);
+    writerBin.WriteUint64Be(0);
+    writerBin.WriteUint8(8);
+    writerBin.WriteUint32Be(0);
+    writerBin.WriteUint32Be(0);
+    Bwh buf;
+    writer.TransferTo(buf);
+    ReaderBuffer reader(buf);
+    TEST_THROWS(iTable->Read(reader), MediaMpeg4FileInvalid);
+}
+
+
+// SuiteMpeg4Tables
+
+SuiteMpeg4Tables::SuiteMpeg4Tables()
+    : SuiteUnitTest("Mpeg4 sample tables")
+{
+    AddTest(MakeFunctor(*this, &SuiteMpeg4Tables::TestSampleSizeTableLimit), "TestSampleSizeTableLimit");
+    AddTest(MakeFunctor(*this, &SuiteMpeg4Tables::TestSampleSizeTableWriteRead), "TestSampleSizeTableWriteRead");
+    AddTest(MakeFunctor(*this, &SuiteMpeg4Tables::TestSeekTableWriteRead), "TestSeekTableWriteRead");
+}
+
+void SuiteMpeg4Tables::Setup()
+{
+}
+
+void SuiteMpeg4Tables::TearDown()
+{
+}
+
+void SuiteMpeg4Tables::TestSampleSizeTableLimit()
+{
+    SampleSizeTable table;
+    table.Init(2);
+    table.AddSampleSize(10);
+    table.AddSampleSize(20);
+    TEST_THROWS(table.AddSampleSize(30), MediaMpeg4FileInvalid);
+    TEST(table.Count() == 2);
+    TEST(table.SampleSize(1) == 20);
+    TEST_THROWS(table.SampleSize(2), MediaMpeg4FileInvalid);
+}
+
+void SuiteMpeg4Tables::TestSampleSizeTableWriteRead()
+{
+    const TUint count = 1000;
+    SampleSizeTable table;
+    table.Init(count);
+    for (TUint i=0; i<count; i++) {
+        table.AddSampleSize(371 + (i * 31) % 97);
+    }
+    WriterBwh writer(1024);
+    table.Write(writer);
+    Bwh buf;
+    writer.TransferTo(buf);
+    TEST(buf.Bytes() < count * 4 / 2);
+
+    SampleSizeTable copy;
+    ReaderBuffer reader(buf);
+    copy.Read(reader);
+    TEST(copy.Count() == count);
+    for (TUint i=0; i<count; i++) {
+        TEST(copy.SampleSize(i) == 371 + (i * 31) % 97);
+    }
+}
+
+void SuiteMpeg4Tables::TestSeekTableWriteRead()
+{
+    // 3 chunks of 4 samples then 2 of 2, each sample covering 1024 audio samples
+    SeekTable table;
+    table.InitialiseSamplesPerChunk(2);
+    table.SetSamplesPerChunk(1, 4, 1);
+    table.SetSamplesPerChunk(4, 2, 1);
+    table.InitialiseAudioSamplesPerSample(1);
+    table.SetAudioSamplesPerSample(16, 1024);
+    table.InitialiseOffsets(5);
+    const TUint64 kOffsets[] = { 0x100000000ULL, 0x100001000ULL, 0x100002000ULL, 0x100002800ULL, 0x100003000ULL };
+    for (TUint i=0; i<5; i++) {
+        table.SetOffset(kOffsets[i]);
+    }
+
+    WriterBwh writer(1024);
+    table.Write(writer);
+    Bwh buf;
+    writer.TransferTo(buf);
+    SeekTable copy;
+    ReaderBuffer reader(buf);
+    SeekTableInitialiser initialiser(copy, reader);
+    initialiser.Init();
+
+    TEST(copy.Initialised());
+    TEST(copy.ChunkCount() == 5);
+    for (TUint i=0; i<5; i++) {
+        TEST(copy.GetOffset(i) == kOffsets[i]);
+    }
+    TEST(copy.SamplesPerChunk(2) == 4);
+    TEST(copy.SamplesPerChunk(3) == 2);
+    TEST(copy.StartSample(4) == 14);
+    TUint64 audioSample = 13 * 1024 + 10;
+    TUint64 sample = 0;
+    TEST(copy.Offset(audioSample, sample) == kOffsets[3]);
+    TEST(sample == 12);
+    TEST(audioSample == 12 * 1024);
+}
+
+
+
+void TestMpeg4Tables()
+{
+    Runner runner("Mpeg4 sample table tests\n");
+    runner.Add(new SuitePackedTable());
+    runner.Add(new SuiteMpeg4Tables());
+    runner.Run();
+}
@@ -3,9 +3,11 @@
 #include <OpenHome/Media/Pipeline/RampArray.h>
 #include <OpenHome/Media/Utils/AllocatorInfoLogger.h>
 #include <OpenHome/Media/Utils/ProcessorPcmUtils.h>
+#include <OpenHome/Functor.h>
 
 #include <string.h>
 #include <vector>
+#include <algorithm>
 
 using namespace OpenHome;
 using namespace OpenHome::TestFramework;
@@ -19,9 +21,16 @@ class SuiteAllocator : public Suite
 public:
     SuiteAllocator();
     void Test();
+private:
+    void TestThreadCaches();
+    void ThreadAllocate();
+    void AllocateAndFreeAll();
 private:
     static const TUint kNumTestCells = 10;
+    static const TUint kNumCachedTestCells = 128;
     AllocatorInfoLogger iInfoAggregator;
+    Allocator<TestCell>* iCachedAllocator;
+    Semaphore iThreadDone;
 };
 
 class TestCell : public Allocated
@@ -35,16 +44,20 @@ private:
     TChar iBytes[kNumBytes];
 };
 
-class SuiteMsgAudioEncoded : public Suite
+class SuiteMsgAudioEncoded : public Suite, private IEncodedAudioSource
 {
     static const TUint kMsgCount = 8;
 public:
     SuiteMsgAudioEncoded();
     ~SuiteMsgAudioEncoded();
     void Test();
+private: // from IEncodedAudioSource
+    void AddRef() override;
+    void RemoveRef() override;
 private:
     MsgFactory* iMsgFactory;
     AllocatorInfoLogger iInfoAggregator;
+    TUint iSourceRefCount;
 };
 
 class SuiteMsgAudio : public Suite
@@ -85,6 +98,26 @@ private:
     AllocatorInfoLogger iInfoAggregator;
 };
 
+class SuiteRampApplicator : public Suite
+{
+    static const TUint kMsgCount = 4;
+public:
+    SuiteRampApplicator();
+    ~SuiteRampApplicator();
+    void Test();
+private:
+    void TestBlockMatchesSample(const Ramp& aRamp, TUint aBitDepth, TUint aNumChannels, TUint aNumSamples);
+    void TestPlayableMatchesSample(TUint aBitDepth, TUint aNumChannels);
+    void FillAudio(TByte* aData, TUint aBytes);
+private:
+    MsgFactory* iMsgFactory;
+    AllocatorInfoLogger iInfoAggregator;
+    TUint iSeed;
+    TByte iAudioData[DecodedAudio::kMaxBytes];
+    TByte iExpected[DecodedAudio::kMaxBytes];
+    TByte iActual[DecodedAudio::kMaxBytes];
+};
+
 class SuiteAudioStream : public Suite
 {
     static const TUint kMsgEncodedStreamCount = 1;
@@ -260,6 +293,23 @@ private:
     AllocatorInfoLogger iInfoAggregator;
 };
 
+class SuiteMsgQueueSpsc : public Suite, private INonCopyable
+{
+    static const TUint kMsgFlushCount = 200; // > 2 chunks
+    static const TUint kThreadedMsgCount = 100000;
+public:
+    SuiteMsgQueueSpsc();
+    ~SuiteMsgQueueSpsc();
+    void Test();
+private:
+    void ProducerThread();
+private:
+    MsgFactory* iMsgFactory;
+    AllocatorInfoLogger iInfoAggregator;
+    MsgQueueSpsc* iQueue;
+    Semaphore iSemCredit;
+};
+
 class SuiteMsgReservoir : public Suite
 {
     static const TUint kMsgCount = 8;
@@ -395,6 +445,8 @@ void TestCell::CheckIsFilled(TChar aVal) const
 
 SuiteAllocator::SuiteAllocator()
     : Suite("Allocator tests")
+    , iCachedAllocator(nullptr)
+    , iThreadDone("TALS", 0)
 {
 }
 
@@ -454,6 +506,56 @@ void SuiteAllocator::Test()
         allocator->Free(cells[i]);
     }
     delete allocator;
+
+    TestThreadCaches();
+}
+
+void SuiteAllocator::TestThreadCaches()
+{
+    // allocator is large enough to use per-thread caches; cells freed on one thread must
+    // still be available to others and usage stats must stay exact
+    iCachedAllocator = new Allocator<TestCell>("TestCellCached", kNumCachedTestCells, iInfoAggregator);
+    ThreadFunctor* th = new ThreadFunctor("TestAllocator", MakeFunctor(*this, &SuiteAllocator::ThreadAllocate));
+    th->Start();
+    iThreadDone.Wait();
+    delete th;
+    TEST(iCachedAllocator->CellsUsed() == 0);
+    TEST(iCachedAllocator->CellsUsedMax() == kNumCachedTestCells);
+
+    AllocateAndFreeAll();
+    TEST(iCachedAllocator->CellsUsed() == 0);
+    TEST(iCachedAllocator->CellsUsedMax() == kNumCachedTestCells);
+
+    TestCell* cell = iCachedAllocator->Allocate();
+    cell->AddRef();
+    TEST(iCachedAllocator->CellsUsed() == 1);
+    cell->RemoveRef();
+    TEST(iCachedAllocator->CellsUsed() == 1);
+    cell->RemoveRef();
+    TEST(iCachedAllocator->CellsUsed() == 0);
+
+    delete iCachedAllocator; // would assert if any cell was lost in a thread's cache
+    iCachedAllocator = nullptr;
+}
+
+void SuiteAllocator::ThreadAllocate()
+{
+    AllocateAndFreeAll();
+    iThreadDone.Signal();
+}
+
+void SuiteAllocator::AllocateAndFreeAll()
+{
+    TestCell* cells[kNumCachedTestCells];
+    for (TUint i=0; i<kNumCachedTestCells; i++) {
+        cells[i] = iCachedAllocator->Allocate();
+        cells[i]->Fill((TByte)i);
+    }
+    TEST(iCachedAllocator->CellsUsed() == kNumCachedTestCells);
+    for (TUint i=0; i<kNumCachedTestCells; i++) {
+        cells[i]->CheckIsFilled((TByte)i);
+        cells[i]->RemoveRef();
+    }
 }
 
 
@@ -461,6 +563,7 @@ void SuiteAllocator::Test()
 
 SuiteMsgAudioEncoded::SuiteMsgAudioEncoded()
     : Suite("MsgAudioEncoded tests")
+    , iSourceRefCount(0)
 {
     MsgFactoryInitParams init;
     init.SetMsgAudioEncodedCount(kMsgCount, kMsgCount);
@@ -683,9 +786,66 @@ void SuiteMsgAudioEncoded::Test()
     TEST(consumed == EncodedAudio::kMaxBytes % buf.Bytes());
     msg->RemoveRef();
 
+    // msg referencing an external source reports/outputs the source's data
+    for (TUint i=0; i<sizeof(data)/sizeof(data[0]); i++) {
+        data[i] = (TByte)(i + 100);
+    }
+    buf.Set(data, sizeof(data));
+    msg = iMsgFactory->CreateMsgAudioEncoded(*this, buf);
+    TEST(iSourceRefCount == 1);
+    TEST(msg->Bytes() == buf.Bytes());
+    (void)memset(output, 0xde, sizeof(output));
+    msg->CopyTo(output);
+    for (TUint i=0; i<msg->Bytes(); i++) {
+        TEST(output[i] == buf[i]);
+    }
+
+    // source data can't be appended to
+    TEST(msg->Append(buf) == 0);
+    TEST(msg->Bytes() == buf.Bytes());
+
+    // split and clone share the source; it is only released when all msgs are freed
+    splitPos = 20;
+    msg2 = msg->Split(splitPos);
+    msg3 = msg2->Clone();
+    TEST(msg->Bytes() == splitPos);
+    TEST(msg3->Bytes() == buf.Bytes() - splitPos);
+    (void)memset(output, 0xde, sizeof(output));
+    msg3->CopyTo(output);
+    for (TUint i=0; i<msg3->Bytes(); i++) {
+        TEST(output[i] == buf[splitPos + i]);
+    }
+    msg->RemoveRef();
+    msg2->RemoveRef();
+    TEST(iSourceRefCount == 1);
+    msg3->RemoveRef();
+    TEST(iSourceRefCount == 0);
+
+    // EncodedAudio reused from the pool after referencing a source holds its own data again
+    msg = iMsgFactory->CreateMsgAudioEncoded(*this, buf);
+    msg->RemoveRef();
+    memset(data3, 7, sizeof(data3));
+    buf.Set(data3, sizeof(data3));
+    msg = iMsgFactory->CreateMsgAudioEncoded(buf);
+    TEST(msg->Append(buf) == buf.Bytes());
+    TEST(msg->Bytes() == 2 * buf.Bytes());
+    msg->RemoveRef();
+    TEST(iSourceRefCount == 0);
+
     // clean shutdown implies no leaked msgs
 }
 
+void SuiteMsgAudioEncoded::AddRef()
+{
+    iSourceRefCount++;
+}
+
+void SuiteMsgAudioEncoded::RemoveRef()
+{
+    ASSERT(iSourceRefCount > 0);
+    iSourceRefCount--;
+}
+
 
 // SuiteMsgAudio
 
@@ -883,6 +1043,33 @@ void SuiteMsgAudio::Test()
     msgAggregate1->RemoveRef();
     msgAggregate2->RemoveRef();
 
+    // Decode directly into a borrowed DecodedAudio.  Check msg contains exactly the data written.
+    {
+        static const TUint kBorrowedSamples = 100;
+        static const TUint kBorrowedBytes = kBorrowedSamples * 2 * 3;
+        DecodedAudio* decodedAudio = iMsgFactory->CreateDecodedAudioBuffer();
+        TByte* p = decodedAudio->WritePtr();
+        for (TUint i=0; i<kBorrowedBytes; i++) {
+            p[i] = (TByte)i;
+        }
+        MsgAudioPcm* msgBorrowed = iMsgFactory->CreateMsgAudioPcm(decodedAudio, kBorrowedBytes, 2, 44100, 24, Jiffies::kPerMs);
+        TEST(msgBorrowed->Jiffies() == kBorrowedSamples * Jiffies::JiffiesPerSample(44100));
+        TEST(msgBorrowed->TrackOffset() == Jiffies::kPerMs);
+        MsgPlayable* playableBorrowed = msgBorrowed->CreatePlayable();
+        TEST(playableBorrowed->Bytes() == kBorrowedBytes);
+        ProcessorPcmBufTest pcmProcessorBorrowed;
+        playableBorrowed->Read(pcmProcessorBorrowed);
+        playableBorrowed->RemoveRef();
+        ptr = pcmProcessorBorrowed.Ptr();
+        for (TUint i=0; i<kBorrowedBytes; i++) {
+            TEST(ptr[i] == (TByte)i);
+        }
+
+        // borrowed buffers that are never output can be returned to the pipeline
+        decodedAudio = iMsgFactory->CreateDecodedAudioBuffer();
+        decodedAudio->RemoveRef();
+    }
+
     // Check creating zero-length msg asserts
     TEST_THROWS(iMsgFactory->CreateMsgAudioPcm(Brx::Empty(), 2, 44100, 8, EMediaDataEndianLittle, 0), AssertionFailed);
 
@@ -1515,6 +1702,133 @@ void SuiteRamp::Test()
 }
 
 
+// SuiteRampApplicator
+
+SuiteRampApplicator::SuiteRampApplicator()
+    : Suite("RampApplicator block tests")
+    , iSeed(1)
+{
+    MsgFactoryInitParams init;
+    init.SetMsgAudioPcmCount(kMsgCount, kMsgCount);
+    init.SetMsgPlayableCount(kMsgCount, kMsgCount);
+    iMsgFactory = new MsgFactory(iInfoAggregator, init);
+}
+
+SuiteRampApplicator::~SuiteRampApplicator()
+{
+    delete iMsgFactory;
+}
+
+void SuiteRampApplicator::Test()
+{
+    // Check GetNextBlock is bit-exact with GetNextSample for all bit depths and channel counts
+    // ...over a range of ramps, including ones that cover only a single sample
+    static const TUint kBitDepths[] = { 8, 16, 24 };
+    static const TUint kNumSampleCounts[] = { 1, 2, 7, 64, 65, 256 };
+    const TUint kQuarter = (Ramp::kMax - Ramp::kMin) / 4;
+    for (TUint i=0; i<sizeof(kBitDepths)/sizeof(kBitDepths[0]); i++) {
+        for (TUint channels=1; channels<=DecodedAudio::kMaxNumChannels; channels++) {
+            const TUint maxSamples = DecodedAudio::kMaxBytes / ((kBitDepths[i]/8) * channels);
+            for (TUint j=0; j<sizeof(kNumSampleCounts)/sizeof(kNumSampleCounts[0]); j++) {
+                const TUint numSamples = std::min(kNumSampleCounts[j], maxSamples);
+                Ramp ramp;
+                Ramp split;
+                TUint splitPos;
+                (void)ramp.Set(Ramp::kMax, numSamples, numSamples, Ramp::EDown, split, splitPos);
+                TestBlockMatchesSample(ramp, kBitDepths[i], channels, numSamples);
+                ramp.Reset();
+                (void)ramp.Set(Ramp::kMin, numSamples, numSamples, Ramp::EUp, split, splitPos);
+                TestBlockMatchesSample(ramp, kBitDepths[i], channels, numSamples);
+                ramp.Reset();
+                (void)ramp.Set(3 * kQuarter, numSamples, 3 * numSamples, Ramp::EDown, split, splitPos);
+                TestBlockMatchesSample(ramp, kBitDepths[i], channels, numSamples);
+                ramp.Reset();
+                (void)ramp.Set(kQuarter, numSamples, 5 * numSamples, Ramp::EUp, split, splitPos);
+                TestBlockMatchesSample(ramp, kBitDepths[i], channels, numSamples);
+            }
+            TestBlockMatchesSample(Ramp(), kBitDepths[i], channels, maxSamples); // disabled ramp - full gain
+            Ramp ramp;
+            ramp.SetMuted();
+            TestBlockMatchesSample(ramp, kBitDepths[i], channels, maxSamples);
+        }
+    }
+
+    // Check ramped MsgPlayablePcm output matches per-sample ramping
+    TestPlayableMatchesSample(8, 2);
+    TestPlayableMatchesSample(16, 2);
+    TestPlayableMatchesSample(16, 8);
+    TestPlayableMatchesSample(24, 2);
+    TestPlayableMatchesSample(24, 6);
+}
+
+void SuiteRampApplicator::TestBlockMatchesSample(const Ramp& aRamp, TUint aBitDepth, TUint aNumChannels, TUint aNumSamples)
+{
+    const TUint sampleBytes = (aBitDepth/8) * aNumChannels;
+    const TUint bytes = aNumSamples * sampleBytes;
+    FillAudio(iAudioData, bytes);
+    Brn audioBuf(iAudioData, bytes);
+
+    RampApplicator raSample(aRamp);
+    TEST(raSample.Start(audioBuf, aBitDepth, aNumChannels) == aNumSamples);
+    for (TUint i=0; i<aNumSamples; i++) {
+        raSample.GetNextSample(&iExpected[i * sampleBytes]);
+    }
+
+    RampApplicator raBlock(aRamp);
+    TEST(raBlock.Start(audioBuf, aBitDepth, aNumChannels) == aNumSamples);
+    TUint samplesDone = 0;
+    if (aNumSamples > 1) {
+        // check that per-sample and block calls can be interleaved
+        raBlock.GetNextSample(iActual);
+        samplesDone++;
+    }
+    for (;;) {
+        const TUint numSamples = raBlock.GetNextBlock(&iActual[samplesDone * sampleBytes]);
+        if (numSamples == 0) {
+            break;
+        }
+        TEST(numSamples <= RampApplicator::kMaxBlockSamples);
+        samplesDone += numSamples;
+    }
+    TEST(samplesDone == aNumSamples);
+    TEST(memcmp(iExpected, iActual, bytes) == 0);
+}
+
+void SuiteRampApplicator::TestPlayableMatchesSample(TUint aBitDepth, TUint aNumChannels)
+{
+    const TUint sampleBytes = (aBitDepth/8) * aNumChannels;
+    const TUint bytes = (DecodedAudio::kMaxBytes / sampleBytes) * sampleBytes;
+    FillAudio(iAudioData, bytes);
+    Brn audioBuf(iAudioData, bytes);
+    MsgAudioPcm* audioPcm = iMsgFactory->CreateMsgAudioPcm(audioBuf, aNumChannels, 44100, aBitDepth, EMediaDataEndianBig, 0);
+    TUint remainingDuration = audioPcm->Jiffies() * 2;
+    MsgAudio* remaining = nullptr;
+    (void)audioPcm->SetRamp(Ramp::kMax, remainingDuration, Ramp::EDown, remaining);
+    TEST(remaining == nullptr);
+
+    RampApplicator ra(audioPcm->Ramp());
+    const TUint numSamples = ra.Start(audioBuf, aBitDepth, aNumChannels);
+    for (TUint i=0; i<numSamples; i++) {
+        ra.GetNextSample(&iExpected[i * sampleBytes]);
+    }
+
+    MsgPlayable* playable = audioPcm->CreatePlayable();
+    ProcessorPcmBufTest pcmProcessor;
+    playable->Read(pcmProcessor);
+    playable->RemoveRef();
+    TEST(pcmProcessor.Buf().Bytes() == bytes);
+    TEST(memcmp(iExpected, pcmProcessor.Ptr(), bytes) == 0);
+}
+
+void SuiteRampApplicator::FillAudio(TByte* aData, TUint aBytes)
+{
+    for (TUint i=0; i<aBytes; i++) {
+        iSeed = iSeed * 1103515245 + 12345;
+        aData[i] = (TByte)(iSeed >> 16);
+    }
+}
+
+
 // SuiteAudioStream
 
 SuiteAudioStream::SuiteAudioStream()
@@ -2365,6 +2679,112 @@ void SuiteMsgQueue::Test()
 }
 
 
+// SuiteMsgQueueSpsc
+
+SuiteMsgQueueSpsc::SuiteMsgQueueSpsc()
+    : Suite("MsgQueueSpsc tests")
+    , iQueue(nullptr)
+    , iSemCredit("MQSC", 0)
+{
+    MsgFactoryInitParams init;
+    init.SetMsgFlushCount(kMsgFlushCount);
+    iMsgFactory = new MsgFactory(iInfoAggregator, init);
+}
+
+SuiteMsgQueueSpsc::~SuiteMsgQueueSpsc()
+{
+    delete iMsgFactory;
+}
+
+void SuiteMsgQueueSpsc::Test()
+{
+    iQueue = new MsgQueueSpsc();
+
+    // queue is fifo, including when msgs span several chunks
+    TEST(iQueue->IsEmpty());
+    for (TUint i=0; i<kMsgFlushCount; i++) {
+        iQueue->Enqueue(iMsgFactory->CreateMsgFlush(i+1));
+    }
+    TEST(!iQueue->IsEmpty());
+    TEST(iQueue->NumMsgs() == kMsgFlushCount);
+    for (TUint i=0; i<kMsgFlushCount; i++) {
+        MsgFlush* flush = static_cast<MsgFlush*>(iQueue->Dequeue());
+        TEST(flush->Id() == i+1);
+        flush->RemoveRef();
+    }
+    TEST(iQueue->IsEmpty());
+    TEST(iQueue->NumMsgs() == 0);
+
+    // EnqueueAtHead skips existing items and is lifo
+    iQueue->Enqueue(iMsgFactory->CreateMsgFlush(1));
+    iQueue->Enqueue(iMsgFactory->CreateMsgFlush(2));
+    iQueue->EnqueueAtHead(iMsgFactory->CreateMsgFlush(3));
+    iQueue->EnqueueAtHead(iMsgFactory->CreateMsgFlush(4));
+    TEST(iQueue->NumMsgs() == 4);
+    static const TUint kExpectedIds[] = { 4, 3, 1, 2 };
+    for (TUint i=0; i<sizeof(kExpectedIds)/sizeof(kExpectedIds[0]); i++) {
+        TEST(!iQueue->IsEmpty());
+        MsgFlush* flush = static_cast<MsgFlush*>(iQueue->Dequeue());
+        TEST(flush->Id() == kExpectedIds[i]);
+        flush->RemoveRef();
+    }
+    TEST(iQueue->IsEmpty());
+
+    // EnqueueAtHead for empty queue
+    iQueue->EnqueueAtHead(iMsgFactory->CreateMsgFlush(1));
+    TEST(!iQueue->IsEmpty());
+    Msg* msg = iQueue->Dequeue();
+    TEST(static_cast<MsgFlush*>(msg)->Id() == 1);
+    msg->RemoveRef();
+    TEST(iQueue->IsEmpty());
+
+    // Enqueueing the same msg at head consecutively fails
+    msg = iMsgFactory->CreateMsgFlush(1);
+    iQueue->EnqueueAtHead(msg);
+    TEST_THROWS(iQueue->EnqueueAtHead(msg), AssertionFailed);
+    iQueue->Dequeue()->RemoveRef();
+
+    // Clear removes msgs from both shared and pushed back lists
+    for (TUint i=0; i<kMsgFlushCount/2; i++) {
+        iQueue->Enqueue(iMsgFactory->CreateMsgFlush(i+1));
+    }
+    iQueue->EnqueueAtHead(iMsgFactory->CreateMsgFlush(kMsgFlushCount));
+    iQueue->Clear();
+    TEST(iQueue->IsEmpty());
+    TEST(iQueue->NumMsgs() == 0);
+
+    // msgs enqueued in one thread are dequeued in order by another, with consumer blocking when empty
+    for (TUint i=0; i<kMsgFlushCount; i++) {
+        iSemCredit.Signal();
+    }
+    ThreadFunctor* th = new ThreadFunctor("MQSP", MakeFunctor(*this, &SuiteMsgQueueSpsc::ProducerThread));
+    th->Start();
+    TBool inOrder = true;
+    for (TUint i=0; i<kThreadedMsgCount; i++) {
+        MsgFlush* flush = static_cast<MsgFlush*>(iQueue->Dequeue());
+        if (flush->Id() != i+1) {
+            inOrder = false;
+        }
+        flush->RemoveRef();
+        iSemCredit.Signal();
+    }
+    TEST(inOrder);
+    TEST(iQueue->IsEmpty());
+    delete th;
+    (void)iSemCredit.Clear();
+
+    delete iQueue;
+}
+
+void SuiteMsgQueueSpsc::ProducerThread()
+{
+    for (TUint i=0; i<kThreadedMsgCount; i++) {
+        iSemCredit.Wait();
+        iQueue->Enqueue(iMsgFactory->CreateMsgFlush(i+1));
+    }
+}
+
+
 // SuiteMsgReservoir
 
 SuiteMsgReservoir::SuiteMsgReservoir()
@@ -2904,6 +3324,7 @@ void TestMsg()
     runner.Add(new SuiteMsgAudio());
     runner.Add(new SuiteMsgPlayable());
     runner.Add(new SuiteRamp());
+    runner.Add(new SuiteRampApplicator());
     runner.Add(new SuiteAudioStream());
     runner.Add(new SuiteMetaText());
     runner.Add(new SuiteTrack());
@@ -2914,6 +3335,7 @@ void TestMsg()
     runner.Add(new SuiteDecodedStream());
     runner.Add(new SuiteMsgProcessor());
     runner.Add(new SuiteMsgQueue());
+    runner.Add(new SuiteMsgQueueSpsc());
     runner.Add(new SuiteMsgReservoir());
     runner.Add(new SuitePipelineElement());
     runner.Run();
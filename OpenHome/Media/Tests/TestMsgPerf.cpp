@@ -0,0 +1,217 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Media/Utils/AllocatorInfoLogger.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/OsWrapper.h>
+#include <OpenHome/Private/Printer.h>
+
+#include <string.h>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media;
+
+namespace OpenHome {
+namespace Media {
+
+class ProcessorPcmNull : public IPcmProcessor
+{
+public:
+    ProcessorPcmNull();
+    TUint Bytes() const;
+private: // from IPcmProcessor
+    void BeginBlock() override;
+    void ProcessFragment8(const Brx& aData, TUint aNumChannels) override;
+    void ProcessFragment16(const Brx& aData, TUint aNumChannels) override;
+    void ProcessFragment24(const Brx& aData, TUint aNumChannels) override;
+    void ProcessFragment32(const Brx& aData, TUint aNumChannels) override;
+    void ProcessSample8(const TByte* aSample, TUint aNumChannels) override;
+    void ProcessSample16(const TByte* aSample, TUint aNumChannels) override;
+    void ProcessSample24(const TByte* aSample, TUint aNumChannels) override;
+    void ProcessSample32(const TByte* aSample, TUint aNumChannels) override;
+    void EndBlock() override;
+    void Flush() override;
+private:
+    TUint iBytes;
+};
+
+class SuiteRampPerf : public Suite, private INonCopyable
+{
+    static const TUint kIterations = 5000;
+    static const TUint kMsgCount = 4;
+public:
+    SuiteRampPerf(Environment& aEnv);
+    ~SuiteRampPerf();
+    void Test();
+private:
+    void TimeRampApplicator(TUint aBitDepth, TUint aNumChannels);
+    void TimePlayable(TUint aBitDepth, TUint aNumChannels);
+private:
+    Environment& iEnv;
+    MsgFactory* iMsgFactory;
+    AllocatorInfoLogger iInfoAggregator;
+    TByte iAudioData[DecodedAudio::kMaxBytes];
+    TByte iRamped[DecodedAudio::kMaxBytes];
+};
+
+} // namespace Media
+} // namespace OpenHome
+
+
+// ProcessorPcmNull
+
+ProcessorPcmNull::ProcessorPcmNull()
+    : iBytes(0)
+{
+}
+
+TUint ProcessorPcmNull::Bytes() const
+{
+    return iBytes;
+}
+
+void ProcessorPcmNull::BeginBlock()
+{
+}
+
+void ProcessorPcmNull::ProcessFragment8(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iBytes += aData.Bytes();
+}
+
+void ProcessorPcmNull::ProcessFragment16(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iBytes += aData.Bytes();
+}
+
+void ProcessorPcmNull::ProcessFragment24(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iBytes += aData.Bytes();
+}
+
+void ProcessorPcmNull::ProcessFragment32(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iBytes += aData.Bytes();
+}
+
+void ProcessorPcmNull::ProcessSample8(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iBytes += aNumChannels;
+}
+
+void ProcessorPcmNull::ProcessSample16(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iBytes += 2 * aNumChannels;
+}
+
+void ProcessorPcmNull::ProcessSample24(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iBytes += 3 * aNumChannels;
+}
+
+void ProcessorPcmNull::ProcessSample32(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iBytes += 4 * aNumChannels;
+}
+
+void ProcessorPcmNull::EndBlock()
+{
+}
+
+void ProcessorPcmNull::Flush()
+{
+}
+
+
+// SuiteRampPerf
+
+SuiteRampPerf::SuiteRampPerf(Environment& aEnv)
+    : Suite("Ramp performance")
+    , iEnv(aEnv)
+{
+    MsgFactoryInitParams init;
+    init.SetMsgAudioPcmCount(kMsgCount, kMsgCount);
+    init.SetMsgPlayableCount(kMsgCount, kMsgCount);
+    iMsgFactory = new MsgFactory(iInfoAggregator, init);
+    for (TUint i=0; i<sizeof(iAudioData); i++) {
+        iAudioData[i] = (TByte)(i * 7);
+    }
+}
+
+SuiteRampPerf::~SuiteRampPerf()
+{
+    delete iMsgFactory;
+}
+
+void SuiteRampPerf::Test()
+{
+    TimeRampApplicator(16, 2);
+    TimeRampApplicator(24, 2);
+    TimeRampApplicator(24, 8);
+    TimePlayable(16, 2);
+    TimePlayable(24, 2);
+    TimePlayable(24, 8);
+}
+
+void SuiteRampPerf::TimeRampApplicator(TUint aBitDepth, TUint aNumChannels)
+{
+    const TUint sampleBytes = (aBitDepth/8) * aNumChannels;
+    Brn audioBuf(iAudioData, (DecodedAudio::kMaxBytes / sampleBytes) * sampleBytes);
+    Ramp ramp;
+    Ramp split;
+    TUint splitPos;
+    (void)ramp.Set(Ramp::kMax, audioBuf.Bytes(), audioBuf.Bytes(), Ramp::EDown, split, splitPos);
+
+    const TUint startSample = Os::TimeInMs(iEnv.OsCtx());
+    for (TUint i=0; i<kIterations; i++) {
+        RampApplicator ra(ramp);
+        const TUint numSamples = ra.Start(audioBuf, aBitDepth, aNumChannels);
+        for (TUint j=0; j<numSamples; j++) {
+            ra.GetNextSample(&iRamped[j * sampleBytes]);
+        }
+    }
+    const TUint startBlock = Os::TimeInMs(iEnv.OsCtx());
+    for (TUint i=0; i<kIterations; i++) {
+        RampApplicator ra(ramp);
+        (void)ra.Start(audioBuf, aBitDepth, aNumChannels);
+        TByte* dest = iRamped;
+        TUint numSamples;
+        while ((numSamples = ra.GetNextBlock(dest)) > 0) {
+            dest += numSamples * sampleBytes;
+        }
+    }
+    const TUint end = Os::TimeInMs(iEnv.OsCtx());
+    Log::Print("RampApplicator %2u-bit, %u channels: GetNextSample=%ums, GetNextBlock=%ums (%u x %u bytes)\n",
+               aBitDepth, aNumChannels, startBlock - startSample, end - startBlock, kIterations, audioBuf.Bytes());
+    TEST(true);
+}
+
+void SuiteRampPerf::TimePlayable(TUint aBitDepth, TUint aNumChannels)
+{
+    const TUint sampleBytes = (aBitDepth/8) * aNumChannels;
+    Brn audioBuf(iAudioData, (DecodedAudio::kMaxBytes / sampleBytes) * sampleBytes);
+    ProcessorPcmNull processor;
+    const TUint start = Os::TimeInMs(iEnv.OsCtx());
+    for (TUint i=0; i<kIterations; i++) {
+        MsgAudioPcm* audioPcm = iMsgFactory->CreateMsgAudioPcm(audioBuf, aNumChannels, 44100, aBitDepth, EMediaDataEndianBig, 0);
+        TUint remainingDuration = audioPcm->Jiffies();
+        MsgAudio* remaining = nullptr;
+        (void)audioPcm->SetRamp(Ramp::kMax, remainingDuration, Ramp::EDown, remaining);
+        MsgPlayable* playable = audioPcm->CreatePlayable();
+        playable->Read(processor);
+        playable->RemoveRef();
+    }
+    const TUint end = Os::TimeInMs(iEnv.OsCtx());
+    Log::Print("MsgPlayablePcm ramped Read %2u-bit, %u channels: %ums (%u x %u bytes)\n",
+               aBitDepth, aNumChannels, end - start, kIterations, audioBuf.Bytes());
+    TEST(processor.Bytes() == kIterations * audioBuf.Bytes());
+}
+
+
+
+void TestMsgPerf(Environment& aEnv)
+{
+    Runner runner("Msg performance tests\n");
+    runner.Add(new SuiteRampPerf(aEnv));
+    runner.Run();
+}
@@ -0,0 +1,214 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
+#include <OpenHome/Private/Printer.h>
+
+#include <string.h>
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media;
+
+namespace OpenHome {
+namespace Media {
+
+class SuitePcmConverter : public Suite
+{
+    static const TUint kMaxSubsamples = 300;
+    static const TUint kMaxChannels = 8;
+public:
+    SuitePcmConverter();
+    ~SuitePcmConverter();
+    void Test();
+private:
+    void TestSwap();
+    void TestPack();
+    void TestInterleave();
+    void TestFixed();
+    TUint32 NextRandom();
+private:
+    PcmConverter::EImplementation iDefaultImpl;
+    TUint32 iRandom;
+};
+
+} // namespace Media
+} // namespace OpenHome
+
+
+// SuitePcmConverter
+
+SuitePcmConverter::SuitePcmConverter()
+    : Suite("PcmConverter tests")
+    , iRandom(1)
+{
+    iDefaultImpl = PcmConverter::Implementation();
+}
+
+SuitePcmConverter::~SuitePcmConverter()
+{
+    PcmConverter::SetImplementation(iDefaultImpl);
+}
+
+void SuitePcmConverter::Test()
+{
+    const PcmConverter::EImplementation impls[] = { PcmConverter::eScalar, PcmConverter::eSse2, PcmConverter::eAvx2, PcmConverter::eNeon };
+    for (TUint i=0; i<sizeof(impls)/sizeof(impls[0]); i++) {
+        if (!PcmConverter::IsSupported(impls[i])) {
+            continue;
+        }
+        Print("  %s\n", PcmConverter::ImplementationName(impls[i]));
+        PcmConverter::SetImplementation(impls[i]);
+        TestSwap();
+        TestPack();
+        TestInterleave();
+        TestFixed();
+    }
+}
+
+void SuitePcmConverter::TestSwap()
+{
+    // every length up to kMaxSubsamples, checking output doesn't overrun
+    TByte src[kMaxSubsamples * 3];
+    TByte dst[kMaxSubsamples * 3 + 1];
+    for (TUint i=0; i<sizeof(src); i++) {
+        src[i] = (TByte)NextRandom();
+    }
+    TBool ok = true;
+    for (TUint n=0; n<=kMaxSubsamples; n++) {
+        (void)memset(dst, 0xcc, sizeof(dst));
+        PcmConverter::SwapEndian16(dst, src, n);
+        for (TUint i=0; i<n; i++) {
+            ok = ok && dst[2*i] == src[2*i+1] && dst[2*i+1] == src[2*i];
+        }
+        ok = ok && dst[2*n] == 0xcc;
+
+        (void)memset(dst, 0xcc, sizeof(dst));
+        PcmConverter::SwapEndian24(dst, src, n);
+        for (TUint i=0; i<n; i++) {
+            ok = ok && dst[3*i] == src[3*i+2] && dst[3*i+1] == src[3*i+1] && dst[3*i+2] == src[3*i];
+        }
+        ok = ok && dst[3*n] == 0xcc;
+
+        // in place
+        (void)memcpy(dst, src, n*3);
+        PcmConverter::SwapEndian24(dst, dst, n);
+        PcmConverter::SwapEndian24(dst, dst, n);
+        ok = ok && memcmp(dst, src, n*3) == 0;
+        (void)memcpy(dst, src, n*2);
+        PcmConverter::SwapEndian16(dst, dst, n);
+        PcmConverter::SwapEndian16(dst, dst, n);
+        ok = ok && memcmp(dst, src, n*2) == 0;
+    }
+    TEST(ok);
+}
+
+void SuitePcmConverter::TestPack()
+{
+    TInt32 src[kMaxSubsamples];
+    TByte dst[kMaxSubsamples * 3 + 1];
+    for (TUint i=0; i<kMaxSubsamples; i++) {
+        src[i] = (TInt32)NextRandom();
+    }
+    src[0] = (TInt32)0x80000000;
+    src[1] = 0x7fffffff;
+    TBool ok = true;
+    for (TUint n=0; n<=kMaxSubsamples; n++) {
+        (void)memset(dst, 0xcc, sizeof(dst));
+        PcmConverter::PackToBigEndian24(dst, src, n);
+        for (TUint i=0; i<n; i++) {
+            const TUint32 s = (TUint32)src[i];
+            ok = ok && dst[3*i] == (TByte)(s >> 24) && dst[3*i+1] == (TByte)(s >> 16) && dst[3*i+2] == (TByte)(s >> 8);
+        }
+        ok = ok && dst[3*n] == 0xcc;
+
+        (void)memset(dst, 0xcc, sizeof(dst));
+        PcmConverter::PackToBigEndian16(dst, src, n);
+        for (TUint i=0; i<n; i++) {
+            const TUint32 s = (TUint32)src[i];
+            ok = ok && dst[2*i] == (TByte)(s >> 24) && dst[2*i+1] == (TByte)(s >> 16);
+        }
+        ok = ok && dst[2*n] == 0xcc;
+    }
+    TEST(ok);
+}
+
+void SuitePcmConverter::TestInterleave()
+{
+    static const TUint kSamples = 777; // more than one internal staging block
+    static const TUint kOffset = 5;
+    static const TUint kBitDepths[] = { 8, 16, 24 };
+    std::vector<TInt32> channels[kMaxChannels];
+    const TInt32* src[kMaxChannels];
+    std::vector<TByte> interleaved(kSamples * kMaxChannels * 3);
+    for (TUint numChannels=1; numChannels<=kMaxChannels; numChannels++) {
+        for (TUint b=0; b<sizeof(kBitDepths)/sizeof(kBitDepths[0]); b++) {
+            const TUint bitDepth = kBitDepths[b];
+            const TUint byteDepth = bitDepth / 8;
+            for (TUint j=0; j<numChannels; j++) {
+                channels[j].resize(kOffset + kSamples);
+                for (TUint i=0; i<kOffset+kSamples; i++) {
+                    channels[j][i] = ((TInt32)NextRandom()) >> (32 - bitDepth); // right aligned, sign extended
+                }
+                src[j] = &channels[j][0];
+            }
+            PcmConverter::InterleaveToBigEndian(&interleaved[0], src, numChannels, kOffset, kSamples, bitDepth);
+
+            // each subsample is written most significant byte first, channels interleaved
+            TBool ok = true;
+            const TByte* p = &interleaved[0];
+            for (TUint i=kOffset; i<kOffset+kSamples; i++) {
+                for (TUint j=0; j<numChannels; j++) {
+                    const TUint32 s = (TUint32)channels[j][i];
+                    for (TUint k=0; k<byteDepth; k++) {
+                        ok = ok && *p++ == (TByte)(s >> (bitDepth - 8 * (k + 1)));
+                    }
+                }
+            }
+            TEST(ok);
+        }
+    }
+}
+
+void SuitePcmConverter::TestFixed()
+{
+    // libmad-style 4.28 fixed point.  +/-1.0 and beyond clip; other values are truncated to 24 bits
+    static const TUint kFracBits = 28;
+    static const TInt32 kOne = 1 << kFracBits;
+    const TInt32 left[] = { 0, kOne, -kOne, kOne * 3, -kOne * 5, kOne - 1, 1 << 4, -(1 << 4) };
+    const TInt32 right[] = { kOne / 2, -kOne / 2, 1 << 5, 0, 0, 0, 0, 0 };
+    const TUint numSamples = sizeof(left) / sizeof(left[0]);
+    const TInt32* src[2] = { left, right };
+    TByte dst[numSamples * 2 * 3];
+    PcmConverter::InterleaveFixedToBigEndian24(dst, src, 2, 0, numSamples, kFracBits);
+    const TByte expected[numSamples * 2 * 3] = {
+        0x00, 0x00, 0x00,   0x40, 0x00, 0x00,
+        0x7f, 0xff, 0xff,   0xc0, 0x00, 0x00,
+        0x80, 0x00, 0x00,   0x00, 0x00, 0x01,
+        0x7f, 0xff, 0xff,   0x00, 0x00, 0x00,
+        0x80, 0x00, 0x00,   0x00, 0x00, 0x00,
+        0x7f, 0xff, 0xff,   0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00,   0x00, 0x00, 0x00,
+        0xff, 0xff, 0xff,   0x00, 0x00, 0x00
+    };
+    TEST(memcmp(dst, expected, sizeof(dst)) == 0);
+
+    // skip leading samples and handle mono
+    PcmConverter::InterleaveFixedToBigEndian24(dst, src, 1, 1, 2, kFracBits);
+    TEST(dst[0] == 0x7f && dst[1] == 0xff && dst[2] == 0xff);
+    TEST(dst[3] == 0x80 && dst[4] == 0x00 && dst[5] == 0x00);
+}
+
+TUint32 SuitePcmConverter::NextRandom()
+{
+    iRandom = iRandom * 1103515245u + 12345u;
+    return (iRandom << 16) ^ (iRandom >> 8);
+}
+
+
+
+void TestPcmConverter()
+{
+    Runner runner("PcmConverter tests\n");
+    runner.Add(new SuitePcmConverter());
+    runner.Run();
+}
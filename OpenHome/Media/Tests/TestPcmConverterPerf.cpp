@@ -0,0 +1,147 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Utils/PcmConverter.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/OsWrapper.h>
+#include <OpenHome/Private/Printer.h>
+
+#include <string.h>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media;
+
+namespace OpenHome {
+namespace Media {
+
+class SuitePcmConverterPerf : public Suite, private INonCopyable
+{
+    static const TUint kIterations = 20000;
+    static const TUint kMaxChannels = 8;
+    static const TUint kMaxSubsamples = DecodedAudio::kMaxBytes / 3;
+public:
+    SuitePcmConverterPerf(Environment& aEnv);
+    ~SuitePcmConverterPerf();
+    void Test();
+private:
+    void TimeImplementation(PcmConverter::EImplementation aImpl);
+    TUint Start() const;
+    void Report(const TChar* aKernel, TUint aStart, TUint aSubsamples);
+private:
+    Environment& iEnv;
+    PcmConverter::EImplementation iDefaultImpl;
+    TByte iPcm[DecodedAudio::kMaxBytes];
+    TByte iOut[DecodedAudio::kMaxBytes];
+    TInt32 iSubsamples[kMaxSubsamples];
+    TInt32 iChannels[kMaxChannels][kMaxSubsamples / kMaxChannels];
+};
+
+} // namespace Media
+} // namespace OpenHome
+
+
+// SuitePcmConverterPerf
+
+SuitePcmConverterPerf::SuitePcmConverterPerf(Environment& aEnv)
+    : Suite("PcmConverter performance")
+    , iEnv(aEnv)
+{
+    iDefaultImpl = PcmConverter::Implementation();
+    for (TUint i=0; i<sizeof(iPcm); i++) {
+        iPcm[i] = (TByte)(i * 7);
+    }
+    for (TUint i=0; i<kMaxSubsamples; i++) {
+        iSubsamples[i] = (TInt32)(i * 0x01010101);
+    }
+    for (TUint j=0; j<kMaxChannels; j++) {
+        for (TUint i=0; i<kMaxSubsamples / kMaxChannels; i++) {
+            iChannels[j][i] = (TInt32)((i * 0x0101) ^ j) & 0xffffff;
+        }
+    }
+}
+
+SuitePcmConverterPerf::~SuitePcmConverterPerf()
+{
+    PcmConverter::SetImplementation(iDefaultImpl);
+}
+
+void SuitePcmConverterPerf::Test()
+{
+    Log::Print("Default implementation: %s\n", PcmConverter::ImplementationName(iDefaultImpl));
+    const PcmConverter::EImplementation impls[] = { PcmConverter::eScalar, PcmConverter::eSse2, PcmConverter::eAvx2, PcmConverter::eNeon };
+    for (TUint i=0; i<sizeof(impls)/sizeof(impls[0]); i++) {
+        if (PcmConverter::IsSupported(impls[i])) {
+            TimeImplementation(impls[i]);
+        }
+    }
+    TEST(true);
+}
+
+void SuitePcmConverterPerf::TimeImplementation(PcmConverter::EImplementation aImpl)
+{
+    PcmConverter::SetImplementation(aImpl);
+    Log::Print("%s\n", PcmConverter::ImplementationName(aImpl));
+
+    const TUint subsamples16 = DecodedAudio::kMaxBytes / 2;
+    const TUint subsamples24 = DecodedAudio::kMaxBytes / 3;
+    TUint start = Start();
+    for (TUint i=0; i<kIterations; i++) {
+        PcmConverter::SwapEndian16(iOut, iPcm, subsamples16);
+    }
+    Report("SwapEndian16", start, subsamples16);
+
+    start = Start();
+    for (TUint i=0; i<kIterations; i++) {
+        PcmConverter::SwapEndian24(iOut, iPcm, subsamples24);
+    }
+    Report("SwapEndian24", start, subsamples24);
+
+    start = Start();
+    for (TUint i=0; i<kIterations; i++) {
+        PcmConverter::PackToBigEndian24(iOut, iSubsamples, subsamples24);
+    }
+    Report("PackToBigEndian24", start, subsamples24);
+
+    start = Start();
+    for (TUint i=0; i<kIterations; i++) {
+        PcmConverter::PackToBigEndian16(iOut, iSubsamples, subsamples24);
+    }
+    Report("PackToBigEndian16", start, subsamples24);
+
+    const TInt32* channels[kMaxChannels];
+    for (TUint j=0; j<kMaxChannels; j++) {
+        channels[j] = iChannels[j];
+    }
+    const TUint samples8 = kMaxSubsamples / kMaxChannels;
+    start = Start();
+    for (TUint i=0; i<kIterations; i++) {
+        PcmConverter::InterleaveToBigEndian(iOut, channels, kMaxChannels, 0, samples8, 24);
+    }
+    Report("InterleaveToBigEndian (8ch, 24-bit)", start, samples8 * kMaxChannels);
+
+    start = Start();
+    for (TUint i=0; i<kIterations; i++) {
+        PcmConverter::InterleaveFixedToBigEndian24(iOut, channels, 2, 0, samples8, 28);
+    }
+    Report("InterleaveFixedToBigEndian24 (2ch)", start, samples8 * 2);
+}
+
+TUint SuitePcmConverterPerf::Start() const
+{
+    return Os::TimeInMs(iEnv.OsCtx());
+}
+
+void SuitePcmConverterPerf::Report(const TChar* aKernel, TUint aStart, TUint aSubsamples)
+{
+    const TUint ms = Os::TimeInMs(iEnv.OsCtx()) - aStart;
+    Log::Print("  %-40s %5ums (%u x %u subsamples)\n", aKernel, ms, kIterations, aSubsamples);
+}
+
+
+
+void TestPcmConverterPerf(Environment& aEnv)
+{
+    Runner runner("PcmConverter performance\n");
+    runner.Add(new SuitePcmConverterPerf(aEnv));
+    runner.Run();
+}
@@ -0,0 +1,941 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/PipelineManager.h>
+#include <OpenHome/Media/Pipeline/Pipeline.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Media/UriProviderSingleTrack.h>
+#include <OpenHome/Media/MimeTypeList.h>
+#include <OpenHome/Media/Codec/CodecFactory.h>
+#include <OpenHome/Media/Codec/ContainerFactory.h>
+#include <OpenHome/Media/Protocol/ProtocolFactory.h>
+#include <OpenHome/Media/Utils/AllocatorInfoLogger.h>
+#include <OpenHome/Media/Tests/TestCodec.h>
+#include <OpenHome/Net/Private/Shell.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/File.h>
+#include <OpenHome/Private/Http.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Parser.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/Uri.h>
+#include <OpenHome/OsWrapper.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media;
+
+/*
+Time-to-first-audio benchmark.
+
+Plays every file from TestCodec's file set through a complete PipelineManager, fetching each
+via ProtocolFile and via ProtocolHttp (from an in-process server), plus a set of ProtocolTone
+streams.  A driver pulls from the end of the pipeline as fast as it can, so results measure
+pipeline/codec cost rather than playback speed.  For each stream, one line of json is output:
+
+    ttfa_ms     - Begin()+Play() until the first MsgPlayable for the track is pulled
+    seek_ms     - Seek() to the middle of the track until the first MsgPlayable after it
+    reseek_ms   - Seek() back to audio decoded before that seek until the first MsgPlayable after it
+    skip_ms     - RemoveAll()+Begin()+Play() of another track until its first MsgPlayable
+    x_realtime  - duration of the track / wall time taken to pull all of it
+
+Values that couldn't be measured (non-seekable streams, timeouts) are reported as null.
+--rtt delays each response from the http server, simulating a remote server for seek tests.
+--file adds a file of your own, e.g. a multi-hour m4a whose sample tables dominate ttfa_ms.
+*/
+
+extern AudioFileCollection* TestCodecFiles();
+
+namespace OpenHome {
+namespace Media {
+
+class BenchmarkHeaderRange : public HttpHeader
+{
+public:
+    static const TUint kEndUnspecified = 0;
+public:
+    TUint Start() const;
+    TUint End() const;
+private: // from HttpHeader
+    TBool Recognise(const Brx& aHeader) override;
+    void Process(const Brx& aValue) override;
+private:
+    TUint iStart;
+    TUint iEnd;
+};
+
+class BenchmarkHttpSession : public SocketTcpSession
+{
+    static const TUint kMaxReadBytes = 1024;
+    static const TUint kReadTimeoutMs = 5000;
+    static const TUint kWriteBufBytes = 16 * 1024;
+    static const TUint kMaxPathBytes = 512;
+public:
+    BenchmarkHttpSession(Environment& aEnv, const Brx& aRootDir, TUint aRttMs);
+    ~BenchmarkHttpSession();
+private: // from SocketTcpSession
+    void Run() override;
+private:
+    void Respond();
+    void Respond(IFile& aFile);
+    void WriteStatus(const HttpStatus& aStatus);
+private:
+    const Brx& iRootDir;
+    const TUint iRttMs;
+    Srs<kMaxReadBytes> iReadBuffer;
+    ReaderUntilS<kMaxReadBytes> iReaderUntil;
+    ReaderHttpRequest iReaderRequest;
+    BenchmarkHeaderRange iHeaderRange;
+    Sws<kWriteBufBytes> iWriterBuffer;
+    WriterHttpResponse iWriterResponse;
+    Bwh iFileBuf;
+};
+
+class BenchmarkHttpServer : public SocketTcpServer
+{
+    static const TUint kNumSessions = 4; // stream, out-of-band reads and sessions left over from seeks
+    static const Brn kPrefixHttp;
+    static const TUint kMaxUriBytes = Endpoint::kMaxEndpointBytes + sizeof("http://") - 1;
+public:
+    BenchmarkHttpServer(Environment& aEnv, TIpAddress aInterface, const Brx& aRootDir, TUint aRttMs);
+    const Brx& ServingUri() const;
+private:
+    Bws<kMaxUriBytes> iUri;
+};
+
+class BenchmarkDriver : public PipelineElement, public IPipelineAnimator, private IPcmProcessor
+{
+    static const TUint kSupportedMsgTypes;
+public:
+    BenchmarkDriver(Environment& aEnv, IPipeline& aPipeline);
+    ~BenchmarkDriver();
+    /*
+     * Report the time of the first MsgPlayable from the next MsgDecodedStream.
+     * If aHold is set, stop pulling after it (until Resume() is called) so that the stream
+     * remains in the pipeline for a subsequent seek or skip.
+     */
+    void ExpectStream(TBool aHold);
+    TUint64 WaitForAudio(TUint aTimeoutMs); // returns time in us.  Throws Timeout
+    void Resume();
+    void ExpectHalt();
+    TUint64 WaitForHalt(TUint aTimeoutMs, TUint64& aJiffies); // returns time in us.  Throws Timeout
+    TUint StreamId() const;
+    TBool Seekable() const;
+    TUint64 TrackLengthJiffies() const;
+    void CodecName(Bwx& aName) const;
+private:
+    void DriverThread();
+private: // from IMsgProcessor
+    Msg* ProcessMsg(MsgMode* aMsg) override;
+    Msg* ProcessMsg(MsgDrain* aMsg) override;
+    Msg* ProcessMsg(MsgHalt* aMsg) override;
+    Msg* ProcessMsg(MsgDecodedStream* aMsg) override;
+    Msg* ProcessMsg(MsgPlayable* aMsg) override;
+    Msg* ProcessMsg(MsgQuit* aMsg) override;
+private: // from IPipelineAnimator
+    TUint PipelineDriverDelayJiffies(TUint aSampleRateFrom, TUint aSampleRateTo) override;
+private: // from IPcmProcessor
+    void BeginBlock() override;
+    void ProcessFragment8(const Brx& aData, TUint aNumChannels) override;
+    void ProcessFragment16(const Brx& aData, TUint aNumChannels) override;
+    void ProcessFragment24(const Brx& aData, TUint aNumChannels) override;
+    void ProcessFragment32(const Brx& aData, TUint aNumChannels) override;
+    void ProcessSample8(const TByte* aSample, TUint aNumChannels) override;
+    void ProcessSample16(const TByte* aSample, TUint aNumChannels) override;
+    void ProcessSample24(const TByte* aSample, TUint aNumChannels) override;
+    void ProcessSample32(const TByte* aSample, TUint aNumChannels) override;
+    void EndBlock() override;
+    void Flush() override;
+private:
+    IPipeline& iPipeline;
+    OsContext* iOsCtx;
+    mutable Mutex iLock;
+    Semaphore iSemAudio;
+    Semaphore iSemHalt;
+    Semaphore iSemResume;
+    ThreadFunctor* iThread;
+    TBool iAwaitStream;
+    TBool iAwaitAudio;
+    TBool iAwaitHalt;
+    TBool iHold;
+    TBool iHeld;
+    TUint64 iAudioTimeUs;
+    TUint64 iHaltTimeUs;
+    TUint iStreamId;
+    TBool iSeekable;
+    TUint64 iTrackLength;
+    Bws<DecodedStreamInfo::kMaxCodecNameBytes> iCodecName;
+    TUint iBytesPerSample; // across all channels
+    TUint iJiffiesPerSample;
+    TUint64 iStreamBytes;
+    TUint64 iStreamJiffies;
+    TBool iQuit;
+};
+
+class SuitePipelineBenchmark : public Suite, private IMimeTypeList, private INonCopyable
+{
+    static const TChar* kMode;
+    static const TUint kTimeoutMs = 10000;
+    static const TUint kMaxUriBytes = 1024;
+    static const TUint kReseekSeconds = 1;
+public:
+    SuitePipelineBenchmark(Environment& aEnv, const Brx& aRootDir, const Brx& aExtraFile, TBool aFull, TUint aIterations, TBool aMemoryMapped, TUint aRttMs);
+    ~SuitePipelineBenchmark();
+    void Test() override;
+private: // from IMimeTypeList
+    void Add(const TChar* aMimeType) override;
+private:
+    void MeasureFile(const Brx& aFilename);
+    void Measure(const TChar* aProtocol, const Brx& aName, const Brx& aUri);
+    TBool MeasureStartAndThroughput(const Brx& aUri, TUint64& aTtfaUs, TUint64& aJiffies, TUint64& aElapsedUs);
+    TBool MeasureSeek(const Brx& aUri, TUint64& aSeekUs);
+    TBool MeasureReseek(TUint64& aReseekUs);
+    TBool MeasureSkip(const Brx& aUri, TUint64& aSkipUs);
+    void Start(const Brx& aUri);
+    void Stop();
+    static void AppendMs(Bwx& aBuf, TBool aValid, TUint64 aUs);
+private:
+    Environment& iEnv;
+    const Brx& iRootDir;
+    const Brx& iExtraFile;
+    const TBool iFull;
+    const TUint iIterations;
+    AllocatorInfoLogger iInfoAggregator;
+    Net::ShellNull iShell;
+    TrackFactory* iTrackFactory;
+    PipelineManager* iPipeline;
+    UriProviderSingleTrack* iUriProvider;
+    BenchmarkDriver* iDriver;
+    BenchmarkHttpServer* iServer;
+};
+
+} // namespace Media
+} // namespace OpenHome
+
+
+// BenchmarkHeaderRange
+
+TUint BenchmarkHeaderRange::Start() const
+{
+    return (Received()? iStart : 0);
+}
+
+TUint BenchmarkHeaderRange::End() const
+{
+    return (Received()? iEnd : kEndUnspecified);
+}
+
+TBool BenchmarkHeaderRange::Recognise(const Brx& aHeader)
+{
+    return Ascii::CaseInsensitiveEquals(aHeader, Http::kHeaderRange);
+}
+
+void BenchmarkHeaderRange::Process(const Brx& aValue)
+{
+    // Format of value is: "bytes=21010-" or "bytes=21010-47021"
+    iStart = 0;
+    iEnd = kEndUnspecified;
+    SetReceived();
+    Parser parser(aValue);
+    (void)parser.Next('=');
+    const Brn start = parser.Next('-');
+    const Brn end = parser.Remaining();
+    try {
+        iStart = Ascii::Uint(start);
+        if (end.Bytes() > 0) {
+            iEnd = Ascii::Uint(end);
+        }
+    }
+    catch (AsciiError&) {
+        THROW(HttpError);
+    }
+}
+
+
+// BenchmarkHttpSession
+
+BenchmarkHttpSession::BenchmarkHttpSession(Environment& aEnv, const Brx& aRootDir, TUint aRttMs)
+    : iRootDir(aRootDir)
+    , iRttMs(aRttMs)
+    , iReadBuffer(*this)
+    , iReaderUntil(iReadBuffer)
+    , iReaderRequest(aEnv, iReaderUntil)
+    , iWriterBuffer(*this)
+    , iWriterResponse(iWriterBuffer)
+    , iFileBuf(kWriteBufBytes)
+{
+    iReaderRequest.AddMethod(Http::kMethodGet);
+    iReaderRequest.AddHeader(iHeaderRange);
+}
+
+BenchmarkHttpSession::~BenchmarkHttpSession()
+{
+    iReaderUntil.ReadInterrupt();
+}
+
+void BenchmarkHttpSession::Run()
+{
+    // Client closing its connection early (on seek, skip or stop) is expected so errors are ignored
+    try {
+        iReaderRequest.Flush();
+        iReaderRequest.Read(kReadTimeoutMs);
+        iReaderRequest.UnescapeUri();
+        if (iRttMs > 0) {
+            Thread::Sleep(iRttMs);
+        }
+        Respond();
+    }
+    catch (HttpError&) {}
+    catch (ReaderError&) {}
+    catch (WriterError&) {}
+    catch (NetworkError&) {}
+}
+
+void BenchmarkHttpSession::Respond()
+{
+    Bws<kMaxPathBytes> path(iRootDir);
+    path.Append(iReaderRequest.Uri());
+    IFile* file = nullptr;
+    try {
+        file = IFile::Open(path.PtrZ(), eFileReadOnly);
+    }
+    catch (FileOpenError&) {
+        WriteStatus(HttpStatus::kNotFound);
+        iWriterResponse.WriteFlush();
+        return;
+    }
+    try {
+        Respond(*file);
+    }
+    catch (Exception&) {
+        delete file;
+        throw;
+    }
+    delete file;
+}
+
+void BenchmarkHttpSession::Respond(IFile& aFile)
+{
+    const TUint total = aFile.Bytes();
+    TUint first = 0;
+    TUint last = (total == 0? 0 : total - 1);
+    if (iHeaderRange.Received()) {
+        first = iHeaderRange.Start();
+        if (iHeaderRange.End() != BenchmarkHeaderRange::kEndUnspecified) {
+            last = std::min(iHeaderRange.End(), last);
+        }
+        if (first > last) {
+            WriteStatus(HttpStatus::kBadRequest);
+            iWriterResponse.WriteFlush();
+            return;
+        }
+        WriteStatus(HttpStatus::kPartialContent);
+        // Format of value is: "bytes 21010-47021/47022"
+        Bws<6+10+1+10+1+10> range("bytes ");
+        Ascii::AppendDec(range, first);
+        range.Append('-');
+        Ascii::AppendDec(range, last);
+        range.Append('/');
+        Ascii::AppendDec(range, total);
+        iWriterResponse.WriteHeader(Http::kHeaderContentRange, range);
+    }
+    else {
+        WriteStatus(HttpStatus::kOk);
+    }
+    TUint remaining = (total == 0? 0 : last - first + 1);
+    Http::WriteHeaderContentLength(iWriterResponse, remaining);
+    iWriterResponse.WriteFlush();
+
+    try {
+        aFile.Seek(first, eSeekFromStart);
+        while (remaining > 0) {
+            iFileBuf.SetBytes(0);
+            aFile.Read(iFileBuf, std::min(remaining, iFileBuf.MaxBytes()));
+            iWriterBuffer.Write(iFileBuf);
+            remaining -= iFileBuf.Bytes();
+        }
+    }
+    catch (FileSeekError&) {
+        THROW(WriterError);
+    }
+    catch (FileReadError&) {
+        THROW(WriterError);
+    }
+    iWriterBuffer.WriteFlush();
+}
+
+void BenchmarkHttpSession::WriteStatus(const HttpStatus& aStatus)
+{
+    iWriterResponse.WriteStatus(aStatus, Http::eHttp11);
+    Http::WriteHeaderConnectionClose(iWriterResponse);
+}
+
+
+// BenchmarkHttpServer
+
+const Brn BenchmarkHttpServer::kPrefixHttp("http://");
+
+BenchmarkHttpServer::BenchmarkHttpServer(Environment& aEnv, TIpAddress aInterface, const Brx& aRootDir, TUint aRttMs)
+    : SocketTcpServer(aEnv, "BHSV", 0, aInterface)
+{
+    for (TUint i=0; i<kNumSessions; i++) {
+        Bws<Thread::kMaxNameBytes+1> name("BHS");
+        Ascii::AppendDec(name, i);
+        SocketTcpServer::Add(name.PtrZ(), new BenchmarkHttpSession(aEnv, aRootDir, aRttMs));
+    }
+    iUri.Append(kPrefixHttp);
+    Endpoint endpoint(Port(), Interface());
+    endpoint.AppendEndpoint(iUri);
+}
+
+const Brx& BenchmarkHttpServer::ServingUri() const
+{
+    return iUri;
+}
+
+
+// BenchmarkDriver
+
+const TUint BenchmarkDriver::kSupportedMsgTypes =   eMode
+                                                  | eDrain
+                                                  | eHalt
+                                                  | eDecodedStream
+                                                  | ePlayable
+                                                  | eQuit;
+
+BenchmarkDriver::BenchmarkDriver(Environment& aEnv, IPipeline& aPipeline)
+    : PipelineElement(kSupportedMsgTypes)
+    , iPipeline(aPipeline)
+    , iOsCtx(aEnv.OsCtx())
+    , iLock("BDRV")
+    , iSemAudio("BDR1", 0)
+    , iSemHalt("BDR2", 0)
+    , iSemResume("BDR3", 0)
+    , iAwaitStream(false)
+    , iAwaitAudio(false)
+    , iAwaitHalt(false)
+    , iHold(false)
+    , iHeld(false)
+    , iAudioTimeUs(0)
+    , iHaltTimeUs(0)
+    , iStreamId(IPipelineIdProvider::kStreamIdInvalid)
+    , iSeekable(false)
+    , iTrackLength(0)
+    , iBytesPerSample(0)
+    , iJiffiesPerSample(0)
+    , iStreamBytes(0)
+    , iStreamJiffies(0)
+    , iQuit(false)
+{
+    iPipeline.SetAnimator(*this);
+    iThread = new ThreadFunctor("BenchmarkDriver", MakeFunctor(*this, &BenchmarkDriver::DriverThread), kPrioritySystemHighest);
+    iThread->Start();
+}
+
+BenchmarkDriver::~BenchmarkDriver()
+{
+    Resume();
+    delete iThread;
+}
+
+void BenchmarkDriver::ExpectStream(TBool aHold)
+{
+    AutoMutex _(iLock);
+    iAwaitStream = true;
+    iAwaitAudio = false;
+    iHold = aHold;
+    iSemAudio.Clear();
+}
+
+TUint64 BenchmarkDriver::WaitForAudio(TUint aTimeoutMs)
+{
+    iSemAudio.Wait(aTimeoutMs);
+    AutoMutex _(iLock);
+    return iAudioTimeUs;
+}
+
+void BenchmarkDriver::Resume()
+{
+    AutoMutex _(iLock);
+    iHold = false;
+    if (iHeld) {
+        iHeld = false;
+        iSemResume.Signal();
+    }
+}
+
+void BenchmarkDriver::ExpectHalt()
+{
+    AutoMutex _(iLock);
+    iAwaitHalt = true;
+    iSemHalt.Clear();
+}
+
+TUint64 BenchmarkDriver::WaitForHalt(TUint aTimeoutMs, TUint64& aJiffies)
+{
+    iSemHalt.Wait(aTimeoutMs);
+    AutoMutex _(iLock);
+    aJiffies = iStreamJiffies;
+    return iHaltTimeUs;
+}
+
+TUint BenchmarkDriver::StreamId() const
+{
+    AutoMutex _(iLock);
+    return iStreamId;
+}
+
+TBool BenchmarkDriver::Seekable() const
+{
+    AutoMutex _(iLock);
+    return iSeekable;
+}
+
+TUint64 BenchmarkDriver::TrackLengthJiffies() const
+{
+    AutoMutex _(iLock);
+    return iTrackLength;
+}
+
+void BenchmarkDriver::CodecName(Bwx& aName) const
+{
+    AutoMutex _(iLock);
+    aName.Replace(iCodecName);
+}
+
+void BenchmarkDriver::DriverThread()
+{
+    while (!iQuit) {
+        Msg* msg = iPipeline.Pull();
+        msg = msg->Process(*this);
+        ASSERT(msg == nullptr);
+        iLock.Wait();
+        const TBool held = iHeld;
+        iLock.Signal();
+        if (held) {
+            iSemResume.Wait();
+        }
+    }
+}
+
+Msg* BenchmarkDriver::ProcessMsg(MsgMode* aMsg)
+{
+    aMsg->RemoveRef();
+    return nullptr;
+}
+
+Msg* BenchmarkDriver::ProcessMsg(MsgDrain* aMsg)
+{
+    aMsg->ReportDrained();
+    aMsg->RemoveRef();
+    return nullptr;
+}
+
+Msg* BenchmarkDriver::ProcessMsg(MsgHalt* aMsg)
+{
+    aMsg->RemoveRef();
+    AutoMutex _(iLock);
+    // ignore halts that precede audio for the expected stream (e.g. left over from RemoveAll())
+    if (iAwaitHalt && !iAwaitStream && !iAwaitAudio) {
+        iAwaitHalt = false;
+        iHaltTimeUs = Os::TimeInUs(iOsCtx);
+        iSemHalt.Signal();
+    }
+    return nullptr;
+}
+
+Msg* BenchmarkDriver::ProcessMsg(MsgDecodedStream* aMsg)
+{
+    const DecodedStreamInfo& info = aMsg->StreamInfo();
+    AutoMutex _(iLock);
+    iStreamId = info.StreamId();
+    iSeekable = info.Seekable();
+    iTrackLength = info.TrackLength();
+    iCodecName.Replace(info.CodecName());
+    iBytesPerSample = (info.BitDepth() / 8) * info.NumChannels();
+    iJiffiesPerSample = Jiffies::JiffiesPerSample(info.SampleRate());
+    iStreamJiffies = 0;
+    if (iAwaitStream) {
+        iAwaitStream = false;
+        iAwaitAudio = true;
+    }
+    aMsg->RemoveRef();
+    return nullptr;
+}
+
+Msg* BenchmarkDriver::ProcessMsg(MsgPlayable* aMsg)
+{
+    iStreamBytes = 0;
+    aMsg->Read(*this);
+    aMsg->RemoveRef();
+    AutoMutex _(iLock);
+    iStreamJiffies += (iStreamBytes / iBytesPerSample) * iJiffiesPerSample;
+    if (iAwaitAudio) {
+        iAwaitAudio = false;
+        iAudioTimeUs = Os::TimeInUs(iOsCtx);
+        iHeld = iHold;
+        iSemAudio.Signal();
+    }
+    return nullptr;
+}
+
+Msg* BenchmarkDriver::ProcessMsg(MsgQuit* aMsg)
+{
+    iQuit = true;
+    aMsg->RemoveRef();
+    return nullptr;
+}
+
+TUint BenchmarkDriver::PipelineDriverDelayJiffies(TUint /*aSampleRateFrom*/, TUint /*aSampleRateTo*/)
+{
+    return 0;
+}
+
+void BenchmarkDriver::BeginBlock()
+{
+}
+
+void BenchmarkDriver::ProcessFragment8(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iStreamBytes += aData.Bytes();
+}
+
+void BenchmarkDriver::ProcessFragment16(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iStreamBytes += aData.Bytes();
+}
+
+void BenchmarkDriver::ProcessFragment24(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iStreamBytes += aData.Bytes();
+}
+
+void BenchmarkDriver::ProcessFragment32(const Brx& aData, TUint /*aNumChannels*/)
+{
+    iStreamBytes += aData.Bytes();
+}
+
+void BenchmarkDriver::ProcessSample8(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iStreamBytes += aNumChannels;
+}
+
+void BenchmarkDriver::ProcessSample16(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iStreamBytes += 2 * aNumChannels;
+}
+
+void BenchmarkDriver::ProcessSample24(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iStreamBytes += 3 * aNumChannels;
+}
+
+void BenchmarkDriver::ProcessSample32(const TByte* /*aSample*/, TUint aNumChannels)
+{
+    iStreamBytes += 4 * aNumChannels;
+}
+
+void BenchmarkDriver::EndBlock()
+{
+}
+
+void BenchmarkDriver::Flush()
+{
+}
+
+
+// SuitePipelineBenchmark
+
+const TChar* SuitePipelineBenchmark::kMode = "Benchmark";
+
+SuitePipelineBenchmark::SuitePipelineBenchmark(Environment& aEnv, const Brx& aRootDir, const Brx& aExtraFile, TBool aFull, TUint aIterations, TBool aMemoryMapped, TUint aRttMs)
+    : Suite("Pipeline time-to-first-audio benchmark")
+    , iEnv(aEnv)
+    , iRootDir(aRootDir)
+    , iExtraFile(aExtraFile)
+    , iFull(aFull)
+    , iIterations(aIterations)
+{
+    std::vector<NetworkAdapter*>* ifs = Os::NetworkListAdapters(aEnv, Net::InitialisationParams::ELoopbackUse, "PipelineBenchmark");
+    ASSERT(ifs->size() > 0);
+    TIpAddress addr = (*ifs)[0]->Address(); // using loopback, so first one should do
+    for (TUint i=0; i<ifs->size(); i++) {
+        (*ifs)[i]->RemoveRef("PipelineBenchmark");
+    }
+    delete ifs;
+    iServer = new BenchmarkHttpServer(aEnv, addr, aRootDir, aRttMs);
+
+    iTrackFactory = new TrackFactory(iInfoAggregator, 4);
+    iPipeline = new PipelineManager(PipelineInitParams::New(), iInfoAggregator, *iTrackFactory, iShell);
+    iPipeline->Add(Codec::ContainerFactory::NewId3v2());
+    iPipeline->Add(Codec::ContainerFactory::NewMpeg4(*this));
+    iPipeline->Add(Codec::ContainerFactory::NewMpegTs(*this));
+    iPipeline->Add(Codec::CodecFactory::NewFlac(*this));
+    iPipeline->Add(Codec::CodecFactory::NewWav(*this));
+    iPipeline->Add(Codec::CodecFactory::NewAiff(*this));
+    iPipeline->Add(Codec::CodecFactory::NewAifc(*this));
+    iPipeline->Add(Codec::CodecFactory::NewAac(*this));
+    iPipeline->Add(Codec::CodecFactory::NewAdts(*this));
+    iPipeline->Add(Codec::CodecFactory::NewAlac(*this));
+    iPipeline->Add(Codec::CodecFactory::NewMp3(*this));
+    iPipeline->Add(Codec::CodecFactory::NewPcm());
+    iPipeline->Add(Codec::CodecFactory::NewVorbis(*this));
+    iPipeline->Add(ProtocolFactory::NewFile(aEnv, aMemoryMapped));
+    iPipeline->Add(ProtocolFactory::NewHttp(aEnv, Brx::Empty()));
+    iPipeline->Add(ProtocolFactory::NewHttp(aEnv, Brx::Empty())); // second ProtocolHttp to allow out-of-band reads
+    iPipeline->Add(ProtocolFactory::NewTone(aEnv));
+    iUriProvider = new UriProviderSingleTrack(kMode, false, false, *iTrackFactory);
+    iPipeline->Add(iUriProvider); // ownership passed
+    iPipeline->Start();
+    iDriver = new BenchmarkDriver(aEnv, *iPipeline);
+}
+
+SuitePipelineBenchmark::~SuitePipelineBenchmark()
+{
+    iDriver->Resume();
+    iPipeline->Quit();
+    delete iDriver;
+    delete iPipeline;
+    delete iTrackFactory;
+    delete iServer;
+}
+
+void SuitePipelineBenchmark::Test()
+{
+    AudioFileCollection* collection = TestCodecFiles();
+    std::vector<AudioFileDescriptor> files(collection->RequiredFiles());
+    if (iFull) {
+        files.insert(files.end(), collection->ExtraFiles().begin(), collection->ExtraFiles().end());
+    }
+
+    static const TChar* kTones[] = {
+        "tone://sine.wav?bitdepth=16&samplerate=44100&pitch=440&channels=2&duration=10",
+        "tone://sine.wav?bitdepth=24&samplerate=192000&pitch=440&channels=2&duration=10",
+    };
+    for (TUint i=0; i<iIterations; i++) {
+        for (auto it=files.begin(); it!=files.end(); ++it) {
+            MeasureFile(it->Filename());
+        }
+        if (iExtraFile.Bytes() > 0) {
+            MeasureFile(iExtraFile);
+        }
+        for (TUint j=0; j<sizeof(kTones)/sizeof(kTones[0]); j++) {
+            Brn tone(kTones[j]);
+            Measure("tone", tone, tone);
+        }
+    }
+
+    delete collection;
+}
+
+void SuitePipelineBenchmark::Add(const TChar* /*aMimeType*/)
+{
+}
+
+void SuitePipelineBenchmark::MeasureFile(const Brx& aFilename)
+{
+    Bws<kMaxUriBytes> uri("file://");
+    uri.Append(iRootDir);
+    uri.Append('/');
+    uri.Append(aFilename);
+    Measure("file", aFilename, uri);
+
+    uri.Replace(iServer->ServingUri());
+    uri.Append('/');
+    uri.Append(aFilename);
+    Measure("http", aFilename, uri);
+}
+
+void SuitePipelineBenchmark::Measure(const TChar* aProtocol, const Brx& aName, const Brx& aUri)
+{
+    TUint64 ttfaUs = 0, jiffies = 0, elapsedUs = 0, seekUs = 0, reseekUs = 0, skipUs = 0;
+    const TBool started = MeasureStartAndThroughput(aUri, ttfaUs, jiffies, elapsedUs);
+    Bws<DecodedStreamInfo::kMaxCodecNameBytes> codec;
+    iDriver->CodecName(codec);
+    const TBool sought = (started && MeasureSeek(aUri, seekUs));
+    const TBool resought = (sought && MeasureReseek(reseekUs));
+    const TBool skipped = (started && MeasureSkip(aUri, skipUs));
+    Stop();
+    TEST(started);
+
+    Bws<320> line;
+    line.Append("{\"protocol\":\"");
+    line.Append(aProtocol);
+    line.Append("\",\"file\":\"");
+    line.Append(aName);
+    line.Append("\",\"codec\":\"");
+    line.Append(started? codec : Brx::Empty());
+    line.Append("\",\"ttfa_ms\":");
+    AppendMs(line, started, ttfaUs);
+    line.Append(",\"seek_ms\":");
+    AppendMs(line, sought, seekUs);
+    line.Append(",\"reseek_ms\":");
+    AppendMs(line, resought, reseekUs);
+    line.Append(",\"skip_ms\":");
+    AppendMs(line, skipped, skipUs);
+    line.Append(",\"x_realtime\":");
+    if (started && elapsedUs > 0) {
+        // jiffies -> us, scaled by 100 to report two decimal places
+        const TUint64 x100 = (jiffies * 1000 * 100) / (Jiffies::kPerMs * elapsedUs);
+        Ascii::AppendDec(line, x100 / 100);
+        line.Append('.');
+        if (x100 % 100 < 10) {
+            line.Append('0');
+        }
+        Ascii::AppendDec(line, x100 % 100);
+    }
+    else {
+        line.Append("null");
+    }
+    line.Append("}\n");
+    Log::Print(line);
+}
+
+TBool SuitePipelineBenchmark::MeasureStartAndThroughput(const Brx& aUri, TUint64& aTtfaUs, TUint64& aJiffies, TUint64& aElapsedUs)
+{
+    iDriver->ExpectStream(false);
+    iDriver->ExpectHalt();
+    const TUint64 start = Os::TimeInUs(iEnv.OsCtx());
+    Start(aUri);
+    try {
+        aTtfaUs = iDriver->WaitForAudio(kTimeoutMs) - start;
+        aElapsedUs = iDriver->WaitForHalt(kTimeoutMs, aJiffies) - start;
+    }
+    catch (Timeout&) {
+        Log::Print("PipelineBenchmark: timeout playing %.*s\n", PBUF(aUri));
+        return false;
+    }
+    return true;
+}
+
+TBool SuitePipelineBenchmark::MeasureSeek(const Brx& aUri, TUint64& aSeekUs)
+{
+    // restart the track, holding the driver once audio is available so the stream is still
+    // being decoded when we seek
+    iDriver->ExpectStream(true);
+    Start(aUri);
+    try {
+        (void)iDriver->WaitForAudio(kTimeoutMs);
+    }
+    catch (Timeout&) {
+        return false;
+    }
+    if (!iDriver->Seekable()) {
+        return false;
+    }
+    const TUint seconds = (TUint)(iDriver->TrackLengthJiffies() / Jiffies::kPerSecond) / 2;
+    iDriver->ExpectStream(true);
+    const TUint64 start = Os::TimeInUs(iEnv.OsCtx());
+    iPipeline->Seek(iDriver->StreamId(), seconds);
+    iDriver->Resume();
+    try {
+        aSeekUs = iDriver->WaitForAudio(kTimeoutMs) - start;
+    }
+    catch (Timeout&) {
+        return false;
+    }
+    return true;
+}
+
+TBool SuitePipelineBenchmark::MeasureReseek(TUint64& aReseekUs)
+{
+    // MeasureSeek() started the track, so audio up to kReseekSeconds has already been decoded
+    const TUint seconds = (TUint)(iDriver->TrackLengthJiffies() / Jiffies::kPerSecond) / 2;
+    if (seconds <= kReseekSeconds) {
+        return false;
+    }
+    iDriver->ExpectStream(true);
+    const TUint64 start = Os::TimeInUs(iEnv.OsCtx());
+    iPipeline->Seek(iDriver->StreamId(), kReseekSeconds);
+    iDriver->Resume();
+    try {
+        aReseekUs = iDriver->WaitForAudio(kTimeoutMs) - start;
+    }
+    catch (Timeout&) {
+        return false;
+    }
+    return true;
+}
+
+TBool SuitePipelineBenchmark::MeasureSkip(const Brx& aUri, TUint64& aSkipUs)
+{
+    // driver may still be holding audio from the seek test, so the pipeline is part way
+    // through a track when we skip
+    iDriver->ExpectStream(true);
+    const TUint64 start = Os::TimeInUs(iEnv.OsCtx());
+    Start(aUri);
+    iDriver->Resume();
+    try {
+        aSkipUs = iDriver->WaitForAudio(kTimeoutMs) - start;
+    }
+    catch (Timeout&) {
+        return false;
+    }
+    return true;
+}
+
+void SuitePipelineBenchmark::Start(const Brx& aUri)
+{
+    iPipeline->RemoveAll();
+    Track* track = iUriProvider->SetTrack(aUri, Brx::Empty());
+    iPipeline->Begin(Brn(kMode), track->Id());
+    iPipeline->Play();
+}
+
+void SuitePipelineBenchmark::Stop()
+{
+    iPipeline->RemoveAll();
+    iDriver->Resume();
+}
+
+void SuitePipelineBenchmark::AppendMs(Bwx& aBuf, TBool aValid, TUint64 aUs)
+{ // static
+    if (!aValid) {
+        aBuf.Append("null");
+        return;
+    }
+    Ascii::AppendDec(aBuf, aUs / 1000);
+    aBuf.Append('.');
+    const TUint frac = (TUint)(aUs % 1000);
+    if (frac < 100) {
+        aBuf.Append('0');
+    }
+    if (frac < 10) {
+        aBuf.Append('0');
+    }
+    Ascii::AppendDec(aBuf, frac);
+}
+
+
+
+void TestPipelineBenchmark(Environment& aEnv, const std::vector<Brn>& aArgs)
+{
+    OptionParser parser;
+    OptionString optionDir("-d", "--dir", Brn(""), "absolute path of directory containing TestCodec's files");
+    parser.AddOption(&optionDir);
+    OptionString optionFile("-f", "--file", Brn(""), "additional file in --dir to play (e.g. a multi-hour m4a)");
+    parser.AddOption(&optionFile);
+    OptionString optionTestType("-t", "--type", Brn("quick"), "files to play (quick | full)");
+    parser.AddOption(&optionTestType);
+    OptionUint optionIterations("-i", "--iterations", 1, "number of times to play each file");
+    parser.AddOption(&optionIterations);
+    OptionBool optionMmap("-m", "--mmap", "read local files via memory mapping");
+    parser.AddOption(&optionMmap);
+    OptionUint optionRtt("-r", "--rtt", 0, "ms to delay each http response by");
+    parser.AddOption(&optionRtt);
+    if (!parser.Parse(aArgs) || parser.HelpDisplayed()) {
+        return;
+    }
+    if (optionDir.Value().Bytes() == 0) {
+        Log::Print("PipelineBenchmark: --dir is required\n");
+        return;
+    }
+    const TBool full = (optionTestType.Value() == Brn("full"));
+
+    Runner runner("Pipeline benchmark\n");
+    runner.Add(new SuitePipelineBenchmark(aEnv, optionDir.Value(), optionFile.Value(), full, optionIterations.Value(), optionMmap.Value(), optionRtt.Value()));
+    runner.Run();
+}
@@ -0,0 +1,409 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Pipeline/PipelineTracer.h>
+#include <OpenHome/Media/Pipeline/Logger.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Media/Utils/AllocatorInfoLogger.h>
+#include <OpenHome/Private/Converter.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Net/Private/Shell.h>
+
+#include <list>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media;
+
+namespace OpenHome {
+namespace Media {
+
+class SuitePipelineTracer : public SuiteUnitTest, private IPipelineElementUpstream
+{
+    static const TUint kMaxRecords = 16;
+    static const TUint kRecordBytes = 28;
+public:
+    SuitePipelineTracer();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private: // from IPipelineElementUpstream
+    Msg* Pull() override;
+private:
+    void TestDisabledByDefault();
+    void TestLoggerTracesMsgs();
+    void TestResidency();
+    void TestStaleStampsIgnored();
+    void TestReallocatedMsgNotStamped();
+    void TestLevel();
+    void TestPercentiles();
+    void TestRingWraps();
+    void TestFreeze();
+    void TestStarvationRecordsWorstResidency();
+    void TestPrintDump();
+    void TestPrintDumpRejectsInvalid();
+    void TestQueryInfo();
+    void TestLoggerQuit();
+private:
+    void Level(TUint& aLevel);
+    TUint DumpRecordCount();
+private:
+    AllocatorInfoLogger iInfoAggregator;
+    Net::ShellNull iShell;
+    MsgFactory* iMsgFactory;
+    PipelineTracer* iTracer;
+    std::list<Msg*> iPendingMsgs;
+    TUint iLevel;
+};
+
+} // namespace Media
+} // namespace OpenHome
+
+
+// SuitePipelineTracer
+
+SuitePipelineTracer::SuitePipelineTracer()
+    : SuiteUnitTest("PipelineTracer")
+{
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestDisabledByDefault), "TestDisabledByDefault");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestLoggerTracesMsgs), "TestLoggerTracesMsgs");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestResidency), "TestResidency");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestStaleStampsIgnored), "TestStaleStampsIgnored");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestReallocatedMsgNotStamped), "TestReallocatedMsgNotStamped");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestLevel), "TestLevel");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestPercentiles), "TestPercentiles");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestRingWraps), "TestRingWraps");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestFreeze), "TestFreeze");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestStarvationRecordsWorstResidency), "TestStarvationRecordsWorstResidency");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestPrintDump), "TestPrintDump");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestPrintDumpRejectsInvalid), "TestPrintDumpRejectsInvalid");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestQueryInfo), "TestQueryInfo");
+    AddTest(MakeFunctor(*this, &SuitePipelineTracer::TestLoggerQuit), "TestLoggerQuit");
+}
+
+void SuitePipelineTracer::Setup()
+{
+    MsgFactoryInitParams init;
+    init.SetMsgSilenceCount(10);
+    init.SetMsgHaltCount(2);
+    init.SetMsgQuitCount(2);
+    iMsgFactory = new MsgFactory(iInfoAggregator, init);
+    iTracer = new PipelineTracer(iInfoAggregator, iShell, kMaxRecords);
+    iLevel = 0;
+}
+
+void SuitePipelineTracer::TearDown()
+{
+    for (auto it=iPendingMsgs.begin(); it!=iPendingMsgs.end(); ++it) {
+        (*it)->RemoveRef();
+    }
+    iPendingMsgs.clear();
+    delete iTracer;
+    delete iMsgFactory;
+}
+
+Msg* SuitePipelineTracer::Pull()
+{
+    ASSERT(iPendingMsgs.size() > 0);
+    Msg* msg = iPendingMsgs.front();
+    iPendingMsgs.pop_front();
+    return msg;
+}
+
+void SuitePipelineTracer::Level(TUint& aLevel)
+{
+    aLevel = iLevel;
+}
+
+TUint SuitePipelineTracer::DumpRecordCount()
+{
+    WriterBwh writer(1024);
+    iTracer->Dump(writer);
+    Bwh dump;
+    writer.TransferTo(dump);
+    return Converter::BeUint32At(dump, 12);
+}
+
+void SuitePipelineTracer::TestDisabledByDefault()
+{
+    TEST(!iTracer->Enabled());
+    Logger logger(*this, "A");
+    logger.SetTracer(*iTracer);
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs));
+    Msg* msg = logger.Pull();
+    msg->RemoveRef();
+    TEST(iTracer->iElements[0].iMsgs == 0);
+    TEST(DumpRecordCount() == 0);
+
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgQuit());
+    logger.Pull()->RemoveRef();
+}
+
+void SuitePipelineTracer::TestLoggerTracesMsgs()
+{
+    Logger loggerA(*this, "A");
+    loggerA.SetTracer(*iTracer);
+    Logger loggerB(loggerA, "B");
+    loggerB.SetTracer(*iTracer);
+    iTracer->SetEnabled(true);
+
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgSilence(Jiffies::kPerMs * 2));
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgHalt());
+    for (TUint i=0; i<2; i++) {
+        Msg* msg = loggerB.Pull();
+        msg->RemoveRef();
+    }
+    const PipelineTracer::Element& a = iTracer->iElements[0];
+    const PipelineTracer::Element& b = iTracer->iElements[1];
+    TEST(a.iMsgs == 2);
+    TEST(b.iMsgs == 2);
+    TEST(a.iJiffies == Jiffies::kPerMs * 2);
+    TEST(b.iJiffies == Jiffies::kPerMs * 2);
+    TEST(a.iResidency.Count() == 0); // msgs weren't stamped before reaching the first element
+    TEST(b.iResidency.Count() == 2);
+    TEST(a.iCallLatency.Count() == 2);
+    TEST(DumpRecordCount() == 4);
+
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgQuit());
+    loggerB.Pull()->RemoveRef();
+}
+
+void SuitePipelineTracer::TestResidency()
+{
+    const TUint a = iTracer->AddElement("A");
+    const TUint b = iTracer->AddElement("B");
+    iTracer->SetEnabled(true);
+    const TUint64 base = PipelineTracer::NowUs() + 1000;
+    Msg* msg = iMsgFactory->CreateMsgHalt();
+    iTracer->Trace(a, *msg, PipelineTracer::ECallPull, base, 3, 0);
+    iTracer->Trace(b, *msg, PipelineTracer::ECallPull, base + 500, 7, 0);
+    msg->RemoveRef();
+    TEST(iTracer->iElements[a].iResidency.Count() == 0);
+    TEST(iTracer->iElements[b].iResidency.Count() == 1);
+    TEST(iTracer->iElements[b].iResidency.Max() == 500);
+    TEST(iTracer->iElements[a].iCallLatency.Max() == 3);
+    TEST(iTracer->iElements[b].iCallLatency.Max() == 7);
+}
+
+void SuitePipelineTracer::TestStaleStampsIgnored()
+{
+    const TUint a = iTracer->AddElement("A");
+    const TUint b = iTracer->AddElement("B");
+    iTracer->SetEnabled(true);
+    Msg* msg = iMsgFactory->CreateMsgHalt();
+    iTracer->Trace(a, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+    // re-enabling starts a new session; stamps from the previous one shouldn't count
+    iTracer->SetEnabled(false);
+    Thread::Sleep(2);
+    iTracer->SetEnabled(true);
+    iTracer->Trace(b, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+    msg->RemoveRef();
+    TEST(iTracer->iElements[b].iResidency.Count() == 0);
+}
+
+void SuitePipelineTracer::TestReallocatedMsgNotStamped()
+{
+    const TUint a = iTracer->AddElement("A");
+    const TUint b = iTracer->AddElement("B");
+    iTracer->SetEnabled(true);
+    Msg* msg = iMsgFactory->CreateMsgHalt();
+    iTracer->Trace(a, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+    msg->RemoveRef();
+    msg = iMsgFactory->CreateMsgHalt();
+    iTracer->Trace(b, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+    msg->RemoveRef();
+    TEST(iTracer->iElements[b].iResidency.Count() == 0);
+}
+
+void SuitePipelineTracer::TestLevel()
+{
+    const TUint id = iTracer->AddElement("Reservoir", MakeFunctorGeneric<TUint&>(*this, &SuitePipelineTracer::Level), "jiffies");
+    iTracer->SetEnabled(true);
+    const TUint levels[] = { 30, 10, 20 };
+    for (TUint i=0; i<sizeof(levels)/sizeof(levels[0]); i++) {
+        iLevel = levels[i];
+        Msg* msg = iMsgFactory->CreateMsgHalt();
+        iTracer->Trace(id, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+        msg->RemoveRef();
+    }
+    const PipelineTracer::Element& elem = iTracer->iElements[id];
+    TEST(elem.iLevelMin == 10);
+    TEST(elem.iLevelMax == 30);
+    TEST(elem.iLevelSamples == 3);
+    TEST(elem.iLevelSum == 60);
+}
+
+void SuitePipelineTracer::TestPercentiles()
+{
+    PipelineTracer::Histogram hist;
+    TEST(hist.Percentile(50) == 0);
+    for (TUint i=0; i<98; i++) {
+        hist.Add(5);      // bucket [4..8)
+    }
+    hist.Add(1000);       // bucket [512..1024)
+    hist.Add(100000);
+    TEST(hist.Count() == 100);
+    TEST(hist.Max() == 100000);
+    TEST(hist.Percentile(50) == 7);
+    TEST(hist.Percentile(98) == 7);
+    TEST(hist.Percentile(99) == 1023);
+    TEST(hist.Percentile(100) == 100000);
+    hist.Reset();
+    TEST(hist.Count() == 0);
+    TEST(hist.Max() == 0);
+}
+
+void SuitePipelineTracer::TestRingWraps()
+{
+    const TUint id = iTracer->AddElement("A");
+    iTracer->SetEnabled(true);
+    for (TUint i=0; i<kMaxRecords * 3 + 1; i++) {
+        Msg* msg = iMsgFactory->CreateMsgHalt();
+        iTracer->Trace(id, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), i, 0);
+        msg->RemoveRef();
+    }
+    TEST(iTracer->iElements[id].iMsgs == kMaxRecords * 3 + 1);
+
+    WriterBwh writer(1024);
+    iTracer->Dump(writer);
+    Bwh dump;
+    writer.TransferTo(dump);
+    TEST(Converter::BeUint32At(dump, 12) == kMaxRecords);
+    // oldest record first
+    const TUint recordsStart = 16 + 1 + 1 + 1; // header + "A" + empty level units
+    TEST(dump.Bytes() == recordsStart + kMaxRecords * kRecordBytes);
+    TEST(Converter::BeUint32At(dump, recordsStart + 12) == kMaxRecords * 2 + 1);
+    TEST(Converter::BeUint32At(dump, recordsStart + (kMaxRecords-1) * kRecordBytes + 12) == kMaxRecords * 3);
+}
+
+void SuitePipelineTracer::TestFreeze()
+{
+    const TUint id = iTracer->AddElement("A");
+    iTracer->SetEnabled(true);
+    Msg* msg = iMsgFactory->CreateMsgHalt();
+    iTracer->Trace(id, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+    iTracer->SetFrozen(true);
+    iTracer->Trace(id, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+    TEST(DumpRecordCount() == 1);
+    TEST(iTracer->iElements[id].iMsgs == 2); // stats still gathered while frozen
+    iTracer->SetFrozen(false);
+    iTracer->Trace(id, *msg, PipelineTracer::ECallPull, PipelineTracer::NowUs(), 0, 0);
+    TEST(DumpRecordCount() == 2);
+    msg->RemoveRef();
+
+    iTracer->Reset();
+    TEST(DumpRecordCount() == 0);
+    TEST(iTracer->iElements[id].iMsgs == 0);
+}
+
+void SuitePipelineTracer::TestStarvationRecordsWorstResidency()
+{
+    const TUint a = iTracer->AddElement("A");
+    const TUint b = iTracer->AddElement("B");
+    const TUint c = iTracer->AddElement("C");
+    iTracer->SetEnabled(true);
+    iTracer->SetFreezeOnStarvation(true);
+    Thread::Sleep(10); // so that all stamps below are later than the point tracing was enabled
+    const TUint64 now = PipelineTracer::NowUs();
+    const TUint residencyB[] = { 100, 900, 200 };
+    for (TUint i=0; i<3; i++) {
+        Msg* msg = iMsgFactory->CreateMsgHalt();
+        const TUint64 t = now - 5000 + i*1000;
+        iTracer->Trace(a, *msg, PipelineTracer::ECallPull, t, 0, 0);
+        iTracer->Trace(b, *msg, PipelineTracer::ECallPull, t + residencyB[i], 0, 0);
+        iTracer->Trace(c, *msg, PipelineTracer::ECallPull, t + residencyB[i] + 10, 0, 0);
+        msg->RemoveRef();
+    }
+    const TUint before = DumpRecordCount();
+    iTracer->NotifyStarvation(true);
+    TEST(iTracer->iStarvations == 1);
+    TEST(iTracer->iElements[a].iStarvationMaxResidency == 0);
+    TEST(iTracer->iElements[b].iStarvationMaxResidency == 900);
+    TEST(iTracer->iElements[c].iStarvationMaxResidency == 10);
+    TEST(iTracer->iFrozen);
+    TEST(DumpRecordCount() == before + 1);
+    iTracer->NotifyStarvation(false);
+    TEST(DumpRecordCount() == before + 1);
+}
+
+void SuitePipelineTracer::TestPrintDump()
+{
+    const TUint a = iTracer->AddElement("Alpha");
+    const TUint b = iTracer->AddElement("Beta", MakeFunctorGeneric<TUint&>(*this, &SuitePipelineTracer::Level), "bytes");
+    iTracer->SetEnabled(true);
+    iLevel = 1234;
+    const TUint64 now = PipelineTracer::NowUs();
+    Msg* msg = iMsgFactory->CreateMsgHalt();
+    iTracer->Trace(a, *msg, PipelineTracer::ECallPush, now, 0, Jiffies::kPerMs * 5);
+    iTracer->Trace(b, *msg, PipelineTracer::ECallPull, now + 42, 17, 0);
+    msg->RemoveRef();
+    iTracer->NotifyStarvation(true);
+
+    WriterBwh writer(1024);
+    iTracer->Dump(writer);
+    Bwh dump;
+    writer.TransferTo(dump);
+    WriterBwh text(1024);
+    PipelineTracer::PrintDump(dump, text);
+    Bwh printed;
+    text.TransferTo(printed);
+    Brn expected("         0 Alpha: residency 0us, push 0us, 5ms audio\n"
+                 "        42 Beta: residency 42us, pull 17us, level 1234 bytes\n");
+    TEST(printed.Bytes() > expected.Bytes());
+    TEST(Brn(printed.Ptr(), expected.Bytes()) == expected);
+    Brn starvation("*** STARVATION ***\n");
+    TEST(Brn(printed.Ptr() + printed.Bytes() - starvation.Bytes(), starvation.Bytes()) == starvation);
+}
+
+void SuitePipelineTracer::TestPrintDumpRejectsInvalid()
+{
+    const TByte badMagic[] = { 'O', 'H', 'P', 'X', 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0 };
+    WriterBwh text(64);
+    PipelineTracer::PrintDump(Brn(badMagic, sizeof(badMagic)), text);
+    Bwh printed;
+    text.TransferTo(printed);
+    TEST(printed == Brn("Not a pipeline trace dump\n"));
+
+    const TByte truncated[] = { 'O', 'H', 'P', 'T', 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 5, 3, 'a' };
+    WriterBwh text2(64);
+    PipelineTracer::PrintDump(Brn(truncated, sizeof(truncated)), text2);
+    Bwh printed2;
+    text2.TransferTo(printed2);
+    TEST(printed2 == Brn("Truncated pipeline trace dump\n"));
+}
+
+void SuitePipelineTracer::TestQueryInfo()
+{
+    (void)iTracer->AddElement("Alpha");
+    WriterBwh writer(1024);
+    iTracer->QueryInfo(PipelineTracer::kQueryTrace, writer);
+    Bwh info;
+    writer.TransferTo(info);
+    TEST(info.Bytes() > 0);
+    Brn prefix("Pipeline trace: disabled");
+    TEST(Brn(info.Ptr(), prefix.Bytes()) == prefix);
+
+    WriterBwh writer2(64);
+    iTracer->QueryInfo(AllocatorBase::kQueryMemory, writer2);
+    writer2.TransferTo(info);
+    TEST(info.Bytes() == 0);
+}
+
+void SuitePipelineTracer::TestLoggerQuit()
+{
+    Logger* logger = new Logger(*this, "A");
+    logger->SetTracer(*iTracer);
+    iTracer->SetEnabled(true);
+    iPendingMsgs.push_back(iMsgFactory->CreateMsgQuit());
+    Msg* msg = logger->Pull();
+    delete logger; // would block if quit wasn't acknowledged
+    msg->RemoveRef();
+    TEST(iTracer->iElements[0].iMsgs == 1);
+}
+
+
+
+void TestPipelineTracer()
+{
+    Runner runner("PipelineTracer tests\n");
+    runner.Add(new SuitePipelineTracer());
+    runner.Run();
+}
@@ -9,6 +9,9 @@
 #include <OpenHome/OsWrapper.h>
 #include <OpenHome/Private/Network.h>
 #include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Parser.h>
+#include <OpenHome/Private/Thread.h>
 #include <OpenHome/Private/TestFramework.h>
 #include <OpenHome/Private/SuiteUnitTest.h>
 #include <OpenHome/Media/Tests/TestProtocolHls.h>
@@ -141,6 +144,17 @@ private:
     TUint iNextFlushId;
 };
 
+class TestReservoirLevel : public IEncodedReservoirLevel
+{
+public:
+    TestReservoirLevel();
+    void SetBytes(TUint aBytes);
+public: // from IEncodedReservoirLevel
+    TUint EncodedReservoirBytes() const override;
+private:
+    TUint iBytes;
+};
+
 class TestElementDownstream : public IPipelineElementDownstream, private IMsgProcessor
 {
 private:
@@ -153,6 +167,7 @@ public:
     TUint TrackCount() const;
     TUint StreamCount() const;
     TUint FlushCount() const;
+    TUint StreamInterruptedCount() const;
     IStreamHandler* StreamHandler() const;  // NOT passing ownership; may return nullptr
 public: // from IPipelineElementDownstream
     void Push(Msg* aMsg) override;
@@ -180,11 +195,36 @@ private:
     TUint iTrackCount;
     TUint iStreamCount;
     TUint iFlushCount;
+    TUint iStreamInterruptedCount;
     TUint iDataTotal;
     IStreamHandler* iStreamHandler;
     Bws<kBufferBytes> iBuf;
 };
 
+class SuiteHlsVariantSelector : public OpenHome::TestFramework::SuiteUnitTest
+{
+private:
+    static const TUint kBandwidthLow = 64000;
+    static const TUint kBandwidthMid = 128000;
+    static const TUint kBandwidthHigh = 256000;
+public:
+    SuiteHlsVariantSelector();
+public: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void DownloadSegments(TUint aCount, TUint aThroughputBps);
+    void TestNoSamples();
+    void TestSingleVariant();
+    void TestThroughputAveraged();
+    void TestSwitchDown();
+    void TestNoSwitchDownWithHeadroom();
+    void TestSwitchUp();
+    void TestNoSwitchUp();
+private:
+    HlsVariantSelector* iSelector;
+};
+
 class SuiteHlsM3uReader : public OpenHome::TestFramework::SuiteUnitTest
 {
 private:
@@ -212,6 +252,10 @@ private:
     void TestFailedConnection();
     void TestUriNotFound();
     void TestInvalidAttributes();
+    void TestMasterPlaylist();
+    void TestMasterPlaylistNoAudioOnly();
+    void TestMasterPlaylistNoVariants();
+    void TestVariantSwitch();
 private:
     const Uri iUriDefault;
     Semaphore* iSemReader;
@@ -231,7 +275,7 @@ class SuiteSegmentStreamer : public OpenHome::TestFramework::SuiteUnitTest
 private:
     static const TUint kSemWaitMs = 0;
 public:
-    SuiteSegmentStreamer();
+    SuiteSegmentStreamer(Environment& aEnv);
 public: // from SuiteUnitTest
     void Setup() override;
     void TearDown() override;
@@ -242,6 +286,7 @@ private:
     void TestGetNextSegmentFail();
     void TestInterrupt();
 private:
+    Environment& iEnv;
     TestSegmentUriProvider* iUriProvider;
     Semaphore* iSemReader;
     Semaphore* iSemWait;
@@ -274,6 +319,7 @@ private:
     void TestTrySeek();
     void TestTryStop();
     void TestInterrupt();
+    void TestVariantSwitch();
 private:
     Environment& iEnv;
     AllocatorInfoLogger* iInfoAggregator;
@@ -281,6 +327,7 @@ private:
     MsgFactory* iMsgFactory;
     TestPipelineIdProvider* iIdProvider;
     TestFlushIdProvider* iFlushIdProvider;
+    TestReservoirLevel* iReservoirLevel;
     TestElementDownstream* iElementDownstream;
     ProtocolManager* iProtocolManager;
 
@@ -300,6 +347,143 @@ private:
     ProtocolStreamResult iResult;
 };
 
+class HlsTestServer;
+
+class HlsTestSession : public SocketTcpSession
+{
+    static const TUint kMaxReadBytes = 1024;
+    static const TUint kReadTimeoutMs = 5000;
+    static const TUint kWriteBufBytes = 4 * 1024;
+public:
+    HlsTestSession(Environment& aEnv, HlsTestServer& aServer);
+    ~HlsTestSession();
+private: // from SocketTcpSession
+    void Run() override;
+private:
+    TBool Respond(); // returns false if connection should be closed
+    void WriteSegment(TUint aIndex, TBool aKeepAlive);
+private:
+    HlsTestServer& iServer;
+    Srs<kMaxReadBytes> iReadBuffer;
+    ReaderUntilS<kMaxReadBytes> iReaderUntil;
+    ReaderHttpRequest iReaderRequest;
+    Sws<kWriteBufBytes> iWriterBuffer;
+    WriterHttpResponse iWriterResponse;
+};
+
+/*
+Local stand-in for an HLS server.  Serves segments "/<index>.ts" of kSegmentBytes, each after a
+delay of LatencyMs(), over connections that are kept alive unless SetKeepAlive(false) is called.
+Any other path is "not found".
+*/
+class HlsTestServer : public SocketTcpServer
+{
+    static const TUint kNumSessions = 8;
+    static const TUint kMaxUriBytes = Endpoint::kMaxEndpointBytes + sizeof("http://") - 1;
+public:
+    static const TUint kSegmentBytes = 20 * 1024;
+public:
+    HlsTestServer(Environment& aEnv, TIpAddress aInterface);
+    void AppendSegmentUri(Bwx& aUri, TUint aIndex) const;
+    void AppendMissingUri(Bwx& aUri) const;
+    void SetLatency(TUint aMs);
+    void SetKeepAlive(TBool aKeepAlive);
+    TUint Connections() const;
+    TUint Requests() const;
+    TUint MaxConcurrentRequests() const;
+    TUint Responses() const; // requests whose latency had elapsed and response was started
+    static TByte SegmentByte(TUint aIndex, TUint aOffset);
+public: // for HlsTestSession
+    void ConnectionOpened();
+    void RequestStarted(TUint& aLatencyMs, TBool& aKeepAlive);
+    void ResponseStarted();
+    void RequestCompleted();
+private:
+    Bws<kMaxUriBytes> iUri;
+    mutable Mutex iLock;
+    TUint iLatencyMs;
+    TBool iKeepAlive;
+    TUint iConnections;
+    TUint iRequests;
+    TUint iConcurrentRequests;
+    TUint iMaxConcurrentRequests;
+    TUint iResponses;
+};
+
+class TestSegmentList : public ISegmentUriProvider
+{
+public:
+    TestSegmentList(const HlsTestServer& aServer);
+    void Reset(TUint aCount);
+    void SetErrorAtEnd();   // HlsVariantPlaylistError rather than HlsEndOfStream
+    void SetNotFound(TUint aIndex);
+    void BlockAt(TUint aIndex, Semaphore& aBlocked, Semaphore& aRelease); // simulates a slow playlist reload
+    void SetVariantChangedAt(TUint aIndex); // HlsVariantChanged is thrown once before segment aIndex
+public: // from ISegmentUriProvider
+    TUint NextSegmentUri(Uri& aUri) override;
+private:
+    static const TUint kNone = std::numeric_limits<TUint>::max();
+    const HlsTestServer& iServer;
+    TUint iCount;
+    TUint iNext;
+    TBool iErrorAtEnd;
+    TUint iNotFoundIndex;
+    TUint iVariantChangedIndex;
+    TUint iBlockIndex;
+    Semaphore* iBlocked;
+    Semaphore* iRelease;
+};
+
+class TestThroughputObserver : public ISegmentThroughputObserver
+{
+public:
+    TestThroughputObserver();
+    TUint Count() const;
+    TUint Bytes() const;
+    TUint Ms() const;
+public: // from ISegmentThroughputObserver
+    void NotifySegmentDownloaded(TUint aBytes, TUint aDownloadMs) override;
+private:
+    mutable Mutex iLock;
+    TUint iCount;
+    TUint iBytes;
+    TUint iMs;
+};
+
+class SuiteSegmentPrefetcher : public OpenHome::TestFramework::SuiteUnitTest, private INonCopyable
+{
+private:
+    static const TUint kReaders = 3;
+    static const TUint kSlotBytes = 8 * 1024; // less than a segment so readers have to wait for space
+public:
+    SuiteSegmentPrefetcher(Environment& aEnv);
+public: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void Start(TUint aSegments);
+    TBool ReadSegment(TUint aIndex);
+    void InterruptThread();
+    void TestSegmentsInOrder();
+    void TestConnectionsReused();
+    void TestConnectionsNotReused();
+    void TestFetchesConcurrently();
+    void TestPlaylistReloadOverlapsFetch();
+    void TestPlaylistErrorAfterSegments();
+    void TestSegmentNotFound();
+    void TestInterrupt();
+    void TestRestart();
+    void TestVariantChanged();
+    void TestThroughputReported();
+private:
+    Environment& iEnv;
+    HlsTestServer* iServer;
+    TestSegmentList* iSegments;
+    SegmentPrefetcher* iPrefetcher;
+    SegmentStreamer* iStreamer;
+    TUint iInterruptDelayMs;
+};
+
 } // namespace Test
 } // namespace Media
 } // namespace OpenHome
@@ -644,6 +828,24 @@ TUint TestFlushIdProvider::NextFlushId()
 }
 
 
+// TestReservoirLevel
+
+TestReservoirLevel::TestReservoirLevel()
+    : iBytes(0)
+{
+}
+
+void TestReservoirLevel::SetBytes(TUint aBytes)
+{
+    iBytes = aBytes;
+}
+
+TUint TestReservoirLevel::EncodedReservoirBytes() const
+{
+    return iBytes;
+}
+
+
 // TestElementDownstream
 
 TestElementDownstream::TestElementDownstream()
@@ -652,6 +854,7 @@ TestElementDownstream::TestElementDownstream()
     , iTrackCount(0)
     , iStreamCount(0)
     , iFlushCount(0)
+    , iStreamInterruptedCount(0)
     , iDataTotal(0)
     , iStreamHandler(nullptr)
 {
@@ -687,6 +890,11 @@ TUint TestElementDownstream::FlushCount() const
     return iFlushCount;
 }
 
+TUint TestElementDownstream::StreamInterruptedCount() const
+{
+    return iStreamInterruptedCount;
+}
+
 IStreamHandler* TestElementDownstream::StreamHandler() const
 {
     return iStreamHandler;
@@ -745,6 +953,7 @@ Msg* TestElementDownstream::ProcessMsg(MsgMetaText* aMsg)
 
 Msg* TestElementDownstream::ProcessMsg(MsgStreamInterrupted* aMsg)
 {
+    iStreamInterruptedCount++;
     return aMsg;
 }
 
@@ -800,6 +1009,157 @@ Msg* TestElementDownstream::ProcessMsg(MsgQuit* aMsg)
 }
 
 
+// SuiteHlsVariantSelector
+
+SuiteHlsVariantSelector::SuiteHlsVariantSelector()
+    : SuiteUnitTest("SuiteHlsVariantSelector")
+{
+    AddTest(MakeFunctor(*this, &SuiteHlsVariantSelector::TestNoSamples), "TestNoSamples");
+    AddTest(MakeFunctor(*this, &SuiteHlsVariantSelector::TestSingleVariant), "TestSingleVariant");
+    AddTest(MakeFunctor(*this, &SuiteHlsVariantSelector::TestThroughputAveraged), "TestThroughputAveraged");
+    AddTest(MakeFunctor(*this, &SuiteHlsVariantSelector::TestSwitchDown), "TestSwitchDown");
+    AddTest(MakeFunctor(*this, &SuiteHlsVariantSelector::TestNoSwitchDownWithHeadroom), "TestNoSwitchDownWithHeadroom");
+    AddTest(MakeFunctor(*this, &SuiteHlsVariantSelector::TestSwitchUp), "TestSwitchUp");
+    AddTest(MakeFunctor(*this, &SuiteHlsVariantSelector::TestNoSwitchUp), "TestNoSwitchUp");
+}
+
+void SuiteHlsVariantSelector::Setup()
+{
+    iSelector = new HlsVariantSelector();
+    iSelector->AddVariant(kBandwidthLow);
+    iSelector->AddVariant(kBandwidthMid);
+    iSelector->AddVariant(kBandwidthHigh);
+}
+
+void SuiteHlsVariantSelector::TearDown()
+{
+    delete iSelector;
+}
+
+void SuiteHlsVariantSelector::DownloadSegments(TUint aCount, TUint aThroughputBps)
+{
+    // each segment takes 1s to download
+    for (TUint i=0; i<aCount; i++) {
+        iSelector->SegmentDownloaded(aThroughputBps / 8, 1000);
+    }
+}
+
+void SuiteHlsVariantSelector::TestNoSamples()
+{
+    TEST(iSelector->Count() == 3);
+    iSelector->SetCurrent(2);
+    TEST(iSelector->ThroughputBps() == 0);
+    // Nothing known about the connection yet so stay with the current variant.
+    TEST(iSelector->Select(0) == 2);
+    iSelector->SetCurrent(0);
+    TEST(iSelector->Select(HlsVariantSelector::kHeadroomUnknown) == 0);
+}
+
+void SuiteHlsVariantSelector::TestSingleVariant()
+{
+    iSelector->Reset();
+    TEST(iSelector->Count() == 0);
+    iSelector->AddVariant(kBandwidthHigh);
+    iSelector->SetCurrent(0);
+    DownloadSegments(1, kBandwidthLow);
+    TEST(iSelector->Select(0) == 0);
+}
+
+void SuiteHlsVariantSelector::TestThroughputAveraged()
+{
+    DownloadSegments(1, 80000);
+    TEST(iSelector->ThroughputBps() == 80000);
+    DownloadSegments(1, 240000);
+    TEST(iSelector->ThroughputBps() == 160000);
+    // A segment downloaded in <1ms doesn't cause a divide by zero.
+    iSelector->SegmentDownloaded(1000, 0);
+    TEST(iSelector->ThroughputBps() == (160000 + 8000000) / 2);
+}
+
+void SuiteHlsVariantSelector::TestSwitchDown()
+{
+    iSelector->SetCurrent(2);
+    // Only mid variant fits in 80% of throughput.
+    DownloadSegments(1, 200000);
+    TEST(iSelector->Select(0) == 1);
+    TEST(iSelector->Current() == 1);
+
+    // Throughput (averaged to 120000) no longer supports mid variant.
+    DownloadSegments(1, 40000);
+    TEST(iSelector->Select(0) == 0);
+
+    // Nowhere lower to go.
+    DownloadSegments(1, 8000);
+    TEST(iSelector->Select(0) == 0);
+
+    // Drop straight from high to the highest variant that fits rather than one step at a time.
+    iSelector->Reset();
+    iSelector->AddVariant(kBandwidthLow);
+    iSelector->AddVariant(kBandwidthMid);
+    iSelector->AddVariant(kBandwidthHigh);
+    iSelector->SetCurrent(2);
+    DownloadSegments(1, 81000);
+    TEST(iSelector->Select(HlsVariantSelector::kMinHeadroomMs - 1) == 0);
+}
+
+void SuiteHlsVariantSelector::TestNoSwitchDownWithHeadroom()
+{
+    iSelector->SetCurrent(2);
+    DownloadSegments(1, 80000);
+    // Enough audio buffered to ride out a slow segment.
+    TEST(iSelector->Select(HlsVariantSelector::kMinHeadroomMs) == 2);
+    TEST(iSelector->Select(HlsVariantSelector::kMinHeadroomMs * 4) == 2);
+    // Buffer drained.
+    TEST(iSelector->Select(HlsVariantSelector::kMinHeadroomMs - 1) == 0);
+
+    // Unknown headroom doesn't prevent a switch down.
+    iSelector->SetCurrent(2);
+    DownloadSegments(1, 80000);
+    TEST(iSelector->Select(HlsVariantSelector::kHeadroomUnknown) == 0);
+}
+
+void SuiteHlsVariantSelector::TestSwitchUp()
+{
+    static const TUint kFast = 1000000;
+    iSelector->SetCurrent(0);
+    DownloadSegments(1, kFast);
+    // Throughput must be sustained for a few segments before switching up.
+    TEST(iSelector->Select(HlsVariantSelector::kUpHeadroomMs) == 0);
+    DownloadSegments(HlsVariantSelector::kSegmentsBeforeUp - 2, kFast);
+    TEST(iSelector->Select(HlsVariantSelector::kUpHeadroomMs) == 0);
+    DownloadSegments(1, kFast);
+    TEST(iSelector->Select(HlsVariantSelector::kUpHeadroomMs) == 1);
+
+    // Switch up one variant at a time, each after kSegmentsBeforeUp segments.
+    TEST(iSelector->Select(HlsVariantSelector::kUpHeadroomMs) == 1);
+    DownloadSegments(HlsVariantSelector::kSegmentsBeforeUp, kFast);
+    TEST(iSelector->Select(HlsVariantSelector::kHeadroomUnknown) == 2);
+    DownloadSegments(HlsVariantSelector::kSegmentsBeforeUp, kFast);
+    TEST(iSelector->Select(HlsVariantSelector::kHeadroomUnknown) == 2);
+}
+
+void SuiteHlsVariantSelector::TestNoSwitchUp()
+{
+    // Not enough audio buffered to risk a higher bandwidth.
+    iSelector->SetCurrent(0);
+    DownloadSegments(HlsVariantSelector::kSegmentsBeforeUp, 1000000);
+    TEST(iSelector->Select(HlsVariantSelector::kUpHeadroomMs - 1) == 0);
+    TEST(iSelector->Select(HlsVariantSelector::kUpHeadroomMs) == 1);
+
+    // Throughput supports the current variant but not the next, so stay put rather than oscillate.
+    iSelector->Reset();
+    iSelector->AddVariant(kBandwidthLow);
+    iSelector->AddVariant(kBandwidthMid);
+    iSelector->AddVariant(kBandwidthHigh);
+    iSelector->SetCurrent(1);
+    for (TUint i=0; i<2*HlsVariantSelector::kSegmentsBeforeUp; i++) {
+        DownloadSegments(1, 200000);
+        TEST(iSelector->Select(0) == 1);
+        TEST(iSelector->Select(HlsVariantSelector::kUpHeadroomMs) == 1);
+    }
+}
+
+
 // SuiteHlsM3uReader
 
 //https://tools.ietf.org/html/draft-pantos-http-live-streaming-14#section-8
@@ -836,6 +1196,10 @@ SuiteHlsM3uReader::SuiteHlsM3uReader()
     AddTest(MakeFunctor(*this, &SuiteHlsM3uReader::TestFailedConnection), "TestFailedConnection");
     AddTest(MakeFunctor(*this, &SuiteHlsM3uReader::TestUriNotFound), "TestUriNotFound");
     AddTest(MakeFunctor(*this, &SuiteHlsM3uReader::TestInvalidAttributes), "TestInvalidAttributes");
+    AddTest(MakeFunctor(*this, &SuiteHlsM3uReader::TestMasterPlaylist), "TestMasterPlaylist");
+    AddTest(MakeFunctor(*this, &SuiteHlsM3uReader::TestMasterPlaylistNoAudioOnly), "TestMasterPlaylistNoAudioOnly");
+    AddTest(MakeFunctor(*this, &SuiteHlsM3uReader::TestMasterPlaylistNoVariants), "TestMasterPlaylistNoVariants");
+    AddTest(MakeFunctor(*this, &SuiteHlsM3uReader::TestVariantSwitch), "TestVariantSwitch");
 }
 
 void SuiteHlsM3uReader::Setup()
@@ -1826,11 +2190,215 @@ void SuiteHlsM3uReader::TestInvalidAttributes()
     TEST(iM3uReader->Error() == true);
 }
 
+void SuiteHlsM3uReader::TestMasterPlaylist()
+{
+    // Audio-only variants are preferred over those that also contain video.
+    // Only http variants are supported.
+    // Highest bandwidth variant is streamed first.
+    const Uri kUriMaster(Brn("http://example.com/master.m3u8"));
+    const Brn kFileMaster(
+    "#EXTM3U\n"
+    "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=32000,CODECS=\"mp4a.40.5\"\n"
+    "low/index.m3u8\n"
+    "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=512000,CODECS=\"avc1.42001e,mp4a.40.2\",RESOLUTION=416x234\n"
+    "video/index.m3u8\n"
+    "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=256000,CODECS=\"mp4a.40.2\"\n"
+    "https://secure.example.com/high/index.m3u8\n"
+    "#EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=128000,CODECS=\"mp4a.40.2\"\n"
+    "\n"
+    "http://media.example.com/mid/index.m3u8\n"
+    );
+    const Uri kUriVariant(Brn("http://media.example.com/mid/index.m3u8"));
+    const Brn kFileVariant(
+    "#EXTM3U\n"
+    "#EXT-X-VERSION:2\n"
+    "#EXT-X-TARGETDURATION:8\n"
+    "#EXT-X-MEDIA-SEQUENCE:1\n"
+    "#EXTINF:8,\n"
+    "seg1.ts\n"
+    "#EXTINF:8,\n"
+    "seg2.ts\n"
+    );
+
+    TestHttpReader::UriList uriList1;
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriMaster, TestHttpReader::eSuccess));
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriVariant, TestHttpReader::eSuccess));
+    TestHttpReader::BufList bufList1;
+    bufList1.push_back(&kFileMaster);
+    bufList1.push_back(&kFileVariant);
+    iHttpReader->SetContent(uriList1, bufList1);
+    iM3uReader->SetUri(kUriMaster);
+
+    Uri segmentUri;
+    TUint duration = iM3uReader->NextSegmentUri(segmentUri);
+    TEST(duration == 8000);
+    TEST(segmentUri.AbsoluteUri() == Brn("http://media.example.com/mid/seg1.ts"));
+    duration = iM3uReader->NextSegmentUri(segmentUri);
+    TEST(duration == 8000);
+    TEST(segmentUri.AbsoluteUri() == Brn("http://media.example.com/mid/seg2.ts"));
+    TEST(iHttpReader->ConnectCount() == 2);
+    TEST(iTimer->StartCount() == 1);
+    TEST(iTimer->LastDurationMs() == 8000);
+    TEST(iM3uReader->Error() == false);
+}
+
+void SuiteHlsM3uReader::TestMasterPlaylistNoAudioOnly()
+{
+    // No audio-only variants, so choose from all variants.
+    const Uri kUriMaster(Brn("http://example.com/master.m3u8"));
+    const Brn kFileMaster(
+    "#EXTM3U\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=1280000\n"
+    "video_hi.m3u8\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=640000,CODECS=\"avc1.42001e,mp4a.40.2\"\n"
+    "video_lo.m3u8\n"
+    );
+    const Uri kUriVariant(Brn("http://example.com/video_hi.m3u8"));
+    const Brn kFileVariant(
+    "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:6\n"
+    "#EXTINF:6,\n"
+    "http://media.example.com/a.ts\n"
+    );
+
+    TestHttpReader::UriList uriList1;
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriMaster, TestHttpReader::eSuccess));
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriVariant, TestHttpReader::eSuccess));
+    TestHttpReader::BufList bufList1;
+    bufList1.push_back(&kFileMaster);
+    bufList1.push_back(&kFileVariant);
+    iHttpReader->SetContent(uriList1, bufList1);
+    iM3uReader->SetUri(kUriMaster);
+
+    Uri segmentUri;
+    const TUint duration = iM3uReader->NextSegmentUri(segmentUri);
+    TEST(duration == 6000);
+    TEST(segmentUri.AbsoluteUri() == Brn("http://media.example.com/a.ts"));
+}
+
+void SuiteHlsM3uReader::TestMasterPlaylistNoVariants()
+{
+    // Master playlist that only contains unsupported variants.
+    const Uri kUriMaster(Brn("http://example.com/master.m3u8"));
+    const Brn kFileMaster(
+    "#EXTM3U\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=128000,CODECS=\"mp4a.40.2\"\n"
+    "https://secure.example.com/index.m3u8\n"
+    );
+
+    TestHttpReader::UriList uriList1;
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriMaster, TestHttpReader::eSuccess));
+    TestHttpReader::BufList bufList1;
+    bufList1.push_back(&kFileMaster);
+    iHttpReader->SetContent(uriList1, bufList1);
+    iM3uReader->SetUri(kUriMaster);
+
+    Uri segmentUri;
+    TEST(iM3uReader->Error() == false);
+    TEST_THROWS(iM3uReader->NextSegmentUri(segmentUri), HlsVariantPlaylistError);
+    TEST(iM3uReader->Error() == true);
+}
+
+void SuiteHlsM3uReader::TestVariantSwitch()
+{
+    // Variants share media sequence numbers, so after a switch streaming continues from
+    // the next segment in the new variant's playlist.
+    const Uri kUriMaster(Brn("http://example.com/master.m3u8"));
+    const Brn kFileMaster(
+    "#EXTM3U\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=32000,CODECS=\"mp4a.40.5\"\n"
+    "low/index.m3u8\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=128000,CODECS=\"mp4a.40.2\"\n"
+    "high/index.m3u8\n"
+    );
+    const Uri kUriHigh(Brn("http://example.com/high/index.m3u8"));
+    const Brn kFileHigh(
+    "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:8\n"
+    "#EXT-X-MEDIA-SEQUENCE:100\n"
+    "#EXTINF:8,\n"
+    "seg100.ts\n"
+    "#EXTINF:8,\n"
+    "seg101.ts\n"
+    "#EXTINF:8,\n"
+    "seg102.ts\n"
+    );
+    const Brn kFileHighReloaded(
+    "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:8\n"
+    "#EXT-X-MEDIA-SEQUENCE:101\n"
+    "#EXTINF:8,\n"
+    "seg101.ts\n"
+    "#EXTINF:8,\n"
+    "seg102.ts\n"
+    "#EXTINF:8,\n"
+    "seg103.ts\n"
+    );
+    const Uri kUriLow(Brn("http://example.com/low/index.m3u8"));
+    const Brn kFileLow(
+    "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:8\n"
+    "#EXT-X-MEDIA-SEQUENCE:100\n"
+    "#EXTINF:8,\n"
+    "seg100.ts\n"
+    "#EXTINF:8,\n"
+    "seg101.ts\n"
+    "#EXTINF:8,\n"
+    "seg102.ts\n"
+    );
+
+    TestHttpReader::UriList uriList1;
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriMaster, TestHttpReader::eSuccess));
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriHigh, TestHttpReader::eSuccess));
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriLow, TestHttpReader::eSuccess));
+    uriList1.push_back(TestHttpReader::UriConnectPair(&kUriHigh, TestHttpReader::eSuccess));
+    TestHttpReader::BufList bufList1;
+    bufList1.push_back(&kFileMaster);
+    bufList1.push_back(&kFileHigh);
+    bufList1.push_back(&kFileLow);
+    bufList1.push_back(&kFileHighReloaded);
+    iHttpReader->SetContent(uriList1, bufList1);
+    TestReservoirLevel reservoir;
+    iM3uReader->SetReservoirLevel(reservoir);
+    iM3uReader->SetUri(kUriMaster);
+
+    Uri segmentUri;
+    (void)iM3uReader->NextSegmentUri(segmentUri);
+    TEST(segmentUri.AbsoluteUri() == Brn("http://example.com/high/seg100.ts"));
+
+    // Segment took 1s to download at 64kbps.  Too slow for the high variant but 10s of it is
+    // buffered so there's no need to switch down yet.
+    iM3uReader->NotifySegmentDownloaded(8000, 1000);
+    reservoir.SetBytes(160000);
+    (void)iM3uReader->NextSegmentUri(segmentUri);
+    TEST(segmentUri.AbsoluteUri() == Brn("http://example.com/high/seg101.ts"));
+
+    // Buffered audio has run down.  Switch to the low variant.
+    reservoir.SetBytes(0);
+    TEST_THROWS(iM3uReader->NextSegmentUri(segmentUri), HlsVariantChanged);
+    TEST(iTimer->CancelCount() == 1);
+    TEST(iM3uReader->Error() == false);
+    (void)iM3uReader->NextSegmentUri(segmentUri);
+    TEST(segmentUri.AbsoluteUri() == Brn("http://example.com/low/seg102.ts"));
+
+    // Throughput recovers and there is plenty of audio buffered.  Switch back up.
+    for (TUint i=0; i<HlsVariantSelector::kSegmentsBeforeUp; i++) {
+        iM3uReader->NotifySegmentDownloaded(160000, 1000);
+    }
+    reservoir.SetBytes(80000);
+    TEST_THROWS(iM3uReader->NextSegmentUri(segmentUri), HlsVariantChanged);
+    (void)iM3uReader->NextSegmentUri(segmentUri);
+    TEST(segmentUri.AbsoluteUri() == Brn("http://example.com/high/seg103.ts"));
+    TEST(iHttpReader->ConnectCount() == 4);
+    TEST(iM3uReader->Error() == false);
+}
+
 
 // SuiteSegmentStreamer
 
-SuiteSegmentStreamer::SuiteSegmentStreamer()
+SuiteSegmentStreamer::SuiteSegmentStreamer(Environment& aEnv)
     : SuiteUnitTest("SuiteSegmentStreamer")
+    , iEnv(aEnv)
 {
     AddTest(MakeFunctor(*this, &SuiteSegmentStreamer::TestSetStream), "TestSetStream");
     AddTest(MakeFunctor(*this, &SuiteSegmentStreamer::TestRead), "TestRead");
@@ -1844,7 +2412,7 @@ void SuiteSegmentStreamer::Setup()
     iSemReader = new Semaphore("SSSS", 0);
     iSemWait = new Semaphore("SSWS", 0);
     iHttpReader = new TestHttpReader(*iSemReader, *iSemWait);
-    iStreamer = new SegmentStreamer(*iHttpReader, *iHttpReader);
+    iStreamer = new SegmentStreamer(iEnv, *iHttpReader, *iHttpReader);
     iReadBytes = 0;
     iThreadSem = new Semaphore("SSTS", 0);
 }
@@ -2035,6 +2603,7 @@ SuiteProtocolHls::SuiteProtocolHls(Environment& aEnv)
     AddTest(MakeFunctor(*this, &SuiteProtocolHls::TestTrySeek), "TestTrySeek");
     AddTest(MakeFunctor(*this, &SuiteProtocolHls::TestTryStop), "TestTryStop");
     AddTest(MakeFunctor(*this, &SuiteProtocolHls::TestInterrupt), "TestInterrupt");
+    AddTest(MakeFunctor(*this, &SuiteProtocolHls::TestVariantSwitch), "TestVariantSwitch");
 }
 
 
@@ -2063,8 +2632,9 @@ void SuiteProtocolHls::Setup()
     iMsgFactory = new MsgFactory(*iInfoAggregator, init);
     iIdProvider = new TestPipelineIdProvider();
     iFlushIdProvider = new TestFlushIdProvider();
+    iReservoirLevel = new TestReservoirLevel();
     iElementDownstream = new TestElementDownstream();
-    iProtocolManager = new ProtocolManager(*iElementDownstream, *iMsgFactory, *iIdProvider, *iFlushIdProvider);
+    iProtocolManager = new ProtocolManager(*iElementDownstream, *iMsgFactory, *iIdProvider, *iFlushIdProvider, iReservoirLevel);
 
     iProtocolManager->Add(iProtocolHls);    // takes ownership
 
@@ -2076,6 +2646,7 @@ void SuiteProtocolHls::TearDown()
 {
     delete iProtocolManager;
     delete iElementDownstream;
+    delete iReservoirLevel;
     delete iFlushIdProvider;
     delete iIdProvider;
     delete iMsgFactory;
@@ -2836,13 +3407,665 @@ void SuiteProtocolHls::TestInterrupt()
     TEST(iElementDownstream->FlushCount() == 0);
 }
 
+void SuiteProtocolHls::TestVariantSwitch()
+{
+    // First segment from the high bandwidth variant downloads slowly and no audio is
+    // buffered in the pipeline, so the rest of the stream comes from the low variant.
+    static const TUint kSlowSegmentMs = 50;
+    static const Brn kUriHlsMaster("hls://example.com/master.m3u8");
+    static const Uri kUriMaster(Brn("http://example.com/master.m3u8"));
+    static const Brn kFileMaster(
+    "#EXTM3U\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=1000,CODECS=\"mp4a.40.5\"\n"
+    "http://example.com/low.m3u8\n"
+    "#EXT-X-STREAM-INF:BANDWIDTH=64000,CODECS=\"mp4a.40.2\"\n"
+    "http://example.com/high.m3u8\n");
+    static const Uri kUriHigh(Brn("http://example.com/high.m3u8"));
+    static const Brn kFileHigh(
+    "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:10\n"
+    "#EXT-X-MEDIA-SEQUENCE:1\n"
+    "#EXTINF:10,\n"
+    "http://media.example.com/high1.ts\n"
+    "#EXTINF:10,\n"
+    "http://media.example.com/high2.ts\n"
+    "#EXTINF:10,\n"
+    "http://media.example.com/high3.ts\n"
+    "#EXT-X-ENDLIST\n");
+    static const Uri kUriLow(Brn("http://example.com/low.m3u8"));
+    static const Brn kFileLow(
+    "#EXTM3U\n"
+    "#EXT-X-TARGETDURATION:10\n"
+    "#EXT-X-MEDIA-SEQUENCE:1\n"
+    "#EXTINF:10,\n"
+    "http://media.example.com/low1.ts\n"
+    "#EXTINF:10,\n"
+    "http://media.example.com/low2.ts\n"
+    "#EXTINF:10,\n"
+    "http://media.example.com/low3.ts\n"
+    "#EXT-X-ENDLIST\n");
+
+    TestHttpReader::UriList uriListM3u1;
+    uriListM3u1.push_back(TestHttpReader::UriConnectPair(&kUriMaster, TestHttpReader::eSuccess));
+    uriListM3u1.push_back(TestHttpReader::UriConnectPair(&kUriHigh, TestHttpReader::eSuccess));
+    uriListM3u1.push_back(TestHttpReader::UriConnectPair(&kUriLow, TestHttpReader::eSuccess));
+    TestHttpReader::BufList bufListM3u1;
+    bufListM3u1.push_back(&kFileMaster);
+    bufListM3u1.push_back(&kFileHigh);
+    bufListM3u1.push_back(&kFileLow);
+    iM3uReader->SetContent(uriListM3u1, bufListM3u1);
+
+
+    static const Uri kSegUri1(Brn("http://media.example.com/high1.ts"));
+    static const Brn kSegFile1(Brn("abcdefghijklmnopqrstuvwxyz"));
+    static const Uri kSegUri2(Brn("http://media.example.com/low2.ts"));
+    static const Brn kSegFile2(Brn("ABCDEFGHIJKLMNOPQRSTUVWXYZ"));
+    static const Uri kSegUri3(Brn("http://media.example.com/low3.ts"));
+    static const Brn kSegFile3(Brn("1234567890"));
+
+    TestHttpReader::UriList uriListSeg1;
+    uriListSeg1.push_back(TestHttpReader::UriConnectPair(&kSegUri1, TestHttpReader::eSuccess));
+    uriListSeg1.push_back(TestHttpReader::UriConnectPair(&kSegUri2, TestHttpReader::eSuccess));
+    uriListSeg1.push_back(TestHttpReader::UriConnectPair(&kSegUri3, TestHttpReader::eSuccess));
+    TestHttpReader::BufList bufListSeg1;
+    bufListSeg1.push_back(&kSegFile1);
+    bufListSeg1.push_back(&kSegFile2);
+    bufListSeg1.push_back(&kSegFile3);
+    iSegmentReader->SetContent(uriListSeg1, bufListSeg1);
+
+    iSegmentReader->WaitAtOffset(10);
+    iReservoirLevel->SetBytes(0);
+
+    iTrack = iTrackFactory->CreateTrack(kUriHlsMaster, Brx::Empty());
+    ThreadFunctor thread("SuiteProtocolHls", MakeFunctor(*this, &SuiteProtocolHls::StreamThread));
+    thread.Start();
+
+    iSegmentSem->Wait(kSemWaitMs);  // first segment is being read
+    Thread::Sleep(kSlowSegmentMs);
+    iSegmentWaitSem->Signal();
+    iThreadSem->Wait(kSemWaitMs);
+
+    iTrack->RemoveRef();
+    TEST(iResult == EProtocolStreamSuccess);
+
+    // Whole of first segment was output, followed by a new stream for the low variant.
+    TEST(iElementDownstream->Data() == Brn("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"));
+    TEST(iElementDownstream->IsLive() == true);
+    TEST(iElementDownstream->StreamId() == 2);
+    TEST(iElementDownstream->TrackCount() == 1);
+    TEST(iElementDownstream->StreamCount() == 2);
+    TEST(iElementDownstream->StreamInterruptedCount() == 1);
+    TEST(iElementDownstream->FlushCount() == 0);
+}
+
+
+// HlsTestSession
+
+HlsTestSession::HlsTestSession(Environment& aEnv, HlsTestServer& aServer)
+    : iServer(aServer)
+    , iReadBuffer(*this)
+    , iReaderUntil(iReadBuffer)
+    , iReaderRequest(aEnv, iReaderUntil)
+    , iWriterBuffer(*this)
+    , iWriterResponse(iWriterBuffer)
+{
+    iReaderRequest.AddMethod(Http::kMethodGet);
+}
+
+HlsTestSession::~HlsTestSession()
+{
+    iReaderUntil.ReadInterrupt();
+}
+
+void HlsTestSession::Run()
+{
+    iServer.ConnectionOpened();
+    // Client closing its connection (on interrupt or when a test completes) is expected so errors are ignored
+    try {
+        do {
+            iReaderRequest.Flush();
+            iReaderRequest.Read(kReadTimeoutMs);
+        } while (Respond());
+    }
+    catch (HttpError&) {}
+    catch (ReaderError&) {}
+    catch (WriterError&) {}
+    catch (NetworkError&) {}
+}
+
+TBool HlsTestSession::Respond()
+{
+    TUint latencyMs = 0;
+    TBool keepAlive = true;
+    iServer.RequestStarted(latencyMs, keepAlive);
+    if (latencyMs > 0) {
+        Thread::Sleep(latencyMs);
+    }
+    iServer.ResponseStarted();
+
+    Parser p(iReaderRequest.Uri());
+    (void)p.Next('/');
+    TBool found = true;
+    TUint index = 0;
+    try {
+        index = Ascii::Uint(p.Next('.'));
+    }
+    catch (AsciiError&) {
+        found = false;
+    }
+    try {
+        if (found) {
+            WriteSegment(index, keepAlive);
+        }
+        else {
+            iWriterResponse.WriteStatus(HttpStatus::kNotFound, Http::eHttp11);
+            Http::WriteHeaderContentLength(iWriterResponse, 0);
+            if (!keepAlive) {
+                Http::WriteHeaderConnectionClose(iWriterResponse);
+            }
+            iWriterResponse.WriteFlush();
+        }
+    }
+    catch (WriterError&) {
+        iServer.RequestCompleted();
+        throw;
+    }
+    iServer.RequestCompleted();
+    return keepAlive;
+}
+
+void HlsTestSession::WriteSegment(TUint aIndex, TBool aKeepAlive)
+{
+    iWriterResponse.WriteStatus(HttpStatus::kOk, Http::eHttp11);
+    Http::WriteHeaderContentLength(iWriterResponse, HlsTestServer::kSegmentBytes);
+    if (!aKeepAlive) {
+        Http::WriteHeaderConnectionClose(iWriterResponse);
+    }
+    iWriterResponse.WriteFlush();
+    for (TUint i=0; i<HlsTestServer::kSegmentBytes; i++) {
+        iWriterBuffer.Write(HlsTestServer::SegmentByte(aIndex, i));
+    }
+    iWriterBuffer.WriteFlush();
+}
+
+
+// HlsTestServer
+
+HlsTestServer::HlsTestServer(Environment& aEnv, TIpAddress aInterface)
+    : SocketTcpServer(aEnv, "HTSV", 0, aInterface)
+    , iLock("HTSL")
+    , iLatencyMs(0)
+    , iKeepAlive(true)
+    , iConnections(0)
+    , iRequests(0)
+    , iConcurrentRequests(0)
+    , iMaxConcurrentRequests(0)
+    , iResponses(0)
+{
+    for (TUint i=0; i<kNumSessions; i++) {
+        Bws<Thread::kMaxNameBytes+1> name("HTS");
+        Ascii::AppendDec(name, i);
+        SocketTcpServer::Add(name.PtrZ(), new HlsTestSession(aEnv, *this));
+    }
+    iUri.Append("http://");
+    Endpoint endpoint(Port(), Interface());
+    endpoint.AppendEndpoint(iUri);
+}
+
+void HlsTestServer::AppendSegmentUri(Bwx& aUri, TUint aIndex) const
+{
+    aUri.Append(iUri);
+    aUri.Append('/');
+    Ascii::AppendDec(aUri, aIndex);
+    aUri.Append(".ts");
+}
+
+void HlsTestServer::AppendMissingUri(Bwx& aUri) const
+{
+    aUri.Append(iUri);
+    aUri.Append("/missing.ts");
+}
+
+void HlsTestServer::SetLatency(TUint aMs)
+{
+    AutoMutex a(iLock);
+    iLatencyMs = aMs;
+}
+
+void HlsTestServer::SetKeepAlive(TBool aKeepAlive)
+{
+    AutoMutex a(iLock);
+    iKeepAlive = aKeepAlive;
+}
+
+TUint HlsTestServer::Connections() const
+{
+    AutoMutex a(iLock);
+    return iConnections;
+}
+
+TUint HlsTestServer::Requests() const
+{
+    AutoMutex a(iLock);
+    return iRequests;
+}
+
+TUint HlsTestServer::MaxConcurrentRequests() const
+{
+    AutoMutex a(iLock);
+    return iMaxConcurrentRequests;
+}
+
+TUint HlsTestServer::Responses() const
+{
+    AutoMutex a(iLock);
+    return iResponses;
+}
+
+TByte HlsTestServer::SegmentByte(TUint aIndex, TUint aOffset)
+{ // static
+    return (TByte)((aIndex * 37) + aOffset);
+}
+
+void HlsTestServer::ConnectionOpened()
+{
+    AutoMutex a(iLock);
+    iConnections++;
+}
+
+void HlsTestServer::RequestStarted(TUint& aLatencyMs, TBool& aKeepAlive)
+{
+    AutoMutex a(iLock);
+    iRequests++;
+    iConcurrentRequests++;
+    iMaxConcurrentRequests = std::max(iMaxConcurrentRequests, iConcurrentRequests);
+    aLatencyMs = iLatencyMs;
+    aKeepAlive = iKeepAlive;
+}
+
+void HlsTestServer::ResponseStarted()
+{
+    AutoMutex a(iLock);
+    iResponses++;
+}
+
+void HlsTestServer::RequestCompleted()
+{
+    AutoMutex a(iLock);
+    iConcurrentRequests--;
+}
+
+
+// TestSegmentList
+
+TestSegmentList::TestSegmentList(const HlsTestServer& aServer)
+    : iServer(aServer)
+{
+    Reset(0);
+}
+
+void TestSegmentList::Reset(TUint aCount)
+{
+    iCount = aCount;
+    iNext = 0;
+    iErrorAtEnd = false;
+    iNotFoundIndex = kNone;
+    iVariantChangedIndex = kNone;
+    iBlockIndex = kNone;
+    iBlocked = nullptr;
+    iRelease = nullptr;
+}
+
+void TestSegmentList::SetErrorAtEnd()
+{
+    iErrorAtEnd = true;
+}
+
+void TestSegmentList::SetNotFound(TUint aIndex)
+{
+    iNotFoundIndex = aIndex;
+}
+
+void TestSegmentList::SetVariantChangedAt(TUint aIndex)
+{
+    iVariantChangedIndex = aIndex;
+}
+
+void TestSegmentList::BlockAt(TUint aIndex, Semaphore& aBlocked, Semaphore& aRelease)
+{
+    iBlockIndex = aIndex;
+    iBlocked = &aBlocked;
+    iRelease = &aRelease;
+}
+
+TUint TestSegmentList::NextSegmentUri(Uri& aUri)
+{
+    const TUint index = iNext++;
+    if (index == iBlockIndex) {
+        iBlocked->Signal();
+        iRelease->Wait();
+    }
+    if (index == iVariantChangedIndex) {
+        // no segment is consumed by a variant change
+        iVariantChangedIndex = kNone;
+        iNext--;
+        THROW(HlsVariantChanged);
+    }
+    if (index >= iCount) {
+        if (iErrorAtEnd) {
+            THROW(HlsVariantPlaylistError);
+        }
+        THROW(HlsEndOfStream);
+    }
+    Bws<Uri::kMaxUriBytes> uri;
+    if (index == iNotFoundIndex) {
+        iServer.AppendMissingUri(uri);
+    }
+    else {
+        iServer.AppendSegmentUri(uri, index);
+    }
+    aUri.Replace(uri);
+    return 1000;
+}
+
+
+// TestThroughputObserver
+
+TestThroughputObserver::TestThroughputObserver()
+    : iLock("TTOL")
+    , iCount(0)
+    , iBytes(0)
+    , iMs(0)
+{
+}
+
+TUint TestThroughputObserver::Count() const
+{
+    AutoMutex a(iLock);
+    return iCount;
+}
+
+TUint TestThroughputObserver::Bytes() const
+{
+    AutoMutex a(iLock);
+    return iBytes;
+}
+
+TUint TestThroughputObserver::Ms() const
+{
+    AutoMutex a(iLock);
+    return iMs;
+}
+
+void TestThroughputObserver::NotifySegmentDownloaded(TUint aBytes, TUint aDownloadMs)
+{
+    AutoMutex a(iLock);
+    iCount++;
+    iBytes += aBytes;
+    iMs += aDownloadMs;
+}
+
+
+// SuiteSegmentPrefetcher
+
+SuiteSegmentPrefetcher::SuiteSegmentPrefetcher(Environment& aEnv)
+    : SuiteUnitTest("SuiteSegmentPrefetcher")
+    , iEnv(aEnv)
+{
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestSegmentsInOrder), "TestSegmentsInOrder");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestConnectionsReused), "TestConnectionsReused");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestConnectionsNotReused), "TestConnectionsNotReused");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestFetchesConcurrently), "TestFetchesConcurrently");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestPlaylistReloadOverlapsFetch), "TestPlaylistReloadOverlapsFetch");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestPlaylistErrorAfterSegments), "TestPlaylistErrorAfterSegments");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestSegmentNotFound), "TestSegmentNotFound");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestInterrupt), "TestInterrupt");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestRestart), "TestRestart");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestVariantChanged), "TestVariantChanged");
+    AddTest(MakeFunctor(*this, &SuiteSegmentPrefetcher::TestThroughputReported), "TestThroughputReported");
+}
+
+void SuiteSegmentPrefetcher::Setup()
+{
+    std::vector<NetworkAdapter*>* ifs = Os::NetworkListAdapters(iEnv, Net::InitialisationParams::ELoopbackUse, "SuiteSegmentPrefetcher");
+    ASSERT(ifs->size() > 0);
+    TIpAddress addr = (*ifs)[0]->Address(); // using loopback, so first one should do
+    for (TUint i=0; i<ifs->size(); i++) {
+        (*ifs)[i]->RemoveRef("SuiteSegmentPrefetcher");
+    }
+    delete ifs;
+    iServer = new HlsTestServer(iEnv, addr);
+    iSegments = new TestSegmentList(*iServer);
+    std::vector<IHlsReader*> readers;
+    for (TUint i=0; i<kReaders; i++) {
+        readers.push_back(new HlsSegmentReader(iEnv, Brx::Empty()));
+    }
+    iPrefetcher = new SegmentPrefetcher(iEnv, readers, kSlotBytes);
+    iStreamer = new SegmentStreamer(iEnv, iPrefetcher->Socket(), iPrefetcher->Reader());
+    iInterruptDelayMs = 0;
+}
+
+void SuiteSegmentPrefetcher::TearDown()
+{
+    iStreamer->ReadInterrupt();
+    iPrefetcher->Stop();
+    iStreamer->Close();
+    delete iStreamer;
+    delete iPrefetcher;
+    delete iSegments;
+    delete iServer;
+}
+
+void SuiteSegmentPrefetcher::Start(TUint aSegments)
+{
+    iSegments->Reset(aSegments);
+    iPrefetcher->Start(*iSegments);
+    iStreamer->Stream(*iPrefetcher);
+}
+
+TBool SuiteSegmentPrefetcher::ReadSegment(TUint aIndex)
+{
+    TUint offset = 0;
+    while (offset < HlsTestServer::kSegmentBytes) {
+        Brn buf = iStreamer->Read(HlsTestServer::kSegmentBytes - offset);
+        for (TUint i=0; i<buf.Bytes(); i++, offset++) {
+            if (buf[i] != HlsTestServer::SegmentByte(aIndex, offset)) {
+                Print("SuiteSegmentPrefetcher::ReadSegment(%u) unexpected byte at offset %u\n", aIndex, offset);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void SuiteSegmentPrefetcher::InterruptThread()
+{
+    Thread::Sleep(iInterruptDelayMs);
+    iPrefetcher->Interrupt();
+}
+
+void SuiteSegmentPrefetcher::TestSegmentsInOrder()
+{
+    static const TUint kSegments = 10;
+    Start(kSegments);
+    for (TUint i=0; i<kSegments; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iStreamer->Error() == false);
+    TEST(iServer->Requests() == kSegments);
+}
+
+void SuiteSegmentPrefetcher::TestConnectionsReused()
+{
+    static const TUint kSegments = 10;
+    Start(kSegments);
+    for (TUint i=0; i<kSegments; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iServer->Requests() == kSegments);
+    TEST(iServer->Connections() <= kReaders);
+}
+
+void SuiteSegmentPrefetcher::TestConnectionsNotReused()
+{
+    static const TUint kSegments = 5;
+    iServer->SetKeepAlive(false);
+    Start(kSegments);
+    for (TUint i=0; i<kSegments; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iServer->Connections() == kSegments);
+}
+
+void SuiteSegmentPrefetcher::TestFetchesConcurrently()
+{
+    static const TUint kSegments = 6;
+    static const TUint kLatencyMs = 100;
+    iServer->SetLatency(kLatencyMs); // long enough that readers' requests overlap
+    Start(kSegments);
+    for (TUint i=0; i<kSegments; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iServer->MaxConcurrentRequests() > 1);
+    TEST(iServer->MaxConcurrentRequests() <= kReaders);
+}
+
+void SuiteSegmentPrefetcher::TestPlaylistReloadOverlapsFetch()
+{
+    Semaphore blocked("SSPB", 0);
+    Semaphore release("SSPR", 0);
+    iSegments->Reset(4);
+    iSegments->BlockAt(1, blocked, release);
+    iPrefetcher->Start(*iSegments);
+    iStreamer->Stream(*iPrefetcher);
+    blocked.Wait();
+    // first segment can be read while the reader fetching the next uri is blocked
+    TEST(ReadSegment(0));
+    release.Signal();
+    for (TUint i=1; i<4; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+}
+
+void SuiteSegmentPrefetcher::TestPlaylistErrorAfterSegments()
+{
+    static const TUint kSegments = 3;
+    iSegments->Reset(kSegments);
+    iSegments->SetErrorAtEnd();
+    iPrefetcher->Start(*iSegments);
+    iStreamer->Stream(*iPrefetcher);
+    for (TUint i=0; i<kSegments; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST(iStreamer->Error() == false);
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iStreamer->Error());
+}
+
+void SuiteSegmentPrefetcher::TestSegmentNotFound()
+{
+    iSegments->Reset(3);
+    iSegments->SetNotFound(1);
+    iPrefetcher->Start(*iSegments);
+    iStreamer->Stream(*iPrefetcher);
+    TEST(ReadSegment(0));
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iStreamer->Error());
+}
+
+void SuiteSegmentPrefetcher::TestInterrupt()
+{
+    static const TUint kLatencyMs = 2000;
+    iServer->SetLatency(kLatencyMs);
+    Start(3);
+    iInterruptDelayMs = 100;
+    ThreadFunctor thread("SSPI", MakeFunctor(*this, &SuiteSegmentPrefetcher::InterruptThread));
+    thread.Start();
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    iPrefetcher->Stop();
+    // neither Read() nor Stop() waited for the server to respond
+    TEST(iServer->Responses() == 0);
+    TEST(iStreamer->Error() == false);
+}
+
+void SuiteSegmentPrefetcher::TestRestart()
+{
+    Start(5);
+    TEST(ReadSegment(0));
+    TEST(ReadSegment(1));
+
+    iStreamer->ReadInterrupt();
+    iPrefetcher->Stop();
+    iStreamer->Close();
+
+    Start(5);
+    for (TUint i=0; i<5; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+}
+
+void SuiteSegmentPrefetcher::TestVariantChanged()
+{
+    // Variant change is passed on in order, and doesn't stop later segments being fetched.
+    static const TUint kSegments = 5;
+    iSegments->Reset(kSegments);
+    iSegments->SetVariantChangedAt(2);
+    iPrefetcher->Start(*iSegments);
+    iStreamer->Stream(*iPrefetcher);
+    TEST(ReadSegment(0));
+    TEST(ReadSegment(1));
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iStreamer->VariantChanged());
+    TEST(iStreamer->Error() == false);
+    for (TUint i=2; i<kSegments; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST(iStreamer->VariantChanged() == false);
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    TEST(iStreamer->VariantChanged() == false);
+    TEST(iStreamer->Error() == false);
+    TEST(iServer->Requests() == kSegments);
+}
+
+void SuiteSegmentPrefetcher::TestThroughputReported()
+{
+    // Every byte fetched is reported.  Segments are fetched concurrently so one notification
+    // may cover the end of several segments.
+    static const TUint kSegments = 4;
+    static const TUint kLatencyMs = 50;
+    TestThroughputObserver observer;
+    iServer->SetLatency(kLatencyMs);
+    iSegments->Reset(kSegments);
+    iPrefetcher->Start(*iSegments, &observer);
+    iStreamer->Stream(*iPrefetcher);
+    for (TUint i=0; i<kSegments; i++) {
+        TEST(ReadSegment(i));
+    }
+    TEST_THROWS(iStreamer->Read(1), ReaderError);
+    iStreamer->ReadInterrupt();
+    iPrefetcher->Stop();    // waits for fetching threads to finish reporting
+
+    TEST(observer.Count() > 0);
+    TEST(observer.Count() <= kSegments);
+    TEST(observer.Bytes() == kSegments * HlsTestServer::kSegmentBytes);
+    TEST(observer.Ms() >= kLatencyMs);
+}
+
 
 
 void TestProtocolHls(Environment& aEnv)
 {
     Runner runner("HLS tests\n");
+    runner.Add(new SuiteHlsVariantSelector());
     runner.Add(new SuiteHlsM3uReader());
-    runner.Add(new SuiteSegmentStreamer());
+    runner.Add(new SuiteSegmentStreamer(aEnv));
     runner.Add(new SuiteProtocolHls(aEnv));
+    runner.Add(new SuiteSegmentPrefetcher(aEnv));
     runner.Run();
 }
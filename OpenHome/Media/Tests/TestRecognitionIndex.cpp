@@ -0,0 +1,241 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Codec/RecognitionIndex.h>
+#include <OpenHome/Buffer.h>
+
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media::Codec;
+
+namespace OpenHome {
+namespace Media {
+namespace Codec {
+
+class SuiteRecognitionIndex : public SuiteUnitTest
+{
+    static const TUint kIdFlac = 0;
+    static const TUint kIdWav = 1;
+    static const TUint kIdMp3 = 2;
+    static const TUint kIdVorbis = 3;
+    static const TUint kIdNoHints = 4;
+public:
+    SuiteRecognitionIndex();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestExtension();
+    void TestNoCandidates();
+    void TestExtensionMatch();
+    void TestSignatureMatch();
+    void TestSignatureAtOffset();
+    void TestSignatureBeforeExtension();
+    void TestSharedPrefix();
+    void TestShortHeader();
+    void TestHeaderBytes();
+private:
+    void AddHints();
+private:
+    RecognitionIndex* iIndex;
+    std::vector<TUint> iCandidates;
+};
+
+} // namespace Codec
+} // namespace Media
+} // namespace OpenHome
+
+
+// SuiteRecognitionIndex
+
+SuiteRecognitionIndex::SuiteRecognitionIndex()
+    : SuiteUnitTest("RecognitionIndex")
+{
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestExtension), "TestExtension");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestNoCandidates), "TestNoCandidates");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestExtensionMatch), "TestExtensionMatch");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestSignatureMatch), "TestSignatureMatch");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestSignatureAtOffset), "TestSignatureAtOffset");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestSignatureBeforeExtension), "TestSignatureBeforeExtension");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestSharedPrefix), "TestSharedPrefix");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestShortHeader), "TestShortHeader");
+    AddTest(MakeFunctor(*this, &SuiteRecognitionIndex::TestHeaderBytes), "TestHeaderBytes");
+}
+
+void SuiteRecognitionIndex::Setup()
+{
+    iIndex = new RecognitionIndex();
+    AddHints();
+}
+
+void SuiteRecognitionIndex::TearDown()
+{
+    iCandidates.clear();
+    delete iIndex;
+}
+
+void SuiteRecognitionIndex::AddHints()
+{
+    RecognitionHints flac;
+    flac.AddSignature(Brn("fLaC"));
+    flac.AddSignature(Brn("fLaC"), 37);
+    flac.AddExtension("flac");
+    flac.AddExtension("ogg");
+
+    RecognitionHints wav;
+    wav.AddSignature(Brn("WAVE"), 8);
+    wav.AddExtension("wav");
+
+    RecognitionHints mp3;
+    static const TByte kSync[][2] = { { 0xff, 0xfb }, { 0xff, 0xfa } };
+    mp3.AddSignature(Brn(kSync[0], 2));
+    mp3.AddSignature(Brn(kSync[1], 2));
+    mp3.AddExtension("mp3");
+
+    RecognitionHints vorbis;
+    vorbis.AddSignature(Brn("\x01vorbis"), 28);
+    vorbis.AddExtension("ogg");
+
+    RecognitionHints none;
+
+    // add out of order to check candidates are returned in order of preference
+    iIndex->Add(kIdVorbis, vorbis);
+    iIndex->Add(kIdMp3, mp3);
+    iIndex->Add(kIdNoHints, none);
+    iIndex->Add(kIdWav, wav);
+    iIndex->Add(kIdFlac, flac);
+}
+
+void SuiteRecognitionIndex::TestExtension()
+{
+    Bws<RecognitionIndex::kMaxExtensionBytes> ext;
+    RecognitionIndex::Extension(Brn("http://host:1234/path/file.flac"), ext);
+    TEST(ext == Brn("flac"));
+    RecognitionIndex::Extension(Brn("http://host/file.MP3?token=a.b#frag.c"), ext);
+    TEST(ext == Brn("mp3"));
+    RecognitionIndex::Extension(Brn("http://host/dir.name/file"), ext);
+    TEST(ext.Bytes() == 0);
+    RecognitionIndex::Extension(Brn("http://host/file."), ext);
+    TEST(ext.Bytes() == 0);
+    RecognitionIndex::Extension(Brn("http://host/file.waytoolongextension"), ext);
+    TEST(ext.Bytes() == 0);
+    RecognitionIndex::Extension(Brx::Empty(), ext);
+    TEST(ext.Bytes() == 0);
+}
+
+void SuiteRecognitionIndex::TestNoCandidates()
+{
+    iIndex->Candidates(Brn("http://host/file.xyz"), Brn("not a known signature"), iCandidates);
+    TEST(iCandidates.size() == 0);
+    iIndex->Candidates(Brx::Empty(), Brx::Empty(), iCandidates);
+    TEST(iCandidates.size() == 0);
+}
+
+void SuiteRecognitionIndex::TestExtensionMatch()
+{
+    iIndex->Candidates(Brn("http://host/file.Wav"), Brx::Empty(), iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdWav);
+
+    iIndex->Candidates(Brn("http://host/file.ogg"), Brx::Empty(), iCandidates);
+    TEST(iCandidates.size() == 2);
+    TEST(iCandidates[0] == kIdFlac);
+    TEST(iCandidates[1] == kIdVorbis);
+}
+
+void SuiteRecognitionIndex::TestSignatureMatch()
+{
+    iIndex->Candidates(Brx::Empty(), Brn("fLaCdata"), iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdFlac);
+
+    const TByte mp3[] = { 0xff, 0xfb, 0x90, 0x64 };
+    iIndex->Candidates(Brx::Empty(), Brn(mp3, sizeof(mp3)), iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdMp3);
+
+    const TByte notMp3[] = { 0xff, 0xf1, 0x50, 0x80 };
+    iIndex->Candidates(Brx::Empty(), Brn(notMp3, sizeof(notMp3)), iCandidates);
+    TEST(iCandidates.size() == 0);
+}
+
+void SuiteRecognitionIndex::TestSignatureAtOffset()
+{
+    iIndex->Candidates(Brx::Empty(), Brn("RIFFsizeWAVEfmt "), iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdWav);
+
+    Bws<64> ogg("OggS");
+    while (ogg.Bytes() < 28) {
+        ogg.Append('\0');
+    }
+    Bws<64> oggFlac;
+    oggFlac.Replace(ogg);
+    ogg.Append("\x01vorbis");
+    iIndex->Candidates(Brx::Empty(), ogg, iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdVorbis);
+
+    while (oggFlac.Bytes() < 37) {
+        oggFlac.Append('\0');
+    }
+    oggFlac.Append("fLaC");
+    iIndex->Candidates(Brx::Empty(), oggFlac, iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdFlac);
+}
+
+void SuiteRecognitionIndex::TestSignatureBeforeExtension()
+{
+    // wav content served with a misleading extension
+    iIndex->Candidates(Brn("http://host/file.ogg"), Brn("RIFFsizeWAVEfmt "), iCandidates);
+    TEST(iCandidates.size() == 3);
+    TEST(iCandidates[0] == kIdWav);
+    TEST(iCandidates[1] == kIdFlac);
+    TEST(iCandidates[2] == kIdVorbis);
+
+    // candidate matched by both signature and extension is only listed once
+    iIndex->Candidates(Brn("http://host/file.flac"), Brn("fLaC"), iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdFlac);
+}
+
+void SuiteRecognitionIndex::TestSharedPrefix()
+{
+    RecognitionHints hints;
+    hints.AddSignature(Brn("fL"));
+    iIndex->Add(kIdNoHints, hints);
+    iIndex->Candidates(Brx::Empty(), Brn("fLaC"), iCandidates);
+    TEST(iCandidates.size() == 2);
+    TEST(iCandidates[0] == kIdFlac);
+    TEST(iCandidates[1] == kIdNoHints);
+    iIndex->Candidates(Brx::Empty(), Brn("fLxx"), iCandidates);
+    TEST(iCandidates.size() == 1);
+    TEST(iCandidates[0] == kIdNoHints);
+}
+
+void SuiteRecognitionIndex::TestShortHeader()
+{
+    iIndex->Candidates(Brx::Empty(), Brn("fLa"), iCandidates);
+    TEST(iCandidates.size() == 0);
+    iIndex->Candidates(Brx::Empty(), Brn("RIFFsizeWAV"), iCandidates);
+    TEST(iCandidates.size() == 0);
+}
+
+void SuiteRecognitionIndex::TestHeaderBytes()
+{
+    TEST(iIndex->HeaderBytes() == 41);
+    iIndex->Clear();
+    TEST(iIndex->HeaderBytes() == 0);
+    iIndex->Candidates(Brn("http://host/file.flac"), Brn("fLaC"), iCandidates);
+    TEST(iCandidates.size() == 0);
+}
+
+
+
+void TestRecognitionIndex()
+{
+    Runner runner("RecognitionIndex tests\n");
+    runner.Add(new SuiteRecognitionIndex());
+    runner.Run();
+}
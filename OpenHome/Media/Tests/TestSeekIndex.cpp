@@ -0,0 +1,177 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Codec/SeekIndex.h>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media::Codec;
+
+namespace OpenHome {
+namespace Media {
+namespace Codec {
+
+class SuiteSeekIndex : public SuiteUnitTest
+{
+    static const TUint kMaxEntries = 8;
+    static const TUint kGranularity = 100;
+public:
+    SuiteSeekIndex();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestEmpty();
+    void TestFindExact();
+    void TestFindPreceding();
+    void TestMaxDistance();
+    void TestGranularity();
+    void TestOutOfOrder();
+    void TestThin();
+    void TestReset();
+private:
+    SeekIndex* iIndex;
+};
+
+} // namespace Codec
+} // namespace Media
+} // namespace OpenHome
+
+
+// SuiteSeekIndex
+
+SuiteSeekIndex::SuiteSeekIndex()
+    : SuiteUnitTest("SeekIndex")
+{
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestEmpty), "TestEmpty");
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestFindExact), "TestFindExact");
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestFindPreceding), "TestFindPreceding");
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestMaxDistance), "TestMaxDistance");
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestGranularity), "TestGranularity");
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestOutOfOrder), "TestOutOfOrder");
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestThin), "TestThin");
+    AddTest(MakeFunctor(*this, &SuiteSeekIndex::TestReset), "TestReset");
+}
+
+void SuiteSeekIndex::Setup()
+{
+    iIndex = new SeekIndex(kMaxEntries);
+    iIndex->Reset(kGranularity);
+}
+
+void SuiteSeekIndex::TearDown()
+{
+    delete iIndex;
+}
+
+void SuiteSeekIndex::TestEmpty()
+{
+    TUint64 sample, offset;
+    TEST(iIndex->Count() == 0);
+    TEST(!iIndex->TryFind(0, 1000, sample, offset));
+    TEST(!iIndex->TryFind(12345, 100000, sample, offset));
+}
+
+void SuiteSeekIndex::TestFindExact()
+{
+    iIndex->Add(0, 42);
+    iIndex->Add(200, 1042);
+    TUint64 sample, offset;
+    TEST(iIndex->TryFind(0, 0, sample, offset));
+    TEST(sample == 0);
+    TEST(offset == 42);
+    TEST(iIndex->TryFind(200, 0, sample, offset));
+    TEST(sample == 200);
+    TEST(offset == 1042);
+}
+
+void SuiteSeekIndex::TestFindPreceding()
+{
+    iIndex->Add(1000, 5000);
+    iIndex->Add(2000, 9000);
+    TUint64 sample, offset;
+    TEST(!iIndex->TryFind(999, 1000, sample, offset));
+    TEST(iIndex->TryFind(1999, 1000, sample, offset));
+    TEST(sample == 1000);
+    TEST(offset == 5000);
+    TEST(iIndex->TryFind(2500, 1000, sample, offset));
+    TEST(sample == 2000);
+    TEST(offset == 9000);
+}
+
+void SuiteSeekIndex::TestMaxDistance()
+{
+    iIndex->Add(1000, 5000);
+    TUint64 sample, offset;
+    TEST(iIndex->TryFind(1500, 500, sample, offset));
+    TEST(sample == 1000);
+    TEST(!iIndex->TryFind(1501, 500, sample, offset));
+}
+
+void SuiteSeekIndex::TestGranularity()
+{
+    iIndex->Add(1000, 5000);
+    iIndex->Add(1050, 5200); // too close to previous entry
+    iIndex->Add(1000, 6000); // duplicate
+    iIndex->Add(950, 4800);  // too close to following entry
+    TEST(iIndex->Count() == 1);
+    TUint64 sample, offset;
+    TEST(iIndex->TryFind(1050, 100, sample, offset));
+    TEST(sample == 1000);
+    TEST(offset == 5000);
+    iIndex->Add(1100, 5400);
+    TEST(iIndex->Count() == 2);
+}
+
+void SuiteSeekIndex::TestOutOfOrder()
+{
+    iIndex->Add(3000, 30);
+    iIndex->Add(1000, 10);
+    iIndex->Add(2000, 20);
+    TEST(iIndex->Count() == 3);
+    TUint64 sample, offset;
+    for (TUint i=1; i<=3; i++) {
+        TEST(iIndex->TryFind(i*1000 + 1, 1000, sample, offset));
+        TEST(sample == i*1000);
+        TEST(offset == i*10);
+    }
+}
+
+void SuiteSeekIndex::TestThin()
+{
+    for (TUint i=0; i<kMaxEntries; i++) {
+        iIndex->Add(i*kGranularity, i);
+    }
+    TEST(iIndex->Count() == kMaxEntries);
+    TEST(iIndex->Granularity() == kGranularity);
+    iIndex->Add(kMaxEntries*kGranularity, kMaxEntries);
+    TEST(iIndex->Count() == kMaxEntries/2 + 1);
+    TEST(iIndex->Granularity() == 2*kGranularity);
+    TUint64 sample, offset;
+    TEST(iIndex->TryFind(kGranularity, kGranularity, sample, offset));
+    TEST(sample == 0);
+    TEST(iIndex->TryFind(kMaxEntries*kGranularity, 0, sample, offset));
+    TEST(offset == kMaxEntries);
+    // entries closer than the new granularity are no longer added
+    iIndex->Add((kMaxEntries+1)*kGranularity, kMaxEntries+1);
+    TEST(iIndex->Count() == kMaxEntries/2 + 1);
+}
+
+void SuiteSeekIndex::TestReset()
+{
+    iIndex->Add(0, 0);
+    iIndex->Add(1000, 1);
+    iIndex->Reset(10);
+    TEST(iIndex->Count() == 0);
+    TEST(iIndex->Granularity() == 10);
+    iIndex->Add(0, 0);
+    iIndex->Add(10, 1);
+    TEST(iIndex->Count() == 2);
+}
+
+
+
+void TestSeekIndex()
+{
+    Runner runner("SeekIndex tests\n");
+    runner.Add(new SuiteSeekIndex());
+    runner.Run();
+}
@@ -0,0 +1,287 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Media/Protocol/UrlBlockCache.h>
+#include <OpenHome/Media/Pipeline/Msg.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Stream.h>
+
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Media;
+
+namespace OpenHome {
+namespace Media {
+
+class HelperUrlBlockWriter : public IUrlBlockWriter
+{
+public:
+    HelperUrlBlockWriter(TUint aStreamBytes);
+    TUint Requests() const;
+    TUint64 LastOffset() const;
+    TUint LastBytes() const;
+    static TByte Value(TUint64 aOffset);
+public: // from IUrlBlockWriter
+    TBool TryGet(IWriter& aWriter, const Brx& aUrl, TUint64 aOffset, TUint aBytes) override;
+private:
+    const TUint iStreamBytes;
+    TUint iRequests;
+    TUint64 iLastOffset;
+    TUint iLastBytes;
+};
+
+class SuiteUrlBlockCache : public SuiteUnitTest
+{
+    static const TUint kStreamBytes = 20 * UrlBlockCache::kBlockBytes + 100;
+    static const TUint kCacheBytes = UrlBlockCache::kMinBlocks * UrlBlockCache::kBlockBytes;
+    static const TUint kReadBytes = 1024;
+    static const Brn kUrl1;
+    static const Brn kUrl2;
+public:
+    SuiteUrlBlockCache();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestSequentialReadsCoalesced();
+    void TestRepeatReadCached();
+    void TestReadSpanningBlocks();
+    void TestUrlsCachedSeparately();
+    void TestLeastRecentlyUsedEvicted();
+    void TestEndOfStream();
+    void TestLargeReadPassedThrough();
+    void TestDisabled();
+private:
+    TBool Read(const Brx& aUrl, TUint64 aOffset, TUint aBytes);
+    TBool ReadOk(const Brx& aUrl, TUint64 aOffset, TUint aBytes);
+private:
+    HelperUrlBlockWriter* iUpstream;
+    UrlBlockCache* iCache;
+    Bwh iBuf;
+};
+
+} // namespace Media
+} // namespace OpenHome
+
+
+// HelperUrlBlockWriter
+
+HelperUrlBlockWriter::HelperUrlBlockWriter(TUint aStreamBytes)
+    : iStreamBytes(aStreamBytes)
+    , iRequests(0)
+    , iLastOffset(0)
+    , iLastBytes(0)
+{
+}
+
+TUint HelperUrlBlockWriter::Requests() const
+{
+    return iRequests;
+}
+
+TUint64 HelperUrlBlockWriter::LastOffset() const
+{
+    return iLastOffset;
+}
+
+TUint HelperUrlBlockWriter::LastBytes() const
+{
+    return iLastBytes;
+}
+
+TByte HelperUrlBlockWriter::Value(TUint64 aOffset)
+{ // static
+    return (TByte)((aOffset * 7) + (aOffset >> 8));
+}
+
+TBool HelperUrlBlockWriter::TryGet(IWriter& aWriter, const Brx& /*aUrl*/, TUint64 aOffset, TUint aBytes)
+{
+    iRequests++;
+    iLastOffset = aOffset;
+    iLastBytes = aBytes;
+    if (aOffset + aBytes > iStreamBytes) {
+        return false;
+    }
+    Bws<256> buf;
+    for (TUint64 i=aOffset; i<aOffset+aBytes; i++) {
+        buf.Append(Value(i));
+        if (buf.Bytes() == buf.MaxBytes()) {
+            aWriter.Write(buf);
+            buf.SetBytes(0);
+        }
+    }
+    aWriter.Write(buf);
+    return true;
+}
+
+
+// SuiteUrlBlockCache
+
+const Brn SuiteUrlBlockCache::kUrl1("http://host/file1.m4a");
+const Brn SuiteUrlBlockCache::kUrl2("http://host/file2.m4a");
+
+SuiteUrlBlockCache::SuiteUrlBlockCache()
+    : SuiteUnitTest("UrlBlockCache")
+    , iBuf(4 * UrlBlockCache::kBlockBytes)
+{
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestSequentialReadsCoalesced), "TestSequentialReadsCoalesced");
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestRepeatReadCached), "TestRepeatReadCached");
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestReadSpanningBlocks), "TestReadSpanningBlocks");
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestUrlsCachedSeparately), "TestUrlsCachedSeparately");
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestLeastRecentlyUsedEvicted), "TestLeastRecentlyUsedEvicted");
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestEndOfStream), "TestEndOfStream");
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestLargeReadPassedThrough), "TestLargeReadPassedThrough");
+    AddTest(MakeFunctor(*this, &SuiteUrlBlockCache::TestDisabled), "TestDisabled");
+}
+
+void SuiteUrlBlockCache::Setup()
+{
+    iUpstream = new HelperUrlBlockWriter(kStreamBytes);
+    iCache = new UrlBlockCache(*iUpstream, kCacheBytes);
+}
+
+void SuiteUrlBlockCache::TearDown()
+{
+    delete iCache;
+    delete iUpstream;
+}
+
+TBool SuiteUrlBlockCache::Read(const Brx& aUrl, TUint64 aOffset, TUint aBytes)
+{
+    iBuf.SetBytes(0);
+    WriterBuffer writer(iBuf);
+    return iCache->TryGet(writer, aUrl, aOffset, aBytes);
+}
+
+TBool SuiteUrlBlockCache::ReadOk(const Brx& aUrl, TUint64 aOffset, TUint aBytes)
+{
+    if (!Read(aUrl, aOffset, aBytes) || iBuf.Bytes() != aBytes) {
+        return false;
+    }
+    for (TUint i=0; i<aBytes; i++) {
+        if (iBuf[i] != HelperUrlBlockWriter::Value(aOffset + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SuiteUrlBlockCache::TestSequentialReadsCoalesced()
+{
+    const TUint fetchBytes = UrlBlockCache::kMaxFetchBlocks * UrlBlockCache::kBlockBytes;
+    for (TUint64 offset=0; offset<fetchBytes; offset+=kReadBytes) {
+        TEST(ReadOk(kUrl1, offset, kReadBytes));
+    }
+    TEST(iUpstream->Requests() == 1);
+    TEST(iUpstream->LastOffset() == 0);
+    TEST(iUpstream->LastBytes() == fetchBytes);
+    TEST(ReadOk(kUrl1, fetchBytes, kReadBytes));
+    TEST(iUpstream->Requests() == 2);
+    TEST(iUpstream->LastOffset() == fetchBytes);
+}
+
+void SuiteUrlBlockCache::TestRepeatReadCached()
+{
+    const TUint64 offset = 5 * UrlBlockCache::kBlockBytes + 10;
+    TEST(ReadOk(kUrl1, offset, kReadBytes));
+    TEST(iUpstream->Requests() == 1);
+    TEST(iUpstream->LastOffset() == 5 * UrlBlockCache::kBlockBytes);
+    TEST(ReadOk(kUrl1, offset, kReadBytes));
+    TEST(ReadOk(kUrl1, offset - 10, 10));
+    TEST(iUpstream->Requests() == 1);
+}
+
+void SuiteUrlBlockCache::TestReadSpanningBlocks()
+{
+    // first block cached, second not
+    TEST(ReadOk(kUrl1, UrlBlockCache::kBlockBytes, kReadBytes));
+    TEST(ReadOk(kUrl1, UrlBlockCache::kBlockBytes - 100, 200));
+    TEST(iUpstream->Requests() == 2);
+    TEST(iUpstream->LastOffset() == 0);
+    TEST(iUpstream->LastBytes() == UrlBlockCache::kBlockBytes); // fetch stops at first cached block
+    TEST(ReadOk(kUrl1, 100, 2 * UrlBlockCache::kBlockBytes));
+    TEST(iUpstream->Requests() == 2);
+}
+
+void SuiteUrlBlockCache::TestUrlsCachedSeparately()
+{
+    TEST(ReadOk(kUrl1, 0, kReadBytes));
+    TEST(ReadOk(kUrl2, 0, kReadBytes));
+    TEST(iUpstream->Requests() == 2);
+    TEST(ReadOk(kUrl1, kReadBytes, kReadBytes));
+    TEST(ReadOk(kUrl2, kReadBytes, kReadBytes));
+    TEST(iUpstream->Requests() == 2);
+}
+
+void SuiteUrlBlockCache::TestLeastRecentlyUsedEvicted()
+{
+    const TUint fetchBytes = UrlBlockCache::kMaxFetchBlocks * UrlBlockCache::kBlockBytes;
+    TEST(ReadOk(kUrl1, 0, kReadBytes));                 // blocks 0-3
+    TEST(ReadOk(kUrl1, fetchBytes, kReadBytes));        // blocks 4-7; cache now full
+    TEST(ReadOk(kUrl1, 0, kReadBytes));                 // block 0 recently used
+    TEST(iUpstream->Requests() == 2);
+    TEST(ReadOk(kUrl1, 2 * fetchBytes, kReadBytes));    // blocks 8-11 replace 1, 4, 5, 6
+    TEST(iUpstream->Requests() == 3);
+    TEST(ReadOk(kUrl1, 0, kReadBytes));
+    TEST(ReadOk(kUrl1, 7 * UrlBlockCache::kBlockBytes, kReadBytes));
+    TEST(iUpstream->Requests() == 3);
+    TEST(ReadOk(kUrl1, UrlBlockCache::kBlockBytes, kReadBytes));
+    TEST(iUpstream->Requests() == 4);
+}
+
+void SuiteUrlBlockCache::TestEndOfStream()
+{
+    // read ahead fails, fetch of the block needed succeeds
+    const TUint64 offset = 18 * UrlBlockCache::kBlockBytes;
+    TEST(ReadOk(kUrl1, offset, kReadBytes));
+    TEST(iUpstream->Requests() == 2);
+    TEST(iUpstream->LastBytes() == UrlBlockCache::kBlockBytes);
+    TEST(ReadOk(kUrl1, offset + kReadBytes, kReadBytes));
+    TEST(iUpstream->Requests() == 2);
+
+    // blocks beyond a failed read ahead (including the final, partial, block) aren't cached
+    const TUint64 tail = 20 * UrlBlockCache::kBlockBytes;
+    TEST(ReadOk(kUrl1, tail, 100));
+    TEST(iUpstream->Requests() == 3);
+    TEST(iUpstream->LastOffset() == tail);
+    TEST(iUpstream->LastBytes() == 100);
+    TEST(ReadOk(kUrl1, tail, 50));
+    TEST(iUpstream->Requests() == 4);
+    TEST(!Read(kUrl1, tail, kReadBytes));
+    TEST(iUpstream->Requests() == 5);
+    TEST(ReadOk(kUrl1, offset + UrlBlockCache::kBlockBytes, kReadBytes));
+    TEST(iUpstream->Requests() == 6);
+
+    // earlier blocks are still cached
+    TEST(ReadOk(kUrl1, offset, kReadBytes));
+    TEST(iUpstream->Requests() == 6);
+}
+
+void SuiteUrlBlockCache::TestLargeReadPassedThrough()
+{
+    const TUint bytes = 4 * UrlBlockCache::kBlockBytes;
+    TEST(ReadOk(kUrl1, 0, bytes));
+    TEST(iUpstream->Requests() == 1);
+    TEST(iUpstream->LastBytes() == bytes);
+    TEST(ReadOk(kUrl1, 0, kReadBytes));
+    TEST(iUpstream->Requests() == 2);
+}
+
+void SuiteUrlBlockCache::TestDisabled()
+{
+    delete iCache;
+    iCache = new UrlBlockCache(*iUpstream, kCacheBytes - 1);
+    TEST(ReadOk(kUrl1, 0, kReadBytes));
+    TEST(ReadOk(kUrl1, 0, kReadBytes));
+    TEST(iUpstream->Requests() == 2);
+    TEST(iUpstream->LastBytes() == kReadBytes);
+}
+
+
+
+void TestUrlBlockCache()
+{
+    Runner runner("UrlBlockCache tests\n");
+    runner.Add(new SuiteUrlBlockCache());
+    runner.Run();
+}
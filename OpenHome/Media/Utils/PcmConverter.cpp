@@ -0,0 +1,518 @@
+#include <OpenHome/Media/Utils/PcmConverter.h>
+#include <OpenHome/Types.h>
+#include <OpenHome/Private/Standard.h>
+
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define PCM_CONVERTER_SSE2
+# include <emmintrin.h>
+# if defined(__GNUC__) || defined(__clang__)
+#  define PCM_CONVERTER_AVX2
+#  define PCM_CONVERTER_TARGET_AVX2 __attribute__((target("avx2")))
+#  include <immintrin.h>
+# elif defined(_MSC_VER) && _MSC_VER >= 1700
+#  define PCM_CONVERTER_AVX2
+#  define PCM_CONVERTER_TARGET_AVX2
+#  include <immintrin.h>
+#  include <intrin.h>
+# endif
+#elif (defined(__ARM_NEON__) || defined(__ARM_NEON)) && !defined(__ARM_BIG_ENDIAN)
+# define PCM_CONVERTER_NEON
+# include <arm_neon.h>
+#endif
+
+using namespace OpenHome;
+using namespace OpenHome::Media;
+
+namespace {
+
+typedef void (*SwapFunc)(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples);
+typedef void (*PackFunc)(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples);
+
+struct Kernels
+{
+    PcmConverter::EImplementation iImpl;
+    SwapFunc iSwap16;
+    SwapFunc iSwap24;
+    PackFunc iPack24;
+    PackFunc iPack16;
+};
+
+// Number of subsamples staged on the stack by the interleave/fixed converters
+// before being packed by one of the kernels above.
+const TUint kStageSubsamples = 256;
+
+// Scalar
+
+void Swap16Scalar(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    for (TUint i=0; i<aNumSubsamples; i++) {
+        const TByte b0 = aSrc[0];
+        aDst[0] = aSrc[1];
+        aDst[1] = b0;
+        aSrc += 2;
+        aDst += 2;
+    }
+}
+
+void Swap24Scalar(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    for (TUint i=0; i<aNumSubsamples; i++) {
+        const TByte b0 = aSrc[0];
+        aDst[0] = aSrc[2];
+        aDst[1] = aSrc[1];
+        aDst[2] = b0;
+        aSrc += 3;
+        aDst += 3;
+    }
+}
+
+void Pack24Scalar(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    for (TUint i=0; i<aNumSubsamples; i++) {
+        const TUint32 s = (TUint32)aSrc[i];
+        *aDst++ = (TByte)(s >> 24);
+        *aDst++ = (TByte)(s >> 16);
+        *aDst++ = (TByte)(s >> 8);
+    }
+}
+
+void Pack16Scalar(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    for (TUint i=0; i<aNumSubsamples; i++) {
+        const TUint32 s = (TUint32)aSrc[i];
+        *aDst++ = (TByte)(s >> 24);
+        *aDst++ = (TByte)(s >> 16);
+    }
+}
+
+const Kernels kKernelsScalar = { PcmConverter::eScalar, Swap16Scalar, Swap24Scalar, Pack24Scalar, Pack16Scalar };
+
+#ifdef PCM_CONVERTER_SSE2
+
+inline __m128i ByteMask(const TByte* aMask)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(aMask));
+}
+
+// Bytes of a 16 byte block holding 5 packed 24-bit subsamples (plus 1 byte of the next)
+// that swap with the byte two places later/earlier or stay where they are.
+const TByte kMask24Low[16]  = { 0xff,0,0, 0xff,0,0, 0xff,0,0, 0xff,0,0, 0xff,0,0, 0 };
+const TByte kMask24Mid[16]  = { 0,0xff,0, 0,0xff,0, 0,0xff,0, 0,0xff,0, 0,0xff,0, 0xff };
+const TByte kMask24High[16] = { 0,0,0xff, 0,0,0xff, 0,0,0xff, 0,0,0xff, 0,0,0xff, 0 };
+
+void Swap16Sse2(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    TUint i = 0;
+    for (; i+8<=aNumSubsamples; i+=8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc));
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst), x);
+        aSrc += 16;
+        aDst += 16;
+    }
+    Swap16Scalar(aDst, aSrc, aNumSubsamples - i);
+}
+
+void Swap24Sse2(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    // 5 subsamples per iteration.  The 16th byte is written back unchanged so the
+    // following subsample must exist (and is safe to rewrite when converting in place).
+    const __m128i low = ByteMask(kMask24Low);
+    const __m128i mid = ByteMask(kMask24Mid);
+    const __m128i high = ByteMask(kMask24High);
+    TUint i = 0;
+    for (; i+6<=aNumSubsamples; i+=5) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc));
+        __m128i y = _mm_and_si128(x, mid);
+        y = _mm_or_si128(y, _mm_and_si128(_mm_srli_si128(x, 2), low));
+        y = _mm_or_si128(y, _mm_and_si128(_mm_slli_si128(x, 2), high));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst), y);
+        aSrc += 15;
+        aDst += 15;
+    }
+    Swap24Scalar(aDst, aSrc, aNumSubsamples - i);
+}
+
+inline __m128i ByteSwap32Sse2(__m128i aX)
+{
+    aX = _mm_or_si128(_mm_slli_epi16(aX, 8), _mm_srli_epi16(aX, 8));
+    aX = _mm_shufflelo_epi16(aX, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_shufflehi_epi16(aX, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+void Pack24Sse2(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    // 4 subsamples (12 bytes) per iteration; writes 16 bytes so needs 2 spare subsamples of output
+    const __m128i keepLow = _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff);
+    const __m128i keepHigh = _mm_set_epi32(0x0000ffff, (TInt32)0xff000000, 0x0000ffff, (TInt32)0xff000000);
+    const __m128i halfLow = _mm_set_epi32(0, 0, 0x0000ffff, (TInt32)0xffffffff);
+    TUint i = 0;
+    for (; i+6<=aNumSubsamples; i+=4) {
+        __m128i x = ByteSwap32Sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i)));
+        // within each 64-bit half, close the gap left by the discarded low byte of the first subsample
+        x = _mm_or_si128(_mm_and_si128(x, keepLow), _mm_and_si128(_mm_srli_epi64(x, 8), keepHigh));
+        // then move the upper half's 6 bytes down against the lower half's
+        x = _mm_or_si128(_mm_and_si128(x, halfLow), _mm_srli_si128(_mm_andnot_si128(halfLow, x), 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst), x);
+        aDst += 12;
+    }
+    Pack24Scalar(aDst, aSrc + i, aNumSubsamples - i);
+}
+
+void Pack16Sse2(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    TUint i = 0;
+    for (; i+8<=aNumSubsamples; i+=8) {
+        const __m128i a = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i)), 16);
+        const __m128i b = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + i + 4)), 16);
+        __m128i x = _mm_packs_epi32(a, b);
+        x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst), x);
+        aDst += 16;
+    }
+    Pack16Scalar(aDst, aSrc + i, aNumSubsamples - i);
+}
+
+const Kernels kKernelsSse2 = { PcmConverter::eSse2, Swap16Sse2, Swap24Sse2, Pack24Sse2, Pack16Sse2 };
+
+#endif // PCM_CONVERTER_SSE2
+
+#ifdef PCM_CONVERTER_AVX2
+
+PCM_CONVERTER_TARGET_AVX2 void Swap16Avx2(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    TUint i = 0;
+    for (; i+16<=aNumSubsamples; i+=16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aSrc));
+        x = _mm256_or_si256(_mm256_slli_epi16(x, 8), _mm256_srli_epi16(x, 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(aDst), x);
+        aSrc += 32;
+        aDst += 32;
+    }
+    Swap16Sse2(aDst, aSrc, aNumSubsamples - i);
+}
+
+PCM_CONVERTER_TARGET_AVX2 void Swap24Avx2(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    // 5 subsamples per 128-bit shuffle; 16th byte written back unchanged (see Swap24Sse2)
+    const __m128i shuffle = _mm_setr_epi8(2,1,0, 5,4,3, 8,7,6, 11,10,9, 14,13,12, 15);
+    TUint i = 0;
+    for (; i+11<=aNumSubsamples; i+=10) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aSrc + 15));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst), _mm_shuffle_epi8(a, shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(aDst + 15), _mm_shuffle_epi8(b, shuffle));
+        aSrc += 30;
+        aDst += 30;
+    }
+    Swap24Scalar(aDst, aSrc, aNumSubsamples - i);
+}
+
+PCM_CONVERTER_TARGET_AVX2 void Pack24Avx2(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    // 8 subsamples (24 bytes) per iteration; writes 32 bytes so needs 3 spare subsamples of output
+    const __m256i shuffle = _mm256_setr_epi8(3,2,1, 7,6,5, 11,10,9, 15,14,13, -1,-1,-1,-1,
+                                             3,2,1, 7,6,5, 11,10,9, 15,14,13, -1,-1,-1,-1);
+    const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    TUint i = 0;
+    for (; i+11<=aNumSubsamples; i+=8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aSrc + i));
+        x = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, shuffle), compact);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(aDst), x);
+        aDst += 24;
+    }
+    Pack24Scalar(aDst, aSrc + i, aNumSubsamples - i);
+}
+
+PCM_CONVERTER_TARGET_AVX2 void Pack16Avx2(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    const __m256i shuffle = _mm256_setr_epi8(1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14,
+                                             1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14);
+    TUint i = 0;
+    for (; i+16<=aNumSubsamples; i+=16) {
+        const __m256i a = _mm256_srai_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(aSrc + i)), 16);
+        const __m256i b = _mm256_srai_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(aSrc + i + 8)), 16);
+        __m256i x = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        x = _mm256_shuffle_epi8(x, shuffle);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(aDst), x);
+        aDst += 32;
+    }
+    Pack16Sse2(aDst, aSrc + i, aNumSubsamples - i);
+}
+
+const Kernels kKernelsAvx2 = { PcmConverter::eAvx2, Swap16Avx2, Swap24Avx2, Pack24Avx2, Pack16Avx2 };
+
+TBool CpuSupportsAvx2()
+{
+# if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) {
+        return false;
+    }
+    __cpuid(regs, 1);
+    const TBool osxsave = (regs[2] & (1 << 27)) != 0;
+    const TBool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+# else
+    return __builtin_cpu_supports("avx2") != 0;
+# endif
+}
+
+#endif // PCM_CONVERTER_AVX2
+
+#ifdef PCM_CONVERTER_NEON
+
+void Swap16Neon(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    TUint i = 0;
+    for (; i+8<=aNumSubsamples; i+=8) {
+        vst1q_u8(aDst, vrev16q_u8(vld1q_u8(aSrc)));
+        aSrc += 16;
+        aDst += 16;
+    }
+    Swap16Scalar(aDst, aSrc, aNumSubsamples - i);
+}
+
+void Swap24Neon(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    TUint i = 0;
+    for (; i+16<=aNumSubsamples; i+=16) {
+        uint8x16x3_t x = vld3q_u8(aSrc);
+        const uint8x16_t b0 = x.val[0];
+        x.val[0] = x.val[2];
+        x.val[2] = b0;
+        vst3q_u8(aDst, x);
+        aSrc += 48;
+        aDst += 48;
+    }
+    Swap24Scalar(aDst, aSrc, aNumSubsamples - i);
+}
+
+void Pack24Neon(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    TUint i = 0;
+    for (; i+16<=aNumSubsamples; i+=16) {
+        const uint8x16x4_t x = vld4q_u8(reinterpret_cast<const TByte*>(aSrc + i)); // val[n] holds byte n of each subsample
+        uint8x16x3_t y;
+        y.val[0] = x.val[3];
+        y.val[1] = x.val[2];
+        y.val[2] = x.val[1];
+        vst3q_u8(aDst, y);
+        aDst += 48;
+    }
+    Pack24Scalar(aDst, aSrc + i, aNumSubsamples - i);
+}
+
+void Pack16Neon(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    TUint i = 0;
+    for (; i+16<=aNumSubsamples; i+=16) {
+        const uint8x16x4_t x = vld4q_u8(reinterpret_cast<const TByte*>(aSrc + i));
+        uint8x16x2_t y;
+        y.val[0] = x.val[3];
+        y.val[1] = x.val[2];
+        vst2q_u8(aDst, y);
+        aDst += 32;
+    }
+    Pack16Scalar(aDst, aSrc + i, aNumSubsamples - i);
+}
+
+const Kernels kKernelsNeon = { PcmConverter::eNeon, Swap16Neon, Swap24Neon, Pack24Neon, Pack16Neon };
+
+#endif // PCM_CONVERTER_NEON
+
+const Kernels* KernelsFor(PcmConverter::EImplementation aImpl)
+{
+    switch (aImpl)
+    {
+    case PcmConverter::eScalar:
+        return &kKernelsScalar;
+#ifdef PCM_CONVERTER_SSE2
+    case PcmConverter::eSse2:
+        return &kKernelsSse2;
+#endif
+#ifdef PCM_CONVERTER_AVX2
+    case PcmConverter::eAvx2:
+        return CpuSupportsAvx2()? &kKernelsAvx2 : nullptr;
+#endif
+#ifdef PCM_CONVERTER_NEON
+    case PcmConverter::eNeon:
+        return &kKernelsNeon;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+std::atomic<const Kernels*> gKernels(nullptr);
+
+const Kernels& ActiveKernels()
+{
+    const Kernels* kernels = gKernels.load(std::memory_order_relaxed);
+    if (kernels == nullptr) {
+        static const PcmConverter::EImplementation kPreferred[] = { PcmConverter::eAvx2, PcmConverter::eSse2, PcmConverter::eNeon };
+        kernels = &kKernelsScalar;
+        for (TUint i=0; i<sizeof(kPreferred)/sizeof(kPreferred[0]); i++) {
+            const Kernels* k = KernelsFor(kPreferred[i]);
+            if (k != nullptr) {
+                kernels = k;
+                break;
+            }
+        }
+        gKernels.store(kernels, std::memory_order_relaxed);
+    }
+    return *kernels;
+}
+
+void PackToBigEndian(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples, TUint aBitDepth)
+{
+    // aSrc is msb aligned
+    switch (aBitDepth)
+    {
+    case 8:
+        for (TUint i=0; i<aNumSubsamples; i++) {
+            aDst[i] = (TByte)((TUint32)aSrc[i] >> 24);
+        }
+        break;
+    case 16:
+        ActiveKernels().iPack16(aDst, aSrc, aNumSubsamples);
+        break;
+    case 24:
+        ActiveKernels().iPack24(aDst, aSrc, aNumSubsamples);
+        break;
+    default:
+        ASSERTS();
+    }
+}
+
+} // namespace
+
+
+// PcmConverter
+
+void PcmConverter::SwapEndian16(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    ActiveKernels().iSwap16(aDst, aSrc, aNumSubsamples);
+}
+
+void PcmConverter::SwapEndian24(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples)
+{
+    ActiveKernels().iSwap24(aDst, aSrc, aNumSubsamples);
+}
+
+void PcmConverter::PackToBigEndian24(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    ActiveKernels().iPack24(aDst, aSrc, aNumSubsamples);
+}
+
+void PcmConverter::PackToBigEndian16(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples)
+{
+    ActiveKernels().iPack16(aDst, aSrc, aNumSubsamples);
+}
+
+void PcmConverter::InterleaveToBigEndian(TByte* aDst, const TInt32* const aSrc[], TUint aNumChannels,
+                                         TUint aStartSample, TUint aNumSamples, TUint aBitDepth)
+{
+    ASSERT(aBitDepth == 8 || aBitDepth == 16 || aBitDepth == 24);
+    ASSERT(aNumChannels > 0 && aNumChannels <= kStageSubsamples);
+    const TUint shift = 32 - aBitDepth;
+    const TUint samplesPerStage = kStageSubsamples / aNumChannels;
+    const TUint bytesPerSubsample = aBitDepth / 8;
+    TInt32 stage[kStageSubsamples];
+    TUint sample = aStartSample;
+    TUint remaining = aNumSamples;
+    while (remaining > 0) {
+        const TUint samples = (remaining < samplesPerStage? remaining : samplesPerStage);
+        TInt32* p = stage;
+        if (aNumChannels == 2) {
+            const TInt32* left = aSrc[0] + sample;
+            const TInt32* right = aSrc[1] + sample;
+            for (TUint i=0; i<samples; i++) {
+                *p++ = (TInt32)((TUint32)left[i] << shift);
+                *p++ = (TInt32)((TUint32)right[i] << shift);
+            }
+        }
+        else {
+            for (TUint i=sample; i<sample+samples; i++) {
+                for (TUint j=0; j<aNumChannels; j++) {
+                    *p++ = (TInt32)((TUint32)aSrc[j][i] << shift);
+                }
+            }
+        }
+        const TUint subsamples = samples * aNumChannels;
+        PackToBigEndian(aDst, stage, subsamples, aBitDepth);
+        aDst += subsamples * bytesPerSubsample;
+        sample += samples;
+        remaining -= samples;
+    }
+}
+
+void PcmConverter::InterleaveFixedToBigEndian24(TByte* aDst, const TInt32* const aSrc[], TUint aNumChannels,
+                                                TUint aStartSample, TUint aNumSamples, TUint aFracBits)
+{
+    ASSERT(aFracBits > 0 && aFracBits < 31);
+    ASSERT(aNumChannels > 0 && aNumChannels <= kStageSubsamples);
+    const TInt32 max = (1 << aFracBits) - 1;
+    const TInt32 min = -(1 << aFracBits);
+    const TUint shift = 31 - aFracBits;
+    const TUint samplesPerStage = kStageSubsamples / aNumChannels;
+    TInt32 stage[kStageSubsamples];
+    TUint sample = aStartSample;
+    TUint remaining = aNumSamples;
+    while (remaining > 0) {
+        const TUint samples = (remaining < samplesPerStage? remaining : samplesPerStage);
+        TInt32* p = stage;
+        for (TUint i=sample; i<sample+samples; i++) {
+            for (TUint j=0; j<aNumChannels; j++) {
+                TInt32 s = aSrc[j][i];
+                s = (s > max? max : (s < min? min : s));
+                *p++ = (TInt32)((TUint32)s << shift);
+            }
+        }
+        const TUint subsamples = samples * aNumChannels;
+        ActiveKernels().iPack24(aDst, stage, subsamples);
+        aDst += subsamples * 3;
+        sample += samples;
+        remaining -= samples;
+    }
+}
+
+PcmConverter::EImplementation PcmConverter::Implementation()
+{
+    return ActiveKernels().iImpl;
+}
+
+const TChar* PcmConverter::ImplementationName(EImplementation aImpl)
+{
+    switch (aImpl)
+    {
+    case eScalar:
+        return "Scalar";
+    case eSse2:
+        return "SSE2";
+    case eAvx2:
+        return "AVX2";
+    case eNeon:
+        return "NEON";
+    }
+    return "Unknown";
+}
+
+TBool PcmConverter::IsSupported(EImplementation aImpl)
+{
+    return KernelsFor(aImpl) != nullptr;
+}
+
+void PcmConverter::SetImplementation(EImplementation aImpl)
+{
+    const Kernels* kernels = KernelsFor(aImpl);
+    ASSERT(kernels != nullptr);
+    gKernels.store(kernels, std::memory_order_relaxed);
+}
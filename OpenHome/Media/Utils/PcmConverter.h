@@ -0,0 +1,68 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+
+namespace OpenHome {
+namespace Media {
+
+/*
+ * Conversions between the formats codecs produce and the pipeline's native
+ * (packed, big endian) PCM.
+ *
+ * The byte swap and pack kernels have a scalar implementation plus SSE2/AVX2 (x86) or
+ * NEON (ARM) versions.  The fastest implementation supported by the host cpu is selected
+ * the first time any kernel is used.  All implementations produce identical output.
+ * The interleaving converters reorder subsamples in scalar code then pack them using
+ * the selected kernels.
+ */
+class PcmConverter
+{
+public:
+    enum EImplementation
+    {
+        eScalar
+       ,eSse2
+       ,eAvx2
+       ,eNeon
+    };
+    static const TUint kMaxBitDepth = 24;
+public:
+    /*
+     * Reverse the byte order of each 16 or 24-bit subsample (little <-> big endian).
+     * aDst may equal aSrc.
+     */
+    static void SwapEndian16(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples);
+    static void SwapEndian24(TByte* aDst, const TByte* aSrc, TUint aNumSubsamples);
+    /*
+     * Write the most significant 24 or 16 bits of each native endian 32-bit subsample
+     * as big endian PCM.
+     */
+    static void PackToBigEndian24(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples);
+    static void PackToBigEndian16(TByte* aDst, const TInt32* aSrc, TUint aNumSubsamples);
+    /*
+     * Interleave per-channel arrays of right-aligned aBitDepth (8, 16 or 24) bit subsamples
+     * into big endian PCM.  Reads samples [aStartSample..aStartSample+aNumSamples) from
+     * each channel.
+     */
+    static void InterleaveToBigEndian(TByte* aDst, const TInt32* const aSrc[], TUint aNumChannels,
+                                      TUint aStartSample, TUint aNumSamples, TUint aBitDepth);
+    /*
+     * Interleave per-channel arrays of signed fixed point values (aFracBits fractional bits,
+     * so +/-1.0 is +/-(1<<aFracBits)) into 24-bit big endian PCM.  Values outside [-1.0..1.0)
+     * are clipped; remaining bits are truncated.
+     */
+    static void InterleaveFixedToBigEndian24(TByte* aDst, const TInt32* const aSrc[], TUint aNumChannels,
+                                             TUint aStartSample, TUint aNumSamples, TUint aFracBits);
+public:
+    static EImplementation Implementation();
+    static const TChar* ImplementationName(EImplementation aImpl);
+    static TBool IsSupported(EImplementation aImpl);
+    /*
+     * Override the implementation selected at startup.  For use by tests and benchmarks only.
+     * Asserts if aImpl is not supported by the host.
+     */
+    static void SetImplementation(EImplementation aImpl);
+};
+
+} // namespace Media
+} // namespace OpenHome
@@ -11,6 +11,7 @@
 #include <OpenHome/Private/Debug.h>
 #include <OpenHome/Av/VolumeManager.h>
 
+#include <algorithm>
 #include <limits>
 
 using namespace OpenHome;
@@ -513,6 +514,106 @@ IConfigMessage& ConfigMessageAllocator::Allocate(ConfigText& aText, const Brx& a
 }
 
 
+// ConfigJsonCache
+
+ConfigJsonCache::Entry::Entry()
+    : iLock("CJCE")
+    , iJson(kJsonGranularityBytes)
+    , iValid(false)
+{
+}
+
+void ConfigJsonCache::Entry::Serialise(IConfigMessage& aMessage)
+{
+    iJson.Reset();
+    aMessage.Send(iJson);
+    aMessage.Destroy();
+}
+
+TBool ConfigJsonCache::Entry::Matches(const Brx& aValue, const Brx& aLanguageTag) const
+{
+    return iValid && iValue == aValue && iLanguageTag == aLanguageTag;
+}
+
+void ConfigJsonCache::Entry::SetValue(const Brx& aValue, const Brx& aLanguageTag)
+{
+    if (iValue.MaxBytes() < aValue.Bytes()) {
+        iValue.Grow(aValue.Bytes());
+    }
+    iValue.Replace(aValue);
+    if (iLanguageTag.MaxBytes() < aLanguageTag.Bytes()) {
+        iLanguageTag.Grow(aLanguageTag.Bytes());
+    }
+    iLanguageTag.Replace(aLanguageTag);
+    iValid = true;
+}
+
+ConfigJsonCache::ConfigJsonCache(IConfigMessageAllocator& aMsgAllocator)
+    : iMsgAllocator(aMsgAllocator)
+{
+}
+
+ConfigJsonCache::~ConfigJsonCache()
+{
+    for (EntryMap::iterator it = iEntries.begin(); it != iEntries.end(); ++it) {
+        delete it->second;
+    }
+}
+
+void ConfigJsonCache::Add(const Brx& aKey)
+{
+    // aKey must remain valid for lifetime of this.
+    ASSERT(iEntries.find(Brn(aKey)) == iEntries.end());
+    iEntries.insert(std::pair<Brn, Entry*>(Brn(aKey), new Entry()));
+}
+
+void ConfigJsonCache::WriteNum(IWriter& aWriter, ConfigNum& aNum, TInt aValue, const Brx& aAdditionalJson)
+{
+    Entry& entry = Find(aNum.Key());
+    Bws<Ascii::kMaxIntStringBytes> value;
+    Ascii::AppendDec(value, aValue);
+    AutoMutex a(entry.iLock);
+    if (!entry.Matches(value, Brx::Empty())) {
+        entry.Serialise(iMsgAllocator.Allocate(aNum, aValue, aAdditionalJson));
+        entry.SetValue(value, Brx::Empty());
+    }
+    aWriter.Write(entry.iJson.Buffer());
+}
+
+void ConfigJsonCache::WriteChoice(IWriter& aWriter, ConfigChoice& aChoice, TUint aValue, const Brx& aAdditionalJson, std::vector<const Brx*>& aLanguageList, const Brx& aLanguageTag)
+{
+    Entry& entry = Find(aChoice.Key());
+    Bws<Ascii::kMaxUintStringBytes> value;
+    Ascii::AppendDec(value, aValue);
+    AutoMutex a(entry.iLock);
+    /* Options written by a custom mapper (e.g. source names for the startup source) can
+       change without the choice's value changing, so are never served from the cache. */
+    if (aChoice.HasInternalMapping() || !entry.Matches(value, aLanguageTag)) {
+        entry.Serialise(iMsgAllocator.Allocate(aChoice, aValue, aAdditionalJson, aLanguageList));
+        entry.SetValue(value, aLanguageTag);
+    }
+    aWriter.Write(entry.iJson.Buffer());
+}
+
+void ConfigJsonCache::WriteText(IWriter& aWriter, ConfigText& aText, const Brx& aValue, const Brx& aAdditionalJson)
+{
+    Entry& entry = Find(aText.Key());
+    AutoMutex a(entry.iLock);
+    if (!entry.Matches(aValue, Brx::Empty())) {
+        entry.Serialise(iMsgAllocator.Allocate(aText, aValue, aAdditionalJson));
+        entry.SetValue(aValue, Brx::Empty());
+    }
+    aWriter.Write(entry.iJson.Buffer());
+}
+
+ConfigJsonCache::Entry& ConfigJsonCache::Find(const Brx& aKey)
+{
+    EntryMap::iterator it = iEntries.find(Brn(aKey));
+    ASSERT(it != iEntries.end());
+    return *it->second;
+}
+
+
 // JsonStringParser
 
 Brn JsonStringParser::ParseString(const Brx& aBuffer, Brn& aRemaining)
@@ -660,17 +761,47 @@ void JsonKvpString::SerialiseValue(IWriter& aWriter) const
 }
 
 
+// ConfigTabUpdate
+
+ConfigTabUpdate::ConfigTabUpdate(IConfigTabUpdateHandler& aHandler)
+    : iHandler(aHandler)
+    , iSent(false)
+{
+}
+
+void ConfigTabUpdate::Queued()
+{
+    iSent = false;
+}
+
+void ConfigTabUpdate::Send(IWriter& aWriter)
+{
+    iSent = true;
+    iHandler.WriteUpdates(aWriter);
+}
+
+void ConfigTabUpdate::Destroy()
+{
+    iHandler.UpdateDestroyed(iSent);
+}
+
+
 // ConfigTab
 
 const TUint ConfigTab::kInvalidSubscription = OpenHome::Configuration::IConfigManager::kSubscriptionIdInvalid;
 
-ConfigTab::ConfigTab(TUint aId, IConfigMessageAllocator& aMessageAllocator, IConfigManager& aConfigManager, IJsonProvider& aJsonProvider)
+ConfigTab::ConfigTab(TUint aId, ConfigJsonCache& aJsonCache, IConfigManager& aConfigManager, IJsonProvider& aJsonProvider)
     : iId(aId)
-    , iMsgAllocator(aMessageAllocator)
+    , iJsonCache(aJsonCache)
     , iConfigManager(aConfigManager)
     , iJsonProvider(aJsonProvider)
     , iHandler(nullptr)
     , iStarted(false)
+    , iLockUpdates("CTUL")
+    , iUpdate1(*this)
+    , iUpdate2(*this)
+    , iUpdateNext(&iUpdate1)
+    , iUpdateQueued(false)
 {
 }
 
@@ -679,24 +810,30 @@ ConfigTab::~ConfigTab()
     if (iHandler != nullptr) {
         Destroy();
     }
+    for (TUint i=0; i<iValuesText.size(); i++) {
+        delete iValuesText[i];
+    }
 }
 
 void ConfigTab::AddKeyNum(const Brx& aKey)
 {
     ASSERT(!iStarted);
     iConfigNums.push_back(SubscriptionPair(Brn(aKey),kInvalidSubscription));
+    iValuesNum.push_back(0);
 }
 
 void ConfigTab::AddKeyChoice(const Brx& aKey)
 {
     ASSERT(!iStarted);
     iConfigChoices.push_back(SubscriptionPair(Brn(aKey),kInvalidSubscription));
+    iValuesChoice.push_back(0);
 }
 
 void ConfigTab::AddKeyText(const Brx& aKey)
 {
     ASSERT(!iStarted);
     iConfigTexts.push_back(SubscriptionPair(Brn(aKey),kInvalidSubscription));
+    iValuesText.push_back(new Bwh(ConfigText::kMaxBytes));
 }
 
 // FIXME - remove?
@@ -718,7 +855,24 @@ void ConfigTab::SetHandler(ITabHandler& aHandler, const std::vector<const Brx*>&
     LOG(kHttp, "ConfigTab::SetHandler iId: %u\n", iId);
     ASSERT(iHandler == nullptr);
     iLanguageList = aLanguageList;
+
+    // Identifies the language list to ConfigJsonCache, which only re-serialises
+    // choice options if they were last written for a different list.
+    TUint tagBytes = 0;
+    for (TUint i=0; i<iLanguageList.size(); i++) {
+        tagBytes += iLanguageList[i]->Bytes() + 1;
+    }
+    if (iLanguageTag.MaxBytes() < tagBytes) {
+        iLanguageTag.Grow(tagBytes);
+    }
+    iLanguageTag.SetBytes(0);
+    for (TUint i=0; i<iLanguageList.size(); i++) {
+        iLanguageTag.Append(*iLanguageList[i]);
+        iLanguageTag.Append(',');
+    }
+
     iHandler = &aHandler;
+    // Each subscription reports its current value; these are all coalesced into a single update.
     for (TUint i=0; i<iConfigNums.size(); i++) {
         const Brx& key = iConfigNums[i].first;
         ConfigNum& num = iConfigManager.GetNum(key);
@@ -775,6 +929,7 @@ void ConfigTab::Destroy()
     ASSERT(iHandler != nullptr);
     iHandler = nullptr;
 
+    // Must not hold iLockUpdates here; a ConfigVal holds its own lock while calling our callbacks.
     for (TUint i=0; i<iConfigNums.size(); i++) {
         const Brx& key = iConfigNums[i].first;
         ConfigNum& num = iConfigManager.GetNum(key);
@@ -793,36 +948,124 @@ void ConfigTab::Destroy()
         text.Unsubscribe(iConfigTexts[i].second);
         iConfigTexts[i].second = kInvalidSubscription;
     }
+
+    // Tab handler has already been disabled, so won't Send() any update that is still queued.
+    AutoMutex a(iLockUpdates);
+    iPending.clear();
+    iUpdateQueued = false;
+}
+
+void ConfigTab::WriteUpdates(IWriter& aWriter)
+{
+    AutoMutex a(iLockUpdates);
+    // Any change from here on must queue another update.
+    iUpdateQueued = false;
+    for (TUint i=0; i<iPending.size(); i++) {
+        if (i > 0) {
+            aWriter.Write(',');
+        }
+        const TUint index = iPending[i].second;
+        switch (iPending[i].first)
+        {
+        case eNum:
+        {
+            ConfigNum& num = iConfigManager.GetNum(iConfigNums[index].first);
+            iJsonCache.WriteNum(aWriter, num, iValuesNum[index], iJsonProvider.GetJson(num.Key()));
+        }
+            break;
+        case eChoice:
+        {
+            ConfigChoice& choice = iConfigManager.GetChoice(iConfigChoices[index].first);
+            iJsonCache.WriteChoice(aWriter, choice, iValuesChoice[index], iJsonProvider.GetJson(choice.Key()), iLanguageList, iLanguageTag);
+        }
+            break;
+        case eText:
+        {
+            ConfigText& text = iConfigManager.GetText(iConfigTexts[index].first);
+            iJsonCache.WriteText(aWriter, text, *iValuesText[index], iJsonProvider.GetJson(text.Key()));
+        }
+            break;
+        }
+    }
+    // Not cleared if a WriterError is thrown above, so will be retried with the next update.
+    iPending.clear();
+}
+
+void ConfigTab::UpdateDestroyed(TBool aSent)
+{
+    AutoMutex a(iLockUpdates);
+    if (!aSent) {
+        // Dropped by tab handler. Anything pending will go out with the next update.
+        iUpdateQueued = false;
+    }
 }
 
 void ConfigTab::ConfigNumCallback(ConfigNum::KvpNum& aKvp)
 {
     ASSERT(iHandler != nullptr);
-    ConfigNum& num = iConfigManager.GetNum(aKvp.Key());
-    const Brx& json = iJsonProvider.GetJson(aKvp.Key());
-    // FIXME - because JSON is static and now stored in ConfigApp, it means
-    // that ConfigMessages can also now just take a reference to the JSON
-    // instead of copying it.
-    IConfigMessage& msg = iMsgAllocator.Allocate(num, aKvp.Value(), json);
-    iHandler->Send(msg);
+    const TUint index = Index(iConfigNums, aKvp.Key());
+    iLockUpdates.Wait();
+    iValuesNum[index] = aKvp.Value();
+    ConfigTabUpdate* update = SetPendingLocked(eNum, index);
+    iLockUpdates.Signal();
+    if (update != nullptr) {
+        iHandler->Send(*update);
+    }
 }
 
 void ConfigTab::ConfigChoiceCallback(ConfigChoice::KvpChoice& aKvp)
 {
     ASSERT(iHandler != nullptr);
-    ConfigChoice& choice = iConfigManager.GetChoice(aKvp.Key());
-    const Brx& json = iJsonProvider.GetJson(aKvp.Key());
-    IConfigMessage& msg = iMsgAllocator.Allocate(choice, aKvp.Value(), json, iLanguageList);
-    iHandler->Send(msg);
+    const TUint index = Index(iConfigChoices, aKvp.Key());
+    iLockUpdates.Wait();
+    iValuesChoice[index] = aKvp.Value();
+    ConfigTabUpdate* update = SetPendingLocked(eChoice, index);
+    iLockUpdates.Signal();
+    if (update != nullptr) {
+        iHandler->Send(*update);
+    }
 }
 
 void ConfigTab::ConfigTextCallback(ConfigText::KvpText& aKvp)
 {
     ASSERT(iHandler != nullptr);
-    ConfigText& text = iConfigManager.GetText(aKvp.Key());
-    const Brx& json = iJsonProvider.GetJson(aKvp.Key());
-    IConfigMessage& msg = iMsgAllocator.Allocate(text, aKvp.Value(), json);
-    iHandler->Send(msg);
+    const TUint index = Index(iConfigTexts, aKvp.Key());
+    iLockUpdates.Wait();
+    iValuesText[index]->Replace(aKvp.Value());
+    ConfigTabUpdate* update = SetPendingLocked(eText, index);
+    iLockUpdates.Signal();
+    if (update != nullptr) {
+        iHandler->Send(*update);
+    }
+}
+
+ConfigTabUpdate* ConfigTab::SetPendingLocked(EValType aType, TUint aIndex)
+{
+    // Returns update that caller must pass to iHandler (after releasing
+    // iLockUpdates), or nullptr if an update is already queued.
+    const PendingUpdate pending(aType, aIndex);
+    if (std::find(iPending.begin(), iPending.end(), pending) == iPending.end()) {
+        iPending.push_back(pending);
+    }
+    if (iUpdateQueued) {
+        return nullptr;
+    }
+    iUpdateQueued = true;
+    ConfigTabUpdate* update = iUpdateNext;
+    iUpdateNext = (iUpdateNext == &iUpdate1? &iUpdate2 : &iUpdate1);
+    update->Queued();
+    return update;
+}
+
+TUint ConfigTab::Index(const SubscriptionVector& aVector, const Brx& aKey)
+{
+    for (TUint i=0; i<aVector.size(); i++) {
+        if (aVector[i].first == aKey) {
+            return i;
+        }
+    }
+    ASSERTS();
+    return 0;   // unreachable
 }
 
 
@@ -835,6 +1078,7 @@ ConfigAppBase::ConfigAppBase(IConfigManager& aConfigManager, const Brx& aResourc
     : iConfigManager(aConfigManager)
     , iLangResourceDir(aResourceDir.Bytes()+1+kLangRoot.Bytes()+1)  // "<aResourceDir>/<kLangRoot>/"
     , iResourcePrefix(aResourcePrefix)
+    , iResourceCache(aResourceDir)
     , iLock("COAL")
 {
     Log::Print("ConfigAppBase::ConfigAppBase iResourcePrefix: ");
@@ -849,10 +1093,11 @@ ConfigAppBase::ConfigAppBase(IConfigManager& aConfigManager, const Brx& aResourc
     iLangResourceDir.Append('/');
 
     iMsgAllocator = new ConfigMessageAllocator(aSendQueueSize, *this);
+    iJsonCache = new ConfigJsonCache(*iMsgAllocator);
 
     for (TUint i=0; i<aMaxTabs; i++) {
-        iResourceHandlers.push_back(new FileResourceHandler(aResourceDir));
-        iTabs.push_back(new ConfigTab(i, *iMsgAllocator, iConfigManager, *this));
+        iResourceHandlers.push_back(new CachedResourceHandler(iResourceCache));
+        iTabs.push_back(new ConfigTab(i, *iJsonCache, iConfigManager, *this));
     }
 
     for (TUint i=0; i<aMaxTabs; i++) {
@@ -885,6 +1130,7 @@ ConfigAppBase::~ConfigAppBase()
         delete it->second;
     }
 
+    delete iJsonCache;
     delete iMsgAllocator;
 }
 
@@ -921,7 +1167,7 @@ IResourceHandler& ConfigAppBase::CreateResourceHandler(const OpenHome::Brx& aRes
     AutoMutex a(iLock);
     for (TUint i=0; i<iResourceHandlers.size(); i++) {
         if (!iResourceHandlers[i]->Allocated()) {
-            FileResourceHandler& handler = *iResourceHandlers[i];
+            CachedResourceHandler& handler = *iResourceHandlers[i];
             handler.SetResource(aResource);
             return handler;
         }
@@ -974,6 +1220,7 @@ void ConfigAppBase::AddNum(const OpenHome::Brx& aKey, JsonKvpVector& aAdditional
     Brh* key = new Brh(aKey);
     iKeysNums.push_back(key);
     AddJson(*key, aAdditionalInfo);
+    iJsonCache->Add(*key);
 
     for (TUint i=0; i<iTabs.size(); i++) {
         iTabs[i]->AddKeyNum(*key);
@@ -985,6 +1232,7 @@ void ConfigAppBase::AddChoice(const OpenHome::Brx& aKey, JsonKvpVector& aAdditio
     Brh* key = new Brh(aKey);
     iKeysChoices.push_back(key);
     AddJson(*key, aAdditionalInfo);
+    iJsonCache->Add(*key);
 
     for (TUint i=0; i<iTabs.size(); i++) {
         iTabs[i]->AddKeyChoice(*key);
@@ -996,6 +1244,7 @@ void ConfigAppBase::AddText(const OpenHome::Brx& aKey, JsonKvpVector& aAdditiona
     Brh* key = new Brh(aKey);
     iKeysTexts.push_back(key);
     AddJson(*key, aAdditionalInfo);
+    iJsonCache->Add(*key);
 
     for (TUint i=0; i<iTabs.size(); i++) {
         iTabs[i]->AddKeyText(*key);
@@ -1086,7 +1335,9 @@ ConfigAppMediaPlayer::ConfigAppMediaPlayer(IConfigManager& aConfigManager, const
     AddNumConditional(VolumeConfig::kKeyLimit, emptyJsonVector);
     AddNumConditional(VolumeConfig::kKeyStartupValue, emptyJsonVector);
 
+    AddChoiceConditional(Brn("Sender.Compression"), emptyJsonVector);
     AddChoiceConditional(Brn("Sender.Enabled"), emptyJsonVector);
+    AddChoiceConditional(Brn("Sender.ErrorCorrection"), emptyJsonVector);
     AddChoiceConditional(Brn("Sender.Mode"), emptyJsonVector);
     AddChoiceConditional(Brn("Source.NetAux.Auto"), emptyJsonVector);
     AddChoiceConditional(Av::VolumeConfig::kKeyStartupEnabled, emptyJsonVector);
@@ -5,8 +5,13 @@
 #include <OpenHome/Web/WebAppFramework.h>
 #include <OpenHome/Configuration/ConfigManager.h>
 #include <OpenHome/Private/Fifo.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
 #include <OpenHome/Av/Source.h>
 
+#include <map>
+#include <vector>
+
 EXCEPTION(LanguageResourceInvalid);
 EXCEPTION(JsonStringError);
 
@@ -246,6 +251,49 @@ private:
     ConfigMessageTextAllocator iAllocatorText;
 };
 
+/*
+ * Pre-serialised JSON for each ConfigVal, shared by all ConfigTabs.
+ *
+ * An entry is only re-serialised when it is asked for with a value (or, for a
+ * ConfigChoice, a language list) other than the one it was last written for, so
+ * a change pushed to several tabs is serialised once rather than once per tab.
+ * ConfigChoices with an internal mapper are always re-serialised.
+ * All keys must be Add()ed before any Write*() call.
+ */
+class ConfigJsonCache : private OpenHome::INonCopyable
+{
+private:
+    static const TUint kJsonGranularityBytes = 256;
+    class Entry : private OpenHome::INonCopyable
+    {
+    public:
+        Entry();
+        void Serialise(IConfigMessage& aMessage);
+        TBool Matches(const OpenHome::Brx& aValue, const OpenHome::Brx& aLanguageTag) const;
+        void SetValue(const OpenHome::Brx& aValue, const OpenHome::Brx& aLanguageTag);
+    public:
+        OpenHome::Mutex iLock;
+        OpenHome::WriterBwh iJson;
+    private:
+        TBool iValid;
+        OpenHome::Bwh iValue;
+        OpenHome::Bwh iLanguageTag;
+    };
+    typedef std::map<OpenHome::Brn, Entry*, OpenHome::BufferCmp> EntryMap;
+public:
+    ConfigJsonCache(IConfigMessageAllocator& aMsgAllocator);
+    ~ConfigJsonCache();
+    void Add(const OpenHome::Brx& aKey);
+    void WriteNum(OpenHome::IWriter& aWriter, OpenHome::Configuration::ConfigNum& aNum, TInt aValue, const OpenHome::Brx& aAdditionalJson);
+    void WriteChoice(OpenHome::IWriter& aWriter, OpenHome::Configuration::ConfigChoice& aChoice, TUint aValue, const OpenHome::Brx& aAdditionalJson, std::vector<const Brx*>& aLanguageList, const OpenHome::Brx& aLanguageTag);
+    void WriteText(OpenHome::IWriter& aWriter, OpenHome::Configuration::ConfigText& aText, const OpenHome::Brx& aValue, const OpenHome::Brx& aAdditionalJson);
+private:
+    Entry& Find(const OpenHome::Brx& aKey);
+private:
+    IConfigMessageAllocator& iMsgAllocator;
+    EntryMap iEntries;
+};
+
 class JsonStringParser
 {
 public:
@@ -326,14 +374,54 @@ public:
     virtual ~IJsonProvider() {}
 };
 
-class ConfigTab : public ConfigTabReceiver, public OpenHome::INonCopyable
+class IConfigTabUpdateHandler
+{
+public:
+    virtual void WriteUpdates(OpenHome::IWriter& aWriter) = 0;
+    virtual void UpdateDestroyed(TBool aSent) = 0;
+    virtual ~IConfigTabUpdateHandler() {}
+};
+
+/**
+ * Msg that writes out all ConfigVals that have changed in a ConfigTab since its
+ * last update was sent. The JSON objects are comma-separated so that, like
+ * any other ITabMessage, they form part of a single array in a long poll response.
+ */
+class ConfigTabUpdate : public ITabMessage, private OpenHome::INonCopyable
+{
+public:
+    ConfigTabUpdate(IConfigTabUpdateHandler& aHandler);
+    void Queued();
+public: // from ITabMessage
+    void Send(OpenHome::IWriter& aWriter) override;
+    void Destroy() override;
+private:
+    IConfigTabUpdateHandler& iHandler;
+    TBool iSent;
+};
+
+/**
+ * Changes to ConfigVals are coalesced rather than each being queued as a
+ * separate msg. At most one ConfigTabUpdate is queued with the tab handler at
+ * any time; a value that changes again before it is sent just has its pending
+ * value replaced. A second ConfigTabUpdate allows the next update to be queued
+ * while the previous one is still being written out.
+ */
+class ConfigTab : public ConfigTabReceiver, private IConfigTabUpdateHandler, public OpenHome::INonCopyable
 {
 private:
     static const TUint kInvalidSubscription;
     typedef std::pair<OpenHome::Brn,TUint> SubscriptionPair;
     typedef std::vector<SubscriptionPair> SubscriptionVector;
+    enum EValType
+    {
+        eNum,
+        eChoice,
+        eText
+    };
+    typedef std::pair<EValType,TUint> PendingUpdate;   // type and index into SubscriptionVector of that type
 public:
-    ConfigTab(TUint aId, IConfigMessageAllocator& aMessageAllocator, OpenHome::Configuration::IConfigManager& aConfigManager, IJsonProvider& aJsonProvider);
+    ConfigTab(TUint aId, ConfigJsonCache& aJsonCache, OpenHome::Configuration::IConfigManager& aConfigManager, IJsonProvider& aJsonProvider);
     ~ConfigTab();
     void AddKeyNum(const OpenHome::Brx& aKey);
     void AddKeyChoice(const OpenHome::Brx& aKey);
@@ -344,13 +432,18 @@ public:
 private: // from ConfigTabReceiver
     void Receive(const OpenHome::Brx& aKey, const OpenHome::Brx& aValue);
     void Destroy();
+private: // from IConfigTabUpdateHandler
+    void WriteUpdates(OpenHome::IWriter& aWriter) override;
+    void UpdateDestroyed(TBool aSent) override;
 private:
     void ConfigNumCallback(OpenHome::Configuration::ConfigNum::KvpNum& aKvp);
     void ConfigChoiceCallback(OpenHome::Configuration::ConfigChoice::KvpChoice& aKvp);
     void ConfigTextCallback(OpenHome::Configuration::ConfigText::KvpText& aKvp);
+    ConfigTabUpdate* SetPendingLocked(EValType aType, TUint aIndex);
+    static TUint Index(const SubscriptionVector& aVector, const OpenHome::Brx& aKey);
 private:
     const TUint iId;
-    IConfigMessageAllocator& iMsgAllocator;
+    ConfigJsonCache& iJsonCache;
     OpenHome::Configuration::IConfigManager& iConfigManager;
     IJsonProvider& iJsonProvider;
     ITabHandler* iHandler;
@@ -359,6 +452,16 @@ private:
     SubscriptionVector iConfigTexts;
     TBool iStarted;
     std::vector<const Brx*> iLanguageList;
+    OpenHome::Bwh iLanguageTag;
+    OpenHome::Mutex iLockUpdates;
+    std::vector<TInt> iValuesNum;
+    std::vector<TUint> iValuesChoice;
+    std::vector<OpenHome::Bwh*> iValuesText;
+    std::vector<PendingUpdate> iPending;
+    ConfigTabUpdate iUpdate1;
+    ConfigTabUpdate iUpdate2;
+    ConfigTabUpdate* iUpdateNext;
+    TBool iUpdateQueued;
 };
 
 class IConfigApp : public IWebApp
@@ -403,9 +506,11 @@ protected:
     OpenHome::Configuration::IConfigManager& iConfigManager;
 private:
     ConfigMessageAllocator* iMsgAllocator;
+    ConfigJsonCache* iJsonCache;
     Bwh iLangResourceDir;
     const OpenHome::Bws<kMaxResourcePrefixBytes> iResourcePrefix;
-    std::vector<FileResourceHandler*> iResourceHandlers;
+    ResourceCache iResourceCache;
+    std::vector<CachedResourceHandler*> iResourceHandlers;
     std::vector<LanguageResourceFileReader*> iLanguageResourceHandlers;
     std::vector<ConfigTab*> iTabs;
     KeyVector iKeysNums;
@@ -4,6 +4,7 @@
 #include <OpenHome/Net/Core/CpDeviceUpnp.h>
 #include <OpenHome/Net/Private/CpiStack.h>
 #include <OpenHome/Net/Private/DviStack.h>
+#include <OpenHome/Private/Ascii.h>
 #include <OpenHome/Private/Parser.h>
 #include <OpenHome/Private/Stream.h>
 #include <OpenHome/Private/Uri.h>
@@ -221,6 +222,81 @@ private:
     ConfigMessageTextAllocator* iMessageAllocator;
 };
 
+class HelperConfigMessageAllocatorCounting : public IConfigMessageAllocator, private INonCopyable
+{
+public:
+    HelperConfigMessageAllocatorCounting(ILanguageResourceManager& aLanguageResourceManager);
+    TUint Allocated() const;
+public: // from IConfigMessageAllocator
+    IConfigMessage& Allocate(Configuration::ConfigNum& aNum, TInt aValue, const Brx& aAdditionalJson) override;
+    IConfigMessage& Allocate(Configuration::ConfigChoice& aChoice, TUint aValue, const Brx& aAdditionalJson, std::vector<const Brx*>& aLanguageList) override;
+    IConfigMessage& Allocate(Configuration::ConfigText& aText, const Brx& aValue, const Brx& aAdditionalJson) override;
+private:
+    ConfigMessageAllocator iAllocator;
+    TUint iAllocated;
+};
+
+class HelperTabHandler : public ITabHandler
+{
+public:
+    TUint MsgCount() const;
+    void SendAndDestroy(IWriter& aWriter);
+    void DestroyUnsent();
+public: // from ITabHandler
+    void Send(ITabMessage& aMessage) override;
+private:
+    std::vector<ITabMessage*> iMsgs;
+};
+
+class HelperJsonProviderEmpty : public IJsonProvider
+{
+public: // from IJsonProvider
+    const Brx& GetJson(const Brx& aKey) override;
+};
+
+class HelperChoiceMapperNames : public Configuration::IConfigChoiceMapper
+{
+public:
+    static const TUint kMaxNameBytes = 20;
+public:
+    HelperChoiceMapperNames();
+    void SetName(TUint aChoice, const Brx& aName);
+public: // from IConfigChoiceMapper
+    void Write(IWriter& aWriter, Configuration::IConfigChoiceMappingWriter& aMappingWriter) override;
+private:
+    Bws<kMaxNameBytes> iNames[2];
+};
+
+class SuiteConfigTab : public TestFramework::SuiteUnitTest
+{
+private:
+    static const TUint kMaxMsgBytes = 1024;
+public:
+    SuiteConfigTab();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestInitialValuesCoalesced();
+    void TestChangesCoalesced();
+    void TestUpdateDroppedRequeued();
+    void TestJsonCacheShared();
+    void TestJsonCacheChoiceMapperRenamed();
+private:
+    Configuration::ConfigRamStore* iStore;
+    Configuration::ConfigManager* iConfigManager;
+    Configuration::ConfigNum* iConfigNum;
+    Configuration::ConfigText* iConfigText;
+    HelperChoiceMapperNames iMapper;
+    Configuration::ConfigChoice* iConfigChoiceMapped;
+    Bws<1> iLanguageMap;
+    HelperLanguageResourceManager* iResourceManager;
+    HelperConfigMessageAllocatorCounting* iMessageAllocator;
+    ConfigJsonCache* iJsonCache;
+    HelperJsonProviderEmpty iJsonProvider;
+    std::vector<const Brx*> iLanguages;
+};
+
 class SuiteConfigUiMediaPlayer : public SuiteConfigUi
 {
 public:
@@ -963,6 +1039,278 @@ void SuiteConfigMessageText::TestSendAdditional()
 }
 
 
+// HelperConfigMessageAllocatorCounting
+
+HelperConfigMessageAllocatorCounting::HelperConfigMessageAllocatorCounting(ILanguageResourceManager& aLanguageResourceManager)
+    : iAllocator(1, aLanguageResourceManager)
+    , iAllocated(0)
+{
+}
+
+TUint HelperConfigMessageAllocatorCounting::Allocated() const
+{
+    return iAllocated;
+}
+
+IConfigMessage& HelperConfigMessageAllocatorCounting::Allocate(Configuration::ConfigNum& aNum, TInt aValue, const Brx& aAdditionalJson)
+{
+    iAllocated++;
+    return iAllocator.Allocate(aNum, aValue, aAdditionalJson);
+}
+
+IConfigMessage& HelperConfigMessageAllocatorCounting::Allocate(Configuration::ConfigChoice& aChoice, TUint aValue, const Brx& aAdditionalJson, std::vector<const Brx*>& aLanguageList)
+{
+    iAllocated++;
+    return iAllocator.Allocate(aChoice, aValue, aAdditionalJson, aLanguageList);
+}
+
+IConfigMessage& HelperConfigMessageAllocatorCounting::Allocate(Configuration::ConfigText& aText, const Brx& aValue, const Brx& aAdditionalJson)
+{
+    iAllocated++;
+    return iAllocator.Allocate(aText, aValue, aAdditionalJson);
+}
+
+
+// HelperTabHandler
+
+TUint HelperTabHandler::MsgCount() const
+{
+    return iMsgs.size();
+}
+
+void HelperTabHandler::SendAndDestroy(IWriter& aWriter)
+{
+    // Output in the same form as FrameworkTabHandler::LongPoll().
+    aWriter.Write(Brn("["));
+    for (TUint i=0; i<iMsgs.size(); i++) {
+        iMsgs[i]->Send(aWriter);
+        if (i < iMsgs.size()-1) {
+            aWriter.Write(Brn(","));
+        }
+        iMsgs[i]->Destroy();
+    }
+    aWriter.Write(Brn("]"));
+    iMsgs.clear();
+}
+
+void HelperTabHandler::DestroyUnsent()
+{
+    for (TUint i=0; i<iMsgs.size(); i++) {
+        iMsgs[i]->Destroy();
+    }
+    iMsgs.clear();
+}
+
+void HelperTabHandler::Send(ITabMessage& aMessage)
+{
+    iMsgs.push_back(&aMessage);
+}
+
+
+// HelperJsonProviderEmpty
+
+const Brx& HelperJsonProviderEmpty::GetJson(const Brx& /*aKey*/)
+{
+    return Brx::Empty();
+}
+
+
+// HelperChoiceMapperNames
+
+HelperChoiceMapperNames::HelperChoiceMapperNames()
+{
+    iNames[0].Replace("Playlist");
+    iNames[1].Replace("Radio");
+}
+
+void HelperChoiceMapperNames::SetName(TUint aChoice, const Brx& aName)
+{
+    iNames[aChoice].Replace(aName);
+}
+
+void HelperChoiceMapperNames::Write(IWriter& aWriter, Configuration::IConfigChoiceMappingWriter& aMappingWriter)
+{
+    for (TUint i=0; i<2; i++) {
+        aMappingWriter.Write(aWriter, i, iNames[i]);
+    }
+    aMappingWriter.WriteComplete(aWriter);
+}
+
+
+// SuiteConfigTab
+
+SuiteConfigTab::SuiteConfigTab()
+    : SuiteUnitTest("SuiteConfigTab")
+{
+    AddTest(MakeFunctor(*this, &SuiteConfigTab::TestInitialValuesCoalesced), "TestInitialValuesCoalesced");
+    AddTest(MakeFunctor(*this, &SuiteConfigTab::TestChangesCoalesced), "TestChangesCoalesced");
+    AddTest(MakeFunctor(*this, &SuiteConfigTab::TestUpdateDroppedRequeued), "TestUpdateDroppedRequeued");
+    AddTest(MakeFunctor(*this, &SuiteConfigTab::TestJsonCacheShared), "TestJsonCacheShared");
+    AddTest(MakeFunctor(*this, &SuiteConfigTab::TestJsonCacheChoiceMapperRenamed), "TestJsonCacheChoiceMapperRenamed");
+}
+
+void SuiteConfigTab::Setup()
+{
+    iStore = new Configuration::ConfigRamStore();
+    iConfigManager = new ConfigManager(*iStore);
+    iConfigNum = new ConfigNum(*iConfigManager, Brn("Config.Num.Key"), 0, 10, 1);
+    iConfigText = new ConfigText(*iConfigManager, Brn("Config.Text.Key"), 25, Brn("abc"));
+    std::vector<TUint> choices;
+    choices.push_back(0);
+    choices.push_back(1);
+    iMapper.SetName(0, Brn("Playlist"));
+    iMapper.SetName(1, Brn("Radio"));
+    iConfigChoiceMapped = new ConfigChoice(*iConfigManager, Brn("Config.Choice.Mapped"), choices, 0, iMapper);
+    iResourceManager = new HelperLanguageResourceManager(iLanguageMap);
+    iMessageAllocator = new HelperConfigMessageAllocatorCounting(*iResourceManager);
+    iJsonCache = new ConfigJsonCache(*iMessageAllocator);
+    iJsonCache->Add(iConfigNum->Key());
+    iJsonCache->Add(iConfigText->Key());
+    iJsonCache->Add(iConfigChoiceMapped->Key());
+}
+
+void SuiteConfigTab::TearDown()
+{
+    delete iJsonCache;
+    delete iMessageAllocator;
+    delete iResourceManager;
+    delete iConfigChoiceMapped;
+    delete iConfigText;
+    delete iConfigNum;
+    delete iConfigManager;
+    delete iStore;
+}
+
+void SuiteConfigTab::TestInitialValuesCoalesced()
+{
+    // Subscribing reports every value. These should go out as a single msg.
+    HelperTabHandler handler;
+    ConfigTab tab(0, *iJsonCache, *iConfigManager, iJsonProvider);
+    tab.AddKeyNum(iConfigNum->Key());
+    tab.AddKeyText(iConfigText->Key());
+    tab.SetHandler(handler, iLanguages);
+    TEST(handler.MsgCount() == 1);
+
+    Bws<kMaxMsgBytes> buf;
+    WriterBuffer writerBuffer(buf);
+    handler.SendAndDestroy(writerBuffer);
+    Bws<kMaxMsgBytes> expectedBuf("["
+        "{\"key\":\"Config.Num.Key\",\"value\":1,\"type\":\"numeric\",\"meta\":{\"min\":0,\"max\":10}},"
+        "{\"key\":\"Config.Text.Key\",\"value\":\"abc\",\"type\":\"text\",\"meta\":{\"maxlength\":25}}"
+        "]");
+    TEST(buf == expectedBuf);
+}
+
+void SuiteConfigTab::TestChangesCoalesced()
+{
+    HelperTabHandler handler;
+    ConfigTab tab(0, *iJsonCache, *iConfigManager, iJsonProvider);
+    tab.AddKeyNum(iConfigNum->Key());
+    tab.AddKeyText(iConfigText->Key());
+    tab.SetHandler(handler, iLanguages);
+    Bws<kMaxMsgBytes> buf;
+    WriterBuffer writerBuffer(buf);
+    handler.SendAndDestroy(writerBuffer);
+    buf.SetBytes(0);
+
+    // Only latest value of each ConfigVal should be output, in a single msg.
+    iConfigNum->Set(2);
+    iConfigNum->Set(3);
+    TEST(handler.MsgCount() == 1);
+    handler.SendAndDestroy(writerBuffer);
+    Bws<kMaxMsgBytes> expectedBuf("["
+        "{\"key\":\"Config.Num.Key\",\"value\":3,\"type\":\"numeric\",\"meta\":{\"min\":0,\"max\":10}}"
+        "]");
+    TEST(buf == expectedBuf);
+
+    // No further msg until something changes again.
+    TEST(handler.MsgCount() == 0);
+    iConfigText->Set(Brn("def"));
+    TEST(handler.MsgCount() == 1);
+    handler.DestroyUnsent();
+}
+
+void SuiteConfigTab::TestUpdateDroppedRequeued()
+{
+    HelperTabHandler handler;
+    ConfigTab tab(0, *iJsonCache, *iConfigManager, iJsonProvider);
+    tab.AddKeyNum(iConfigNum->Key());
+    tab.AddKeyText(iConfigText->Key());
+    tab.SetHandler(handler, iLanguages);
+    TEST(handler.MsgCount() == 1);
+
+    // Destroy update without sending it (as a disabled tab handler would).
+    // Next change must queue a new update, which also outputs the dropped values.
+    handler.DestroyUnsent();
+    iConfigNum->Set(4);
+    TEST(handler.MsgCount() == 1);
+    Bws<kMaxMsgBytes> buf;
+    WriterBuffer writerBuffer(buf);
+    handler.SendAndDestroy(writerBuffer);
+    Bws<kMaxMsgBytes> expectedBuf("["
+        "{\"key\":\"Config.Num.Key\",\"value\":4,\"type\":\"numeric\",\"meta\":{\"min\":0,\"max\":10}},"
+        "{\"key\":\"Config.Text.Key\",\"value\":\"abc\",\"type\":\"text\",\"meta\":{\"maxlength\":25}}"
+        "]");
+    TEST(buf == expectedBuf);
+}
+
+void SuiteConfigTab::TestJsonCacheShared()
+{
+    // Same value pushed to two tabs should only be serialised once.
+    HelperTabHandler handler1;
+    HelperTabHandler handler2;
+    ConfigTab tab1(0, *iJsonCache, *iConfigManager, iJsonProvider);
+    ConfigTab tab2(1, *iJsonCache, *iConfigManager, iJsonProvider);
+    tab1.AddKeyNum(iConfigNum->Key());
+    tab2.AddKeyNum(iConfigNum->Key());
+    tab1.SetHandler(handler1, iLanguages);
+    tab2.SetHandler(handler2, iLanguages);
+
+    Bws<kMaxMsgBytes> buf1;
+    WriterBuffer writerBuffer1(buf1);
+    Bws<kMaxMsgBytes> buf2;
+    WriterBuffer writerBuffer2(buf2);
+    handler1.SendAndDestroy(writerBuffer1);
+    handler2.SendAndDestroy(writerBuffer2);
+    TEST(iMessageAllocator->Allocated() == 1);
+    TEST(buf1 == buf2);
+
+    // A change invalidates the cached JSON.
+    iConfigNum->Set(5);
+    handler1.SendAndDestroy(writerBuffer1);
+    handler2.SendAndDestroy(writerBuffer2);
+    TEST(iMessageAllocator->Allocated() == 2);
+    TEST(buf1 == buf2);
+}
+
+void SuiteConfigTab::TestJsonCacheChoiceMapperRenamed()
+{
+    // Renaming a source changes a mapper's output without changing the choice's value.
+    // A tab subscribing after the rename must see the new name, not cached JSON.
+    HelperTabHandler handler1;
+    ConfigTab tab1(0, *iJsonCache, *iConfigManager, iJsonProvider);
+    tab1.AddKeyChoice(iConfigChoiceMapped->Key());
+    tab1.SetHandler(handler1, iLanguages);
+    Bws<kMaxMsgBytes> buf;
+    WriterBuffer writerBuffer(buf);
+    handler1.SendAndDestroy(writerBuffer);
+    TEST(Ascii::Contains(buf, Brn("\"value\": \"Radio\"")));
+
+    iMapper.SetName(1, Brn("Internet Radio"));
+    HelperTabHandler handler2;
+    ConfigTab tab2(1, *iJsonCache, *iConfigManager, iJsonProvider);
+    tab2.AddKeyChoice(iConfigChoiceMapped->Key());
+    tab2.SetHandler(handler2, iLanguages);
+    buf.SetBytes(0);
+    handler2.SendAndDestroy(writerBuffer);
+    Bws<kMaxMsgBytes> expectedBuf("["
+        "{\"key\":\"Config.Choice.Mapped\",\"value\":0,\"type\":\"choice\",\"meta\":{\"options\":["
+        "{\"id\": 0,\"value\": \"Playlist\"},{\"id\": 1,\"value\": \"Internet Radio\"}]}}"
+        "]");
+    TEST(buf == expectedBuf);
+}
+
+
 // SuiteConfigUi
 
 // FIXME - take resource dir as param
@@ -1160,6 +1508,7 @@ void TestConfigUi(CpStack& aCpStack, DvStack& aDvStack)
     runner.Add(new SuiteConfigMessageNum());
     runner.Add(new SuiteConfigMessageChoice());
     runner.Add(new SuiteConfigMessageText());
+    runner.Add(new SuiteConfigTab());
     // FIXME - SuiteConfigUi currently only works on desktop platforms.
 #if defined(_WIN32) || defined(__linux__) || (defined(__APPLE__) && defined(__MACH__))
     runner.Add(new SuiteConfigUiMediaPlayer(aCpStack, aDvStack));
@@ -0,0 +1,1186 @@
+#include <OpenHome/Web/HttpServerEpoll.h>
+
+#if defined(__linux__)
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/OsWrapper.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Parser.h>
+#include <OpenHome/Private/Debug.h>
+#include <OpenHome/Private/Network.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace OpenHome;
+using namespace OpenHome::Web;
+
+
+// HttpServerEpoll::ResponseWriter
+
+HttpServerEpoll::ResponseWriter::ResponseWriter()
+    : iBuf(new Bwh(kMaxResponseBytes))
+{
+}
+
+HttpServerEpoll::ResponseWriter::~ResponseWriter()
+{
+    delete iBuf;
+}
+
+const Brx& HttpServerEpoll::ResponseWriter::Buffer() const
+{
+    return *iBuf;
+}
+
+void HttpServerEpoll::ResponseWriter::Reset()
+{
+    if (iBuf->MaxBytes() > kMaxResponseBytes) {
+        delete iBuf;
+        iBuf = new Bwh(kMaxResponseBytes);
+    }
+    else {
+        iBuf->SetBytes(0);
+    }
+}
+
+void HttpServerEpoll::ResponseWriter::Write(TByte aValue)
+{
+    Write(Brn(&aValue, 1));
+}
+
+void HttpServerEpoll::ResponseWriter::Write(const Brx& aBuffer)
+{
+    const TUint bytes = iBuf->Bytes() + aBuffer.Bytes();
+    if (bytes > iBuf->MaxBytes()) {
+        iBuf->Grow(std::max(bytes, 2 * iBuf->MaxBytes()));
+    }
+    iBuf->Append(aBuffer);
+}
+
+void HttpServerEpoll::ResponseWriter::WriteFlush()
+{
+}
+
+
+// HttpServerEpoll::Connection
+
+HttpServerEpoll::Connection::Connection()
+    : iFd(-1)
+    , iState(eFree)
+    , iEvents(0)
+    , iDeadlineMs(0)
+    , iRequestBytes(0)
+    , iResponseOffset(0)
+    , iKeepAlive(false)
+    , iPollSessionId(IFrameworkTab::kInvalidTabId)
+    , iStreaming(false)
+    , iStreamFailed(false)
+    , iSemPieceSent("HSEP", 0)
+{
+}
+
+void HttpServerEpoll::Connection::Open(int aFd)
+{
+    ASSERT(iState == eFree);
+    iFd = aFd;
+    iState = eReading;
+    iEvents = 0;
+    iRequest.SetBytes(0);
+    iRequestBytes = 0;
+    iResponse.Reset();
+    iResponseBody.Set(Brx::Empty());
+    iResponseOffset = 0;
+    iKeepAlive = false;
+    iPollSessionId = IFrameworkTab::kInvalidTabId;
+    iStreaming = false;
+    iStreamFailed = false;
+}
+
+void HttpServerEpoll::Connection::ConsumeRequest()
+{
+    const TUint remaining = iRequest.Bytes() - iRequestBytes;
+    TByte* ptr = const_cast<TByte*>(iRequest.Ptr());
+    (void)memmove(ptr, ptr + iRequestBytes, remaining);
+    iRequest.SetBytes(remaining);
+    iRequestBytes = 0;
+}
+
+
+// HttpServerEpoll::PieceWriter
+
+HttpServerEpoll::PieceWriter::PieceWriter(HttpServerEpoll& aServer)
+    : iServer(aServer)
+    , iConn(nullptr)
+    , iSent(false)
+{
+}
+
+void HttpServerEpoll::PieceWriter::Start(Connection& aConn)
+{
+    iConn = &aConn;
+    iSent = false;
+}
+
+TBool HttpServerEpoll::PieceWriter::Sent() const
+{
+    return iSent;
+}
+
+void HttpServerEpoll::PieceWriter::Write(TByte aValue)
+{
+    Write(Brn(&aValue, 1));
+}
+
+void HttpServerEpoll::PieceWriter::Write(const Brx& aBuffer)
+{
+    ASSERT(iConn != nullptr);
+    ResponseWriter& response = iConn->iResponse;
+    TUint offset = 0;
+    while (offset < aBuffer.Bytes()) {
+        if (response.Buffer().Bytes() >= kMaxResponseBytes) {
+            iServer.SendPiece(*iConn);
+            iSent = true;
+        }
+        TUint bytes = kMaxResponseBytes - response.Buffer().Bytes();
+        if (bytes > aBuffer.Bytes() - offset) {
+            bytes = aBuffer.Bytes() - offset;
+        }
+        response.Write(Brn(aBuffer.Ptr() + offset, bytes));
+        offset += bytes;
+    }
+}
+
+void HttpServerEpoll::PieceWriter::WriteFlush()
+{
+    // Final piece is left in iResponse and sent once the request completes.
+}
+
+
+// HttpServerEpoll::RequestHandler
+
+HttpServerEpoll::RequestHandler::RequestHandler(Environment& aEnv, HttpServerEpoll& aServer, TUint aIndex)
+    : iServer(aServer)
+    , iReaderUntilPreChunker(iReaderBuffer)
+    , iReaderRequest(aEnv, iReaderUntilPreChunker)
+    , iReaderChunked(iReaderUntilPreChunker)
+    , iReaderUntil(iReaderChunked)
+    , iHeaderIfNoneMatch(CachedResource::kHeaderIfNoneMatch)
+    , iHeaderAcceptEncoding(CachedResource::kHeaderAcceptEncoding)
+    , iErrorStatus(&HttpStatus::kOk)
+    , iWriterPiece(aServer)
+    , iWriterChunked(iWriterPiece)
+{
+    iReaderRequest.AddMethod(Http::kMethodGet);
+    iReaderRequest.AddMethod(Http::kMethodPost);
+    iReaderRequest.AddMethod(Http::kMethodHead);
+
+    iReaderRequest.AddHeader(iHeaderHost);
+    iReaderRequest.AddHeader(iHeaderTransferEncoding);
+    iReaderRequest.AddHeader(iHeaderConnection);
+    iReaderRequest.AddHeader(iHeaderAcceptLanguage);
+    iReaderRequest.AddHeader(iHeaderIfNoneMatch);
+    iReaderRequest.AddHeader(iHeaderAcceptEncoding);
+
+    Bws<kMaxThreadNameBytes> name(WebAppFramework::kSessionPrefix);
+    Ascii::AppendDec(name, aIndex+1);
+    iThread = new ThreadFunctor(name.PtrZ(), MakeFunctor(*this, &RequestHandler::Run));
+    iThread->Start();
+}
+
+HttpServerEpoll::RequestHandler::~RequestHandler()
+{
+    // Owner must have made NextRequest() return nullptr.
+    delete iThread;
+}
+
+void HttpServerEpoll::RequestHandler::Run()
+{
+    for (;;) {
+        Connection* conn = iServer.NextRequest();
+        if (conn == nullptr) {
+            return;
+        }
+        Process(*conn);
+        iServer.RequestComplete(*conn);
+    }
+}
+
+void HttpServerEpoll::RequestHandler::Process(Connection& aConn)
+{
+    // Flush before Set(), as flushing the readers also flushes iReaderBuffer.
+    iReaderUntil.ReadFlush();
+    iReaderRequest.Flush();
+    iReaderChunked.SetChunked(false);
+    iReaderBuffer.Set(Brn(aConn.iRequest.Ptr(), aConn.iRequestBytes));
+    iBody.Reset();
+    iErrorStatus = &HttpStatus::kBadRequest;
+    aConn.iKeepAlive = false;
+    aConn.iPollSessionId = IFrameworkTab::kInvalidTabId;
+
+    try {
+        iReaderRequest.Read(kReadTimeoutMs);
+        if (iReaderRequest.MethodNotAllowed()) {
+            Error(HttpStatus::kMethodNotAllowed);
+        }
+        // Request has been framed (by RequestBytes()) so the connection can
+        // be reused whatever happens from here.
+        if (iReaderRequest.Version() == Http::eHttp11) {
+            aConn.iKeepAlive = !iHeaderConnection.Close();
+            if (!iHeaderHost.Received()) {
+                Error(HttpStatus::kBadRequest);
+            }
+        }
+        else {
+            aConn.iKeepAlive = iHeaderConnection.KeepAlive();
+        }
+        iReaderRequest.UnescapeUri();
+        iReaderChunked.SetChunked(iHeaderTransferEncoding.IsChunked());
+
+        const Brx& method = iReaderRequest.Method();
+        LOG(kHttp, "HttpServerEpoll::RequestHandler::Process Method: %.*s, URI: %.*s\n", PBUF(method), PBUF(iReaderRequest.Uri()));
+        if (method == Http::kMethodGet) {
+            Get(aConn, false);
+        }
+        else if (method == Http::kMethodHead) {
+            Get(aConn, true);
+        }
+        else if (method == Http::kMethodPost) {
+            Post(aConn);
+        }
+        return;
+    }
+    catch (ResourceInvalid&) {
+        iErrorStatus = &HttpStatus::kNotFound;
+    }
+    catch (HttpError&) {
+    }
+    catch (ReaderError&) {
+        iErrorStatus = &HttpStatus::kBadRequest;
+    }
+    aConn.iPollSessionId = IFrameworkTab::kInvalidTabId;
+    WriteResponse(aConn, *iErrorStatus, Brx::Empty(), Brx::Empty());
+}
+
+void HttpServerEpoll::RequestHandler::Get(Connection& aConn, TBool aHeadersOnly)
+{
+    IResourceHandler& resourceHandler = iServer.iResourceManager.CreateResourceHandler(iReaderRequest.Uri()); // throws ResourceInvalid
+    const CachedResource* cached = resourceHandler.Cached();
+    if (cached != nullptr) {
+        // Cached content outlives resourceHandler, so can be sent straight from the cache.
+        resourceHandler.Destroy();
+        GetCached(aConn, *cached, aHeadersOnly);
+        return;
+    }
+    GetUncached(aConn, resourceHandler, aHeadersOnly);
+}
+
+void HttpServerEpoll::RequestHandler::GetCached(Connection& aConn, const CachedResource& aResource, TBool aHeadersOnly)
+{
+    const CachedResource::EEncoding encoding = aResource.SelectEncoding(iHeaderAcceptEncoding.Value());
+    const TBool notModified = iHeaderIfNoneMatch.Received() && aResource.Matches(iHeaderIfNoneMatch.Value(), encoding);
+    const Brx& content = aResource.Content(encoding);
+
+    aConn.iResponse.Reset();
+    aConn.iResponseOffset = 0;
+    WriterHttpResponse writer(aConn.iResponse);
+    writer.WriteStatus(notModified? HttpStatus::kNotModified : HttpStatus::kOk, Http::eHttp11);
+    aResource.WriteHeaders(writer, encoding);
+    if (!notModified) {
+        writer.WriteHeader(Http::kHeaderContentType, aResource.MimeType());
+        Http::WriteHeaderContentLength(writer, content.Bytes());
+    }
+    if (!aConn.iKeepAlive) {
+        Http::WriteHeaderConnectionClose(writer);
+    }
+    writer.WriteFlush();
+    aConn.iResponseBody.Set((notModified || aHeadersOnly)? Brx::Empty() : content);
+}
+
+void HttpServerEpoll::RequestHandler::GetUncached(Connection& aConn, IResourceHandler& aResourceHandler, TBool aHeadersOnly)
+{
+    // Length isn't known until the resource has been written. HTTP/1.1 clients get a chunked
+    // body; for older clients the end of the body is marked by closing the connection.
+    const TBool chunked = (iReaderRequest.Version() == Http::eHttp11);
+    if (!chunked) {
+        aConn.iKeepAlive = false;
+    }
+    aConn.iResponse.Reset();
+    aConn.iResponseBody.Set(Brx::Empty());
+    aConn.iResponseOffset = 0;
+    WriterHttpResponse writer(aConn.iResponse);
+    writer.WriteStatus(HttpStatus::kOk, Http::eHttp11);
+    writer.WriteHeader(Http::kHeaderContentType, aResourceHandler.MimeType());
+    if (chunked) {
+        writer.WriteHeader(Http::kHeaderTransferEncoding, Http::kTransferEncodingChunked);
+    }
+    if (!aConn.iKeepAlive) {
+        Http::WriteHeaderConnectionClose(writer);
+    }
+    writer.WriteFlush();
+    if (aHeadersOnly) {
+        aResourceHandler.Destroy();
+        return;
+    }
+
+    iWriterPiece.Start(aConn);
+    iWriterChunked.SetChunked(chunked);
+    try {
+        aResourceHandler.Write(iWriterChunked, 0, 0);
+        iWriterChunked.WriteFlush();
+    }
+    catch (WriterError&) {
+        aResourceHandler.Destroy();
+        aConn.iKeepAlive = false;
+        if (!iWriterPiece.Sent()) {
+            Error(HttpStatus::kInternalServerError);
+        }
+        // Status line has already been sent. Closing the connection without
+        // completing the body is all that can be done to report the failure.
+        aConn.iResponse.Reset();
+        return;
+    }
+    aResourceHandler.Destroy();
+}
+
+void HttpServerEpoll::RequestHandler::Post(Connection& aConn)
+{
+    Parser uriParser(iReaderRequest.Uri());
+    uriParser.Next('/');    // skip leading '/'
+    Brn uriPrefix = uriParser.Next('/');
+    Brn uriTail = uriParser.NextToEnd();
+
+    if (uriTail == Brn("lpcreate")) {
+        IWebApp* app = nullptr;
+        try {
+            app = &iServer.iAppManager.GetApp(uriPrefix);
+        }
+        catch (InvalidAppPrefix&) {
+            Error(HttpStatus::kNotFound);
+        }
+        std::vector<char*>& languageList = iHeaderAcceptLanguage.LanguageList();
+        std::vector<const Brx*> languageListHeapBufs;
+        for (TUint i=0; i<languageList.size(); i++) {
+            languageListHeapBufs.push_back(new Brh(languageList[i]));
+        }
+        TUint id = IFrameworkTab::kInvalidTabId;
+        try {
+            id = iServer.iTabManager.CreateTab(*app, languageListHeapBufs); // Takes ownership of language list on success.
+        }
+        catch (TabAllocatorFull&) {
+        }
+        catch (TabManagerFull&) {
+        }
+        if (id == IFrameworkTab::kInvalidTabId) {
+            for (TUint i=0; i<languageListHeapBufs.size(); i++) {
+                delete languageListHeapBufs[i];
+            }
+            Error(HttpStatus::kServiceUnavailable);
+        }
+        iBody.Write(Brn("lpcreate\r\n"));
+        iBody.Write(Brn("session-id: "));
+        Bws<Ascii::kMaxUintStringBytes> idBuf;
+        Ascii::AppendDec(idBuf, id);
+        iBody.Write(idBuf);
+        iBody.Write(Brn("\r\n"));
+        WriteResponse(aConn, HttpStatus::kOk, kContentTypeLongPoll, iBody.Buffer());
+    }
+    else if (uriTail == Brn("lp")) {
+        // Response is written by the event thread once msgs are queued or the poll times out.
+        aConn.iPollSessionId = ReadSessionId();
+    }
+    else if (uriTail == Brn("lpterminate")) {
+        const TUint sessionId = ReadSessionId();
+        try {
+            iServer.iTabManager.Destroy(sessionId);
+        }
+        catch (InvalidTabId&) {
+            Error(HttpStatus::kNotFound);
+        }
+        WriteResponse(aConn, HttpStatus::kOk, kContentTypeLongPoll, Brx::Empty());
+    }
+    else if (uriTail == Brn("update")) {
+        const TUint sessionId = ReadSessionId();
+        Brn update;
+        // Rest of request should be a single ConfigVal (so should fit in read buffer).
+        try {
+            update = Ascii::Trim(iReaderUntil.ReadUntil(Ascii::kLf));
+        }
+        catch (ReaderError&) {
+            Error(HttpStatus::kBadRequest);
+        }
+        try {
+            iServer.iTabManager.Receive(sessionId, update);
+        }
+        catch (InvalidTabId&) {
+            Error(HttpStatus::kNotFound);
+        }
+        WriteResponse(aConn, HttpStatus::kOk, Brx::Empty(), Brx::Empty());
+    }
+    else {
+        Error(HttpStatus::kNotFound);
+    }
+}
+
+TUint HttpServerEpoll::RequestHandler::ReadSessionId()
+{
+    Brn buf;
+    try {
+        buf = Ascii::Trim(iReaderUntil.ReadUntil(Ascii::kLf));
+    }
+    catch (ReaderError&) {
+        Error(HttpStatus::kBadRequest);
+    }
+    Parser p(buf);
+    if (p.Next() != Brn("session-id:")) {
+        Error(HttpStatus::kBadRequest);
+    }
+    TUint sessionId = IFrameworkTab::kInvalidTabId;
+    try {
+        sessionId = Ascii::Uint(p.Next());
+    }
+    catch (AsciiError&) {
+        Error(HttpStatus::kNotFound);
+    }
+    if (sessionId == IFrameworkTab::kInvalidTabId) {
+        Error(HttpStatus::kNotFound);
+    }
+    return sessionId;
+}
+
+void HttpServerEpoll::RequestHandler::Error(const HttpStatus& aStatus)
+{
+    iErrorStatus = &aStatus;
+    THROW(HttpError);
+}
+
+
+// HttpServerEpoll
+
+const Brn HttpServerEpoll::kContentTypeLongPoll("text/plain; charset=\"utf-8\"");
+const Brn HttpServerEpoll::kLongPollPrefix("lp\r\n");
+const Brn HttpServerEpoll::kResponseServiceUnavailable("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+
+HttpServerEpoll::HttpServerEpoll(Environment& aEnv, const TChar* aName, TIpAddress aInterface, TUint aPort, TUint aMaxConnections, TUint aPollTimeoutMs,
+                                 IWebAppManager& aAppManager, ITabManager& aTabManager, IResourceManager& aResourceManager)
+    : iEnv(aEnv)
+    , iAppManager(aAppManager)
+    , iTabManager(aTabManager)
+    , iResourceManager(aResourceManager)
+    , iPollTimeoutMs(aPollTimeoutMs)
+    , iInterface(aInterface)
+    , iPort(aPort)
+    , iListenFd(-1)
+    , iEpollFd(-1)
+    , iWakeFd(-1)
+    , iNextDeadlineMs(0)
+    , iDeadlinePending(false)
+    , iLock("HSEL")
+    , iSemPending("HSES", 0)
+    , iPollReady(false)
+    , iQuit(false)
+{
+    iListenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    iEpollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    iWakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    TBool ok = (iListenFd >= 0 && iEpollFd >= 0 && iWakeFd >= 0);
+    if (ok) {
+        int reuse = 1;
+        (void)::setsockopt(iListenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in addr;
+        (void)memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)aPort);
+        addr.sin_addr.s_addr = aInterface; // TIpAddress is in network byte order
+        socklen_t addrLen = sizeof(addr);
+        ok = (::bind(iListenFd, (struct sockaddr*)&addr, sizeof(addr)) == 0
+           && ::listen(iListenFd, SOMAXCONN) == 0
+           && ::getsockname(iListenFd, (struct sockaddr*)&addr, &addrLen) == 0);
+        iPort = ntohs(addr.sin_port);
+    }
+    if (ok) {
+        struct epoll_event ev;
+        (void)memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &iListenFd;
+        ok = (::epoll_ctl(iEpollFd, EPOLL_CTL_ADD, iListenFd, &ev) == 0);
+        ev.data.ptr = &iWakeFd;
+        ok = ok && (::epoll_ctl(iEpollFd, EPOLL_CTL_ADD, iWakeFd, &ev) == 0);
+    }
+    if (!ok) {
+        LOG2(kHttp, kError, "HttpServerEpoll: failed to listen on port %u (errno %d)\n", aPort, errno);
+        const int fds[] = { iListenFd, iEpollFd, iWakeFd };
+        for (TUint i=0; i<sizeof(fds)/sizeof(fds[0]); i++) {
+            if (fds[i] >= 0) {
+                (void)::close(fds[i]);
+            }
+        }
+        THROW(NetworkError);
+    }
+
+    for (TUint i=0; i<aMaxConnections; i++) {
+        Connection* conn = new Connection();
+        iConnections.push_back(conn);
+        iFree.push_back(conn);
+    }
+    iCompleted.reserve(aMaxConnections);
+    iCompletedEvent.reserve(aMaxConnections);
+    for (TUint i=0; i<kRequestHandlers; i++) {
+        iRequestHandlers.push_back(new RequestHandler(aEnv, *this, i));
+    }
+    iThread = new ThreadFunctor(aName, MakeFunctor(*this, &HttpServerEpoll::Run));
+    iThread->Start();
+}
+
+HttpServerEpoll::~HttpServerEpoll()
+{
+    {
+        AutoMutex a(iLock);
+        iQuit = true;
+        iPending.clear();
+    }
+    Wake();
+    delete iThread;
+
+    // Restart poll timers of tabs with parked polls before waiting for RequestHandlers.
+    // A handler could be blocked sending to one of those tabs until it times out.
+    // Any handler waiting for a piece of a response to be sent is failed.
+    for (TUint i=0; i<iConnections.size(); i++) {
+        Connection& conn = *iConnections[i];
+        if (conn.iState == Connection::eParked) {
+            try {
+                iTabManager.EndLongPoll(conn.iPollSessionId);
+            }
+            catch (InvalidTabId&) {}
+        }
+        AutoMutex a(iLock);
+        if (conn.iStreaming) {
+            conn.iStreaming = false;
+            conn.iStreamFailed = true;
+            conn.iSemPieceSent.Signal();
+        }
+    }
+    for (TUint i=0; i<iRequestHandlers.size(); i++) {
+        iSemPending.Signal();
+    }
+    for (TUint i=0; i<iRequestHandlers.size(); i++) {
+        delete iRequestHandlers[i];
+    }
+
+    for (TUint i=0; i<iConnections.size(); i++) {
+        Connection& conn = *iConnections[i];
+        if (conn.iFd >= 0) {
+            (void)::close(conn.iFd);
+        }
+        delete iConnections[i];
+    }
+    (void)::close(iListenFd);
+    (void)::close(iEpollFd);
+    (void)::close(iWakeFd);
+}
+
+TUint HttpServerEpoll::Port() const
+{
+    return iPort;
+}
+
+TIpAddress HttpServerEpoll::Interface() const
+{
+    return iInterface;
+}
+
+void HttpServerEpoll::NotifyLongPollReady()
+{
+    if (!iPollReady.exchange(true)) {
+        Wake();
+    }
+}
+
+void HttpServerEpoll::Run()
+{
+    struct epoll_event events[kMaxEvents];
+    for (;;) {
+        const int count = ::epoll_wait(iEpollFd, events, kMaxEvents, NextTimeoutMs());
+        if (iQuit) {
+            return;
+        }
+        for (int i=0; i<count; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &iListenFd) {
+                Accept();
+            }
+            else if (ptr == &iWakeFd) {
+                uint64_t val;
+                (void)::read(iWakeFd, &val, sizeof(val));
+            }
+            else {
+                Event(*static_cast<Connection*>(ptr), events[i].events);
+            }
+        }
+        ProcessCompleted();
+        if (iPollReady.exchange(false)) {
+            PollsReady();
+        }
+        ProcessTimeouts();
+    }
+}
+
+void HttpServerEpoll::Accept()
+{
+    for (;;) {
+        const int fd = ::accept4(iListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return; // EAGAIN, or an error that leaves the listening socket usable
+        }
+        if (iFree.size() == 0) {
+            LOG(kHttp, "HttpServerEpoll::Accept no free connections\n");
+            (void)::send(fd, kResponseServiceUnavailable.Ptr(), kResponseServiceUnavailable.Bytes(), MSG_NOSIGNAL);
+            (void)::close(fd);
+            continue;
+        }
+        int noDelay = 1; // long poll responses are small and latency sensitive
+        (void)::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        Connection& conn = *iFree.back();
+        iFree.pop_back();
+        conn.Open(fd);
+        SetDeadline(conn, kReadTimeoutMs);
+        SetEvents(conn, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+void HttpServerEpoll::Event(Connection& aConn, TUint aEvents)
+{
+    switch (aConn.iState)
+    {
+    case Connection::eReading:
+        if (aEvents & (EPOLLERR | EPOLLHUP)) {
+            Close(aConn);
+        }
+        else {
+            Read(aConn); // will see end of stream if EPOLLRDHUP
+        }
+        break;
+    case Connection::eWriting:
+        if (aEvents & (EPOLLERR | EPOLLHUP)) {
+            Close(aConn);
+        }
+        else {
+            Write(aConn);
+        }
+        break;
+    case Connection::eParked:
+        // Only registered for hangup. Client has gone away so, as for a failed
+        // write from a blocking long poll, discard its tab.
+        try {
+            iTabManager.Destroy(aConn.iPollSessionId);
+        }
+        catch (InvalidTabId&) {}
+        Close(aConn);
+        break;
+    default:
+        break;
+    }
+}
+
+void HttpServerEpoll::Read(Connection& aConn)
+{
+    Bwx& buf = aConn.iRequest;
+    TBool peerClosed = false;
+    while (buf.Bytes() < buf.MaxBytes()) {
+        const ssize_t bytes = ::recv(aConn.iFd, const_cast<TByte*>(buf.Ptr()) + buf.Bytes(), buf.MaxBytes() - buf.Bytes(), 0);
+        if (bytes > 0) {
+            buf.SetBytes(buf.Bytes() + (TUint)bytes);
+        }
+        else if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        else if (bytes == 0) {
+            // Client may have shut down its side after sending a complete request.
+            peerClosed = true;
+            break;
+        }
+        else {
+            Close(aConn);
+            return;
+        }
+    }
+    TryDispatch(aConn);
+    if (peerClosed && aConn.iState == Connection::eReading) {
+        Close(aConn); // rest of the request will never arrive
+    }
+}
+
+void HttpServerEpoll::TryDispatch(Connection& aConn)
+{
+    try {
+        aConn.iRequestBytes = RequestBytes(aConn.iRequest);
+    }
+    catch (HttpError&) {
+        aConn.iKeepAlive = false;
+        aConn.iRequestBytes = aConn.iRequest.Bytes();
+        WriteResponse(aConn, HttpStatus::kBadRequest, Brx::Empty(), Brx::Empty());
+        aConn.iState = Connection::eWriting;
+        SetDeadline(aConn, kWriteTimeoutMs);
+        Write(aConn);
+        return;
+    }
+    if (aConn.iRequestBytes == 0) {
+        return; // wait for rest of request
+    }
+    aConn.iState = Connection::eProcessing;
+    SetEvents(aConn, 0);
+    {
+        AutoMutex a(iLock);
+        iPending.push_back(&aConn);
+    }
+    iSemPending.Signal();
+}
+
+void HttpServerEpoll::Write(Connection& aConn)
+{
+    // Headers (and any body copied alongside them) are followed by iResponseBody.
+    // Gather both into each send rather than copying the body.
+    const Brx& headers = aConn.iResponse.Buffer();
+    const Brx& body = aConn.iResponseBody;
+    const TUint total = headers.Bytes() + body.Bytes();
+    while (aConn.iResponseOffset < total) {
+        struct iovec iov[2];
+        int iovCount = 0;
+        if (aConn.iResponseOffset < headers.Bytes()) {
+            iov[iovCount].iov_base = const_cast<TByte*>(headers.Ptr()) + aConn.iResponseOffset;
+            iov[iovCount].iov_len = headers.Bytes() - aConn.iResponseOffset;
+            iovCount++;
+        }
+        const TUint bodyOffset = (aConn.iResponseOffset > headers.Bytes()? aConn.iResponseOffset - headers.Bytes() : 0);
+        if (bodyOffset < body.Bytes()) {
+            iov[iovCount].iov_base = const_cast<TByte*>(body.Ptr()) + bodyOffset;
+            iov[iovCount].iov_len = body.Bytes() - bodyOffset;
+            iovCount++;
+        }
+        struct msghdr msg;
+        (void)memset(&msg, 0, sizeof msg);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovCount;
+        const ssize_t bytes = ::sendmsg(aConn.iFd, &msg, MSG_NOSIGNAL);
+        if (bytes >= 0) {
+            aConn.iResponseOffset += (TUint)bytes;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            SetEvents(aConn, EPOLLOUT);
+            return;
+        }
+        else {
+            Close(aConn);
+            return;
+        }
+    }
+    WriteComplete(aConn);
+}
+
+void HttpServerEpoll::WriteComplete(Connection& aConn)
+{
+    if (aConn.iStreaming) {
+        // Hand aConn back to the RequestHandler waiting to write the next piece.
+        aConn.iStreaming = false;
+        aConn.iState = Connection::eProcessing;
+        SetEvents(aConn, 0);
+        aConn.iSemPieceSent.Signal();
+        return;
+    }
+    if (!aConn.iKeepAlive) {
+        Close(aConn);
+        return;
+    }
+    aConn.iResponse.Reset();
+    aConn.iResponseBody.Set(Brx::Empty());
+    aConn.iResponseOffset = 0;
+    aConn.ConsumeRequest();
+    aConn.iState = Connection::eReading;
+    SetDeadline(aConn, kReadTimeoutMs);
+    SetEvents(aConn, EPOLLIN | EPOLLRDHUP);
+    if (aConn.iRequest.Bytes() > 0) {
+        TryDispatch(aConn); // pipelined request
+    }
+}
+
+void HttpServerEpoll::ProcessCompleted()
+{
+    {
+        AutoMutex a(iLock);
+        iCompletedEvent.swap(iCompleted);
+    }
+    for (TUint i=0; i<iCompletedEvent.size(); i++) {
+        Connection& conn = *iCompletedEvent[i];
+        if (conn.iStreamFailed) {
+            Close(conn); // socket was closed while a piece of the response was being sent
+        }
+        else if (conn.iPollSessionId != IFrameworkTab::kInvalidTabId) {
+            Poll(conn);
+        }
+        else {
+            conn.iState = Connection::eWriting;
+            SetDeadline(conn, kWriteTimeoutMs);
+            Write(conn);
+        }
+    }
+    iCompletedEvent.clear();
+}
+
+void HttpServerEpoll::Poll(Connection& aConn)
+{
+    iPollBody.Reset();
+    iPollBody.Write(kLongPollPrefix);
+    TBool complete = false;
+    try {
+        complete = iTabManager.TryLongPoll(aConn.iPollSessionId, iPollBody);
+    }
+    catch (InvalidTabId&) {
+        aConn.iPollSessionId = IFrameworkTab::kInvalidTabId;
+        WriteResponse(aConn, HttpStatus::kNotFound, Brx::Empty(), Brx::Empty());
+        aConn.iState = Connection::eWriting;
+        SetDeadline(aConn, kWriteTimeoutMs);
+        Write(aConn);
+        return;
+    }
+
+    if (complete) {
+        aConn.iPollSessionId = IFrameworkTab::kInvalidTabId;
+        WriteResponse(aConn, HttpStatus::kOk, kContentTypeLongPoll, iPollBody.Buffer());
+        aConn.iState = Connection::eWriting;
+        SetDeadline(aConn, kWriteTimeoutMs);
+        Write(aConn);
+    }
+    else if (aConn.iState != Connection::eParked) {
+        aConn.iState = Connection::eParked;
+        SetDeadline(aConn, iPollTimeoutMs);
+        SetEvents(aConn, EPOLLRDHUP);
+    }
+}
+
+void HttpServerEpoll::PollsReady()
+{
+    // Notification doesn't say which tab has msgs. Retrying every parked poll
+    // is cheap compared to the cost of writing out msgs.
+    for (TUint i=0; i<iConnections.size(); i++) {
+        Connection& conn = *iConnections[i];
+        if (conn.iState == Connection::eParked) {
+            Poll(conn);
+        }
+    }
+}
+
+void HttpServerEpoll::PollTimeout(Connection& aConn)
+{
+    try {
+        iTabManager.EndLongPoll(aConn.iPollSessionId);
+    }
+    catch (InvalidTabId&) {}
+    aConn.iPollSessionId = IFrameworkTab::kInvalidTabId;
+    WriteResponse(aConn, HttpStatus::kOk, kContentTypeLongPoll, kLongPollPrefix);
+    aConn.iState = Connection::eWriting;
+    SetDeadline(aConn, kWriteTimeoutMs);
+    Write(aConn);
+}
+
+void HttpServerEpoll::ProcessTimeouts()
+{
+    if (!iDeadlinePending) {
+        return;
+    }
+    const TUint now = Os::TimeInMs(iEnv.OsCtx());
+    if ((TInt)(iNextDeadlineMs - now) > 0) {
+        return;
+    }
+    iDeadlinePending = false;
+    for (TUint i=0; i<iConnections.size(); i++) {
+        Connection& conn = *iConnections[i];
+        if (conn.iState != Connection::eReading && conn.iState != Connection::eWriting && conn.iState != Connection::eParked) {
+            continue;
+        }
+        if ((TInt)(conn.iDeadlineMs - now) <= 0) {
+            if (conn.iState == Connection::eParked) {
+                PollTimeout(conn);
+            }
+            else {
+                Close(conn);
+            }
+        }
+        if (conn.iState == Connection::eReading || conn.iState == Connection::eWriting || conn.iState == Connection::eParked) {
+            if (!iDeadlinePending || (TInt)(conn.iDeadlineMs - iNextDeadlineMs) < 0) {
+                iNextDeadlineMs = conn.iDeadlineMs;
+                iDeadlinePending = true;
+            }
+        }
+    }
+}
+
+TInt HttpServerEpoll::NextTimeoutMs() const
+{
+    if (!iDeadlinePending) {
+        return -1;
+    }
+    const TInt remaining = (TInt)(iNextDeadlineMs - Os::TimeInMs(iEnv.OsCtx()));
+    return std::max(remaining, 0);
+}
+
+void HttpServerEpoll::SetDeadline(Connection& aConn, TUint aDurationMs)
+{
+    aConn.iDeadlineMs = Os::TimeInMs(iEnv.OsCtx()) + aDurationMs;
+    if (!iDeadlinePending || (TInt)(aConn.iDeadlineMs - iNextDeadlineMs) < 0) {
+        iNextDeadlineMs = aConn.iDeadlineMs;
+        iDeadlinePending = true;
+    }
+}
+
+void HttpServerEpoll::SetEvents(Connection& aConn, TUint aEvents)
+{
+    if (aConn.iEvents == aEvents) {
+        return;
+    }
+    struct epoll_event ev;
+    (void)memset(&ev, 0, sizeof(ev));
+    ev.events = aEvents;
+    ev.data.ptr = &aConn;
+    int op = EPOLL_CTL_MOD;
+    if (aEvents == 0) {
+        op = EPOLL_CTL_DEL; // stops level-triggered hangups being reported while a RequestHandler owns aConn
+    }
+    else if (aConn.iEvents == 0) {
+        op = EPOLL_CTL_ADD;
+    }
+    if (::epoll_ctl(iEpollFd, op, aConn.iFd, &ev) != 0) {
+        LOG2(kHttp, kError, "HttpServerEpoll::SetEvents epoll_ctl failed (errno %d)\n", errno);
+    }
+    aConn.iEvents = aEvents;
+}
+
+void HttpServerEpoll::Close(Connection& aConn)
+{
+    SetEvents(aConn, 0);
+    if (aConn.iFd >= 0) {
+        (void)::close(aConn.iFd);
+    }
+    aConn.iFd = -1;
+    if (aConn.iStreaming) {
+        // A RequestHandler is waiting for this piece to be sent. It still owns aConn,
+        // which is freed once the handler completes.
+        aConn.iStreaming = false;
+        aConn.iStreamFailed = true;
+        aConn.iState = Connection::eProcessing;
+        aConn.iSemPieceSent.Signal();
+        return;
+    }
+    aConn.iState = Connection::eFree;
+    aConn.iPollSessionId = IFrameworkTab::kInvalidTabId;
+    aConn.iResponse.Reset();
+    iFree.push_back(&aConn);
+}
+
+HttpServerEpoll::Connection* HttpServerEpoll::NextRequest()
+{
+    for (;;) {
+        iSemPending.Wait();
+        AutoMutex a(iLock);
+        if (iQuit) {
+            return nullptr;
+        }
+        if (iPending.size() > 0) {
+            Connection* conn = iPending.front();
+            iPending.pop_front();
+            return conn;
+        }
+    }
+}
+
+void HttpServerEpoll::RequestComplete(Connection& aConn)
+{
+    {
+        AutoMutex a(iLock);
+        iCompleted.push_back(&aConn);
+    }
+    Wake();
+}
+
+void HttpServerEpoll::SendPiece(Connection& aConn)
+{
+    {
+        AutoMutex a(iLock);
+        if (iQuit) {
+            THROW(WriterError);
+        }
+        aConn.iStreaming = true;
+        aConn.iResponseOffset = 0;
+        iCompleted.push_back(&aConn);
+    }
+    Wake();
+    aConn.iSemPieceSent.Wait();
+    if (aConn.iStreamFailed) {
+        THROW(WriterError);
+    }
+    aConn.iResponse.Reset();
+}
+
+void HttpServerEpoll::Wake()
+{
+    const uint64_t val = 1;
+    (void)::write(iWakeFd, &val, sizeof(val));
+}
+
+TUint HttpServerEpoll::RequestBytes(const Brx& aBuf)
+{
+    // Returns bytes of the first complete request in aBuf, or 0 if more bytes are needed.
+    const TInt headerEnd = Find(aBuf, Brn("\r\n\r\n"), 0);
+    if (headerEnd < 0) {
+        if (aBuf.Bytes() >= kMaxRequestBytes) {
+            THROW(HttpError);
+        }
+        return 0;
+    }
+    const TUint headerBytes = (TUint)headerEnd + 4;
+
+    TUint contentLength = 0;
+    TBool chunked = false;
+    Parser parser(Brn(aBuf.Ptr(), headerBytes));
+    (void)parser.Next(Ascii::kLf);   // skip request line
+    for (;;) {
+        Brn line = Ascii::Trim(parser.Next(Ascii::kLf));
+        if (line.Bytes() == 0) {
+            break;
+        }
+        Parser lineParser(line);
+        Brn field = Ascii::Trim(lineParser.Next(':'));
+        Brn value = Ascii::Trim(lineParser.Remaining());
+        if (Ascii::CaseInsensitiveEquals(field, Http::kHeaderContentLength)) {
+            try {
+                contentLength = Ascii::Uint(value);
+            }
+            catch (AsciiError&) {
+                THROW(HttpError);
+            }
+        }
+        else if (Ascii::CaseInsensitiveEquals(field, Http::kHeaderTransferEncoding)) {
+            chunked = Ascii::CaseInsensitiveEquals(value, Http::kTransferEncodingChunked);
+        }
+    }
+
+    if (chunked) {
+        const TUint bytes = ChunkedBodyEnd(aBuf, headerBytes);
+        if (bytes == 0 && aBuf.Bytes() >= kMaxRequestBytes) {
+            THROW(HttpError);
+        }
+        return bytes;
+    }
+    // RFC 7230 (3.3.3): request with neither Content-Length nor chunked encoding has no body.
+    if (contentLength > kMaxRequestBytes - headerBytes) {
+        THROW(HttpError);
+    }
+    const TUint bytes = headerBytes + contentLength;
+    return (aBuf.Bytes() >= bytes? bytes : 0);
+}
+
+TUint HttpServerEpoll::ChunkedBodyEnd(const Brx& aBuf, TUint aOffset)
+{
+    // Returns offset of the end of a chunked body starting at aOffset, or 0 if more bytes are needed.
+    // Each chunk is "<hex size>[;extensions]\r\n<data>\r\n".  Data is skipped by size so may contain anything.
+    TUint offset = aOffset;
+    for (;;) {
+        const TInt lineEnd = Find(aBuf, Brn("\r\n"), offset);
+        if (lineEnd < 0) {
+            return 0;
+        }
+        Parser parser(Brn(aBuf.Ptr() + offset, (TUint)lineEnd - offset));
+        Brn size = Ascii::Trim(parser.Next(';'));
+        if (size.Bytes() == 0 || size.Bytes() > 8) {
+            THROW(HttpError);
+        }
+        TUint chunkBytes = 0;
+        try {
+            chunkBytes = Ascii::UintHex(size);
+        }
+        catch (AsciiError&) {
+            THROW(HttpError);
+        }
+        offset = (TUint)lineEnd + 2;
+        if (chunkBytes == 0) {
+            break; // last chunk
+        }
+        if (chunkBytes > kMaxRequestBytes) {
+            THROW(HttpError);
+        }
+        offset += chunkBytes;
+        if (aBuf.Bytes() < offset + 2) {
+            return 0;
+        }
+        if (aBuf[offset] != Ascii::kCr || aBuf[offset + 1] != Ascii::kLf) {
+            THROW(HttpError);
+        }
+        offset += 2;
+    }
+    // Optional trailer fields follow the last chunk, then an empty line.
+    for (;;) {
+        const TInt lineEnd = Find(aBuf, Brn("\r\n"), offset);
+        if (lineEnd < 0) {
+            return 0;
+        }
+        const TUint lineBytes = (TUint)lineEnd - offset;
+        offset = (TUint)lineEnd + 2;
+        if (lineBytes == 0) {
+            return offset;
+        }
+    }
+}
+
+TInt HttpServerEpoll::Find(const Brx& aBuf, const Brx& aSeq, TUint aFrom)
+{
+    if (aBuf.Bytes() < aSeq.Bytes()) {
+        return -1;
+    }
+    const TUint last = aBuf.Bytes() - aSeq.Bytes();
+    for (TUint i=aFrom; i<=last; i++) {
+        if (memcmp(aBuf.Ptr() + i, aSeq.Ptr(), aSeq.Bytes()) == 0) {
+            return (TInt)i;
+        }
+    }
+    return -1;
+}
+
+void HttpServerEpoll::WriteResponse(Connection& aConn, const HttpStatus& aStatus, const Brx& aContentType, const Brx& aBody, TBool aHeadersOnly)
+{
+    aConn.iResponse.Reset();
+    aConn.iResponseBody.Set(Brx::Empty());
+    aConn.iResponseOffset = 0;
+    WriterHttpResponse writer(aConn.iResponse);
+    writer.WriteStatus(aStatus, Http::eHttp11);
+    if (aContentType.Bytes() > 0) {
+        writer.WriteHeader(Http::kHeaderContentType, aContentType);
+    }
+    Http::WriteHeaderContentLength(writer, aBody.Bytes());
+    if (!aConn.iKeepAlive) {
+        Http::WriteHeaderConnectionClose(writer);
+    }
+    writer.WriteFlush();
+    if (!aHeadersOnly) {
+        aConn.iResponse.Write(aBody);
+    }
+}
+
+#endif // __linux__
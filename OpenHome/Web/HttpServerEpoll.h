@@ -0,0 +1,212 @@
+#pragma once
+
+#include <OpenHome/Types.h>
+#include <OpenHome/Buffer.h>
+#include <OpenHome/Private/Standard.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Http.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Net/Private/DviServerUpnp.h>
+#include <OpenHome/Web/WebAppFramework.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+namespace OpenHome {
+    class Environment;
+namespace Web {
+
+/*
+ * Event driven HTTP/1.1 server for WebAppFramework. Linux only (uses epoll).
+ *
+ * One thread owns every socket. It accepts connections and reads requests and writes
+ * responses without blocking, so an idle keep-alive connection or a parked long poll
+ * costs a Connection rather than a thread. Complete requests are passed to a small pool
+ * of RequestHandler threads, as serving a resource or passing an update to a tab may
+ * block. A long poll that finds no msgs queued is handed back to the event thread and
+ * parked until msgs are queued for its tab (see ILongPollObserver) or aPollTimeoutMs
+ * passes. The size of an uncached resource isn't known until it has been written, so its
+ * RequestHandler passes it to the event thread in pieces of kMaxResponseBytes, waiting
+ * for each piece to be sent before writing the next.
+ *
+ * All Connections are allocated on construction. Any connection beyond aMaxConnections
+ * is sent 503 Service Unavailable and closed.
+ */
+class HttpServerEpoll : public IServer, public ILongPollObserver, private INonCopyable
+{
+public:
+    static const TUint kSpareConnections = 4;
+private:
+    static const TUint kMaxRequestBytes = 4*1024;
+    static const TUint kMaxResponseBytes = 4*1024;    // Larger responses (other than uncached resources) are buffered then memory is released.
+    static const TUint kReadTimeoutMs = 5 * 1000;     // Covers keep-alive idle time as well as reading a request.
+    static const TUint kWriteTimeoutMs = 5 * 1000;
+    static const TUint kRequestHandlers = 2;
+    static const TUint kMaxEvents = 32;
+    static const TUint kMaxThreadNameBytes = 32;
+    static const Brn kContentTypeLongPoll;
+    static const Brn kLongPollPrefix;
+    static const Brn kResponseServiceUnavailable;
+private:
+    class ResponseWriter : public IWriter, private INonCopyable
+    {
+    public:
+        ResponseWriter();
+        ~ResponseWriter();
+        const Brx& Buffer() const;
+        void Reset();   // Releases memory if the last response was unusually large.
+    public: // from IWriter
+        void Write(TByte aValue) override;
+        void Write(const Brx& aBuffer) override;
+        void WriteFlush() override;
+    private:
+        Bwh* iBuf;
+    };
+
+    class Connection : private INonCopyable
+    {
+    public:
+        enum EState
+        {
+            eFree,
+            eReading,       // owned by event thread
+            eProcessing,    // owned by a RequestHandler
+            eParked,        // owned by event thread; iPollSessionId is set
+            eWriting        // owned by event thread
+        };
+    public:
+        Connection();
+        void Open(int aFd);
+        void ConsumeRequest();  // Removes current request, leaving any pipelined bytes that followed it.
+    public:
+        int iFd;
+        EState iState;
+        TUint iEvents;          // epoll events registered, 0 if not registered
+        TUint iDeadlineMs;
+        Bws<kMaxRequestBytes> iRequest;
+        TUint iRequestBytes;    // bytes in iRequest that make up the current request
+        ResponseWriter iResponse;
+        Brn iResponseBody;      // sent after iResponse, without copying (e.g. content of a CachedResource)
+        TUint iResponseOffset;  // bytes of iResponse then iResponseBody sent
+        TBool iKeepAlive;
+        TUint iPollSessionId;   // IFrameworkTab::kInvalidTabId unless request was a long poll
+        TBool iStreaming;       // iResponse is one piece of a longer response; a RequestHandler waits on iSemPieceSent
+        TBool iStreamFailed;    // connection was closed while streaming; a RequestHandler still owns it
+        Semaphore iSemPieceSent;
+    };
+
+    class PieceWriter : public IWriter, private INonCopyable
+    {
+    public:
+        PieceWriter(HttpServerEpoll& aServer);
+        void Start(Connection& aConn);  // Appends to aConn.iResponse, which should already hold response headers.
+        TBool Sent() const;             // true if any piece has been sent
+    public: // from IWriter
+        void Write(TByte aValue) override;
+        void Write(const Brx& aBuffer) override; // THROWS WriterError
+        void WriteFlush() override;
+    private:
+        HttpServerEpoll& iServer;
+        Connection* iConn;
+        TBool iSent;
+    };
+
+    class RequestHandler : private INonCopyable
+    {
+    public:
+        RequestHandler(Environment& aEnv, HttpServerEpoll& aServer, TUint aIndex);
+        ~RequestHandler();
+    private:
+        void Run();
+        void Process(Connection& aConn);
+        void Get(Connection& aConn, TBool aHeadersOnly);
+        void GetCached(Connection& aConn, const CachedResource& aResource, TBool aHeadersOnly);
+        void GetUncached(Connection& aConn, IResourceHandler& aResourceHandler, TBool aHeadersOnly);
+        void Post(Connection& aConn);
+        TUint ReadSessionId();
+        void Error(const HttpStatus& aStatus);
+    private:
+        HttpServerEpoll& iServer;
+        ReaderBuffer iReaderBuffer;
+        ReaderUntilS<kMaxRequestBytes> iReaderUntilPreChunker;
+        ReaderHttpRequest iReaderRequest;
+        ReaderHttpChunked iReaderChunked;
+        ReaderUntilS<kMaxRequestBytes> iReaderUntil;
+        HttpHeaderHost iHeaderHost;
+        HttpHeaderTransferEncoding iHeaderTransferEncoding;
+        HttpHeaderConnection iHeaderConnection;
+        Net::HeaderAcceptLanguage iHeaderAcceptLanguage;
+        HttpHeaderValue iHeaderIfNoneMatch;
+        HttpHeaderValue iHeaderAcceptEncoding;
+        const HttpStatus* iErrorStatus;
+        ResponseWriter iBody;
+        PieceWriter iWriterPiece;
+        WriterHttpChunked iWriterChunked;
+        ThreadFunctor* iThread;
+    };
+public:
+    HttpServerEpoll(Environment& aEnv, const TChar* aName, TIpAddress aInterface, TUint aPort, TUint aMaxConnections, TUint aPollTimeoutMs,
+                    IWebAppManager& aAppManager, ITabManager& aTabManager, IResourceManager& aResourceManager);
+    ~HttpServerEpoll();
+public: // from IServer
+    TUint Port() const override;
+    TIpAddress Interface() const override;
+public: // from ILongPollObserver
+    void NotifyLongPollReady() override;
+private: // called on event thread
+    void Run();
+    void Accept();
+    void Event(Connection& aConn, TUint aEvents);
+    void Read(Connection& aConn);
+    void TryDispatch(Connection& aConn);
+    void Write(Connection& aConn);
+    void WriteComplete(Connection& aConn);
+    void ProcessCompleted();
+    void Poll(Connection& aConn);
+    void PollsReady();
+    void PollTimeout(Connection& aConn);
+    void ProcessTimeouts();
+    TInt NextTimeoutMs() const;
+    void SetDeadline(Connection& aConn, TUint aDurationMs);
+    void SetEvents(Connection& aConn, TUint aEvents);
+    void Close(Connection& aConn);
+private: // called on RequestHandler threads
+    Connection* NextRequest(); // Blocks. Returns nullptr when server is being destroyed.
+    void RequestComplete(Connection& aConn);
+    void SendPiece(Connection& aConn); // Blocks until aConn.iResponse is sent. THROWS WriterError
+private:
+    void Wake();
+    static TUint RequestBytes(const Brx& aBuf); // THROWS HttpError
+    static TUint ChunkedBodyEnd(const Brx& aBuf, TUint aOffset); // THROWS HttpError
+    static TInt Find(const Brx& aBuf, const Brx& aSeq, TUint aFrom);
+    static void WriteResponse(Connection& aConn, const HttpStatus& aStatus, const Brx& aContentType, const Brx& aBody, TBool aHeadersOnly = false);
+private:
+    Environment& iEnv;
+    IWebAppManager& iAppManager;
+    ITabManager& iTabManager;
+    IResourceManager& iResourceManager;
+    const TUint iPollTimeoutMs;
+    TIpAddress iInterface;
+    TUint iPort;
+    int iListenFd;
+    int iEpollFd;
+    int iWakeFd;
+    std::vector<Connection*> iConnections;
+    std::vector<Connection*> iFree;
+    TUint iNextDeadlineMs;
+    TBool iDeadlinePending;
+    ResponseWriter iPollBody;
+    Mutex iLock;
+    Semaphore iSemPending;
+    std::deque<Connection*> iPending;       // requests awaiting a RequestHandler
+    std::vector<Connection*> iCompleted;    // requests processed by a RequestHandler
+    std::vector<Connection*> iCompletedEvent;
+    std::atomic<TBool> iPollReady;
+    std::atomic<TBool> iQuit;
+    std::vector<RequestHandler*> iRequestHandlers;
+    ThreadFunctor* iThread;
+};
+
+} // namespace Web
+} // namespace OpenHome
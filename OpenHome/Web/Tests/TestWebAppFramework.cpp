@@ -4,6 +4,7 @@
 #include <OpenHome/Private/SuiteUnitTest.h>
 #include <OpenHome/Private/Standard.h>
 
+#include <OpenHome/MimeTypes.h>
 #include <OpenHome/Web/WebAppFramework.h>
 
 namespace OpenHome {
@@ -147,6 +148,8 @@ private:
     void TestBlockingSendMultipleMessages();
     void TestBlockingSendQueueFull();
     void TestBlockingSendNewMessageQueued();
+    void TestTryLongPollQueueEmpty();
+    void TestTryLongPollMultipleMessages();
 private:
     void LongPollThread();
 private:
@@ -167,6 +170,7 @@ private:
 public: // from IResourceHandler
     const OpenHome::Brx& MimeType() override;
     void Write(OpenHome::IWriter& aWriter, TUint aOffset, TUint aBytes) override;
+    const CachedResource* Cached() override;
     void Destroy() override;
 };
 
@@ -237,6 +241,7 @@ public:
 private: // from IFrameworkTabHandler
     void Send(ITabMessage& aMessage);
     void LongPoll(IWriter& aWriter);
+    TBool TryLongPoll(IWriter& aWriter);
     void Enable();
     void Disable();
 private:
@@ -299,6 +304,7 @@ private:
     void TestSessionId();
     void TestReceive();
     void TestLongPoll();
+    void TestTryLongPoll();
     void TestSend();
     void TestTabTimeout();
     void TestDeleteWhileTabAllocated();
@@ -323,6 +329,8 @@ public: // from IFrameworkTab
     void Clear() override;
     void Receive(const Brx& aMessage) override;
     void LongPoll(IWriter& aWriter) override;
+    TBool TryLongPoll(IWriter& aWriter) override;
+    void EndLongPoll() override;
 private:
     ITestPipeWritable& iTestPipe;
     const TUint iId;
@@ -338,6 +346,8 @@ public: // from IFrameworkTab
     void Clear() override;
     void Receive(const Brx& aMessage) override;
     void LongPoll(IWriter& aWriter) override;
+    TBool TryLongPoll(IWriter& aWriter) override;
+    void EndLongPoll() override;
 };
 
 class SuiteTabManager : public TestFramework::SuiteUnitTest, private INonCopyable
@@ -364,6 +374,25 @@ private:
     TestHelperWebApp* iWebApp;
 };
 
+class SuiteCachedResource : public TestFramework::SuiteUnitTest, private INonCopyable
+{
+public:
+    SuiteCachedResource();
+private: // from SuiteUnitTest
+    void Setup() override;
+    void TearDown() override;
+private:
+    void TestMimeType();
+    void TestETag();
+    void TestSelectEncodingNoVariants();
+    void TestSelectEncoding();
+    void TestSelectEncodingQvalue();
+    void TestSelectEncodingLargerVariant();
+    void TestMatches();
+private:
+    CachedResource* iResource;
+};
+
 class SuiteWebAppFramework : public TestFramework::SuiteUnitTest, private INonCopyable
 {
 public:
@@ -479,6 +508,8 @@ SuiteFrameworkTabHandler::SuiteFrameworkTabHandler()
     AddTest(MakeFunctor(*this, &SuiteFrameworkTabHandler::TestBlockingSendMultipleMessages), "TestBlockingSendMultipleMessages");
     AddTest(MakeFunctor(*this, &SuiteFrameworkTabHandler::TestBlockingSendQueueFull), "TestBlockingSendQueueFull");
     AddTest(MakeFunctor(*this, &SuiteFrameworkTabHandler::TestBlockingSendNewMessageQueued), "TestBlockingSendNewMessageQueued");
+    AddTest(MakeFunctor(*this, &SuiteFrameworkTabHandler::TestTryLongPollQueueEmpty), "TestTryLongPollQueueEmpty");
+    AddTest(MakeFunctor(*this, &SuiteFrameworkTabHandler::TestTryLongPollMultipleMessages), "TestTryLongPollMultipleMessages");
 }
 
 void SuiteFrameworkTabHandler::Setup()
@@ -708,6 +739,48 @@ void SuiteFrameworkTabHandler::TestBlockingSendNewMessageQueued()
     TEST(iTestPipe->ExpectEmpty());
 }
 
+void SuiteFrameworkTabHandler::TestTryLongPollQueueEmpty()
+{
+    // Queue no msgs. TryLongPoll() should return immediately without writing anything.
+    IFrameworkTabHandler& tabHandler = *iTabHandler;
+    tabHandler.Enable();
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Clear READ")));
+    TEST(tabHandler.TryLongPoll(*iHelperBufferWriter) == false);
+    TEST(iHelperBufferWriter->Buffer().Bytes() == 0);
+    TEST(iTestPipe->ExpectEmpty());
+}
+
+void SuiteFrameworkTabHandler::TestTryLongPollMultipleMessages()
+{
+    IFrameworkTabHandler& tabHandler = *iTabHandler;
+    tabHandler.Enable();
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Clear READ")));
+
+    HelperTabMessage& msg1 = iTabAllocator->Allocate();
+    msg1.Set(0);
+    tabHandler.Send(msg1);
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Wait WRITE")));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Signal READ")));
+
+    HelperTabMessage& msg2 = iTabAllocator->Allocate();
+    msg2.Set(1);
+    tabHandler.Send(msg2);
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Wait WRITE")));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Signal READ")));
+
+    // All queued msgs are output without blocking and no timer is started.
+    TEST(tabHandler.TryLongPoll(*iHelperBufferWriter));
+    TEST(iHelperBufferWriter->Buffer() == Brn("[0,1]"));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Signal WRITE")));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Signal WRITE")));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkSemaphore::Clear READ")));   // Discards signals from Send().
+    TEST(iTestPipe->ExpectEmpty());
+
+    // Queue is now empty.
+    TEST(tabHandler.TryLongPoll(*iHelperBufferWriter) == false);
+    TEST(iTestPipe->ExpectEmpty());
+}
+
 void SuiteFrameworkTabHandler::LongPollThread()
 {
     IFrameworkTabHandler& tabHandler = *iTabHandler;
@@ -729,6 +802,11 @@ void TestHelperResourceHandler::Write(IWriter& /*aWriter*/, TUint /*aOffset*/, T
 {
 }
 
+const CachedResource* TestHelperResourceHandler::Cached()
+{
+    return nullptr;
+}
+
 void TestHelperResourceHandler::Destroy()
 {
 }
@@ -1141,6 +1219,12 @@ void TestHelperTabHandler::LongPoll(IWriter& /*aWriter*/)
     iTestPipe.Write(Brn("TabHandler::LongPoll"));
 }
 
+TBool TestHelperTabHandler::TryLongPoll(IWriter& /*aWriter*/)
+{
+    iTestPipe.Write(Brn("TabHandler::TryLongPoll"));
+    return true;
+}
+
 void TestHelperTabHandler::Enable()
 {
     iTestPipe.Write(Brn("TabHandler::Enable"));
@@ -1228,6 +1312,7 @@ SuiteFrameworkTab::SuiteFrameworkTab()
     AddTest(MakeFunctor(*this, &SuiteFrameworkTab::TestSessionId), "TestSessionId");
     AddTest(MakeFunctor(*this, &SuiteFrameworkTab::TestReceive), "TestReceive");
     AddTest(MakeFunctor(*this, &SuiteFrameworkTab::TestLongPoll), "TestLongPoll");
+    AddTest(MakeFunctor(*this, &SuiteFrameworkTab::TestTryLongPoll), "TestTryLongPoll");
     AddTest(MakeFunctor(*this, &SuiteFrameworkTab::TestSend), "TestSend");
     AddTest(MakeFunctor(*this, &SuiteFrameworkTab::TestTabTimeout), "TestTabTimeout");
     //AddTest(MakeFunctor(*this, &SuiteFrameworkTab::TestDeleteWhileTabAllocated), "TestDeleteWhileTabAllocated");
@@ -1357,6 +1442,33 @@ void SuiteFrameworkTab::TestLongPoll()
     TEST(iTestPipe->ExpectEmpty());
 }
 
+void SuiteFrameworkTab::TestTryLongPoll()
+{
+    Bws<1> buf;
+    WriterBuffer writerBuffer(buf);
+    iFrameworkTab->CreateTab(1, *iTabCreator, *iDestroyHandler, iLanguages);
+    TEST(iTestPipe->Expect(Brn("TabHandler::Enable")));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkTimer::Start 5000")));
+    TEST(iFrameworkTab->TryLongPoll(writerBuffer));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkTimer::Cancel")));
+    TEST(iTestPipe->Expect(Brn("TabHandler::TryLongPoll")));
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkTimer::Start 5000")));
+    TEST(buf.Bytes() == 0);
+    // Ending a poll that timed out while parked restarts the tab timer.
+    iFrameworkTab->EndLongPoll();
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkTimer::Start 5000")));
+    iFrameworkTab->Clear();
+    TEST(iTestPipe->Expect(Brn("TestHelperFrameworkTimer::Cancel")));
+    TEST(iTestPipe->Expect(Brn("TabHandler::Disable")));
+    TEST(iTestPipe->Expect(Brn("Tab::Destroy")));
+    TEST(iTestPipe->ExpectEmpty());
+
+    // No tab allocated, so poll completes immediately.
+    TEST(iFrameworkTab->TryLongPoll(writerBuffer));
+    iFrameworkTab->EndLongPoll();
+    TEST(iTestPipe->ExpectEmpty());
+}
+
 void SuiteFrameworkTab::TestSend()
 {
     iFrameworkTab->CreateTab(1, *iTabCreator, *iDestroyHandler, iLanguages);
@@ -1487,6 +1599,21 @@ void TestHelperFrameworkTab::LongPoll(IWriter& /*aWriter*/)
     iTestPipe.Write(buf);
 }
 
+TBool TestHelperFrameworkTab::TryLongPoll(IWriter& /*aWriter*/)
+{
+    Bws<50> buf("TestHelperFrameworkTab::TryLongPoll ");
+    Ascii::AppendDec(buf, iId);
+    iTestPipe.Write(buf);
+    return true;
+}
+
+void TestHelperFrameworkTab::EndLongPoll()
+{
+    Bws<50> buf("TestHelperFrameworkTab::EndLongPoll ");
+    Ascii::AppendDec(buf, iId);
+    iTestPipe.Write(buf);
+}
+
 
 // TestHelperFrameworkTabFull
 
@@ -1514,6 +1641,17 @@ void TestHelperFrameworkTabFull::LongPoll(IWriter& /*aWriter*/)
     ASSERTS();
 }
 
+TBool TestHelperFrameworkTabFull::TryLongPoll(IWriter& /*aWriter*/)
+{
+    ASSERTS();
+    return false;
+}
+
+void TestHelperFrameworkTabFull::EndLongPoll()
+{
+    ASSERTS();
+}
+
 
 // SuiteTabManager
 
@@ -1867,6 +2005,121 @@ void SuiteTabManager::TestDeleteWhileTabsAllocated()
 }
 
 
+// SuiteCachedResource
+
+SuiteCachedResource::SuiteCachedResource()
+    : SuiteUnitTest("SuiteCachedResource")
+{
+    AddTest(MakeFunctor(*this, &SuiteCachedResource::TestMimeType), "TestMimeType");
+    AddTest(MakeFunctor(*this, &SuiteCachedResource::TestETag), "TestETag");
+    AddTest(MakeFunctor(*this, &SuiteCachedResource::TestSelectEncodingNoVariants), "TestSelectEncodingNoVariants");
+    AddTest(MakeFunctor(*this, &SuiteCachedResource::TestSelectEncoding), "TestSelectEncoding");
+    AddTest(MakeFunctor(*this, &SuiteCachedResource::TestSelectEncodingQvalue), "TestSelectEncodingQvalue");
+    AddTest(MakeFunctor(*this, &SuiteCachedResource::TestSelectEncodingLargerVariant), "TestSelectEncodingLargerVariant");
+    AddTest(MakeFunctor(*this, &SuiteCachedResource::TestMatches), "TestMatches");
+}
+
+void SuiteCachedResource::Setup()
+{
+    iResource = new CachedResource(Brn("js/config.js"), new Bwh("function Config() { return 'identity content'; }"));
+}
+
+void SuiteCachedResource::TearDown()
+{
+    delete iResource;
+}
+
+void SuiteCachedResource::TestMimeType()
+{
+    TEST(iResource->Uri() == Brn("js/config.js"));
+    TEST(iResource->MimeType() == Brn(kOhNetMimeTypeJs));
+}
+
+void SuiteCachedResource::TestETag()
+{
+    const Brx& etag = iResource->ETag(CachedResource::eIdentity);
+    TEST(etag.Bytes() == 18);  // quoted 8 digit hash + 8 digit length
+    TEST(etag[0] == '\"');
+    TEST(etag[etag.Bytes()-1] == '\"');
+
+    // Same content gives same tag.
+    CachedResource same(Brn("js/other.js"), new Bwh("function Config() { return 'identity content'; }"));
+    TEST(same.ETag(CachedResource::eIdentity) == etag);
+
+    // Each variant is a separate representation so has its own tag.
+    iResource->SetVariant(CachedResource::eGzip, new Bwh("gz"));
+    TEST(iResource->ETag(CachedResource::eGzip) != etag);
+    TEST(iResource->ETag(CachedResource::eIdentity) == etag);
+}
+
+void SuiteCachedResource::TestSelectEncodingNoVariants()
+{
+    TEST(!iResource->HasVariants());
+    TEST(iResource->SelectEncoding(Brx::Empty()) == CachedResource::eIdentity);
+    TEST(iResource->SelectEncoding(Brn("gzip, deflate, br")) == CachedResource::eIdentity);
+}
+
+void SuiteCachedResource::TestSelectEncoding()
+{
+    iResource->SetVariant(CachedResource::eGzip, new Bwh("gzip content"));
+    iResource->SetVariant(CachedResource::eBrotli, new Bwh("br content"));
+    TEST(iResource->HasVariants());
+    TEST(iResource->SelectEncoding(Brx::Empty()) == CachedResource::eIdentity);
+    TEST(iResource->SelectEncoding(Brn("identity")) == CachedResource::eIdentity);
+    TEST(iResource->SelectEncoding(Brn("gzip")) == CachedResource::eGzip);
+    TEST(iResource->SelectEncoding(Brn("GZIP")) == CachedResource::eGzip);
+    TEST(iResource->SelectEncoding(Brn("gzip, deflate")) == CachedResource::eGzip);
+    TEST(iResource->SelectEncoding(Brn("gzip, deflate, br")) == CachedResource::eBrotli);
+    TEST(iResource->SelectEncoding(Brn("*")) == CachedResource::eBrotli);
+    TEST(iResource->Content(CachedResource::eBrotli) == Brn("br content"));
+    TEST(CachedResource::EncodingName(CachedResource::eGzip) == Brn("gzip"));
+    TEST(CachedResource::EncodingName(CachedResource::eBrotli) == Brn("br"));
+    TEST(CachedResource::EncodingName(CachedResource::eIdentity).Bytes() == 0);
+}
+
+void SuiteCachedResource::TestSelectEncodingQvalue()
+{
+    iResource->SetVariant(CachedResource::eGzip, new Bwh("gzip content"));
+    iResource->SetVariant(CachedResource::eBrotli, new Bwh("br content"));
+    TEST(iResource->SelectEncoding(Brn("gzip;q=1.0, br;q=0")) == CachedResource::eGzip);
+    TEST(iResource->SelectEncoding(Brn("gzip; q=0.5, br; q=0.000")) == CachedResource::eGzip);
+    TEST(iResource->SelectEncoding(Brn("gzip;q=0, br;q=0.0")) == CachedResource::eIdentity);
+    TEST(iResource->SelectEncoding(Brn("br;q=0.001")) == CachedResource::eBrotli);
+}
+
+void SuiteCachedResource::TestSelectEncodingLargerVariant()
+{
+    // A "compressed" variant no smaller than the resource isn't worth sending.
+    iResource->SetVariant(CachedResource::eGzip, new Bwh("a gzip variant that is larger than the identity content"));
+    TEST(iResource->SelectEncoding(Brn("gzip")) == CachedResource::eIdentity);
+}
+
+void SuiteCachedResource::TestMatches()
+{
+    Bws<64> etag(iResource->ETag(CachedResource::eIdentity));
+    TEST(iResource->Matches(etag, CachedResource::eIdentity));
+    TEST(iResource->Matches(Brn("*"), CachedResource::eIdentity));
+    TEST(!iResource->Matches(Brn("\"0000000000000000\""), CachedResource::eIdentity));
+
+    Bws<128> list("\"0000000000000000\", ");
+    list.Append(etag);
+    TEST(iResource->Matches(list, CachedResource::eIdentity));
+
+    Bws<64> weak("W/");
+    weak.Append(etag);
+    TEST(iResource->Matches(weak, CachedResource::eIdentity));
+
+    // Unquoted tag doesn't match.
+    Brn unquoted(etag.Ptr() + 1, etag.Bytes() - 2);
+    TEST(!iResource->Matches(unquoted, CachedResource::eIdentity));
+
+    // Tag for identity representation doesn't validate gzip representation.
+    iResource->SetVariant(CachedResource::eGzip, new Bwh("gz"));
+    TEST(!iResource->Matches(etag, CachedResource::eGzip));
+    TEST(iResource->Matches(iResource->ETag(CachedResource::eGzip), CachedResource::eGzip));
+}
+
+
 // SuiteWebAppFramework
 
 SuiteWebAppFramework::SuiteWebAppFramework(Environment& aEnv)
@@ -1958,6 +2211,7 @@ void TestWebAppFramework(Environment& aEnv)
     runner.Add(new SuiteFrameworkTabHandler());
     runner.Add(new SuiteFrameworkTab());
     runner.Add(new SuiteTabManager());
+    runner.Add(new SuiteCachedResource());
     runner.Add(new SuiteWebAppFramework(aEnv));
     runner.Run();
 }
@@ -0,0 +1,384 @@
+#include <OpenHome/Private/TestFramework.h>
+#include <OpenHome/Web/WebAppFramework.h>
+#include <OpenHome/Private/Ascii.h>
+#include <OpenHome/Private/Env.h>
+#include <OpenHome/Private/Http.h>
+#include <OpenHome/Private/Network.h>
+#include <OpenHome/Private/Printer.h>
+#include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
+#include <OpenHome/Private/OptionParser.h>
+#include <OpenHome/Private/Parser.h>
+#include <OpenHome/OsWrapper.h>
+
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+using namespace OpenHome;
+using namespace OpenHome::TestFramework;
+using namespace OpenHome::Web;
+
+/*
+ * Benchmark for WebAppFramework long polling.
+ *
+ * Opens the given number of browser-like sessions (lpcreate then an outstanding lp on a
+ * keep-alive connection), reporting process memory and thread count as sessions are
+ * added. Then queues one msg for every tab and times how long it takes for every
+ * parked poll to be answered.
+ *
+ * Memory and thread figures are read from /proc/self/status so are only available on Linux.
+ */
+
+namespace OpenHome {
+namespace Web {
+namespace Test {
+
+class BenchTabMessage : public ITabMessage, private INonCopyable
+{
+public:
+    BenchTabMessage(const Brx& aMsg);
+public: // from ITabMessage
+    void Send(IWriter& aWriter) override;
+    void Destroy() override;
+private:
+    Bws<32> iMsg;
+};
+
+class BenchTab : public ITab, private INonCopyable
+{
+public:
+    BenchTab(ITabHandler& aHandler);
+    ITabHandler& Handler();
+    TBool Allocated() const;
+public: // from ITab
+    void Receive(const Brx& aMessage) override;
+    void Destroy() override;
+private:
+    ITabHandler& iHandler;
+    TBool iAllocated;
+};
+
+class BenchWebApp : public IWebApp, private INonCopyable
+{
+public:
+    static const Brn kPrefix;
+public:
+    BenchWebApp();
+    ~BenchWebApp();
+    void SendAll(const Brx& aMsg);
+public: // from IWebApp
+    IResourceHandler& CreateResourceHandler(const Brx& aResource) override;
+    ITab& Create(ITabHandler& aHandler, const std::vector<const Brx*>& aLanguageList) override;
+    const Brx& ResourcePrefix() const override;
+private:
+    Mutex iLock;
+    std::vector<BenchTab*> iTabs;
+};
+
+class BenchClient : private INonCopyable
+{
+    static const TUint kTimeoutMs = 60 * 1000;
+    static const TUint kMaxPathBytes = 64;
+public:
+    BenchClient(Environment& aEnv, const Endpoint& aEndpoint);
+    ~BenchClient();
+    void Create(); // THROWS NetworkError, ReaderError, WriterError
+    void StartPoll();
+    TUint ReadResponse(Bwx& aBody);
+private:
+    void WriteRequest(const Brx& aPath, const Brx& aBody);
+private:
+    SocketTcpClient iSocket;
+    Srs<1024> iReadBuffer;
+    ReaderUntilS<1024> iReaderUntil;
+    ReaderHttpResponse iReaderResponse;
+    HttpHeaderContentLength iHeaderContentLength;
+    Sws<1024> iWriteBuffer;
+    WriterHttpRequest iWriterRequest;
+    Bws<32> iSessionId;
+};
+
+class SuiteWebAppFrameworkBenchmark : public Suite, private INonCopyable
+{
+    static const TUint kPollTimeoutMs = 120 * 1000;
+    static const TUint kSendQueueSize = 16;
+    static const TUint kSendTimeoutMs = 5000;
+public:
+    SuiteWebAppFrameworkBenchmark(Environment& aEnv, TUint aSessions, TUint aReportInterval);
+    void Test() override;
+private:
+    void PresentationUrlChanged(const Brx& aUrl);
+    void Report(TUint aSessions);
+private:
+    Environment& iEnv;
+    const TUint iSessions;
+    const TUint iReportInterval;
+};
+
+} // namespace Test
+} // namespace Web
+} // namespace OpenHome
+
+using namespace OpenHome::Web::Test;
+
+
+// BenchTabMessage
+
+BenchTabMessage::BenchTabMessage(const Brx& aMsg)
+    : iMsg(aMsg)
+{
+}
+
+void BenchTabMessage::Send(IWriter& aWriter)
+{
+    aWriter.Write(iMsg);
+}
+
+void BenchTabMessage::Destroy()
+{
+    delete this;
+}
+
+
+// BenchTab
+
+BenchTab::BenchTab(ITabHandler& aHandler)
+    : iHandler(aHandler)
+    , iAllocated(true)
+{
+}
+
+ITabHandler& BenchTab::Handler()
+{
+    return iHandler;
+}
+
+TBool BenchTab::Allocated() const
+{
+    return iAllocated;
+}
+
+void BenchTab::Receive(const Brx& /*aMessage*/)
+{
+}
+
+void BenchTab::Destroy()
+{
+    iAllocated = false;
+}
+
+
+// BenchWebApp
+
+const Brn BenchWebApp::kPrefix("BenchWebApp");
+
+BenchWebApp::BenchWebApp()
+    : iLock("BWAL")
+{
+}
+
+BenchWebApp::~BenchWebApp()
+{
+    for (TUint i=0; i<iTabs.size(); i++) {
+        delete iTabs[i];
+    }
+}
+
+void BenchWebApp::SendAll(const Brx& aMsg)
+{
+    AutoMutex a(iLock);
+    for (TUint i=0; i<iTabs.size(); i++) {
+        if (iTabs[i]->Allocated()) {
+            iTabs[i]->Handler().Send(*new BenchTabMessage(aMsg));
+        }
+    }
+}
+
+IResourceHandler& BenchWebApp::CreateResourceHandler(const Brx& /*aResource*/)
+{
+    THROW(ResourceInvalid);
+}
+
+ITab& BenchWebApp::Create(ITabHandler& aHandler, const std::vector<const Brx*>& /*aLanguageList*/)
+{
+    AutoMutex a(iLock);
+    BenchTab* tab = new BenchTab(aHandler);
+    iTabs.push_back(tab);
+    return *tab;
+}
+
+const Brx& BenchWebApp::ResourcePrefix() const
+{
+    return kPrefix;
+}
+
+
+// BenchClient
+
+BenchClient::BenchClient(Environment& aEnv, const Endpoint& aEndpoint)
+    : iReadBuffer(iSocket)
+    , iReaderUntil(iReadBuffer)
+    , iReaderResponse(aEnv, iReaderUntil)
+    , iWriteBuffer(iSocket)
+    , iWriterRequest(iWriteBuffer)
+{
+    iReaderResponse.AddHeader(iHeaderContentLength);
+    iSocket.Open(aEnv);
+    iSocket.Connect(aEndpoint, kTimeoutMs);
+}
+
+BenchClient::~BenchClient()
+{
+    iSocket.Close();
+}
+
+void BenchClient::Create()
+{
+    Bws<kMaxPathBytes> path("/");
+    path.Append(BenchWebApp::kPrefix);
+    path.Append("/lpcreate");
+    WriteRequest(path, Brx::Empty());
+    Bws<64> body;
+    TEST(ReadResponse(body) == HttpStatus::kOk.Code());
+
+    // Response is "lpcreate\r\nsession-id: <id>\r\n". Keep the second line to identify later requests.
+    Parser p(body);
+    (void)p.Next('\n');
+    iSessionId.Replace(Ascii::Trim(p.Next('\n')));
+    iSessionId.Append("\r\n");
+}
+
+void BenchClient::StartPoll()
+{
+    Bws<kMaxPathBytes> path("/");
+    path.Append(BenchWebApp::kPrefix);
+    path.Append("/lp");
+    WriteRequest(path, iSessionId);
+}
+
+TUint BenchClient::ReadResponse(Bwx& aBody)
+{
+    iReaderResponse.Read(kTimeoutMs);
+    aBody.SetBytes(0);
+    TUint remaining = iHeaderContentLength.ContentLength();
+    while (remaining > 0) {
+        Brn buf = iReaderUntil.Read(remaining);
+        const TUint bytes = std::min(buf.Bytes(), aBody.MaxBytes() - aBody.Bytes());
+        aBody.Append(buf.Ptr(), bytes);
+        remaining -= buf.Bytes();
+    }
+    return iReaderResponse.Status().Code();
+}
+
+void BenchClient::WriteRequest(const Brx& aPath, const Brx& aBody)
+{
+    // HTTP/1.1 without "Connection: close", so each client reuses a single connection.
+    iWriterRequest.WriteMethod(Http::kMethodPost, aPath, Http::eHttp11);
+    iWriterRequest.WriteHeader(Http::kHeaderHost, Brn("localhost"));
+    Http::WriteHeaderContentLength(iWriterRequest, aBody.Bytes());
+    iWriterRequest.WriteFlush();
+    iWriteBuffer.Write(aBody);
+    iWriteBuffer.WriteFlush();
+}
+
+
+// SuiteWebAppFrameworkBenchmark
+
+SuiteWebAppFrameworkBenchmark::SuiteWebAppFrameworkBenchmark(Environment& aEnv, TUint aSessions, TUint aReportInterval)
+    : Suite("WebAppFramework long poll benchmark")
+    , iEnv(aEnv)
+    , iSessions(aSessions)
+    , iReportInterval(aReportInterval)
+{
+}
+
+void SuiteWebAppFrameworkBenchmark::Test()
+{
+    Report(0);
+    WebAppFramework* framework = new WebAppFramework(iEnv, 0, 0, iSessions, kSendQueueSize, kSendTimeoutMs, kPollTimeoutMs);
+    BenchWebApp* app = new BenchWebApp();
+    framework->Add(app, MakeFunctorGeneric(*this, &SuiteWebAppFrameworkBenchmark::PresentationUrlChanged));
+    framework->Start();
+    Report(0);
+
+    const Endpoint ep(framework->Port(), framework->Interface());
+    std::vector<BenchClient*> clients;
+    clients.reserve(iSessions);
+    const TUint64 startCreate = Os::TimeInUs(iEnv.OsCtx());
+    for (TUint i=0; i<iSessions; i++) {
+        BenchClient* client = new BenchClient(iEnv, ep);
+        clients.push_back(client);
+        client->Create();
+        client->StartPoll();
+        if ((i+1) % iReportInterval == 0 || i+1 == iSessions) {
+            Report(i+1);
+        }
+    }
+    const TUint64 usCreate = Os::TimeInUs(iEnv.OsCtx()) - startCreate;
+    Log::Print("created %u sessions in %llums\n", iSessions, (unsigned long long)(usCreate / 1000));
+
+    // Every client now has a poll outstanding. Queue a msg for each and time until all have been answered.
+    const TUint64 startSend = Os::TimeInUs(iEnv.OsCtx());
+    app->SendAll(Brn("\"bench\""));
+    Bws<64> body;
+    TUint answered = 0;
+    for (TUint i=0; i<clients.size(); i++) {
+        if (clients[i]->ReadResponse(body) == HttpStatus::kOk.Code() && body == Brn("lp\r\n[\"bench\"]")) {
+            answered++;
+        }
+    }
+    const TUint64 usSend = Os::TimeInUs(iEnv.OsCtx()) - startSend;
+    TEST(answered == iSessions);
+    Log::Print("answered %u/%u polls in %llums (mean %lluus per session)\n",
+               answered, iSessions, (unsigned long long)(usSend / 1000),
+               (unsigned long long)(usSend / (iSessions == 0? 1 : iSessions)));
+
+    for (TUint i=0; i<clients.size(); i++) {
+        delete clients[i];
+    }
+    delete framework;
+}
+
+void SuiteWebAppFrameworkBenchmark::PresentationUrlChanged(const Brx& /*aUrl*/)
+{
+}
+
+void SuiteWebAppFrameworkBenchmark::Report(TUint aSessions)
+{
+#if defined(__linux__)
+    TUint rssKb = 0;
+    TUint threads = 0;
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f != nullptr) {
+        char line[128];
+        while (fgets(line, sizeof line, f) != nullptr) {
+            (void)sscanf(line, "VmRSS: %u kB", &rssKb);
+            (void)sscanf(line, "Threads: %u", &threads);
+        }
+        fclose(f);
+    }
+    Log::Print("sessions=%5u: VmRSS %6ukB, threads %4u\n", aSessions, rssKb, threads);
+#else
+    Log::Print("sessions=%5u\n", aSessions);
+#endif
+}
+
+
+
+void TestWebAppFrameworkBenchmark(Environment& aEnv, const std::vector<Brn>& aArgs)
+{
+    OptionParser parser;
+    OptionUint optionSessions("-s", "--sessions", 500, "Number of concurrent long polling sessions");
+    parser.AddOption(&optionSessions);
+    OptionUint optionReport("-r", "--report", 100, "Report memory use each time this many sessions have been added");
+    parser.AddOption(&optionReport);
+    if (!parser.Parse(aArgs) || parser.HelpDisplayed()) {
+        return;
+    }
+    const TUint sessions = optionSessions.Value() == 0? 1 : optionSessions.Value();
+    const TUint report = optionReport.Value() == 0? 1 : optionReport.Value();
+    Runner runner("WebAppFramework long poll benchmark\n");
+    runner.Add(new SuiteWebAppFrameworkBenchmark(aEnv, sessions, report));
+    runner.Run();
+}
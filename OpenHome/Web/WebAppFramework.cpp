@@ -16,8 +16,14 @@
 #include <OpenHome/Private/NetworkAdapterList.h>
 #include <OpenHome/Configuration/ConfigManager.h>
 
+#include <algorithm>
 #include <limits>
 
+#if defined(__linux__)
+# define WEBAPP_SERVER_EPOLL
+# include <OpenHome/Web/HttpServerEpoll.h>
+#endif
+
 using namespace OpenHome;
 using namespace OpenHome::Configuration;
 using namespace OpenHome::Web;
@@ -52,7 +58,7 @@ void FileResourceHandler::SetResource(const Brx& aUri)
         THROW(ResourceInvalid);
     }
 
-    SetMimeType(aUri);
+    SetMimeType(aUri, iMimeType);
 }
 
 const Brx& FileResourceHandler::MimeType()
@@ -102,6 +108,11 @@ void FileResourceHandler::Write(IWriter& aWriter, TUint aOffset, TUint aBytes)
     }
 }
 
+const CachedResource* FileResourceHandler::Cached()
+{
+    return nullptr;
+}
+
 void FileResourceHandler::Destroy()
 {
     ASSERT(iFile != nullptr);
@@ -110,7 +121,7 @@ void FileResourceHandler::Destroy()
     iMimeType.SetBytes(0);
 }
 
-void FileResourceHandler::SetMimeType(const Brx& aUri)
+void FileResourceHandler::SetMimeType(const Brx& aUri, Bwx& aMimeType)
 {
     // Infer mime type from file extension.
     Parser p(aUri);
@@ -120,29 +131,358 @@ void FileResourceHandler::SetMimeType(const Brx& aUri)
     }
 
     if (Ascii::CaseInsensitiveEquals(buf, Brn("css"))) {
-        iMimeType.Replace(kOhNetMimeTypeCss);
+        aMimeType.Replace(kOhNetMimeTypeCss);
     }
     else if (Ascii::CaseInsensitiveEquals(buf, Brn("js"))) {
-        iMimeType.Replace(kOhNetMimeTypeJs);
+        aMimeType.Replace(kOhNetMimeTypeJs);
     }
     else if (Ascii::CaseInsensitiveEquals(buf, Brn("xml"))) {
-        iMimeType.Replace(kOhNetMimeTypeXml);
+        aMimeType.Replace(kOhNetMimeTypeXml);
     }
     else if (Ascii::CaseInsensitiveEquals(buf, Brn("bmp"))) {
-        iMimeType.Replace(kOhNetMimeTypeBmp);
+        aMimeType.Replace(kOhNetMimeTypeBmp);
     }
     else if (Ascii::CaseInsensitiveEquals(buf, Brn("gif"))) {
-        iMimeType.Replace(kOhNetMimeTypeGif);
+        aMimeType.Replace(kOhNetMimeTypeGif);
     }
     else if (Ascii::CaseInsensitiveEquals(buf, Brn("jpeg"))) {
-        iMimeType.Replace(kOhNetMimeTypeJpeg);
+        aMimeType.Replace(kOhNetMimeTypeJpeg);
     }
     else if (Ascii::CaseInsensitiveEquals(buf, Brn("png"))) {
-        iMimeType.Replace(kOhNetMimeTypePng);
+        aMimeType.Replace(kOhNetMimeTypePng);
     }
     else {  // default to "text/html"
-        iMimeType.Replace(kOhNetMimeTypeHtml);
+        aMimeType.Replace(kOhNetMimeTypeHtml);
+    }
+}
+
+
+// CachedResource
+
+const Brn CachedResource::kHeaderETag("ETag");
+const Brn CachedResource::kHeaderContentEncoding("Content-Encoding");
+const Brn CachedResource::kHeaderVary("Vary");
+const Brn CachedResource::kHeaderIfNoneMatch("If-None-Match");
+const Brn CachedResource::kHeaderAcceptEncoding("Accept-Encoding");
+
+CachedResource::CachedResource(const Brx& aUri, Bwh* aContent)
+    : iUri(aUri)
+{
+    FileResourceHandler::SetMimeType(aUri, iMimeType);
+    for (TUint i=0; i<eEncodingCount; i++) {
+        iContent[i] = nullptr;
+    }
+    SetVariant(eIdentity, aContent);
+}
+
+CachedResource::~CachedResource()
+{
+    for (TUint i=0; i<eEncodingCount; i++) {
+        delete iContent[i];
+    }
+}
+
+void CachedResource::SetVariant(EEncoding aEncoding, Bwh* aContent)
+{
+    ASSERT(aEncoding < eEncodingCount);
+    ASSERT(iContent[aEncoding] == nullptr);
+    iContent[aEncoding] = aContent;
+
+    // Strong validator: FNV-1a hash of this variant's content plus its length.
+    TUint32 hash = 2166136261u;
+    const TByte* ptr = aContent->Ptr();
+    for (TUint i=0; i<aContent->Bytes(); i++) {
+        hash ^= ptr[i];
+        hash *= 16777619u;
+    }
+    Bws<kMaxETagBytes>& etag = iETag[aEncoding];
+    etag.Replace("\"");
+    Ascii::AppendHex(etag, hash);
+    Ascii::AppendHex(etag, aContent->Bytes());
+    etag.Append('\"');
+}
+
+const Brx& CachedResource::Uri() const
+{
+    return iUri;
+}
+
+const Brx& CachedResource::MimeType() const
+{
+    return iMimeType;
+}
+
+TBool CachedResource::HasVariants() const
+{
+    for (TUint i=eIdentity+1; i<eEncodingCount; i++) {
+        if (iContent[i] != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+CachedResource::EEncoding CachedResource::SelectEncoding(const Brx& aAcceptEncoding) const
+{
+    // Prefer the smallest variant the client accepts.
+    EEncoding encoding = eIdentity;
+    for (TUint i=eIdentity+1; i<eEncodingCount; i++) {
+        const Bwh* content = iContent[i];
+        if (content != nullptr && content->Bytes() < Content(encoding).Bytes()
+                && Accepted(aAcceptEncoding, EncodingName((EEncoding)i))) {
+            encoding = (EEncoding)i;
+        }
+    }
+    return encoding;
+}
+
+const Brx& CachedResource::Content(EEncoding aEncoding) const
+{
+    ASSERT(iContent[aEncoding] != nullptr);
+    return *iContent[aEncoding];
+}
+
+const Brx& CachedResource::ETag(EEncoding aEncoding) const
+{
+    ASSERT(iContent[aEncoding] != nullptr);
+    return iETag[aEncoding];
+}
+
+TBool CachedResource::Matches(const Brx& aIfNoneMatch, EEncoding aEncoding) const
+{
+    // If-None-Match uses weak comparison (RFC 7232, 3.2), so ignore any "W/" prefix.
+    const Brx& etag = ETag(aEncoding);
+    Parser p(aIfNoneMatch);
+    while (!p.Finished()) {
+        Brn tag = Ascii::Trim(p.Next(','));
+        if (tag == Brn("*")) {
+            return true;
+        }
+        if (tag.Bytes() > 2 && tag[0] == 'W' && tag[1] == '/') {
+            tag.Set(tag.Ptr() + 2, tag.Bytes() - 2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CachedResource::WriteHeaders(WriterHttpHeader& aWriter, EEncoding aEncoding) const
+{
+    aWriter.WriteHeader(kHeaderETag, ETag(aEncoding));
+    if (aEncoding != eIdentity) {
+        aWriter.WriteHeader(kHeaderContentEncoding, EncodingName(aEncoding));
+    }
+    if (HasVariants()) {
+        // Response depends on Accept-Encoding, so shared caches must key on it.
+        aWriter.WriteHeader(kHeaderVary, kHeaderAcceptEncoding);
+    }
+}
+
+const Brx& CachedResource::EncodingName(EEncoding aEncoding)
+{
+    static const Brn kGzip("gzip");
+    static const Brn kBrotli("br");
+    switch (aEncoding)
+    {
+    case eGzip:
+        return kGzip;
+    case eBrotli:
+        return kBrotli;
+    default:
+        return Brx::Empty();
+    }
+}
+
+TBool CachedResource::Accepted(const Brx& aAcceptEncoding, const Brx& aCoding)
+{
+    // Accept-Encoding: gzip, deflate;q=0.5, br;q=0
+    // A coding is acceptable if listed (or "*" is listed) with a non-zero qvalue.
+    Parser p(aAcceptEncoding);
+    while (!p.Finished()) {
+        Parser entry(p.Next(','));
+        const Brn coding = Ascii::Trim(entry.Next(';'));
+        if (!Ascii::CaseInsensitiveEquals(coding, aCoding) && coding != Brn("*")) {
+            continue;
+        }
+        TBool accepted = true;
+        while (!entry.Finished()) {
+            Parser param(Ascii::Trim(entry.Next(';')));
+            if (Ascii::CaseInsensitiveEquals(Ascii::Trim(param.Next('=')), Brn("q"))) {
+                const Brn qvalue = Ascii::Trim(param.Remaining());
+                accepted = false;
+                for (TUint i=0; i<qvalue.Bytes(); i++) {
+                    if (qvalue[i] >= '1' && qvalue[i] <= '9') {
+                        accepted = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return accepted;
     }
+    return false;
+}
+
+
+// ResourceCache
+
+ResourceCache::ResourceCache(const Brx& aRootDir)
+    : iRootDir(aRootDir)
+    , iLock("RSCL")
+{
+}
+
+ResourceCache::~ResourceCache()
+{
+    for (ResourceMap::iterator it=iResources.begin(); it!=iResources.end(); ++it) {
+        delete it->second;
+    }
+}
+
+const CachedResource& ResourceCache::Get(const Brx& aUri)
+{
+    AutoMutex a(iLock);
+    ResourceMap::const_iterator it = iResources.find(Brn(aUri));
+    if (it != iResources.cend()) {
+        return *(it->second);
+    }
+
+    Bwh* content = Load(aUri, Brx::Empty());
+    if (content == nullptr) {
+        LOG(kHttp, "ResourceCache::Get failed to load resource: %.*s\n", PBUF(aUri));
+        THROW(ResourceInvalid);
+    }
+    CachedResource* resource = new CachedResource(aUri, content);
+    content = Load(aUri, Brn(".gz"));
+    if (content != nullptr) {
+        resource->SetVariant(CachedResource::eGzip, content);
+    }
+    content = Load(aUri, Brn(".br"));
+    if (content != nullptr) {
+        resource->SetVariant(CachedResource::eBrotli, content);
+    }
+    iResources.insert(std::pair<Brn, CachedResource*>(Brn(resource->Uri()), resource));
+    return *resource;
+}
+
+Bwh* ResourceCache::Load(const Brx& aUri, const Brx& aSuffix)
+{
+    Bwh filename(iRootDir.Bytes() + aUri.Bytes() + aSuffix.Bytes() + 1);
+    filename.Replace(iRootDir);
+    filename.Append(aUri);
+    filename.Append(aSuffix);
+
+    Bwh* content = nullptr;
+    try {
+        FileAnsii file(filename.PtrZ(), eFileReadOnly);
+        const TUint bytes = file.Bytes();
+        if (bytes > kMaxResourceBytes) {
+            LOG2(kHttp, kError, "ResourceCache::Load %.*s exceeds %u bytes\n", PBUF(filename), kMaxResourceBytes);
+            return nullptr;
+        }
+        content = new Bwh(bytes);
+        while (content->Bytes() < bytes) {
+            Bwn remaining(content->Ptr() + content->Bytes(), 0, bytes - content->Bytes());
+            file.Read(remaining);
+            if (remaining.Bytes() == 0) {
+                THROW(FileReadError);
+            }
+            content->SetBytes(content->Bytes() + remaining.Bytes());
+        }
+    }
+    catch (FileOpenError&) {
+        return nullptr;
+    }
+    catch (FileReadError&) {
+        LOG2(kHttp, kError, "ResourceCache::Load failed to read %.*s\n", PBUF(filename));
+        delete content;
+        return nullptr;
+    }
+    return content;
+}
+
+
+// CachedResourceHandler
+
+CachedResourceHandler::CachedResourceHandler(ResourceCache& aCache)
+    : iCache(aCache)
+    , iResource(nullptr)
+{
+}
+
+TBool CachedResourceHandler::Allocated()
+{
+    return (iResource != nullptr);
+}
+
+void CachedResourceHandler::SetResource(const Brx& aUri)
+{
+    ASSERT(iResource == nullptr);
+    iResource = &iCache.Get(aUri);  // throws ResourceInvalid
+}
+
+const Brx& CachedResourceHandler::MimeType()
+{
+    ASSERT(iResource != nullptr);
+    return iResource->MimeType();
+}
+
+void CachedResourceHandler::Write(IWriter& aWriter, TUint aOffset, TUint aBytes)
+{
+    ASSERT(iResource != nullptr);
+    const Brx& content = iResource->Content(CachedResource::eIdentity);
+    if (aOffset > content.Bytes()) {
+        THROW(WriterError);
+    }
+    TUint bytes = content.Bytes() - aOffset;
+    if (aBytes != 0 && aBytes < bytes) {    // if aBytes == 0 write whole resource
+        bytes = aBytes;
+    }
+    aWriter.Write(Brn(content.Ptr() + aOffset, bytes));
+}
+
+const CachedResource* CachedResourceHandler::Cached()
+{
+    ASSERT(iResource != nullptr);
+    return iResource;
+}
+
+void CachedResourceHandler::Destroy()
+{
+    ASSERT(iResource != nullptr);
+    iResource = nullptr;
+}
+
+
+// HttpHeaderValue
+
+HttpHeaderValue::HttpHeaderValue(const Brx& aName)
+    : iName(aName)
+{
+}
+
+const Brx& HttpHeaderValue::Value() const
+{
+    return iValue;
+}
+
+void HttpHeaderValue::Reset()
+{
+    HttpHeader::Reset();
+    iValue.SetBytes(0);
+}
+
+TBool HttpHeaderValue::Recognise(const Brx& aHeader)
+{
+    return Ascii::CaseInsensitiveEquals(aHeader, iName);
+}
+
+void HttpHeaderValue::Process(const Brx& aValue)
+{
+    SetReceived();
+    iValue.Replace(Brn(aValue.Ptr(), std::min(aValue.Bytes(), iValue.MaxBytes())));
 }
 
 
@@ -234,6 +574,35 @@ void FrameworkTabHandler::LongPoll(IWriter& aWriter)
     }
 }
 
+TBool FrameworkTabHandler::TryLongPoll(IWriter& aWriter)
+{
+    // Non-blocking equivalent of LongPoll() for servers that park a long poll
+    // rather than block a thread on it. Outputs any msgs already queued.
+    AutoMutex a(iLock);
+    if (!iEnabled) {
+        return true;    // As LongPoll(), complete without writing anything.
+    }
+    if (iFifo.SlotsUsed() == 0) {
+        return false;
+    }
+
+    aWriter.Write(Brn("["));
+    while (iFifo.SlotsUsed() > 0) {
+        ITabMessage* msg = iFifo.Read();
+        msg->Send(aWriter);
+        if (iFifo.SlotsUsed() > 0) {
+            aWriter.Write(Brn(","));
+        }
+        msg->Destroy();
+        iSemWrite.Signal();
+    }
+    aWriter.Write(Brn("]"));
+
+    // Send() signalled iSemRead for each msg output above. Nothing will Wait() for those.
+    (void)iSemRead.Clear();
+    return true;
+}
+
 void FrameworkTabHandler::Disable()
 {
     // Set interrupted state so that no further polls/sends can take place.
@@ -360,6 +729,31 @@ void FrameworkSemaphore::Signal()
 }
 
 
+// FrameworkSemaphoreObservable
+
+FrameworkSemaphoreObservable::FrameworkSemaphoreObservable(const TChar* aName, TUint aCount, ILongPollObserver& aObserver)
+    : iSem(aName, aCount)
+    , iObserver(aObserver)
+{
+}
+
+void FrameworkSemaphoreObservable::Wait()
+{
+    iSem.Wait();
+}
+
+TBool FrameworkSemaphoreObservable::Clear()
+{
+    return iSem.Clear();
+}
+
+void FrameworkSemaphoreObservable::Signal()
+{
+    iSem.Signal();
+    iObserver.NotifyLongPollReady();
+}
+
+
 // FrameworkTab
 
 FrameworkTab::FrameworkTab(TUint aTabId, IFrameworkTimer& aTimer, IFrameworkTabHandler& aTabHandler, TUint aPollTimeoutMs)
@@ -463,6 +857,32 @@ void FrameworkTab::LongPoll(IWriter& aWriter)
     }
 }
 
+TBool FrameworkTab::TryLongPoll(IWriter& aWriter)
+{
+    {
+        AutoMutex a(iLock);
+        if (iTab == nullptr) {
+            // Tab was cleared after caller looked it up. Poll is complete (and there will be no more).
+            return true;
+        }
+        iTimer.Cancel();
+    }
+    if (!iHandler.TryLongPoll(aWriter)) {
+        return false;   // Poll timer stays cancelled until poll is retried or ended.
+    }
+    EndLongPoll();
+    return true;
+}
+
+void FrameworkTab::EndLongPoll()
+{
+    AutoMutex a(iLock);
+    if (iTab != nullptr) {
+        // Tab hasn't been deallocated, so expect another poll.
+        iTimer.Start(iPollTimeoutMs, *this);
+    }
+}
+
 void FrameworkTab::Receive(const Brx& aMessage)
 {
     AutoMutex a(iLock);
@@ -489,8 +909,8 @@ void FrameworkTab::Complete()
 
 // FrameworkTabFull
 
-FrameworkTabFull::FrameworkTabFull(Environment& aEnv, TUint aTabId, TUint aSendQueueSize, TUint aSendTimeoutMs, TUint aPollTimeoutMs)
-    : iSemRead("FTSR", 0)
+FrameworkTabFull::FrameworkTabFull(Environment& aEnv, TUint aTabId, TUint aSendQueueSize, TUint aSendTimeoutMs, TUint aPollTimeoutMs, ILongPollObserver& aPollObserver)
+    : iSemRead("FTSR", 0, aPollObserver)
     , iSemWrite("FTSW", aSendQueueSize)
     , iTabHandlerTimer(aEnv)
     , iTabHandler(iSemRead, iSemWrite, iTabHandlerTimer, aSendQueueSize, aSendTimeoutMs)
@@ -524,6 +944,16 @@ void FrameworkTabFull::LongPoll(IWriter& aWriter)
     iTab.LongPoll(aWriter);
 }
 
+TBool FrameworkTabFull::TryLongPoll(IWriter& aWriter)
+{
+    return iTab.TryLongPoll(aWriter);
+}
+
+void FrameworkTabFull::EndLongPoll()
+{
+    iTab.EndLongPoll();
+}
+
 
 // TabManager
 
@@ -580,26 +1010,23 @@ void TabManager::LongPoll(TUint aId, IWriter& aWriter)
 {
     ASSERT(aId != IFrameworkTab::kInvalidTabId);
     LOG(kHttp, "TabManager::LongPoll aId: %u\n", aId);
-    IFrameworkTab* tab = nullptr;
-    {
-        AutoMutex a(iLock);
-        if (!iEnabled) {
-            THROW(InvalidTabId);
-        }
-
-        for (TUint i=0; i<iTabs.size(); i++) {
-            if (iTabs[i]->SessionId() == aId) {
-                tab = iTabs[i];
-                break;
-            }
-        }
-    }
-    if (tab == nullptr) {
-        THROW(InvalidTabId);
-    }
+    IFrameworkTab& tab = Tab(aId);
     // FIXME - race condition. As lock is released before this call, tab could potentially have been Destroy()ed and then re-assigned to a new tab before the LongPoll() call.
     // Maybe have reference counting on FrameworkTabs to avoid that, or set flag to show tab is currently being long-polled and shouldn't be destroyed until the long-poll is complete. Is the latter just a limited form of reference counting?
-    tab->LongPoll(aWriter);
+    tab.LongPoll(aWriter);
+}
+
+TBool TabManager::TryLongPoll(TUint aId, IWriter& aWriter)
+{
+    ASSERT(aId != IFrameworkTab::kInvalidTabId);
+    LOG(kHttp, "TabManager::TryLongPoll aId: %u\n", aId);
+    return Tab(aId).TryLongPoll(aWriter);   // Same race as LongPoll() above, but FrameworkTab tolerates its tab having been cleared.
+}
+
+void TabManager::EndLongPoll(TUint aId)
+{
+    ASSERT(aId != IFrameworkTab::kInvalidTabId);
+    Tab(aId).EndLongPoll();
 }
 
 void TabManager::Receive(TUint aId, const Brx& aMessage)
@@ -644,6 +1071,21 @@ void TabManager::Destroy(TUint aId)
     THROW(InvalidTabId);
 }
 
+IFrameworkTab& TabManager::Tab(TUint aId)
+{
+    AutoMutex a(iLock);
+    if (!iEnabled) {
+        THROW(InvalidTabId);
+    }
+
+    for (TUint i=0; i<iTabs.size(); i++) {
+        if (iTabs[i]->SessionId() == aId) {
+            return *iTabs[i];
+        }
+    }
+    THROW(InvalidTabId);
+}
+
 
 // WebAppFramework::BrxPtrCmp
 
@@ -698,23 +1140,25 @@ WebAppFramework::WebAppFramework(Environment& aEnv, TIpAddress aInterface, TUint
     , iPollTimer(iEnv)
     , iPort(aPort)
     , iMaxLpSessions(aMaxSessions)
+    , iSendTimeoutMs(aSendTimeoutMs)
+    , iServer(nullptr)
+    , iLockPollObserver("WAFL")
+    , iPollObserver(nullptr)
     , iStarted(false)
     , iCurrentAdapter(nullptr)
 {
     std::vector<IFrameworkTab*> tabs;
     for (TUint i=0; i<iMaxLpSessions; i++) {
-        tabs.push_back(new FrameworkTabFull(aEnv, i, aSendQueueSize, aSendTimeoutMs, aPollTimeoutMs));
+        tabs.push_back(new FrameworkTabFull(aEnv, i, aSendQueueSize, aSendTimeoutMs, aPollTimeoutMs, *this));
     }
     iTabManager = new TabManager(tabs); // Takes ownership.
-    iServer = new SocketTcpServer(iEnv, kName, iPort, aInterface);
+    iServer = CreateServer(aInterface);
 
     Functor functor = MakeFunctor(*this, &WebAppFramework::CurrentAdapterChanged);
     NetworkAdapterList& nifList = iEnv.NetworkAdapterList();
     iAdapterListenerId = nifList.AddCurrentChangeListener(functor, false);
 
     CurrentAdapterChanged();    // Force to set iCurrentAdapter, as not called at point of subscription.
-
-    AddSessions();
 }
 
 WebAppFramework::~WebAppFramework()
@@ -730,7 +1174,7 @@ WebAppFramework::~WebAppFramework()
     iTabManager->Disable();
 
     // Don't allow any more web requests.
-    delete iServer;
+    DestroyServer();
 
     // Delete TabManager before WebApps to allow it to free up any WebApp tabs that it may hold reference for.
     delete iTabManager;
@@ -821,16 +1265,37 @@ IResourceHandler& WebAppFramework::CreateResourceHandler(const Brx& aResource)
     return app.CreateResourceHandler(tail);
 }
 
-void WebAppFramework::AddSessions()
+void WebAppFramework::NotifyLongPollReady()
 {
-    // Add iMaxLpSessions+kSpareSessions to create spare session(s) for when
-    // iMaxLpSessions are in use to allow processing of user input and
-    // rejection of new connections.
-    for (TUint i=0; i<iMaxLpSessions+kSpareSessions; i++) {
-        Bws<kMaxSessionNameBytes> name(kSessionPrefix);
-        Ascii::AppendDec(name, i+1);
-        iServer->Add(name.PtrZ(), new HttpSession(iEnv, *this, *iTabManager, *this));
+    AutoMutex a(iLockPollObserver);
+    if (iPollObserver != nullptr) {
+        iPollObserver->NotifyLongPollReady();
+    }
+}
+
+IServer* WebAppFramework::CreateServer(TIpAddress aInterface)
+{
+#ifdef WEBAPP_SERVER_EPOLL
+    // Long polls are parked rather than each blocking a thread, so allow for
+    // every tab's long poll plus another connection for its updates.
+    HttpServerEpoll* server = new HttpServerEpoll(iEnv, kName, aInterface, iPort, 2*iMaxLpSessions + HttpServerEpoll::kSpareConnections,
+                                                  iSendTimeoutMs, *this, *iTabManager, *this);
+    AutoMutex a(iLockPollObserver);
+    iPollObserver = server;
+    return server;
+#else
+    return new HttpServerThreaded(iEnv, kName, aInterface, iPort, iMaxLpSessions, *this, *iTabManager, *this);
+#endif
+}
+
+void WebAppFramework::DestroyServer()
+{
+    {
+        AutoMutex a(iLockPollObserver);
+        iPollObserver = nullptr;
     }
+    delete iServer;
+    iServer = nullptr;
 }
 
 void WebAppFramework::CurrentAdapterChanged()
@@ -859,20 +1324,53 @@ void WebAppFramework::CurrentAdapterChanged()
 
     // Don't rebind if we have nothing to rebind to - should this ever be the case?
     //if (current != nullptr) {
-        delete iServer;
+        DestroyServer();
         // FIXME - bind only to current adapter or all adapters?
-        iServer = new SocketTcpServer(iEnv, kName, iPort, current->Address());
-        AddSessions();
+        iServer = CreateServer(current->Address());
     //}
 }
 
 
+// HttpServerThreaded
+
+HttpServerThreaded::HttpServerThreaded(Environment& aEnv, const TChar* aName, TIpAddress aInterface, TUint aPort, TUint aMaxLpSessions,
+                                       IWebAppManager& aAppManager, ITabManager& aTabManager, IResourceManager& aResourceManager)
+{
+    iServer = new SocketTcpServer(aEnv, aName, aPort, aInterface);
+    // Add aMaxLpSessions+kSpareSessions to create spare session(s) for when
+    // aMaxLpSessions are in use to allow processing of user input and
+    // rejection of new connections.
+    for (TUint i=0; i<aMaxLpSessions+kSpareSessions; i++) {
+        Bws<kMaxSessionNameBytes> name(WebAppFramework::kSessionPrefix);
+        Ascii::AppendDec(name, i+1);
+        iServer->Add(name.PtrZ(), new HttpSession(aEnv, aAppManager, aTabManager, aResourceManager));
+    }
+}
+
+HttpServerThreaded::~HttpServerThreaded()
+{
+    delete iServer;
+}
+
+TUint HttpServerThreaded::Port() const
+{
+    return iServer->Port();
+}
+
+TIpAddress HttpServerThreaded::Interface() const
+{
+    return iServer->Interface();
+}
+
+
 // HttpSession
 
 HttpSession::HttpSession(Environment& aEnv, IWebAppManager& aAppManager, ITabManager& aTabManager, IResourceManager& aResourceManager)
     : iAppManager(aAppManager)
     , iTabManager(aTabManager)
     , iResourceManager(aResourceManager)
+    , iHeaderIfNoneMatch(CachedResource::kHeaderIfNoneMatch)
+    , iHeaderAcceptEncoding(CachedResource::kHeaderAcceptEncoding)
     , iResponseStarted(false)
     , iResponseEnded(false)
     , iResourceWriterHeadersOnly(false)
@@ -895,6 +1393,8 @@ HttpSession::HttpSession(Environment& aEnv, IWebAppManager& aAppManager, ITabMan
     iReaderRequest->AddHeader(iHeaderTransferEncoding);
     iReaderRequest->AddHeader(iHeaderConnection);
     iReaderRequest->AddHeader(iHeaderAcceptLanguage);
+    iReaderRequest->AddHeader(iHeaderIfNoneMatch);
+    iReaderRequest->AddHeader(iHeaderAcceptEncoding);
 }
 
 HttpSession::~HttpSession()
@@ -1009,11 +1509,29 @@ void HttpSession::Get()
     // Should certainly NOT return a 200 OK!
     // Also, should it be possible to send long poll requests via GETs?
     iResponseStarted = true;
+    const CachedResource* cached = resourceHandler.Cached();
+    CachedResource::EEncoding encoding = CachedResource::eIdentity;
+    if (cached != nullptr) {
+        encoding = cached->SelectEncoding(iHeaderAcceptEncoding.Value());
+        if (iHeaderIfNoneMatch.Received() && cached->Matches(iHeaderIfNoneMatch.Value(), encoding)) {
+            iWriterResponse->WriteStatus(HttpStatus::kNotModified, Http::eHttp11);
+            cached->WriteHeaders(*iWriterResponse, encoding);
+            iWriterResponse->WriteHeader(Http::kHeaderConnection, Http::kConnectionClose);
+            iWriterResponse->WriteFlush();
+            resourceHandler.Destroy();
+            iResponseEnded = true;
+            return;
+        }
+    }
     iWriterResponse->WriteStatus(HttpStatus::kOk, Http::eHttp11);
     IWriterAscii& writer = iWriterResponse->WriteHeaderField(Http::kHeaderContentType);
     writer.Write(resourceHandler.MimeType());
     //writer.Write(Brn("; charset=\"utf-8\""));
     writer.WriteFlush();
+    if (cached != nullptr) {
+        cached->WriteHeaders(*iWriterResponse, encoding);
+        Http::WriteHeaderContentLength(*iWriterResponse, cached->Content(encoding).Bytes());
+    }
     iWriterResponse->WriteHeader(Http::kHeaderConnection, Http::kConnectionClose);
     //WriteServerHeader(*iWriterResponse);
     //if (iReaderRequest->Version() == Http::eHttp11) {
@@ -1022,7 +1540,12 @@ void HttpSession::Get()
     iWriterResponse->WriteFlush();
 
     // Write content.
-    resourceHandler.Write(*iWriterBuffer, 0, 0);
+    if (cached != nullptr) {
+        iWriterBuffer->Write(cached->Content(encoding));
+    }
+    else {
+        resourceHandler.Write(*iWriterBuffer, 0, 0);
+    }
     iWriterBuffer->WriteFlush(); // FIXME - move into iResourceWriter.Write()?
     resourceHandler.Destroy();
     iResponseEnded = true;
@@ -7,8 +7,11 @@
 #include <OpenHome/Private/Fifo.h>
 #include <OpenHome/Private/File.h>
 #include <OpenHome/Private/Stream.h>
+#include <OpenHome/Private/Thread.h>
 #include <OpenHome/Net/Private/DviServerUpnp.h>
 
+#include <map>
+
 EXCEPTION(ResourceInvalid);
 EXCEPTION(TabAllocatorFull);    // Thrown by an IWebApp when its allocator is full.
 EXCEPTION(TabManagerFull);
@@ -22,6 +25,8 @@ namespace OpenHome {
 
 namespace Web {
 
+class CachedResource;
+
 class IResourceHandler
 {
 public:
@@ -29,6 +34,7 @@ public:
 public:
     virtual const OpenHome::Brx& MimeType() = 0;
     virtual void Write(OpenHome::IWriter& aWriter, TUint aOffset, TUint aBytes) = 0;    // THROWS WriterError
+    virtual const CachedResource* Cached() = 0; // nullptr unless resource is held in memory by a ResourceCache
     virtual void Destroy() = 0;
     virtual ~IResourceHandler() {}
 };
@@ -53,15 +59,123 @@ public:
 public : // from IResourceHandler
     const OpenHome::Brx& MimeType();
     void Write(OpenHome::IWriter& aWriter, TUint aOffset, TUint aBytes);
+    const CachedResource* Cached();
     void Destroy();
-private:
-    void SetMimeType(const OpenHome::Brx& aUri);
+public:
+    static void SetMimeType(const OpenHome::Brx& aUri, OpenHome::Bwx& aMimeType);
 private:
     OpenHome::Brh iRootDir;
     OpenHome::FileAnsii* iFile;
     OpenHome::Bws<kMaxMimeTypeBytes> iMimeType;
 };
 
+/**
+ * A static resource held in memory by a ResourceCache. Immutable once loaded.
+ *
+ * As well as the resource itself, holds any precompressed variants that were
+ * installed beside it (i.e., <resource>.br and <resource>.gz). Each variant
+ * has its own strong ETag.
+ */
+class CachedResource : private OpenHome::INonCopyable
+{
+public:
+    enum EEncoding
+    {
+        eIdentity,
+        eGzip,
+        eBrotli,
+        eEncodingCount
+    };
+    static const TUint kMaxETagBytes = 20;  // "<8 hex digit hash><8 hex digit length>"
+    static const OpenHome::Brn kHeaderETag;
+    static const OpenHome::Brn kHeaderContentEncoding;
+    static const OpenHome::Brn kHeaderVary;
+    static const OpenHome::Brn kHeaderIfNoneMatch;
+    static const OpenHome::Brn kHeaderAcceptEncoding;
+public:
+    CachedResource(const OpenHome::Brx& aUri, OpenHome::Bwh* aContent); // Takes ownership of aContent.
+    ~CachedResource();
+    void SetVariant(EEncoding aEncoding, OpenHome::Bwh* aContent);      // Takes ownership of aContent.
+    const OpenHome::Brx& Uri() const;
+    const OpenHome::Brx& MimeType() const;
+    TBool HasVariants() const;
+    EEncoding SelectEncoding(const OpenHome::Brx& aAcceptEncoding) const;
+    const OpenHome::Brx& Content(EEncoding aEncoding) const;
+    const OpenHome::Brx& ETag(EEncoding aEncoding) const;
+    TBool Matches(const OpenHome::Brx& aIfNoneMatch, EEncoding aEncoding) const;
+    void WriteHeaders(OpenHome::WriterHttpHeader& aWriter, EEncoding aEncoding) const; // ETag, Content-Encoding, Vary
+    static const OpenHome::Brx& EncodingName(EEncoding aEncoding);  // Empty for eIdentity.
+private:
+    static TBool Accepted(const OpenHome::Brx& aAcceptEncoding, const OpenHome::Brx& aCoding);
+private:
+    OpenHome::Brh iUri;
+    OpenHome::Bws<IResourceHandler::kMaxMimeTypeBytes> iMimeType;
+    OpenHome::Bwh* iContent[eEncodingCount];
+    OpenHome::Bws<kMaxETagBytes> iETag[eEncodingCount];
+};
+
+/**
+ * Loads static resources from aRootDir on first request and retains them for
+ * the lifetime of the cache, so each file is read from (flash) storage once
+ * rather than on every request.
+ *
+ * Resources are never evicted. References returned by Get() remain valid until
+ * the cache is destroyed.
+ */
+class ResourceCache : private OpenHome::INonCopyable
+{
+    static const TUint kMaxResourceBytes = 4 * 1024 * 1024;
+public:
+    ResourceCache(const OpenHome::Brx& aRootDir);
+    ~ResourceCache();
+    const CachedResource& Get(const OpenHome::Brx& aUri);   // THROWS ResourceInvalid
+private:
+    OpenHome::Bwh* Load(const OpenHome::Brx& aUri, const OpenHome::Brx& aSuffix);   // Returns nullptr if file doesn't exist.
+private:
+    typedef std::map<OpenHome::Brn, CachedResource*, OpenHome::BufferCmp> ResourceMap;
+    OpenHome::Brh iRootDir;
+    OpenHome::Mutex iLock;
+    ResourceMap iResources;
+};
+
+/**
+ * Alternative to FileResourceHandler that serves resources from a (shared)
+ * ResourceCache.
+ */
+class CachedResourceHandler : public IResourceHandler, private OpenHome::INonCopyable
+{
+public:
+    CachedResourceHandler(ResourceCache& aCache);
+    TBool Allocated();
+    void SetResource(const OpenHome::Brx& aUri);    // THROWS ResourceInvalid
+public: // from IResourceHandler
+    const OpenHome::Brx& MimeType() override;
+    void Write(OpenHome::IWriter& aWriter, TUint aOffset, TUint aBytes) override;
+    const CachedResource* Cached() override;
+    void Destroy() override;
+private:
+    ResourceCache& iCache;
+    const CachedResource* iResource;
+};
+
+/**
+ * Retains the (possibly truncated) value of a single named request header.
+ */
+class HttpHeaderValue : public OpenHome::HttpHeader
+{
+    static const TUint kMaxValueBytes = 256;
+public:
+    HttpHeaderValue(const OpenHome::Brx& aName);
+    const OpenHome::Brx& Value() const;
+    void Reset() override;
+private: // from HttpHeader
+    TBool Recognise(const OpenHome::Brx& aHeader) override;
+    void Process(const OpenHome::Brx& aValue) override;
+private:
+    const OpenHome::Brn iName;
+    OpenHome::Bws<kMaxValueBytes> iValue;
+};
+
 
 // Interfaces and abstract classes relevant to clients wishing to make use of
 // the HttpFramework.
@@ -155,12 +269,25 @@ public:
     virtual ~IFrameworkSemaphore() {}
 };
 
+/**
+ * Told whenever msgs are queued for any tab. Lets a server that parks long
+ * polls (rather than blocking a thread on each) know when to retry them.
+ * May be called with tab locks held so must not block.
+ */
+class ILongPollObserver
+{
+public:
+    virtual void NotifyLongPollReady() = 0;
+    virtual ~ILongPollObserver() {}
+};
+
 class IFrameworkTabHandler : public ITabHandler
 {
 public: // from ITabHandler
     virtual void Send(ITabMessage& aMessage) = 0;
 public:
     virtual void LongPoll(IWriter& aWriter) = 0;    // THROWS WriterError.
+    virtual TBool TryLongPoll(IWriter& aWriter) = 0; // Non-blocking. Returns false if no msgs queued (and nothing written). THROWS WriterError.
     virtual void Enable() = 0;
     virtual void Disable() = 0; // Disallow LongPoll()/Send() calls.
     virtual ~IFrameworkTabHandler() {}
@@ -177,6 +304,7 @@ public:
 private: // from IFrameworkTabHandler
     void Send(ITabMessage& aMessage) override;
     void LongPoll(IWriter& aWriter) override;
+    TBool TryLongPoll(IWriter& aWriter) override;
     void Enable() override;  // Allow new polls/sends to take place.
     void Disable() override; // Cancel blocking send and clear FIFO.
 private: // from IFrameworkTimerHandler
@@ -227,6 +355,22 @@ private:
     Semaphore iSem;
 };
 
+/**
+ * FrameworkSemaphore that reports each Signal() to an ILongPollObserver.
+ */
+class FrameworkSemaphoreObservable : public IFrameworkSemaphore
+{
+public:
+    FrameworkSemaphoreObservable(const TChar* aName, TUint aCount, ILongPollObserver& aObserver);
+public: // from IFrameworkSemaphore
+    void Wait() override;
+    TBool Clear() override;
+    void Signal() override;
+private:
+    FrameworkSemaphore iSem;
+    ILongPollObserver& iObserver;
+};
+
 class IFrameworkTab
 {
 public:
@@ -237,6 +381,8 @@ public:
     virtual void Clear() = 0;   // Terminates any blocking sends or outstanding timers.
     virtual void Receive(const Brx& aMessage) = 0;
     virtual void LongPoll(IWriter& aWriter) = 0;    // Terminates poll timer on entry; restarts poll timer on exit.
+    virtual TBool TryLongPoll(IWriter& aWriter) = 0; // Terminates poll timer on entry; only restarts it if poll completed (i.e., returns true).
+    virtual void EndLongPoll() = 0; // Restarts poll timer after a TryLongPoll() that returned false.
     virtual ~IFrameworkTab() {}
 };
 
@@ -255,6 +401,8 @@ public: // from IFrameworkTab
     void Clear() override;   // Terminates any blocking sends or outstanding timers.
     void Receive(const Brx& aMessage) override;
     void LongPoll(IWriter& aWriter) override;    // Terminates poll timer on entry; restarts poll timer on exit.
+    TBool TryLongPoll(IWriter& aWriter) override;
+    void EndLongPoll() override;
 private: // from ITabHandler
     void Send(ITabMessage& aMessage);
 private: // from IFrameworkTimerHandler
@@ -278,15 +426,17 @@ private:
 class FrameworkTabFull : public IFrameworkTab
 {
 public:
-    FrameworkTabFull(Environment& aEnv, TUint aTabId, TUint aSendQueueSize, TUint aSendTimeoutMs, TUint aPollTimeoutMs);
+    FrameworkTabFull(Environment& aEnv, TUint aTabId, TUint aSendQueueSize, TUint aSendTimeoutMs, TUint aPollTimeoutMs, ILongPollObserver& aPollObserver);
 public: // from IFrameworkTab
     TUint SessionId() const override;
     void CreateTab(TUint aSessionId, ITabCreator& aTabCreator, ITabDestroyHandler& aDestroyHandler, const std::vector<const Brx*>& aLanguages) override;
     void Clear() override;
     void Receive(const Brx& aMessage) override;
     void LongPoll(IWriter& aWriter) override;
+    TBool TryLongPoll(IWriter& aWriter) override;
+    void EndLongPoll() override;
 private:
-    FrameworkSemaphore iSemRead;
+    FrameworkSemaphoreObservable iSemRead;
     FrameworkSemaphore iSemWrite;
     FrameworkTimer iTabHandlerTimer;
     FrameworkTabHandler iTabHandler;
@@ -306,6 +456,8 @@ public:
 
     // Following calls may all throw InvalidTabId.
     virtual void LongPoll(TUint aId, IWriter& aWriter) = 0;  // Will block until something is written or poll timeout.
+    virtual TBool TryLongPoll(TUint aId, IWriter& aWriter) = 0; // Non-blocking. If this returns false, must be followed by another TryLongPoll() or EndLongPoll().
+    virtual void EndLongPoll(TUint aId) = 0;
     virtual void Receive(TUint aId, const Brx& aMessage) = 0;
     virtual ~ITabManager() {}
 };
@@ -319,8 +471,12 @@ public:
 public: // from ITabManager
     TUint CreateTab(ITabCreator& aTabCreator, const std::vector<const Brx*>& aLanguageList);
     void LongPoll(TUint aId, IWriter& aWriter) override;
+    TBool TryLongPoll(TUint aId, IWriter& aWriter) override;
+    void EndLongPoll(TUint aId) override;
     void Receive(TUint aId, const Brx& aMessage) override;
     void Destroy(TUint aId) override;
+private:
+    IFrameworkTab& Tab(TUint aId);  // THROWS InvalidTabId
 private:
     const std::vector<IFrameworkTab*> iTabs;
     TUint iNextSessionId;
@@ -371,14 +527,12 @@ private:
 };
 
 // FIXME - handle redirects from "/" to "/index.html"? - job of resource handler
-class WebAppFramework : public IWebAppFramework, public IWebAppManager, public IResourceManager, public IServer
+class WebAppFramework : public IWebAppFramework, public IWebAppManager, public IResourceManager, public IServer, private ILongPollObserver
 {
 public:
     static const TChar* kName;
     static const TChar* kAdapterCookie;
     static const Brn kSessionPrefix;
-private:
-    static const TUint kMaxSessionNameBytes = 32;  // Should be capable of storing string of form kSessionPrefix + ID (0-99) + '\0', e.g., "WebUiSession01\0".
 private:
     class BrxPtrCmp
     {
@@ -386,9 +540,6 @@ private:
         TBool operator()(const Brx* aStr1, const Brx* aStr2) const;
     };
 private:
-    // Spare session(s) for receiving user input and rejecting new long polling
-    // connections when iMaxLpSessions in use.
-    static const TUint kSpareSessions = 1;
     typedef std::pair<const OpenHome::Brx*,WebAppInternal*> WebAppPair;
     typedef std::map<const OpenHome::Brx*,WebAppInternal*, BrxPtrCmp> WebAppMap;
 public:
@@ -405,16 +556,22 @@ private: // from IResourceManager
 public: // from IServer
     TUint Port() const;
     TIpAddress Interface() const;
+private: // from ILongPollObserver
+    void NotifyLongPollReady() override;
 private:
-    void AddSessions();
+    IServer* CreateServer(TIpAddress aInterface);
+    void DestroyServer();
     void CurrentAdapterChanged();
 private:
     OpenHome::Environment& iEnv;
     FrameworkTimer iPollTimer; // FIXME  remove
     const TUint iPort;
     const TUint iMaxLpSessions;
+    const TUint iSendTimeoutMs;
     TUint iAdapterListenerId;
-    OpenHome::SocketTcpServer* iServer;
+    IServer* iServer;
+    Mutex iLockPollObserver;
+    ILongPollObserver* iPollObserver;   // iServer, if it parks long polls
     TabManager* iTabManager;    // Should there be one tab manager for ALL apps, or one TabManager per app? (And, similarly, one set of server sessions for all apps, or a set of server sessions per app? Also, need at least one extra session for receiving (and declining) additional long polling requests.)
 
     // FIXME - what if this is created with a max of 4 tabs and an app is added that is only capable of creating 3 apps and 4 clients try to load apps?
@@ -424,6 +581,28 @@ private:
     NetworkAdapter* iCurrentAdapter;
 };
 
+/**
+ * Server with one thread (HttpSession) per connection. Each long poll blocks
+ * its session until it completes.
+ */
+class HttpServerThreaded : public IServer, private INonCopyable
+{
+private:
+    static const TUint kMaxSessionNameBytes = 32;  // Should be capable of storing string of form kSessionPrefix + ID (0-99) + '\0', e.g., "WebUiSession01\0".
+    // Spare session(s) for receiving user input and rejecting new long polling
+    // connections when aMaxLpSessions in use.
+    static const TUint kSpareSessions = 1;
+public:
+    HttpServerThreaded(Environment& aEnv, const TChar* aName, TIpAddress aInterface, TUint aPort, TUint aMaxLpSessions,
+                       IWebAppManager& aAppManager, ITabManager& aTabManager, IResourceManager& aResourceManager);
+    ~HttpServerThreaded();
+public: // from IServer
+    TUint Port() const override;
+    TIpAddress Interface() const override;
+private:
+    SocketTcpServer* iServer;
+};
+
 /**
  * HttpSession that handles serving files (via GET), processing POST requests
  * and allows long polling.
@@ -463,6 +642,8 @@ private:
     OpenHome::HttpHeaderTransferEncoding iHeaderTransferEncoding;
     OpenHome::HttpHeaderConnection iHeaderConnection;
     Net::HeaderAcceptLanguage iHeaderAcceptLanguage;
+    HttpHeaderValue iHeaderIfNoneMatch;
+    HttpHeaderValue iHeaderAcceptEncoding;
     const OpenHome::HttpStatus* iErrorStatus;
     TBool iResponseStarted;
     TBool iResponseEnded;